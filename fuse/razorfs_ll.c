@@ -0,0 +1,1181 @@
+/**
+ * RAZORFS Low-Level FUSE Implementation
+ *
+ * Inode-based front end over the same core as fuse/razorfs_mt.c:
+ * - Requests carry inode numbers (FUSE ino = node inode, root = FUSE_ROOT_ID),
+ *   resolved with nary_inode_lookup_mt; names are looked up one component
+ *   at a time in the parent, never as full paths
+ * - lookup hands the kernel the inode number; forget has nothing to drop,
+ *   since nodes live in the tree until unlinked, not until forgotten
+ * - Node indices move on rebalance, inode numbers never do
+ * - Snapshots show read-only under /.snapshots, with inode numbers of
+ *   their own (see LL_SNAP_INO); so do the statistics under /.razorfs
+ *   (see LL_STATS_INO)
+ */
+
+#define FUSE_USE_VERSION 31
+
+#include <fuse3/fuse_lowlevel.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include <linux/limits.h>
+
+#include "../src/nary_tree_mt.h"
+#include "../src/fs_core.h"
+#include "../src/metrics.h"
+
+/* How long the kernel may cache entries and attributes without -o cache (seconds) */
+#define LL_ENTRY_TIMEOUT  1.0
+#define LL_ATTR_TIMEOUT   1.0
+
+/* Mount options (-o name=value) */
+static struct fs_core_options g_ll_opts = FS_CORE_OPTIONS_DEFAULT;
+
+#define RAZORFS_OPT(t, p) { t, offsetof(struct fs_core_options, p), 1 }
+static const struct fuse_opt razorfs_ll_opts[] = {
+    RAZORFS_OPT("compress_threads=%u", compress_threads),
+    RAZORFS_OPT("compress_idle_ms=%u", compress_idle_ms),
+    RAZORFS_OPT("writeback_ms=%u", writeback_ms),
+    RAZORFS_OPT("cache", kernel_cache),
+    RAZORFS_OPT("cache_timeout=%lf", cache_timeout),
+    RAZORFS_OPT("io_size=%u", io_size),
+    RAZORFS_OPT("numa=%s", numa_policy),
+    RAZORFS_OPT("hugepages=%s", hugepages),
+    RAZORFS_OPT("prefetch=%u", prefetch),
+    RAZORFS_OPT("rebalance_ms=%u", rebalance_ms),
+    RAZORFS_OPT("memory_mb=%u", memory_mb),
+    RAZORFS_OPT("tier_dir=%s", tier_dir),
+    RAZORFS_OPT("tier_cold_s=%u", tier_cold_s),
+    RAZORFS_OPT("tier_cache=%s", tier_cache_dir),
+    RAZORFS_OPT("tier_cache_mb=%u", tier_cache_mb),
+    RAZORFS_OPT("dedup", dedup),
+    RAZORFS_OPT("durability=%s", durability),
+    RAZORFS_OPT("wal_dirs=%s", wal_dirs),
+    RAZORFS_OPT("wal_segments=%u", wal_segments),
+    RAZORFS_OPT("wal_segment_mb=%u", wal_segment_mb),
+    RAZORFS_OPT("wal_data", wal_data),
+    RAZORFS_OPT("io_engine=%s", io_engine),
+    RAZORFS_OPT("metrics=%s", metrics),
+    FUSE_OPT_END
+};
+
+/* Global filesystem state */
+static struct fs_core g_ll_fs;
+static struct fuse_session *g_ll_se;     /* For cache invalidation notices */
+static double g_ll_entry_timeout = LL_ENTRY_TIMEOUT;
+static double g_ll_attr_timeout = LL_ATTR_TIMEOUT;
+
+/* === Helper Functions === */
+
+/* Current node index of an inode number */
+static uint32_t ino_to_idx(fuse_ino_t ino) {
+    if (ino == FUSE_ROOT_ID) return NARY_ROOT_IDX;
+    if (ino > UINT32_MAX) return NARY_INVALID_IDX;
+    return nary_inode_lookup_mt(&g_ll_fs.tree, (uint32_t)ino);
+}
+
+/* Inode number the kernel knows a node by */
+static fuse_ino_t node_ino(const struct nary_node *node) {
+    return node->parent_idx == NARY_INVALID_IDX ? FUSE_ROOT_ID : node->inode;
+}
+
+static void fill_entry(const struct nary_node *node, struct fuse_entry_param *e) {
+    memset(e, 0, sizeof(*e));
+    e->ino = node_ino(node);
+    e->generation = 1;           /* Inode numbers are never reused */
+    fs_core_stat(node, &e->attr);
+    e->attr.st_ino = e->ino;
+    e->attr_timeout = g_ll_attr_timeout;
+    e->entry_timeout = g_ll_entry_timeout;
+}
+
+/* Child of a directory inode, or -errno */
+static int lookup_child(fuse_ino_t parent, const char *name, uint32_t *idx_out) {
+    uint32_t parent_idx = ino_to_idx(parent);
+    if (parent_idx == NARY_INVALID_IDX) return -ENOENT;
+    if (strnlen(name, MAX_FILENAME_LENGTH) >= MAX_FILENAME_LENGTH) return -ENAMETOOLONG;
+
+    uint32_t idx = nary_find_child_mt(&g_ll_fs.tree, parent_idx, name);
+    if (idx == NARY_INVALID_IDX) return -ENOENT;
+
+    *idx_out = idx;
+    return 0;
+}
+
+/*
+ * Snapshot inode numbers: LL_SNAP_DIR_INO for /.snapshots, LL_SNAP_INO for
+ * a node of a snapshot. Live inode numbers fit in 32 bits, so the high half
+ * tells them apart.
+ */
+#define LL_SNAP_DIR_INO         ((fuse_ino_t)FS_CORE_SNAPSHOT_DIR_INODE << 32)
+#define LL_SNAP_INO(id, inode)  (((fuse_ino_t)(id) << 32) | (uint32_t)(inode))
+#define LL_IS_SNAP_INO(ino)     ((ino) > UINT32_MAX)
+
+/*
+ * Statistics inode numbers: /.razorfs and its files (see
+ * fs_core_stats_node), above the snapshot ones. Test before LL_IS_SNAP_INO.
+ */
+#define LL_STATS_INO(file)      (((fuse_ino_t)FS_CORE_STATS_DIR_INODE << 32) | (uint32_t)(file))
+#define LL_IS_STATS_INO(ino)    ((ino) >> 32 == FS_CORE_STATS_DIR_INODE && \
+                                 (uint32_t)(ino) < FS_CORE_STATS_FILES)
+#define LL_STATS_FILE(ino)      ((enum fs_core_stats_file)(uint32_t)(ino))
+
+/* Entry of /.razorfs or one of its files; contents change on every read */
+static void fill_stats_entry(enum fs_core_stats_file file, struct fuse_entry_param *e) {
+    struct nary_node node;
+    fs_core_stats_node(&g_ll_fs, file, &node);
+    fill_entry(&node, e);
+    e->ino = LL_STATS_INO(file);
+    e->attr.st_ino = e->ino;
+    e->attr_timeout = 0;
+}
+
+/* Snapshot and node of a snapshot inode number (*id_out 0: /.snapshots) */
+static int snap_ino_to_idx(fuse_ino_t ino, uint32_t *id_out, uint32_t *idx_out) {
+    *id_out = 0;
+    *idx_out = NARY_INVALID_IDX;
+    if (ino == LL_SNAP_DIR_INO) return 0;
+
+    uint32_t id = (uint32_t)(ino >> 32);
+    uint32_t inode = (uint32_t)ino;
+    uint32_t idx;
+    if (inode == FUSE_ROOT_ID) {
+        /* The root does not move; the snapshot may be gone */
+        struct nary_node root;
+        idx = nary_snapshot_read_node_mt(&g_ll_fs.tree, id, NARY_ROOT_IDX, &root) == 0 ?
+              NARY_ROOT_IDX : NARY_INVALID_IDX;
+    } else {
+        idx = nary_snapshot_inode_lookup_mt(&g_ll_fs.tree, id, inode);
+    }
+    if (idx == NARY_INVALID_IDX) return -ENOENT;
+
+    *id_out = id;
+    *idx_out = idx;
+    return 0;
+}
+
+/* Entry of a node of snapshot id, or of /.snapshots for id 0 */
+static void fill_snap_entry(uint32_t id, const struct nary_node *node,
+                            struct fuse_entry_param *e) {
+    fill_entry(node, e);
+    e->ino = id ? LL_SNAP_INO(id, node->inode) : LL_SNAP_DIR_INO;
+    e->attr.st_ino = e->ino;
+}
+
+static void reply_snap_attr(fuse_req_t req, fuse_ino_t ino) {
+    uint32_t id, idx;
+    struct nary_node node;
+    int ret = snap_ino_to_idx(ino, &id, &idx);
+    if (ret == 0 && id == 0) {
+        fs_core_snapshot_dir_node(&g_ll_fs, &node);
+    } else if (ret == 0) {
+        ret = fs_core_snapshot_node(&g_ll_fs, id, idx, &node);
+    }
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct stat stbuf;
+    fs_core_stat(&node, &stbuf);
+    stbuf.st_ino = ino;
+    fuse_reply_attr(req, &stbuf, g_ll_attr_timeout);
+}
+
+/* Name under /.snapshots (a snapshot's root) or in a snapshot directory */
+static void snap_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    uint32_t id, dir_idx;
+    struct nary_node node;
+    int ret = snap_ino_to_idx(parent, &id, &dir_idx);
+    if (ret == 0 && id == 0) {
+        id = fs_core_snapshot_find(&g_ll_fs, name);
+        ret = id ? fs_core_snapshot_node(&g_ll_fs, id, NARY_ROOT_IDX, &node) : -ENOENT;
+    } else if (ret == 0) {
+        ret = fs_core_snapshot_lookup(&g_ll_fs, id, dir_idx, name, NULL, &node);
+    }
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct fuse_entry_param e;
+    fill_snap_entry(id, &node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+static void reply_attr_of(fuse_req_t req, uint32_t idx) {
+    struct nary_node node;
+    if (nary_read_node_mt(&g_ll_fs.tree, idx, &node) != 0) {
+        fuse_reply_err(req, EIO);
+        return;
+    }
+
+    struct stat stbuf;
+    fs_core_stat(&node, &stbuf);
+    stbuf.st_ino = node_ino(&node);
+    fuse_reply_attr(req, &stbuf, g_ll_attr_timeout);
+}
+
+/* === FUSE Low-Level Operations === */
+
+static void razorfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    if (LL_IS_STATS_INO(parent) ||
+        (parent == FUSE_ROOT_ID && strcmp(name, FS_CORE_STATS_DIR) == 0)) {
+        enum fs_core_stats_file file = FS_CORE_STATS_ROOT;
+        if (parent != FUSE_ROOT_ID) {
+            file = LL_STATS_FILE(parent) == FS_CORE_STATS_ROOT ? fs_core_stats_find(name)
+                                                               : FS_CORE_STATS_ROOT;
+            if (file == FS_CORE_STATS_ROOT) {
+                fuse_reply_err(req, ENOENT);
+                return;
+            }
+        }
+
+        struct fuse_entry_param e;
+        fill_stats_entry(file, &e);
+        fuse_reply_entry(req, &e);
+        return;
+    }
+    if (LL_IS_SNAP_INO(parent)) {
+        snap_lookup(req, parent, name);
+        return;
+    }
+    if (parent == FUSE_ROOT_ID && strcmp(name, FS_CORE_SNAPSHOT_DIR) == 0) {
+        struct nary_node node;
+        fs_core_snapshot_dir_node(&g_ll_fs, &node);
+
+        struct fuse_entry_param e;
+        fill_snap_entry(0, &node, &e);
+        fuse_reply_entry(req, &e);
+        return;
+    }
+
+    uint32_t idx;
+    int ret = lookup_child(parent, name, &idx);
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct nary_node node;
+    if (nary_read_node_mt(&g_ll_fs.tree, idx, &node) != 0) {
+        fuse_reply_err(req, EIO);
+        return;
+    }
+
+    struct fuse_entry_param e;
+    fill_entry(&node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+static void razorfs_ll_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    (void) ino;
+    (void) nlookup;
+    fuse_reply_none(req);
+}
+
+static void razorfs_ll_forget_multi(fuse_req_t req, size_t count,
+                                    struct fuse_forget_data *forgets) {
+    (void) count;
+    (void) forgets;
+    fuse_reply_none(req);
+}
+
+static void razorfs_ll_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) fi;
+
+    if (LL_IS_STATS_INO(ino)) {
+        struct fuse_entry_param e;
+        fill_stats_entry(LL_STATS_FILE(ino), &e);
+        fuse_reply_attr(req, &e.attr, 0);
+        return;
+    }
+    if (LL_IS_SNAP_INO(ino)) {
+        reply_snap_attr(req, ino);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    reply_attr_of(req, idx);
+}
+
+static void razorfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+                               int to_set, struct fuse_file_info *fi) {
+    (void) fi;
+
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    /* Ownership is not stored (see chown in razorfs_mt.c) */
+    int ret = 0;
+    if (to_set & FUSE_SET_ATTR_MODE) {
+        ret = fs_core_chmod(&g_ll_fs, idx, attr->st_mode);
+    }
+    if (ret == 0 && (to_set & FUSE_SET_ATTR_SIZE)) {
+        ret = fs_core_truncate(&g_ll_fs, idx, attr->st_size);
+    }
+    if (ret == 0 && (to_set & (FUSE_SET_ATTR_MTIME | FUSE_SET_ATTR_MTIME_NOW))) {
+        struct timespec tv[2] = {
+            { .tv_sec = 0, .tv_nsec = UTIME_OMIT },
+            attr->st_mtim,
+        };
+        if (to_set & FUSE_SET_ATTR_MTIME_NOW) {
+            tv[1].tv_nsec = UTIME_NOW;
+        }
+        ret = fs_core_utimens(&g_ll_fs, idx, tv);
+    }
+
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    reply_attr_of(req, idx);
+}
+
+static void razorfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+                             mode_t mode) {
+    if (parent == LL_SNAP_DIR_INO) {
+        /* mkdir .snapshots/<name> takes a snapshot */
+        struct nary_node node;
+        int ret = fs_core_snapshot_create(&g_ll_fs, name);
+        if (ret == 0) {
+            uint32_t id = fs_core_snapshot_find(&g_ll_fs, name);
+            ret = id ? fs_core_snapshot_node(&g_ll_fs, id, NARY_ROOT_IDX, &node) : -ENOENT;
+            if (ret == 0) {
+                struct fuse_entry_param e;
+                fill_snap_entry(id, &node, &e);
+                fuse_reply_entry(req, &e);
+                return;
+            }
+        }
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    if (LL_IS_SNAP_INO(parent)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t parent_idx = ino_to_idx(parent);
+    if (parent_idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    struct nary_node node;
+    int ret = fs_core_mkdir(&g_ll_fs, parent_idx, name, mode, &node);
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct fuse_entry_param e;
+    fill_entry(&node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+static void razorfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    if (parent == LL_SNAP_DIR_INO) {
+        /* rmdir .snapshots/<name> drops the snapshot */
+        fuse_reply_err(req, -fs_core_snapshot_delete(&g_ll_fs, name));
+        return;
+    }
+    if (LL_IS_SNAP_INO(parent)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx;
+    int ret = lookup_child(parent, name, &idx);
+    if (ret == 0) {
+        ret = fs_core_rmdir(&g_ll_fs, idx);
+    }
+    fuse_reply_err(req, -ret);
+}
+
+static void razorfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    if (LL_IS_SNAP_INO(parent)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx;
+    int ret = lookup_child(parent, name, &idx);
+    if (ret == 0) {
+        ret = fs_core_unlink(&g_ll_fs, idx);
+    }
+    fuse_reply_err(req, -ret);
+}
+
+static void razorfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+                              mode_t mode, struct fuse_file_info *fi) {
+    if (LL_IS_SNAP_INO(parent)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t parent_idx = ino_to_idx(parent);
+    if (parent_idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    struct nary_node node;
+    int ret = fs_core_create(&g_ll_fs, parent_idx, name, mode, &node);
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    /* Set file handle to inode for subsequent operations */
+    fi->fh = node.inode;
+    fi->keep_cache = g_ll_opts.kernel_cache ? 1 : 0;
+
+    struct fuse_entry_param e;
+    fill_entry(&node, &e);
+    fuse_reply_create(req, &e, fi);
+}
+
+static void razorfs_ll_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    if (LL_IS_STATS_INO(ino)) {
+        int ret = fs_core_stats_open(&g_ll_fs, LL_STATS_FILE(ino), fi->flags, &fi->fh);
+        if (ret != 0) {
+            fuse_reply_err(req, -ret);
+            return;
+        }
+
+        /* Sized 0 in getattr: the kernel must not cut reads short */
+        fi->direct_io = 1;
+        fuse_reply_open(req, fi);
+        return;
+    }
+    if (LL_IS_SNAP_INO(ino)) {
+        uint32_t id, idx;
+        int ret = snap_ino_to_idx(ino, &id, &idx);
+        if (ret == 0) {
+            ret = id ? fs_core_snapshot_open(&g_ll_fs, id, idx, fi->flags, &fi->fh) : -EISDIR;
+        }
+        if (ret != 0) {
+            fuse_reply_err(req, -ret);
+            return;
+        }
+
+        fi->keep_cache = 1;  /* A snapshot's files never change */
+        fuse_reply_open(req, fi);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int ret = fs_core_open_file(&g_ll_fs, idx, &fi->fh);
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    /* Contents only change through this daemon: keep pages across opens */
+    fi->keep_cache = g_ll_opts.kernel_cache ? 1 : 0;
+    fuse_reply_open(req, fi);
+}
+
+static void razorfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                            struct fuse_file_info *fi) {
+    (void) ino;  /* Use fi->fh instead */
+
+    /* Send straight from the chunk buffers; the file stays read-locked
+     * until the reply has been written to the kernel */
+    struct fs_read_pin pin;
+    ssize_t viewed = fs_core_read_pin(&g_ll_fs, fi->fh, size, off, &pin);
+    if (viewed >= 0) {
+        if (pin.view.count > 0) {
+            fuse_reply_iov(req, pin.view.iov, (int)pin.view.count);
+        } else {
+            fuse_reply_buf(req, NULL, 0);
+        }
+        fs_core_read_unpin(&pin);
+        return;
+    }
+    if (viewed != -E2BIG) {
+        fuse_reply_err(req, (int)-viewed);
+        return;
+    }
+
+    /* Larger than one view: copy */
+    char *buf = malloc(size ? size : 1);
+    if (!buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    ssize_t n = fs_core_read(&g_ll_fs, fi->fh, buf, size, off);
+    if (n < 0) {
+        fuse_reply_err(req, (int)-n);
+    } else {
+        fuse_reply_buf(req, buf, (size_t)n);
+    }
+    free(buf);
+}
+
+static void razorfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+                             size_t size, off_t off, struct fuse_file_info *fi) {
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    ssize_t n = fs_core_write(&g_ll_fs, idx, fi->fh, buf, size, off);
+    if (n < 0) {
+        fuse_reply_err(req, (int)-n);
+    } else {
+        fuse_reply_write(req, (size_t)n);
+    }
+}
+
+static void razorfs_ll_fallocate(fuse_req_t req, fuse_ino_t ino, int mode, off_t offset,
+                                 off_t length, struct fuse_file_info *fi) {
+    (void) fi;
+
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    fuse_reply_err(req, -fs_core_fallocate(&g_ll_fs, idx, mode, offset, length));
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+static void razorfs_ll_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence,
+                             struct fuse_file_info *fi) {
+    (void) ino;
+
+    off_t pos = fs_core_lseek(&g_ll_fs, fi->fh, off, whence);
+    if (pos < 0) {
+        fuse_reply_err(req, (int)-pos);
+    } else {
+        fuse_reply_lseek(req, pos);
+    }
+}
+#endif
+
+static void razorfs_ll_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    fuse_reply_err(req, -fs_core_flush(&g_ll_fs, fi->fh));
+}
+
+static void razorfs_ll_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    fs_core_release(&g_ll_fs, fi->fh);
+    fuse_reply_err(req, 0);
+}
+
+static void razorfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+                             struct fuse_file_info *fi) {
+    (void) ino;
+    (void) datasync;
+
+    fuse_reply_err(req, -fs_core_fsync(&g_ll_fs, fi->fh));
+}
+
+static void razorfs_ll_fsyncdir(fuse_req_t req, fuse_ino_t ino, int datasync,
+                                struct fuse_file_info *fi) {
+    (void) ino;
+    (void) datasync;
+    (void) fi;
+
+    fuse_reply_err(req, -fs_core_fsyncdir(&g_ll_fs));
+}
+
+/* Reply being filled by razorfs_ll_readdir / razorfs_ll_readdirplus */
+struct ll_dir_fill {
+    fuse_req_t req;
+    char *buf;
+    size_t size;
+    size_t used;
+    int plus;                    /* Entries carry attributes (readdirplus) */
+    uint32_t snapshot;           /* Listing a directory of this snapshot (0 = live) */
+    int snapdir;                 /* Listing /.snapshots */
+    int statsdir;                /* Listing /.razorfs */
+};
+
+/* Inode number of a listed node */
+static fuse_ino_t dirent_ino(const struct ll_dir_fill *f, const char *name,
+                             const struct nary_node *node) {
+    if (node->inode == FS_CORE_SNAPSHOT_DIR_INODE) return LL_SNAP_DIR_INO;
+    if (f->statsdir && node->parent_idx != NARY_INVALID_IDX) {
+        return LL_STATS_INO(FS_CORE_STATS_DIR_INODE - node->inode);
+    }
+    if (f->snapdir) {
+        /* Snapshot roots, by name; ".." is the live root */
+        uint32_t id = strcmp(name, "..") == 0 ? 0 : fs_core_snapshot_find(&g_ll_fs, name);
+        return id ? LL_SNAP_INO(id, node->inode) : node_ino(node);
+    }
+    return f->snapshot ? LL_SNAP_INO(f->snapshot, node->inode) : node_ino(node);
+}
+
+/* Append one directory entry; returns 0 once the buffer is full */
+static int ll_add_dirent(void *ctx, const char *name, const struct nary_node *node,
+                         off_t next_off) {
+    struct ll_dir_fill *f = ctx;
+    size_t need;
+    if (f->plus) {
+        struct fuse_entry_param e;
+        fill_entry(node, &e);
+        e.ino = dirent_ino(f, name, node);
+        e.attr.st_ino = e.ino;
+        need = fuse_add_direntry_plus(f->req, f->buf + f->used, f->size - f->used,
+                                      name, &e, next_off);
+    } else {
+        struct stat stbuf;
+        memset(&stbuf, 0, sizeof(stbuf));
+        stbuf.st_ino = dirent_ino(f, name, node);
+        stbuf.st_mode = node->mode & S_IFMT;
+        need = fuse_add_direntry(f->req, f->buf + f->used, f->size - f->used,
+                                 name, &stbuf, next_off);
+    }
+    if (need > f->size - f->used) {
+        return 0;
+    }
+    f->used += need;
+    return 1;
+}
+
+static void razorfs_ll_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    int ret;
+    if (LL_IS_STATS_INO(ino)) {
+        fi->fh = 0;
+        ret = LL_STATS_FILE(ino) == FS_CORE_STATS_ROOT ? 0 : -ENOTDIR;
+    } else if (LL_IS_SNAP_INO(ino)) {
+        uint32_t id, idx;
+        fi->fh = 0;  /* /.snapshots itself needs no cursor */
+        ret = snap_ino_to_idx(ino, &id, &idx);
+        if (ret == 0 && id != 0) {
+            ret = fs_core_snapshot_opendir(&g_ll_fs, id, idx, &fi->fh);
+        }
+    } else {
+        uint32_t idx = ino_to_idx(ino);
+        if (idx == NARY_INVALID_IDX) {
+            fuse_reply_err(req, ENOENT);
+            return;
+        }
+        ret = fs_core_opendir(&g_ll_fs, idx, &fi->fh);
+    }
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    fuse_reply_open(req, fi);
+}
+
+/* Offsets are positions in the listing (see fs_core_readdir) */
+static void ll_list(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                    struct fuse_file_info *fi, int plus) {
+    uint32_t id = 0, idx = NARY_INVALID_IDX;
+    int ret = 0;
+    int statsdir = LL_IS_STATS_INO(ino);
+    if (statsdir) {
+        ret = LL_STATS_FILE(ino) == FS_CORE_STATS_ROOT ? 0 : -ENOTDIR;
+    } else if (LL_IS_SNAP_INO(ino)) {
+        ret = snap_ino_to_idx(ino, &id, &idx);
+    } else if ((idx = ino_to_idx(ino)) == NARY_INVALID_IDX) {
+        ret = -ENOENT;
+    }
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct ll_dir_fill fill = {
+        .req = req,
+        .buf = malloc(size ? size : 1),
+        .size = size,
+        .used = 0,
+        .plus = plus,
+        .snapshot = id,
+        .snapdir = !statsdir && LL_IS_SNAP_INO(ino) && id == 0,
+        .statsdir = statsdir,
+    };
+    if (!fill.buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    if (fill.statsdir) {
+        ret = fs_core_stats_list(&g_ll_fs, off, ll_add_dirent, &fill);
+    } else if (fill.snapdir) {
+        ret = fs_core_snapshot_list(&g_ll_fs, off, ll_add_dirent, &fill);
+    } else if (id != 0) {
+        ret = fs_core_snapshot_readdir(&g_ll_fs, id, idx, fi ? fi->fh : 0, off,
+                                       ll_add_dirent, &fill);
+    } else {
+        ret = fs_core_readdir(&g_ll_fs, idx, fi ? fi->fh : 0, off, ll_add_dirent, &fill);
+    }
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+    } else {
+        fuse_reply_buf(req, fill.buf, fill.used);
+    }
+    free(fill.buf);
+}
+
+static void razorfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                               struct fuse_file_info *fi) {
+    ll_list(req, ino, size, off, fi, 0);
+}
+
+/* Attributes in the same pass: no lookup per entry afterwards */
+static void razorfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+                                   struct fuse_file_info *fi) {
+    ll_list(req, ino, size, off, fi, 1);
+}
+
+static void razorfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    (void) ino;
+
+    fs_core_releasedir(&g_ll_fs, fi->fh);
+    fuse_reply_err(req, 0);
+}
+
+static void razorfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+                              fuse_ino_t newparent, const char *newname,
+                              unsigned int flags) {
+    if (LL_IS_SNAP_INO(parent) || LL_IS_SNAP_INO(newparent)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t parent_idx = ino_to_idx(parent);
+    uint32_t new_parent_idx = ino_to_idx(newparent);
+    if (parent_idx == NARY_INVALID_IDX || new_parent_idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    if (strnlen(newname, MAX_FILENAME_LENGTH) >= MAX_FILENAME_LENGTH) {
+        fuse_reply_err(req, ENAMETOOLONG);
+        return;
+    }
+
+    uint32_t from_idx = nary_find_child_mt(&g_ll_fs.tree, parent_idx, name);
+    if (from_idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    int ret = fs_core_rename(&g_ll_fs, parent_idx, from_idx, new_parent_idx, newname, flags);
+    fuse_reply_err(req, -ret);
+
+    /* Drop cached names only after replying: the kernel holds the
+     * directory locks until the rename completes, and a notice sent
+     * from inside the request would wait on them forever. */
+    if (ret == 0 && g_ll_opts.kernel_cache && g_ll_se) {
+        fuse_lowlevel_notify_inval_entry(g_ll_se, parent, name, strlen(name));
+        fuse_lowlevel_notify_inval_entry(g_ll_se, newparent, newname, strlen(newname));
+    }
+}
+
+static void razorfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                                const char *value, size_t size, int flags) {
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    fuse_reply_err(req, -fs_core_setxattr(&g_ll_fs, idx, name, value, size, flags));
+}
+
+/* Size 0 asks for the size; otherwise the data goes back as a buffer */
+static void reply_xattr(fuse_req_t req, int ret, const char *buf, size_t size) {
+    if (ret < 0) {
+        fuse_reply_err(req, -ret);
+    } else if (size == 0) {
+        fuse_reply_xattr(req, (size_t)ret);
+    } else {
+        fuse_reply_buf(req, buf, (size_t)ret);
+    }
+}
+
+static void razorfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+                                size_t size) {
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, ENODATA);  /* Extended attributes are not part of snapshots */
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    char *buf = size ? malloc(size) : NULL;
+    if (size && !buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    reply_xattr(req, fs_core_getxattr(&g_ll_fs, idx, name, buf, size), buf, size);
+    free(buf);
+}
+
+static void razorfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size) {
+    if (LL_IS_SNAP_INO(ino)) {
+        reply_xattr(req, 0, NULL, size);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    char *buf = size ? malloc(size) : NULL;
+    if (size && !buf) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    reply_xattr(req, fs_core_listxattr(&g_ll_fs, idx, buf, size), buf, size);
+    free(buf);
+}
+
+static void razorfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino, const char *name) {
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+
+    fuse_reply_err(req, -fs_core_removexattr(&g_ll_fs, idx, name));
+}
+
+static void razorfs_ll_ioctl(fuse_req_t req, fuse_ino_t ino, int cmd, void *arg,
+                             struct fuse_file_info *fi, unsigned flags,
+                             const void *in_buf, size_t in_bufsz, size_t out_bufsz) {
+    (void) arg;
+    (void) fi;
+
+    if (flags & FUSE_IOCTL_COMPAT) {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+    if ((unsigned int)cmd != FS_CORE_IOC_CREATE_BATCH) {
+        fuse_reply_err(req, ENOTTY);
+        return;
+    }
+
+    if (LL_IS_SNAP_INO(ino)) {
+        fuse_reply_err(req, EROFS);
+        return;
+    }
+
+    struct fs_core_batch_ioctl batch;
+    uint32_t idx = ino_to_idx(ino);
+    if (idx == NARY_INVALID_IDX) {
+        fuse_reply_err(req, ENOENT);
+        return;
+    }
+    if (in_bufsz != sizeof(batch) || out_bufsz != sizeof(batch)) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    memcpy(&batch, in_buf, sizeof(batch));
+
+    int ret = fs_core_ioctl_create_batch(&g_ll_fs, idx, &batch);
+    if (ret != 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+    fuse_reply_ioctl(req, 0, &batch, sizeof(batch));
+
+    /* The kernel may hold negative entries for the new names; drop them
+     * after replying, as rename does */
+    if (g_ll_opts.kernel_cache && g_ll_se) {
+        size_t pos = 0;
+        for (uint32_t i = 0; i < batch.count; i++) {
+            const char *name = batch.buf + pos + sizeof(uint32_t);
+            size_t len = strlen(name);
+            fuse_lowlevel_notify_inval_entry(g_ll_se, ino, name, len);
+            pos += sizeof(uint32_t) + len + 1;
+        }
+    }
+}
+
+static void razorfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask) {
+    if (LL_IS_STATS_INO(ino)) {
+        fuse_reply_err(req, (mask & W_OK) ? EROFS : 0);
+        return;
+    }
+    if (LL_IS_SNAP_INO(ino)) {
+        uint32_t id, idx;
+        int ret = snap_ino_to_idx(ino, &id, &idx);
+        fuse_reply_err(req, ret != 0 ? -ret : (mask & W_OK) ? EROFS : 0);
+        return;
+    }
+
+    /* Simple access check - just verify existence for now */
+    (void) mask;
+    fuse_reply_err(req, ino_to_idx(ino) == NARY_INVALID_IDX ? ENOENT : 0);
+}
+
+/* === Per-Operation Latency (see metrics.h) === */
+
+#define LL_TIMED(op, hist, params, args)                  \
+    static void razorfs_ll_##op##_timed params {          \
+        uint64_t start = metrics_start();                 \
+        razorfs_ll_##op args;                             \
+        metrics_record_since(hist, start);                \
+    }
+
+typedef struct fuse_file_info ffi_t;
+
+LL_TIMED(lookup, METRICS_OP_LOOKUP, (fuse_req_t r, fuse_ino_t p, const char *n), (r, p, n))
+LL_TIMED(getattr, METRICS_OP_GETATTR, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(setattr, METRICS_OP_SETATTR,
+         (fuse_req_t r, fuse_ino_t i, struct stat *attr, int to_set, ffi_t *fi),
+         (r, i, attr, to_set, fi))
+LL_TIMED(mkdir, METRICS_OP_MKDIR, (fuse_req_t r, fuse_ino_t p, const char *n, mode_t mode),
+         (r, p, n, mode))
+LL_TIMED(rmdir, METRICS_OP_RMDIR, (fuse_req_t r, fuse_ino_t p, const char *n), (r, p, n))
+LL_TIMED(unlink, METRICS_OP_UNLINK, (fuse_req_t r, fuse_ino_t p, const char *n), (r, p, n))
+LL_TIMED(create, METRICS_OP_CREATE,
+         (fuse_req_t r, fuse_ino_t p, const char *n, mode_t mode, ffi_t *fi), (r, p, n, mode, fi))
+LL_TIMED(open, METRICS_OP_OPEN, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(read, METRICS_OP_READ, (fuse_req_t r, fuse_ino_t i, size_t size, off_t off, ffi_t *fi),
+         (r, i, size, off, fi))
+LL_TIMED(write, METRICS_OP_WRITE,
+         (fuse_req_t r, fuse_ino_t i, const char *buf, size_t size, off_t off, ffi_t *fi),
+         (r, i, buf, size, off, fi))
+LL_TIMED(fallocate, METRICS_OP_FALLOCATE,
+         (fuse_req_t r, fuse_ino_t i, int mode, off_t off, off_t len, ffi_t *fi),
+         (r, i, mode, off, len, fi))
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+LL_TIMED(lseek, METRICS_OP_LSEEK, (fuse_req_t r, fuse_ino_t i, off_t off, int whence, ffi_t *fi),
+         (r, i, off, whence, fi))
+#endif
+LL_TIMED(flush, METRICS_OP_FLUSH, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(release, METRICS_OP_RELEASE, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(fsync, METRICS_OP_FSYNC, (fuse_req_t r, fuse_ino_t i, int ds, ffi_t *fi),
+         (r, i, ds, fi))
+LL_TIMED(fsyncdir, METRICS_OP_FSYNC, (fuse_req_t r, fuse_ino_t i, int ds, ffi_t *fi),
+         (r, i, ds, fi))
+LL_TIMED(opendir, METRICS_OP_OPENDIR, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(readdir, METRICS_OP_READDIR,
+         (fuse_req_t r, fuse_ino_t i, size_t size, off_t off, ffi_t *fi), (r, i, size, off, fi))
+LL_TIMED(readdirplus, METRICS_OP_READDIR,
+         (fuse_req_t r, fuse_ino_t i, size_t size, off_t off, ffi_t *fi), (r, i, size, off, fi))
+LL_TIMED(releasedir, METRICS_OP_RELEASEDIR, (fuse_req_t r, fuse_ino_t i, ffi_t *fi), (r, i, fi))
+LL_TIMED(rename, METRICS_OP_RENAME,
+         (fuse_req_t r, fuse_ino_t p, const char *n, fuse_ino_t np, const char *nn,
+          unsigned int flags), (r, p, n, np, nn, flags))
+LL_TIMED(access, METRICS_OP_ACCESS, (fuse_req_t r, fuse_ino_t i, int mask), (r, i, mask))
+LL_TIMED(setxattr, METRICS_OP_XATTR,
+         (fuse_req_t r, fuse_ino_t i, const char *n, const char *value, size_t size, int flags),
+         (r, i, n, value, size, flags))
+LL_TIMED(getxattr, METRICS_OP_XATTR, (fuse_req_t r, fuse_ino_t i, const char *n, size_t size),
+         (r, i, n, size))
+LL_TIMED(listxattr, METRICS_OP_XATTR, (fuse_req_t r, fuse_ino_t i, size_t size), (r, i, size))
+LL_TIMED(removexattr, METRICS_OP_XATTR, (fuse_req_t r, fuse_ino_t i, const char *n), (r, i, n))
+LL_TIMED(ioctl, METRICS_OP_IOCTL,
+         (fuse_req_t r, fuse_ino_t i, int cmd, void *arg, ffi_t *fi, unsigned flags,
+          const void *in_buf, size_t in_bufsz, size_t out_bufsz),
+         (r, i, cmd, arg, fi, flags, in_buf, in_bufsz, out_bufsz))
+
+/* === Initialization and Cleanup === */
+
+static void razorfs_ll_init(void *userdata, struct fuse_conn_info *conn) {
+    (void) userdata;
+
+    /* Larger requests: fewer round trips through the daemon */
+    conn->max_write = g_ll_opts.io_size;
+    conn->max_readahead = g_ll_opts.io_size;
+
+    if (g_ll_opts.kernel_cache) {
+        unsigned int want = FUSE_CAP_WRITEBACK_CACHE | FUSE_CAP_SPLICE_READ |
+                            FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE;
+        conn->want |= conn->capable & want;
+    }
+
+    printf("🚀 RAZORFS low-level front end initialized - inode-based requests\n");
+    printf("   Kernel cache: %s\n", g_ll_opts.kernel_cache ? "on" : "off");
+
+    /* Worker threads must start here, after FUSE has daemonized */
+    fs_core_start(&g_ll_fs, &g_ll_opts);
+}
+
+static const struct fuse_lowlevel_ops razorfs_ll_ops = {
+    .init         = razorfs_ll_init,
+    .lookup       = razorfs_ll_lookup_timed,
+    .forget       = razorfs_ll_forget,
+    .forget_multi = razorfs_ll_forget_multi,
+    .getattr      = razorfs_ll_getattr_timed,
+    .setattr      = razorfs_ll_setattr_timed,
+    .mkdir        = razorfs_ll_mkdir_timed,
+    .rmdir        = razorfs_ll_rmdir_timed,
+    .unlink       = razorfs_ll_unlink_timed,
+    .create       = razorfs_ll_create_timed,
+    .open         = razorfs_ll_open_timed,
+    .read         = razorfs_ll_read_timed,
+    .write        = razorfs_ll_write_timed,
+    .fallocate    = razorfs_ll_fallocate_timed,
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    .lseek        = razorfs_ll_lseek_timed,
+#endif
+    .flush        = razorfs_ll_flush_timed,
+    .release      = razorfs_ll_release_timed,
+    .fsync        = razorfs_ll_fsync_timed,
+    .fsyncdir     = razorfs_ll_fsyncdir_timed,
+    .opendir      = razorfs_ll_opendir_timed,
+    .readdir      = razorfs_ll_readdir_timed,
+    .readdirplus  = razorfs_ll_readdirplus_timed,
+    .releasedir   = razorfs_ll_releasedir_timed,
+    .rename       = razorfs_ll_rename_timed,
+    .access       = razorfs_ll_access_timed,
+    .setxattr     = razorfs_ll_setxattr_timed,
+    .getxattr     = razorfs_ll_getxattr_timed,
+    .listxattr    = razorfs_ll_listxattr_timed,
+    .removexattr  = razorfs_ll_removexattr_timed,
+    .ioctl        = razorfs_ll_ioctl_timed,
+};
+
+int main(int argc, char *argv[]) {
+    memset(&g_ll_fs, 0, sizeof(g_ll_fs));
+
+    /* Parse razorfs-specific mount options, pass the rest to FUSE */
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    if (fuse_opt_parse(&args, &g_ll_opts, razorfs_ll_opts, NULL) == -1) {
+        fprintf(stderr, "Failed to parse mount options\n");
+        return 1;
+    }
+
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(&args, &opts) != 0) {
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+    if (opts.show_help) {
+        printf("usage: %s [options] <mountpoint>\n\n", argv[0]);
+        fuse_cmdline_help();
+        fuse_lowlevel_help();
+        free(opts.mountpoint);
+        fuse_opt_free_args(&args);
+        return 0;
+    }
+    if (opts.show_version) {
+        fuse_lowlevel_version();
+        free(opts.mountpoint);
+        fuse_opt_free_args(&args);
+        return 0;
+    }
+    if (!opts.mountpoint) {
+        fprintf(stderr, "usage: %s [options] <mountpoint>\n", argv[0]);
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+
+    if (g_ll_opts.kernel_cache) {
+        g_ll_entry_timeout = g_ll_opts.cache_timeout;
+        g_ll_attr_timeout = g_ll_opts.cache_timeout;
+    }
+
+    /* NUMA placement applies from the first mapping on */
+    if (fs_core_set_placement(&g_ll_opts) != 0) {
+        free(opts.mountpoint);
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+
+    /* WAL, persistent tree and crash recovery. This runs before mounting,
+     * so the kernel never holds caches from before a replay. */
+    if (fs_core_open(&g_ll_fs, FS_CORE_WAL_PATH, &g_ll_opts) != 0) {
+        free(opts.mountpoint);
+        fuse_opt_free_args(&args);
+        return 1;
+    }
+
+    printf("✅ RAZORFS - Persistent Multithreaded Filesystem (low-level API)\n");
+    printf("   Node size: %zu bytes (MT + shared memory)\n", sizeof(struct nary_node_mt));
+    if (g_ll_fs.wal_enabled) {
+        printf("   Crash Recovery: Enabled (WAL active)\n");
+    } else {
+        printf("   Crash Recovery: ⚠️  DISABLED (no WAL)\n");
+    }
+
+    int ret = 1;
+    struct fuse_session *se = fuse_session_new(&args, &razorfs_ll_ops,
+                                               sizeof(razorfs_ll_ops), NULL);
+    g_ll_se = se;
+    if (se) {
+        if (fuse_set_signal_handlers(se) == 0) {
+            if (fuse_session_mount(se, opts.mountpoint) == 0) {
+                fuse_daemonize(opts.foreground);
+
+                /* Run FUSE */
+                if (opts.singlethread) {
+                    ret = fuse_session_loop(se);
+                } else {
+                    ret = fuse_session_loop_mt(se, opts.clone_fd);
+                }
+                fuse_session_unmount(se);
+            }
+            fuse_remove_signal_handlers(se);
+        }
+        g_ll_se = NULL;
+        fuse_session_destroy(se);
+    }
+
+    /* Also reached if the mount failed before init started any workers */
+    printf("💾 Shutting down RAZORFS\n");
+    fs_core_close(&g_ll_fs);
+
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+
+    return ret ? 1 : 0;
+}
@@ -3,6 +3,10 @@
  *
  * Thread-safe FUSE filesystem using ext4-style per-inode locking.
  * Implements all FUSE operations with proper concurrency support.
+ *
+ * Path-based front end: every request names a path, which is resolved
+ * (through the dentry cache) to a node and handed to the shared core.
+ * fuse/razorfs_ll.c is the inode-based alternative over the same core.
  */
 
 #define FUSE_USE_VERSION 31
@@ -20,170 +24,93 @@
 #include <linux/limits.h>
 
 #include "../src/nary_tree_mt.h"
-#include "../src/shm_persist.h"
-#include "../src/compression.h"
-#include "../src/wal.h"
-#include "../src/recovery.h"
-
-/* RENAME flags if not defined */
-#ifndef RENAME_NOREPLACE
-#define RENAME_NOREPLACE (1 << 0)
+#include "../src/fs_core.h"
+#include "../src/path_cache.h"
+#include "../src/metrics.h"
+#ifdef RAZORFS_WITH_S3
+#include "../src/s3_backend.h"
 #endif
 
-/* Forward declarations */
-static void sync_string_table(void);
-
-/* File data hash table size */
-#define FILE_HASH_TABLE_SIZE 1024
-/* Compression threshold - only compress files larger than this */
-#define COMPRESSION_BUFFER_THRESHOLD (64 * 1024)  /* 64KB */
+/* Mount options (-o name=value) */
+static struct fs_core_options g_mt_opts = FS_CORE_OPTIONS_DEFAULT;
+
+#define RAZORFS_OPT(t, p) { t, offsetof(struct fs_core_options, p), 1 }
+static const struct fuse_opt razorfs_mt_opts[] = {
+    RAZORFS_OPT("compress_threads=%u", compress_threads),
+    RAZORFS_OPT("compress_idle_ms=%u", compress_idle_ms),
+    RAZORFS_OPT("writeback_ms=%u", writeback_ms),
+    RAZORFS_OPT("cache", kernel_cache),
+    RAZORFS_OPT("cache_timeout=%lf", cache_timeout),
+    RAZORFS_OPT("io_size=%u", io_size),
+    RAZORFS_OPT("numa=%s", numa_policy),
+    RAZORFS_OPT("hugepages=%s", hugepages),
+    RAZORFS_OPT("prefetch=%u", prefetch),
+    RAZORFS_OPT("rebalance_ms=%u", rebalance_ms),
+    RAZORFS_OPT("memory_mb=%u", memory_mb),
+    RAZORFS_OPT("tier_dir=%s", tier_dir),
+    RAZORFS_OPT("tier_cold_s=%u", tier_cold_s),
+    RAZORFS_OPT("tier_cache=%s", tier_cache_dir),
+    RAZORFS_OPT("tier_cache_mb=%u", tier_cache_mb),
+    RAZORFS_OPT("dedup", dedup),
+    RAZORFS_OPT("durability=%s", durability),
+    RAZORFS_OPT("wal_dirs=%s", wal_dirs),
+    RAZORFS_OPT("wal_segments=%u", wal_segments),
+    RAZORFS_OPT("wal_segment_mb=%u", wal_segment_mb),
+    RAZORFS_OPT("wal_data", wal_data),
+    RAZORFS_OPT("io_engine=%s", io_engine),
+    RAZORFS_OPT("metrics=%s", metrics),
+    FUSE_OPT_END
+};
 
-/* Global multithreaded filesystem state */
-static struct {
-    struct nary_tree_mt tree;
-    struct wal wal;                  /* Write-Ahead Log for crash recovery */
-    int wal_enabled;                 /* WAL enabled flag */
-
-    /* Thread-safe file content storage */
-    struct mt_file_data {
-        uint32_t inode;
-        int is_active;               /* Flag to indicate if entry is in use */
-        pthread_rwlock_t data_lock;  /* Per-file lock */
-        char *data;
-        size_t size;
-        size_t capacity;
-        int is_compressed;           /* Flag to track compression state */
-        size_t uncompressed_size;    /* Original size if compressed */
-        struct mt_file_data *next;   /* For hash table chaining */
-    } *files;
-
-    uint32_t file_count;
-    uint32_t file_capacity;
-    pthread_rwlock_t files_lock;  /* Lock for files array management */
-
-    /* Hash table for O(1) file lookup by inode */
-    struct mt_file_data *file_hash_table[FILE_HASH_TABLE_SIZE];
-} g_mt_fs;
-
-/* === Thread-Safe File Content Management === */
-
-static inline uint32_t hash_inode(uint32_t inode) {
-    /* Simple modulo hash */
-    return inode % FILE_HASH_TABLE_SIZE;
-}
-
-static struct mt_file_data *find_file_data(uint32_t inode) {
-    uint32_t hash = hash_inode(inode);
-
-    pthread_rwlock_rdlock(&g_mt_fs.files_lock);
-
-    struct mt_file_data *current = g_mt_fs.file_hash_table[hash];
-    while (current) {
-        if (current->inode == inode) {
-            pthread_rwlock_unlock(&g_mt_fs.files_lock);
-            return current;
-        }
-        current = current->next;
-    }
+#ifdef RAZORFS_WITH_S3
+/* Cold file offload to a bucket (-o tier_s3_bucket=name); credentials
+ * come from AWS_ACCESS_KEY_ID / AWS_SECRET_ACCESS_KEY */
+struct razorfs_s3_options {
+    char *bucket;
+    char *region;
+    char *endpoint;
+    unsigned int part_mb;       /* Multipart part size (0 = default) */
+    unsigned int parallel;      /* Parts in flight (0 = default) */
+};
+static struct razorfs_s3_options g_s3_opts;
+static struct s3_backend g_s3;
+static struct tier_backend g_s3_tier;
+
+#define RAZORFS_S3_OPT(t, p) { t, offsetof(struct razorfs_s3_options, p), 1 }
+static const struct fuse_opt razorfs_s3_opts[] = {
+    RAZORFS_S3_OPT("tier_s3_bucket=%s", bucket),
+    RAZORFS_S3_OPT("tier_s3_region=%s", region),
+    RAZORFS_S3_OPT("tier_s3_endpoint=%s", endpoint),
+    RAZORFS_S3_OPT("tier_s3_part_mb=%u", part_mb),
+    RAZORFS_S3_OPT("tier_s3_parallel=%u", parallel),
+    FUSE_OPT_END
+};
 
-    pthread_rwlock_unlock(&g_mt_fs.files_lock);
-    return NULL;
+/* Point the tier at the bucket, if one was given */
+static int setup_s3_tier(void) {
+    if (!g_s3_opts.bucket) return 0;
+
+    const char *access_key = getenv("AWS_ACCESS_KEY_ID");
+    const char *secret_key = getenv("AWS_SECRET_ACCESS_KEY");
+    if (s3_backend_init(&g_s3, g_s3_opts.bucket, g_s3_opts.region,
+                        g_s3_opts.endpoint) != 0 ||
+        (access_key && secret_key &&
+         s3_backend_configure_credentials(&g_s3, access_key, secret_key) != 0) ||
+        s3_backend_configure_transfer(&g_s3, (size_t)g_s3_opts.part_mb << 20,
+                                      g_s3_opts.parallel, 0) != 0 ||
+        s3_tier_backend(&g_s3, &g_s3_tier) != 0) {
+        const char *err = s3_get_last_error();
+        fprintf(stderr, "S3 tier unavailable: %s\n", err ? err : "unknown error");
+        return -1;
+    }
+    g_mt_opts.tier_backend = &g_s3_tier;
+    return 0;
 }
+#endif
 
-static struct mt_file_data *create_file_data(uint32_t inode) {
-    pthread_rwlock_wrlock(&g_mt_fs.files_lock);
-
-    /* Try to find an inactive slot to reuse */
-    for (uint32_t i = 0; i < g_mt_fs.file_count; i++) {
-        if (!g_mt_fs.files[i].is_active) {
-            struct mt_file_data *fd = &g_mt_fs.files[i];
-            fd->inode = inode;
-            fd->is_active = 1;
-            fd->data = NULL;
-            fd->size = 0;
-            fd->capacity = 0;
-            fd->is_compressed = 0;
-            fd->uncompressed_size = 0;
-            fd->next = NULL;
-
-            uint32_t hash = hash_inode(inode);
-            fd->next = g_mt_fs.file_hash_table[hash];
-            g_mt_fs.file_hash_table[hash] = fd;
-
-            pthread_rwlock_unlock(&g_mt_fs.files_lock);
-            return fd;
-        }
-    }
-
-    /* If no inactive slot, append a new one. Grow if needed. */
-    if (g_mt_fs.file_count >= g_mt_fs.file_capacity) {
-        uint32_t new_capacity = g_mt_fs.file_capacity == 0 ? 64 : g_mt_fs.file_capacity * 2;
-        struct mt_file_data *new_files = realloc(g_mt_fs.files, new_capacity * sizeof(struct mt_file_data));
-        if (!new_files) {
-            pthread_rwlock_unlock(&g_mt_fs.files_lock);
-            return NULL;
-        }
-        g_mt_fs.files = new_files;
-        g_mt_fs.file_capacity = new_capacity;
-    }
-
-    struct mt_file_data *fd = &g_mt_fs.files[g_mt_fs.file_count];
-    fd->inode = inode;
-    fd->is_active = 1;
-    pthread_rwlock_init(&fd->data_lock, NULL);
-    fd->data = NULL;
-    fd->size = 0;
-    fd->capacity = 0;
-    fd->is_compressed = 0;
-    fd->uncompressed_size = 0;
-    fd->next = NULL;
-
-    uint32_t hash = hash_inode(inode);
-    fd->next = g_mt_fs.file_hash_table[hash];
-    g_mt_fs.file_hash_table[hash] = fd;
-
-    g_mt_fs.file_count++;
-    pthread_rwlock_unlock(&g_mt_fs.files_lock);
-    return fd;
-}
-
-static void remove_file_data(uint32_t inode) {
-    pthread_rwlock_wrlock(&g_mt_fs.files_lock);
-
-    uint32_t hash = hash_inode(inode);
-    struct mt_file_data *current = g_mt_fs.file_hash_table[hash];
-    struct mt_file_data *prev = NULL;
-
-    while (current) {
-        if (current->inode == inode) {
-            if (prev) {
-                prev->next = current->next;
-            } else {
-                g_mt_fs.file_hash_table[hash] = current->next;
-            }
-
-            pthread_rwlock_wrlock(&current->data_lock);
-            if (current->data) {
-                free(current->data);
-                current->data = NULL;
-            }
-            current->size = 0;
-            current->capacity = 0;
-            pthread_rwlock_unlock(&current->data_lock);
-
-            current->is_active = 0;
-            /* Do not decrement file_count, it is a high-water mark.
-               The slot will be reused by create_file_data. */
-            break;
-        }
-        prev = current;
-        current = current->next;
-    }
-
-    pthread_rwlock_unlock(&g_mt_fs.files_lock);
-
-    disk_file_data_remove(inode);
-}
+/* Global multithreaded filesystem state */
+static struct fs_core g_mt_fs;
+static struct path_cache g_mt_dcache;   /* Full path → node index */
 
 /* === Helper Functions === */
 
@@ -220,80 +147,226 @@ static int split_path(const char *path, char *parent_out, char *name_out) {
     return 0;
 }
 
-/* === FUSE Operations - Thread-Safe === */
+/* Resolve a path through the dentry cache, walking the tree on a miss */
+static uint32_t lookup_path(const char *path) {
+    uint64_t gen = nary_paths_generation_mt(&g_mt_fs.tree);
+    if (gen != NARY_PATHS_UNSTABLE) {
+        uint32_t idx = path_cache_lookup(&g_mt_dcache, path, gen);
+        if (idx != NARY_INVALID_IDX) {
+            return idx;
+        }
+    }
 
-static int razorfs_mt_getattr(const char *path, struct stat *stbuf,
-                              struct fuse_file_info *fi) {
-    (void) fi;
+    uint32_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    if (idx != NARY_INVALID_IDX && gen != NARY_PATHS_UNSTABLE) {
+        path_cache_insert(&g_mt_dcache, path, idx, gen);
+    }
+    return idx;
+}
 
-    memset(stbuf, 0, sizeof(struct stat));
+/* Snapshots show read-only under /.snapshots/<name>/ (not listed in /) */
+#define SNAPSHOTS_PATH "/" FS_CORE_SNAPSHOT_DIR
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
-    if (idx == NARY_INVALID_IDX) {
+static int under_snapshots(const char *path) {
+    size_t len = sizeof(SNAPSHOTS_PATH) - 1;
+    return strncmp(path, SNAPSHOTS_PATH, len) == 0 &&
+           (path[len] == '\0' || path[len] == '/');
+}
+
+/*
+ * Resolve a path under /.snapshots: *id_out is 0 for the directory itself,
+ * else the snapshot, with *idx_out the node in it
+ * Returns 0, or -ENOENT
+ */
+static int lookup_snapshot_path(const char *path, uint32_t *id_out, uint32_t *idx_out) {
+    const char *name = path + sizeof(SNAPSHOTS_PATH) - 1;
+    while (*name == '/') name++;
+    *id_out = 0;
+    *idx_out = NARY_INVALID_IDX;
+    if (*name == '\0') {
+        return 0;
+    }
+
+    char snap[SNAPSHOT_NAME_MAX + 1];
+    const char *rest = strchr(name, '/');
+    size_t len = rest ? (size_t)(rest - name) : strlen(name);
+    if (len > SNAPSHOT_NAME_MAX) {
         return -ENOENT;
     }
+    memcpy(snap, name, len);
+    snap[len] = '\0';
 
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
+    uint32_t id = fs_core_snapshot_find(&g_mt_fs, snap);
+    if (id == 0) {
+        return -ENOENT;
     }
+    uint32_t idx = nary_snapshot_path_lookup_mt(&g_mt_fs.tree, id, rest ? rest : "/");
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
+    *id_out = id;
+    *idx_out = idx;
+    return 0;
+}
 
-    stbuf->st_ino = node.inode;
-    stbuf->st_mode = node.mode;
-    stbuf->st_nlink = NARY_IS_DIR(&node) ? 2 : 1;
-    stbuf->st_uid = getuid();
-    stbuf->st_gid = getgid();
-    stbuf->st_size = node.size;
-    stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = node.mtime;
-    stbuf->st_blocks = (node.size + 511) / 512;
+/* Statistics show read-only under /.razorfs/ (not listed in /) */
+#define STATS_PATH "/" FS_CORE_STATS_DIR
 
-    return 0;
+/*
+ * Statistics file a path names: FS_CORE_STATS_ROOT for /.razorfs itself,
+ * -1 if the path is not under it, -ENOENT if there is no such file
+ */
+static int lookup_stats_path(const char *path) {
+    size_t len = sizeof(STATS_PATH) - 1;
+    if (strncmp(path, STATS_PATH, len) != 0 || (path[len] != '\0' && path[len] != '/')) {
+        return -1;
+    }
+    const char *name = path + len;
+    while (*name == '/') name++;
+    if (*name == '\0') {
+        return FS_CORE_STATS_ROOT;
+    }
+    enum fs_core_stats_file file = fs_core_stats_find(name);
+    return file != FS_CORE_STATS_ROOT ? (int)file : -ENOENT;
 }
 
-static int razorfs_mt_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                              off_t offset, struct fuse_file_info *fi,
-                              enum fuse_readdir_flags flags) {
-    (void) offset;
+/* === FUSE Operations - Thread-Safe === */
+
+static int razorfs_mt_getattr(const char *path, struct stat *stbuf,
+                              struct fuse_file_info *fi) {
     (void) fi;
-    (void) flags;
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    int stats = lookup_stats_path(path);
+    if (stats != -1) {
+        struct nary_node node;
+        if (stats < 0) {
+            return stats;
+        }
+        fs_core_stats_node(&g_mt_fs, (enum fs_core_stats_file)stats, &node);
+        fs_core_stat(&node, stbuf);
+        return 0;
+    }
+
+    if (under_snapshots(path)) {
+        uint32_t id, idx;
+        int ret = lookup_snapshot_path(path, &id, &idx);
+        if (ret != 0) {
+            return ret;
+        }
+
+        struct nary_node node;
+        if (id == 0) {
+            fs_core_snapshot_dir_node(&g_mt_fs, &node);
+        } else if (fs_core_snapshot_node(&g_mt_fs, id, idx, &node) != 0) {
+            return -ENOENT;
+        }
+        fs_core_stat(&node, stbuf);
+        return 0;
+    }
+
+    uint32_t idx = lookup_path(path);
     if (idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
 
-    /* Lock the directory node for reading before accessing its data */
-    if (nary_lock_read(&g_mt_fs.tree, idx) != 0) {
-        return -EIO;
+    return fs_core_getattr(&g_mt_fs, idx, stbuf);
+}
+
+/* Reply being filled by razorfs_mt_readdir */
+struct mt_dir_fill {
+    void *buf;
+    fuse_fill_dir_t filler;
+    int plus;                    /* FUSE_READDIR_PLUS: attributes too */
+};
+
+static int mt_add_dirent(void *ctx, const char *name, const struct nary_node *node,
+                         off_t next_off) {
+    const struct mt_dir_fill *f = ctx;
+    struct stat stbuf;
+    if (f->plus) {
+        fs_core_stat(node, &stbuf);
+    } else {
+        memset(&stbuf, 0, sizeof(stbuf));
+        stbuf.st_ino = node->inode;
+        stbuf.st_mode = node->mode & S_IFMT;
     }
 
-    const struct nary_node *dir_node = &g_mt_fs.tree.nodes[idx].node;
+    return f->filler(f->buf, name, &stbuf, next_off,
+                     f->plus ? FUSE_FILL_DIR_PLUS : (enum fuse_fill_dir_flags)0) == 0;
+}
 
-    if (!NARY_IS_DIR(dir_node)) {
-        nary_unlock(&g_mt_fs.tree, idx);
-        return -ENOTDIR;
+static int razorfs_mt_opendir(const char *path, struct fuse_file_info *fi) {
+    int stats = lookup_stats_path(path);
+    if (stats != -1) {
+        fi->fh = 0;
+        return stats < 0 ? stats : stats == FS_CORE_STATS_ROOT ? 0 : -ENOTDIR;
+    }
+    if (under_snapshots(path)) {
+        uint32_t id, idx;
+        int ret = lookup_snapshot_path(path, &id, &idx);
+        if (ret != 0) {
+            return ret;
+        }
+        fi->fh = 0;  /* /.snapshots itself needs no cursor */
+        return id ? fs_core_snapshot_opendir(&g_mt_fs, id, idx, &fi->fh) : 0;
     }
 
-    /* Add . and .. */
-    filler(buf, ".", NULL, 0, 0);
-    filler(buf, "..", NULL, 0, 0);
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
 
-    /* Iterate over children while holding the lock */
-    for (uint16_t i = 0; i < dir_node->num_children; i++) {
-        uint16_t child_idx = dir_node->children[i];
-        if (child_idx == NARY_INVALID_IDX) break;
+    return fs_core_opendir(&g_mt_fs, idx, &fi->fh);
+}
+
+/*
+ * Offsets are positions in the listing, so a listing larger than one
+ * reply continues where it stopped (see fs_core_readdir)
+ */
+static int razorfs_mt_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                              off_t offset, struct fuse_file_info *fi,
+                              enum fuse_readdir_flags flags) {
+    struct mt_dir_fill fill = {
+        .buf = buf,
+        .filler = filler,
+        .plus = (flags & FUSE_READDIR_PLUS) != 0,
+    };
+
+    int stats = lookup_stats_path(path);
+    if (stats != -1) {
+        if (stats < 0) {
+            return stats;
+        }
+        return stats == FS_CORE_STATS_ROOT ?
+               fs_core_stats_list(&g_mt_fs, offset, mt_add_dirent, &fill) : -ENOTDIR;
+    }
 
-        /* We need to read child info, but nary_read_node_mt acquires its own lock */
-        struct nary_node child_node;
-        if (nary_read_node_mt(&g_mt_fs.tree, child_idx, &child_node) == 0) {
-            const char *name = string_table_get(&g_mt_fs.tree.strings, child_node.name_offset);
-            if (name) {
-                filler(buf, name, NULL, 0, 0);
-            }
+    if (under_snapshots(path)) {
+        uint32_t id, idx;
+        int ret = lookup_snapshot_path(path, &id, &idx);
+        if (ret != 0) {
+            return ret;
         }
+        if (id == 0) {
+            return fs_core_snapshot_list(&g_mt_fs, offset, mt_add_dirent, &fill);
+        }
+        return fs_core_snapshot_readdir(&g_mt_fs, id, idx, fi ? fi->fh : 0, offset,
+                                        mt_add_dirent, &fill);
+    }
+
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    nary_unlock(&g_mt_fs.tree, idx);
+    return fs_core_readdir(&g_mt_fs, idx, fi ? fi->fh : 0, offset, mt_add_dirent, &fill);
+}
+
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_releasedir(const char *path, struct fuse_file_info *fi) {
+    (void) path;
+
+    fs_core_releasedir(&g_mt_fs, fi->fh);
     return 0;
 }
 
@@ -305,57 +378,42 @@ static int razorfs_mt_mkdir(const char *path, mode_t mode) {
         return -EINVAL;
     }
 
-    uint16_t parent_idx = nary_path_lookup_mt(&g_mt_fs.tree, parent_path);
-    if (parent_idx == NARY_INVALID_IDX) {
-        return -ENOENT;
+    /* mkdir /.snapshots/<name> takes a snapshot */
+    if (strcmp(parent_path, SNAPSHOTS_PATH) == 0) {
+        return fs_core_snapshot_create(&g_mt_fs, name);
     }
-
-    uint16_t new_idx = nary_insert_mt(&g_mt_fs.tree, parent_idx, name, S_IFDIR | mode);
-    if (new_idx == NARY_INVALID_IDX) {
-        return -EEXIST;  /* Or ENOSPC if full */
+    if (under_snapshots(parent_path)) {
+        return -EROFS;
     }
 
-    if (g_mt_fs.wal_enabled) {
-        struct nary_node node;
-        if (nary_read_node_mt(&g_mt_fs.tree, new_idx, &node) == 0) {
-            struct wal_insert_data insert_data = {
-                .parent_idx = parent_idx,
-                .inode = node.inode,
-                .name_offset = node.name_offset,
-                .mode = node.mode,
-                .timestamp = node.mtime,
-            };
-            wal_log_insert(&g_mt_fs.wal, 0, &insert_data);
-        }
+    uint32_t parent_idx = lookup_path(parent_path);
+    if (parent_idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    /* Sync string table to ensure persistence */
-    sync_string_table();
-
-    return 0;
+    return fs_core_mkdir(&g_mt_fs, parent_idx, name, mode, NULL);
 }
 
 static int razorfs_mt_rmdir(const char *path) {
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
-    if (idx == NARY_INVALID_IDX) {
-        return -ENOENT;
-    }
-
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
+    if (under_snapshots(path)) {
+        /* rmdir /.snapshots/<name> drops the snapshot */
+        char parent_path[PATH_MAX];
+        char name[MAX_FILENAME_LENGTH];
+        if (split_path(path, parent_path, name) != 0) {
+            return -EINVAL;
+        }
+        if (strcmp(parent_path, SNAPSHOTS_PATH) == 0) {
+            return fs_core_snapshot_delete(&g_mt_fs, name);
+        }
+        return strcmp(path, SNAPSHOTS_PATH) == 0 ? -EBUSY : -EROFS;
     }
 
-    if (!NARY_IS_DIR(&node)) {
-        return -ENOTDIR;
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    int result = nary_delete_mt(&g_mt_fs.tree, idx, &g_mt_fs.wal, g_mt_fs.wal_enabled);
-    switch (result) {
-        case 0:      return 0;
-        case -ENOTEMPTY: return -ENOTEMPTY;
-        default:     return -EIO;
-    }
+    return fs_core_rmdir(&g_mt_fs, idx);
 }
 
 static int razorfs_mt_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
@@ -365,345 +423,179 @@ static int razorfs_mt_create(const char *path, mode_t mode, struct fuse_file_inf
     if (split_path(path, parent_path, name) != 0) {
         return -EINVAL;
     }
+    if (under_snapshots(parent_path)) {
+        return -EROFS;
+    }
 
-    uint16_t parent_idx = nary_path_lookup_mt(&g_mt_fs.tree, parent_path);
+    uint32_t parent_idx = lookup_path(parent_path);
     if (parent_idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
 
-    uint16_t new_idx = nary_insert_mt(&g_mt_fs.tree, parent_idx, name, S_IFREG | mode);
-    if (new_idx == NARY_INVALID_IDX) {
-        return -EEXIST;
-    }
-
-    /* Create file data storage */
     struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, new_idx, &node) != 0) {
-        nary_delete_mt(&g_mt_fs.tree, new_idx, &g_mt_fs.wal, g_mt_fs.wal_enabled);
-        return -EIO;
-    }
-
-    if (!create_file_data(node.inode)) {
-        nary_delete_mt(&g_mt_fs.tree, new_idx, &g_mt_fs.wal, g_mt_fs.wal_enabled);
-        return -ENOMEM;
+    int ret = fs_core_create(&g_mt_fs, parent_idx, name, mode, &node);
+    if (ret != 0) {
+        return ret;
     }
 
     /* Set file handle to inode for subsequent operations */
     fi->fh = node.inode;
-
-    /* Sync string table to ensure persistence */
-    sync_string_table();
-
     return 0;
 }
 
 static int razorfs_mt_unlink(const char *path) {
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
-    if (idx == NARY_INVALID_IDX) {
-        return -ENOENT;
-    }
-
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
-    }
-
-    if (!NARY_IS_FILE(&node)) {
-        return -EISDIR;
-    }
-
-    uint32_t inode = node.inode;
-
-    int result = nary_delete_mt(&g_mt_fs.tree, idx, &g_mt_fs.wal, g_mt_fs.wal_enabled);
-    if (result != 0) {
-        return -EIO;
+    if (under_snapshots(path)) {
+        return -EROFS;
     }
 
-    remove_file_data(inode);
-
-    return 0;
-}
-
-static int razorfs_mt_open(const char *path, struct fuse_file_info *fi) {
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    uint32_t idx = lookup_path(path);
     if (idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
 
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
-    }
+    return fs_core_unlink(&g_mt_fs, idx);
+}
 
-    if (!NARY_IS_FILE(&node)) {
-        return -EISDIR;
+static int razorfs_mt_open(const char *path, struct fuse_file_info *fi) {
+    int stats = lookup_stats_path(path);
+    if (stats != -1) {
+        if (stats < 0) {
+            return stats;
+        }
+        /* Sized 0 in getattr: the kernel must not cut reads short */
+        fi->direct_io = 1;
+        return fs_core_stats_open(&g_mt_fs, (enum fs_core_stats_file)stats, fi->flags, &fi->fh);
+    }
+    if (under_snapshots(path)) {
+        uint32_t id, idx;
+        int ret = lookup_snapshot_path(path, &id, &idx);
+        if (ret != 0) {
+            return ret;
+        }
+        return id ? fs_core_snapshot_open(&g_mt_fs, id, idx, fi->flags, &fi->fh) : -EISDIR;
     }
 
-    /* Store inode in file handle for faster access */
-    fi->fh = node.inode;
-
-    /* Try to restore file data from disk if not already loaded */
-    if (find_file_data(node.inode) == NULL && node.size > 0) {
-        void *data = NULL;
-        size_t size = 0;
-        size_t data_size = 0;
-        int is_file_compressed = 0;
-
-        if (disk_file_data_restore(node.inode, &data, &size,
-                                   &data_size, &is_file_compressed) == 0) {
-            /* Successfully restored - create file data structure */
-            struct mt_file_data *fd = create_file_data(node.inode);
-            if (fd) {
-                pthread_rwlock_wrlock(&fd->data_lock);
-                fd->data = data;
-                fd->size = size;
-                fd->capacity = data_size;
-                fd->is_compressed = is_file_compressed;
-                fd->uncompressed_size = is_file_compressed ? size : 0;
-                pthread_rwlock_unlock(&fd->data_lock);
-            } else {
-                free(data);  /* Failed to create fd, free the data */
-            }
-        }
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    return 0;
+    return fs_core_open_file(&g_mt_fs, idx, &fi->fh);
 }
 
-/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
-static int razorfs_mt_read(const char *path, char *buf, size_t size, off_t offset,
-                           struct fuse_file_info *fi) __attribute__((unused));
 /* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
 static int razorfs_mt_read(const char *path, char *buf, size_t size, off_t offset,
                            struct fuse_file_info *fi) {
     (void) path;  /* Use fi->fh instead */
 
-    /* Cast to const internally since callbacks can't change the signature */
-    const struct fuse_file_info * const_fi = (const struct fuse_file_info *)fi;
-    struct mt_file_data *fd = find_file_data(const_fi->fh);
-    if (!fd) {
-        return 0;  /* File has no data yet */
-    }
-
-    pthread_rwlock_rdlock(&fd->data_lock);
-
-    if (offset >= (off_t)fd->size) {
-        pthread_rwlock_unlock(&fd->data_lock);
-        return 0;  /* Read past end */
-    }
-
-    /* Check if data is compressed */
-    char *source_data = fd->data;
-    size_t source_size = fd->size;
-    void *decompressed = NULL;
-
-    if (fd->is_compressed) {
-        size_t decompressed_size;
-        decompressed = decompress_data(fd->data, fd->capacity, &decompressed_size);
-
-        if (decompressed) {
-            source_data = decompressed;
-            source_size = fd->uncompressed_size;
-        }
-    }
-
-    size_t available = source_size - offset;
-    size_t to_read = size < available ? size : available;
-
-    memcpy(buf, source_data + offset, to_read);
-
-    if (decompressed) {
-        free(decompressed);
-    }
-
-    pthread_rwlock_unlock(&fd->data_lock);
-
-    return to_read;
+    return (int)fs_core_read(&g_mt_fs, fi->fh, buf, size, offset);
 }
 
 /* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
 static int razorfs_mt_write(const char *path, const char *buf, size_t size,
                             off_t offset, struct fuse_file_info *fi) {
-    /* Input validation */
     if (size == 0) {
         return 0;  /* Nothing to write */
     }
-    if (offset < 0) {
-        return -EINVAL;
+    if (under_snapshots(path)) {
+        return -EROFS;
     }
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    uint32_t idx = lookup_path(path);
     if (idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
 
-    /* Calculate required capacity with overflow check */
-    size_t required;
-    if (__builtin_add_overflow((size_t)offset, size, &required)) {
-        return -EFBIG;  /* File too large */
-    }
-
-    /* Get old size for WAL */
-    uint64_t old_size = 0;
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) == 0) {
-        old_size = node.size;
-    }
-
-    if (g_mt_fs.wal_enabled) {
-        struct wal_write_data write_data = {
-            .node_idx = idx,
-            .inode = fi->fh,
-            .offset = offset,
-            .length = size,
-            .old_size = old_size,
-            .new_size = required,
-            .data_checksum = wal_crc32(buf, size),
-        };
-        wal_log_write(&g_mt_fs.wal, 0, &write_data);
-    }
-
-    /* Cast to const internally since callbacks can't change the signature */
-    const struct fuse_file_info * const_fi = (const struct fuse_file_info *)fi;
-    struct mt_file_data *fd = find_file_data(const_fi->fh);
-    if (!fd) {
-        /* First write to this file */
-        fd = create_file_data(fi->fh);
-        if (!fd) return -ENOMEM;
-    }
-
-    pthread_rwlock_wrlock(&fd->data_lock);
-
-    /* Decompress if currently compressed - we need uncompressed data for writing */
-    if (fd->is_compressed) {
-        size_t decompressed_size;
-        void *decompressed = decompress_data(fd->data, fd->capacity, &decompressed_size);
-
-        if (decompressed) {
-            free(fd->data);
-            fd->data = decompressed;
-            fd->capacity = fd->uncompressed_size;
-            fd->size = fd->uncompressed_size;
-            fd->is_compressed = 0;
-            fd->uncompressed_size = 0;
-        }
-    }
-
-    if (required > fd->capacity) {
-        size_t new_capacity = required < 4096 ? 4096 : (required + 4095) & ~4095;
-        char *new_data = realloc(fd->data, new_capacity);
-        if (!new_data) {
-            pthread_rwlock_unlock(&fd->data_lock);
-            return -ENOMEM;
-        }
-
-        fd->data = new_data;
-        fd->capacity = new_capacity;
-    }
+    return (int)fs_core_write(&g_mt_fs, idx, fi->fh, buf, size, offset);
+}
 
-    /* Write data */
-    memcpy(fd->data + offset, buf, size);
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_flush(const char *path, struct fuse_file_info *fi) {
+    (void) path;
 
-    /* Update size if we extended the file */
-    if (required > fd->size) {
-        fd->size = required;
-    }
+    return fs_core_flush(&g_mt_fs, fi->fh);
+}
 
-    /* Only compress if file exceeds the buffer threshold - avoids compressing on every small write */
-    if (fd->size >= COMPRESSION_BUFFER_THRESHOLD && !fd->is_compressed) {
-        size_t compressed_size;
-        void *compressed = compress_data(fd->data, fd->size, &compressed_size);
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_release(const char *path, struct fuse_file_info *fi) {
+    (void) path;
 
-        if (compressed && compressed_size < fd->size) {
-            /* Compression beneficial - replace data */
-            fd->uncompressed_size = fd->size;
-            free(fd->data);
-            fd->data = compressed;
-            fd->capacity = compressed_size;
-            fd->is_compressed = 1;
-            /* Keep fd->size as original (uncompressed) size for file size tracking */
-        } else if (compressed) {
-            /* Compression not beneficial */
-            free(compressed);
-        }
-    }
+    fs_core_release(&g_mt_fs, fi->fh);
+    return 0;
+}
 
-    /* Persist file data to disk WHILE HOLDING THE LOCK */
-    disk_file_data_save(fi->fh, fd->data, fd->size,
-                       fd->is_compressed ? fd->capacity : fd->size,
-                       fd->is_compressed);
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    (void) path;
+    (void) datasync;
 
-    pthread_rwlock_unlock(&fd->data_lock);
+    return fs_core_fsync(&g_mt_fs, fi->fh);
+}
 
-    /* Update node size separately */
-    if (idx != NARY_INVALID_IDX) {
-        nary_update_size_mtime_mt(&g_mt_fs.tree, idx, fd->size, time(NULL));
-    }
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_fsyncdir(const char *path, int datasync, struct fuse_file_info *fi) {
+    (void) path;
+    (void) datasync;
+    (void) fi;
 
-    return size;
+    return fs_core_fsyncdir(&g_mt_fs);
 }
 
 static int razorfs_mt_truncate(const char *path, off_t size,
                                struct fuse_file_info *fi) {
     (void) fi;
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
-    if (idx == NARY_INVALID_IDX) {
-        return -ENOENT;
+    if (under_snapshots(path)) {
+        return -EROFS;
     }
 
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    if (!NARY_IS_FILE(&node)) {
-        return -EISDIR;
-    }
+    return fs_core_truncate(&g_mt_fs, idx, size);
+}
 
-    struct mt_file_data *fd = find_file_data(node.inode);
-    if (!fd && size == 0) {
-        /* Truncate to 0 on non-existent data is OK */
-        node.size = 0;
-        nary_update_node_mt(&g_mt_fs.tree, idx, &node);
-        return 0;
-    }
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static int razorfs_mt_fallocate(const char *path, int mode, off_t offset, off_t length,
+                                struct fuse_file_info *fi) {
+    (void) fi;
 
-    if (!fd) {
-        fd = create_file_data(node.inode);
-        if (!fd) return -ENOMEM;
+    if (under_snapshots(path)) {
+        return -EROFS;
     }
 
-    pthread_rwlock_wrlock(&fd->data_lock);
-
-    if ((size_t)size > fd->capacity) {
-        size_t new_capacity = (size + 4095) & ~4095;
-        char *new_data = realloc(fd->data, new_capacity);
-        if (!new_data) {
-            pthread_rwlock_unlock(&fd->data_lock);
-            return -ENOMEM;
-        }
-
-        /* Zero new space */
-        memset(new_data + fd->size, 0, new_capacity - fd->size);
-
-        fd->data = new_data;
-        fd->capacity = new_capacity;
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    fd->size = size;
-    pthread_rwlock_unlock(&fd->data_lock);
+    return fs_core_fallocate(&g_mt_fs, idx, mode, offset, length);
+}
 
-    /* Update node */
-    node.size = size;
-    node.mtime = time(NULL);
-    nary_update_node_mt(&g_mt_fs.tree, idx, &node);
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+/* cppcheck-suppress constParameterCallback - FUSE API requires non-const fi parameter */
+static off_t razorfs_mt_lseek(const char *path, off_t off, int whence,
+                              struct fuse_file_info *fi) {
+    (void) path;
 
-    return 0;
+    return fs_core_lseek(&g_mt_fs, fi->fh, off, whence);
 }
+#endif
 
 static int razorfs_mt_access(const char *path, int mask) {
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    int stats = lookup_stats_path(path);
+    if (stats != -1) {
+        return stats < 0 ? stats : (mask & W_OK) ? -EROFS : 0;
+    }
+    if (under_snapshots(path)) {
+        uint32_t id, idx;
+        int ret = lookup_snapshot_path(path, &id, &idx);
+        return ret != 0 ? ret : (mask & W_OK) ? -EROFS : 0;
+    }
+
+    uint32_t idx = lookup_path(path);
     if (idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
@@ -717,23 +609,16 @@ static int razorfs_mt_chmod(const char *path, mode_t mode,
                             struct fuse_file_info *fi) {
     (void) fi;
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
-    if (idx == NARY_INVALID_IDX) {
-        return -ENOENT;
+    if (under_snapshots(path)) {
+        return -EROFS;
     }
 
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    /* Update mode preserving file type bits */
-    node.mode = (node.mode & S_IFMT) | (mode & 07777);
-    node.mtime = time(NULL);
-
-    nary_update_node_mt(&g_mt_fs.tree, idx, &node);
-
-    return 0;
+    return fs_core_chmod(&g_mt_fs, idx, mode);
 }
 
 static int razorfs_mt_chown(const char *path, uid_t uid, gid_t gid,
@@ -747,116 +632,245 @@ static int razorfs_mt_chown(const char *path, uid_t uid, gid_t gid,
 }
 
 static int razorfs_mt_rename(const char *from, const char *to, unsigned int flags) {
-    /* Simple rename: same-directory only for now */
     char from_parent[PATH_MAX], from_name[MAX_FILENAME_LENGTH];
     char to_parent[PATH_MAX], to_name[MAX_FILENAME_LENGTH];
 
     if (split_path(from, from_parent, from_name) != 0) return -EINVAL;
     if (split_path(to, to_parent, to_name) != 0) return -EINVAL;
-
-    /* Only support same-directory renames for simplicity */
-    if (strcmp(from_parent, to_parent) != 0) {
-        return -EXDEV;  /* Cross-directory not supported yet */
-    }
+    if (under_snapshots(from) || under_snapshots(to)) return -EROFS;
 
     /* Lookup source */
-    uint16_t from_idx = nary_path_lookup_mt(&g_mt_fs.tree, from);
+    uint32_t from_idx = lookup_path(from);
     if (from_idx == NARY_INVALID_IDX) return -ENOENT;
-    if (from_idx == NARY_ROOT_IDX) return -EBUSY;
 
-    /* Check if destination exists */
-    uint16_t parent_idx = nary_path_lookup_mt(&g_mt_fs.tree, from_parent);
-    uint16_t to_idx = nary_find_child_mt(&g_mt_fs.tree, parent_idx, to_name);
+    uint32_t parent_idx = lookup_path(from_parent);
+    if (parent_idx == NARY_INVALID_IDX) return -ENOENT;
+
+    uint32_t new_parent_idx = lookup_path(to_parent);
+    if (new_parent_idx == NARY_INVALID_IDX) return -ENOENT;
+
+    return fs_core_rename(&g_mt_fs, parent_idx, from_idx, new_parent_idx, to_name, flags);
+}
+
+static int razorfs_mt_utimens(const char *path, const struct timespec tv[2],
+                               struct fuse_file_info *fi) {
+    (void) fi;
+
+    if (under_snapshots(path)) {
+        return -EROFS;
+    }
 
-    if (to_idx != NARY_INVALID_IDX && to_idx != from_idx) {
-        if (flags & RENAME_NOREPLACE) return -EEXIST;
-        /* Would need to delete destination - skip for now */
-        return -EEXIST;
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    /* Update name */
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, from_idx, &node) != 0) return -EIO;
+    return fs_core_utimens(&g_mt_fs, idx, tv);
+}
+
+static int razorfs_mt_setxattr(const char *path, const char *name, const char *value,
+                               size_t size, int flags) {
+    if (under_snapshots(path)) {
+        return -EROFS;
+    }
+
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
 
-    node.name_offset = string_table_intern(&g_mt_fs.tree.strings, to_name);
-    node.mtime = time(NULL);
+    return fs_core_setxattr(&g_mt_fs, idx, name, value, size, flags);
+}
 
-    int result = nary_update_node_mt(&g_mt_fs.tree, from_idx, &node);
+static int razorfs_mt_getxattr(const char *path, const char *name, char *value,
+                               size_t size) {
+    if (under_snapshots(path)) {
+        return -ENODATA;  /* Extended attributes are not part of snapshots */
+    }
 
-    /* Sync string table to ensure persistence */
-    sync_string_table();
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
 
-    return result;
+    return fs_core_getxattr(&g_mt_fs, idx, name, value, size);
 }
 
-static int razorfs_mt_utimens(const char *path, const struct timespec tv[2],
-                               struct fuse_file_info *fi) {
-    (void) fi;
+static int razorfs_mt_listxattr(const char *path, char *list, size_t size) {
+    if (under_snapshots(path)) {
+        return 0;
+    }
 
-    uint16_t idx = nary_path_lookup_mt(&g_mt_fs.tree, path);
+    uint32_t idx = lookup_path(path);
     if (idx == NARY_INVALID_IDX) {
         return -ENOENT;
     }
 
-    struct nary_node node;
-    if (nary_read_node_mt(&g_mt_fs.tree, idx, &node) != 0) {
-        return -EIO;
-    }
-
-    /* Update modification time */
-    if (tv) {
-        /* tv[0] is atime, tv[1] is mtime */
-        /* We only track mtime in our simple implementation */
-        if (tv[1].tv_nsec == UTIME_NOW) {
-            node.mtime = time(NULL);
-        } else if (tv[1].tv_nsec != UTIME_OMIT) {
-            node.mtime = tv[1].tv_sec;
-        }
-    } else {
-        /* NULL means set to current time */
-        node.mtime = time(NULL);
+    return fs_core_listxattr(&g_mt_fs, idx, list, size);
+}
+
+static int razorfs_mt_removexattr(const char *path, const char *name) {
+    if (under_snapshots(path)) {
+        return -EROFS;
+    }
+
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
     }
 
-    return nary_update_node_mt(&g_mt_fs.tree, idx, &node);
+    return fs_core_removexattr(&g_mt_fs, idx, name);
 }
 
-/* FUSE operations structure */
-static struct fuse_operations razorfs_mt_ops = {
-    .getattr    = razorfs_mt_getattr,
-    .readdir    = razorfs_mt_readdir,
-    .mkdir      = razorfs_mt_mkdir,
-    .rmdir      = razorfs_mt_rmdir,
-    .create     = razorfs_mt_create,
-    .unlink     = razorfs_mt_unlink,
-    .open       = razorfs_mt_open,
-    .read       = razorfs_mt_read,
-    .write      = razorfs_mt_write,
-    .truncate   = razorfs_mt_truncate,
-    .access     = razorfs_mt_access,
-    .chmod      = razorfs_mt_chmod,
-    .chown      = razorfs_mt_chown,
-    .rename     = razorfs_mt_rename,
-    .utimens    = razorfs_mt_utimens,
-};
+static int razorfs_mt_ioctl(const char *path, int cmd, void *arg,
+                            struct fuse_file_info *fi, unsigned int flags, void *data) {
+    (void) arg;
+    (void) fi;
 
-/* Helper function to periodically sync string table to disk */
-static void sync_string_table(void) {
-    if (disk_string_table_save(&g_mt_fs.tree.strings, DISK_STRING_TABLE) != 0) {
-        fprintf(stderr, "Warning: Failed to sync string table to disk\n");
+    if (flags & FUSE_IOCTL_COMPAT) {
+        return -ENOSYS;
     }
+    if ((unsigned int)cmd != FS_CORE_IOC_CREATE_BATCH) {
+        return -ENOTTY;
+    }
+    if (under_snapshots(path)) {
+        return -EROFS;
+    }
+
+    uint32_t idx = lookup_path(path);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
+
+    return fs_core_ioctl_create_batch(&g_mt_fs, idx, data);
 }
 
+/* === Per-Operation Latency (see metrics.h) === */
+
+#define MT_TIMED(ret_t, op, hist, params, args)           \
+    static ret_t razorfs_mt_##op##_timed params {         \
+        uint64_t start = metrics_start();                 \
+        ret_t ret = razorfs_mt_##op args;                 \
+        metrics_record_since(hist, start);                \
+        return ret;                                       \
+    }
+
+typedef struct fuse_file_info ffi_t;
+
+MT_TIMED(int, getattr, METRICS_OP_GETATTR,
+         (const char *p, struct stat *st, ffi_t *fi), (p, st, fi))
+MT_TIMED(int, opendir, METRICS_OP_OPENDIR, (const char *p, ffi_t *fi), (p, fi))
+MT_TIMED(int, readdir, METRICS_OP_READDIR,
+         (const char *p, void *buf, fuse_fill_dir_t filler, off_t off, ffi_t *fi,
+          enum fuse_readdir_flags flags), (p, buf, filler, off, fi, flags))
+MT_TIMED(int, releasedir, METRICS_OP_RELEASEDIR, (const char *p, ffi_t *fi), (p, fi))
+MT_TIMED(int, mkdir, METRICS_OP_MKDIR, (const char *p, mode_t mode), (p, mode))
+MT_TIMED(int, rmdir, METRICS_OP_RMDIR, (const char *p), (p))
+MT_TIMED(int, create, METRICS_OP_CREATE, (const char *p, mode_t mode, ffi_t *fi), (p, mode, fi))
+MT_TIMED(int, unlink, METRICS_OP_UNLINK, (const char *p), (p))
+MT_TIMED(int, open, METRICS_OP_OPEN, (const char *p, ffi_t *fi), (p, fi))
+MT_TIMED(int, read, METRICS_OP_READ,
+         (const char *p, char *buf, size_t size, off_t off, ffi_t *fi), (p, buf, size, off, fi))
+MT_TIMED(int, write, METRICS_OP_WRITE,
+         (const char *p, const char *buf, size_t size, off_t off, ffi_t *fi),
+         (p, buf, size, off, fi))
+MT_TIMED(int, flush, METRICS_OP_FLUSH, (const char *p, ffi_t *fi), (p, fi))
+MT_TIMED(int, release, METRICS_OP_RELEASE, (const char *p, ffi_t *fi), (p, fi))
+MT_TIMED(int, fsync, METRICS_OP_FSYNC, (const char *p, int ds, ffi_t *fi), (p, ds, fi))
+MT_TIMED(int, fsyncdir, METRICS_OP_FSYNC, (const char *p, int ds, ffi_t *fi), (p, ds, fi))
+MT_TIMED(int, truncate, METRICS_OP_TRUNCATE, (const char *p, off_t size, ffi_t *fi),
+         (p, size, fi))
+MT_TIMED(int, fallocate, METRICS_OP_FALLOCATE,
+         (const char *p, int mode, off_t off, off_t len, ffi_t *fi), (p, mode, off, len, fi))
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+MT_TIMED(off_t, lseek, METRICS_OP_LSEEK, (const char *p, off_t off, int whence, ffi_t *fi),
+         (p, off, whence, fi))
+#endif
+MT_TIMED(int, access, METRICS_OP_ACCESS, (const char *p, int mask), (p, mask))
+MT_TIMED(int, chmod, METRICS_OP_SETATTR, (const char *p, mode_t mode, ffi_t *fi), (p, mode, fi))
+MT_TIMED(int, chown, METRICS_OP_SETATTR, (const char *p, uid_t uid, gid_t gid, ffi_t *fi),
+         (p, uid, gid, fi))
+MT_TIMED(int, rename, METRICS_OP_RENAME, (const char *from, const char *to, unsigned int flags),
+         (from, to, flags))
+MT_TIMED(int, utimens, METRICS_OP_SETATTR, (const char *p, const struct timespec tv[2], ffi_t *fi),
+         (p, tv, fi))
+MT_TIMED(int, setxattr, METRICS_OP_XATTR,
+         (const char *p, const char *name, const char *value, size_t size, int flags),
+         (p, name, value, size, flags))
+MT_TIMED(int, getxattr, METRICS_OP_XATTR,
+         (const char *p, const char *name, char *value, size_t size), (p, name, value, size))
+MT_TIMED(int, listxattr, METRICS_OP_XATTR, (const char *p, char *list, size_t size),
+         (p, list, size))
+MT_TIMED(int, removexattr, METRICS_OP_XATTR, (const char *p, const char *name), (p, name))
+MT_TIMED(int, ioctl, METRICS_OP_IOCTL,
+         (const char *p, int cmd, void *arg, ffi_t *fi, unsigned int flags, void *data),
+         (p, cmd, arg, fi, flags, data))
+
+/* FUSE operations structure */
+static struct fuse_operations razorfs_mt_ops = {
+    .getattr    = razorfs_mt_getattr_timed,
+    .opendir    = razorfs_mt_opendir_timed,
+    .readdir    = razorfs_mt_readdir_timed,
+    .releasedir = razorfs_mt_releasedir_timed,
+    .mkdir      = razorfs_mt_mkdir_timed,
+    .rmdir      = razorfs_mt_rmdir_timed,
+    .create     = razorfs_mt_create_timed,
+    .unlink     = razorfs_mt_unlink_timed,
+    .open       = razorfs_mt_open_timed,
+    .read       = razorfs_mt_read_timed,
+    .write      = razorfs_mt_write_timed,
+    .flush      = razorfs_mt_flush_timed,
+    .release    = razorfs_mt_release_timed,
+    .fsync      = razorfs_mt_fsync_timed,
+    .fsyncdir   = razorfs_mt_fsyncdir_timed,
+    .truncate   = razorfs_mt_truncate_timed,
+    .fallocate  = razorfs_mt_fallocate_timed,
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    .lseek      = razorfs_mt_lseek_timed,
+#endif
+    .access     = razorfs_mt_access_timed,
+    .chmod      = razorfs_mt_chmod_timed,
+    .chown      = razorfs_mt_chown_timed,
+    .rename     = razorfs_mt_rename_timed,
+    .utimens    = razorfs_mt_utimens_timed,
+    .setxattr   = razorfs_mt_setxattr_timed,
+    .getxattr   = razorfs_mt_getxattr_timed,
+    .listxattr  = razorfs_mt_listxattr_timed,
+    .removexattr = razorfs_mt_removexattr_timed,
+    .ioctl      = razorfs_mt_ioctl_timed,
+};
+
 /* === Initialization and Cleanup === */
 
 static void *razorfs_mt_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
-    (void) conn;
-
-    /* Disable kernel caching for development */
-    cfg->kernel_cache = 0;
-    cfg->auto_cache = 0;
+    /* Larger requests: fewer round trips through the daemon */
+    conn->max_write = g_mt_opts.io_size;
+    conn->max_readahead = g_mt_opts.io_size;
+
+    if (g_mt_opts.kernel_cache) {
+        /* The daemon is the only writer, so the kernel may keep pages
+         * across opens and trust names and attributes for a while. */
+        cfg->kernel_cache = 1;
+        cfg->auto_cache = 0;
+        cfg->entry_timeout = g_mt_opts.cache_timeout;
+        cfg->negative_timeout = g_mt_opts.cache_timeout;
+        cfg->attr_timeout = g_mt_opts.cache_timeout;
+
+        unsigned int want = FUSE_CAP_WRITEBACK_CACHE | FUSE_CAP_SPLICE_READ |
+                            FUSE_CAP_SPLICE_WRITE | FUSE_CAP_SPLICE_MOVE;
+        conn->want |= conn->capable & want;
+    } else {
+        /* Every read and lookup goes to the daemon */
+        cfg->kernel_cache = 0;
+        cfg->auto_cache = 0;
+    }
 
     printf("🚀 RAZORFS Phase 3 initialized - Multithreaded N-ary Tree\n");
-    
+    printf("   Kernel cache: %s\n", g_mt_opts.kernel_cache ? "on" : "off");
+
+    /* Worker threads must start here, after FUSE has daemonized */
+    fs_core_start(&g_mt_fs, &g_mt_opts);
+
     /* Print MT statistics */
     struct nary_mt_stats stats;
     nary_get_mt_stats(&g_mt_fs.tree, &stats);
@@ -871,105 +885,53 @@ static void razorfs_mt_destroy(void *private_data) {
 
     printf("💾 Shutting down RAZORFS MT\n");
 
-    /* Checkpoint and destroy WAL */
-    if (g_mt_fs.wal_enabled) {
-        printf("📝 Checkpointing WAL...\n");
-        wal_checkpoint(&g_mt_fs.wal);
-        wal_destroy(&g_mt_fs.wal);
-        printf("✅ WAL closed cleanly\n");
-    }
+    struct path_cache_stats dstats;
+    path_cache_get_stats(&g_mt_dcache, &dstats);
+    printf("   Path cache: %lu hits, %lu misses\n", dstats.hits, dstats.misses);
+    g_mt_fs.dcache = NULL;
+    path_cache_destroy(&g_mt_dcache);
 
-    /* Print final statistics */
-    struct nary_mt_stats stats;
-    nary_get_mt_stats(&g_mt_fs.tree, &stats);
-    printf("   Final MT Stats: %lu total nodes, %lu read locks, %lu write locks, %lu conflicts\n",
-           stats.total_nodes, stats.read_locks, stats.write_locks, stats.lock_conflicts);
-
-    /* Free file data with proper locking */
-    pthread_rwlock_wrlock(&g_mt_fs.files_lock);
-    for (uint32_t i = 0; i < g_mt_fs.file_count; i++) {
-        pthread_rwlock_wrlock(&g_mt_fs.files[i].data_lock);
-        if (g_mt_fs.files[i].data) {
-            free(g_mt_fs.files[i].data);
-            g_mt_fs.files[i].data = NULL;  /* Prevent double-free */
-        }
-        pthread_rwlock_unlock(&g_mt_fs.files[i].data_lock);
-        /* Destroy lock while still holding files_lock to prevent race */
-        pthread_rwlock_destroy(&g_mt_fs.files[i].data_lock);
-    }
-
-    if (g_mt_fs.files) {
-        free(g_mt_fs.files);
-        g_mt_fs.files = NULL;
-    }
-    g_mt_fs.file_count = 0;
-    g_mt_fs.file_capacity = 0;
-
-    pthread_rwlock_unlock(&g_mt_fs.files_lock);
-    pthread_rwlock_destroy(&g_mt_fs.files_lock);
-
-    /* Detach from shared memory (data persists) */
-    shm_tree_detach(&g_mt_fs.tree);
+    fs_core_close(&g_mt_fs);
+#ifdef RAZORFS_WITH_S3
+    if (g_mt_opts.tier_backend) s3_backend_shutdown(&g_s3);
+#endif
 }
 
 int main(int argc, char *argv[]) {
     /* Initialize multithreaded filesystem */
     memset(&g_mt_fs, 0, sizeof(g_mt_fs));
 
-    /* Initialize WAL for crash recovery */
-    const char *wal_path = "/tmp/razorfs_wal.log";
-    printf("📝 Initializing Write-Ahead Log: %s\n", wal_path);
-
-    if (wal_init_file(&g_mt_fs.wal, wal_path, WAL_DEFAULT_SIZE) == 0) {
-        g_mt_fs.wal_enabled = 1;
-        printf("✅ WAL enabled (crash recovery active)\n");
-
-        /* Check if recovery is needed */
-        if (wal_needs_recovery(&g_mt_fs.wal)) {
-            printf("⚠️  Dirty WAL detected - recovery needed\n");
-            printf("   (Recovery will run after tree initialization)\n");
-        }
-    } else {
-        g_mt_fs.wal_enabled = 0;
-        fprintf(stderr, "⚠️  WAL initialization failed - running without crash recovery\n");
-        fprintf(stderr, "   Data will NOT survive power loss/crashes\n");
+    /* Parse razorfs-specific mount options, pass the rest to FUSE */
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    if (fuse_opt_parse(&args, &g_mt_opts, razorfs_mt_opts, NULL) == -1) {
+        fprintf(stderr, "Failed to parse mount options\n");
+        return 1;
     }
-
-    /* Use DISK-BACKED storage for true persistence (survives reboot) */
-    if (disk_tree_init(&g_mt_fs.tree) != 0) {
-        fprintf(stderr, "Failed to initialize persistent tree\n");
-        if (g_mt_fs.wal_enabled) {
-            wal_destroy(&g_mt_fs.wal);
-        }
+#ifdef RAZORFS_WITH_S3
+    if (fuse_opt_parse(&args, &g_s3_opts, razorfs_s3_opts, NULL) == -1 ||
+        setup_s3_tier() != 0) {
+        fuse_opt_free_args(&args);
         return 1;
     }
+#endif
 
-    /* Run recovery if needed */
-    if (g_mt_fs.wal_enabled && wal_needs_recovery(&g_mt_fs.wal)) {
-        printf("🔧 Running crash recovery...\n");
-
-        struct recovery_ctx recovery;
-        if (recovery_init(&recovery, &g_mt_fs.wal, &g_mt_fs.tree, &g_mt_fs.tree.strings) == 0) {
-            if (recovery_run(&recovery) == 0) {
-                printf("✅ Recovery completed successfully\n");
-            } else {
-                fprintf(stderr, "⚠️  Recovery failed - filesystem may be inconsistent\n");
-            }
-            recovery_destroy(&recovery);
-        } else {
-            fprintf(stderr, "⚠️  Recovery initialization failed\n");
-        }
+    /* NUMA placement applies from the first mapping on */
+    if (fs_core_set_placement(&g_mt_opts) != 0) {
+        fuse_opt_free_args(&args);
+        return 1;
     }
 
-    /* Initialize file management */
-    g_mt_fs.files = NULL;
-    g_mt_fs.file_count = 0;
-    g_mt_fs.file_capacity = 0;
-    pthread_rwlock_init(&g_mt_fs.files_lock, NULL);
+    /* WAL, persistent tree and crash recovery */
+    if (fs_core_open(&g_mt_fs, FS_CORE_WAL_PATH, &g_mt_opts) != 0) {
+        fuse_opt_free_args(&args);
+        return 1;
+    }
 
-    /* Initialize hash table */
-    for (int i = 0; i < FILE_HASH_TABLE_SIZE; i++) {
-        g_mt_fs.file_hash_table[i] = NULL;
+    /* Without the dentry cache every lookup walks the tree */
+    if (path_cache_init(&g_mt_dcache) != 0) {
+        fprintf(stderr, "⚠️  Path cache unavailable - resolving every path from the root\n");
+    } else {
+        g_mt_fs.dcache = &g_mt_dcache;
     }
 
     printf("✅ RAZORFS Phase 6+ - Persistent Multithreaded Filesystem with WAL\n");
@@ -987,7 +949,8 @@ int main(int argc, char *argv[]) {
     razorfs_mt_ops.destroy = razorfs_mt_destroy;
 
     /* Run FUSE */
-    int ret = fuse_main(argc, argv, &razorfs_mt_ops, NULL);
+    int ret = fuse_main(args.argc, args.argv, &razorfs_mt_ops, NULL);
+    fuse_opt_free_args(&args);
 
     return ret;
-}
\ No newline at end of file
+}
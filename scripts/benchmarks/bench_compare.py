@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""
+bench_compare.py
+Compare a razorfs_bench JSON result against a baseline and flag regressions
+
+A workload (name, data kind, thread count) regresses when its throughput
+drops, or its p99 latency rises, by more than the threshold percentage.
+Exit status: 0 = no regression, 1 = regression, 2 = unusable input.
+
+Usage: bench_compare.py BASELINE.json CURRENT.json [--threshold PCT]
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    """Results of one run, keyed by (name, data, threads)"""
+    try:
+        with open(path) as f:
+            doc = json.load(f)
+    except (OSError, ValueError) as e:
+        print(f"❌ Cannot read {path}: {e}", file=sys.stderr)
+        sys.exit(2)
+    return doc, {(r['name'], r['data'], r['threads']): r for r in doc.get('results', [])}
+
+
+def change(base, cur):
+    """Relative change in percent (0 when the baseline is 0)"""
+    return (cur - base) / base * 100.0 if base else 0.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument('baseline')
+    parser.add_argument('current')
+    parser.add_argument('--threshold', type=float, default=10.0,
+                        help='allowed change in percent (default: 10)')
+    args = parser.parse_args()
+
+    base_doc, base = load(args.baseline)
+    cur_doc, cur = load(args.current)
+    if base_doc.get('config') != cur_doc.get('config'):
+        print("⚠️  Runs used different configurations; comparing the common workloads")
+
+    print(f"Baseline: {base_doc.get('label') or args.baseline}")
+    print(f"Current:  {cur_doc.get('label') or args.current}")
+    print(f"{'workload':<32} {'ops/s':>12} {'Δ%':>8} {'p99 us':>10} {'Δ%':>8}")
+
+    regressions = []
+    for key in sorted(base.keys() & cur.keys(), key=lambda k: (k[2], k[0], k[1])):
+        b, c = base[key], cur[key]
+        tput = change(b['ops_per_sec'], c['ops_per_sec'])
+        p99 = change(b['latency_us']['p99'], c['latency_us']['p99'])
+        mark = ''
+        if tput < -args.threshold or p99 > args.threshold:
+            regressions.append(key)
+            mark = '  ❌'
+        name = f"{key[0]}/{key[1]}/{key[2]}t"
+        print(f"{name:<32} {c['ops_per_sec']:>12.0f} {tput:>+8.1f} "
+              f"{c['latency_us']['p99']:>10.1f} {p99:>+8.1f}{mark}")
+
+    for key in sorted(base.keys() - cur.keys()):
+        print(f"⚠️  Missing from current run: {key[0]}/{key[1]}/{key[2]}t")
+
+    if regressions:
+        print(f"❌ {len(regressions)} workload(s) regressed beyond {args.threshold:g}%")
+        return 1
+    print(f"✅ No regression beyond {args.threshold:g}%")
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,108 @@
+#!/bin/bash
+# run_bench.sh - Reproducible end-to-end benchmark of a mounted razorfs
+#
+# Mounts ./razorfs (the multithreaded front end), runs the fixed workload
+# matrix of tests/benchmarks/razorfs_bench.c and stores the JSON result.
+# With BENCH_BASELINE set, the result is compared against that file and
+# the script fails on a regression. Normally run through `make bench`.
+#
+# Environment:
+#   BENCH_THREADS      Highest thread count (default: CPU count)
+#   BENCH_FILES        Entries per thread, metadata workloads (default: 2000)
+#   BENCH_FILE_MB      File size per thread, data workloads (default: 64)
+#   BENCH_IO_OPS       Random I/Os per thread (default: 4096)
+#   BENCH_ONLY         Workload subset, e.g. metadata_storm,lookup,seq (default: all)
+#   BENCH_MOUNT_OPTS   Extra razorfs options, e.g. "-o io_engine=uring"
+#   BENCH_OUT          Result file (default: benchmarks/results/bench_<git>_<time>.json)
+#   BENCH_BASELINE     Baseline JSON to compare against
+#   BENCH_THRESHOLD    Allowed regression in percent (default: 10)
+
+set -e
+
+REPO_ROOT="$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)"
+TIMESTAMP=$(date +%Y%m%d_%H%M%S)
+GIT_SHORT_HASH=$(git -C "$REPO_ROOT" rev-parse --short HEAD 2>/dev/null || echo unknown)
+
+BENCH_THREADS=${BENCH_THREADS:-$(nproc)}
+BENCH_FILES=${BENCH_FILES:-2000}
+BENCH_FILE_MB=${BENCH_FILE_MB:-64}
+BENCH_IO_OPS=${BENCH_IO_OPS:-4096}
+BENCH_THRESHOLD=${BENCH_THRESHOLD:-10}
+BENCH_OUT=${BENCH_OUT:-$REPO_ROOT/benchmarks/results/bench_${GIT_SHORT_HASH}_${TIMESTAMP}.json}
+
+RAZORFS="$REPO_ROOT/razorfs"
+BENCH_BIN="$REPO_ROOT/razorfs_bench"
+
+# Colors
+GREEN='\033[0;32m'
+BLUE='\033[0;34m'
+YELLOW='\033[1;33m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+for bin in "$RAZORFS" "$BENCH_BIN"; do
+    if [ ! -x "$bin" ]; then
+        echo -e "${RED}❌ $bin not found (run: make release razorfs_bench)${NC}"
+        exit 1
+    fi
+done
+
+MOUNT_POINT=$(mktemp -d /tmp/razorfs_bench_mnt.XXXXXX)
+RAZORFS_PID=""
+
+cleanup() {
+    if mountpoint -q "$MOUNT_POINT"; then
+        fusermount3 -u "$MOUNT_POINT" 2>/dev/null || true
+    fi
+    if [ -n "$RAZORFS_PID" ]; then
+        wait "$RAZORFS_PID" 2>/dev/null || true
+    fi
+    rmdir "$MOUNT_POINT" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+echo -e "${BLUE}═══════════════════════════════════════════════════════════════${NC}"
+echo -e "${BLUE}   RazorFS End-to-End Benchmark${NC}"
+echo -e "${BLUE}═══════════════════════════════════════════════════════════════${NC}"
+echo -e "Git Commit: ${YELLOW}${GIT_SHORT_HASH}${NC}"
+echo -e "Threads:    ${YELLOW}1..${BENCH_THREADS}${NC}"
+echo -e "Output:     ${YELLOW}${BENCH_OUT}${NC}"
+echo ""
+
+# Mount in the foreground (backgrounded here) so the PID is the daemon's
+# shellcheck disable=SC2086
+"$RAZORFS" "$MOUNT_POINT" -f $BENCH_MOUNT_OPTS > "${BENCH_OUT%.json}.log" 2>&1 &
+RAZORFS_PID=$!
+for _ in $(seq 1 50); do
+    mountpoint -q "$MOUNT_POINT" && break
+    if ! kill -0 "$RAZORFS_PID" 2>/dev/null; then
+        break
+    fi
+    sleep 0.1
+done
+if ! mountpoint -q "$MOUNT_POINT"; then
+    echo -e "${RED}❌ Mount failed, see ${BENCH_OUT%.json}.log${NC}"
+    exit 1
+fi
+echo -e "${GREEN}✓${NC} Mounted at $MOUNT_POINT (PID $RAZORFS_PID)"
+
+mkdir -p "$(dirname "$BENCH_OUT")"
+ONLY_ARGS=()
+if [ -n "$BENCH_ONLY" ]; then
+    ONLY_ARGS=(--only "$BENCH_ONLY")
+fi
+"$BENCH_BIN" --dir "$MOUNT_POINT" \
+    --threads "$BENCH_THREADS" \
+    --files "$BENCH_FILES" \
+    --file-mb "$BENCH_FILE_MB" \
+    --io-ops "$BENCH_IO_OPS" \
+    --label "$GIT_SHORT_HASH $BENCH_MOUNT_OPTS" \
+    --json "$BENCH_OUT" \
+    "${ONLY_ARGS[@]}"
+echo -e "${GREEN}✓${NC} Results: $BENCH_OUT"
+
+if [ -n "$BENCH_BASELINE" ]; then
+    echo ""
+    python3 "$REPO_ROOT/scripts/benchmarks/bench_compare.py" \
+        "$BENCH_BASELINE" "$BENCH_OUT" --threshold "$BENCH_THRESHOLD"
+fi
@@ -46,7 +46,7 @@ int main(int argc, char **argv) {
     
     if (argc > 1) {
         // Fuzz path lookup function for security issues
-        uint16_t result = nary_path_lookup_mt(&tree, argv[1]);
+        uint32_t result = nary_path_lookup_mt(&tree, argv[1]);
         (void)result; // Suppress unused warning
     }
     
@@ -0,0 +1,308 @@
+/**
+ * Background Compression Pool Implementation - RAZORFS File Data
+ */
+
+#define _GNU_SOURCE
+#include "compress_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline uint32_t hash_inode(uint32_t inode) {
+    return inode % COMPRESS_POOL_HASH_SIZE;
+}
+
+/* === Queue helpers (pool->lock held) === */
+
+static struct compress_pool_entry *find_entry(struct compress_pool *pool, uint32_t inode) {
+    struct compress_pool_entry *e = pool->hash[hash_inode(inode)];
+    while (e && e->inode != inode) {
+        e = e->hash_next;
+    }
+    return e;
+}
+
+static void list_unlink(struct compress_pool *pool, struct compress_pool_entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else pool->head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else pool->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void list_push_tail(struct compress_pool *pool, struct compress_pool_entry *e) {
+    e->next = NULL;
+    e->prev = pool->tail;
+    if (pool->tail) pool->tail->next = e;
+    else pool->head = e;
+    pool->tail = e;
+}
+
+static void list_push_head(struct compress_pool *pool, struct compress_pool_entry *e) {
+    e->prev = NULL;
+    e->next = pool->head;
+    if (pool->head) pool->head->prev = e;
+    else pool->tail = e;
+    pool->head = e;
+}
+
+static void hash_remove(struct compress_pool *pool, struct compress_pool_entry *e) {
+    struct compress_pool_entry **pp = &pool->hash[hash_inode(e->inode)];
+    while (*pp && *pp != e) {
+        pp = &(*pp)->hash_next;
+    }
+    if (*pp) *pp = e->hash_next;
+    e->hash_next = NULL;
+}
+
+/* Queue (or re-queue) an inode at the tail with the given deadline */
+static int enqueue(struct compress_pool *pool, uint32_t inode, uint64_t ready_at) {
+    struct compress_pool_entry *e = find_entry(pool, inode);
+    if (e) {
+        list_unlink(pool, e);
+    } else {
+        e = calloc(1, sizeof(*e));
+        if (!e) return -1;
+        e->inode = inode;
+        uint32_t h = hash_inode(inode);
+        e->hash_next = pool->hash[h];
+        pool->hash[h] = e;
+        pool->stats.pending++;
+    }
+
+    e->ready_at_ms = ready_at;
+    int was_empty = pool->head == NULL;
+    list_push_tail(pool, e);
+    if (was_empty) {
+        pthread_cond_signal(&pool->wake);
+    }
+    return 0;
+}
+
+/* === Workers === */
+
+static void *worker_main(void *arg) {
+    struct compress_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running) {
+        struct compress_pool_entry *e = pool->head;
+        if (!e) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+
+        uint64_t now = now_ms();
+        if (e->ready_at_ms > now) {
+            /* Sleep until the head becomes eligible (or the queue changes) */
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            uint64_t wait = e->ready_at_ms - now;
+            deadline.tv_sec += (time_t)(wait / 1000);
+            deadline.tv_nsec += (long)(wait % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&pool->wake, &pool->lock, &deadline);
+            continue;
+        }
+
+        /* Claim the entry; a write during the callback re-queues the inode */
+        uint32_t inode = e->inode;
+        list_unlink(pool, e);
+        hash_remove(pool, e);
+        pool->stats.pending--;
+        free(e);
+
+        pool->active++;
+        pthread_mutex_unlock(&pool->lock);
+
+        int result = pool->fn(pool->ctx, inode);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->active--;
+        if (result > 0) {
+            pool->stats.retried++;
+            if (!find_entry(pool, inode)) {
+                enqueue(pool, inode, now_ms() + pool->idle_ms);
+            }
+        } else {
+            pool->stats.completed++;
+        }
+        pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* === Public API === */
+
+int compress_pool_init(struct compress_pool *pool, const struct compress_pool_config *config,
+                       compress_pool_fn fn, void *ctx) {
+    if (!pool || !fn) return -1;
+
+    memset(pool, 0, sizeof(*pool));
+    pool->thread_count = config ? config->threads : COMPRESS_POOL_DEFAULT_THREADS;
+    pool->idle_ms = config ? config->idle_ms : COMPRESS_POOL_DEFAULT_IDLE_MS;
+    if (pool->thread_count > COMPRESS_POOL_MAX_THREADS) {
+        pool->thread_count = COMPRESS_POOL_MAX_THREADS;
+    }
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->running = 1;
+
+    pthread_mutex_init(&pool->lock, NULL);
+
+    /* Deadlines are computed on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pool->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&pool->idle, NULL);
+
+    if (pool->thread_count == 0) {
+        return 0;  /* Disabled: mark_* calls are no-ops */
+    }
+
+    pool->threads = calloc(pool->thread_count, sizeof(pthread_t));
+    if (!pool->threads) {
+        pthread_cond_destroy(&pool->idle);
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0) {
+            /* Keep the workers that did start */
+            pool->thread_count = i;
+            break;
+        }
+    }
+
+    if (pool->thread_count == 0) {
+        free(pool->threads);
+        pool->threads = NULL;
+        pthread_cond_destroy(&pool->idle);
+        pthread_cond_destroy(&pool->wake);
+        pthread_mutex_destroy(&pool->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+void compress_pool_destroy(struct compress_pool *pool) {
+    if (!pool) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->running = 0;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    pool->threads = NULL;
+    pool->thread_count = 0;
+
+    struct compress_pool_entry *e = pool->head;
+    while (e) {
+        struct compress_pool_entry *next = e->next;
+        free(e);
+        e = next;
+    }
+    pool->head = pool->tail = NULL;
+    memset(pool->hash, 0, sizeof(pool->hash));
+    pool->stats.pending = 0;
+
+    pthread_cond_destroy(&pool->idle);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void compress_pool_mark_dirty(struct compress_pool *pool, uint32_t inode) {
+    if (!pool || pool->thread_count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stats.marked++;
+    enqueue(pool, inode, now_ms() + pool->idle_ms);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int compress_pool_mark_closed(struct compress_pool *pool, uint32_t inode) {
+    if (!pool || pool->thread_count == 0) return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    struct compress_pool_entry *e = find_entry(pool, inode);
+    if (e) {
+        /* Nothing more is coming: jump the queue */
+        list_unlink(pool, e);
+        uint64_t now = now_ms();
+        /* Keep the queue ordered: never later than the current head */
+        e->ready_at_ms = pool->head && pool->head->ready_at_ms < now ?
+                         pool->head->ready_at_ms : now;
+        list_push_head(pool, e);
+        pthread_cond_signal(&pool->wake);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return e != NULL;
+}
+
+void compress_pool_cancel(struct compress_pool *pool, uint32_t inode) {
+    if (!pool || pool->thread_count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+    struct compress_pool_entry *e = find_entry(pool, inode);
+    if (e) {
+        list_unlink(pool, e);
+        hash_remove(pool, e);
+        pool->stats.pending--;
+        pool->stats.cancelled++;
+        free(e);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void compress_pool_flush(struct compress_pool *pool) {
+    if (!pool || pool->thread_count == 0) return;
+
+    pthread_mutex_lock(&pool->lock);
+
+    uint64_t start = now_ms();
+    for (struct compress_pool_entry *e = pool->head; e; e = e->next) {
+        e->ready_at_ms = start;
+    }
+    pthread_cond_broadcast(&pool->wake);
+
+    /* Entries re-queued by a retry land after `start` and do not block us */
+    while (pool->active > 0 || (pool->head && pool->head->ready_at_ms <= start)) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void compress_pool_get_stats(struct compress_pool *pool, struct compress_pool_stats *stats) {
+    if (!pool || !stats) return;
+
+    if (pool->thread_count == 0) {
+        *stats = pool->stats;
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    *stats = pool->stats;
+    pthread_mutex_unlock(&pool->lock);
+}
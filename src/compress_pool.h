@@ -0,0 +1,141 @@
+/**
+ * Background Compression Pool - RAZORFS File Data
+ *
+ * Keeps compression off the write path:
+ * - Writers mark an inode dirty (cheap: one hash lookup + list move)
+ * - A file becomes eligible once it has been idle for idle_ms, or right
+ *   away once it is closed
+ * - Worker threads hand eligible inodes to a callback that compresses the
+ *   file and swaps the compressed chunks in under the file's own lock
+ *
+ * The queue is ordered by eligibility time, so workers only ever look at
+ * the head and sleep until it becomes ready.
+ */
+
+#ifndef RAZORFS_COMPRESS_POOL_H
+#define RAZORFS_COMPRESS_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults */
+#define COMPRESS_POOL_DEFAULT_THREADS  1
+#define COMPRESS_POOL_DEFAULT_IDLE_MS  2000   /* File must be write-idle this long */
+#define COMPRESS_POOL_MAX_THREADS      64
+#define COMPRESS_POOL_HASH_SIZE        1024
+
+/**
+ * Compress callback
+ * @param ctx Pool context pointer
+ * @param inode Inode to compress
+ * @return 0 when done, > 0 to retry after another idle period
+ */
+typedef int (*compress_pool_fn)(void *ctx, uint32_t inode);
+
+/**
+ * Pool configuration
+ */
+struct compress_pool_config {
+    uint32_t threads;            /* Worker threads (0 = background compression off) */
+    uint32_t idle_ms;            /* Write-idle time before a file is compressed */
+};
+
+/**
+ * Queued inode
+ */
+struct compress_pool_entry {
+    uint32_t inode;
+    uint64_t ready_at_ms;        /* Eligible from this (monotonic) time */
+    struct compress_pool_entry *hash_next;
+    struct compress_pool_entry *prev;
+    struct compress_pool_entry *next;
+};
+
+/**
+ * Pool statistics
+ */
+struct compress_pool_stats {
+    uint64_t marked;             /* mark_dirty calls */
+    uint64_t completed;          /* Callbacks that finished */
+    uint64_t retried;            /* Callbacks that asked to retry */
+    uint64_t cancelled;          /* Entries dropped by cancel */
+    uint32_t pending;            /* Entries currently queued */
+};
+
+/**
+ * Compression pool
+ */
+struct compress_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         /* Queue changed / shutdown */
+    pthread_cond_t idle;         /* A worker finished a job */
+
+    pthread_t *threads;
+    uint32_t thread_count;
+    uint32_t idle_ms;
+    int running;
+    uint32_t active;             /* Workers currently inside the callback */
+
+    compress_pool_fn fn;
+    void *ctx;
+
+    struct compress_pool_entry *head;    /* Queue, ordered by ready_at_ms */
+    struct compress_pool_entry *tail;
+    struct compress_pool_entry *hash[COMPRESS_POOL_HASH_SIZE];
+
+    struct compress_pool_stats stats;
+};
+
+/**
+ * Start a compression pool
+ *
+ * @param pool Pool to initialize
+ * @param config Thread count and idle policy (NULL = defaults)
+ * @param fn Compress callback
+ * @param ctx Passed to fn
+ * @return 0 on success, -1 on failure
+ */
+int compress_pool_init(struct compress_pool *pool, const struct compress_pool_config *config,
+                       compress_pool_fn fn, void *ctx);
+
+/**
+ * Stop workers and free queued entries (queued files stay uncompressed)
+ */
+void compress_pool_destroy(struct compress_pool *pool);
+
+/**
+ * Record a write to an inode; it becomes eligible after idle_ms without writes
+ */
+void compress_pool_mark_dirty(struct compress_pool *pool, uint32_t inode);
+
+/**
+ * Record that an inode was closed; if queued it becomes eligible now
+ * @return 1 if the inode was queued, 0 otherwise
+ */
+int compress_pool_mark_closed(struct compress_pool *pool, uint32_t inode);
+
+/**
+ * Drop an inode from the queue (e.g. on unlink)
+ */
+void compress_pool_cancel(struct compress_pool *pool, uint32_t inode);
+
+/**
+ * Make every queued inode eligible now and wait until the queue is empty
+ * and no callback is running
+ */
+void compress_pool_flush(struct compress_pool *pool);
+
+/**
+ * Snapshot pool statistics
+ */
+void compress_pool_get_stats(struct compress_pool *pool, struct compress_pool_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_COMPRESS_POOL_H */
@@ -4,16 +4,216 @@
 
 #define _GNU_SOURCE
 #include "compression.h"
+#include "metrics.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <zlib.h>
 #include <stdatomic.h>
+#ifdef HAS_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAS_ZSTD
+#include <zstd.h>
+#endif
 
 /* Global stats - use atomics for thread safety */
 static atomic_uint_fast64_t g_total_writes = 0;
 static atomic_uint_fast64_t g_compressed_writes = 0;
 static atomic_uint_fast64_t g_total_reads = 0;
 static atomic_uint_fast64_t g_bytes_saved = 0;
+static atomic_uint_fast64_t g_probe_skips = 0;
+static atomic_uint_fast64_t g_codec_writes[COMPRESSION_CODEC_COUNT];
+static atomic_uint_fast64_t g_codec_bytes_in[COMPRESSION_CODEC_COUNT];
+static atomic_uint_fast64_t g_codec_bytes_out[COMPRESSION_CODEC_COUNT];
+static atomic_uint_fast64_t g_codec_reads[COMPRESSION_CODEC_COUNT];
+
+/* ============================================================================
+ * Codecs
+ * ============================================================================ */
+
+/**
+ * One codec: compress returns the payload size, 0 if it does not fit in
+ * dst_cap; decompress returns 0 only if exactly raw_size bytes came out
+ */
+struct codec_ops {
+    const char *name;
+    size_t (*compress)(const void *src, size_t size, void *dst, size_t dst_cap);
+    int (*decompress)(const void *src, size_t src_size, void *dst, size_t raw_size);
+};
+
+static size_t zlib_compress(const void *src, size_t size, void *dst, size_t dst_cap) {
+    uLongf final_size = (uLongf)dst_cap;
+    int result = compress2((Bytef *)dst, &final_size, (const Bytef *)src, (uLong)size,
+                           COMPRESSION_ZLIB_LEVEL);
+    return result == Z_OK ? (size_t)final_size : 0;  /* Z_BUF_ERROR: did not fit */
+}
+
+static int zlib_decompress(const void *src, size_t src_size, void *dst, size_t raw_size) {
+    uLongf decompressed_size = (uLongf)raw_size;
+    int result = uncompress((Bytef *)dst, &decompressed_size,
+                            (const Bytef *)src, (uLong)src_size);
+    return result == Z_OK && decompressed_size == raw_size ? 0 : -1;
+}
+
+#ifdef HAS_LZ4
+static size_t lz4_compress(const void *src, size_t size, void *dst, size_t dst_cap) {
+    if (size > LZ4_MAX_INPUT_SIZE) return 0;
+    int cap = dst_cap > (size_t)LZ4_compressBound((int)size) ?
+              LZ4_compressBound((int)size) : (int)dst_cap;
+    int n = LZ4_compress_default(src, dst, (int)size, cap);
+    return n > 0 ? (size_t)n : 0;
+}
+
+static int lz4_decompress(const void *src, size_t src_size, void *dst, size_t raw_size) {
+    if (src_size > INT32_MAX || raw_size > INT32_MAX) return -1;
+    int n = LZ4_decompress_safe(src, dst, (int)src_size, (int)raw_size);
+    return n >= 0 && (size_t)n == raw_size ? 0 : -1;
+}
+#endif
+
+#ifdef HAS_ZSTD
+/* Contexts are reused per thread (freed when the thread exits) */
+struct zstd_contexts {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+};
+
+static pthread_key_t g_zstd_key;
+static pthread_once_t g_zstd_once = PTHREAD_ONCE_INIT;
+
+static void zstd_contexts_free(void *p) {
+    struct zstd_contexts *ctx = p;
+    ZSTD_freeCCtx(ctx->cctx);
+    ZSTD_freeDCtx(ctx->dctx);
+    free(ctx);
+}
+
+static void zstd_key_init(void) {
+    pthread_key_create(&g_zstd_key, zstd_contexts_free);
+}
+
+static struct zstd_contexts *zstd_contexts(void) {
+    pthread_once(&g_zstd_once, zstd_key_init);
+    struct zstd_contexts *ctx = pthread_getspecific(g_zstd_key);
+    if (!ctx) {
+        ctx = calloc(1, sizeof(*ctx));
+        if (!ctx) return NULL;
+        ctx->cctx = ZSTD_createCCtx();
+        ctx->dctx = ZSTD_createDCtx();
+        if (!ctx->cctx || !ctx->dctx || pthread_setspecific(g_zstd_key, ctx) != 0) {
+            zstd_contexts_free(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+static size_t zstd_compress(const void *src, size_t size, void *dst, size_t dst_cap) {
+    struct zstd_contexts *ctx = zstd_contexts();
+    if (!ctx) return 0;
+    size_t n = ZSTD_compressCCtx(ctx->cctx, dst, dst_cap, src, size, COMPRESSION_ZSTD_LEVEL);
+    return ZSTD_isError(n) ? 0 : n;
+}
+
+static int zstd_decompress(const void *src, size_t src_size, void *dst, size_t raw_size) {
+    struct zstd_contexts *ctx = zstd_contexts();
+    if (!ctx) return -1;
+    size_t n = ZSTD_decompressDCtx(ctx->dctx, dst, raw_size, src, src_size);
+    return !ZSTD_isError(n) && n == raw_size ? 0 : -1;
+}
+#endif
+
+/* Indexed by enum compression_codec; NULL functions = not built in */
+static const struct codec_ops g_codecs[COMPRESSION_CODEC_COUNT] = {
+    [COMPRESSION_CODEC_ZLIB] = { "zlib", zlib_compress, zlib_decompress },
+#ifdef HAS_LZ4
+    [COMPRESSION_CODEC_LZ4] = { "lz4", lz4_compress, lz4_decompress },
+#else
+    [COMPRESSION_CODEC_LZ4] = { "lz4", NULL, NULL },
+#endif
+#ifdef HAS_ZSTD
+    [COMPRESSION_CODEC_ZSTD] = { "zstd", zstd_compress, zstd_decompress },
+#else
+    [COMPRESSION_CODEC_ZSTD] = { "zstd", NULL, NULL },
+#endif
+};
+
+/* Codec per use, defaulting to the best one built in */
+#ifdef HAS_LZ4
+static int g_use_codec_inline = COMPRESSION_CODEC_LZ4;
+#else
+static int g_use_codec_inline = COMPRESSION_CODEC_ZLIB;
+#endif
+#ifdef HAS_ZSTD
+static int g_use_codec_background = COMPRESSION_CODEC_ZSTD;
+#else
+static int g_use_codec_background = COMPRESSION_CODEC_ZLIB;
+#endif
+
+int compression_codec_available(enum compression_codec codec) {
+    return (unsigned)codec < COMPRESSION_CODEC_COUNT && g_codecs[codec].compress != NULL;
+}
+
+const char *compression_codec_name(enum compression_codec codec) {
+    return (unsigned)codec < COMPRESSION_CODEC_COUNT ? g_codecs[codec].name : "unknown";
+}
+
+enum compression_codec compression_get_codec(enum compression_use use) {
+    int *slot = use == COMPRESSION_INLINE ? &g_use_codec_inline : &g_use_codec_background;
+    return (enum compression_codec)__atomic_load_n(slot, __ATOMIC_RELAXED);
+}
+
+int compression_set_codec(enum compression_use use, enum compression_codec codec) {
+    if (!compression_codec_available(codec)) {
+        return -1;
+    }
+    int *slot = use == COMPRESSION_INLINE ? &g_use_codec_inline : &g_use_codec_background;
+    __atomic_store_n(slot, (int)codec, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int compression_probe(const void *data, size_t size) {
+    size_t n = size < COMPRESSION_PROBE_SIZE ? size : COMPRESSION_PROBE_SIZE;
+    if (!data || n < COMPRESSION_PROBE_MIN) {
+        return 1;  /* Too little to judge */
+    }
+
+    uint32_t counts[256] = {0};
+    const unsigned char *p = data;
+    for (size_t i = 0; i < n; i++) {
+        counts[p[i]]++;
+    }
+
+    /* Sum of p^2 estimated without bias as sum c(c-1) / n(n-1); the
+     * collision entropy -log2(sum p^2) reaches 7.5 bits at 1/181 */
+    uint64_t pairs = 0;
+    for (int i = 0; i < 256; i++) {
+        pairs += (uint64_t)counts[i] * (counts[i] ? counts[i] - 1 : 0);
+    }
+    return pairs * 181 > (uint64_t)n * (n - 1);
+}
+
+static void count_write(enum compression_codec codec, size_t size, size_t stored) {
+    atomic_fetch_add_explicit(&g_total_writes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_compressed_writes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_bytes_saved, (size - stored), memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_codec_writes[codec], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_codec_bytes_in[codec], size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_codec_bytes_out[codec], stored, memory_order_relaxed);
+}
+
+static void count_read(enum compression_codec codec) {
+    atomic_fetch_add_explicit(&g_total_reads, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&g_codec_reads[codec], 1, memory_order_relaxed);
+}
+
+/* Whether to spend a compression attempt on data at all */
+static int worth_trying(const void *data, size_t size) {
+    if (compression_probe(data, size)) return 1;
+    atomic_fetch_add_explicit(&g_probe_skips, 1, memory_order_relaxed);
+    return 0;
+}
 
 /**
  * Compress data (if beneficial)
@@ -26,50 +226,44 @@ void *compress_data(const void *data, size_t size, size_t *out_size) {
     }
 
     /* Don't compress if smaller than threshold */
-    if (size < COMPRESSION_MIN_SIZE) {
+    if (size < COMPRESSION_MIN_SIZE || size > UINT32_MAX || !worth_trying(data, size)) {
         return NULL;
     }
 
-    /* Calculate maximum possible compressed size */
-    uLongf compressed_bound = compressBound((uLong)size);
-    Bytef *compressed_data = malloc(compressed_bound + sizeof(struct compression_header));
-    if (!compressed_data) {
+    /* Only a result smaller than the input (header included) is kept */
+    size_t header_size = sizeof(struct compression_header);
+    if (size <= header_size + 1) {
         return NULL;
     }
-
-    /* Prepare header */
-    struct compression_header *header = (struct compression_header *)compressed_data;
-    header->magic = COMPRESSION_MAGIC;
-    header->original_size = (uint32_t)size;
-    header->compressed_size = compressed_bound;
-
-    /* Compress data */
-    uLongf final_size = compressed_bound;
-    int result = compress2(compressed_data + sizeof(struct compression_header), &final_size,
-                          (const Bytef *)data, (uLong)size, 1);  /* Level 1 - fastest */
-
-    if (result != Z_OK) {
-        free(compressed_data);
+    unsigned char *compressed_data = malloc(size);
+    if (!compressed_data) {
         return NULL;
     }
 
-    /* Update header with actual compressed size */
-    header->compressed_size = final_size;
-
-    /* Check if compression was actually beneficial */
-    size_t total_size = sizeof(struct compression_header) + final_size;
-    if (total_size >= size) {
+    /* Whole buffers are stored data: the background codec */
+    enum compression_codec codec = compression_get_codec(COMPRESSION_BACKGROUND);
+    uint64_t start = metrics_start();
+    size_t final_size = g_codecs[codec].compress(data, size, compressed_data + header_size,
+                                                 size - header_size - 1);
+    metrics_record_since(METRICS_COMPRESS, start);
+    if (final_size == 0) {
         /* Compression not beneficial - return NULL and let caller use original */
         free(compressed_data);
         return NULL;
     }
 
+    /* Prepare header */
+    struct compression_header *header = (struct compression_header *)compressed_data;
+    header->magic = COMPRESSION_MAGIC_CODEC;
+    header->original_size = (uint32_t)size;
+    header->compressed_size = (uint32_t)final_size;
+    header->codec = codec;
+
+    size_t total_size = header_size + final_size;
     *out_size = total_size;
 
     /* Update stats atomically */
-    atomic_fetch_add_explicit(&g_total_writes, 1, memory_order_relaxed);
-    atomic_fetch_add_explicit(&g_compressed_writes, 1, memory_order_relaxed);
-    atomic_fetch_add_explicit(&g_bytes_saved, (size - total_size), memory_order_relaxed);
+    count_write(codec, size, total_size);
 
     return compressed_data;
 }
@@ -80,14 +274,25 @@ void *compress_data(const void *data, size_t size, size_t *out_size) {
  * Sets *out_size to decompressed size
  */
 void *decompress_data(const void *data, size_t size, size_t *out_size) {
-    if (!data || size < sizeof(struct compression_header)) {
+    if (!data || size < COMPRESSION_HEADER_V1_SIZE) {
         return NULL;
     }
 
     const struct compression_header *header = (const struct compression_header *)data;
 
-    /* Validate magic */
-    if (header->magic != COMPRESSION_MAGIC) {
+    /* Validate magic; RZCP blobs predate codecs and are zlib */
+    size_t header_size;
+    enum compression_codec codec;
+    if (header->magic == COMPRESSION_MAGIC) {
+        header_size = COMPRESSION_HEADER_V1_SIZE;
+        codec = COMPRESSION_CODEC_ZLIB;
+    } else if (header->magic == COMPRESSION_MAGIC_CODEC && size >= sizeof(*header)) {
+        header_size = sizeof(*header);
+        if (!compression_codec_available(header->codec)) {
+            return NULL;  /* Written by a build with a codec this one lacks */
+        }
+        codec = header->codec;
+    } else {
         return NULL;
     }
 
@@ -97,43 +302,281 @@ void *decompress_data(const void *data, size_t size, size_t *out_size) {
     }
 
     /* Ensure we have enough data for the compressed payload */
-    if (sizeof(struct compression_header) + header->compressed_size > size) {
+    if (header_size + header->compressed_size > size) {
         return NULL;
     }
 
-    /* Sanity check: decompressed size should be larger than compressed */
-    if (header->original_size < header->compressed_size) {
-        /* This could be valid for small files, so just warn */
-    }
-
     /* Allocate buffer for decompressed data */
     void *output = malloc(header->original_size);
     if (!output) {
         return NULL;
     }
 
-    /* Decompress */
-    uLongf decompressed_size = header->original_size;
-    int result = uncompress((Bytef *)output, &decompressed_size,
-                           (const Bytef *)(header + 1), header->compressed_size);
-
-    if (result != Z_OK) {
+    /* Decompress and verify size matches */
+    uint64_t start = metrics_start();
+    int result = g_codecs[codec].decompress((const char *)data + header_size,
+                                            header->compressed_size,
+                                            output, header->original_size);
+    metrics_record_since(METRICS_DECOMPRESS, start);
+    if (result != 0) {
         free(output);
         return NULL;
     }
 
-    /* Verify size matches */
-    if (decompressed_size != header->original_size) {
-        free(output);
-        return NULL;
+    *out_size = header->original_size;
+
+    /* Update stats atomically */
+    count_read(codec);
+
+    return output;
+}
+
+/**
+ * Compress one block into a caller-provided buffer (no header)
+ * Returns compressed size, or 0 if compression was not beneficial
+ */
+size_t compress_block(const void *src, size_t size, void *dst, size_t dst_cap) {
+    return compress_block_for(COMPRESSION_INLINE, src, size, dst, dst_cap);
+}
+
+size_t compress_block_for(enum compression_use use, const void *src, size_t size,
+                          void *dst, size_t dst_cap) {
+    return compress_block_as(compression_get_codec(use), src, size, dst, dst_cap);
+}
+
+size_t compress_block_as(enum compression_codec codec, const void *src, size_t size,
+                         void *dst, size_t dst_cap) {
+    if (!src || !dst || size < COMPRESSION_MIN_SIZE || !compression_codec_available(codec)) {
+        return 0;
+    }
+
+    /* Only a strictly smaller payload is worth keeping */
+    size_t cap = dst_cap < size ? dst_cap : size - 1;
+    if (!worth_trying(src, size)) {
+        return 0;
     }
 
-    *out_size = decompressed_size;
+    uint64_t start = metrics_start();
+
+    /* zlib streams identify themselves; the rest carry a tag byte */
+    size_t final_size;
+    if (codec == COMPRESSION_CODEC_ZLIB) {
+        final_size = zlib_compress(src, size, dst, cap);
+    } else {
+        if (cap < 2) return 0;
+        *(unsigned char *)dst = COMPRESSION_CODEC_TAG(codec);
+        final_size = g_codecs[codec].compress(src, size, (char *)dst + 1, cap - 1);
+        if (final_size) final_size++;
+    }
+    metrics_record_since(METRICS_COMPRESS, start);
+    if (final_size == 0) {
+        return 0;  /* Did not shrink */
+    }
 
     /* Update stats atomically */
-    atomic_fetch_add_explicit(&g_total_reads, 1, memory_order_relaxed);
+    count_write(codec, size, final_size);
 
-    return output;
+    return final_size;
+}
+
+int compression_block_codec(const void *src, size_t src_size) {
+    if (!src || src_size == 0) {
+        return -1;
+    }
+
+    unsigned char first = *(const unsigned char *)src;
+    int codec;
+    if ((first & 0x0F) == 8) {
+        codec = COMPRESSION_CODEC_ZLIB;  /* CMF byte: deflate */
+    } else if ((first & 0xC0) == 0xC0) {
+        codec = first & 0x3F;
+    } else {
+        return -1;
+    }
+    return compression_codec_available(codec) ? codec : -1;
+}
+
+/**
+ * Decompress one block produced by compress_block()
+ * Returns 0 on success, -1 on error
+ */
+int decompress_block(const void *src, size_t src_size, void *dst, size_t raw_size) {
+    if (!src || !dst || src_size == 0 || raw_size == 0) {
+        return -1;
+    }
+
+    int codec = compression_block_codec(src, src_size);
+    if (codec < 0) {
+        return -1;
+    }
+
+    uint64_t start = metrics_start();
+    int result = codec == COMPRESSION_CODEC_ZLIB ?
+                 zlib_decompress(src, src_size, dst, raw_size) :
+                 g_codecs[codec].decompress((const char *)src + 1, src_size - 1, dst, raw_size);
+    metrics_record_since(METRICS_DECOMPRESS, start);
+    if (result != 0) {
+        return -1;
+    }
+
+    /* Update stats atomically */
+    count_read(codec);
+
+    return 0;
+}
+
+/* Check whether a block is entirely zero (stored as a hole) */
+static int block_is_zero(const unsigned char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i]) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Build a packed blocked container from a flat buffer
+ * Returns container (caller must free) or NULL on error
+ */
+void *compress_blocked(const void *data, size_t size, size_t *out_size) {
+    if ((!data && size > 0) || !out_size) {
+        return NULL;
+    }
+
+    uint64_t block_count = (size + COMPRESSION_BLOCK_SIZE - 1) / COMPRESSION_BLOCK_SIZE;
+    if (block_count > UINT32_MAX) {
+        return NULL;
+    }
+
+    /* Worst case every block is stored raw */
+    size_t table_size = block_count * sizeof(struct compression_seek_entry);
+    size_t payload_start = sizeof(struct compression_blocked_header) + table_size;
+    unsigned char *out = malloc(payload_start + size);
+    if (!out) {
+        return NULL;
+    }
+
+    struct compression_blocked_header *header = (struct compression_blocked_header *)out;
+    header->magic = COMPRESSION_BLOCKED_MAGIC;
+    header->block_size = COMPRESSION_BLOCK_SIZE;
+    header->original_size = size;
+    header->block_count = (uint32_t)block_count;
+    header->table_capacity = (uint32_t)block_count;
+
+    struct compression_seek_entry *table = (struct compression_seek_entry *)(header + 1);
+    const unsigned char *src = data;
+    size_t pos = payload_start;
+
+    for (uint64_t i = 0; i < block_count; i++) {
+        size_t start = i * COMPRESSION_BLOCK_SIZE;
+        size_t len = size - start < COMPRESSION_BLOCK_SIZE ? size - start : COMPRESSION_BLOCK_SIZE;
+        struct compression_seek_entry *entry = &table[i];
+
+        if (block_is_zero(src + start, len)) {
+            entry->offset = 0;
+            entry->stored_size = 0;
+            entry->raw_size = 0;
+            continue;
+        }
+
+        size_t stored = compress_block(src + start, len, out + pos, len);
+        if (stored == 0) {
+            memcpy(out + pos, src + start, len);
+            stored = len;
+        }
+
+        entry->offset = pos;
+        entry->stored_size = (uint32_t)stored;
+        entry->raw_size = (uint32_t)len;
+        pos += stored;
+    }
+
+    *out_size = pos;
+    return out;
+}
+
+/**
+ * Read a range out of a blocked container
+ * Returns bytes read, or -1 if the container is corrupt
+ */
+ssize_t decompress_blocked_range(const void *blob, size_t blob_size,
+                                 void *buf, size_t size, uint64_t offset) {
+    if (!blob || !buf || blob_size < sizeof(struct compression_blocked_header)) {
+        return -1;
+    }
+
+    const struct compression_blocked_header *header = blob;
+    if (header->magic != COMPRESSION_BLOCKED_MAGIC || header->block_size == 0 ||
+        header->table_capacity < header->block_count) {
+        return -1;
+    }
+
+    size_t table_size = (size_t)header->table_capacity * sizeof(struct compression_seek_entry);
+    if (table_size > blob_size - sizeof(*header)) {
+        return -1;
+    }
+
+    if (offset >= header->original_size) {
+        return 0;
+    }
+
+    uint64_t available = header->original_size - offset;
+    size_t total = size < available ? size : (size_t)available;
+
+    const struct compression_seek_entry *table = (const void *)(header + 1);
+    const unsigned char *base = blob;
+    unsigned char *out = buf;
+    unsigned char *scratch = NULL;
+    size_t done = 0;
+
+    while (done < total) {
+        uint64_t block = offset / header->block_size;
+        size_t boff = (size_t)(offset % header->block_size);
+        size_t n = header->block_size - boff;
+        if (n > total - done) n = total - done;
+
+        if (block >= header->block_count) {
+            free(scratch);
+            return -1;
+        }
+
+        const struct compression_seek_entry *entry = &table[block];
+        if (entry->raw_size > header->block_size || entry->stored_size > entry->raw_size ||
+            entry->offset > blob_size || entry->stored_size > blob_size - entry->offset) {
+            free(scratch);
+            return -1;
+        }
+
+        const unsigned char *raw = NULL;
+        if (entry->raw_size > 0 && entry->stored_size == entry->raw_size) {
+            raw = base + entry->offset;
+        } else if (entry->raw_size > 0) {
+            if (!scratch && !(scratch = malloc(header->block_size))) {
+                return -1;
+            }
+            if (decompress_block(base + entry->offset, entry->stored_size,
+                                 scratch, entry->raw_size) != 0) {
+                free(scratch);
+                return -1;
+            }
+            raw = scratch;
+        }
+
+        size_t copied = 0;
+        if (raw && boff < entry->raw_size) {
+            copied = entry->raw_size - boff;
+            if (copied > n) copied = n;
+            memcpy(out + done, raw + boff, copied);
+        }
+        if (copied < n) {
+            memset(out + done + copied, 0, n - copied);
+        }
+
+        done += n;
+        offset += n;
+    }
+
+    free(scratch);
+    return (ssize_t)total;
 }
 
 /**
@@ -141,12 +584,12 @@ void *decompress_data(const void *data, size_t size, size_t *out_size) {
  */
 int is_compressed(const void *data, size_t size) __attribute__((unused));
 int is_compressed(const void *data, size_t size) {
-    if (!data || size < sizeof(struct compression_header)) {
+    if (!data || size < COMPRESSION_HEADER_V1_SIZE) {
         return 0;
     }
 
     const struct compression_header *header = (const struct compression_header *)data;
-    return (header->magic == COMPRESSION_MAGIC);
+    return header->magic == COMPRESSION_MAGIC || header->magic == COMPRESSION_MAGIC_CODEC;
 }
 
 /**
@@ -160,6 +603,14 @@ void get_compression_stats(struct compression_stats *stats) {
         stats->total_reads = atomic_load_explicit(&g_total_reads, memory_order_relaxed);
         stats->compressed_reads = 0;  /* Not tracked separately */
         stats->bytes_saved = atomic_load_explicit(&g_bytes_saved, memory_order_relaxed);
+        stats->probe_skips = atomic_load_explicit(&g_probe_skips, memory_order_relaxed);
+        for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+            struct compression_codec_stats *cs = &stats->codecs[c];
+            cs->writes = atomic_load_explicit(&g_codec_writes[c], memory_order_relaxed);
+            cs->bytes_in = atomic_load_explicit(&g_codec_bytes_in[c], memory_order_relaxed);
+            cs->bytes_out = atomic_load_explicit(&g_codec_bytes_out[c], memory_order_relaxed);
+            cs->reads = atomic_load_explicit(&g_codec_reads[c], memory_order_relaxed);
+        }
     }
 }
 
@@ -172,4 +623,11 @@ void reset_compression_stats(void) {
     atomic_store_explicit(&g_compressed_writes, 0, memory_order_relaxed);
     atomic_store_explicit(&g_total_reads, 0, memory_order_relaxed);
     atomic_store_explicit(&g_bytes_saved, 0, memory_order_relaxed);
+    atomic_store_explicit(&g_probe_skips, 0, memory_order_relaxed);
+    for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+        atomic_store_explicit(&g_codec_writes[c], 0, memory_order_relaxed);
+        atomic_store_explicit(&g_codec_bytes_in[c], 0, memory_order_relaxed);
+        atomic_store_explicit(&g_codec_bytes_out[c], 0, memory_order_relaxed);
+        atomic_store_explicit(&g_codec_reads[c], 0, memory_order_relaxed);
+    }
 }
\ No newline at end of file
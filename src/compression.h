@@ -3,7 +3,11 @@
  *
  * Strategy:
  * - Only compress files > 512 bytes
- * - Use zlib level 1 (fastest)
+ * - Pick the codec by where the data is compressed: LZ4 on the inline
+ *   path, Zstd for background and cold data (zlib level 1 when a codec
+ *   is not built in)
+ * - Probe the first few KB and leave high-entropy data (media, archives)
+ *   alone instead of compressing and discarding the result
  * - Skip if compressed size >= original (no benefit)
  * - Transparent to read/write operations
  */
@@ -13,6 +17,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -25,16 +30,84 @@ extern "C" {
 #define COMPRESSION_MIN_SIZE 512  /* Production threshold */
 #endif
 
+/*
+ * Codecs
+ *
+ * zlib is always built in; LZ4 and Zstd when the build finds them
+ * (HAS_LZ4, HAS_ZSTD). Block payloads name their codec in the first
+ * byte: a zlib stream starts with its CMF byte (low nibble 8, deflate),
+ * any other codec's payload with COMPRESSION_CODEC_TAG(codec) followed by
+ * the codec's own format, so zlib blocks written before codecs existed
+ * read as before.
+ */
+enum compression_codec {
+    COMPRESSION_CODEC_ZLIB = 0,
+    COMPRESSION_CODEC_LZ4 = 1,
+    COMPRESSION_CODEC_ZSTD = 2,
+    COMPRESSION_CODEC_COUNT
+};
+
+#define COMPRESSION_CODEC_TAG(codec) (0xC0 | (codec))
+#define COMPRESSION_ZLIB_LEVEL  1
+#define COMPRESSION_ZSTD_LEVEL  3
+
+/* Where data is compressed, which picks the codec */
+enum compression_use {
+    COMPRESSION_INLINE = 0,      /* On the write path: fast (LZ4) */
+    COMPRESSION_BACKGROUND = 1,  /* Idle and cold data: small (Zstd) */
+};
+
+/* Entropy probe: bytes sampled from the start of the data */
+#define COMPRESSION_PROBE_SIZE   4096
+#define COMPRESSION_PROBE_MIN    256   /* Less than this is not judged */
+
 /* Compression header magic */
-#define COMPRESSION_MAGIC 0x525A4350  /* "RZCP" */
+#define COMPRESSION_MAGIC        0x525A4350  /* "RZCP": zlib, 12-byte header */
+#define COMPRESSION_MAGIC_CODEC  0x525A4332  /* "RZC2": header names the codec */
+#define COMPRESSION_HEADER_V1_SIZE 12
 
 /**
  * Compressed data header
+ * RZCP blobs end the header after compressed_size.
  */
 struct compression_header {
-    uint32_t magic;              /* COMPRESSION_MAGIC */
+    uint32_t magic;              /* COMPRESSION_MAGIC_CODEC */
     uint32_t original_size;      /* Uncompressed size */
     uint32_t compressed_size;    /* Compressed size (without header) */
+    uint32_t codec;              /* enum compression_codec */
+};
+
+/*
+ * Blocked format
+ *
+ * Data is split into fixed-size blocks compressed independently, so a
+ * range read only inflates the blocks it covers and a write only
+ * re-compresses the blocks it dirties. Layout:
+ *
+ *   struct compression_blocked_header
+ *   struct compression_seek_entry[table_capacity]
+ *   block payloads at the offsets given by the seek table
+ *
+ * Seek entries encode the block kind by size: raw_size == 0 is a hole
+ * (all zeros), stored_size == raw_size is stored uncompressed, and
+ * stored_size < raw_size is a compressed payload (see Codecs). Bytes of a
+ * block past its raw_size are zero.
+ */
+#define COMPRESSION_BLOCKED_MAGIC 0x525A424B  /* "RZBK" */
+#define COMPRESSION_BLOCK_SIZE    (64 * 1024)
+
+struct compression_blocked_header {
+    uint32_t magic;              /* COMPRESSION_BLOCKED_MAGIC */
+    uint32_t block_size;         /* Uncompressed bytes per block */
+    uint64_t original_size;      /* Total uncompressed size */
+    uint32_t block_count;        /* Blocks covering original_size */
+    uint32_t table_capacity;     /* Seek table slots (>= block_count) */
+};
+
+struct compression_seek_entry {
+    uint64_t offset;             /* Payload offset from start of header */
+    uint32_t stored_size;        /* Payload bytes */
+    uint32_t raw_size;           /* Uncompressed bytes (0 = hole) */
 };
 
 /**
@@ -51,15 +124,117 @@ void *compress_data(const void *data, size_t size, size_t *out_size);
  */
 void *decompress_data(const void *data, size_t size, size_t *out_size);
 
+/**
+ * Compress one block into a caller-provided buffer (no header)
+ * Uses the inline codec; see compress_block_for().
+ *
+ * @param src Uncompressed block
+ * @param size Block size in bytes
+ * @param dst Output buffer
+ * @param dst_cap Output capacity; compression only counts if it fits
+ * @return Compressed size, or 0 if compression was not beneficial
+ */
+size_t compress_block(const void *src, size_t size, void *dst, size_t dst_cap);
+
+/**
+ * Compress one block with the codec chosen for `use`
+ * @return Compressed size, or 0 if not beneficial (or skipped by the probe)
+ */
+size_t compress_block_for(enum compression_use use, const void *src, size_t size,
+                          void *dst, size_t dst_cap);
+
+/**
+ * Compress one block with a given codec
+ * @return Compressed size, or 0 if not beneficial, skipped by the probe or
+ *         the codec is not built in
+ */
+size_t compress_block_as(enum compression_codec codec, const void *src, size_t size,
+                         void *dst, size_t dst_cap);
+
+/**
+ * Codec a compressed block payload was written with
+ * @return enum compression_codec, or -1 if unknown or not built in
+ */
+int compression_block_codec(const void *src, size_t src_size);
+
+/**
+ * Decompress one block produced by compress_block() (any codec)
+ *
+ * @param src Compressed payload
+ * @param src_size Payload size
+ * @param dst Output buffer
+ * @param raw_size Expected uncompressed size
+ * @return 0 on success, -1 if the payload is corrupt or the size mismatches
+ */
+int decompress_block(const void *src, size_t src_size, void *dst, size_t raw_size);
+
+/**
+ * Build a packed blocked container from a flat buffer
+ * Blocks that do not shrink are stored raw; all-zero blocks become holes.
+ * Returns container (caller must free) or NULL on error
+ * Sets *out_size to container size
+ */
+void *compress_blocked(const void *data, size_t size, size_t *out_size);
+
+/**
+ * Read a range out of a blocked container
+ * Only the blocks overlapping [offset, offset + size) are decompressed.
+ *
+ * @param blob Container
+ * @param blob_size Container size
+ * @param buf Destination buffer
+ * @param size Bytes requested
+ * @param offset Uncompressed offset
+ * @return Bytes read (0 at or past the end), -1 if the container is corrupt
+ */
+ssize_t decompress_blocked_range(const void *blob, size_t blob_size,
+                                 void *buf, size_t size, uint64_t offset);
+
+/**
+ * Check whether data looks worth compressing
+ * Estimates the entropy of the first COMPRESSION_PROBE_SIZE bytes from
+ * their byte histogram; 7.5 bits per byte or more is taken as already
+ * compressed or encrypted.
+ *
+ * @return 1 to try compressing, 0 to store the data raw
+ */
+int compression_probe(const void *data, size_t size);
+
+/**
+ * Codec registry
+ */
+int compression_codec_available(enum compression_codec codec);
+const char *compression_codec_name(enum compression_codec codec);
+
+/**
+ * Codec used for one kind of compression
+ */
+enum compression_codec compression_get_codec(enum compression_use use);
+
+/**
+ * Change the codec used for one kind of compression
+ * @return 0 on success, -1 if the codec is not built in
+ */
+int compression_set_codec(enum compression_use use, enum compression_codec codec);
+
 /**
  * Get compression statistics
  */
+struct compression_codec_stats {
+    uint64_t writes;             /* Blocks and buffers compressed */
+    uint64_t bytes_in;           /* ... their raw bytes */
+    uint64_t bytes_out;          /* ... and what they were stored in */
+    uint64_t reads;              /* Blocks and buffers decompressed */
+};
+
 struct compression_stats {
     uint64_t total_reads;
     uint64_t compressed_reads;
     uint64_t total_writes;
     uint64_t compressed_writes;
     uint64_t bytes_saved;
+    uint64_t probe_skips;        /* Left raw by the entropy probe */
+    struct compression_codec_stats codecs[COMPRESSION_CODEC_COUNT];
 };
 
 void get_compression_stats(struct compression_stats *stats);
@@ -0,0 +1,225 @@
+/**
+ * CRC32C (Castagnoli) Implementation - RAZORFS Checksums
+ */
+
+#include "crc32c.h"
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#elif defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#define CRC32C_HAVE_ARMV8 1
+#endif
+
+typedef uint32_t (*crc32c_fn)(uint32_t crc, const void *data, size_t len);
+
+/* Slicing-by-8 tables: crc32c_table[k][b] is the CRC of byte b followed
+ * by k zero bytes */
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static pthread_once_t crc32c_select_once = PTHREAD_ONCE_INIT;
+static crc32c_fn crc32c_selected;
+static const char *crc32c_selected_name = "slicing-by-8";
+
+static void init_crc32c_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int j = 0; j < 8; j++) {
+            c = (c & 1) ? (CRC32C_POLY ^ (c >> 1)) : (c >> 1);
+        }
+        crc32c_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = crc32c_table[0][i];
+        for (int k = 1; k < 8; k++) {
+            c = crc32c_table[0][c & 0xFF] ^ (c >> 8);
+            crc32c_table[k][i] = c;
+        }
+    }
+}
+
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc32c_table_once, init_crc32c_table);
+
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t c = ~crc;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= c;
+        c = crc32c_table[7][lo & 0xFF] ^
+            crc32c_table[6][(lo >> 8) & 0xFF] ^
+            crc32c_table[5][(lo >> 16) & 0xFF] ^
+            crc32c_table[4][lo >> 24] ^
+            crc32c_table[3][hi & 0xFF] ^
+            crc32c_table[2][(hi >> 8) & 0xFF] ^
+            crc32c_table[1][(hi >> 16) & 0xFF] ^
+            crc32c_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+#endif
+
+    while (len--) {
+        c = crc32c_table[0][(c ^ *p++) & 0xFF] ^ (c >> 8);
+    }
+    return ~c;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint64_t c = ~crc;
+
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c;
+    while (len--) {
+        c32 = _mm_crc32_u8(c32, *p++);
+    }
+    return ~c32;
+}
+#endif
+
+#ifdef CRC32C_HAVE_ARMV8
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t c = ~crc;
+
+    while (len >= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = __crc32cd(c, v);
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        c = __crc32cb(c, *p++);
+    }
+    return ~c;
+}
+#endif
+
+static void crc32c_select(void) {
+    crc32c_fn fn = crc32c_sw;
+
+#if defined(CRC32C_HAVE_SSE42)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        fn = crc32c_sse42;
+        crc32c_selected_name = "sse4.2";
+    }
+#elif defined(CRC32C_HAVE_ARMV8)
+    if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+        fn = crc32c_armv8;
+        crc32c_selected_name = "armv8";
+    }
+#endif
+
+    __atomic_store_n(&crc32c_selected, fn, __ATOMIC_RELEASE);
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    crc32c_fn fn = __atomic_load_n(&crc32c_selected, __ATOMIC_ACQUIRE);
+    if (!fn) {
+        pthread_once(&crc32c_select_once, crc32c_select);
+        fn = crc32c_selected;
+    }
+    return fn(crc, data, len);
+}
+
+const char *crc32c_impl(void) {
+    pthread_once(&crc32c_select_once, crc32c_select);
+    return crc32c_selected_name;
+}
+
+/* === CRC combination (zlib's GF(2) matrix method) === */
+
+#define GF2_DIM 32
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    int i = 0;
+    while (vec) {
+        if (vec & 1) {
+            sum ^= mat[i];
+        }
+        vec >>= 1;
+        i++;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
+    for (int i = 0; i < GF2_DIM; i++) {
+        square[i] = gf2_matrix_times(mat, mat[i]);
+    }
+}
+
+uint32_t crc32_combine_poly(uint32_t poly, uint32_t crc1, uint32_t crc2, size_t len2) {
+    if (len2 == 0) {
+        return crc1;
+    }
+
+    uint32_t even[GF2_DIM];
+    uint32_t odd[GF2_DIM];
+
+    // operator for one zero bit
+    odd[0] = poly;
+    uint32_t row = 1;
+    for (int i = 1; i < GF2_DIM; i++) {
+        odd[i] = row;
+        row <<= 1;
+    }
+
+    // square to get operator for two zero bits
+    gf2_matrix_square(even, odd);
+
+    // square to get operator for four zero bits
+    gf2_matrix_square(odd, even);
+
+    // apply len2 zeros to crc1
+    do {
+        // apply matrix multiplication for each bit of len2
+        gf2_matrix_square(even, odd);
+        if (len2 & 1) {
+            crc1 = gf2_matrix_times(even, crc1);
+        }
+        len2 >>= 1;
+
+        if (len2 == 0) {
+            break;
+        }
+
+        gf2_matrix_square(odd, even);
+        if (len2 & 1) {
+            crc1 = gf2_matrix_times(odd, crc1);
+        }
+        len2 >>= 1;
+    } while (len2 != 0);
+
+    crc1 ^= crc2;
+    return crc1;
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    return crc32_combine_poly(CRC32C_POLY, crc1, crc2, len2);
+}
@@ -0,0 +1,65 @@
+/**
+ * CRC32C (Castagnoli) - RAZORFS Checksums
+ *
+ * Used for WAL records and file data checksums:
+ * - SSE4.2 `crc32` on x86-64, ARMv8 CRC32C instructions on AArch64
+ * - Slicing-by-8 table fallback everywhere else
+ * The implementation is picked once at first use from the CPU feature bits.
+ *
+ * All functions take and return the finalized CRC, so a running checksum
+ * is continued by passing the previous result back in (start with 0).
+ */
+
+#ifndef RAZORFS_CRC32C_H
+#define RAZORFS_CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reflected polynomials */
+#define CRC32C_POLY  0x82F63B78   /* Castagnoli */
+#define CRC32_POLY   0xEDB88320   /* IEEE 802.3 (legacy WAL format) */
+
+/**
+ * Extend a CRC32C with more data
+ *
+ * @param crc CRC of the preceding data (0 to start)
+ * @param data Data to checksum
+ * @param len Length in bytes
+ * @return CRC32C of the preceding data followed by data
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * Portable slicing-by-8 CRC32C, bypassing hardware dispatch
+ * (same contract as crc32c)
+ */
+uint32_t crc32c_sw(uint32_t crc, const void *data, size_t len);
+
+/**
+ * Combine two CRC32Cs: crc32c(A || B) from crc32c(A), crc32c(B) and len(B)
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+/**
+ * Combine two CRCs of any reflected 32-bit polynomial
+ *
+ * @param poly Reflected polynomial (CRC32C_POLY, CRC32_POLY)
+ * @return CRC of the concatenation
+ */
+uint32_t crc32_combine_poly(uint32_t poly, uint32_t crc1, uint32_t crc2, size_t len2);
+
+/**
+ * Name of the selected implementation ("sse4.2", "armv8", "slicing-by-8")
+ */
+const char *crc32c_impl(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_CRC32C_H */
@@ -0,0 +1,1479 @@
+/**
+ * File Data Log Implementation - RAZORFS Persistent File Contents
+ */
+
+#define _GNU_SOURCE
+#include "data_log.h"
+#include "crc32c.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ALIGN8(x) (((uint64_t)(x) + 7) & ~(uint64_t)7)
+
+static const char zero_pad[8];
+
+/* Write `len` bytes at `offset`, retrying on short writes */
+static int pwrite_all(int fd, const void *buf, size_t len, uint64_t offset) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+/* Write through the I/O engine (queued until log_submit) or directly */
+static int log_write(struct data_log *log, const void *buf, size_t len, uint64_t offset) {
+    if (log->io) return io_engine_write(log->io, log->fd, buf, len, offset);
+    return pwrite_all(log->fd, buf, len, offset);
+}
+
+/* fdatasync, after the writes queued before it */
+static int log_fdatasync(struct data_log *log) {
+    if (log->io) return io_engine_fsync(log->io, log->fd);
+    return fdatasync(log->fd);
+}
+
+/* Wait for everything queued on the I/O engine */
+static int log_submit(struct data_log *log) {
+    return log->io ? io_engine_submit(log->io) : 0;
+}
+
+/* === Index (append_lock held to change it) === */
+
+static inline uint32_t bucket_of(const struct data_log *log, uint32_t inode) {
+    return (inode * 2654435761u) & log->bucket_mask;
+}
+
+static struct data_log_file *find_file(const struct data_log *log, uint32_t inode) {
+    struct data_log_file *f = log->buckets[bucket_of(log, inode)];
+    while (f && f->inode != inode) {
+        f = f->next;
+    }
+    return f;
+}
+
+/* Double the bucket array once there are more files than buckets */
+static int grow_buckets(struct data_log *log) {
+    uint32_t count = (log->bucket_mask + 1) * 2;
+    struct data_log_file **buckets = calloc(count, sizeof(*buckets));
+    if (!buckets) return -1;
+
+    uint32_t old_count = log->bucket_mask + 1;
+    struct data_log_file **old = log->buckets;
+    log->buckets = buckets;
+    log->bucket_mask = count - 1;
+
+    for (uint32_t b = 0; b < old_count; b++) {
+        struct data_log_file *f = old[b];
+        while (f) {
+            struct data_log_file *next = f->next;
+            uint32_t nb = bucket_of(log, f->inode);
+            f->next = buckets[nb];
+            buckets[nb] = f;
+            f = next;
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static struct data_log_file *add_file(struct data_log *log, uint32_t inode) {
+    if (log->file_count > log->bucket_mask && grow_buckets(log) != 0) {
+        return NULL;
+    }
+
+    struct data_log_file *f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+
+    f->inode = inode;
+    uint32_t b = bucket_of(log, inode);
+    f->next = log->buckets[b];
+    log->buckets[b] = f;
+    log->file_count++;
+    return f;
+}
+
+/* Bytes a ref occupies in the log itself */
+static inline uint64_t local_bytes(const struct data_log_chunk_ref *ref) {
+    return ref->flags & DATA_LOG_CHUNK_REMOTE ? 0 : ref->stored_size;
+}
+
+/* === Block Index (dedup; changed with the lock held for writing) === */
+
+/* Hash of a stored payload, 8 bytes at a time */
+static uint64_t block_hash(const char *data, uint32_t len) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ len;
+    uint32_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, data + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    uint64_t w = 0;
+    memcpy(&w, data + i, len - i);
+    h = (h ^ w) * 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 29);
+}
+
+static inline uint32_t block_bucket(const struct data_log *log, uint64_t key) {
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & log->block_mask;
+}
+
+static struct data_log_block *block_at(const struct data_log *log, uint64_t offset) {
+    struct data_log_block *b = log->blocks_by_offset[block_bucket(log, offset)];
+    while (b && b->offset != offset) {
+        b = b->next_by_offset;
+    }
+    return b;
+}
+
+/* A block holding the same stored bytes, or NULL */
+static struct data_log_block *block_find(const struct data_log *log, uint64_t hash,
+                                         uint32_t raw_size, const char *data,
+                                         uint32_t stored_size) {
+    struct data_log_block *b = log->blocks_by_hash[block_bucket(log, hash)];
+    for (; b; b = b->next_by_hash) {
+        if (b->hash == hash && b->raw_size == raw_size && b->stored_size == stored_size &&
+            memcmp(log->map + b->offset, data, stored_size) == 0) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* Double the block buckets (chains just get longer if this fails) */
+static void grow_blocks(struct data_log *log) {
+    uint32_t count = (log->block_mask + 1) * 2;
+    struct data_log_block **by_hash = calloc(count, sizeof(*by_hash));
+    struct data_log_block **by_offset = calloc(count, sizeof(*by_offset));
+    if (!by_hash || !by_offset) {
+        free(by_hash);
+        free(by_offset);
+        return;
+    }
+
+    uint32_t old_count = log->block_mask + 1;
+    struct data_log_block **old = log->blocks_by_offset;
+    free(log->blocks_by_hash);
+    log->blocks_by_hash = by_hash;
+    log->blocks_by_offset = by_offset;
+    log->block_mask = count - 1;
+
+    for (uint32_t i = 0; i < old_count; i++) {
+        struct data_log_block *b = old[i];
+        while (b) {
+            struct data_log_block *next = b->next_by_offset;
+            uint32_t hb = block_bucket(log, b->hash);
+            uint32_t ob = block_bucket(log, b->offset);
+            b->next_by_hash = by_hash[hb];
+            by_hash[hb] = b;
+            b->next_by_offset = by_offset[ob];
+            by_offset[ob] = b;
+            b = next;
+        }
+    }
+    free(old);
+}
+
+/* Set aside blocks so that linking `count` refs cannot fail */
+static int block_reserve(struct data_log *log, uint32_t count) {
+    if (!log->dedup) return 0;
+
+    while (log->spare_count < count) {
+        struct data_log_block *b = malloc(sizeof(*b));
+        if (!b) return -1;
+        b->next_by_hash = log->spare_blocks;
+        log->spare_blocks = b;
+        log->spare_count++;
+    }
+    if (log->block_count + count > log->block_mask) grow_blocks(log);
+    return 0;
+}
+
+/* Count a new local ref (reserved with block_reserve) */
+static void block_link(struct data_log *log, const struct data_log_chunk_ref *ref) {
+    struct data_log_block *b = block_at(log, ref->offset);
+    if (b) {
+        b->refs++;
+        return;
+    }
+
+    b = log->spare_blocks;
+    log->spare_blocks = b->next_by_hash;
+    log->spare_count--;
+
+    b->hash = block_hash(log->map + ref->offset, ref->stored_size);
+    b->offset = ref->offset;
+    b->raw_size = ref->raw_size;
+    b->stored_size = ref->stored_size;
+    b->refs = 1;
+
+    uint32_t hb = block_bucket(log, b->hash);
+    uint32_t ob = block_bucket(log, b->offset);
+    b->next_by_hash = log->blocks_by_hash[hb];
+    log->blocks_by_hash[hb] = b;
+    b->next_by_offset = log->blocks_by_offset[ob];
+    log->blocks_by_offset[ob] = b;
+    log->block_count++;
+    log->live_bytes += b->stored_size;  /* Stored once however often shared */
+}
+
+static void block_unlink(struct data_log *log, const struct data_log_chunk_ref *ref) {
+    struct data_log_block *b = block_at(log, ref->offset);
+    if (!b || --b->refs > 0) return;
+
+    struct data_log_block **link = &log->blocks_by_hash[block_bucket(log, b->hash)];
+    while (*link != b) link = &(*link)->next_by_hash;
+    *link = b->next_by_hash;
+    link = &log->blocks_by_offset[block_bucket(log, b->offset)];
+    while (*link != b) link = &(*link)->next_by_offset;
+    *link = b->next_by_offset;
+
+    log->block_count--;
+    log->live_bytes -= b->stored_size;
+    free(b);
+}
+
+static void free_blocks(struct data_log *log) {
+    if (log->blocks_by_offset) {
+        for (uint32_t i = 0; i <= log->block_mask; i++) {
+            struct data_log_block *b = log->blocks_by_offset[i];
+            while (b) {
+                struct data_log_block *next = b->next_by_offset;
+                free(b);
+                b = next;
+            }
+        }
+    }
+    while (log->spare_blocks) {
+        struct data_log_block *next = log->spare_blocks->next_by_hash;
+        free(log->spare_blocks);
+        log->spare_blocks = next;
+    }
+    free(log->blocks_by_hash);
+    free(log->blocks_by_offset);
+    log->blocks_by_hash = NULL;
+    log->blocks_by_offset = NULL;
+    log->block_mask = 0;
+    log->block_count = 0;
+    log->spare_count = 0;
+    log->dedup = 0;
+}
+
+/* Whether other refs point at the same payload */
+static inline int is_shared(const struct data_log *log, const struct data_log_chunk_ref *ref) {
+    if (!log->dedup || (ref->flags & DATA_LOG_CHUNK_REMOTE)) return 0;
+    const struct data_log_block *b = block_at(log, ref->offset);
+    return b && b->refs > 1;
+}
+
+/* A ref starts or stops pointing at its payload */
+static inline void ref_link(struct data_log *log, const struct data_log_chunk_ref *ref) {
+    if (ref->flags & DATA_LOG_CHUNK_REMOTE) return;
+    if (log->dedup) {
+        block_link(log, ref);
+    } else {
+        log->live_bytes += ref->stored_size;
+    }
+}
+
+static inline void ref_unlink(struct data_log *log, const struct data_log_chunk_ref *ref) {
+    if (ref->flags & DATA_LOG_CHUNK_REMOTE) return;
+    if (log->dedup) {
+        block_unlink(log, ref);
+    } else {
+        log->live_bytes -= ref->stored_size;
+    }
+}
+
+/* Forget chunks [keep, capacity) of a file */
+static void file_cut(struct data_log *log, struct data_log_file *f, uint32_t keep) {
+    for (uint32_t i = keep; i < f->capacity; i++) {
+        struct data_log_chunk_ref *ref = &f->chunks[i];
+        if (ref->raw_size) {
+            ref_unlink(log, ref);
+            f->count--;
+            memset(ref, 0, sizeof(*ref));
+        }
+    }
+}
+
+static void drop_file(struct data_log *log, uint32_t inode) {
+    struct data_log_file **link = &log->buckets[bucket_of(log, inode)];
+    while (*link && (*link)->inode != inode) {
+        link = &(*link)->next;
+    }
+
+    struct data_log_file *f = *link;
+    if (!f) return;
+
+    *link = f->next;
+    file_cut(log, f, 0);
+    log->file_count--;
+    free(f->chunks);
+    free(f);
+}
+
+static void free_index(struct data_log *log) {
+    if (!log->buckets) return;
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        struct data_log_file *f = log->buckets[b];
+        while (f) {
+            struct data_log_file *next = f->next;
+            free(f->chunks);
+            free(f);
+            f = next;
+        }
+    }
+    free(log->buckets);
+    log->buckets = NULL;
+    log->file_count = 0;
+    log->live_bytes = 0;
+    free_blocks(log);
+}
+
+/* Make room for chunk slots [0, top) */
+static int file_reserve(struct data_log_file *f, uint32_t top) {
+    if (top <= f->capacity) return 0;
+
+    uint32_t capacity = f->capacity ? f->capacity : 4;
+    while (capacity < top) capacity *= 2;
+
+    struct data_log_chunk_ref *chunks = realloc(f->chunks, (size_t)capacity * sizeof(*chunks));
+    if (!chunks) return -1;
+    memset(chunks + f->capacity, 0, (size_t)(capacity - f->capacity) * sizeof(*chunks));
+    f->chunks = chunks;
+    f->capacity = capacity;
+    return 0;
+}
+
+/* Apply one file's new state; on failure the index is unchanged */
+static int apply_file(struct data_log *log, uint32_t inode, uint64_t size, uint32_t keep,
+                      const struct data_log_chunk_ref *refs, uint32_t count) {
+    struct data_log_file *f = find_file(log, inode);
+    int created = f == NULL;
+    if (created && !(f = add_file(log, inode))) return -1;
+
+    uint32_t top = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (refs[i].idx >= top) top = refs[i].idx + 1;
+    }
+    if (file_reserve(f, top) != 0 || block_reserve(log, count) != 0) {
+        if (created) drop_file(log, inode);
+        return -1;
+    }
+
+    file_cut(log, f, keep);
+    for (uint32_t i = 0; i < count; i++) {
+        struct data_log_chunk_ref *slot = &f->chunks[refs[i].idx];
+        if (slot->raw_size) {
+            ref_unlink(log, slot);
+            f->count--;
+        }
+        *slot = refs[i];
+        slot->flags &= ~(uint32_t)DATA_LOG_CHUNK_SHARED;  /* Where it lies no longer matters */
+        if (slot->raw_size) {
+            ref_link(log, slot);
+            f->count++;
+        }
+    }
+    f->size = size;
+    return 0;
+}
+
+/* Approximate size of the log after compaction */
+static uint64_t live_estimate(const struct data_log *log) {
+    uint64_t bytes = log->live_bytes;
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f; f = f->next) {
+            bytes += sizeof(struct data_log_record) + sizeof(struct data_log_file_ref) + 8 +
+                     (uint64_t)f->count * 2 * sizeof(struct data_log_chunk_ref);
+        }
+    }
+    return bytes;
+}
+
+/* === Mapping === */
+
+/* Cover [0, end) with the mapping (lock held for writing) */
+static int ensure_mapped(struct data_log *log, uint64_t end) {
+    if (end <= log->map_len) return 0;
+
+    size_t len = log->map_len;
+    while (len < end) len *= 2;
+
+    void *map = mremap((void *)log->map, log->map_len, len, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        perror("mremap (data log)");
+        return -1;
+    }
+    log->map = map;
+    log->map_len = len;
+    return 0;
+}
+
+/* A complete record with a valid checksum at pos, or NULL */
+static const struct data_log_record *record_at(const struct data_log *log, uint64_t pos,
+                                               uint64_t end) {
+    if (pos + sizeof(struct data_log_record) > end) return NULL;
+
+    struct data_log_record hdr;
+    memcpy(&hdr, log->map + pos, sizeof(hdr));
+    if (hdr.magic != DATA_LOG_RECORD_MAGIC || hdr.length < sizeof(hdr) ||
+        hdr.length % 8 != 0 || hdr.length > end - pos) {
+        return NULL;
+    }
+
+    uint32_t crc = hdr.crc;
+    hdr.crc = 0;
+    uint32_t actual = crc32c(0, &hdr, sizeof(hdr));
+    actual = crc32c(actual, log->map + pos + sizeof(hdr), hdr.length - sizeof(hdr));
+    return actual == crc ? (const struct data_log_record *)(log->map + pos) : NULL;
+}
+
+/* Chunk refs starting at p, with local payloads checked to lie in [lo, hi)
+ * and shared ones in [DATA_LOG_HEADER_SIZE, shared_hi) */
+static const struct data_log_chunk_ref *check_refs(const void *p, uint32_t count,
+                                                   const char *body_end,
+                                                   uint64_t lo, uint64_t hi,
+                                                   uint64_t shared_hi) {
+    const struct data_log_chunk_ref *refs = p;
+    if ((uint64_t)(body_end - (const char *)p) < (uint64_t)count * sizeof(*refs)) return NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t flags = refs[i].flags;
+        if (refs[i].raw_size == 0 && refs[i].stored_size == 0 && flags == 0) {
+            continue;  /* Hole punched into a logged chunk */
+        }
+        if (refs[i].raw_size == 0 || refs[i].stored_size == 0 ||
+            refs[i].stored_size > refs[i].raw_size ||
+            (flags & ~(uint32_t)(DATA_LOG_CHUNK_REMOTE | DATA_LOG_CHUNK_SHARED)) ||
+            flags == (DATA_LOG_CHUNK_REMOTE | DATA_LOG_CHUNK_SHARED)) {
+            return NULL;
+        }
+        if (flags & DATA_LOG_CHUNK_REMOTE) continue;
+
+        uint64_t first = flags & DATA_LOG_CHUNK_SHARED ? DATA_LOG_HEADER_SIZE : lo;
+        uint64_t end = flags & DATA_LOG_CHUNK_SHARED ? shared_hi : hi;
+        if (refs[i].offset < first || refs[i].offset + refs[i].stored_size > end) {
+            return NULL;
+        }
+    }
+    return refs;
+}
+
+/* === Open / Replay === */
+
+static uint32_t slot_crc(const struct data_log_checkpoint *slot) {
+    struct data_log_checkpoint copy = *slot;
+    copy.crc = 0;
+    return crc32c(0, &copy, sizeof(copy));
+}
+
+/* Load the index from a checkpoint slot */
+static int load_checkpoint(struct data_log *log, const struct data_log_checkpoint *slot,
+                           uint64_t file_size) {
+    if (slot->seq == 0 || slot->crc != slot_crc(slot) ||
+        slot->offset < DATA_LOG_HEADER_SIZE || slot->offset > file_size) {
+        return -1;
+    }
+
+    const struct data_log_record *rec = record_at(log, slot->offset, file_size);
+    if (!rec || rec->type != DATA_LOG_REC_CHECKPOINT || rec->length != slot->length) {
+        return -1;
+    }
+
+    const char *p = (const char *)(rec + 1);
+    const char *end = (const char *)rec + rec->length;
+    for (uint32_t i = 0; i < rec->count; i++) {
+        const struct data_log_file_ref *fr = (const struct data_log_file_ref *)p;
+        if ((const char *)(fr + 1) > end) goto corrupt;
+
+        /* Payloads all precede the checkpoint */
+        const struct data_log_chunk_ref *refs =
+            check_refs(fr + 1, fr->count, end, DATA_LOG_HEADER_SIZE, slot->offset, 0);
+        if (!refs) goto corrupt;
+        if (apply_file(log, fr->inode, fr->size, 0, refs, fr->count) != 0) goto corrupt;
+        p = (const char *)(refs + fr->count);
+    }
+    return 0;
+
+corrupt:
+    free_index(log);
+    log->buckets = calloc(DATA_LOG_INITIAL_BUCKETS, sizeof(*log->buckets));
+    log->bucket_mask = DATA_LOG_INITIAL_BUCKETS - 1;
+    return -1;
+}
+
+/* Apply the records after the checkpoint; returns the end of the last valid one */
+static int replay(struct data_log *log, uint64_t pos, uint64_t file_size, uint64_t *end_out) {
+    const struct data_log_record *rec;
+    while ((rec = record_at(log, pos, file_size)) != NULL) {
+        if (rec->type == DATA_LOG_REC_FILE) {
+            const char *body_end = (const char *)rec + rec->length;
+            const struct data_log_chunk_ref *refs =
+                check_refs(rec + 1, rec->count, body_end, pos, pos + rec->length, pos);
+            if (!refs) break;
+            if (apply_file(log, rec->inode, rec->size, rec->keep, refs, rec->count) != 0) {
+                return -1;
+            }
+        } else if (rec->type == DATA_LOG_REC_REMOVE) {
+            drop_file(log, rec->inode);
+        } else if (rec->type != DATA_LOG_REC_CHECKPOINT) {
+            break;  /* Checkpoints whose slot never got written are skipped */
+        }
+        pos += rec->length;
+    }
+
+    *end_out = pos;
+    return 0;
+}
+
+static void release(struct data_log *log) {
+    free_index(log);
+    if (log->map) {
+        munmap((void *)log->map, log->map_len);
+        log->map = NULL;
+    }
+    if (log->fd >= 0) {
+        io_engine_unregister_file(log->io, log->fd);
+        close(log->fd);  /* Drops the flock */
+        log->fd = -1;
+    }
+}
+
+static int open_log(struct data_log *log, const char *path, int readonly) {
+    if (!log || !path) return -1;
+
+    memset(log, 0, sizeof(*log));
+    log->fd = -1;
+    if (strlen(path) >= sizeof(log->path)) return -1;
+    strcpy(log->path, path);
+
+    log->buckets = calloc(DATA_LOG_INITIAL_BUCKETS, sizeof(*log->buckets));
+    if (!log->buckets) return -1;
+    log->bucket_mask = DATA_LOG_INITIAL_BUCKETS - 1;
+
+    log->fd = readonly ? open(path, O_RDONLY) : open(path, O_RDWR | O_CREAT, 0600);
+    if (log->fd < 0) {
+        perror("open (data log)");
+        release(log);
+        return -1;
+    }
+
+    if (!readonly && flock(log->fd, LOCK_EX | LOCK_NB) != 0) {
+        fprintf(stderr, "Data log %s is in use by another process\n", path);
+        release(log);
+        return -1;
+    }
+
+    struct stat st;
+    struct data_log_super sb;
+    memset(&sb, 0, sizeof(sb));
+    if (fstat(log->fd, &st) != 0) {
+        perror("fstat (data log)");
+        release(log);
+        return -1;
+    }
+
+    uint64_t file_size = (uint64_t)st.st_size;
+    if (file_size >= DATA_LOG_HEADER_SIZE &&
+        pread(log->fd, &sb, sizeof(sb), 0) != (ssize_t)sizeof(sb)) {
+        perror("pread (data log)");
+        release(log);
+        return -1;
+    }
+
+    if (sb.magic == 0 && file_size <= DATA_LOG_HEADER_SIZE && !readonly) {
+        /* New (or never finished creating): no records yet */
+        memset(&sb, 0, sizeof(sb));
+        sb.magic = DATA_LOG_MAGIC;
+        sb.version = DATA_LOG_VERSION;
+        if (ftruncate(log->fd, DATA_LOG_HEADER_SIZE) != 0 ||
+            pwrite_all(log->fd, &sb, sizeof(sb), 0) != 0 ||
+            fdatasync(log->fd) != 0) {
+            perror("create (data log)");
+            release(log);
+            return -1;
+        }
+        file_size = DATA_LOG_HEADER_SIZE;
+    } else if (sb.magic != DATA_LOG_MAGIC || sb.version != DATA_LOG_VERSION) {
+        fprintf(stderr, "Invalid data log %s (magic 0x%x, version %u)\n",
+                path, sb.magic, sb.version);
+        release(log);
+        return -1;
+    }
+
+    /* Reserve address space so appends rarely need a remap */
+    size_t map_len = DATA_LOG_MAP_RESERVE;
+    while (map_len < file_size) map_len *= 2;
+    void *map = mmap(NULL, map_len, PROT_READ, MAP_SHARED | MAP_NORESERVE, log->fd, 0);
+    if (map == MAP_FAILED) {
+        map_len = (size_t)ALIGN8(file_size * 2) + (1u << 20);
+        map = mmap(NULL, map_len, PROT_READ, MAP_SHARED | MAP_NORESERVE, log->fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        perror("mmap (data log)");
+        release(log);
+        return -1;
+    }
+    log->map = map;
+    log->map_len = map_len;
+
+    /* Newest valid checkpoint first */
+    int first = sb.slots[1].seq > sb.slots[0].seq ? 1 : 0;
+    uint64_t start = DATA_LOG_HEADER_SIZE;
+    for (int i = 0; i < 2; i++) {
+        const struct data_log_checkpoint *slot = &sb.slots[(first + i) % 2];
+        if (load_checkpoint(log, slot, file_size) == 0) {
+            log->checkpoint_seq = slot->seq;
+            start = slot->offset + slot->length;
+            break;
+        }
+        if (!log->buckets) {
+            release(log);
+            return -1;
+        }
+    }
+
+    uint64_t end;
+    if (replay(log, start, file_size, &end) != 0) {
+        fprintf(stderr, "Out of memory replaying data log %s\n", path);
+        release(log);
+        return -1;
+    }
+
+    /* Cut off a torn append (read-only: it may be one in progress) */
+    if (end < file_size && !readonly && ftruncate(log->fd, (off_t)end) != 0) {
+        perror("ftruncate (data log)");
+        release(log);
+        return -1;
+    }
+
+    log->tail = end;
+    log->checkpoint_end = start;
+    log->readonly = readonly;
+    pthread_mutex_init(&log->append_lock, NULL);
+    pthread_rwlock_init(&log->lock, NULL);
+    return 0;
+}
+
+int data_log_open(struct data_log *log, const char *path) {
+    return open_log(log, path, 0);
+}
+
+int data_log_open_readonly(struct data_log *log, const char *path) {
+    return open_log(log, path, 1);
+}
+
+/* === Appends === */
+
+/* Append a FILE record; the index changes only once it is written */
+static int append_locked(struct data_log *log, uint32_t inode, uint64_t size, uint32_t keep,
+                         const struct data_log_put *puts, uint32_t count, int sync) {
+    size_t refs_size = (size_t)count * sizeof(struct data_log_chunk_ref);
+    struct data_log_chunk_ref *refs = calloc(count ? count : 1, sizeof(*refs));
+    if (!refs) return -1;
+
+    /* Without dedup (or memory for the hashes) every payload is written */
+    uint64_t *hashes = log->dedup ? malloc((size_t)(count ? count : 1) * sizeof(*hashes)) : NULL;
+
+    uint64_t start = log->tail;
+    uint64_t first = start + sizeof(struct data_log_record) + refs_size;
+    uint64_t pos = first;
+    for (uint32_t i = 0; i < count; i++) {
+        refs[i].idx = puts[i].idx;
+        if (!puts[i].raw_size) continue;  /* Punched: an all-zero ref */
+        refs[i].raw_size = puts[i].raw_size;
+        refs[i].stored_size = puts[i].stored_size;
+        refs[i].flags = puts[i].flags & DATA_LOG_CHUNK_REMOTE;
+        if (refs[i].flags) {
+            refs[i].offset = puts[i].offset;  /* No payload here */
+            continue;
+        }
+
+        if (hashes) {
+            /* Same bytes earlier in this record, or anywhere in the log */
+            hashes[i] = block_hash(puts[i].data, puts[i].stored_size);
+            const struct data_log_block *b = NULL;
+            uint32_t j = 0;
+            for (; j < i; j++) {
+                if (!(refs[j].flags & DATA_LOG_CHUNK_REMOTE) && hashes[j] == hashes[i] &&
+                    refs[j].raw_size == refs[i].raw_size &&
+                    refs[j].stored_size == refs[i].stored_size &&
+                    memcmp(puts[j].data, puts[i].data, puts[i].stored_size) == 0) {
+                    break;
+                }
+            }
+            if (j < i) {
+                refs[i].offset = refs[j].offset;
+                refs[i].flags = refs[j].flags;
+                log->dedup_hits++;
+                continue;
+            }
+            b = block_find(log, hashes[i], puts[i].raw_size, puts[i].data,
+                           puts[i].stored_size);
+            if (b) {
+                refs[i].offset = b->offset;
+                refs[i].flags = DATA_LOG_CHUNK_SHARED;
+                log->dedup_hits++;
+                continue;
+            }
+        }
+        refs[i].offset = pos;
+        pos += puts[i].stored_size;
+    }
+    free(hashes);
+
+    struct data_log_record rec = {
+        .magic = DATA_LOG_RECORD_MAGIC,
+        .type = DATA_LOG_REC_FILE,
+        .length = ALIGN8(pos - start),
+        .inode = inode,
+        .size = size,
+        .keep = keep,
+        .count = count,
+    };
+    size_t pad = (size_t)(start + rec.length - pos);
+
+    /* This record's own payloads sit back to back from `first`; the other
+     * refs point at payloads written before */
+    uint32_t crc = crc32c(0, &rec, sizeof(rec));
+    crc = crc32c(crc, refs, refs_size);
+    uint64_t next = first;
+    for (uint32_t i = 0; i < count; i++) {
+        if (refs[i].flags || refs[i].offset != next) continue;
+        crc = crc32c(crc, puts[i].data, puts[i].stored_size);
+        next += puts[i].stored_size;
+    }
+    rec.crc = crc32c(crc, zero_pad, pad);
+
+    /* Payloads and padding first, the header that validates them last */
+    int ret = 0;
+    next = first;
+    for (uint32_t i = 0; i < count && ret == 0; i++) {
+        if (refs[i].flags || refs[i].offset != next) continue;
+        ret = log_write(log, puts[i].data, puts[i].stored_size, refs[i].offset);
+        next += puts[i].stored_size;
+    }
+    if (ret == 0) ret = log_write(log, zero_pad, pad, pos);
+    if (ret == 0 && log->stage && sizeof(rec) + refs_size <= DATA_LOG_STAGE_SIZE) {
+        /* Header and refs are adjacent: one write from the registered buffer */
+        memcpy(log->stage, &rec, sizeof(rec));
+        memcpy(log->stage + sizeof(rec), refs, refs_size);
+        ret = log_write(log, log->stage, sizeof(rec) + refs_size, start);
+    } else {
+        if (ret == 0) ret = log_write(log, refs, refs_size, start + sizeof(rec));
+        if (ret == 0) ret = log_write(log, &rec, sizeof(rec), start);
+    }
+    if (ret == 0 && sync) {
+        if (log->deferred_sync) log->unsynced = 1;
+        else ret = log_fdatasync(log);
+    }
+    if (log_submit(log) != 0) ret = -1;
+    if (ret != 0) {
+        perror("write (data log)");
+        free(refs);
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&log->lock);
+    ret = ensure_mapped(log, start + rec.length);
+    if (ret == 0) ret = apply_file(log, inode, size, keep, refs, count);
+    if (ret == 0) log->tail = start + rec.length;
+    pthread_rwlock_unlock(&log->lock);
+
+    free(refs);
+    return ret;
+}
+
+/* Write the whole index as a checkpoint and point a superblock slot at it */
+static int write_checkpoint_locked(struct data_log *log) {
+    uint64_t body = 0;
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f; f = f->next) {
+            body += sizeof(struct data_log_file_ref) +
+                    (uint64_t)f->count * sizeof(struct data_log_chunk_ref);
+        }
+    }
+
+    uint64_t length = ALIGN8(sizeof(struct data_log_record) + body);
+    char *buf = calloc(1, length);
+    if (!buf) return -1;
+
+    struct data_log_record *rec = (struct data_log_record *)buf;
+    rec->magic = DATA_LOG_RECORD_MAGIC;
+    rec->type = DATA_LOG_REC_CHECKPOINT;
+    rec->length = length;
+    rec->count = log->file_count;
+
+    char *p = (char *)(rec + 1);
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f; f = f->next) {
+            struct data_log_file_ref *fr = (struct data_log_file_ref *)p;
+            fr->inode = f->inode;
+            fr->count = f->count;
+            fr->size = f->size;
+
+            struct data_log_chunk_ref *out = (struct data_log_chunk_ref *)(fr + 1);
+            for (uint32_t i = 0; i < f->capacity; i++) {
+                if (f->chunks[i].raw_size) *out++ = f->chunks[i];
+            }
+            p = (char *)out;
+        }
+    }
+    rec->crc = crc32c(0, buf, length);
+
+    struct data_log_checkpoint slot = {
+        .seq = log->checkpoint_seq + 1,
+        .offset = log->tail,
+        .length = length,
+    };
+    slot.crc = slot_crc(&slot);
+    uint64_t slot_pos = offsetof(struct data_log_super, slots) +
+                        (slot.seq % 2) * sizeof(struct data_log_checkpoint);
+
+    /* Record durable before the slot that points at it */
+    int ret = log_write(log, buf, length, log->tail);
+    if (ret == 0) ret = log_fdatasync(log);
+    if (log_submit(log) != 0) ret = -1;
+    free(buf);
+    if (ret == 0) ret = log_write(log, &slot, sizeof(slot), slot_pos);
+    if (ret == 0) ret = log_fdatasync(log);
+    if (log_submit(log) != 0) ret = -1;
+    if (ret == 0) log->unsynced = 0;
+    if (ret != 0) {
+        perror("checkpoint (data log)");
+        return -1;
+    }
+
+    pthread_rwlock_wrlock(&log->lock);
+    ret = ensure_mapped(log, log->tail + length);
+    log->tail += length;  /* The slot already points past it */
+    pthread_rwlock_unlock(&log->lock);
+
+    log->checkpoint_seq = slot.seq;
+    log->checkpoint_end = log->tail;
+    return ret;
+}
+
+/* Rewrite the live chunks into a fresh segment and switch to it */
+static int compact_locked(struct data_log *log) {
+    char tmp[sizeof(log->path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", log->path);
+    unlink(tmp);
+
+    struct data_log fresh;
+    if (data_log_open(&fresh, tmp) != 0) return -1;
+    fresh.io = log->io;
+    fresh.stage = log->stage;
+
+    /* Shared payloads are found again by content and copied once */
+    if (log->dedup && data_log_enable_dedup(&fresh) != 0) {
+        release(&fresh);
+        pthread_mutex_destroy(&fresh.append_lock);
+        pthread_rwlock_destroy(&fresh.lock);
+        unlink(tmp);
+        return -1;
+    }
+
+    struct data_log_put *puts = NULL;
+    uint32_t puts_capacity = 0;
+    int ret = 0;
+
+    for (uint32_t b = 0; b <= log->bucket_mask && ret == 0; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f && ret == 0; f = f->next) {
+            if (f->count > puts_capacity) {
+                struct data_log_put *grown = realloc(puts, (size_t)f->count * sizeof(*puts));
+                if (!grown) {
+                    ret = -1;
+                    break;
+                }
+                puts = grown;
+                puts_capacity = f->count;
+            }
+
+            uint32_t n = 0;
+            for (uint32_t i = 0; i < f->capacity; i++) {
+                const struct data_log_chunk_ref *ref = &f->chunks[i];
+                if (!ref->raw_size) continue;
+                puts[n].idx = i;
+                puts[n].raw_size = ref->raw_size;
+                puts[n].stored_size = ref->stored_size;
+                puts[n].flags = ref->flags;
+                puts[n].offset = ref->offset;
+                puts[n].data = ref->flags ? NULL : log->map + ref->offset;
+                n++;
+            }
+
+            /* Synced by the checkpoint below */
+            ret = append_locked(&fresh, f->inode, f->size, 0, puts, n, 0);
+        }
+    }
+    free(puts);
+
+    if (ret == 0) ret = write_checkpoint_locked(&fresh);
+    if (ret == 0 && rename(tmp, log->path) != 0) {
+        perror("rename (data log)");
+        ret = -1;
+    }
+    if (ret != 0) {
+        release(&fresh);
+        pthread_mutex_destroy(&fresh.append_lock);
+        pthread_rwlock_destroy(&fresh.lock);
+        unlink(tmp);
+        return -1;
+    }
+
+    printf("🧹 Data log compacted: %lu -> %lu bytes\n",
+           (unsigned long)log->tail, (unsigned long)fresh.tail);
+
+    pthread_rwlock_wrlock(&log->lock);
+    release(log);
+    log->fd = fresh.fd;
+    log->map = fresh.map;
+    log->map_len = fresh.map_len;
+    log->tail = fresh.tail;
+    log->checkpoint_seq = fresh.checkpoint_seq;
+    log->checkpoint_end = fresh.checkpoint_end;
+    log->live_bytes = fresh.live_bytes;
+    log->buckets = fresh.buckets;
+    log->bucket_mask = fresh.bucket_mask;
+    log->file_count = fresh.file_count;
+    log->dedup = fresh.dedup;
+    log->blocks_by_hash = fresh.blocks_by_hash;
+    log->blocks_by_offset = fresh.blocks_by_offset;
+    log->block_mask = fresh.block_mask;
+    log->block_count = fresh.block_count;
+    log->spare_blocks = fresh.spare_blocks;
+    log->spare_count = fresh.spare_count;
+    log->unsynced = 0;  /* Everything was copied into the synced file */
+    pthread_rwlock_unlock(&log->lock);
+    if (log->io) io_engine_register_file(log->io, log->fd);
+
+    pthread_mutex_destroy(&fresh.append_lock);
+    pthread_rwlock_destroy(&fresh.lock);
+    return 0;
+}
+
+static int checkpoint_locked(struct data_log *log) {
+    uint64_t used = log->tail - DATA_LOG_HEADER_SIZE;
+    if (log->tail >= DATA_LOG_COMPACT_MIN_BYTES && used > 2 * live_estimate(log)) {
+        if (compact_locked(log) == 0) return 0;
+        /* Keep using the old segment */
+    }
+
+    if (log->tail == log->checkpoint_end) return 0;  /* Nothing new */
+    return write_checkpoint_locked(log);
+}
+
+/* === Public API === */
+
+int data_log_append(struct data_log *log, uint32_t inode, uint64_t size,
+                    uint32_t keep, const struct data_log_put *puts, uint32_t count) {
+    if (!log || (count && !puts) || log->readonly) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    int ret = append_locked(log, inode, size, keep, puts, count, 1);
+    if (ret == 0 && log->tail - log->checkpoint_end >= DATA_LOG_CHECKPOINT_BYTES) {
+        checkpoint_locked(log);  /* Retried after the next append if it fails */
+    }
+    pthread_mutex_unlock(&log->append_lock);
+    return ret;
+}
+
+int data_log_remove(struct data_log *log, uint32_t inode) {
+    if (!log || log->readonly) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    if (!find_file(log, inode)) {
+        pthread_mutex_unlock(&log->append_lock);
+        return 0;  /* Never written back */
+    }
+
+    struct data_log_record rec = {
+        .magic = DATA_LOG_RECORD_MAGIC,
+        .type = DATA_LOG_REC_REMOVE,
+        .length = sizeof(rec),
+        .inode = inode,
+    };
+    rec.crc = crc32c(0, &rec, sizeof(rec));
+
+    int ret = pwrite_all(log->fd, &rec, sizeof(rec), log->tail);
+    if (ret != 0) {
+        perror("write (data log)");
+    } else {
+        pthread_rwlock_wrlock(&log->lock);
+        ret = ensure_mapped(log, log->tail + sizeof(rec));
+        if (ret == 0) {
+            drop_file(log, inode);
+            log->tail += sizeof(rec);
+        }
+        pthread_rwlock_unlock(&log->lock);
+    }
+
+    pthread_mutex_unlock(&log->append_lock);
+    return ret;
+}
+
+int data_log_contains(struct data_log *log, uint32_t inode) {
+    if (!log) return 0;
+
+    pthread_rwlock_rdlock(&log->lock);
+    int found = find_file(log, inode) != NULL;
+    pthread_rwlock_unlock(&log->lock);
+    return found;
+}
+
+int data_log_restore(struct data_log *log, uint32_t inode, data_log_chunk_fn fn,
+                     void *ctx, uint64_t *size_out) {
+    if (!log || !fn) return -1;
+
+    pthread_rwlock_rdlock(&log->lock);
+    const struct data_log_file *f = find_file(log, inode);
+    if (!f) {
+        pthread_rwlock_unlock(&log->lock);
+        return 1;
+    }
+
+    int ret = 0;
+    for (uint32_t i = 0; i < f->capacity && ret == 0; i++) {
+        const struct data_log_chunk_ref *ref = &f->chunks[i];
+        if (!ref->raw_size) continue;  /* Hole */
+        const char *payload = ref->flags & DATA_LOG_CHUNK_REMOTE ? NULL : log->map + ref->offset;
+        ret = fn(ctx, i, payload, ref->raw_size, ref->stored_size);
+    }
+    if (size_out) *size_out = f->size;
+
+    pthread_rwlock_unlock(&log->lock);
+    return ret == 0 ? 0 : -1;
+}
+
+int data_log_restore_chunk(struct data_log *log, uint32_t inode, uint32_t idx,
+                           data_log_chunk_fn fn, void *ctx) {
+    if (!log || !fn) return -1;
+
+    pthread_rwlock_rdlock(&log->lock);
+    const struct data_log_file *f = find_file(log, inode);
+    const struct data_log_chunk_ref *ref =
+        f && idx < f->capacity && f->chunks[idx].raw_size ? &f->chunks[idx] : NULL;
+
+    int ret = 1;
+    if (ref && (ref->flags & DATA_LOG_CHUNK_REMOTE)) {
+        ret = 2;
+    } else if (ref) {
+        ret = fn(ctx, idx, log->map + ref->offset, ref->raw_size, ref->stored_size) == 0 ?
+              0 : -1;
+    }
+
+    pthread_rwlock_unlock(&log->lock);
+    return ret;
+}
+
+int data_log_lookup(struct data_log *log, uint32_t inode, uint32_t idx,
+                    struct data_log_chunk_ref *ref_out) {
+    if (!log || !ref_out) return 1;
+
+    pthread_rwlock_rdlock(&log->lock);
+    const struct data_log_file *f = find_file(log, inode);
+    int found = f && idx < f->capacity && f->chunks[idx].raw_size;
+    if (found) *ref_out = f->chunks[idx];
+    pthread_rwlock_unlock(&log->lock);
+    return found ? 0 : 1;
+}
+
+int data_log_has_remote(struct data_log *log, uint32_t inode) {
+    if (!log) return 0;
+
+    pthread_rwlock_rdlock(&log->lock);
+    const struct data_log_file *f = find_file(log, inode);
+    int remote = 0;
+    for (uint32_t i = 0; f && i < f->capacity && !remote; i++) {
+        remote = f->chunks[i].raw_size && (f->chunks[i].flags & DATA_LOG_CHUNK_REMOTE);
+    }
+    pthread_rwlock_unlock(&log->lock);
+    return remote;
+}
+
+void data_log_for_each(struct data_log *log,
+                       void (*fn)(void *ctx, uint32_t inode, uint64_t size), void *ctx) {
+    if (!log || !fn) return;
+
+    pthread_rwlock_rdlock(&log->lock);
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f; f = f->next) {
+            fn(ctx, f->inode, f->size);
+        }
+    }
+    pthread_rwlock_unlock(&log->lock);
+}
+
+int data_log_export(struct data_log *log, uint32_t inode,
+                    struct data_log_chunk_ref **refs_out, uint32_t *count_out,
+                    char **payload_out, uint64_t *payload_len_out) {
+    if (!log || !refs_out || !count_out || !payload_out || !payload_len_out) return -1;
+
+    pthread_rwlock_rdlock(&log->lock);
+    const struct data_log_file *f = find_file(log, inode);
+    uint64_t total = 0;
+    uint32_t count = 0;
+    for (uint32_t i = 0; f && i < f->capacity; i++) {
+        const struct data_log_chunk_ref *ref = &f->chunks[i];
+        if (!ref->raw_size) continue;
+        if (ref->flags & DATA_LOG_CHUNK_REMOTE) {
+            f = NULL;  /* Already (partly) offloaded */
+            break;
+        }
+        if (is_shared(log, ref)) continue;
+        total += ref->stored_size;
+        count++;
+    }
+    if (!f) {
+        pthread_rwlock_unlock(&log->lock);
+        return 1;
+    }
+
+    struct data_log_chunk_ref *refs = malloc((size_t)(count ? count : 1) * sizeof(*refs));
+    char *payload = malloc(total ? total : 1);
+    if (!refs || !payload) {
+        pthread_rwlock_unlock(&log->lock);
+        free(refs);
+        free(payload);
+        return -1;
+    }
+
+    uint32_t n = 0;
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < f->capacity; i++) {
+        const struct data_log_chunk_ref *ref = &f->chunks[i];
+        if (!ref->raw_size || is_shared(log, ref)) continue;
+        refs[n++] = *ref;
+        memcpy(payload + pos, log->map + ref->offset, ref->stored_size);
+        pos += ref->stored_size;
+    }
+    pthread_rwlock_unlock(&log->lock);
+
+    *refs_out = refs;
+    *count_out = n;
+    *payload_out = payload;
+    *payload_len_out = total;
+    return 0;
+}
+
+int data_log_swap(struct data_log *log, uint32_t inode,
+                  const struct data_log_chunk_ref *expect,
+                  const struct data_log_put *puts, uint32_t count) {
+    if (!log || (count && (!expect || !puts))) return -1;
+
+    struct data_log_put *kept = malloc((size_t)(count ? count : 1) * sizeof(*kept));
+    if (!kept) return -1;
+
+    /* Only appends change the index, and they are held off from here on */
+    pthread_mutex_lock(&log->append_lock);
+    const struct data_log_file *f = find_file(log, inode);
+    uint32_t n = 0;
+    for (uint32_t i = 0; f && i < count; i++) {
+        uint32_t idx = puts[i].idx;
+        if (idx >= f->capacity) continue;
+        const struct data_log_chunk_ref *ref = &f->chunks[idx];
+        if (ref->raw_size && ref->flags == expect[i].flags &&
+            ref->offset == expect[i].offset) {
+            kept[n++] = puts[i];
+        }
+    }
+
+    int ret = 0;
+    if (n > 0) {
+        /* Nothing is cut: every chunk not in `kept` stays */
+        ret = append_locked(log, inode, f->size, UINT32_MAX, kept, n, 1);
+    }
+    pthread_mutex_unlock(&log->append_lock);
+
+    free(kept);
+    return ret == 0 ? (int)n : -1;
+}
+
+int data_log_checkpoint(struct data_log *log) {
+    if (!log || log->readonly) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    int ret = checkpoint_locked(log);
+    pthread_mutex_unlock(&log->append_lock);
+    return ret;
+}
+
+void data_log_close(struct data_log *log) {
+    if (!log || log->fd < 0) return;
+
+    if (!log->readonly) data_log_checkpoint(log);
+    release(log);
+    if (log->io) {
+        io_engine_destroy(log->io);
+        free(log->io);
+        log->io = NULL;
+    }
+    free(log->stage);
+    log->stage = NULL;
+    pthread_mutex_destroy(&log->append_lock);
+    pthread_rwlock_destroy(&log->lock);
+}
+
+/* === Deferred sync === */
+
+int data_log_set_deferred_sync(struct data_log *log, int enable) {
+    if (!log) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    log->deferred_sync = enable ? 1 : 0;
+    pthread_mutex_unlock(&log->append_lock);
+
+    return enable ? 0 : data_log_sync(log);
+}
+
+int data_log_sync(struct data_log *log) {
+    if (!log) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    int ret = 0;
+    if (log->unsynced) {
+        ret = fdatasync(log->fd);
+        if (ret == 0) log->unsynced = 0;
+        else perror("fdatasync (data log)");
+    }
+    pthread_mutex_unlock(&log->append_lock);
+    return ret;
+}
+
+int data_log_set_io_engine(struct data_log *log, enum io_engine_kind kind) {
+    if (!log || log->fd < 0) return -1;
+
+    struct io_engine *io = NULL;
+    char *stage = NULL;
+    if (kind != IO_ENGINE_PSYNC) {
+        io = malloc(sizeof(*io));
+        if (!io || io_engine_init(io, kind, IO_ENGINE_DEFAULT_DEPTH) != 0) {
+            free(io);
+            return -1;
+        }
+        if (io->kind != kind) {
+            io_engine_destroy(io);
+            free(io);
+            return -1;
+        }
+        io_engine_register_file(io, log->fd);
+        stage = aligned_alloc(4096, DATA_LOG_STAGE_SIZE);
+        if (stage && io_engine_register_buffer(io, stage, DATA_LOG_STAGE_SIZE) != 0) {
+            free(stage);  /* Header writes just do without it */
+            stage = NULL;
+        }
+    }
+
+    pthread_mutex_lock(&log->append_lock);
+    struct io_engine *old = log->io;
+    char *old_stage = log->stage;
+    log->io = io;
+    log->stage = stage;
+    pthread_mutex_unlock(&log->append_lock);
+
+    if (old) {
+        io_engine_destroy(old);
+        free(old);
+    }
+    free(old_stage);
+    return 0;
+}
+
+/* === Dedup === */
+
+int data_log_enable_dedup(struct data_log *log) {
+    if (!log) return -1;
+
+    pthread_mutex_lock(&log->append_lock);
+    pthread_rwlock_wrlock(&log->lock);
+    int ret = 0;
+    if (log->dedup) goto out;
+
+    log->blocks_by_hash = calloc(DATA_LOG_INITIAL_BLOCKS, sizeof(*log->blocks_by_hash));
+    log->blocks_by_offset = calloc(DATA_LOG_INITIAL_BLOCKS, sizeof(*log->blocks_by_offset));
+    log->block_mask = DATA_LOG_INITIAL_BLOCKS - 1;
+    log->dedup = 1;
+    if (!log->blocks_by_hash || !log->blocks_by_offset) ret = -1;
+
+    /* Index the payloads the refs already point at */
+    uint64_t plain_bytes = log->live_bytes;
+    log->live_bytes = 0;
+    for (uint32_t b = 0; ret == 0 && b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f && ret == 0; f = f->next) {
+            ret = block_reserve(log, f->count);
+            for (uint32_t i = 0; ret == 0 && i < f->capacity; i++) {
+                if (f->chunks[i].raw_size) ref_link(log, &f->chunks[i]);
+            }
+        }
+    }
+    if (ret != 0) {
+        free_blocks(log);
+        log->live_bytes = plain_bytes;
+    }
+
+out:
+    pthread_rwlock_unlock(&log->lock);
+    pthread_mutex_unlock(&log->append_lock);
+    return ret;
+}
+
+void data_log_dedup_stats(struct data_log *log, struct data_log_dedup_stats *stats) {
+    if (!log || !stats) return;
+
+    memset(stats, 0, sizeof(*stats));
+    pthread_rwlock_rdlock(&log->lock);
+    stats->hits = log->dedup_hits;
+    for (uint32_t i = 0; log->dedup && i <= log->block_mask; i++) {
+        for (const struct data_log_block *b = log->blocks_by_offset[i]; b; b = b->next_by_offset) {
+            stats->blocks++;
+            stats->refs += b->refs;
+            if (b->refs > 1) {
+                stats->shared_blocks++;
+                stats->saved_bytes += (uint64_t)(b->refs - 1) * b->stored_size;
+            }
+        }
+    }
+    pthread_rwlock_unlock(&log->lock);
+}
+
+/* Payloads of a run of blocks, rehashed by one verify thread */
+struct verify_slice {
+    const struct data_log *log;
+    struct data_log_block *const *blocks;
+    uint64_t count;
+    uint64_t bad_payloads;
+    pthread_t thread;
+    int started;
+};
+
+static int payload_intact(const struct data_log *log, const struct data_log_block *b) {
+    return b->offset + b->stored_size <= log->tail &&
+           block_hash(log->map + b->offset, b->stored_size) == b->hash;
+}
+
+static void *verify_slice_run(void *arg) {
+    struct verify_slice *v = arg;
+    for (uint64_t i = 0; i < v->count; i++) {
+        if (!payload_intact(v->log, v->blocks[i])) v->bad_payloads++;
+    }
+    return NULL;
+}
+
+/* Rehash every payload, split over up to `threads` threads */
+static uint64_t verify_payloads(const struct data_log *log, unsigned int threads) {
+    struct data_log_block **blocks = threads > 1 && log->block_count > threads ?
+        malloc(log->block_count * sizeof(*blocks)) : NULL;
+    struct verify_slice *slices = blocks ? calloc(threads, sizeof(*slices)) : NULL;
+    if (!slices) {
+        free(blocks);
+        uint64_t bad = 0;
+        for (uint32_t i = 0; i <= log->block_mask; i++) {
+            for (const struct data_log_block *b = log->blocks_by_offset[i]; b; b = b->next_by_offset) {
+                if (!payload_intact(log, b)) bad++;
+            }
+        }
+        return bad;
+    }
+
+    uint64_t n = 0;
+    for (uint32_t i = 0; i <= log->block_mask; i++) {
+        for (struct data_log_block *b = log->blocks_by_offset[i]; b; b = b->next_by_offset) {
+            blocks[n++] = b;
+        }
+    }
+
+    /* Slice 0 runs here; a slice whose thread does not start too */
+    uint64_t per = (n + threads - 1) / threads;
+    for (unsigned int t = 0; t < threads; t++) {
+        uint64_t first = (uint64_t)t * per < n ? (uint64_t)t * per : n;
+        slices[t].log = log;
+        slices[t].blocks = blocks + first;
+        slices[t].count = n - first < per ? n - first : per;
+        if (t > 0) {
+            slices[t].started = pthread_create(&slices[t].thread, NULL, verify_slice_run,
+                                               &slices[t]) == 0;
+            if (!slices[t].started) verify_slice_run(&slices[t]);
+        }
+    }
+    verify_slice_run(&slices[0]);
+
+    uint64_t bad = slices[0].bad_payloads;
+    for (unsigned int t = 1; t < threads; t++) {
+        if (slices[t].started) pthread_join(slices[t].thread, NULL);
+        bad += slices[t].bad_payloads;
+    }
+    free(slices);
+    free(blocks);
+    return bad;
+}
+
+int64_t data_log_verify(struct data_log *log, struct data_log_verify_report *report) {
+    return data_log_verify_parallel(log, report, 1);
+}
+
+int64_t data_log_verify_parallel(struct data_log *log, struct data_log_verify_report *report,
+                                 unsigned int threads) {
+    if (!log || !report) return -1;
+    memset(report, 0, sizeof(*report));
+    if (data_log_enable_dedup(log) != 0) return -1;
+
+    /* append_lock keeps the index still while `seen` is counted */
+    pthread_mutex_lock(&log->append_lock);
+    pthread_rwlock_rdlock(&log->lock);
+    for (uint32_t i = 0; i <= log->block_mask; i++) {
+        for (struct data_log_block *b = log->blocks_by_offset[i]; b; b = b->next_by_offset) {
+            b->seen = 0;
+        }
+    }
+
+    for (uint32_t b = 0; b <= log->bucket_mask; b++) {
+        for (const struct data_log_file *f = log->buckets[b]; f; f = f->next) {
+            for (uint32_t i = 0; i < f->capacity; i++) {
+                const struct data_log_chunk_ref *ref = &f->chunks[i];
+                if (!ref->raw_size || (ref->flags & DATA_LOG_CHUNK_REMOTE)) continue;
+                report->refs++;
+                struct data_log_block *blk = block_at(log, ref->offset);
+                if (!blk) {
+                    report->bad_refcounts++;
+                    continue;
+                }
+                blk->seen++;
+                if (blk->raw_size != ref->raw_size || blk->stored_size != ref->stored_size) {
+                    report->mismatched_refs++;
+                }
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i <= log->block_mask; i++) {
+        for (const struct data_log_block *b = log->blocks_by_offset[i]; b; b = b->next_by_offset) {
+            report->blocks++;
+            if (b->seen != b->refs) report->bad_refcounts++;
+        }
+    }
+    report->bad_payloads = verify_payloads(log, threads ? threads : 1);
+    pthread_rwlock_unlock(&log->lock);
+    pthread_mutex_unlock(&log->append_lock);
+
+    return (int64_t)(report->bad_refcounts + report->bad_payloads + report->mismatched_refs);
+}
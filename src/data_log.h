@@ -0,0 +1,429 @@
+/**
+ * File Data Log - RAZORFS Persistent File Contents
+ *
+ * The contents of all files live in one log-structured segment instead of
+ * one image per inode:
+ * - A superblock at offset 0 holds two checkpoint slots, written in turn;
+ *   the valid slot with the higher sequence number wins
+ * - Every write-back appends one FILE record: the new file size plus the
+ *   changed chunks in stored form (raw or compressed), under one CRC32C,
+ *   so a torn append is dropped as a whole
+ * - A CHECKPOINT record holds the whole chunk index. Opening the log maps
+ *   it once, loads the newest checkpoint and replays the records after it;
+ *   restores copy payloads out of the mapping, with no per-file syscalls
+ * - Superseded payloads are garbage. Once they outweigh the live data,
+ *   a checkpoint rewrites the live chunks into a fresh segment instead
+ * - A chunk may be remote: its payload was offloaded to another tier and
+ *   only its ref (with the position in the file's tier object) stays here
+ * - With deduplication on, payloads are content-addressed: a block index
+ *   keyed by a hash of the stored bytes finds an identical payload already
+ *   in the log, and the new ref points at it instead of writing it again.
+ *   Blocks are refcounted by the refs that share them; compaction keeps
+ *   one copy of each
+ *
+ * One process owns a log at a time (flock). Appends are serialized and
+ * made durable with fdatasync before they are visible in the index. With
+ * an io_uring engine, the writes and fdatasync of one append go to the
+ * kernel as one linked batch.
+ */
+
+#ifndef RAZORFS_DATA_LOG_H
+#define RAZORFS_DATA_LOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "io_engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* On-disk format */
+#define DATA_LOG_MAGIC           0x52464C47  /* "RFLG" */
+#define DATA_LOG_RECORD_MAGIC    0x52435244  /* "RCRD" */
+#define DATA_LOG_VERSION         1
+#define DATA_LOG_HEADER_SIZE     4096        /* Superblock; records follow */
+
+/* Chunk ref flags */
+#define DATA_LOG_CHUNK_REMOTE    0x1         /* Payload is in the tier object */
+#define DATA_LOG_CHUNK_SHARED    0x2         /* FILE record: payload is an earlier
+                                                record's (never in the index) */
+
+/* Record types */
+#define DATA_LOG_REC_FILE        1           /* New size and changed chunks */
+#define DATA_LOG_REC_REMOVE      2           /* File deleted */
+#define DATA_LOG_REC_CHECKPOINT  3           /* Full chunk index */
+
+/* Tuning */
+#define DATA_LOG_CHECKPOINT_BYTES  (64ULL << 20)  /* Appended bytes between checkpoints */
+#define DATA_LOG_COMPACT_MIN_BYTES (64ULL << 20)  /* Smallest log worth compacting */
+#define DATA_LOG_MAP_RESERVE       (1ULL << 36)   /* Address space reserved for the mapping */
+#define DATA_LOG_STAGE_SIZE        (64u << 10)    /* Registered buffer for record headers */
+#define DATA_LOG_INITIAL_BUCKETS   1024           /* Index hash buckets (power of two) */
+#define DATA_LOG_INITIAL_BLOCKS    4096           /* Block index buckets (power of two) */
+
+/**
+ * Checkpoint slot in the superblock
+ */
+struct data_log_checkpoint {
+    uint64_t seq;                /* 0 = never written */
+    uint64_t offset;             /* CHECKPOINT record */
+    uint64_t length;
+    uint32_t crc;                /* CRC32C of the slot with crc = 0 */
+    uint32_t reserved;
+};
+
+/**
+ * Superblock (first DATA_LOG_HEADER_SIZE bytes)
+ */
+struct data_log_super {
+    uint32_t magic;
+    uint32_t version;
+    struct data_log_checkpoint slots[2];
+};
+
+/**
+ * Record header, 8-byte aligned
+ * FILE: chunk refs, then their payloads. Chunks from `keep` on that the
+ *       record does not carry are holes (truncated away); an all-zero ref
+ *       turns a chunk below `keep` into a hole (punched).
+ * REMOVE: no body.
+ * CHECKPOINT: `count` x (struct data_log_file_ref + its chunk refs).
+ */
+struct data_log_record {
+    uint32_t magic;
+    uint32_t type;               /* DATA_LOG_REC_* */
+    uint64_t length;             /* Header + body + padding */
+    uint32_t crc;                /* CRC32C of the record with crc = 0 */
+    uint32_t inode;
+    uint64_t size;               /* FILE: file size */
+    uint32_t keep;               /* FILE: first chunk not kept from before */
+    uint32_t count;              /* FILE: chunk refs, CHECKPOINT: files */
+};
+
+/**
+ * Where a chunk payload lies in the log
+ */
+struct data_log_chunk_ref {
+    uint32_t idx;                /* Chunk number */
+    uint32_t raw_size;           /* 0 = hole */
+    uint32_t stored_size;        /* == raw_size if stored raw */
+    uint32_t flags;              /* DATA_LOG_CHUNK_* */
+    uint64_t offset;             /* Payload position in the log (in the tier
+                                    object if remote) */
+};
+
+/**
+ * One file in a CHECKPOINT record, followed by `count` chunk refs
+ */
+struct data_log_file_ref {
+    uint32_t inode;
+    uint32_t count;
+    uint64_t size;
+};
+
+/**
+ * Chunk handed to data_log_append()
+ */
+struct data_log_put {
+    uint32_t idx;
+    uint32_t raw_size;           /* 0: the chunk becomes a hole */
+    uint32_t stored_size;
+    const char *data;            /* stored_size bytes (unused if remote) */
+    uint32_t flags;              /* DATA_LOG_CHUNK_REMOTE: ref only, at `offset` */
+    uint64_t offset;             /* Position in the tier object if remote */
+};
+
+/**
+ * In-memory index entry for one file
+ */
+struct data_log_file {
+    uint32_t inode;
+    uint32_t capacity;           /* Slots in chunks */
+    uint32_t count;              /* Non-hole chunks */
+    uint64_t size;
+    struct data_log_chunk_ref *chunks;   /* Indexed by chunk number */
+    struct data_log_file *next;          /* Hash chain */
+};
+
+/**
+ * One distinct payload in the log, shared by `refs` chunk refs (dedup)
+ */
+struct data_log_block {
+    uint64_t hash;               /* Of the stored bytes */
+    uint64_t offset;
+    uint32_t raw_size;
+    uint32_t stored_size;
+    uint32_t refs;
+    uint32_t seen;               /* data_log_verify() scratch */
+    struct data_log_block *next_by_hash;
+    struct data_log_block *next_by_offset;
+};
+
+/**
+ * Deduplication statistics
+ */
+struct data_log_dedup_stats {
+    uint64_t blocks;             /* Distinct local payloads */
+    uint64_t shared_blocks;      /* ... referenced more than once */
+    uint64_t refs;               /* Local chunk refs */
+    uint64_t saved_bytes;        /* Payload bytes not stored thanks to sharing */
+    uint64_t hits;               /* Appended chunks that found a copy */
+};
+
+/**
+ * Result of data_log_verify()
+ */
+struct data_log_verify_report {
+    uint64_t blocks;
+    uint64_t refs;
+    uint64_t bad_refcounts;      /* Block refcount differs from its refs */
+    uint64_t bad_payloads;       /* Payload no longer matches its hash */
+    uint64_t mismatched_refs;    /* Refs sharing an offset with different sizes */
+};
+
+/**
+ * Open log
+ */
+struct data_log {
+    int fd;
+    char path[256];
+    const char *map;             /* Read-only mapping of the whole log */
+    size_t map_len;              /* Mapped (reserved) length */
+
+    uint64_t tail;               /* End of the last record */
+    uint64_t checkpoint_seq;
+    uint64_t checkpoint_end;     /* Tail when the last checkpoint was taken */
+    uint64_t live_bytes;         /* Local payload bytes the index refers to */
+
+    struct data_log_file **buckets;
+    uint32_t bucket_mask;
+    uint32_t file_count;
+
+    /* Block index (dedup only) */
+    int dedup;
+    struct data_log_block **blocks_by_hash;
+    struct data_log_block **blocks_by_offset;
+    uint32_t block_mask;
+    uint64_t block_count;
+    struct data_log_block *spare_blocks; /* Reserved before the index changes */
+    uint32_t spare_count;
+    uint64_t dedup_hits;
+
+    int readonly;                /* data_log_open_readonly: never written */
+
+    /* Deferred sync: appends skip fdatasync until data_log_sync() */
+    int deferred_sync;
+    int unsynced;                /* Appended since the last sync */
+
+    /* I/O engine (NULL = pwrite/fdatasync on the calling thread) */
+    struct io_engine *io;
+    char *stage;                 /* Registered with it: header + refs of a record */
+
+    pthread_mutex_t append_lock; /* Serializes appends, checkpoints, compaction */
+    pthread_rwlock_t lock;       /* Index and mapping: restores read, appends
+                                    take it briefly to publish */
+};
+
+/**
+ * Called for each chunk of a restored file (payload points into the log,
+ * or is NULL for a remote chunk)
+ * @return 0 to continue, -1 to stop with an error
+ */
+typedef int (*data_log_chunk_fn)(void *ctx, uint32_t idx, const char *payload,
+                                 uint32_t raw_size, uint32_t stored_size);
+
+/**
+ * Open a log, creating it if needed
+ * Loads the newest valid checkpoint and replays the records after it; a
+ * torn tail is cut off.
+ *
+ * @return 0 on success, -1 on failure (bad superblock, in use, I/O error)
+ */
+int data_log_open(struct data_log *log, const char *path);
+
+/**
+ * Open a log read-only, e.g. one a mount is using (razorfsck)
+ * Takes no lock and changes nothing: the index is the log as of the open,
+ * records still being appended are left out. Appends fail.
+ *
+ * @return 0 on success, -1 on failure (missing, bad superblock, I/O error)
+ */
+int data_log_open_readonly(struct data_log *log, const char *path);
+
+/**
+ * Checkpoint (compacting if worthwhile) and close
+ */
+void data_log_close(struct data_log *log);
+
+/**
+ * Check whether the log holds a file
+ * @return 1 if it does, 0 otherwise
+ */
+int data_log_contains(struct data_log *log, uint32_t inode);
+
+/**
+ * Append a write-back of one file and make it durable
+ * Chunks below `keep` that are not in `puts` keep their logged payloads;
+ * from `keep` on, only `puts` remain.
+ *
+ * @param size New file size
+ * @param keep First chunk dropped unless rewritten (the file's span if
+ *             nothing was truncated)
+ * @return 0 on success, -1 on failure (the index is unchanged)
+ */
+int data_log_append(struct data_log *log, uint32_t inode, uint64_t size,
+                    uint32_t keep, const struct data_log_put *puts, uint32_t count);
+
+/**
+ * Forget a file
+ * Not synced by itself; the next append or checkpoint makes it durable.
+ *
+ * @return 0 on success (or if the log does not hold it), -1 on failure
+ */
+int data_log_remove(struct data_log *log, uint32_t inode);
+
+/**
+ * Hand a file's chunks to fn, in chunk order
+ *
+ * @param size_out Receives the file size
+ * @return 0 on success, 1 if the log does not hold the file,
+ *         -1 if fn failed or a chunk is corrupt
+ */
+int data_log_restore(struct data_log *log, uint32_t inode, data_log_chunk_fn fn,
+                     void *ctx, uint64_t *size_out);
+
+/**
+ * Hand one chunk of a file to fn
+ * Looked up by chunk number at call time, so it still finds the chunk
+ * after later appends or compaction moved it.
+ *
+ * @return 0 on success, 1 if the log holds no such chunk (file or chunk
+ *         gone), 2 if the chunk is remote (fn not called; see
+ *         data_log_lookup()), -1 if fn failed
+ */
+int data_log_restore_chunk(struct data_log *log, uint32_t inode, uint32_t idx,
+                           data_log_chunk_fn fn, void *ctx);
+
+/**
+ * Copy one chunk's index entry
+ * @return 0 if found, 1 if the log holds no such chunk
+ */
+int data_log_lookup(struct data_log *log, uint32_t inode, uint32_t idx,
+                    struct data_log_chunk_ref *ref_out);
+
+/**
+ * Check whether any chunk of a file is remote
+ * @return 1 if one is, 0 otherwise
+ */
+int data_log_has_remote(struct data_log *log, uint32_t inode);
+
+/**
+ * List the files in the log
+ * fn runs under the index lock and must not call back into the log.
+ *
+ * @param fn Called with each inode and its file size
+ */
+void data_log_for_each(struct data_log *log,
+                       void (*fn)(void *ctx, uint32_t inode, uint64_t size), void *ctx);
+
+/**
+ * Copy a file's chunks out of the log
+ *
+ * @param refs_out Receives the chunk refs in chunk order (malloc'd)
+ * @param payload_out Receives their payloads back to back (malloc'd)
+ * @param payload_len_out Total payload bytes
+ * Chunks whose payload other refs share (dedup) are left out: they are
+ * stored once here already and stay local.
+ *
+ * @return 0 on success, 1 if the log does not hold the file or part of it
+ *         is already remote, -1 out of memory
+ */
+int data_log_export(struct data_log *log, uint32_t inode,
+                    struct data_log_chunk_ref **refs_out, uint32_t *count_out,
+                    char **payload_out, uint64_t *payload_len_out);
+
+/**
+ * Replace chunks, but only those the index still holds as `expect`
+ * (same flags and offset), in one durable append. The file size is left
+ * as it is. Used to turn exported chunks remote without losing writes
+ * that landed in between.
+ *
+ * @param expect Current ref of each chunk in `puts`
+ * @return Chunks replaced, or -1 on failure
+ */
+int data_log_swap(struct data_log *log, uint32_t inode,
+                  const struct data_log_chunk_ref *expect,
+                  const struct data_log_put *puts, uint32_t count);
+
+/**
+ * Enable/disable deferred sync
+ * Appends then return once written, without fdatasync; data_log_sync()
+ * (or the next checkpoint) makes them durable. A crash may lose the
+ * records written since, never records before them. Disabling syncs.
+ *
+ * @return 0 on success, -1 on error
+ */
+int data_log_set_deferred_sync(struct data_log *log, int enable);
+
+/**
+ * Make every record appended so far durable
+ * @return 0 on success, -1 on error
+ */
+int data_log_sync(struct data_log *log);
+
+/**
+ * Choose the I/O engine for appends and checkpoints
+ * IO_ENGINE_URING submits each append (payloads, header, fdatasync) as
+ * one linked batch; IO_ENGINE_PSYNC goes back to pwrite/fdatasync.
+ *
+ * @return 0 if the engine is in use, -1 if it is unavailable (the log
+ *         keeps using pwrite/fdatasync)
+ */
+int data_log_set_io_engine(struct data_log *log, enum io_engine_kind kind);
+
+/**
+ * Turn on deduplication
+ * Builds the block index by hashing every local payload once, then lets
+ * appends share identical payloads. Logs written with dedup stay readable
+ * without it (shared payloads are then copied apart by compaction).
+ *
+ * @return 0 on success, -1 out of memory (dedup stays off)
+ */
+int data_log_enable_dedup(struct data_log *log);
+
+/**
+ * Copy out the deduplication statistics (zeros with dedup off)
+ */
+void data_log_dedup_stats(struct data_log *log, struct data_log_dedup_stats *stats);
+
+/**
+ * Check the block index against the chunk refs and the payloads
+ * Recounts the refs of every block and rehashes its payload (turns dedup
+ * on if it is off).
+ *
+ * @return Problems found (0 = consistent), -1 if the check could not run
+ */
+int64_t data_log_verify(struct data_log *log, struct data_log_verify_report *report);
+
+/**
+ * data_log_verify() with the payloads rehashed by `threads` threads
+ * (the caller's included); falls back to one if threads cannot be started
+ *
+ * @return Problems found (0 = consistent), -1 if the check could not run
+ */
+int64_t data_log_verify_parallel(struct data_log *log, struct data_log_verify_report *report,
+                                 unsigned int threads);
+
+/**
+ * Write a checkpoint, or compact the log if garbage outweighs live data
+ * @return 0 on success, -1 on failure
+ */
+int data_log_checkpoint(struct data_log *log);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_DATA_LOG_H */
@@ -0,0 +1,750 @@
+/**
+ * Chunked Extent Store Implementation - RAZORFS File Data
+ */
+
+#define _GNU_SOURCE
+#include "extent_store.h"
+#include "compression.h"
+#include "numa_support.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Initial extent map size (slots) */
+#define EXTENT_MAP_INITIAL 16
+
+/* Largest addressable file: chunk numbers must fit the 32-bit map index */
+#define EXTENT_MAX_FILE_SIZE ((uint64_t)UINT32_MAX << EXTENT_CHUNK_SHIFT)
+
+/* Holes and chunk tails in views point here */
+static const char g_zero_chunk[EXTENT_CHUNK_SIZE];
+
+int extent_store_init(struct extent_store *es) {
+    if (!es) return -1;
+
+    es->chunks = NULL;
+    es->map_capacity = 0;
+    es->chunk_count = 0;
+    es->compressed_count = 0;
+    es->dirty_count = 0;
+    es->absent_count = 0;
+    es->shrunk_span = EXTENT_SPAN_NONE;
+    es->size_dirty = 0;
+    es->numa_node = -1;
+    es->data_bytes = 0;
+    es->size = 0;
+    return 0;
+}
+
+void extent_store_destroy(struct extent_store *es) {
+    if (!es) return;
+
+    for (uint32_t i = 0; i < es->map_capacity; i++) {
+        free(es->chunks[i].data);
+    }
+    free(es->chunks);
+
+    es->chunks = NULL;
+    es->map_capacity = 0;
+    es->chunk_count = 0;
+    es->compressed_count = 0;
+    es->dirty_count = 0;
+    es->absent_count = 0;
+    es->shrunk_span = EXTENT_SPAN_NONE;
+    es->size_dirty = 0;
+    es->data_bytes = 0;
+    es->size = 0;
+}
+
+/* Heap bytes a chunk payload occupies */
+static inline uint32_t chunk_bytes(const struct extent_chunk *chunk) {
+    if (!chunk->data) return 0;
+    return chunk->stored ? chunk->stored : chunk->capacity;
+}
+
+/* Flag a chunk as changed since the last write-back */
+static void mark_dirty(struct extent_store *es, uint32_t idx) {
+    struct extent_chunk *chunk = &es->chunks[idx];
+    if (!(chunk->flags & EXTENT_CHUNK_DIRTY)) {
+        chunk->flags |= EXTENT_CHUNK_DIRTY;
+        es->dirty_count++;
+    }
+}
+
+/* Release one chunk back to a hole */
+static void free_chunk(struct extent_store *es, uint32_t idx) {
+    struct extent_chunk *chunk = &es->chunks[idx];
+    if (chunk->flags & EXTENT_CHUNK_ABSENT) {
+        chunk->flags &= ~EXTENT_CHUNK_ABSENT;
+        chunk->capacity = 0;
+        chunk->version++;
+        es->absent_count--;
+        return;
+    }
+    if (!chunk->data) return;
+
+    es->data_bytes -= chunk_bytes(chunk);
+    free(chunk->data);
+    if (chunk->stored) {
+        es->compressed_count--;
+    }
+    chunk->data = NULL;
+    chunk->capacity = 0;
+    chunk->stored = 0;
+    chunk->version++;
+    if (chunk->flags & EXTENT_CHUNK_DIRTY) {
+        chunk->flags &= ~EXTENT_CHUNK_DIRTY;
+        es->dirty_count--;
+    }
+    es->chunk_count--;
+}
+
+/**
+ * Grow the extent map so it has at least `slots` entries
+ * Only the small map array is reallocated - chunk buffers never move.
+ */
+static int ensure_map(struct extent_store *es, uint64_t slots) {
+    if (slots <= es->map_capacity) return 0;
+
+    uint64_t new_capacity = es->map_capacity ? es->map_capacity : EXTENT_MAP_INITIAL;
+    while (new_capacity < slots) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > UINT32_MAX) {
+        new_capacity = UINT32_MAX;
+    }
+
+    struct extent_chunk *new_map = realloc(es->chunks,
+                                           new_capacity * sizeof(struct extent_chunk));
+    if (!new_map) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memset(new_map + es->map_capacity, 0,
+           (new_capacity - es->map_capacity) * sizeof(struct extent_chunk));
+    es->chunks = new_map;
+    es->map_capacity = (uint32_t)new_capacity;
+    return 0;
+}
+
+/* Replace a compressed chunk with its raw bytes (before modifying it) */
+static int inflate_chunk(struct extent_store *es, uint32_t idx) {
+    struct extent_chunk *chunk = &es->chunks[idx];
+    if (!chunk->stored) return 0;
+
+    char *raw = malloc(chunk->capacity);
+    if (!raw) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (decompress_block(chunk->data, chunk->stored, raw, chunk->capacity) != 0) {
+        free(raw);
+        errno = EIO;
+        return -1;
+    }
+
+    numa_place(raw, chunk->capacity, NUMA_MEM_FILE_DATA, es->numa_node);
+    es->data_bytes += chunk->capacity - chunk->stored;
+    free(chunk->data);
+    chunk->data = raw;
+    chunk->stored = 0;
+    es->compressed_count--;
+    return 0;
+}
+
+/**
+ * Make chunk `idx` hold at least `needed` raw bytes
+ * Chunk buffers double from EXTENT_CHUNK_MIN_ALLOC up to EXTENT_CHUNK_SIZE;
+ * newly allocated bytes are zeroed so holes inside a chunk read as zeros.
+ */
+static int ensure_chunk(struct extent_store *es, uint32_t idx, uint32_t needed) {
+    if (es->chunks[idx].flags & EXTENT_CHUNK_ABSENT) {
+        errno = EIO;  /* Not faulted in */
+        return -1;
+    }
+    if (inflate_chunk(es, idx) != 0) return -1;
+
+    struct extent_chunk *chunk = &es->chunks[idx];
+    chunk->version++;  /* Caller is about to modify it */
+    mark_dirty(es, idx);
+    if (chunk->capacity >= needed) return 0;
+
+    uint32_t new_capacity = chunk->capacity ? chunk->capacity : EXTENT_CHUNK_MIN_ALLOC;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > EXTENT_CHUNK_SIZE) {
+        new_capacity = EXTENT_CHUNK_SIZE;
+    }
+
+    char *new_data = realloc(chunk->data, new_capacity);
+    if (!new_data) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    numa_place(new_data, new_capacity, NUMA_MEM_FILE_DATA, es->numa_node);
+    memset(new_data + chunk->capacity, 0, new_capacity - chunk->capacity);
+    if (!chunk->data) {
+        es->chunk_count++;
+    }
+    es->data_bytes += new_capacity - chunk->capacity;
+    chunk->data = new_data;
+    chunk->capacity = new_capacity;
+    return 0;
+}
+
+ssize_t extent_store_read(const struct extent_store *es, void *buf,
+                          size_t size, uint64_t offset) {
+    if (!es || !buf || offset >= es->size) return 0;
+
+    uint64_t available = es->size - offset;
+    size_t total = size < available ? size : (size_t)available;
+    char *out = buf;
+    char *scratch = NULL;
+    size_t remaining = total;
+
+    while (remaining > 0) {
+        uint64_t idx = EXTENT_CHUNK_INDEX(offset);
+        uint32_t coff = EXTENT_CHUNK_OFFSET(offset);
+        size_t n = EXTENT_CHUNK_SIZE - coff;
+        if (n > remaining) n = remaining;
+
+        const struct extent_chunk *chunk =
+            idx < es->map_capacity ? &es->chunks[idx] : NULL;
+        if (chunk && (chunk->flags & EXTENT_CHUNK_ABSENT)) {
+            free(scratch);
+            errno = EIO;  /* Not faulted in */
+            return -1;
+        }
+
+        size_t copied = 0;
+        if (chunk && chunk->data && coff < chunk->capacity) {
+            const char *src = chunk->data;
+
+            /* Inflate only this chunk, never the whole file */
+            if (chunk->stored) {
+                if (!scratch && !(scratch = malloc(EXTENT_CHUNK_SIZE))) {
+                    errno = ENOMEM;
+                    return -1;
+                }
+                if (decompress_block(chunk->data, chunk->stored,
+                                     scratch, chunk->capacity) != 0) {
+                    free(scratch);
+                    errno = EIO;
+                    return -1;
+                }
+                src = scratch;
+            }
+
+            copied = chunk->capacity - coff;
+            if (copied > n) copied = n;
+            memcpy(out, src + coff, copied);
+        }
+        if (copied < n) {
+            memset(out + copied, 0, n - copied);
+        }
+
+        out += n;
+        offset += n;
+        remaining -= n;
+    }
+
+    free(scratch);
+    return (ssize_t)total;
+}
+
+static void view_add(struct extent_view *view, const char *mem, size_t len) {
+    view->iov[view->count].iov_base = (void *)mem;
+    view->iov[view->count].iov_len = len;
+    view->count++;
+    view->bytes += len;
+}
+
+ssize_t extent_store_view(const struct extent_store *es, struct extent_view *view,
+                          size_t size, uint64_t offset) {
+    if (!view) {
+        errno = EINVAL;
+        return -1;
+    }
+    view->count = 0;
+    view->bytes = 0;
+    view->scratch_count = 0;
+    if (!es || offset >= es->size || size == 0) return 0;
+
+    uint64_t available = es->size - offset;
+    size_t total = size < available ? size : (size_t)available;
+
+    uint64_t first = EXTENT_CHUNK_INDEX(offset);
+    uint64_t last = EXTENT_CHUNK_INDEX(offset + total - 1);
+    if (last - first + 1 > EXTENT_VIEW_MAX_CHUNKS) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    size_t remaining = total;
+    while (remaining > 0) {
+        uint64_t idx = EXTENT_CHUNK_INDEX(offset);
+        uint32_t coff = EXTENT_CHUNK_OFFSET(offset);
+        size_t n = EXTENT_CHUNK_SIZE - coff;
+        if (n > remaining) n = remaining;
+
+        const struct extent_chunk *chunk =
+            idx < es->map_capacity ? &es->chunks[idx] : NULL;
+        if (chunk && (chunk->flags & EXTENT_CHUNK_ABSENT)) {
+            extent_view_release(view);
+            errno = EIO;  /* Not faulted in */
+            return -1;
+        }
+
+        size_t mapped = 0;
+        if (chunk && chunk->data && coff < chunk->capacity) {
+            const char *src = chunk->data;
+
+            /* Compressed chunks are the only ones that need a copy */
+            if (chunk->stored) {
+                char *raw = malloc(chunk->capacity);
+                if (!raw) {
+                    extent_view_release(view);
+                    errno = ENOMEM;
+                    return -1;
+                }
+                if (decompress_block(chunk->data, chunk->stored,
+                                     raw, chunk->capacity) != 0) {
+                    free(raw);
+                    extent_view_release(view);
+                    errno = EIO;
+                    return -1;
+                }
+                view->scratch[view->scratch_count++] = raw;
+                src = raw;
+            }
+
+            mapped = chunk->capacity - coff;
+            if (mapped > n) mapped = n;
+            view_add(view, src + coff, mapped);
+        }
+        if (mapped < n) {
+            view_add(view, g_zero_chunk, n - mapped);
+        }
+
+        offset += n;
+        remaining -= n;
+    }
+
+    return (ssize_t)total;
+}
+
+void extent_view_release(struct extent_view *view) {
+    if (!view) return;
+
+    for (uint32_t i = 0; i < view->scratch_count; i++) {
+        free(view->scratch[i]);
+    }
+    view->scratch_count = 0;
+    view->count = 0;
+    view->bytes = 0;
+}
+
+ssize_t extent_store_write(struct extent_store *es, const void *buf,
+                           size_t size, uint64_t offset) {
+    if (!es || !buf) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (size == 0) return 0;
+
+    uint64_t end;
+    if (__builtin_add_overflow(offset, (uint64_t)size, &end) ||
+        end > EXTENT_MAX_FILE_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    if (ensure_map(es, EXTENT_CHUNK_INDEX(end - 1) + 1) != 0) {
+        return -1;
+    }
+
+    const char *in = buf;
+    size_t written = 0;
+
+    while (written < size) {
+        uint32_t idx = (uint32_t)EXTENT_CHUNK_INDEX(offset);
+        uint32_t coff = EXTENT_CHUNK_OFFSET(offset);
+        size_t n = EXTENT_CHUNK_SIZE - coff;
+        if (n > size - written) n = size - written;
+
+        if (ensure_chunk(es, idx, coff + (uint32_t)n) != 0) {
+            break;  /* Short write - keep what fit */
+        }
+
+        memcpy(es->chunks[idx].data + coff, in + written, n);
+        written += n;
+        offset += n;
+    }
+
+    if (written == 0) {
+        return -1;
+    }
+
+    if (offset > es->size) {
+        es->size = offset;
+    }
+    return (ssize_t)written;
+}
+
+int extent_store_truncate(struct extent_store *es, uint64_t size) {
+    if (!es) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (size > EXTENT_MAX_FILE_SIZE) {
+        errno = EFBIG;
+        return -1;
+    }
+
+    if (size < es->size) {
+        /* Drop whole chunks past the new end */
+        uint64_t first_free = (size + EXTENT_CHUNK_SIZE - 1) >> EXTENT_CHUNK_SHIFT;
+        for (uint64_t i = first_free; i < es->map_capacity; i++) {
+            free_chunk(es, (uint32_t)i);
+        }
+        if (first_free < es->shrunk_span) {
+            es->shrunk_span = (uint32_t)first_free;
+        }
+
+        /* Zero the tail of the new last chunk so a later extension reads zeros */
+        uint32_t coff = EXTENT_CHUNK_OFFSET(size);
+        uint64_t last = EXTENT_CHUNK_INDEX(size);
+        if (coff != 0 && last < es->map_capacity) {
+            struct extent_chunk *chunk = &es->chunks[last];
+            if (chunk->flags & EXTENT_CHUNK_ABSENT) {
+                errno = EIO;  /* Not faulted in */
+                return -1;
+            }
+            if (chunk->data && coff < chunk->capacity) {
+                if (inflate_chunk(es, (uint32_t)last) != 0) return -1;
+                memset(chunk->data + coff, 0, chunk->capacity - coff);
+                chunk->version++;
+                mark_dirty(es, (uint32_t)last);
+            }
+        }
+    }
+
+    if (size != es->size) {
+        es->size_dirty = 1;
+    }
+    es->size = size;
+    return 0;
+}
+
+int extent_store_punch(struct extent_store *es, uint64_t offset, uint64_t length) {
+    if (!es) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (length == 0 || offset >= es->size) return 0;
+
+    uint64_t end = offset + length;
+    if (end < offset || end > es->size) end = es->size;
+
+    uint64_t last = EXTENT_CHUNK_INDEX(end - 1);
+    for (uint64_t i = EXTENT_CHUNK_INDEX(offset); i <= last && i < es->map_capacity; i++) {
+        struct extent_chunk *chunk = &es->chunks[i];
+        if (!chunk->data && !(chunk->flags & EXTENT_CHUNK_ABSENT)) continue;  /* Hole */
+
+        uint64_t base = i << EXTENT_CHUNK_SHIFT;
+        uint32_t coff = offset > base ? (uint32_t)(offset - base) : 0;
+        uint32_t cend = end - base < EXTENT_CHUNK_SIZE ? (uint32_t)(end - base)
+                                                        : EXTENT_CHUNK_SIZE;
+
+        /* Past its last byte everything reads as zeros anyway */
+        if (coff == 0 && (cend >= chunk->capacity || end == es->size)) {
+            free_chunk(es, (uint32_t)i);
+            mark_dirty(es, (uint32_t)i);  /* A hole the log still has data for */
+            continue;
+        }
+
+        if (chunk->flags & EXTENT_CHUNK_ABSENT) {
+            errno = EIO;  /* Not faulted in */
+            return -1;
+        }
+        if (coff >= chunk->capacity) continue;
+        if (inflate_chunk(es, (uint32_t)i) != 0) return -1;
+        if (cend > chunk->capacity) cend = chunk->capacity;
+        memset(chunk->data + coff, 0, cend - coff);
+        chunk->version++;
+        mark_dirty(es, (uint32_t)i);
+    }
+    return 0;
+}
+
+off_t extent_store_seek(const struct extent_store *es, uint64_t offset, int whence) {
+    if (!es || (whence != SEEK_DATA && whence != SEEK_HOLE)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (offset >= es->size) {
+        errno = ENXIO;
+        return -1;
+    }
+
+    uint32_t span = extent_store_chunk_span(es);
+    for (uint64_t i = EXTENT_CHUNK_INDEX(offset); i < span; i++) {
+        int is_data = i < es->map_capacity &&
+                      (es->chunks[i].data || (es->chunks[i].flags & EXTENT_CHUNK_ABSENT));
+        if (is_data == (whence == SEEK_DATA)) {
+            uint64_t base = i << EXTENT_CHUNK_SHIFT;
+            return (off_t)(base > offset ? base : offset);
+        }
+    }
+
+    if (whence == SEEK_HOLE) return (off_t)es->size;
+    errno = ENXIO;
+    return -1;
+}
+
+uint32_t extent_store_compress_range(struct extent_store *es,
+                                     uint64_t offset, uint64_t length) {
+    if (!es || length == 0 || offset >= es->size) return 0;
+
+    uint64_t end = offset + length;
+    if (end < offset || end > es->size) end = es->size;
+
+    uint64_t first = EXTENT_CHUNK_INDEX(offset);
+    uint64_t last = EXTENT_CHUNK_INDEX(end - 1);
+    char *scratch = NULL;
+    uint32_t compressed = 0;
+
+    for (uint64_t i = first; i <= last && i < es->map_capacity; i++) {
+        struct extent_chunk *chunk = &es->chunks[i];
+
+        /* Only complete, raw chunks that lie entirely inside the file */
+        if (!chunk->data || chunk->stored || chunk->capacity != EXTENT_CHUNK_SIZE ||
+            ((i + 1) << EXTENT_CHUNK_SHIFT) > es->size) {
+            continue;
+        }
+
+        if (!scratch && !(scratch = malloc(EXTENT_CHUNK_SIZE))) {
+            break;
+        }
+
+        size_t stored = compress_block_for(COMPRESSION_BACKGROUND, chunk->data,
+                                           EXTENT_CHUNK_SIZE, scratch, EXTENT_CHUNK_SIZE);
+        if (stored == 0) continue;  /* Not compressible - keep raw */
+
+        /* Hand the scratch buffer over as the payload, trimmed to size */
+        char *payload = realloc(scratch, stored);
+        if (!payload) payload = scratch;
+        scratch = NULL;
+
+        es->data_bytes -= chunk->capacity - stored;
+        free(chunk->data);
+        chunk->data = payload;
+        chunk->stored = (uint32_t)stored;
+        es->compressed_count++;
+        mark_dirty(es, (uint32_t)i);
+        compressed++;
+    }
+
+    free(scratch);
+    return compressed;
+}
+
+char *extent_store_compress_chunk(const struct extent_store *es, uint32_t idx,
+                                  uint32_t *stored_out, uint32_t *version_out) {
+    if (!es || idx >= es->map_capacity) return NULL;
+
+    const struct extent_chunk *chunk = &es->chunks[idx];
+    if (!chunk->data || chunk->stored) return NULL;
+
+    char *payload = malloc(chunk->capacity);
+    if (!payload) return NULL;
+
+    size_t stored = compress_block_for(COMPRESSION_BACKGROUND, chunk->data, chunk->capacity,
+                                       payload, chunk->capacity);
+    if (stored == 0) {
+        free(payload);
+        return NULL;
+    }
+
+    char *trimmed = realloc(payload, stored);
+    if (stored_out) *stored_out = (uint32_t)stored;
+    if (version_out) *version_out = chunk->version;
+    return trimmed ? trimmed : payload;
+}
+
+int extent_store_commit_chunk(struct extent_store *es, uint32_t idx, char *payload,
+                              uint32_t stored, uint32_t version) {
+    if (!es || !payload || idx >= es->map_capacity) {
+        free(payload);
+        return 0;
+    }
+
+    struct extent_chunk *chunk = &es->chunks[idx];
+    if (!chunk->data || chunk->stored || chunk->version != version ||
+        stored == 0 || stored >= chunk->capacity) {
+        free(payload);  /* Written, truncated or compressed meanwhile */
+        return 0;
+    }
+
+    es->data_bytes -= chunk->capacity - stored;
+    free(chunk->data);
+    chunk->data = payload;
+    chunk->stored = stored;
+    es->compressed_count++;
+    mark_dirty(es, idx);
+    return 1;
+}
+
+uint32_t extent_store_chunk_span(const struct extent_store *es) {
+    if (!es || es->size == 0) return 0;
+    return (uint32_t)EXTENT_CHUNK_INDEX(es->size - 1) + 1;
+}
+
+const char *extent_store_chunk(const struct extent_store *es, uint32_t idx,
+                               uint32_t *raw_len_out, uint32_t *stored_len_out) {
+    if (raw_len_out) *raw_len_out = 0;
+    if (stored_len_out) *stored_len_out = 0;
+    if (!es || idx >= es->map_capacity || !es->chunks[idx].data) return NULL;
+
+    const struct extent_chunk *chunk = &es->chunks[idx];
+    uint64_t start = (uint64_t)idx << EXTENT_CHUNK_SHIFT;
+    if (start >= es->size) return NULL;
+
+    uint32_t raw_len = chunk->capacity;
+    uint32_t stored_len = chunk->stored;
+    if (!chunk->stored) {
+        /* Raw: expose only the bytes inside the file */
+        uint64_t valid = es->size - start;
+        if (valid < raw_len) raw_len = (uint32_t)valid;
+        stored_len = raw_len;
+    }
+
+    if (raw_len_out) *raw_len_out = raw_len;
+    if (stored_len_out) *stored_len_out = stored_len;
+    return chunk->data;
+}
+
+int extent_store_install_chunk(struct extent_store *es, uint32_t idx, char *data,
+                               uint32_t raw_len, uint32_t stored_len) {
+    if (!es || !data || raw_len == 0 || raw_len > EXTENT_CHUNK_SIZE ||
+        stored_len == 0 || stored_len > raw_len) {
+        free(data);
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (ensure_map(es, (uint64_t)idx + 1) != 0) {
+        free(data);
+        return -1;
+    }
+
+    free_chunk(es, idx);
+
+    struct extent_chunk *chunk = &es->chunks[idx];
+    chunk->version++;
+    chunk->data = data;
+    chunk->capacity = raw_len;
+    numa_place(data, stored_len, NUMA_MEM_FILE_DATA, es->numa_node);
+    chunk->stored = stored_len < raw_len ? stored_len : 0;
+    es->data_bytes += stored_len;
+    es->chunk_count++;
+    if (chunk->stored) {
+        es->compressed_count++;
+    }
+    return 0;
+}
+
+int extent_store_mark_absent(struct extent_store *es, uint32_t idx, uint32_t raw_len) {
+    if (!es || raw_len == 0 || raw_len > EXTENT_CHUNK_SIZE) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ensure_map(es, (uint64_t)idx + 1) != 0) return -1;
+
+    struct extent_chunk *chunk = &es->chunks[idx];
+    if (chunk->data || (chunk->flags & EXTENT_CHUNK_ABSENT)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    chunk->flags |= EXTENT_CHUNK_ABSENT;
+    chunk->capacity = raw_len;
+    chunk->version++;
+    es->absent_count++;
+    return 0;
+}
+
+size_t extent_store_evict_clean(struct extent_store *es) {
+    if (!es) return 0;
+
+    size_t freed = 0;
+    uint32_t span = extent_store_chunk_span(es);
+    for (uint32_t i = 0; i < span && i < es->map_capacity; i++) {
+        struct extent_chunk *chunk = &es->chunks[i];
+        if (!chunk->data || (chunk->flags & EXTENT_CHUNK_DIRTY)) continue;
+
+        /* Remember the size it was written back with */
+        uint32_t raw_len = 0;
+        extent_store_chunk(es, i, &raw_len, NULL);
+        uint32_t bytes = chunk_bytes(chunk);
+
+        free_chunk(es, i);
+        chunk->flags |= EXTENT_CHUNK_ABSENT;
+        chunk->capacity = raw_len;
+        es->absent_count++;
+        freed += bytes;
+    }
+    return freed;
+}
+
+int extent_store_chunk_absent(const struct extent_store *es, uint32_t idx) {
+    if (!es || idx >= es->map_capacity) return 0;
+    return (es->chunks[idx].flags & EXTENT_CHUNK_ABSENT) != 0;
+}
+
+int extent_store_range_absent(const struct extent_store *es, uint64_t offset, uint64_t length) {
+    if (!es || es->absent_count == 0 || length == 0 || offset >= es->size) return 0;
+
+    uint64_t end = offset + length;
+    if (end < offset || end > es->size) end = es->size;
+
+    uint64_t last = EXTENT_CHUNK_INDEX(end - 1);
+    for (uint64_t i = EXTENT_CHUNK_INDEX(offset); i <= last && i < es->map_capacity; i++) {
+        if (es->chunks[i].flags & EXTENT_CHUNK_ABSENT) return 1;
+    }
+    return 0;
+}
+
+int extent_store_is_dirty(const struct extent_store *es) {
+    if (!es) return 0;
+    return es->dirty_count > 0 || es->size_dirty || es->shrunk_span != EXTENT_SPAN_NONE;
+}
+
+int extent_store_chunk_dirty(const struct extent_store *es, uint32_t idx) {
+    if (!es || idx >= es->map_capacity) return 0;
+    return (es->chunks[idx].flags & EXTENT_CHUNK_DIRTY) != 0;
+}
+
+void extent_store_mark_clean(struct extent_store *es) {
+    if (!es) return;
+
+    for (uint32_t i = 0; i < es->map_capacity && es->dirty_count > 0; i++) {
+        if (es->chunks[i].flags & EXTENT_CHUNK_DIRTY) {
+            es->chunks[i].flags &= ~EXTENT_CHUNK_DIRTY;
+            es->dirty_count--;
+        }
+    }
+    es->dirty_count = 0;
+    es->shrunk_span = EXTENT_SPAN_NONE;
+    es->size_dirty = 0;
+}
+
+size_t extent_store_memory_usage(const struct extent_store *es) {
+    if (!es) return 0;
+
+    return (size_t)es->map_capacity * sizeof(struct extent_chunk) + es->data_bytes;
+}
@@ -0,0 +1,323 @@
+/**
+ * Chunked Extent Store - RAZORFS File Data
+ *
+ * File contents are kept as fixed-size chunks indexed by an extent map:
+ * - Chunk N covers bytes [N * EXTENT_CHUNK_SIZE, (N + 1) * EXTENT_CHUNK_SIZE)
+ * - Writes only touch the chunks they cover (no whole-file realloc/copy)
+ * - Unallocated chunks are holes and read back as zeros; truncating up or
+ *   writing far past the end allocates nothing in between, and ranges can
+ *   be punched back into holes
+ * - Chunk buffers grow up to EXTENT_CHUNK_SIZE, so small files stay small
+ * - Each chunk may be compressed on its own (one block of the blocked
+ *   format in compression.h), so reads inflate only the chunks they cover
+ * - Modified chunks are flagged dirty until written back, so persistence
+ *   only touches what changed since the last flush
+ * - A store attached from disk starts with its chunks absent: their size is
+ *   known but their bytes stay on disk until the caller faults them in
+ *
+ * The store itself is not locked; callers serialize access (per-file lock).
+ */
+
+#ifndef RAZORFS_EXTENT_STORE_H
+#define RAZORFS_EXTENT_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Chunk geometry */
+#define EXTENT_CHUNK_SHIFT    16
+#define EXTENT_CHUNK_SIZE     (1U << EXTENT_CHUNK_SHIFT)  /* 64KB */
+#define EXTENT_CHUNK_MIN_ALLOC 4096                        /* First allocation of a chunk */
+
+/* Chunk flags */
+#define EXTENT_CHUNK_DIRTY    0x1    /* Changed since the last write-back */
+#define EXTENT_CHUNK_ABSENT   0x2    /* Persisted but not loaded (data is NULL) */
+
+/* Zero-copy views */
+#define EXTENT_VIEW_MAX_CHUNKS 32                            /* 2MB per view */
+#define EXTENT_VIEW_MAX_SEGS   (EXTENT_VIEW_MAX_CHUNKS * 2)  /* Data + zero tail per chunk */
+
+/* No truncate below the persisted span since the last write-back */
+#define EXTENT_SPAN_NONE      UINT32_MAX
+
+/**
+ * One chunk of file data
+ * Bytes in [capacity, EXTENT_CHUNK_SIZE) are implicitly zero.
+ */
+struct extent_chunk {
+    char *data;                  /* Raw buffer or compressed payload (NULL = hole
+                                    or absent) */
+    uint32_t capacity;           /* Raw bytes held (or on disk if absent),
+                                    <= EXTENT_CHUNK_SIZE */
+    uint32_t stored;             /* Compressed payload bytes, 0 if raw */
+    uint32_t version;            /* Bumped on every change to this chunk */
+    uint32_t flags;              /* EXTENT_CHUNK_* */
+};
+
+/**
+ * Extent map for one file
+ */
+struct extent_store {
+    struct extent_chunk *chunks; /* Extent map indexed by chunk number */
+    uint32_t map_capacity;       /* Slots in the extent map */
+    uint32_t chunk_count;        /* Allocated (non-hole) chunks */
+    uint32_t compressed_count;   /* Chunks currently held compressed */
+    uint32_t dirty_count;        /* Chunks flagged EXTENT_CHUNK_DIRTY */
+    uint32_t absent_count;       /* Chunks flagged EXTENT_CHUNK_ABSENT */
+    uint32_t shrunk_span;        /* Smallest span truncated to since the last
+                                    write-back (EXTENT_SPAN_NONE = none) */
+    int size_dirty;              /* Size changed by truncate since write-back */
+    int numa_node;               /* Node for chunk buffers under the SUBTREE
+                                    NUMA policy (-1 = the writer's node) */
+    uint64_t data_bytes;         /* Heap held by chunk payloads */
+    uint64_t size;               /* Logical file size */
+};
+
+/**
+ * Read-only view of a file range, for replies sent without copying
+ * Segments point into raw chunk buffers, into a shared zero page for holes
+ * and into inflated copies of compressed chunks owned by the view. Valid
+ * only while the store is unchanged (callers hold the per-file lock).
+ */
+struct extent_view {
+    struct iovec iov[EXTENT_VIEW_MAX_SEGS];
+    uint32_t count;                          /* Segments used */
+    size_t bytes;                            /* Total bytes in the segments */
+    char *scratch[EXTENT_VIEW_MAX_CHUNKS];   /* Inflated chunks to free */
+    uint32_t scratch_count;
+};
+
+/* Chunk number / in-chunk offset for a byte offset */
+#define EXTENT_CHUNK_INDEX(off)  ((uint64_t)(off) >> EXTENT_CHUNK_SHIFT)
+#define EXTENT_CHUNK_OFFSET(off) ((uint32_t)((off) & (EXTENT_CHUNK_SIZE - 1)))
+
+/**
+ * Initialize an empty extent store
+ * @return 0 on success, -1 on failure
+ */
+int extent_store_init(struct extent_store *es);
+
+/**
+ * Free all chunks and the extent map
+ */
+void extent_store_destroy(struct extent_store *es);
+
+/**
+ * Read from the store
+ * Holes and bytes past the end of written data read as zeros. Compressed
+ * chunks are inflated into a scratch buffer; the store is not modified.
+ * Absent chunks in the range must be faulted in first.
+ *
+ * @param es Extent store
+ * @param buf Destination buffer
+ * @param size Bytes requested
+ * @param offset File offset
+ * @return Bytes read (0 at or past EOF), -1 on corrupt or absent chunk
+ *         (errno = EIO)
+ */
+ssize_t extent_store_read(const struct extent_store *es, void *buf,
+                          size_t size, uint64_t offset);
+
+/**
+ * Describe a range of the store without copying it
+ * Same bytes as extent_store_read(), as segments in `view`. Only
+ * compressed chunks are materialized (inflated once, into the view).
+ * Release the view with extent_view_release() before the store changes.
+ *
+ * @param es Extent store
+ * @param view View to fill
+ * @param size Bytes requested
+ * @param offset File offset
+ * @return Bytes viewed (0 at or past EOF), -1 on failure (errno = E2BIG if
+ *         the range spans more than EXTENT_VIEW_MAX_CHUNKS chunks, ENOMEM,
+ *         or EIO on a corrupt chunk); nothing is held on failure
+ */
+ssize_t extent_store_view(const struct extent_store *es, struct extent_view *view,
+                          size_t size, uint64_t offset);
+
+/**
+ * Free what a view owns (the store itself is untouched)
+ */
+void extent_view_release(struct extent_view *view);
+
+/**
+ * Write into the store, extending the file size if needed
+ * Only the chunks covering [offset, offset + size) are allocated or touched;
+ * compressed chunks among them are inflated first. Absent chunks in the
+ * range must be faulted in first (EIO otherwise).
+ *
+ * @param es Extent store
+ * @param buf Source buffer
+ * @param size Bytes to write
+ * @param offset File offset
+ * @return Bytes written (short on allocation failure), -1 if nothing was
+ *         written (errno set to ENOMEM, EFBIG or EIO)
+ */
+ssize_t extent_store_write(struct extent_store *es, const void *buf,
+                           size_t size, uint64_t offset);
+
+/**
+ * Set the file size
+ * Shrinking frees whole chunks past the new end and zeroes the tail of the
+ * last chunk (which must not be absent); growing only updates the size
+ * (the new range is a hole).
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+int extent_store_truncate(struct extent_store *es, uint64_t size);
+
+/**
+ * Deallocate a range (FALLOC_FL_PUNCH_HOLE); the file size is unchanged
+ * Chunks the range covers entirely become holes, flagged dirty so the
+ * write-back records them as such; the covered bytes of the chunks at
+ * either edge are zeroed (those must not be absent).
+ *
+ * @return 0 on success, -1 on failure (errno set)
+ */
+int extent_store_punch(struct extent_store *es, uint64_t offset, uint64_t length);
+
+/**
+ * Find the next data or hole at or after `offset` (SEEK_DATA / SEEK_HOLE)
+ * Chunk-granular: a chunk holding any bytes (or absent) counts as data
+ * throughout; the end of the file counts as a hole.
+ *
+ * @param whence SEEK_DATA or SEEK_HOLE
+ * @return Resulting offset, -1 on failure (errno = ENXIO at or past EOF or
+ *         with no data after `offset`, EINVAL for another whence)
+ */
+off_t extent_store_seek(const struct extent_store *es, uint64_t offset, int whence);
+
+/**
+ * Compress the full chunks overlapping [offset, offset + length)
+ * Partial (tail) chunks are left raw since they are likely still growing.
+ * Chunks that do not shrink stay raw. Uses the background codec.
+ *
+ * @return Number of chunks newly compressed
+ */
+uint32_t extent_store_compress_range(struct extent_store *es,
+                                     uint64_t offset, uint64_t length);
+
+/**
+ * Compress one raw chunk without modifying the store
+ * Lets a background worker compress under a read lock and swap the result
+ * in later with extent_store_commit_chunk(). Partial chunks are accepted;
+ * the background codec is used.
+ *
+ * @param es Extent store (read access is enough)
+ * @param idx Chunk number
+ * @param stored_out Receives the payload size
+ * @param version_out Receives the chunk version the payload was built from
+ * @return Compressed payload (caller owns it), or NULL if the chunk is a hole,
+ *         already compressed, or does not shrink
+ */
+char *extent_store_compress_chunk(const struct extent_store *es, uint32_t idx,
+                                  uint32_t *stored_out, uint32_t *version_out);
+
+/**
+ * Swap in a payload built by extent_store_compress_chunk()
+ * The swap only happens if the chunk is still raw and unchanged since the
+ * payload was built; otherwise the payload is discarded. A swapped chunk
+ * is flagged dirty so its compressed form gets written back.
+ *
+ * @param es Extent store (write access required)
+ * @return 1 if swapped, 0 if stale (payload freed)
+ */
+int extent_store_commit_chunk(struct extent_store *es, uint32_t idx, char *payload,
+                              uint32_t stored, uint32_t version);
+
+/**
+ * Number of extent map slots covering the current file size
+ */
+uint32_t extent_store_chunk_span(const struct extent_store *es);
+
+/**
+ * Get a chunk in its stored form for persistence/inspection
+ *
+ * @param es Extent store
+ * @param idx Chunk number
+ * @param raw_len_out Receives the uncompressed bytes in the chunk (may be NULL)
+ * @param stored_len_out Receives the payload size; equals *raw_len_out when
+ *                       the chunk is raw (may be NULL)
+ * @return Chunk payload, or NULL if the chunk is a hole
+ */
+const char *extent_store_chunk(const struct extent_store *es, uint32_t idx,
+                               uint32_t *raw_len_out, uint32_t *stored_len_out);
+
+/**
+ * Install a chunk payload (used when restoring from disk)
+ * Takes ownership of `data` (malloc'd). stored_len == raw_len means raw.
+ * The chunk is installed clean (it matches the on-disk copy).
+ * Does not change the file size; callers set it with extent_store_truncate().
+ *
+ * @return 0 on success, -1 on failure (data is freed)
+ */
+int extent_store_install_chunk(struct extent_store *es, uint32_t idx, char *data,
+                               uint32_t raw_len, uint32_t stored_len);
+
+/**
+ * Record a persisted chunk without loading it
+ * The slot must be a hole. The chunk is clean and reads as an error until
+ * extent_store_install_chunk() brings its bytes in. Does not change the
+ * file size.
+ *
+ * @param raw_len Uncompressed bytes in the chunk
+ * @return 0 on success, -1 on failure
+ */
+int extent_store_mark_absent(struct extent_store *es, uint32_t idx, uint32_t raw_len);
+
+/**
+ * Drop the payloads of all clean chunks, leaving them absent
+ * Only valid when everything clean is also on disk (the store was written
+ * back and marked clean); dirty chunks stay.
+ *
+ * @return Heap bytes freed
+ */
+size_t extent_store_evict_clean(struct extent_store *es);
+
+/**
+ * Check whether a chunk is absent
+ * @return 1 if absent, 0 otherwise
+ */
+int extent_store_chunk_absent(const struct extent_store *es, uint32_t idx);
+
+/**
+ * Check whether any chunk overlapping [offset, offset + length) (clamped
+ * to the file size) is absent
+ * @return 1 if one is, 0 otherwise
+ */
+int extent_store_range_absent(const struct extent_store *es, uint64_t offset, uint64_t length);
+
+/**
+ * Check whether anything changed since the last extent_store_mark_clean()
+ * @return 1 if there are dirty chunks or a pending size change, 0 otherwise
+ */
+int extent_store_is_dirty(const struct extent_store *es);
+
+/**
+ * Check whether one chunk changed since the last write-back
+ * @return 1 if dirty, 0 otherwise
+ */
+int extent_store_chunk_dirty(const struct extent_store *es, uint32_t idx);
+
+/**
+ * Clear all dirty state after a successful write-back
+ */
+void extent_store_mark_clean(struct extent_store *es);
+
+/**
+ * Bytes of heap held by the store (chunk payloads + extent map; absent
+ * chunks hold none)
+ */
+size_t extent_store_memory_usage(const struct extent_store *es);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_EXTENT_STORE_H */
@@ -0,0 +1,2691 @@
+/**
+ * Filesystem Core Implementation - RAZORFS Front-End Shared State
+ */
+
+#define _GNU_SOURCE
+#include "fs_core.h"
+#include "shm_persist.h"
+#include "recovery.h"
+#include "crc32c.h"
+#include "compression.h"
+#include "numa_support.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* === File Contents === */
+
+static inline struct fs_file_shard *file_shard(struct fs_core *fs, uint32_t inode) {
+    return &fs->file_shards[inode % FS_CORE_FILE_SHARDS];
+}
+
+static inline uint32_t file_bucket(uint32_t inode) {
+    return (inode / FS_CORE_FILE_SHARDS) % FS_CORE_FILE_BUCKETS;
+}
+
+struct fs_file_data *fs_core_find_file(struct fs_core *fs, uint32_t inode) {
+    struct fs_file_shard *shard = file_shard(fs, inode);
+
+    pthread_rwlock_rdlock(&shard->lock);
+
+    struct fs_file_data *current = shard->buckets[file_bucket(inode)];
+    while (current && current->inode != inode) {
+        current = current->next;
+    }
+
+    pthread_rwlock_unlock(&shard->lock);
+    return current;
+}
+
+/* Node for a file's data under the SUBTREE policy: top-level directories
+ * are spread over the nodes by inode and everything below follows its
+ * top-level ancestor (-1 = the writer's node under other policies) */
+static int subtree_numa_node(struct fs_core *fs, uint32_t idx) {
+    if (numa_get_policy() != NUMA_POLICY_SUBTREE || numa_node_count() <= 1) {
+        return -1;
+    }
+
+    metrics_rwlock_rdlock(&fs->tree.tree_lock, METRICS_LOCK_TREE);
+    uint32_t top = idx;
+    for (uint32_t hops = 0; top < fs->tree.used && hops < fs->tree.used; hops++) {
+        uint32_t parent = fs->tree.nodes[top].node.parent_idx;
+        if (parent == NARY_ROOT_IDX || parent == NARY_INVALID_IDX) {
+            break;
+        }
+        top = parent;
+    }
+    uint32_t inode = top < fs->tree.used ? fs->tree.nodes[top].node.inode : 0;
+    metrics_rwlock_unlock(&fs->tree.tree_lock, METRICS_LOCK_TREE);
+
+    return (int)(inode % (uint32_t)numa_node_count());
+}
+
+static struct fs_file_data *create_file_data(struct fs_core *fs, uint32_t inode) {
+    struct fs_file_shard *shard = file_shard(fs, inode);
+
+    pthread_rwlock_wrlock(&shard->lock);
+
+    /* Racing first writes of one file share an entry */
+    uint32_t bucket = file_bucket(inode);
+    struct fs_file_data *fd = shard->buckets[bucket];
+    while (fd && fd->inode != inode) {
+        fd = fd->next;
+    }
+    if (fd) {
+        pthread_rwlock_unlock(&shard->lock);
+        return fd;
+    }
+
+    /* Reuse a removed entry (locks already initialized) or make one */
+    fd = shard->free_list;
+    if (fd) {
+        shard->free_list = fd->next;
+    } else {
+        fd = calloc(1, sizeof(*fd));
+        if (!fd) {
+            pthread_rwlock_unlock(&shard->lock);
+            return NULL;
+        }
+        pthread_rwlock_init(&fd->data_lock, NULL);
+        pthread_mutex_init(&fd->flush_lock, NULL);
+    }
+
+    /* Anyone still holding this entry from its last life rechecks these */
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    fd->inode = inode;
+    fd->is_active = 1;
+    fd->last_access = (uint32_t)time(NULL);
+    extent_store_init(&fd->extents);
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    fd->next = shard->buckets[bucket];
+    shard->buckets[bucket] = fd;
+    shard->active++;
+
+    pthread_rwlock_unlock(&shard->lock);
+    return fd;
+}
+
+/* Fold a change in a store's heap use into the total (under data_lock) */
+static void account_file_bytes(struct fs_core *fs, const struct fs_file_data *fd,
+                               uint64_t before) {
+    uint64_t after = fd->extents.data_bytes;
+    if (after != before) {
+        __atomic_add_fetch(&fs->file_bytes, after - before, __ATOMIC_RELAXED);
+    }
+}
+
+/* Note an access for the reclaim sweep and the tier scanner */
+static inline void touch_file_data(struct fs_file_data *fd) {
+    if (!__atomic_load_n(&fd->referenced, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&fd->referenced, 1, __ATOMIC_RELAXED);
+    }
+    uint32_t now = (uint32_t)time(NULL);
+    if (__atomic_load_n(&fd->last_access, __ATOMIC_RELAXED) != now) {
+        __atomic_store_n(&fd->last_access, now, __ATOMIC_RELAXED);
+    }
+}
+
+static inline int over_budget(struct fs_core *fs) {
+    return fs->memory_limit &&
+           __atomic_load_n(&fs->file_bytes, __ATOMIC_RELAXED) > fs->file_budget;
+}
+
+/* Hand all of a file's data to the newest snapshot before it goes */
+static void retire_file_data(struct fs_core *fs, uint32_t inode) {
+    struct fs_file_data *fd = fs_core_find_file(fs, inode);
+    if (fd) {
+        metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+        if (fd->is_active && fd->inode == inode) {
+            /* Chunks that cannot be loaded are counted lost by the snapshot */
+            uint64_t before = fd->extents.data_bytes;
+            disk_file_extents_fault(inode, &fd->extents, 0, fd->extents.size);
+            account_file_bytes(fs, fd, before);
+            snapshot_retire(&fs->snapshots, inode, &fd->extents);
+            metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+            return;
+        }
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+    }
+
+    /* Never opened: its data is only on disk */
+    struct extent_store attached;
+    extent_store_init(&attached);
+    if (disk_file_extents_attach(inode, &attached) == 0) {
+        disk_file_extents_fault(inode, &attached, 0, attached.size);
+    }
+    snapshot_retire(&fs->snapshots, inode, &attached);
+    extent_store_destroy(&attached);
+}
+
+static void remove_file_data(struct fs_core *fs, uint32_t inode) {
+    if (snapshot_set_active(&fs->snapshots)) {
+        retire_file_data(fs, inode);
+    }
+
+    struct fs_file_shard *shard = file_shard(fs, inode);
+
+    pthread_rwlock_wrlock(&shard->lock);
+
+    struct fs_file_data **link = &shard->buckets[file_bucket(inode)];
+    while (*link && (*link)->inode != inode) {
+        link = &(*link)->next;
+    }
+
+    struct fs_file_data *current = *link;
+    if (current) {
+        *link = current->next;
+
+        metrics_rwlock_wrlock(&current->data_lock, METRICS_LOCK_FILE);
+        __atomic_sub_fetch(&fs->file_bytes, current->extents.data_bytes, __ATOMIC_RELAXED);
+        extent_store_destroy(&current->extents);
+        current->is_active = 0;
+        metrics_rwlock_unlock(&current->data_lock, METRICS_LOCK_FILE);
+
+        current->next = shard->free_list;
+        shard->free_list = current;
+        shard->active--;
+    }
+
+    pthread_rwlock_unlock(&shard->lock);
+
+    compress_pool_cancel(&fs->compressor, inode);
+    writeback_cancel(&fs->writeback, inode);
+    disk_file_data_remove(inode);
+}
+
+/* Persist the xattr entries just changed (xattrs.lock held for write):
+ * their records are appended, so the cost follows the change, not the
+ * arena */
+static void save_xattrs_locked(struct fs_core *fs) {
+    /* In-memory trees have nothing to persist */
+    if (!fs->tree.is_mapped) return;
+
+    if (disk_xattrs_flush(&fs->xattrs) != 0) {
+        fprintf(stderr, "Warning: Failed to save extended attributes\n");
+    }
+}
+
+/* Free the xattrs of a removed node */
+static void drop_xattrs(struct fs_core *fs, uint32_t head) {
+    if (head == 0) return;
+
+    pthread_rwlock_wrlock(&fs->xattrs.lock);
+    xattr_drop(&fs->xattrs, head);
+    save_xattrs_locked(fs);
+    pthread_rwlock_unlock(&fs->xattrs.lock);
+}
+
+/*
+ * The read lock is held across the I/O so writers cannot change chunks
+ * while they are written; flush_lock keeps concurrent flushers (fsync and
+ * the flusher thread) apart, so clearing the dirty state under the read
+ * lock is safe.
+ */
+int fs_core_flush_file(struct fs_core *fs, uint32_t inode) {
+    struct fs_file_data *fd = fs_core_find_file(fs, inode);
+    if (!fd) return 0;  /* Deleted meanwhile */
+
+    int ret = 0;
+    pthread_mutex_lock(&fd->flush_lock);
+    metrics_rwlock_rdlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (fd->is_active && fd->inode == inode && extent_store_is_dirty(&fd->extents)) {
+        ret = disk_file_extents_flush(inode, &fd->extents);
+        if (ret == 0) {
+            extent_store_mark_clean(&fd->extents);
+        }
+    }
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+    pthread_mutex_unlock(&fd->flush_lock);
+
+    return ret;
+}
+
+/* File data budget: what the tree leaves of the memory limit */
+static uint64_t file_budget(struct fs_core *fs) {
+    uint64_t tree = nary_get_memory_usage_mt(&fs->tree);
+    return tree < fs->memory_limit ? fs->memory_limit - tree : 0;
+}
+
+void fs_core_reclaim(struct fs_core *fs) {
+    if (!fs->memory_limit) return;
+    if (pthread_mutex_trylock(&fs->reclaim_lock) != 0) return;  /* Someone is on it */
+
+    fs->file_budget = file_budget(fs);
+    uint64_t target = fs->file_budget - fs->file_budget / 8;  /* Some headroom */
+
+    /* Two laps at most: the first may only clear reference bits */
+    const uint32_t slots = FS_CORE_FILE_SHARDS * FS_CORE_FILE_BUCKETS;
+    for (uint32_t n = 0; n < 2 * slots &&
+         __atomic_load_n(&fs->file_bytes, __ATOMIC_RELAXED) > target; n++) {
+        uint32_t slot = fs->reclaim_hand;
+        fs->reclaim_hand = (slot + 1) % slots;
+
+        struct fs_file_shard *shard = &fs->file_shards[slot / FS_CORE_FILE_BUCKETS];
+        pthread_rwlock_rdlock(&shard->lock);
+        for (struct fs_file_data *fd = shard->buckets[slot % FS_CORE_FILE_BUCKETS];
+             fd; fd = fd->next) {
+            if (__atomic_exchange_n(&fd->referenced, 0, __ATOMIC_RELAXED)) {
+                continue;  /* Recently used: next lap */
+            }
+            if (metrics_rwlock_trywrlock(&fd->data_lock, METRICS_LOCK_FILE) != 0) {
+                continue;  /* Busy, so not cold */
+            }
+            if (fd->is_active) {
+                uint64_t before = fd->extents.data_bytes;
+                size_t freed = disk_file_extents_evict(fd->inode, &fd->extents);
+                account_file_bytes(fs, fd, before);
+                __atomic_add_fetch(&fs->evicted_bytes, freed, __ATOMIC_RELAXED);
+            }
+            metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        }
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    pthread_mutex_unlock(&fs->reclaim_lock);
+}
+
+/* Write-back callback; failures are reported by the next flush/fsync */
+static int writeback_file_data(void *ctx, uint32_t inode) {
+    struct fs_core *fs = ctx;
+    int ret = fs_core_flush_file(fs, inode);
+    if (ret != 0) {
+        struct fs_file_data *fd = fs_core_find_file(fs, inode);
+        if (fd) __atomic_store_n(&fd->wb_error, 1, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+/**
+ * Checkpoint a WAL holding write payloads (the WAL checkpoint thread's
+ * hook, see wal_set_checkpoint_fn)
+ * The checkpoint reclaims every record before it, so the data they carry
+ * must be in the data log first. With the gate held exclusively no change
+ * is between its log append and being marked dirty; once the flusher has
+ * written back everything queued (and nothing failed), the data of every
+ * logged payload is on disk.
+ */
+static int checkpoint_wal_data(void *arg) {
+    struct fs_core *fs = arg;
+    int ret = -1;
+
+    pthread_rwlock_wrlock(&fs->wal_gate);
+    writeback_sync(&fs->writeback);
+
+    struct writeback_stats wb;
+    writeback_get_stats(&fs->writeback, &wb);
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (wb.dirty == 0 && (!log || data_log_sync(log) == 0)) {
+        ret = wal_checkpoint(&fs->wal);
+    }
+    pthread_rwlock_unlock(&fs->wal_gate);
+    return ret;
+}
+
+/* Log a change with its bytes and mark the file dirty, under the gate
+ * (see checkpoint_wal_data); *full is set if the log had no room */
+static int log_data_change(struct fs_core *fs, const struct wal_write_data *change,
+                           uint8_t kind, const void *buf, int *logged, int *full) {
+    pthread_rwlock_rdlock(&fs->wal_gate);
+    *logged = wal_log_write_payload(&fs->wal, 0, change, kind, buf) == 0;
+    *full = !*logged && errno == ENOSPC;
+    int ret = writeback_mark_dirty(&fs->writeback, change->inode);
+    pthread_rwlock_unlock(&fs->wal_gate);
+    return ret;
+}
+
+/**
+ * Mark a file's data dirty after a change, logging the change with its
+ * bytes first if payloads are on (see fs_core_options.wal_data)
+ * Writers are throttled as the log fills; one finding it full waits for
+ * the checkpoint thread and tries once more, both without the gate (the
+ * checkpoint takes it). Still no room: a sync mount writes the change
+ * through instead.
+ *
+ * @return 0 on success, -1 if a write-through flush failed
+ */
+static int mark_data_dirty(struct fs_core *fs, const struct wal_write_data *change,
+                           uint8_t kind, const void *buf) {
+    if (!fs->wal_data) {
+        return writeback_mark_dirty(&fs->writeback, change->inode);
+    }
+
+    wal_throttle(&fs->wal);
+    int logged, full;
+    int ret = log_data_change(fs, change, kind, buf, &logged, &full);
+    if (ret == 0 && full && wal_wait_checkpoint(&fs->wal) == 0) {
+        ret = log_data_change(fs, change, kind, buf, &logged, &full);
+    }
+
+    if (ret == 0 && !logged && fs->durability == FS_DURABILITY_SYNC) {
+        ret = fs_core_flush_file(fs, change->inode);
+    }
+    return ret;
+}
+
+/**
+ * Recovery: apply one logged file data change to the stored file
+ * Runs before any file is open, on a private copy: attach the file, load
+ * what the change partly overwrites, apply it and save the range.
+ */
+static int recover_file_data(void *arg, const struct wal_write_payload *record,
+                             const void *bytes) {
+    (void)arg;
+    const struct wal_write_data *change = &record->write;
+    uint32_t inode = change->inode;
+
+    struct extent_store es;
+    extent_store_init(&es);
+    if (disk_file_extents_attach(inode, &es) != 0) {
+        /* Never written back: starts out empty */
+        extent_store_destroy(&es);
+        extent_store_init(&es);
+    }
+
+    uint64_t offset = change->offset;
+    uint64_t length = change->length;
+    uint64_t end = offset + length;
+    int ret = 0;
+    switch (record->kind) {
+    case WAL_DATA_WRITE:
+        ret = disk_file_extents_fault(inode, &es, offset, length);
+        if (ret == 0 && extent_store_write(&es, bytes, length, offset) < 0) {
+            ret = -1;
+        }
+        break;
+    case WAL_DATA_TRUNCATE:
+        /* The new last chunk keeps its head */
+        offset = change->new_size;
+        length = 0;
+        if (offset < es.size && EXTENT_CHUNK_OFFSET(offset) != 0) {
+            ret = disk_file_extents_fault(inode, &es, offset, 1);
+        }
+        if (ret == 0) {
+            ret = extent_store_truncate(&es, offset);
+        }
+        break;
+    case WAL_DATA_PUNCH:
+        /* Partly punched chunks at either edge keep bytes */
+        if (EXTENT_CHUNK_OFFSET(offset) != 0) {
+            ret = disk_file_extents_fault(inode, &es, offset, 1);
+        }
+        if (ret == 0 && EXTENT_CHUNK_OFFSET(end) != 0) {
+            ret = disk_file_extents_fault(inode, &es, end - 1, 1);
+        }
+        if (ret == 0) {
+            ret = extent_store_punch(&es, offset, length);
+        }
+        break;
+    default:
+        ret = -1;
+        break;
+    }
+
+    if (ret == 0) {
+        ret = disk_file_extents_save(inode, &es, offset, length);
+    }
+    extent_store_destroy(&es);
+    return ret;
+}
+
+/* Swap a compressed chunk in if this slot still belongs to `inode` */
+static int commit_compressed_chunk(struct fs_core *fs, struct fs_file_data *fd,
+                                   uint32_t inode, uint32_t idx,
+                                   char *payload, uint32_t stored, uint32_t version) {
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    int swapped = 0;
+    if (fd->is_active && fd->inode == inode) {
+        uint64_t before = fd->extents.data_bytes;
+        swapped = extent_store_commit_chunk(&fd->extents, idx, payload, stored, version);
+        account_file_bytes(fs, fd, before);
+    } else {
+        free(payload);
+    }
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+    return swapped;
+}
+
+/**
+ * Background compression callback
+ * Each chunk is compressed under the read lock (readers keep going) and
+ * swapped in under a short write lock; chunks written meanwhile are skipped.
+ * The file is then written back in one pass, compressed chunks included.
+ */
+static int compress_file_data(void *ctx, uint32_t inode) {
+    struct fs_core *fs = ctx;
+
+    struct fs_file_data *fd = fs_core_find_file(fs, inode);
+    if (!fd) return 0;  /* Deleted meanwhile */
+
+    metrics_rwlock_rdlock(&fd->data_lock, METRICS_LOCK_FILE);
+    uint32_t span = fd->is_active && fd->inode == inode ?
+                    extent_store_chunk_span(&fd->extents) : 0;
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    for (uint32_t i = 0; i < span; i++) {
+        uint32_t stored = 0, version = 0;
+        char *payload = NULL;
+
+        metrics_rwlock_rdlock(&fd->data_lock, METRICS_LOCK_FILE);
+        if (fd->is_active && fd->inode == inode) {
+            payload = extent_store_compress_chunk(&fd->extents, i, &stored, &version);
+        }
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+        if (payload) {
+            commit_compressed_chunk(fs, fd, inode, i, payload, stored, version);
+        }
+    }
+
+    /* Leave it to the flusher if the write-back fails here */
+    if (fs_core_flush_file(fs, inode) != 0) {
+        writeback_mark_dirty(&fs->writeback, inode);
+    }
+
+    return 0;
+}
+
+void fs_core_sync_strings(struct fs_core *fs) {
+    /* In-memory trees have nothing to persist */
+    if (!fs->tree.is_mapped) return;
+
+    if (disk_string_table_sync(&fs->tree.strings) != 0) {
+        fprintf(stderr, "Warning: Failed to sync string table to disk\n");
+    }
+}
+
+/* === Lifecycle === */
+
+int fs_core_init(struct fs_core *fs) {
+    for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+        struct fs_file_shard *shard = &fs->file_shards[i];
+        memset(shard->buckets, 0, sizeof(shard->buckets));
+        shard->free_list = NULL;
+        shard->active = 0;
+        if (pthread_rwlock_init(&shard->lock, NULL) != 0) {
+            while (--i >= 0) {
+                pthread_rwlock_destroy(&fs->file_shards[i].lock);
+            }
+            return -1;
+        }
+    }
+
+    fs->memory_limit = 0;
+    fs->file_budget = 0;
+    fs->file_bytes = 0;
+    fs->evicted_bytes = 0;
+    fs->reclaim_hand = 0;
+    fs->tier_enabled = 0;
+    if (xattr_store_init(&fs->xattrs, &fs->tree.strings) != 0) {
+        for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+            pthread_rwlock_destroy(&fs->file_shards[i].lock);
+        }
+        return -1;
+    }
+    if (snapshot_set_init(&fs->snapshots) != 0) {
+        xattr_store_destroy(&fs->xattrs);
+        for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+            pthread_rwlock_destroy(&fs->file_shards[i].lock);
+        }
+        return -1;
+    }
+    pthread_mutex_init(&fs->reclaim_lock, NULL);
+    pthread_rwlock_init(&fs->wal_gate, NULL);
+    return 0;
+}
+
+int fs_core_set_placement(const struct fs_core_options *opts) {
+    enum numa_policy policy = NUMA_POLICY_DEFAULT;
+    if (opts->numa_policy && numa_policy_parse(opts->numa_policy, &policy) != 0) {
+        fprintf(stderr, "Unknown NUMA policy '%s' (default, interleave, local, subtree)\n",
+                opts->numa_policy);
+        return -1;
+    }
+    enum numa_huge_pages huge = NUMA_HUGE_OFF;
+    if (opts->hugepages && numa_huge_pages_parse(opts->hugepages, &huge) != 0) {
+        fprintf(stderr, "Unknown huge page mode '%s' (off, thp, hugetlb)\n", opts->hugepages);
+        return -1;
+    }
+
+    numa_init();
+    numa_set_policy(policy);
+    numa_set_huge_pages(huge);
+    printf("📍 NUMA placement: %s\n", numa_policy_name(policy));
+    if (huge != NUMA_HUGE_OFF) {
+        printf("📐 Huge pages: %s (node array, string table)\n", numa_huge_pages_name(huge));
+    }
+    return 0;
+}
+
+/* Load the saved xattrs and keep only the chains live nodes still reach
+ * (nodes removed by recovery, or chains cut short by a crash between
+ * saving the arena and the node image) */
+static void load_xattrs(struct fs_core *fs) {
+    if (disk_xattrs_load(&fs->xattrs) != 0) return;
+
+    uint8_t *claimed = calloc((fs->xattrs.used + 7) / 8, 1);
+    if (!claimed) return;  /* Unreachable entries stay until the next mount */
+
+    for (uint32_t i = 0; i < fs->tree.used; i++) {
+        struct nary_node *node = &fs->tree.nodes[i].node;
+        if (node->inode == 0 || node->xattr_head == 0) continue;
+        uint32_t head = xattr_claim(&fs->xattrs, node->xattr_head, claimed);
+        if (head != node->xattr_head) {
+            nary_set_xattr_head_mt(&fs->tree, i, head);
+        }
+    }
+    uint32_t freed = xattr_sweep(&fs->xattrs, claimed);
+    free(claimed);
+
+    if (freed > 0) {
+        printf("♻️  Dropped %u unreachable extended attributes\n", freed);
+        disk_xattrs_save(&fs->xattrs);
+    }
+}
+
+/* Open the log in the layout the options ask for: one file, or segments
+ * next to it or striped over wal_dirs */
+static int open_wal(struct fs_core *fs, const char *wal_path,
+                    const struct fs_core_options *opts) {
+    if (!opts || (!opts->wal_dirs && opts->wal_segments == 0)) {
+        return wal_init_file(&fs->wal, wal_path, WAL_DEFAULT_SIZE);
+    }
+
+    char *list = opts->wal_dirs ? strdup(opts->wal_dirs) : NULL;
+    const char *dirs[WAL_MAX_SEGMENTS];
+    size_t ndirs = 0;
+    for (char *save = NULL, *dir = list ? strtok_r(list, ":", &save) : NULL;
+         dir && ndirs < WAL_MAX_SEGMENTS; dir = strtok_r(NULL, ":", &save)) {
+        dirs[ndirs++] = dir;
+    }
+
+    uint32_t segments = opts->wal_segments ? opts->wal_segments : FS_CORE_WAL_SEGMENTS;
+    int ret = wal_init_segmented(&fs->wal, wal_path, ndirs ? dirs : NULL, ndirs,
+                                 (size_t)opts->wal_segment_mb << 20, segments);
+    free(list);
+    return ret;
+}
+
+int fs_core_open(struct fs_core *fs, const char *wal_path,
+                 const struct fs_core_options *opts) {
+    /* Recording starts before recovery, so replay shows in the histograms */
+    enum metrics_level level = METRICS_OPS;
+    if (opts && opts->metrics && metrics_level_parse(opts->metrics, &level) != 0) {
+        fprintf(stderr, "⚠️  Unknown metrics level '%s' (off, ops, full) - using ops\n",
+                opts->metrics);
+    }
+    if (metrics_init(level) != 0) {
+        fprintf(stderr, "⚠️  Metrics unavailable (out of memory)\n");
+    } else if (level != METRICS_OPS) {
+        printf("📈 Metrics: %s\n", metrics_level_name(level));
+    }
+
+    /* Initialize WAL for crash recovery */
+    printf("📝 Initializing Write-Ahead Log: %s\n", wal_path);
+
+    if (open_wal(fs, wal_path, opts) == 0) {
+        fs->wal_enabled = 1;
+        printf("✅ WAL enabled (crash recovery active)\n");
+        printf("   Checksums: %s (%s)\n",
+               fs->wal.version != WAL_VERSION_CRC32 ? "CRC32C" : "CRC32",
+               crc32c_impl());
+        if (fs->wal.segment_count > 0) {
+            printf("   Segments: %u x %zu MB on %u device(s)\n", fs->wal.segment_count,
+                   fs->wal.segment_size >> 20, fs->wal.device_count);
+        }
+
+        /* Concurrent metadata ops reserve log space without log_lock
+         * and share one log flush */
+        wal_set_lockfree_append(&fs->wal, 1);
+        wal_set_group_commit(&fs->wal, 1);
+
+        /* Check if recovery is needed */
+        if (wal_needs_recovery(&fs->wal)) {
+            printf("⚠️  Dirty WAL detected - recovery needed\n");
+            printf("   (Recovery will run after tree initialization)\n");
+        }
+    } else {
+        fs->wal_enabled = 0;
+        fprintf(stderr, "⚠️  WAL initialization failed - running without crash recovery\n");
+        fprintf(stderr, "   Data will NOT survive power loss/crashes\n");
+    }
+
+    /* Use DISK-BACKED storage for true persistence (survives reboot) */
+    if (disk_tree_init(&fs->tree) != 0) {
+        fprintf(stderr, "Failed to initialize persistent tree\n");
+        if (fs->wal_enabled) {
+            wal_destroy(&fs->wal);
+            fs->wal_enabled = 0;
+        }
+        return -1;
+    }
+    fs->tree.prefetch = !opts || opts->prefetch;
+
+    /* Run recovery if needed */
+    int recovery_failed = 0;
+    int log_empty = !fs->wal_enabled || !wal_needs_recovery(&fs->wal);
+    if (fs->wal_enabled && wal_needs_recovery(&fs->wal)) {
+        printf("🔧 Running crash recovery...\n");
+
+        struct recovery_ctx recovery;
+        if (recovery_init(&recovery, &fs->wal, &fs->tree, &fs->tree.strings) == 0) {
+            /* Independent partitions of the log replay in parallel */
+            long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+            recovery.redo_threads = cpus > 0 ? (uint32_t)cpus : 1;
+            /* Write payloads rebuild file data the data log never got */
+            if (fs->tree.is_mapped) {
+                recovery.apply_data = recover_file_data;
+            }
+            if (recovery_run(&recovery) == 0) {
+                printf("✅ Recovery completed successfully\n");
+            } else {
+                fprintf(stderr, "⚠️  Recovery failed - filesystem may be inconsistent\n");
+                recovery_failed = 1;
+            }
+            recovery_destroy(&recovery);
+        } else {
+            fprintf(stderr, "⚠️  Recovery initialization failed\n");
+            recovery_failed = 1;
+        }
+    }
+
+    /* Older logs hold 16-bit node indices: once replayed, start over in
+     * the current record format (never append to an old-format log) */
+    if (fs->wal_enabled && fs->wal.version != WAL_VERSION) {
+        if (recovery_failed || wal_reset(&fs->wal) != 0) {
+            fprintf(stderr, "⚠️  Keeping old-format WAL - running without crash recovery\n");
+            wal_destroy(&fs->wal);
+            fs->wal_enabled = 0;
+        } else {
+            printf("🔄 WAL upgraded to format version %u\n", WAL_VERSION);
+        }
+    }
+
+    /* Names of removed and renamed entries: once no log record can refer
+     * to them, their space goes to new names */
+    if (log_empty) {
+        uint32_t reclaimed = string_table_reclaim(&fs->tree.strings);
+        if (reclaimed > 0) {
+            printf("♻️  Reclaimed %u bytes of unused names\n", reclaimed);
+        }
+    }
+
+    if (fs_core_init(fs) != 0) {
+        if (fs->wal_enabled) {
+            wal_destroy(&fs->wal);
+            fs->wal_enabled = 0;
+        }
+        shm_tree_detach(&fs->tree);
+        return -1;
+    }
+
+    load_xattrs(fs);
+    return 0;
+}
+
+/* A file is cold if neither its node (written) nor its in-memory data
+ * (read or written this mount) changed since the cutoff */
+static int file_is_cold(void *ctx, uint32_t inode, time_t cutoff) {
+    struct fs_core *fs = ctx;
+
+    struct fs_file_data *fd = fs_core_find_file(fs, inode);
+    if (fd && (time_t)__atomic_load_n(&fd->last_access, __ATOMIC_RELAXED) >= cutoff) {
+        return 0;
+    }
+
+    struct nary_node node;
+    uint32_t idx = nary_inode_lookup_mt(&fs->tree, inode);
+    if (idx == NARY_INVALID_IDX || nary_read_node_mt(&fs->tree, idx, &node) != 0 ||
+        node.inode != inode) {
+        return 0;  /* Being deleted */
+    }
+    return (time_t)node.mtime < cutoff;
+}
+
+static int tier_remote_read(void *ctx, uint32_t inode, uint64_t offset, uint32_t size,
+                            void *buf) {
+    return tier_read(ctx, inode, offset, size, buf);
+}
+
+static void tier_remote_forget(void *ctx, uint32_t inode) {
+    tier_forget(ctx, inode);
+}
+
+static void start_dedup(struct fs_core *fs, const struct fs_core_options *opts) {
+    if (!opts->dedup) return;
+
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (!log || data_log_enable_dedup(log) != 0) {
+        fprintf(stderr, "⚠️  Deduplication unavailable - identical chunks stored apart\n");
+        return;
+    }
+
+    struct data_log_dedup_stats stats;
+    data_log_dedup_stats(log, &stats);
+    printf("   Deduplication: %lu distinct chunks, %lu KB shared\n",
+           (unsigned long)stats.blocks, (unsigned long)(stats.saved_bytes / 1024));
+}
+
+static void start_tier(struct fs_core *fs, const struct fs_core_options *opts) {
+    if (!opts->tier_backend && !opts->tier_dir) return;
+
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (!log) {
+        fprintf(stderr, "⚠️  Tiering needs the file data log - cold files stay local\n");
+        return;
+    }
+
+    struct tier_backend backend;
+    if (opts->tier_backend) {
+        backend = *opts->tier_backend;
+    } else if (tier_backend_dir(&backend, opts->tier_dir) != 0) {
+        fprintf(stderr, "⚠️  Tier directory %s unusable - cold files stay local\n",
+                opts->tier_dir);
+        return;
+    }
+
+    struct tier_config config = {
+        .cold_s = opts->tier_cold_s,
+        .scan_ms = TIER_DEFAULT_SCAN_MS,
+        .min_bytes = TIER_DEFAULT_MIN_BYTES,
+        .cache_dir = opts->tier_cache_dir ? opts->tier_cache_dir : TIER_DEFAULT_CACHE_DIR,
+        .cache_bytes = (uint64_t)opts->tier_cache_mb << 20,
+    };
+    if (tier_init(&fs->tier, &config, &backend, log, file_is_cold, fs) != 0) {
+        fprintf(stderr, "⚠️  Tiering unavailable - cold files stay local\n");
+        return;
+    }
+
+    struct disk_remote_ops ops = {
+        .read = tier_remote_read,
+        .forget = tier_remote_forget,
+        .ctx = &fs->tier,
+    };
+    disk_set_remote(&ops);
+    fs->tier_enabled = 1;
+    printf("   Tiering: files idle for %u s offloaded to %s (%u MB read cache)\n",
+           config.cold_s, opts->tier_dir ? opts->tier_dir : "object store",
+           opts->tier_cache_mb);
+}
+
+static void start_durability(struct fs_core *fs, const struct fs_core_options *opts) {
+    fs->durability = FS_DURABILITY_PERIODIC;
+    if (opts->durability) {
+        if (strcmp(opts->durability, "sync") == 0) {
+            fs->durability = FS_DURABILITY_SYNC;
+        } else if (strcmp(opts->durability, "fsync-only") == 0) {
+            fs->durability = FS_DURABILITY_FSYNC;
+        } else if (strcmp(opts->durability, "periodic") != 0) {
+            fprintf(stderr, "⚠️  Unknown durability '%s' (sync, periodic, fsync-only) - "
+                    "using periodic\n", opts->durability);
+        }
+    }
+
+    unsigned int interval_ms = opts->writeback_ms ? opts->writeback_ms
+                                                  : WRITEBACK_DEFAULT_INTERVAL_MS;
+    if (fs->wal_enabled && fs->durability != FS_DURABILITY_SYNC) {
+        wal_set_deferred(&fs->wal, 1);
+        if (fs->durability == FS_DURABILITY_PERIODIC &&
+            wal_start_sync_thread(&fs->wal, interval_ms) != 0) {
+            fprintf(stderr, "⚠️  WAL sync thread unavailable - syncing every operation\n");
+            wal_set_deferred(&fs->wal, 0);
+        }
+    }
+
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (log && fs->durability == FS_DURABILITY_FSYNC) {
+        data_log_set_deferred_sync(log, 1);
+    }
+
+    /* Logged writes carry their bytes: file data needs no write-through */
+    fs->wal_data = fs->wal_enabled && opts->wal_data;
+
+    switch (fs->durability) {
+    case FS_DURABILITY_SYNC:
+        printf("   Durability: sync (every operation on disk before it returns)\n");
+        break;
+    case FS_DURABILITY_PERIODIC:
+        printf("   Durability: periodic (on disk within %u ms, or at fsync)\n", interval_ms);
+        break;
+    case FS_DURABILITY_FSYNC:
+        printf("   Durability: fsync-only (on disk at fsync or unmount)\n");
+        break;
+    }
+    if (fs->wal_data) {
+        printf("   WAL data: write payloads logged (file data rebuilt from the log)\n");
+    }
+
+    enum io_engine_kind engine = IO_ENGINE_PSYNC;
+    if (opts->io_engine && io_engine_parse(opts->io_engine, &engine) != 0) {
+        fprintf(stderr, "⚠️  Unknown I/O engine '%s' (psync, uring) - using psync\n",
+                opts->io_engine);
+    }
+    if (engine != IO_ENGINE_PSYNC) {
+        int wal_io = fs->wal_enabled && wal_set_io_engine(&fs->wal, engine) == 0;
+        int log_io = log && data_log_set_io_engine(log, engine) == 0;
+        if (wal_io || log_io) {
+            printf("   I/O engine: %s (%s%s%s)\n", io_engine_name(engine),
+                   wal_io ? "WAL commits" : "", wal_io && log_io ? ", " : "",
+                   log_io ? "data log appends" : "");
+        } else {
+            fprintf(stderr, "⚠️  I/O engine '%s' unavailable - using psync\n",
+                    io_engine_name(engine));
+        }
+    }
+}
+
+void fs_core_start(struct fs_core *fs, const struct fs_core_options *opts) {
+    start_durability(fs, opts);
+
+    struct writeback_config wb_config = {
+        /* Synchronous mounts write file data through as well, unless the
+         * WAL already holds it */
+        .interval_ms = fs->durability == FS_DURABILITY_SYNC && !fs->wal_data ?
+                       0 : opts->writeback_ms,
+    };
+    if (writeback_init(&fs->writeback, &wb_config, writeback_file_data, fs) == 0) {
+        if (fs->writeback.interval_ms > 0) {
+            printf("   Write-back cache: dirty data flushed within %u ms\n",
+                   fs->writeback.interval_ms);
+        } else {
+            printf("   Write-back cache: off (write-through)\n");
+        }
+    } else {
+        /* No flusher thread: write every change through instead */
+        fprintf(stderr, "⚠️  Write-back flusher unavailable - falling back to write-through\n");
+        wb_config.interval_ms = 0;
+        writeback_init(&fs->writeback, &wb_config, writeback_file_data, fs);
+    }
+
+    /* The log frees its own space: appends slow down as it fills instead
+     * of failing once it is full. Payloads are only reclaimed once their
+     * data is in the data log (so the flusher must be running) */
+    if (fs->wal_enabled) {
+        if (fs->wal_data) {
+            wal_set_checkpoint_fn(&fs->wal, checkpoint_wal_data, fs);
+        }
+        if (wal_start_checkpoint_thread(&fs->wal) != 0) {
+            fprintf(stderr, "⚠️  WAL checkpoint thread unavailable - %s\n",
+                    fs->wal_data ? "writes past a full log go unlogged"
+                                 : "checkpointing when full");
+            wal_set_auto_checkpoint(&fs->wal, 1);
+        }
+    }
+
+    struct compress_pool_config pool_config = {
+        .threads = opts->compress_threads,
+        .idle_ms = opts->compress_idle_ms,
+    };
+    if (compress_pool_init(&fs->compressor, &pool_config, compress_file_data, fs) == 0) {
+        printf("   Background compression: %u thread(s), %u ms idle, %s\n",
+               fs->compressor.thread_count, fs->compressor.idle_ms,
+               compression_codec_name(compression_get_codec(COMPRESSION_BACKGROUND)));
+    } else {
+        fprintf(stderr, "⚠️  Background compression unavailable - files stay uncompressed\n");
+    }
+
+    if (opts->memory_mb > 0) {
+        /* Metadata allocations fail with ENOSPC past the limit; file data
+         * gets whatever the tree leaves and is evicted to stay inside it */
+        fs->memory_limit = (uint64_t)opts->memory_mb << 20;
+        nary_set_memory_limit_mt(&fs->tree, fs->memory_limit);
+        fs_core_reclaim(fs);
+        printf("   Memory budget: %u MB (cold file data evicted beyond it)\n",
+               opts->memory_mb);
+    }
+
+    start_dedup(fs, opts);  /* First: the tier leaves shared chunks local */
+    start_tier(fs, opts);
+
+    if (rebalancer_init(&fs->rebalancer, &fs->tree, opts->rebalance_ms, 0) == 0) {
+        if (fs->rebalancer.started) {
+            printf("   Tree compaction: %u nodes every %u ms\n",
+                   fs->rebalancer.step_nodes, fs->rebalancer.interval_ms);
+        }
+    } else {
+        fprintf(stderr, "⚠️  Tree compaction unavailable - directories may scatter\n");
+    }
+}
+
+void fs_core_close(struct fs_core *fs) {
+    /* No node moves from here on */
+    rebalancer_destroy(&fs->rebalancer);
+
+    /* No more offloads; remote chunks read from here on fail */
+    struct tier_stats tier_stats = {0};
+    if (fs->tier_enabled) {
+        disk_set_remote(NULL);
+        tier_get_stats(&fs->tier, &tier_stats);
+        tier_destroy(&fs->tier);
+        fs->tier_enabled = 0;
+    }
+
+    /* The final checkpoint is the close's own */
+    if (fs->wal_enabled) {
+        wal_stop_checkpoint_thread(&fs->wal);
+    }
+
+    /* Stop compression workers, then write back all dirty file data */
+    compress_pool_destroy(&fs->compressor);
+    writeback_destroy(&fs->writeback);
+
+    /* Checkpoint and destroy WAL (payloads only once their data is durable) */
+    if (fs->wal_enabled) {
+        printf("📝 Checkpointing WAL...\n");
+        struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+        if (!fs->wal_data || !log || data_log_sync(log) == 0) {
+            wal_checkpoint(&fs->wal);
+        }
+        wal_destroy(&fs->wal);
+        fs->wal_enabled = 0;
+        printf("✅ WAL closed cleanly\n");
+    }
+
+    /* Print final statistics */
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&fs->tree, &stats);
+    printf("   Final MT Stats: %lu total nodes, %lu read locks, %lu write locks, %lu conflicts\n",
+           stats.total_nodes, stats.read_locks, stats.write_locks, stats.lock_conflicts);
+    if (stats.numa_nodes > 1) {
+        for (uint32_t n = 0; n < stats.numa_nodes; n++) {
+            printf("   NUMA node %u: %lu KB of metadata\n", n, stats.node_memory_bytes[n] / 1024);
+        }
+    }
+    if (stats.rebalance_steps > 0) {
+        printf("   Compaction: %lu steps, %lu nodes moved, longest pause %lu us\n",
+               stats.rebalance_steps, stats.nodes_moved, stats.pause_max_ns / 1000);
+    }
+    if (fs->evicted_bytes > 0) {
+        printf("   Memory budget: %lu KB of cold file data evicted\n",
+               (unsigned long)(fs->evicted_bytes / 1024));
+    }
+    if (tier_stats.offloaded_files > 0 || tier_stats.remote_reads > 0) {
+        printf("   Tiering: %lu files (%lu KB) offloaded, %lu remote reads (%lu from cache)\n",
+               (unsigned long)tier_stats.offloaded_files,
+               (unsigned long)(tier_stats.offloaded_bytes / 1024),
+               (unsigned long)tier_stats.remote_reads, (unsigned long)tier_stats.cache_hits);
+    }
+    struct xattr_stats xattr_stats;
+    xattr_get_stats(&fs->xattrs, &xattr_stats);
+    if (xattr_stats.lookups > 0 || xattr_stats.negative > 0) {
+        printf("   Xattrs: %lu entries, %lu lookups, %lu answered without the arena\n",
+               (unsigned long)fs->xattrs.live, (unsigned long)xattr_stats.lookups,
+               (unsigned long)xattr_stats.negative);
+    }
+    struct snapshot_stats snap_stats;
+    snapshot_get_stats(&fs->snapshots, &snap_stats);
+    if (snap_stats.snapshots > 0) {
+        printf("   Snapshots: %u held (not kept across mounts), %lu chunks (%lu KB) saved\n",
+               snap_stats.snapshots, (unsigned long)snap_stats.chunks,
+               (unsigned long)(snap_stats.bytes / 1024));
+    }
+    struct compression_stats comp_stats;
+    get_compression_stats(&comp_stats);
+    for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+        const struct compression_codec_stats *cs = &comp_stats.codecs[c];
+        if (cs->writes == 0 && cs->reads == 0) continue;
+        printf("   Compression (%s): %lu chunks, %lu KB -> %lu KB, %lu decompressed\n",
+               compression_codec_name(c), (unsigned long)cs->writes,
+               (unsigned long)(cs->bytes_in / 1024), (unsigned long)(cs->bytes_out / 1024),
+               (unsigned long)cs->reads);
+    }
+    if (comp_stats.probe_skips > 0) {
+        printf("   Compression: %lu chunks left raw by the entropy probe\n",
+               (unsigned long)comp_stats.probe_skips);
+    }
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (log && log->dedup) {
+        struct data_log_dedup_stats dedup_stats;
+        data_log_dedup_stats(log, &dedup_stats);
+        printf("   Deduplication: %lu chunks share %lu copies, %lu KB saved\n",
+               (unsigned long)dedup_stats.refs, (unsigned long)dedup_stats.blocks,
+               (unsigned long)(dedup_stats.saved_bytes / 1024));
+    }
+
+    /* Free file data; the workers are stopped, nothing else holds entries */
+    for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+        struct fs_file_shard *shard = &fs->file_shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+
+        for (int b = 0; b <= FS_CORE_FILE_BUCKETS; b++) {
+            struct fs_file_data **head = b < FS_CORE_FILE_BUCKETS ?
+                                         &shard->buckets[b] : &shard->free_list;
+            struct fs_file_data *fd = *head;
+            while (fd) {
+                struct fs_file_data *next = fd->next;
+                extent_store_destroy(&fd->extents);  /* Safe to repeat */
+                pthread_rwlock_destroy(&fd->data_lock);
+                pthread_mutex_destroy(&fd->flush_lock);
+                free(fd);
+                fd = next;
+            }
+            *head = NULL;
+        }
+        shard->active = 0;
+
+        pthread_rwlock_unlock(&shard->lock);
+        pthread_rwlock_destroy(&shard->lock);
+    }
+    pthread_mutex_destroy(&fs->reclaim_lock);
+    pthread_rwlock_destroy(&fs->wal_gate);
+    xattr_store_destroy(&fs->xattrs);
+    snapshot_set_destroy(&fs->snapshots);  /* The tree drops its own */
+
+    if (fs->tree.is_mapped) {
+        /* Detach from shared memory (data persists) */
+        shm_tree_detach(&fs->tree);
+    } else {
+        nary_tree_mt_destroy(&fs->tree);
+    }
+    metrics_destroy();
+}
+
+/* === Operations on Resolved Nodes === */
+
+void fs_core_stat(const struct nary_node *node, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+
+    stbuf->st_ino = node->inode;
+    stbuf->st_mode = node->mode;
+    stbuf->st_nlink = NARY_IS_DIR(node) ? 2 : 1;
+    stbuf->st_uid = getuid();
+    stbuf->st_gid = getgid();
+    stbuf->st_size = node->size;
+    stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = node->mtime;
+    stbuf->st_blocks = (node->size + 511) / 512;
+}
+
+int fs_core_getattr(struct fs_core *fs, uint32_t idx, struct stat *stbuf) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    fs_core_stat(&node, stbuf);
+    return 0;
+}
+
+/* FS_CORE_SNAPSHOT_DIR and FS_CORE_STATS_DIR cannot be created in the root */
+static inline int reserved_name(uint32_t parent_idx, const char *name) {
+    return parent_idx == NARY_ROOT_IDX &&
+           (strcmp(name, FS_CORE_SNAPSHOT_DIR) == 0 || strcmp(name, FS_CORE_STATS_DIR) == 0);
+}
+
+/* Read the node just inserted at *idx as name in the directory holding
+ * dir_inode. A compaction step may move the node, or the directory, before
+ * it is read: it is then found again by name and *idx updated.
+ * @return 0, -ENOENT if it is already gone again, or -EIO */
+static int read_inserted(struct fs_core *fs, uint32_t dir_inode, uint32_t *idx,
+                         const char *name, struct nary_node *node) {
+    for (;;) {
+        if (nary_read_node_mt(&fs->tree, *idx, node) != 0) {
+            return -EIO;
+        }
+        uint32_t dir_idx = nary_inode_lookup_mt(&fs->tree, dir_inode);
+        const char *node_name = node->inode != 0
+            ? string_table_get(&fs->tree.strings, node->name_offset) : NULL;
+        if (node_name && node->parent_idx == dir_idx && strcmp(node_name, name) == 0) {
+            return 0;
+        }
+        if (dir_idx == NARY_INVALID_IDX) {
+            return -ENOENT;
+        }
+        uint32_t found = nary_find_child_mt(&fs->tree, dir_idx, name);
+        if (found == NARY_INVALID_IDX) {
+            return -ENOENT;
+        }
+        if (found == *idx) {
+            return -EIO;
+        }
+        *idx = found;
+    }
+}
+
+int fs_core_mkdir(struct fs_core *fs, uint32_t parent_idx, const char *name,
+                  mode_t mode, struct nary_node *out) {
+    if (reserved_name(parent_idx, name)) {
+        return -EEXIST;
+    }
+    struct nary_node dir;
+    if (nary_read_node_mt(&fs->tree, parent_idx, &dir) != 0 || dir.inode == 0) {
+        return -ENOENT;
+    }
+    uint32_t new_idx = nary_insert_mt(&fs->tree, parent_idx, name, S_IFDIR | mode);
+    if (new_idx == NARY_INVALID_IDX) {
+        return -EEXIST;  /* Or ENOSPC if full */
+    }
+
+    struct nary_node node;
+    int have_node = read_inserted(fs, dir.inode, &new_idx, name, &node) == 0;
+    if (have_node && fs->wal_enabled) {
+        struct wal_insert_data insert_data = {
+            .parent_idx = parent_idx,
+            .inode = node.inode,
+            .name_offset = node.name_offset,
+            .mode = node.mode,
+            .timestamp = node.mtime,
+        };
+        wal_log_insert(&fs->wal, 0, &insert_data);
+    }
+    if (out) {
+        if (!have_node) return -EIO;
+        *out = node;
+    }
+
+    /* Sync string table to ensure persistence */
+    fs_core_sync_strings(fs);
+
+    return 0;
+}
+
+/* Delete the node holding inode, found at idx by an earlier lookup. A
+ * compaction step may move it to another index before the tree lock is
+ * taken (see nary_rebalance_step_mt): inode numbers never move, so the
+ * node is found again by inode.
+ * @return 0, -ENOENT if it is gone, or as nary_delete_inode_mt */
+static int delete_node(struct fs_core *fs, uint32_t idx, uint32_t inode) {
+    int ret;
+    while ((ret = nary_delete_inode_mt(&fs->tree, idx, inode, &fs->wal,
+                                       fs->wal_enabled)) == -ESTALE) {
+        uint32_t moved = nary_inode_lookup_mt(&fs->tree, inode);
+        if (moved == NARY_INVALID_IDX) {
+            return -ENOENT;
+        }
+        if (moved == idx) {
+            return -EIO;  /* Indexed but not linked: not a move */
+        }
+        idx = moved;
+    }
+    return ret;
+}
+
+int fs_core_create(struct fs_core *fs, uint32_t parent_idx, const char *name,
+                   mode_t mode, struct nary_node *out) {
+    if (reserved_name(parent_idx, name)) {
+        return -EEXIST;
+    }
+    struct nary_node dir;
+    if (nary_read_node_mt(&fs->tree, parent_idx, &dir) != 0 || dir.inode == 0) {
+        return -ENOENT;
+    }
+    uint32_t new_idx = nary_insert_mt(&fs->tree, parent_idx, name, S_IFREG | mode);
+    if (new_idx == NARY_INVALID_IDX) {
+        return -EEXIST;
+    }
+
+    /* Create file data storage */
+    struct nary_node node;
+    int ret = read_inserted(fs, dir.inode, &new_idx, name, &node);
+    if (ret != 0) {
+        return ret;
+    }
+
+    struct fs_file_data *fd = create_file_data(fs, node.inode);
+    if (!fd) {
+        delete_node(fs, new_idx, node.inode);
+        return -ENOMEM;
+    }
+    fd->extents.numa_node = subtree_numa_node(fs, new_idx);
+
+    if (out) {
+        *out = node;
+    }
+
+    /* Sync string table to ensure persistence */
+    fs_core_sync_strings(fs);
+
+    return 0;
+}
+
+int fs_core_create_batch(struct fs_core *fs, uint32_t parent_idx,
+                         struct nary_batch_entry *entries, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!S_ISREG(entries[i].mode) && !S_ISDIR(entries[i].mode)) {
+            return -EINVAL;
+        }
+        if (strnlen(entries[i].name, MAX_FILENAME_LENGTH) >= MAX_FILENAME_LENGTH) {
+            return -ENAMETOOLONG;
+        }
+        if (strchr(entries[i].name, '/')) {
+            return -EINVAL;
+        }
+        if (reserved_name(parent_idx, entries[i].name)) {
+            return -EEXIST;
+        }
+    }
+
+    int ret = nary_insert_batch_mt(&fs->tree, parent_idx, entries, count,
+                                   &fs->wal, fs->wal_enabled);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Sync string table to ensure persistence (once for the batch) */
+    fs_core_sync_strings(fs);
+
+    return 0;
+}
+
+int fs_core_ioctl_create_batch(struct fs_core *fs, uint32_t dir_idx,
+                               struct fs_core_batch_ioctl *req) {
+    uint32_t count = req->count;
+    if (count > sizeof(req->buf) / (sizeof(uint32_t) + 2)) {
+        return -EINVAL;
+    }
+
+    struct nary_batch_entry *entries = malloc((count ? count : 1) * sizeof(*entries));
+    if (!entries) {
+        return -ENOMEM;
+    }
+
+    /* Records are packed: copy each mode out, check each name ends */
+    size_t pos = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t mode;
+        if (pos + sizeof(mode) >= sizeof(req->buf)) {
+            free(entries);
+            return -EINVAL;
+        }
+        memcpy(&mode, req->buf + pos, sizeof(mode));
+        pos += sizeof(mode);
+
+        const char *name = req->buf + pos;
+        size_t len = strnlen(name, sizeof(req->buf) - pos);
+        if (len == sizeof(req->buf) - pos || mode > UINT16_MAX) {
+            free(entries);
+            return -EINVAL;
+        }
+        entries[i].name = name;
+        entries[i].mode = (uint16_t)mode;
+        pos += len + 1;
+    }
+
+    int ret = fs_core_create_batch(fs, dir_idx, entries, count);
+    free(entries);
+    if (ret == 0) {
+        req->created = count;
+    }
+    return ret;
+}
+
+int fs_core_rmdir(struct fs_core *fs, uint32_t idx) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+    if (node.inode == 0) {
+        return -ENOENT;  /* Deleted (or moved) since the lookup */
+    }
+
+    if (!NARY_IS_DIR(&node)) {
+        return -ENOTDIR;
+    }
+
+    int result = delete_node(fs, idx, node.inode);
+    switch (result) {
+        case 0:
+            drop_xattrs(fs, node.xattr_head);
+            return 0;
+        case -ENOTEMPTY: return -ENOTEMPTY;
+        case -ENOENT:    return -ENOENT;
+        default:     return -EIO;
+    }
+}
+
+int fs_core_unlink(struct fs_core *fs, uint32_t idx) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+    if (node.inode == 0) {
+        return -ENOENT;  /* Deleted (or moved) since the lookup */
+    }
+
+    if (!NARY_IS_FILE(&node)) {
+        return -EISDIR;
+    }
+
+    uint32_t inode = node.inode;
+
+    int result = delete_node(fs, idx, inode);
+    if (result != 0) {
+        return result == -ENOENT ? -ENOENT : -EIO;
+    }
+
+    remove_file_data(fs, inode);
+    drop_xattrs(fs, node.xattr_head);
+
+    return 0;
+}
+
+/**
+ * Attach a file's persisted data if it is not loaded yet
+ * Only the chunk index is read; chunk payloads stay on disk until a read
+ * or write touches them (see lock_range_for_read()).
+ */
+static void attach_file_data(struct fs_core *fs, uint32_t idx, const struct nary_node *node) {
+    if (fs_core_find_file(fs, node->inode) != NULL || node->size == 0) return;
+
+    struct extent_store attached;
+    extent_store_init(&attached);
+
+    if (disk_file_extents_attach(node->inode, &attached) != 0) {
+        extent_store_destroy(&attached);
+        return;
+    }
+
+    struct fs_file_data *fd = create_file_data(fs, node->inode);
+    if (!fd) {
+        extent_store_destroy(&attached);  /* Failed to create fd */
+        return;
+    }
+
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (fd->extents.size == 0 && fd->extents.chunk_count == 0 &&
+        fd->extents.absent_count == 0) {
+        fd->extents = attached;
+        fd->extents.numa_node = subtree_numa_node(fs, idx);
+        account_file_bytes(fs, fd, 0);  /* Old per-inode images load in full */
+        touch_file_data(fd);
+    } else {
+        extent_store_destroy(&attached);  /* Another open won */
+    }
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+}
+
+int fs_core_open_file(struct fs_core *fs, uint32_t idx, uint64_t *fh_out) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    if (!NARY_IS_FILE(&node)) {
+        return -EISDIR;
+    }
+
+    /* Store inode in file handle for faster access */
+    *fh_out = node.inode;
+
+    attach_file_data(fs, idx, &node);
+    if (over_budget(fs)) {
+        fs_core_reclaim(fs);
+    }
+
+    return 0;
+}
+
+/**
+ * Take the read lock on a range whose chunks are all in memory
+ * Absent chunks are faulted in under the write lock first, then the read
+ * lock is retaken (and the range rechecked, since a truncate may have run
+ * in between).
+ *
+ * @return 0 with the read lock held, 1 if the entry was removed meanwhile,
+ *         -EIO if faulting failed (no lock held in either case)
+ */
+static int lock_range_for_read(struct fs_core *fs, struct fs_file_data *fd, uint32_t inode,
+                               uint64_t offset, size_t size) {
+    for (;;) {
+        metrics_rwlock_rdlock(&fd->data_lock, METRICS_LOCK_FILE);
+        if (!fd->is_active || fd->inode != inode) {
+            metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+            return 1;
+        }
+        if (!extent_store_range_absent(&fd->extents, offset, size)) {
+            touch_file_data(fd);
+            return 0;
+        }
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+        metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+        int ret = 0;
+        if (fd->is_active && fd->inode == inode) {
+            uint64_t before = fd->extents.data_bytes;
+            ret = disk_file_extents_fault(inode, &fd->extents, offset, size);
+            account_file_bytes(fs, fd, before);
+        }
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        if (ret != 0) {
+            return -EIO;
+        }
+    }
+}
+
+/* Contents of an open statistics file (see fs_core_stats_open) */
+struct stats_buf {
+    size_t size;
+    char data[];
+};
+
+static inline struct stats_buf *stats_buf(uint64_t fh) {
+    return (struct stats_buf *)(uintptr_t)(fh & ~(1ULL << 63));
+}
+
+static ssize_t stats_read(uint64_t fh, char *buf, size_t size, off_t offset) {
+    const struct stats_buf *sb = stats_buf(fh);
+    if ((uint64_t)offset >= sb->size) {
+        return 0;
+    }
+    if (size > sb->size - (size_t)offset) {
+        size = sb->size - (size_t)offset;
+    }
+    memcpy(buf, sb->data + offset, size);
+    return (ssize_t)size;
+}
+
+/*
+ * Read a file opened in a snapshot: the live bytes first, then what the
+ * snapshots saved over them (a copy saved after the live read is what
+ * that read saw before the change)
+ */
+static ssize_t snapshot_read(struct fs_core *fs, uint64_t fh, char *buf, size_t size,
+                             off_t offset) {
+    uint32_t id = (uint32_t)(fh >> 32);
+    uint32_t idx = (uint32_t)fh;
+
+    struct nary_node node;
+    if (nary_snapshot_read_node_mt(&fs->tree, id, idx, &node) != 0) {
+        return -ESTALE;  /* Snapshot dropped */
+    }
+    if ((uint64_t)offset >= node.size) {
+        return 0;
+    }
+    if (size > node.size - (uint64_t)offset) {
+        size = (size_t)(node.size - (uint64_t)offset);
+    }
+    memset(buf, 0, size);
+
+    /* The live file, while it is the same one */
+    struct nary_node live;
+    if (nary_read_node_mt(&fs->tree, idx, &live) == 0 && live.inode == node.inode) {
+        attach_file_data(fs, idx, &live);
+    }
+    struct fs_file_data *fd = fs_core_find_file(fs, node.inode);
+    if (fd) {
+        int locked = lock_range_for_read(fs, fd, node.inode, (uint64_t)offset, size);
+        if (locked < 0) {
+            return locked;
+        }
+        if (locked == 0) {
+            ssize_t got = extent_store_read(&fd->extents, buf, size, (uint64_t)offset);
+            int err = errno;
+            metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+            if (got < 0) {
+                return -err;
+            }
+        }
+    }
+
+    int ret = snapshot_overlay(&fs->snapshots, id, node.inode, buf, size, (uint64_t)offset);
+    if (ret != 0) {
+        return ret == -ENOENT ? -ESTALE : ret;
+    }
+    return (ssize_t)size;
+}
+
+ssize_t fs_core_read(struct fs_core *fs, uint64_t fh, char *buf, size_t size, off_t offset) {
+    if (FS_CORE_FH_IS_STATS(fh)) {
+        return offset < 0 ? -EINVAL : stats_read(fh, buf, size, offset);
+    }
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) {
+        return offset < 0 ? -EINVAL : snapshot_read(fs, fh, buf, size, offset);
+    }
+
+    struct fs_file_data *fd = fs_core_find_file(fs, (uint32_t)fh);
+    if (!fd) {
+        return 0;  /* File has no data yet */
+    }
+
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    int locked = lock_range_for_read(fs, fd, (uint32_t)fh, (uint64_t)offset, size);
+    if (locked != 0) {
+        return locked > 0 ? 0 : locked;  /* Removed meanwhile, or I/O error */
+    }
+
+    /* Only the chunks covering the request are inflated; holes read as zeros */
+    ssize_t to_read = extent_store_read(&fd->extents, buf, size, (uint64_t)offset);
+    int err = errno;
+
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    if (to_read < 0) {
+        return -err;
+    }
+
+    /* What this read faulted in may have pushed us over the budget */
+    if (over_budget(fs)) {
+        fs_core_reclaim(fs);
+    }
+
+    return to_read;
+}
+
+ssize_t fs_core_read_pin(struct fs_core *fs, uint64_t fh, size_t size, off_t offset,
+                         struct fs_read_pin *pin) {
+    pin->fd = NULL;
+    pin->view.count = 0;
+    pin->view.bytes = 0;
+    pin->view.scratch_count = 0;
+
+    if (offset < 0) {
+        return -EINVAL;
+    }
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) {
+        return -E2BIG;  /* Assembled from copies (or rendered): fs_core_read() */
+    }
+
+    struct fs_file_data *fd = fs_core_find_file(fs, (uint32_t)fh);
+    if (!fd) {
+        return 0;  /* File has no data yet */
+    }
+
+    /* The pin outlives this call, so make room before taking it */
+    if (over_budget(fs)) {
+        fs_core_reclaim(fs);
+    }
+
+    int locked = lock_range_for_read(fs, fd, (uint32_t)fh, (uint64_t)offset, size);
+    if (locked != 0) {
+        return locked > 0 ? 0 : locked;  /* Removed meanwhile, or I/O error */
+    }
+
+    ssize_t viewed = extent_store_view(&fd->extents, &pin->view, size, (uint64_t)offset);
+    if (viewed < 0) {
+        int err = errno;
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -err;
+    }
+
+    pin->fd = fd;
+    return viewed;
+}
+
+void fs_core_read_unpin(struct fs_read_pin *pin) {
+    if (!pin->fd) return;
+
+    extent_view_release(&pin->view);
+    metrics_rwlock_unlock(&pin->fd->data_lock, METRICS_LOCK_FILE);
+    pin->fd = NULL;
+}
+
+ssize_t fs_core_write(struct fs_core *fs, uint32_t idx, uint64_t fh,
+                      const char *buf, size_t size, off_t offset) {
+    /* Input validation */
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) {
+        return -EROFS;
+    }
+    if (size == 0) {
+        return 0;  /* Nothing to write */
+    }
+    if (offset < 0) {
+        return -EINVAL;
+    }
+
+    /* Calculate required capacity with overflow check */
+    size_t required;
+    if (__builtin_add_overflow((size_t)offset, size, &required)) {
+        return -EFBIG;  /* File too large */
+    }
+
+    /* Get old size for WAL */
+    uint64_t old_size = 0;
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) == 0) {
+        old_size = node.size;
+    }
+
+    /* Payload records are logged once the data changed (mark_data_dirty) */
+    if (fs->wal_enabled && !fs->wal_data) {
+        struct wal_write_data write_data = {
+            .node_idx = idx,
+            .inode = fh,
+            .offset = offset,
+            .length = size,
+            .old_size = old_size,
+            .new_size = old_size > required ? old_size : required,
+            .data_checksum = wal_checksum(&fs->wal, buf, size),
+        };
+        wal_log_write(&fs->wal, 0, &write_data);
+    }
+
+    struct fs_file_data *fd = fs_core_find_file(fs, (uint32_t)fh);
+    if (!fd) {
+        /* First write to this file */
+        fd = create_file_data(fs, (uint32_t)fh);
+        if (!fd) return -ENOMEM;
+    }
+
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (!fd->is_active || fd->inode != (uint32_t)fh) {
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -ENOENT;  /* Unlinked meanwhile */
+    }
+
+    /* Partly overwritten chunks still on disk are loaded first */
+    uint64_t before = fd->extents.data_bytes;
+    if (disk_file_extents_fault((uint32_t)fh, &fd->extents, (uint64_t)offset, size) != 0) {
+        account_file_bytes(fs, fd, before);
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -EIO;
+    }
+
+    /* Write into the chunks covering [offset, offset + size), once the
+     * newest snapshot has what it needs of them */
+    snapshot_capture(&fs->snapshots, (uint32_t)fh, &fd->extents, (uint64_t)offset, size);
+    ssize_t written = extent_store_write(&fd->extents, buf, size, (uint64_t)offset);
+    account_file_bytes(fs, fd, before);
+    if (written < 0) {
+        int err = errno;
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -err;
+    }
+    touch_file_data(fd);
+
+    uint64_t new_size = fd->extents.size;
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    /* The touched chunks are now dirty; the flusher writes them back later
+     * (or right away in write-through mode) */
+    struct wal_write_data change = {
+        .node_idx = idx,
+        .inode = (uint32_t)fh,
+        .offset = (uint64_t)offset,
+        .length = (uint32_t)written,
+        .old_size = old_size,
+        .new_size = new_size,
+    };
+    if (mark_data_dirty(fs, &change, WAL_DATA_WRITE, buf) != 0) {
+        return -EIO;
+    }
+
+    /* Compression happens later, once the file goes idle or is closed */
+    compress_pool_mark_dirty(&fs->compressor, (uint32_t)fh);
+
+    if (over_budget(fs)) {
+        fs_core_reclaim(fs);
+    }
+
+    /* Update node size separately */
+    nary_update_size_mtime_mt(&fs->tree, idx, new_size, time(NULL));
+
+    return written;
+}
+
+void fs_core_release(struct fs_core *fs, uint64_t fh) {
+    if (FS_CORE_FH_IS_STATS(fh)) {
+        free(stats_buf(fh));
+        return;
+    }
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) return;  /* Read-only: nothing to do */
+
+    /* Closed files are compressed right away instead of after the idle
+     * period; the compressor writes the file back when done. Otherwise
+     * just start the write-back now. */
+    if (!compress_pool_mark_closed(&fs->compressor, (uint32_t)fh)) {
+        writeback_schedule(&fs->writeback, (uint32_t)fh);
+    }
+}
+
+/* Report (once) a background write-back failure of this file */
+static int take_wb_error(struct fs_core *fs, uint64_t fh) {
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) return 0;
+
+    uint32_t inode = (uint32_t)fh;
+    struct fs_file_data *fd = fs_core_find_file(fs, inode);
+    return fd && __atomic_exchange_n(&fd->wb_error, 0, __ATOMIC_RELAXED) ? -EIO : 0;
+}
+
+int fs_core_fsync(struct fs_core *fs, uint64_t fh) {
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) return 0;  /* Nothing to make durable */
+
+    /* The WAL is shared: flushing it covers this file's entries along
+     * with everything logged before them */
+    int ret = 0;
+    if (fs->wal_enabled && wal_sync(&fs->wal) != 0) {
+        ret = -EIO;
+    }
+
+    /* Write this file's dirty chunks now instead of waiting for the flusher,
+     * then make them durable if the data log defers that */
+    if (fs_core_flush_file(fs, (uint32_t)fh) != 0) {
+        ret = -EIO;
+    }
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (log && data_log_sync(log) != 0) {
+        ret = -EIO;
+    }
+
+    int wb = take_wb_error(fs, fh);
+    return ret ? ret : wb;
+}
+
+int fs_core_flush(struct fs_core *fs, uint64_t fh) {
+    return take_wb_error(fs, fh);
+}
+
+int fs_core_fsyncdir(struct fs_core *fs) {
+    if (fs->wal_enabled && wal_sync(&fs->wal) != 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+int fs_core_truncate(struct fs_core *fs, uint32_t idx, off_t size) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    if (!NARY_IS_FILE(&node)) {
+        return -EISDIR;
+    }
+
+    if (size < 0) {
+        return -EINVAL;
+    }
+
+    /* No entry in memory does not mean no stored data: even a truncate
+     * to 0 goes through the entry, so the data log learns of the cut */
+    struct fs_file_data *fd = fs_core_find_file(fs, node.inode);
+    if (!fd) {
+        /* Truncated without being opened: keep what is on disk */
+        attach_file_data(fs, idx, &node);
+        fd = fs_core_find_file(fs, node.inode);
+    }
+    if (!fd) {
+        fd = create_file_data(fs, node.inode);
+        if (!fd) return -ENOMEM;
+    }
+
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (!fd->is_active || fd->inode != node.inode) {
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -ENOENT;  /* Unlinked meanwhile */
+    }
+
+    /* The new last chunk keeps its head, so it must be loaded; so must
+     * everything cut off while the newest snapshot still needs it */
+    uint64_t before = fd->extents.data_bytes;
+    int shrink = (uint64_t)size < fd->extents.size;
+    uint64_t cut = shrink && snapshot_set_active(&fs->snapshots) ?
+                   fd->extents.size - (uint64_t)size : 0;
+    if (shrink && (cut || EXTENT_CHUNK_OFFSET((uint64_t)size) != 0) &&
+        disk_file_extents_fault(node.inode, &fd->extents, (uint64_t)size, cut ? cut : 1) != 0) {
+        account_file_bytes(fs, fd, before);
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -EIO;
+    }
+    snapshot_capture(&fs->snapshots, node.inode, &fd->extents, (uint64_t)size, cut);
+
+    /* Growing leaves a hole; shrinking frees the chunks past the new end */
+    int truncated = extent_store_truncate(&fd->extents, (uint64_t)size);
+    account_file_bytes(fs, fd, before);
+    if (truncated != 0) {
+        int err = errno;
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -err;
+    }
+
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    struct wal_write_data change = {
+        .node_idx = idx,
+        .inode = node.inode,
+        .old_size = node.size,
+        .new_size = (uint64_t)size,
+    };
+    if (mark_data_dirty(fs, &change, WAL_DATA_TRUNCATE, NULL) != 0) {
+        return -EIO;
+    }
+
+    /* Update node */
+    node.size = size;
+    node.mtime = time(NULL);
+    nary_update_node_mt(&fs->tree, idx, &node);
+
+    return 0;
+}
+
+int fs_core_fallocate(struct fs_core *fs, uint32_t idx, int mode, off_t offset, off_t length) {
+    if (offset < 0 || length <= 0) {
+        return -EINVAL;
+    }
+    if ((mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE)) ||
+        ((mode & FALLOC_FL_PUNCH_HOLE) && !(mode & FALLOC_FL_KEEP_SIZE))) {
+        return -EOPNOTSUPP;
+    }
+    off_t end;
+    if (__builtin_add_overflow(offset, length, &end)) {
+        return -EFBIG;
+    }
+
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+    if (!NARY_IS_FILE(&node)) {
+        return -EISDIR;
+    }
+
+    if (!(mode & FALLOC_FL_PUNCH_HOLE)) {
+        /* Reserving memory up front would only make sparse files dense */
+        if ((mode & FALLOC_FL_KEEP_SIZE) || (uint64_t)end <= node.size) return 0;
+        return fs_core_truncate(fs, idx, end);
+    }
+
+    struct fs_file_data *fd = fs_core_find_file(fs, node.inode);
+    if (!fd) {
+        attach_file_data(fs, idx, &node);
+        fd = fs_core_find_file(fs, node.inode);
+    }
+    if (!fd) {
+        return 0;  /* No data: all hole already */
+    }
+
+    metrics_rwlock_wrlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (!fd->is_active || fd->inode != node.inode) {
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -ENOENT;  /* Unlinked meanwhile */
+    }
+
+    /* Partly punched chunks at either edge keep bytes, so they must be loaded */
+    uint64_t before = fd->extents.data_bytes;
+    int ret = 0;
+    if (EXTENT_CHUNK_OFFSET((uint64_t)offset) != 0) {
+        ret = disk_file_extents_fault(node.inode, &fd->extents, (uint64_t)offset, 1);
+    }
+    if (ret == 0 && EXTENT_CHUNK_OFFSET((uint64_t)end) != 0) {
+        ret = disk_file_extents_fault(node.inode, &fd->extents, (uint64_t)end - 1, 1);
+    }
+    if (ret == 0 && snapshot_set_active(&fs->snapshots)) {
+        /* The newest snapshot saves the whole range first */
+        ret = disk_file_extents_fault(node.inode, &fd->extents, (uint64_t)offset,
+                                      (uint64_t)length);
+        if (ret == 0) {
+            snapshot_capture(&fs->snapshots, node.inode, &fd->extents, (uint64_t)offset,
+                             (uint64_t)length);
+        }
+    }
+    if (ret == 0) {
+        ret = extent_store_punch(&fd->extents, (uint64_t)offset, (uint64_t)length) == 0 ? 0
+                                                                                      : -errno;
+    } else {
+        ret = -EIO;
+    }
+    account_file_bytes(fs, fd, before);
+    uint64_t size = fd->extents.size;
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Records hold 32-bit lengths: a larger hole is logged in pieces
+     * (nothing past the end of the file was there to punch) */
+    uint64_t punch_end = (uint64_t)end < size ? (uint64_t)end : size;
+    for (uint64_t pos = (uint64_t)offset; pos < punch_end;) {
+        uint64_t piece = punch_end - pos;
+        struct wal_write_data change = {
+            .node_idx = idx,
+            .inode = node.inode,
+            .offset = pos,
+            .length = piece < UINT32_MAX ? (uint32_t)piece : UINT32_MAX,
+            .old_size = node.size,
+            .new_size = size,
+        };
+        if (mark_data_dirty(fs, &change, WAL_DATA_PUNCH, NULL) != 0) {
+            return -EIO;
+        }
+        pos += change.length;
+    }
+    nary_update_size_mtime_mt(&fs->tree, idx, size, time(NULL));
+    return 0;
+}
+
+off_t fs_core_lseek(struct fs_core *fs, uint64_t fh, off_t offset, int whence) {
+    if (whence != SEEK_DATA && whence != SEEK_HOLE) {
+        return -EINVAL;
+    }
+    if (offset < 0) {
+        return -ENXIO;
+    }
+    if (FS_CORE_FH_IS_STATS(fh)) {
+        uint64_t size = stats_buf(fh)->size;
+        if ((uint64_t)offset >= size) return -ENXIO;
+        return whence == SEEK_DATA ? offset : (off_t)size;
+    }
+    if (FS_CORE_FH_IS_SNAPSHOT(fh)) {
+        /* Snapshots keep no hole map: all data up to the end */
+        struct nary_node node;
+        if (nary_snapshot_read_node_mt(&fs->tree, (uint32_t)(fh >> 32), (uint32_t)fh,
+                                       &node) != 0) {
+            return -ESTALE;
+        }
+        if ((uint64_t)offset >= node.size) return -ENXIO;
+        return whence == SEEK_DATA ? offset : (off_t)node.size;
+    }
+
+    struct fs_file_data *fd = fs_core_find_file(fs, (uint32_t)fh);
+    if (!fd) {
+        return -ENXIO;  /* File has no data yet */
+    }
+
+    /* Absent chunks count as data: nothing needs loading */
+    metrics_rwlock_rdlock(&fd->data_lock, METRICS_LOCK_FILE);
+    if (!fd->is_active || fd->inode != (uint32_t)fh) {
+        metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+        return -ENXIO;
+    }
+    off_t pos = extent_store_seek(&fd->extents, (uint64_t)offset, whence);
+    int err = errno;
+    metrics_rwlock_unlock(&fd->data_lock, METRICS_LOCK_FILE);
+
+    return pos < 0 ? -err : pos;
+}
+
+int fs_core_opendir(struct fs_core *fs, uint32_t idx, uint64_t *dh_out) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+    if (!NARY_IS_DIR(&node)) {
+        return -ENOTDIR;
+    }
+
+    struct fs_dir_cursor *cursor = calloc(1, sizeof(*cursor));
+    if (!cursor) {
+        return -ENOMEM;
+    }
+    cursor->dir_idx = idx;
+    cursor->next_off = -1;
+    *dh_out = (uint64_t)(uintptr_t)cursor;
+    return 0;
+}
+
+/* A second cursor running FS_CORE_READDIR_PREFETCH children ahead of
+ * readdir: it prefetches their nodes, and names half as far ahead, by when
+ * the node (which holds the name's offset) should have arrived */
+struct readdir_prefetch {
+    struct nary_child_iter ahead;
+    uint32_t upcoming[FS_CORE_READDIR_PREFETCH];  /* Ring of what ahead returned */
+    uint32_t issued;             /* Children ahead has passed */
+    uint32_t listed;             /* Children the listing has passed */
+};
+
+static void readdir_prefetch_init(struct readdir_prefetch *pf, const struct nary_child_iter *it) {
+    pf->ahead = *it;
+    pf->issued = pf->listed = 0;
+}
+
+/* The listing moved on by one child */
+static void readdir_prefetch_step(struct nary_tree_mt *tree, struct readdir_prefetch *pf) {
+    pf->listed++;
+    while (pf->issued < pf->listed + FS_CORE_READDIR_PREFETCH) {
+        uint32_t child = nary_child_iter_next(&pf->ahead);
+        pf->upcoming[pf->issued++ % FS_CORE_READDIR_PREFETCH] = child;
+        nary_prefetch_node_mt(tree, child);
+    }
+    uint32_t name_at = pf->listed + FS_CORE_READDIR_PREFETCH / 2;
+    nary_prefetch_name_mt(tree, pf->upcoming[name_at % FS_CORE_READDIR_PREFETCH]);
+}
+
+int fs_core_readdir(struct fs_core *fs, uint32_t idx, uint64_t dh, off_t off,
+                    fs_core_dirent_fn fill, void *ctx) {
+    struct fs_dir_cursor *cursor = (struct fs_dir_cursor *)(uintptr_t)dh;
+    if (off < 0) {
+        return -EINVAL;
+    }
+
+    /* Parent first: never lock a parent while holding the child */
+    struct nary_node dir_copy, parent_node;
+    if (nary_read_node_mt(&fs->tree, idx, &dir_copy) != 0) {
+        return -EIO;
+    }
+    parent_node = dir_copy;
+    if (dir_copy.parent_idx != NARY_INVALID_IDX &&
+        nary_read_node_mt(&fs->tree, dir_copy.parent_idx, &parent_node) != 0) {
+        parent_node = dir_copy;
+    }
+
+    uint64_t gen = nary_paths_generation_mt(&fs->tree);
+    if (nary_lock_read(&fs->tree, idx) != 0) {
+        return -EIO;
+    }
+
+    const struct nary_node *dir_node = &fs->tree.nodes[idx].node;
+    if (!NARY_IS_DIR(dir_node)) {
+        nary_unlock(&fs->tree, idx);
+        return -ENOTDIR;
+    }
+
+    off_t pos = 0;
+    int room = 1;
+    if (pos++ >= off) {
+        room = fill(ctx, ".", &dir_copy, pos);
+    }
+    if (room && pos++ >= off) {
+        room = fill(ctx, "..", &parent_node, pos);
+    }
+
+    /* Continue where the last call stopped, unless something moved */
+    struct nary_child_iter it;
+    uint32_t version = nary_node_version_mt(&fs->tree, idx);
+    if (cursor && off >= 2 && cursor->next_off == off && cursor->dir_idx == idx &&
+        cursor->version == version && !(version & 1) &&
+        cursor->paths_gen == gen && gen != NARY_PATHS_UNSTABLE) {
+        it = cursor->it;
+        pos = off;
+    } else {
+        nary_child_iter_init(&it, &fs->tree, dir_node);
+    }
+
+    /* Child nodes are copied without their locks when reads are optimistic */
+    struct readdir_prefetch pf;
+    readdir_prefetch_init(&pf, &it);
+    while (room) {
+        struct nary_child_iter at = it;
+        uint32_t child_idx = nary_child_iter_next(&it);
+        if (child_idx == NARY_INVALID_IDX) break;
+        if (fs->tree.prefetch) readdir_prefetch_step(&fs->tree, &pf);
+        if (pos++ < off) continue;
+
+        struct nary_node child_node;
+        if (nary_read_node_mt(&fs->tree, child_idx, &child_node) != 0) continue;
+        const char *name = string_table_get(&fs->tree.strings, child_node.name_offset);
+        if (!name) continue;
+
+        if (!fill(ctx, name, &child_node, pos)) {
+            it = at;  /* Not consumed: the next call starts with it */
+            pos--;
+            room = 0;
+        }
+    }
+
+    if (cursor) {
+        cursor->dir_idx = idx;
+        cursor->next_off = pos;
+        cursor->version = version;
+        cursor->paths_gen = gen;
+        cursor->it = it;
+    }
+    nary_unlock(&fs->tree, idx);
+    return 0;
+}
+
+void fs_core_releasedir(struct fs_core *fs, uint64_t dh) {
+    (void) fs;
+    struct fs_dir_cursor *cursor = (struct fs_dir_cursor *)(uintptr_t)dh;
+    if (cursor) free(cursor->snap_children);
+    free(cursor);
+}
+
+int fs_core_chmod(struct fs_core *fs, uint32_t idx, mode_t mode) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    /* Update mode preserving file type bits */
+    node.mode = (node.mode & S_IFMT) | (mode & 07777);
+    node.mtime = time(NULL);
+
+    nary_update_node_mt(&fs->tree, idx, &node);
+
+    return 0;
+}
+
+int fs_core_utimens(struct fs_core *fs, uint32_t idx, const struct timespec tv[2]) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    /* Update modification time */
+    if (tv) {
+        /* tv[0] is atime, tv[1] is mtime */
+        /* We only track mtime in our simple implementation */
+        if (tv[1].tv_nsec == UTIME_NOW) {
+            node.mtime = time(NULL);
+        } else if (tv[1].tv_nsec != UTIME_OMIT) {
+            node.mtime = tv[1].tv_sec;
+        }
+    } else {
+        /* NULL means set to current time */
+        node.mtime = time(NULL);
+    }
+
+    return nary_update_node_mt(&fs->tree, idx, &node) == 0 ? 0 : -EIO;
+}
+
+int fs_core_rename(struct fs_core *fs, uint32_t parent_idx, uint32_t from_idx,
+                   uint32_t new_parent_idx, const char *to_name, unsigned int flags) {
+    if (from_idx == NARY_ROOT_IDX) return -EBUSY;
+    if (reserved_name(new_parent_idx, to_name)) return -EBUSY;
+    if (flags & ~(RENAME_NOREPLACE | RENAME_EXCHANGE)) return -EINVAL;
+
+    struct nary_node node, dir;
+    if (nary_read_node_mt(&fs->tree, from_idx, &node) != 0 ||
+        nary_read_node_mt(&fs->tree, new_parent_idx, &dir) != 0) return -EIO;
+    if (node.inode == 0 || dir.inode == 0 || node.parent_idx != parent_idx) return -ENOENT;
+
+    /* Relink in place: no data is copied, whatever the file size */
+    struct nary_node replaced;
+    int result;
+    while ((result = nary_rename_inode_mt(&fs->tree, from_idx, node.inode, new_parent_idx,
+                                          dir.inode, to_name, flags, &replaced, &fs->wal,
+                                          fs->wal_enabled)) == -ESTALE) {
+        /* A compaction step moved the node or the target directory (see
+         * delete_node) */
+        uint32_t moved = nary_inode_lookup_mt(&fs->tree, node.inode);
+        uint32_t moved_dir = nary_inode_lookup_mt(&fs->tree, dir.inode);
+        if (moved == NARY_INVALID_IDX || moved_dir == NARY_INVALID_IDX) {
+            return -ENOENT;
+        }
+        if (moved == from_idx && moved_dir == new_parent_idx) {
+            return -EIO;  /* Indexed but not linked: not a move */
+        }
+        from_idx = moved;
+        new_parent_idx = moved_dir;
+    }
+    if (result != 0) return result;
+
+    if (replaced.inode) {
+        drop_xattrs(fs, replaced.xattr_head);
+        if (NARY_IS_FILE(&replaced)) remove_file_data(fs, replaced.inode);
+    }
+
+    /* Sync string table to ensure persistence */
+    fs_core_sync_strings(fs);
+
+    return 0;
+}
+
+/* === Snapshots === */
+
+int fs_core_snapshot_create(struct fs_core *fs, const char *name) {
+    return snapshot_create(&fs->snapshots, &fs->tree, name, NULL);
+}
+
+int fs_core_snapshot_delete(struct fs_core *fs, const char *name) {
+    return snapshot_delete(&fs->snapshots, &fs->tree, name);
+}
+
+uint32_t fs_core_snapshot_find(struct fs_core *fs, const char *name) {
+    return snapshot_find(&fs->snapshots, name);
+}
+
+void fs_core_snapshot_dir_node(struct fs_core *fs, struct nary_node *out) {
+    if (nary_read_node_mt(&fs->tree, NARY_ROOT_IDX, out) != 0) {
+        memset(out, 0, sizeof(*out));
+    }
+    out->inode = FS_CORE_SNAPSHOT_DIR_INODE;
+    out->parent_idx = NARY_ROOT_IDX;
+    out->mode = S_IFDIR | 0555;
+    out->num_children = 0;
+    out->xattr_head = 0;
+}
+
+int fs_core_snapshot_node(struct fs_core *fs, uint32_t id, uint32_t idx,
+                          struct nary_node *out) {
+    if (nary_snapshot_read_node_mt(&fs->tree, id, idx, out) != 0) {
+        return -ENOENT;
+    }
+    out->mode &= ~(S_IWUSR | S_IWGRP | S_IWOTH);
+    out->xattr_head = 0;  /* Extended attributes are not part of snapshots */
+    return 0;
+}
+
+int fs_core_snapshot_list(struct fs_core *fs, off_t off, fs_core_dirent_fn fill, void *ctx) {
+    if (off < 0) {
+        return -EINVAL;
+    }
+
+    struct nary_node dir, root;
+    fs_core_snapshot_dir_node(fs, &dir);
+    if (nary_read_node_mt(&fs->tree, NARY_ROOT_IDX, &root) != 0) {
+        return -EIO;
+    }
+
+    off_t pos = 0;
+    int room = 1;
+    if (pos++ >= off) {
+        room = fill(ctx, ".", &dir, pos);
+    }
+    if (room && pos++ >= off) {
+        room = fill(ctx, "..", &root, pos);
+    }
+
+    /* Each snapshot shows as its root, dated when it was taken */
+    char name[SNAPSHOT_NAME_MAX + 1];
+    time_t created;
+    uint32_t id;
+    for (uint32_t i = pos < off ? (uint32_t)(off - pos) : 0;
+         room && (id = snapshot_get(&fs->snapshots, i, name, &created)) != 0; i++) {
+        struct nary_node node;
+        if (fs_core_snapshot_node(fs, id, NARY_ROOT_IDX, &node) != 0) continue;
+        node.mtime = created;
+        room = fill(ctx, name, &node, pos + i + 1);
+    }
+    return 0;
+}
+
+int fs_core_snapshot_lookup(struct fs_core *fs, uint32_t id, uint32_t dir_idx,
+                            const char *name, uint32_t *idx_out, struct nary_node *out) {
+    uint32_t idx = nary_snapshot_find_child_mt(&fs->tree, id, dir_idx, name);
+    if (idx == NARY_INVALID_IDX) {
+        return -ENOENT;
+    }
+    if (idx_out) *idx_out = idx;
+    return out ? fs_core_snapshot_node(fs, id, idx, out) : 0;
+}
+
+int fs_core_snapshot_open(struct fs_core *fs, uint32_t id, uint32_t idx, int flags,
+                          uint64_t *fh_out) {
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC)) {
+        return -EROFS;
+    }
+
+    struct nary_node node;
+    if (nary_snapshot_read_node_mt(&fs->tree, id, idx, &node) != 0) {
+        return -ENOENT;
+    }
+    if (!NARY_IS_FILE(&node)) {
+        return -EISDIR;
+    }
+
+    *fh_out = FS_CORE_SNAPSHOT_FH(id, idx);
+    return 0;
+}
+
+int fs_core_snapshot_opendir(struct fs_core *fs, uint32_t id, uint32_t idx, uint64_t *dh_out) {
+    struct fs_dir_cursor *cursor = calloc(1, sizeof(*cursor));
+    if (!cursor) {
+        return -ENOMEM;
+    }
+
+    int ret = nary_snapshot_children_mt(&fs->tree, id, idx, &cursor->snap_children,
+                                        &cursor->snap_count);
+    if (ret != 0) {
+        free(cursor);
+        return ret;
+    }
+    cursor->snapshot = id;
+    cursor->dir_idx = idx;
+    cursor->next_off = -1;
+    *dh_out = (uint64_t)(uintptr_t)cursor;
+    return 0;
+}
+
+int fs_core_snapshot_readdir(struct fs_core *fs, uint32_t id, uint32_t idx, uint64_t dh,
+                             off_t off, fs_core_dirent_fn fill, void *ctx) {
+    struct fs_dir_cursor *cursor = (struct fs_dir_cursor *)(uintptr_t)dh;
+    if (off < 0) {
+        return -EINVAL;
+    }
+
+    struct nary_node dir, parent;
+    if (fs_core_snapshot_node(fs, id, idx, &dir) != 0) {
+        return -ENOENT;  /* Dropped */
+    }
+    if (!NARY_IS_DIR(&dir)) {
+        return -ENOTDIR;
+    }
+    if (idx == NARY_ROOT_IDX) {
+        fs_core_snapshot_dir_node(fs, &parent);
+    } else if (fs_core_snapshot_node(fs, id, dir.parent_idx, &parent) != 0) {
+        parent = dir;
+    }
+
+    /* The listing never changes: take the children fetched at open */
+    uint32_t *children = NULL, *owned = NULL;
+    uint32_t count = 0;
+    if (cursor && cursor->snapshot == id && cursor->dir_idx == idx) {
+        children = cursor->snap_children;
+        count = cursor->snap_count;
+    } else {
+        int ret = nary_snapshot_children_mt(&fs->tree, id, idx, &owned, &count);
+        if (ret != 0) {
+            return ret;
+        }
+        children = owned;
+    }
+
+    off_t pos = 0;
+    int room = 1;
+    if (pos++ >= off) {
+        room = fill(ctx, ".", &dir, pos);
+    }
+    if (room && pos++ >= off) {
+        room = fill(ctx, "..", &parent, pos);
+    }
+
+    for (uint32_t i = pos < off ? (uint32_t)(off - pos) : 0; room && i < count; i++) {
+        struct nary_node child;
+        if (fs_core_snapshot_node(fs, id, children[i], &child) != 0) continue;
+        const char *name = string_table_get(&fs->tree.strings, child.name_offset);
+        if (!name) continue;
+
+        room = fill(ctx, name, &child, pos + i + 1);
+    }
+
+    free(owned);
+    return 0;
+}
+
+/* === Runtime Statistics === */
+
+static const char *const g_stats_names[FS_CORE_STATS_FILES] = {
+    [FS_CORE_STATS_TEXT] = "stats",
+    [FS_CORE_STATS_PROMETHEUS] = "metrics",
+};
+
+/* One component counter, shown in both files */
+struct stats_value {
+    const char *name;            /* Prometheus name; the text report drops "razorfs_" */
+    const char *type;            /* "counter" or "gauge" */
+    const char *help;
+    double value;
+};
+
+#define STATS_VALUES_MAX 32
+
+static unsigned int collect_stats(struct fs_core *fs, struct stats_value *v) {
+    unsigned int n = 0;
+#define STAT(n_, t_, h_, val_) \
+    v[n++] = (struct stats_value){ .name = (n_), .type = (t_), .help = (h_), .value = (double)(val_) }
+
+    STAT("razorfs_uptime_seconds", "gauge", "Seconds since mount", metrics_uptime());
+
+    struct nary_mt_stats tree;
+    nary_get_mt_stats(&fs->tree, &tree);
+    STAT("razorfs_tree_nodes", "gauge", "Tree nodes in use", tree.total_nodes - tree.free_nodes);
+    STAT("razorfs_tree_memory_bytes", "gauge", "Metadata memory", tree.current_memory_bytes);
+    STAT("razorfs_tree_read_fallbacks_total", "counter",
+         "Optimistic tree reads that raced a writer and locked", tree.read_fallbacks);
+    STAT("razorfs_tree_compaction_steps_total", "counter", "Tree compaction steps",
+         tree.rebalance_steps);
+
+    if (fs->dcache) {
+        struct path_cache_stats dstats;
+        path_cache_get_stats(fs->dcache, &dstats);
+        STAT("razorfs_path_cache_hits_total", "counter", "Path lookups served by the cache",
+             dstats.hits);
+        STAT("razorfs_path_cache_misses_total", "counter", "Path lookups that walked the tree",
+             dstats.misses);
+    }
+
+    STAT("razorfs_file_memory_bytes", "gauge", "File data held in memory",
+         __atomic_load_n(&fs->file_bytes, __ATOMIC_RELAXED));
+    STAT("razorfs_evicted_bytes_total", "counter", "Clean file data dropped under the budget",
+         __atomic_load_n(&fs->evicted_bytes, __ATOMIC_RELAXED));
+
+    struct compression_stats comp;
+    get_compression_stats(&comp);
+    uint64_t bytes_in = 0, bytes_out = 0;
+    for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+        bytes_in += comp.codecs[c].bytes_in;
+        bytes_out += comp.codecs[c].bytes_out;
+    }
+    STAT("razorfs_compression_bytes_in_total", "counter", "Raw bytes compressed", bytes_in);
+    STAT("razorfs_compression_bytes_out_total", "counter", "What they were stored in", bytes_out);
+    STAT("razorfs_compression_ratio", "gauge", "Raw / stored bytes of compressed data",
+         bytes_out ? (double)(bytes_in * 1000 / bytes_out) / 1000 : 0);
+    STAT("razorfs_compression_probe_skips_total", "counter",
+         "Chunks left raw by the entropy probe", comp.probe_skips);
+
+    struct data_log *log = fs->tree.is_mapped ? disk_data_log() : NULL;
+    if (log && log->dedup) {
+        struct data_log_dedup_stats dedup;
+        data_log_dedup_stats(log, &dedup);
+        STAT("razorfs_dedup_hits_total", "counter", "Appended chunks that found a copy",
+             dedup.hits);
+        STAT("razorfs_dedup_saved_bytes", "gauge", "Payload bytes not stored thanks to sharing",
+             dedup.saved_bytes);
+    }
+
+    if (fs->tier_enabled) {
+        struct tier_stats tier;
+        tier_get_stats(&fs->tier, &tier);
+        STAT("razorfs_tier_offloaded_files_total", "counter", "Files moved to the tier",
+             tier.offloaded_files);
+        STAT("razorfs_tier_remote_reads_total", "counter", "Chunks read from the tier",
+             tier.remote_reads);
+        STAT("razorfs_tier_cache_hits_total", "counter", "... of which from the read cache",
+             tier.cache_hits);
+    }
+
+    if (fs->wal_enabled) {
+        struct wal_stats wal;
+        wal_get_stats(&fs->wal, &wal);
+        STAT("razorfs_wal_entries_total", "counter", "WAL entries logged", wal.total_entries);
+        STAT("razorfs_wal_bytes_total", "counter", "WAL bytes logged", wal.bytes_logged);
+        STAT("razorfs_wal_sync_batches_total", "counter", "Group commit flushes",
+             wal.sync_batches);
+        STAT("razorfs_wal_checkpoints_total", "counter", "WAL checkpoints", wal.total_checkpoints);
+        STAT("razorfs_wal_throttled_appends_total", "counter", "Appends delayed near a full log",
+             wal.throttled_appends);
+    }
+
+    struct writeback_stats wb;
+    writeback_get_stats(&fs->writeback, &wb);
+    STAT("razorfs_writeback_flushed_total", "counter", "Files written back", wb.flushed);
+    STAT("razorfs_writeback_failed_total", "counter", "Failed write-backs (retried)", wb.failed);
+    STAT("razorfs_writeback_dirty", "gauge", "Files waiting for write-back", wb.dirty);
+#undef STAT
+    return n;
+}
+
+void fs_core_stats_report(struct fs_core *fs, enum fs_core_stats_file file, FILE *out) {
+    struct metrics_shard *snap = malloc(sizeof(*snap));
+    struct stats_value values[STATS_VALUES_MAX];
+    unsigned int count = collect_stats(fs, values);
+
+    if (file == FS_CORE_STATS_PROMETHEUS) {
+        if (snap) {
+            metrics_snapshot(snap);
+            metrics_write_prometheus(out, snap);
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            metrics_write_prometheus_value(out, values[i].name, values[i].type,
+                                           values[i].help, values[i].value);
+        }
+    } else {
+        if (snap) {
+            metrics_snapshot(snap);
+            metrics_write_text(out, snap);
+        }
+        fprintf(out, "\nComponents\n");
+        for (unsigned int i = 0; i < count; i++) {
+            fprintf(out, "  %-36s %.15g\n", values[i].name + strlen("razorfs_"), values[i].value);
+        }
+    }
+    free(snap);
+}
+
+enum fs_core_stats_file fs_core_stats_find(const char *name) {
+    for (int file = FS_CORE_STATS_ROOT + 1; file < FS_CORE_STATS_FILES; file++) {
+        if (strcmp(name, g_stats_names[file]) == 0) {
+            return (enum fs_core_stats_file)file;
+        }
+    }
+    return FS_CORE_STATS_ROOT;
+}
+
+int fs_core_stats_node(struct fs_core *fs, enum fs_core_stats_file file, struct nary_node *out) {
+    if ((unsigned int)file >= FS_CORE_STATS_FILES) {
+        return -ENOENT;
+    }
+
+    /* Owned and dated like the root */
+    if (nary_read_node_mt(&fs->tree, NARY_ROOT_IDX, out) != 0) {
+        memset(out, 0, sizeof(*out));
+    }
+    out->inode = FS_CORE_STATS_DIR_INODE - (uint32_t)file;
+    out->parent_idx = NARY_ROOT_IDX;
+    out->mode = file == FS_CORE_STATS_ROOT ? S_IFDIR | 0555 : S_IFREG | 0444;
+    out->size = 0;
+    out->num_children = 0;
+    out->xattr_head = 0;
+    return 0;
+}
+
+int fs_core_stats_list(struct fs_core *fs, off_t off, fs_core_dirent_fn fill, void *ctx) {
+    if (off < 0) {
+        return -EINVAL;
+    }
+
+    struct nary_node dir, root;
+    fs_core_stats_node(fs, FS_CORE_STATS_ROOT, &dir);
+    if (nary_read_node_mt(&fs->tree, NARY_ROOT_IDX, &root) != 0) {
+        return -EIO;
+    }
+
+    int room = 1;
+    if (off < 1) {
+        room = fill(ctx, ".", &dir, 1);
+    }
+    if (room && off < 2) {
+        room = fill(ctx, "..", &root, 2);
+    }
+    for (int file = FS_CORE_STATS_ROOT + 1; room && file < FS_CORE_STATS_FILES; file++) {
+        if (off > file + 1) continue;
+        struct nary_node node;
+        fs_core_stats_node(fs, (enum fs_core_stats_file)file, &node);
+        room = fill(ctx, g_stats_names[file], &node, file + 2);
+    }
+    return 0;
+}
+
+int fs_core_stats_open(struct fs_core *fs, enum fs_core_stats_file file, int flags,
+                       uint64_t *fh_out) {
+    if ((flags & O_ACCMODE) != O_RDONLY || (flags & O_TRUNC)) {
+        return -EROFS;
+    }
+    if (file == FS_CORE_STATS_ROOT) {
+        return -EISDIR;
+    }
+    if ((unsigned int)file >= FS_CORE_STATS_FILES) {
+        return -ENOENT;
+    }
+
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    if (!out) {
+        return -ENOMEM;
+    }
+    fs_core_stats_report(fs, file, out);
+    if (fclose(out) != 0) {
+        free(text);
+        return -ENOMEM;
+    }
+
+    struct stats_buf *sb = malloc(sizeof(*sb) + len);
+    if (!sb) {
+        free(text);
+        return -ENOMEM;
+    }
+    sb->size = len;
+    memcpy(sb->data, text, len);
+    free(text);
+
+    *fh_out = FS_CORE_STATS_FH(sb);
+    return 0;
+}
+
+/* === Extended attributes === */
+
+int fs_core_getxattr(struct fs_core *fs, uint32_t idx, const char *name,
+                     char *value, size_t size) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    /* Most nodes have no xattrs: the probes on them stop here */
+    if (node.xattr_head == 0) {
+        __atomic_add_fetch(&fs->xattrs.stats.negative, 1, __ATOMIC_RELAXED);
+        return -ENODATA;
+    }
+
+    pthread_rwlock_rdlock(&fs->xattrs.lock);
+    /* Read again under the lock: the chain may have changed */
+    int ret = nary_read_node_mt(&fs->tree, idx, &node) == 0 ?
+              xattr_get(&fs->xattrs, node.xattr_head, name, value, size) : -EIO;
+    pthread_rwlock_unlock(&fs->xattrs.lock);
+    return ret;
+}
+
+int fs_core_setxattr(struct fs_core *fs, uint32_t idx, const char *name,
+                     const char *value, size_t size, int flags) {
+    pthread_rwlock_wrlock(&fs->xattrs.lock);
+
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        pthread_rwlock_unlock(&fs->xattrs.lock);
+        return -EIO;
+    }
+
+    uint32_t head = node.xattr_head;
+    int ret = xattr_set(&fs->xattrs, &head, name, value, size, flags);
+    if (ret == 0) {
+        if (head != node.xattr_head) {
+            nary_set_xattr_head_mt(&fs->tree, idx, head);
+        }
+        save_xattrs_locked(fs);
+    }
+
+    pthread_rwlock_unlock(&fs->xattrs.lock);
+
+    /* The name may be new to the string table */
+    if (ret == 0) {
+        fs_core_sync_strings(fs);
+    }
+    return ret;
+}
+
+int fs_core_listxattr(struct fs_core *fs, uint32_t idx, char *list, size_t size) {
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        return -EIO;
+    }
+
+    if (node.xattr_head == 0) {
+        __atomic_add_fetch(&fs->xattrs.stats.negative, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    pthread_rwlock_rdlock(&fs->xattrs.lock);
+    int ret = nary_read_node_mt(&fs->tree, idx, &node) == 0 ?
+              xattr_list(&fs->xattrs, node.xattr_head, list, size) : -EIO;
+    pthread_rwlock_unlock(&fs->xattrs.lock);
+    return ret;
+}
+
+int fs_core_removexattr(struct fs_core *fs, uint32_t idx, const char *name) {
+    pthread_rwlock_wrlock(&fs->xattrs.lock);
+
+    struct nary_node node;
+    if (nary_read_node_mt(&fs->tree, idx, &node) != 0) {
+        pthread_rwlock_unlock(&fs->xattrs.lock);
+        return -EIO;
+    }
+
+    uint32_t head = node.xattr_head;
+    int ret = xattr_remove(&fs->xattrs, &head, name);
+    if (ret == 0) {
+        if (head != node.xattr_head) {
+            nary_set_xattr_head_mt(&fs->tree, idx, head);
+        }
+        save_xattrs_locked(fs);
+    }
+
+    pthread_rwlock_unlock(&fs->xattrs.lock);
+    return ret;
+}
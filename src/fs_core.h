@@ -0,0 +1,693 @@
+/**
+ * Filesystem Core - RAZORFS Front-End Shared State
+ *
+ * Everything below the FUSE request layer, shared by the path-based
+ * daemon (fuse/razorfs_mt.c) and the inode-based one (fuse/razorfs_ll.c):
+ * - Bring-up and shutdown: WAL, persistent tree, crash recovery, workers
+ * - File contents by inode (extent stores), compression and write-back
+ * - Operations on already resolved nodes, returning 0 or -errno like FUSE
+ *
+ * Front ends only turn requests into node indices (by path or by inode
+ * number) and results into replies.
+ */
+
+#ifndef RAZORFS_FS_CORE_H
+#define RAZORFS_FS_CORE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include "nary_tree_mt.h"
+#include "extent_store.h"
+#include "compress_pool.h"
+#include "writeback.h"
+#include "rebalancer.h"
+#include "wal.h"
+#include "tiering.h"
+#include "xattr.h"
+#include "snapshot.h"
+#include "path_cache.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Configuration */
+#define FS_CORE_FILE_SHARDS     64      /* Independently locked parts of the file table */
+#define FS_CORE_FILE_BUCKETS    64      /* Hash buckets per shard */
+#define FS_CORE_WAL_PATH        "/tmp/razorfs_wal.log"
+#define FS_CORE_WAL_SEGMENTS    4       /* Segments with wal_dirs but no wal_segments */
+#define FS_CORE_CACHE_TIMEOUT   30.0            /* Seconds, with kernel caching on */
+#define FS_CORE_IO_SIZE         (1024 * 1024)   /* Largest read/write request */
+#define FS_CORE_READDIR_PREFETCH 8      /* Children readdir prefetches ahead of the one it lists */
+
+/* Snapshots appear read-only in this directory of the root (see
+ * fs_core_snapshot_create); the name is reserved there */
+#define FS_CORE_SNAPSHOT_DIR    ".snapshots"
+#define FS_CORE_SNAPSHOT_DIR_INODE UINT32_MAX   /* st_ino of the directory */
+
+/* Handle of a file opened in a snapshot; live file handles are inodes */
+#define FS_CORE_SNAPSHOT_FH(id, idx)  (((uint64_t)(id) << 32) | (uint32_t)(idx))
+#define FS_CORE_FH_IS_SNAPSHOT(fh)    (((uint64_t)(fh) >> 32) != 0)
+
+/* Runtime statistics appear read-only in this directory of the root (see
+ * fs_core_stats_open); the name is reserved there */
+#define FS_CORE_STATS_DIR       ".razorfs"
+#define FS_CORE_STATS_DIR_INODE (UINT32_MAX - 1)  /* Its files count down from here */
+
+enum fs_core_stats_file {
+    FS_CORE_STATS_ROOT = 0,      /* The directory itself */
+    FS_CORE_STATS_TEXT,          /* "stats": human-readable report */
+    FS_CORE_STATS_PROMETHEUS,    /* "metrics": Prometheus text format */
+    FS_CORE_STATS_FILES,
+};
+
+/* Handle of an open statistics file: its contents, rendered at open.
+ * Test it before FS_CORE_FH_IS_SNAPSHOT, which it also satisfies. */
+#define FS_CORE_STATS_FH(buf)   ((uint64_t)(uintptr_t)(buf) | (1ULL << 63))
+#define FS_CORE_FH_IS_STATS(fh) (((uint64_t)(fh) >> 63) != 0)
+
+/* RENAME flags if not defined */
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+#ifndef RENAME_EXCHANGE
+#define RENAME_EXCHANGE (1 << 1)
+#endif
+
+/**
+ * Batch creation ioctl, issued on an open directory
+ *
+ * buf holds count records, each a uint32_t mode (S_IFREG or S_IFDIR plus
+ * permissions, native byte order) followed by a NUL-terminated name; the
+ * records are packed, so a mode may be unaligned. On success created is
+ * set to count.
+ */
+#define FS_CORE_BATCH_BUF_SIZE  4096
+struct fs_core_batch_ioctl {
+    uint32_t count;
+    uint32_t created;
+    char buf[FS_CORE_BATCH_BUF_SIZE - 2 * sizeof(uint32_t)];
+};
+#define FS_CORE_IOC_CREATE_BATCH _IOWR('R', 1, struct fs_core_batch_ioctl)
+
+/**
+ * When writes become durable (-o durability=...)
+ * - SYNC: every metadata change is flushed to the WAL before the call
+ *   returns and file data is written through
+ * - PERIODIC: calls return after in-memory work; the WAL is flushed and
+ *   dirty data written back every writeback_ms, and on fsync
+ * - FSYNC: only fsync (and unmount) pays for durability
+ */
+enum fs_durability {
+    FS_DURABILITY_SYNC,
+    FS_DURABILITY_PERIODIC,
+    FS_DURABILITY_FSYNC,
+};
+
+/**
+ * Mount options shared by the front ends (-o name=value)
+ */
+struct fs_core_options {
+    unsigned int compress_threads;   /* Background compression workers (0 = off) */
+    unsigned int compress_idle_ms;   /* Write-idle time before compressing a file */
+    unsigned int writeback_ms;       /* Max age of dirty file data (0 = write-through) */
+    unsigned int kernel_cache;       /* Kernel page cache, entry/attr caching, writeback cache */
+    double cache_timeout;            /* Entry and attribute timeout with kernel_cache (s) */
+    unsigned int io_size;            /* max_write / max_readahead requested from the kernel */
+    char *numa_policy;               /* NUMA placement policy name (NULL = default) */
+    char *hugepages;                 /* Metadata on huge pages: off, thp or hugetlb (NULL = off) */
+    unsigned int prefetch;           /* Prefetch child nodes and names on lookups and readdir */
+    unsigned int rebalance_ms;       /* Time between compaction steps (0 = off) */
+    unsigned int memory_mb;          /* Metadata + file data budget (0 = unlimited) */
+    char *tier_dir;                  /* Offload cold files into this directory (NULL = off) */
+    const struct tier_backend *tier_backend; /* ... or to this store (e.g. S3) */
+    unsigned int tier_cold_s;        /* Idle time before a file is offloaded */
+    char *tier_cache_dir;            /* Local read cache of offloaded files */
+    unsigned int tier_cache_mb;      /* Read cache size */
+    unsigned int dedup;              /* Store identical chunks once in the data log */
+    char *durability;                /* sync, periodic or fsync-only (NULL = periodic) */
+    char *wal_dirs;                  /* Stripe WAL segments over these directories (a:b:...) */
+    unsigned int wal_segments;       /* WAL segment files (0 = one log file) */
+    unsigned int wal_segment_mb;     /* Size of each WAL segment */
+    unsigned int wal_data;           /* Log write payloads; file data written back lazily */
+    char *io_engine;                 /* Persistence I/O: psync or uring (NULL = psync) */
+    char *metrics;                   /* Recording: off, ops or full (NULL = ops) */
+};
+
+#define FS_CORE_OPTIONS_DEFAULT {                        \
+    .compress_threads = COMPRESS_POOL_DEFAULT_THREADS,  \
+    .compress_idle_ms = COMPRESS_POOL_DEFAULT_IDLE_MS,  \
+    .writeback_ms = WRITEBACK_DEFAULT_INTERVAL_MS,      \
+    .kernel_cache = 0,                                  \
+    .cache_timeout = FS_CORE_CACHE_TIMEOUT,             \
+    .io_size = FS_CORE_IO_SIZE,                         \
+    .numa_policy = NULL,                                \
+    .hugepages = NULL,                                  \
+    .prefetch = 1,                                      \
+    .rebalance_ms = REBALANCER_DEFAULT_INTERVAL_MS,     \
+    .memory_mb = 0,                                     \
+    .tier_dir = NULL,                                   \
+    .tier_backend = NULL,                               \
+    .tier_cold_s = TIER_DEFAULT_COLD_S,                 \
+    .tier_cache_dir = NULL,                             \
+    .tier_cache_mb = TIER_DEFAULT_CACHE_MB,             \
+    .dedup = 0,                                         \
+    .durability = NULL,                                 \
+    .wal_dirs = NULL,                                   \
+    .wal_segments = 0,                                  \
+    .wal_segment_mb = WAL_SEGMENT_DEFAULT_SIZE >> 20,   \
+    .wal_data = 0,                                      \
+    .io_engine = NULL,                                  \
+    .metrics = NULL,                                    \
+}
+
+/**
+ * In-memory contents of one file
+ *
+ * Entries are never freed while the filesystem is up: a removed entry
+ * goes to its shard's free list and may be reused for another inode.
+ * Holders of a pointer therefore always see valid memory, and recheck
+ * is_active/inode under data_lock before trusting the contents.
+ */
+struct fs_file_data {
+    uint32_t inode;
+    int is_active;               /* Flag to indicate if entry is in use */
+    pthread_rwlock_t data_lock;  /* Per-file lock */
+    pthread_mutex_t flush_lock;  /* Serializes write-back of this file */
+    int referenced;              /* Accessed since the reclaim hand last
+                                    passed (__atomic) */
+    uint32_t last_access;        /* Seconds since the epoch (__atomic) */
+    int wb_error;                /* Background write-back failed since the
+                                    last flush/fsync (__atomic) */
+    struct extent_store extents; /* File contents as 64KB chunks */
+    struct fs_file_data *next;   /* Hash chain while active, free list after */
+};
+
+/**
+ * One part of the inode -> file data table
+ * Inode N lives in shard N % FS_CORE_FILE_SHARDS, so creates, deletes and
+ * lookups of different files rarely meet on the same lock.
+ */
+struct fs_file_shard {
+    pthread_rwlock_t lock;                              /* Buckets and free list */
+    struct fs_file_data *buckets[FS_CORE_FILE_BUCKETS];
+    struct fs_file_data *free_list;                     /* Removed entries to reuse */
+    uint32_t active;                                    /* Entries in the buckets */
+} __attribute__((aligned(64)));
+
+/**
+ * Filesystem state
+ */
+struct fs_core {
+    struct nary_tree_mt tree;
+    struct wal wal;                  /* Write-Ahead Log for crash recovery */
+    int wal_enabled;                 /* WAL enabled flag */
+    struct compress_pool compressor; /* Background file compression */
+    struct writeback writeback;      /* Background file data write-back */
+    struct rebalancer rebalancer;    /* Background tree compaction */
+
+    /* File contents by inode (sharded, stable addresses) */
+    struct fs_file_shard file_shards[FS_CORE_FILE_SHARDS];
+
+    /* Memory budget (see fs_core_reclaim) */
+    uint64_t memory_limit;           /* Metadata + file data (0 = unlimited) */
+    uint64_t file_budget;            /* What the tree leaves of it for file data */
+    uint64_t file_bytes;             /* File data held in memory (__atomic) */
+    uint64_t evicted_bytes;          /* Dropped by reclaim so far (__atomic) */
+    pthread_mutex_t reclaim_lock;    /* One sweep at a time */
+    uint32_t reclaim_hand;           /* Next file table bucket to sweep */
+
+    /* Cold file offload (see tiering.h) */
+    struct tier tier;
+    int tier_enabled;
+
+    enum fs_durability durability;
+
+    /* Write payloads in the WAL (-o wal_data): recovery rebuilds file data
+     * from the log, so it is written back lazily even on sync mounts */
+    int wal_data;
+    pthread_rwlock_t wal_gate;       /* Shared from a payload append until its data
+                                        is marked dirty; a checkpoint takes it */
+
+    /* Extended attributes of all nodes (see xattr.h) */
+    struct xattr_store xattrs;
+
+    /* Point-in-time copies of the tree and file data (see snapshot.h) */
+    struct snapshot_set snapshots;
+
+    /* The front end's path cache, shown in FS_CORE_STATS_DIR (NULL = none) */
+    struct path_cache *dcache;
+};
+
+/**
+ * Open directory: where the last readdir call stopped
+ * Listing offsets are positions: 0 = ".", 1 = "..", then the children in
+ * name order. A call continuing at next_off resumes the saved iterator if
+ * the directory (version) and node placement (paths_gen) are unchanged;
+ * any other call walks past the first `off` entries again. A directory
+ * in a snapshot never changes: its children are fetched once, at open.
+ */
+struct fs_dir_cursor {
+    uint32_t dir_idx;
+    off_t next_off;              /* Offset the iterator stands at (-1 = none) */
+    uint32_t version;            /* nary_node_version_mt() of the directory */
+    uint64_t paths_gen;          /* nary_paths_generation_mt() */
+    struct nary_child_iter it;
+    uint32_t snapshot;           /* Snapshot listed (0 = the live tree) */
+    uint32_t *snap_children;     /* Its children, in name order */
+    uint32_t snap_count;
+};
+
+/**
+ * Add one directory entry to a reply
+ * @param node The entry's node (the directory itself for "." and for ".."
+ *             of the root)
+ * @param next_off Offset of the entry after this one
+ * @return 1 if added, 0 once the reply is full (the entry is not consumed)
+ */
+typedef int (*fs_core_dirent_fn)(void *ctx, const char *name, const struct nary_node *node,
+                                 off_t next_off);
+
+/* === Lifecycle === */
+
+/**
+ * Open the persistent filesystem
+ *
+ * Opens the WAL (running without it if that fails), maps the disk-backed
+ * tree, replays the log if the last shutdown was unclean and initializes
+ * the file table. No threads are started (see fs_core_start).
+ *
+ * @param fs Zeroed state
+ * @param wal_path Log file (the header of a segmented log)
+ * @param opts Log layout (wal_dirs, wal_segments; NULL = one log file)
+ * @return 0 on success, -1 if the tree cannot be opened
+ */
+int fs_core_open(struct fs_core *fs, const char *wal_path,
+                 const struct fs_core_options *opts);
+
+/**
+ * Detect NUMA nodes and select the placement policy and huge page mode
+ * for everything allocated from now on (call before fs_core_open)
+ * @return 0 on success, -1 if the policy or huge page mode is unknown
+ */
+int fs_core_set_placement(const struct fs_core_options *opts);
+
+/**
+ * Initialize the file table over an already set up tree
+ * (fs_core_open does this; for in-memory trees)
+ */
+int fs_core_init(struct fs_core *fs);
+
+/**
+ * Start the write-back flusher, compression workers, tree compaction and
+ * cold file offload
+ * Must run after FUSE has daemonized (from the init callback).
+ */
+void fs_core_start(struct fs_core *fs, const struct fs_core_options *opts);
+
+/**
+ * Stop the workers, write back everything, checkpoint the WAL and
+ * release the tree (persistent trees are detached, not destroyed)
+ */
+void fs_core_close(struct fs_core *fs);
+
+/* === File Contents === */
+
+/**
+ * File contents of an inode, or NULL if it has none in memory
+ */
+struct fs_file_data *fs_core_find_file(struct fs_core *fs, uint32_t inode);
+
+/**
+ * Write back the dirty chunks of one file
+ * @return 0 on success or if nothing was dirty, -1 on I/O error
+ */
+int fs_core_flush_file(struct fs_core *fs, uint32_t inode);
+
+/**
+ * Bring file data back under the memory budget
+ * A CLOCK sweep over the file table: files accessed since the hand last
+ * passed get another lap, the others drop their clean chunks (already in
+ * the data log; they are faulted back in on access). Dirty chunks stay
+ * until written back. Runs on the calling thread; a no-op without a
+ * budget or while another thread is sweeping.
+ */
+void fs_core_reclaim(struct fs_core *fs);
+
+/**
+ * Persist the string table (names of new entries)
+ */
+void fs_core_sync_strings(struct fs_core *fs);
+
+/* === Operations on Resolved Nodes === */
+
+/**
+ * Fill a stat buffer from a node
+ */
+void fs_core_stat(const struct nary_node *node, struct stat *stbuf);
+
+/**
+ * Attributes of a node
+ */
+int fs_core_getattr(struct fs_core *fs, uint32_t idx, struct stat *stbuf);
+
+/**
+ * Create a directory (logged to the WAL)
+ * @param out Optional copy of the new node
+ */
+int fs_core_mkdir(struct fs_core *fs, uint32_t parent_idx, const char *name,
+                  mode_t mode, struct nary_node *out);
+
+/**
+ * Create an empty regular file with its data storage
+ * @param out Optional copy of the new node
+ */
+int fs_core_create(struct fs_core *fs, uint32_t parent_idx, const char *name,
+                   mode_t mode, struct nary_node *out);
+
+/**
+ * Create many files and directories in one directory (see
+ * nary_insert_batch_mt): one WAL transaction and one string table sync
+ * for the whole batch. Files get their data storage on first write.
+ *
+ * @param entries Names and modes (S_IFREG or S_IFDIR); idx is filled in
+ * @return 0 (all created) or -errno (none created)
+ */
+int fs_core_create_batch(struct fs_core *fs, uint32_t parent_idx,
+                         struct nary_batch_entry *entries, uint32_t count);
+
+/**
+ * Run FS_CORE_IOC_CREATE_BATCH on directory dir_idx
+ * @return 0 or -errno (-EINVAL for a malformed buffer)
+ */
+int fs_core_ioctl_create_batch(struct fs_core *fs, uint32_t dir_idx,
+                               struct fs_core_batch_ioctl *req);
+
+/**
+ * Remove an empty directory
+ */
+int fs_core_rmdir(struct fs_core *fs, uint32_t idx);
+
+/**
+ * Remove a regular file and its contents
+ */
+int fs_core_unlink(struct fs_core *fs, uint32_t idx);
+
+/**
+ * Open a regular file, restoring its contents from disk if needed
+ * @param fh_out File handle for read/write/release/fsync (the inode)
+ */
+int fs_core_open_file(struct fs_core *fs, uint32_t idx, uint64_t *fh_out);
+
+/**
+ * Read from an open file (holes read as zeros)
+ * @return Bytes read or -errno
+ */
+ssize_t fs_core_read(struct fs_core *fs, uint64_t fh, char *buf, size_t size, off_t offset);
+
+/**
+ * Open file data pinned for a zero-copy reply
+ */
+struct fs_read_pin {
+    struct fs_file_data *fd;     /* Read-locked until unpinned (NULL = none) */
+    struct extent_view view;     /* Segments to send */
+};
+
+/**
+ * Pin a range of an open file for sending without copying
+ *
+ * On success the file stays read-locked (writers wait) until
+ * fs_core_read_unpin(), so send the reply right away.
+ *
+ * @return Bytes viewed, or -errno with nothing pinned (-E2BIG: range too
+ *         large for one view, use fs_core_read)
+ */
+ssize_t fs_core_read_pin(struct fs_core *fs, uint64_t fh, size_t size, off_t offset,
+                         struct fs_read_pin *pin);
+
+/**
+ * Release a pinned range
+ */
+void fs_core_read_unpin(struct fs_read_pin *pin);
+
+/**
+ * Write to an open file and update the node size
+ * @return Bytes written or -errno
+ */
+ssize_t fs_core_write(struct fs_core *fs, uint32_t idx, uint64_t fh,
+                      const char *buf, size_t size, off_t offset);
+
+/**
+ * Last close of an open file: compress or write back in the background
+ */
+void fs_core_release(struct fs_core *fs, uint64_t fh);
+
+/**
+ * Make an open file durable: flush the WAL (metadata up to now), write
+ * the file's dirty data and sync the data log
+ * @return 0 or -EIO (also for an earlier failed background write-back)
+ */
+int fs_core_fsync(struct fs_core *fs, uint64_t fh);
+
+/**
+ * close() of an open file descriptor: report a failed background
+ * write-back of the file without forcing anything to disk
+ * @return 0 or -EIO
+ */
+int fs_core_flush(struct fs_core *fs, uint64_t fh);
+
+/**
+ * Make directory changes durable (flushes the WAL)
+ * @return 0 or -EIO
+ */
+int fs_core_fsyncdir(struct fs_core *fs);
+
+/**
+ * Open a directory for listing
+ * @param dh_out Handle for readdir/releasedir (the cursor)
+ * @return 0 or -errno
+ */
+int fs_core_opendir(struct fs_core *fs, uint32_t idx, uint64_t *dh_out);
+
+/**
+ * List a directory from offset `off` until `fill` reports the reply full
+ * Entries carry their whole node, so attributes (readdirplus) cost no
+ * extra lookup.
+ *
+ * @param dh Handle from fs_core_opendir(), or 0 (no cursor: every call
+ *           walks from the first child)
+ * @return 0 or -errno
+ */
+int fs_core_readdir(struct fs_core *fs, uint32_t idx, uint64_t dh, off_t off,
+                    fs_core_dirent_fn fill, void *ctx);
+
+/**
+ * Close a directory opened with fs_core_opendir()
+ */
+void fs_core_releasedir(struct fs_core *fs, uint64_t dh);
+
+/**
+ * Change a regular file's size
+ */
+int fs_core_truncate(struct fs_core *fs, uint32_t idx, off_t size);
+
+/**
+ * Allocate or deallocate a range of a regular file
+ * Mode 0 / FALLOC_FL_KEEP_SIZE reserve nothing (chunks are allocated when
+ * written) and only extend the size if asked to; FALLOC_FL_PUNCH_HOLE |
+ * FALLOC_FL_KEEP_SIZE turns the range into a hole.
+ *
+ * @return 0 or -errno (-EOPNOTSUPP for other modes)
+ */
+int fs_core_fallocate(struct fs_core *fs, uint32_t idx, int mode, off_t offset, off_t length);
+
+/**
+ * SEEK_DATA / SEEK_HOLE in an open file
+ * @return Resulting offset or -errno (-ENXIO at or past EOF)
+ */
+off_t fs_core_lseek(struct fs_core *fs, uint64_t fh, off_t offset, int whence);
+
+/**
+ * Change permission bits (file type is kept)
+ */
+int fs_core_chmod(struct fs_core *fs, uint32_t idx, mode_t mode);
+
+/**
+ * Set the modification time (tv[1]; NULL = now)
+ */
+int fs_core_utimens(struct fs_core *fs, uint32_t idx, const struct timespec tv[2]);
+
+/**
+ * Rename or move a node (see nary_rename_mt)
+ * An existing target is replaced atomically (its file data dropped),
+ * unless RENAME_NOREPLACE; RENAME_EXCHANGE swaps the two.
+ *
+ * @param parent_idx Directory holding the source
+ * @param from_idx Source node
+ * @param new_parent_idx Target directory (any directory)
+ * @param to_name New name
+ * @param flags RENAME_NOREPLACE or RENAME_EXCHANGE
+ * @return 0 or -errno as rename(2)
+ */
+int fs_core_rename(struct fs_core *fs, uint32_t parent_idx, uint32_t from_idx,
+                   uint32_t new_parent_idx, const char *to_name, unsigned int flags);
+
+/* === Snapshots === */
+
+/**
+ * Take a snapshot of the whole filesystem, named `name` under
+ * FS_CORE_SNAPSHOT_DIR
+ *
+ * Writers are not stopped: from now on they save a node or a 64KB chunk
+ * the first time they change it, so a snapshot costs what changed since.
+ * Each operation is in a snapshot or not, but data and size written by
+ * one call are not taken together (as after a crash).
+ *
+ * @return 0, -EINVAL (bad name), -ENAMETOOLONG, -EEXIST, -ENOSPC (too
+ *         many snapshots) or -ENOMEM
+ */
+int fs_core_snapshot_create(struct fs_core *fs, const char *name);
+
+/**
+ * Drop a snapshot; open files in it read as -ESTALE from then on
+ * @return 0 or -ENOENT
+ */
+int fs_core_snapshot_delete(struct fs_core *fs, const char *name);
+
+/**
+ * Snapshot id by name
+ * @return The id, or 0 if there is no such snapshot
+ */
+uint32_t fs_core_snapshot_find(struct fs_core *fs, const char *name);
+
+/**
+ * The FS_CORE_SNAPSHOT_DIR directory itself (not a tree node)
+ */
+void fs_core_snapshot_dir_node(struct fs_core *fs, struct nary_node *out);
+
+/**
+ * List FS_CORE_SNAPSHOT_DIR: ".", ".." and each snapshot, oldest first,
+ * as its root directory
+ * @return 0 or -errno
+ */
+int fs_core_snapshot_list(struct fs_core *fs, off_t off, fs_core_dirent_fn fill, void *ctx);
+
+/**
+ * A node as it was in snapshot id, read-only (write bits cleared)
+ * @return 0 or -ENOENT
+ */
+int fs_core_snapshot_node(struct fs_core *fs, uint32_t id, uint32_t idx,
+                          struct nary_node *out);
+
+/**
+ * Look up a name in a directory of snapshot id
+ * @return 0 or -ENOENT / -ENOTDIR
+ */
+int fs_core_snapshot_lookup(struct fs_core *fs, uint32_t id, uint32_t dir_idx,
+                            const char *name, uint32_t *idx_out, struct nary_node *out);
+
+/**
+ * Open a regular file of snapshot id for reading
+ * @param flags open(2) flags
+ * @param fh_out FS_CORE_SNAPSHOT_FH(id, idx), for fs_core_read and the
+ *               other handle operations (which do nothing for it)
+ * @return 0, -EROFS (opened for writing), -EISDIR or -ENOENT
+ */
+int fs_core_snapshot_open(struct fs_core *fs, uint32_t id, uint32_t idx, int flags,
+                          uint64_t *fh_out);
+
+/**
+ * List a directory of snapshot id like fs_core_readdir()
+ * @param dh Handle from fs_core_snapshot_opendir(), or 0
+ * @return 0 or -errno
+ */
+int fs_core_snapshot_readdir(struct fs_core *fs, uint32_t id, uint32_t idx, uint64_t dh,
+                             off_t off, fs_core_dirent_fn fill, void *ctx);
+
+/**
+ * Open a directory of snapshot id for listing (close with
+ * fs_core_releasedir)
+ * @return 0 or -ENOENT / -ENOTDIR / -ENOMEM
+ */
+int fs_core_snapshot_opendir(struct fs_core *fs, uint32_t id, uint32_t idx, uint64_t *dh_out);
+
+/* === Runtime Statistics === */
+
+/**
+ * Statistics file by name
+ * @return The file, or FS_CORE_STATS_ROOT if there is no such file
+ */
+enum fs_core_stats_file fs_core_stats_find(const char *name);
+
+/**
+ * The FS_CORE_STATS_DIR directory (FS_CORE_STATS_ROOT) or one of its
+ * files, read-only; files show size 0 (read them to the end)
+ * @return 0 or -ENOENT
+ */
+int fs_core_stats_node(struct fs_core *fs, enum fs_core_stats_file file, struct nary_node *out);
+
+/**
+ * List FS_CORE_STATS_DIR: ".", ".." and the files
+ * @return 0 or -EINVAL
+ */
+int fs_core_stats_list(struct fs_core *fs, off_t off, fs_core_dirent_fn fill, void *ctx);
+
+/**
+ * Open a statistics file: renders its contents once, so reads of the
+ * handle see one consistent report
+ * @param fh_out FS_CORE_STATS_FH(...), for fs_core_read, fs_core_lseek
+ *               and fs_core_release (the other handle operations do
+ *               nothing for it, or fail with -EROFS)
+ * @return 0, -EROFS (opened for writing), -EISDIR, -ENOENT or -ENOMEM
+ */
+int fs_core_stats_open(struct fs_core *fs, enum fs_core_stats_file file, int flags,
+                       uint64_t *fh_out);
+
+/**
+ * Write the contents of a statistics file
+ * FS_CORE_STATS_TEXT: metrics_write_text() and the component counters
+ * (tree, caches, compression, WAL, write-back, tiering); the Prometheus
+ * file carries the same as razorfs_* samples.
+ */
+void fs_core_stats_report(struct fs_core *fs, enum fs_core_stats_file file, FILE *out);
+
+/* === Extended attributes === */
+
+/**
+ * Read an extended attribute (size 0 asks for its size)
+ * A node without attributes answers from its own copy, without the arena.
+ * @return Value size, -ENODATA, -ERANGE or -EIO
+ */
+int fs_core_getxattr(struct fs_core *fs, uint32_t idx, const char *name,
+                     char *value, size_t size);
+
+/**
+ * Set an extended attribute (saved to disk before returning)
+ * @param flags XATTR_CREATE or XATTR_REPLACE
+ * @return 0, -EEXIST, -ENODATA, -ERANGE, -ENOSPC or -EIO
+ */
+int fs_core_setxattr(struct fs_core *fs, uint32_t idx, const char *name,
+                     const char *value, size_t size, int flags);
+
+/**
+ * List extended attribute names (size 0 asks for the list size)
+ * @return List size, -ERANGE or -EIO
+ */
+int fs_core_listxattr(struct fs_core *fs, uint32_t idx, char *list, size_t size);
+
+/**
+ * Remove an extended attribute
+ * @return 0, -ENODATA or -EIO
+ */
+int fs_core_removexattr(struct fs_core *fs, uint32_t idx, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_FS_CORE_H */
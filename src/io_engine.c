@@ -0,0 +1,448 @@
+/**
+ * Persistence I/O Engine Implementation - RAZORFS Data and WAL I/O
+ *
+ * The io_uring backend talks to the kernel directly (io_uring_setup,
+ * io_uring_enter, io_uring_register): one SQ/CQ ring pair per engine,
+ * filled and reaped by the owning thread only.
+ */
+
+#define _GNU_SOURCE
+#include "io_engine.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define IO_ENGINE_OP_WRITE  0
+#define IO_ENGINE_OP_FSYNC  1
+
+/* Largest write one SQE carries (that of pwrite); the rest is resumed */
+#define IO_ENGINE_MAX_RW    0x7ffff000u
+
+/* Completion result of an op the kernel has not completed yet */
+#define IO_ENGINE_PENDING   INT32_MIN
+
+/* === Synchronous ops (psync backend and resumed ops) === */
+
+static int pwrite_all(int fd, const void *buf, size_t len, uint64_t offset) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 0;
+}
+
+static int run_op(const struct io_engine_op *op) {
+    if (op->opcode == IO_ENGINE_OP_FSYNC) {
+        return fdatasync(op->fd);
+    }
+    return pwrite_all(op->fd, op->buf, (size_t)op->len, op->offset);
+}
+
+/* === Ring setup === */
+
+static void ring_release(struct io_engine *io) {
+    if (io->sqes) munmap(io->sqes, io->sqes_len);
+    if (io->cq_map && io->cq_map != io->sq_map) munmap(io->cq_map, io->cq_map_len);
+    if (io->sq_map) munmap(io->sq_map, io->sq_map_len);
+    if (io->ring_fd >= 0) close(io->ring_fd);  /* Drops the registrations */
+
+    io->sqes = io->sq_map = io->cq_map = NULL;
+    io->ring_fd = -1;
+    io->files_registered = 0;
+    io->buffer = NULL;
+    io->buffer_len = 0;
+    for (unsigned int i = 0; i < IO_ENGINE_MAX_FILES; i++) {
+        io->files[i] = -1;
+    }
+}
+
+static int ring_setup(struct io_engine *io) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, io->depth, &p);
+    if (fd < 0) return -1;
+    io->ring_fd = fd;
+
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_len > sq_len) sq_len = cq_len;
+
+    void *sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        ring_release(io);
+        return -1;
+    }
+    io->sq_map = sq;
+    io->sq_map_len = sq_len;
+
+    void *cq = sq;
+    if (!single) {
+        cq = mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            ring_release(io);
+            return -1;
+        }
+        io->cq_map_len = cq_len;
+    }
+    io->cq_map = cq;
+
+    size_t sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        ring_release(io);
+        return -1;
+    }
+    io->sqes = sqes;
+    io->sqes_len = sqes_len;
+
+    io->sq_head = (unsigned int *)((char *)sq + p.sq_off.head);
+    io->sq_tail = (unsigned int *)((char *)sq + p.sq_off.tail);
+    io->sq_mask = (unsigned int *)((char *)sq + p.sq_off.ring_mask);
+    io->sq_array = (unsigned int *)((char *)sq + p.sq_off.array);
+    io->cq_head = (unsigned int *)((char *)cq + p.cq_off.head);
+    io->cq_tail = (unsigned int *)((char *)cq + p.cq_off.tail);
+    io->cq_mask = (unsigned int *)((char *)cq + p.cq_off.ring_mask);
+    io->cqes = (char *)cq + p.cq_off.cqes;
+
+    /* Sparse file table, filled slot by slot as files are registered;
+     * without one, ops simply name their fd */
+    int table[IO_ENGINE_MAX_FILES];
+    for (unsigned int i = 0; i < IO_ENGINE_MAX_FILES; i++) {
+        table[i] = -1;
+    }
+    io->files_registered = syscall(__NR_io_uring_register, fd, IORING_REGISTER_FILES,
+                                   table, IO_ENGINE_MAX_FILES) == 0;
+    return 0;
+}
+
+/* === Registration === */
+
+static int file_slot(const struct io_engine *io, int fd) {
+    for (unsigned int i = 0; i < IO_ENGINE_MAX_FILES; i++) {
+        if (io->files[i] == fd) return (int)i;
+    }
+    return -1;
+}
+
+static int update_file(struct io_engine *io, int slot, int fd) {
+    struct io_uring_files_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = (uint32_t)slot;
+    up.fds = (uint64_t)(uintptr_t)&fd;
+    return syscall(__NR_io_uring_register, io->ring_fd, IORING_REGISTER_FILES_UPDATE,
+                   &up, 1) == 1 ? 0 : -1;
+}
+
+int io_engine_register_file(struct io_engine *io, int fd) {
+    if (!io || fd < 0) return -1;
+    if (io->kind != IO_ENGINE_URING || !io->files_registered) return -1;
+    if (file_slot(io, fd) >= 0) return 0;
+
+    int slot = file_slot(io, -1);
+    if (slot < 0 || update_file(io, slot, fd) != 0) return -1;
+    io->files[slot] = fd;
+    return 0;
+}
+
+void io_engine_unregister_file(struct io_engine *io, int fd) {
+    if (!io || fd < 0 || io->kind != IO_ENGINE_URING) return;
+
+    int slot = file_slot(io, fd);
+    if (slot < 0) return;
+    /* Queued ops look their slot up at submission, so they fall back to
+     * the plain fd */
+    update_file(io, slot, -1);
+    io->files[slot] = -1;
+}
+
+int io_engine_register_buffer(struct io_engine *io, void *buf, size_t len) {
+    if (!io || io->kind != IO_ENGINE_URING) return -1;
+
+    if (io->buffer) {
+        syscall(__NR_io_uring_register, io->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        io->buffer = NULL;
+        io->buffer_len = 0;
+    }
+    if (!buf || len == 0) return 0;
+
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    if (syscall(__NR_io_uring_register, io->ring_fd, IORING_REGISTER_BUFFERS, &iov, 1) != 0) {
+        return -1;  /* e.g. over RLIMIT_MEMLOCK */
+    }
+    io->buffer = buf;
+    io->buffer_len = len;
+    return 0;
+}
+
+/* === Submission === */
+
+static void fill_sqe(struct io_engine *io, struct io_uring_sqe *sqe,
+                     const struct io_engine_op *op, int link) {
+    memset(sqe, 0, sizeof(*sqe));
+
+    int slot = io->files_registered ? file_slot(io, op->fd) : -1;
+    if (slot >= 0) {
+        sqe->fd = slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+        io->stats.fixed_files++;
+    } else {
+        sqe->fd = op->fd;
+    }
+
+    if (op->opcode == IO_ENGINE_OP_FSYNC) {
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        return;
+    }
+
+    const char *src = op->buf;
+    sqe->addr = (uint64_t)(uintptr_t)src;
+    sqe->len = op->len < IO_ENGINE_MAX_RW ? (uint32_t)op->len : IO_ENGINE_MAX_RW;
+    sqe->off = op->offset;
+    if (io->buffer && src >= io->buffer && src + op->len <= io->buffer + io->buffer_len) {
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->buf_index = 0;
+        io->stats.fixed_buffers++;
+    } else {
+        sqe->opcode = IORING_OP_WRITE;
+    }
+    if (link) sqe->flags |= IOSQE_IO_LINK;
+}
+
+/* Move completions into the ops they belong to */
+static unsigned int reap(struct io_engine *io) {
+    const struct io_uring_cqe *cqes = io->cqes;
+    unsigned int head = *io->cq_head;
+    unsigned int tail = __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE);
+    unsigned int n = 0;
+
+    while (head != tail) {
+        const struct io_uring_cqe *cqe = &cqes[head & *io->cq_mask];
+        if (cqe->user_data < io->queued) {
+            io->ops[cqe->user_data].res = cqe->res;
+            n++;
+        }
+        head++;
+    }
+    __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/* Hand the batch to the kernel and wait for every completion
+ * @return 0, or -1 if the ring itself failed (nothing was submitted) */
+static int ring_run(struct io_engine *io) {
+    unsigned int n = io->queued;
+    unsigned int tail = *io->sq_tail;
+    struct io_uring_sqe *sqes = io->sqes;
+
+    for (unsigned int i = 0; i < n; i++) {
+        struct io_engine_op *op = &io->ops[i];
+        unsigned int idx = (tail + i) & *io->sq_mask;
+        /* Writes link to the next op; an fsync closes its chain */
+        fill_sqe(io, &sqes[idx], op, op->opcode == IO_ENGINE_OP_WRITE && i + 1 < n);
+        sqes[idx].user_data = i;
+        io->sq_array[idx] = idx;
+        op->res = IO_ENGINE_PENDING;
+    }
+    __atomic_store_n(io->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+    unsigned int submitted = 0, completed = 0;
+    while (completed < n) {
+        int ret = (int)syscall(__NR_io_uring_enter, io->ring_fd, n - submitted,
+                               n - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                completed += reap(io);
+                continue;
+            }
+            if (submitted == 0 && completed == 0) {
+                __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+                return -1;
+            }
+            /* Some ops are in flight: they must finish before their
+             * buffers are reused, so keep waiting */
+            completed += reap(io);
+            continue;
+        }
+        submitted += (unsigned int)ret;
+        completed += reap(io);
+    }
+    return 0;
+}
+
+/* Check completions in queue order: finish short writes, redo ops the
+ * kernel cancelled because of them, stop at the first real failure */
+static int finish_batch(struct io_engine *io) {
+    for (unsigned int i = 0; i < io->queued; i++) {
+        struct io_engine_op *op = &io->ops[i];
+        int32_t res = op->res;
+
+        if (op->opcode == IO_ENGINE_OP_WRITE ? res >= 0 && (uint64_t)res == op->len
+                                             : res == 0) {
+            io->stats.ops++;
+            continue;
+        }
+
+        if (res >= 0 || res == -ECANCELED || res == -EINTR || res == -EAGAIN) {
+            struct io_engine_op rest = *op;
+            if (op->opcode == IO_ENGINE_OP_WRITE && res > 0) {
+                rest.buf = (const char *)op->buf + res;
+                rest.len -= (uint64_t)res;
+                rest.offset += (uint64_t)res;
+            }
+            if (run_op(&rest) != 0) return errno ? errno : EIO;
+            io->stats.resumed++;
+            io->stats.ops++;
+            continue;
+        }
+        return -res;
+    }
+    return 0;
+}
+
+/* Complete the queued ops; a failure is kept in io->error */
+static void run_batch(struct io_engine *io) {
+    int err = 0;
+
+    if (ring_run(io) == 0) {
+        err = finish_batch(io);
+    } else {
+        /* The ring is unusable: from now on run everything here */
+        ring_release(io);
+        io->kind = IO_ENGINE_PSYNC;
+        for (unsigned int i = 0; i < io->queued && err == 0; i++) {
+            if (run_op(&io->ops[i]) != 0) err = errno ? errno : EIO;
+            else io->stats.ops++;
+        }
+    }
+
+    io->queued = 0;
+    if (err && !io->error) io->error = err;
+}
+
+static int queue_op(struct io_engine *io, uint8_t opcode, int fd, const void *buf,
+                    uint64_t len, uint64_t offset) {
+    if (!io || fd < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (io->error) {
+        errno = io->error;
+        return -1;
+    }
+
+    struct io_engine_op op = {
+        .opcode = opcode, .fd = fd, .buf = buf, .len = len, .offset = offset,
+        .res = IO_ENGINE_PENDING,
+    };
+    if (io->kind == IO_ENGINE_PSYNC) {
+        if (run_op(&op) != 0) {
+            io->error = errno ? errno : EIO;
+            return -1;
+        }
+        io->stats.ops++;
+        return 0;
+    }
+
+    /* A full queue goes out first; the order is kept since it completes
+     * before the next op is issued */
+    if (io->queued == io->depth) {
+        run_batch(io);
+        if (io->error) {
+            errno = io->error;
+            return -1;
+        }
+    }
+    io->ops[io->queued++] = op;
+    return 0;
+}
+
+/* === Public API === */
+
+int io_engine_init(struct io_engine *io, enum io_engine_kind kind, unsigned int depth) {
+    if (!io) return -1;
+
+    memset(io, 0, sizeof(*io));
+    io->ring_fd = -1;
+    io->depth = depth ? depth : IO_ENGINE_DEFAULT_DEPTH;
+    for (unsigned int i = 0; i < IO_ENGINE_MAX_FILES; i++) {
+        io->files[i] = -1;
+    }
+    io->ops = calloc(io->depth, sizeof(*io->ops));
+    if (!io->ops) return -1;
+
+    io->kind = IO_ENGINE_PSYNC;
+    if (kind == IO_ENGINE_URING && ring_setup(io) == 0) {
+        io->kind = IO_ENGINE_URING;
+    }
+    return 0;
+}
+
+void io_engine_destroy(struct io_engine *io) {
+    if (!io || !io->ops) return;
+
+    if (io->queued) run_batch(io);
+    ring_release(io);
+    free(io->ops);
+    memset(io, 0, sizeof(*io));
+    io->ring_fd = -1;
+}
+
+const char *io_engine_name(enum io_engine_kind kind) {
+    return kind == IO_ENGINE_URING ? "uring" : "psync";
+}
+
+int io_engine_parse(const char *name, enum io_engine_kind *kind) {
+    if (!name || !kind) return -1;
+
+    if (strcmp(name, "uring") == 0 || strcmp(name, "io_uring") == 0) {
+        *kind = IO_ENGINE_URING;
+    } else if (strcmp(name, "psync") == 0 || strcmp(name, "mmap") == 0) {
+        *kind = IO_ENGINE_PSYNC;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+int io_engine_write(struct io_engine *io, int fd, const void *buf, size_t len,
+                    uint64_t offset) {
+    if (len == 0) return io && io->error ? -1 : 0;
+    return queue_op(io, IO_ENGINE_OP_WRITE, fd, buf, len, offset);
+}
+
+int io_engine_fsync(struct io_engine *io, int fd) {
+    return queue_op(io, IO_ENGINE_OP_FSYNC, fd, NULL, 0, 0);
+}
+
+int io_engine_submit(struct io_engine *io) {
+    if (!io) return -1;
+
+    if (io->queued) run_batch(io);
+    io->stats.submits++;
+
+    int err = io->error;
+    io->error = 0;
+    if (err) {
+        io->stats.failed++;
+        errno = err;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * Persistence I/O Engine - RAZORFS Data and WAL I/O
+ *
+ * Writes and fdatasyncs of the persistence layer are queued on an engine
+ * and completed together by io_engine_submit():
+ * - IO_ENGINE_PSYNC runs each one at once with pwrite/fdatasync (the
+ *   classic path, always available)
+ * - IO_ENGINE_URING queues them as io_uring SQEs and submits the whole
+ *   batch with one system call. Registered files and a registered buffer
+ *   are used when the fd / source memory is one of them.
+ *
+ * Ordering: a write is linked to the op queued after it, so a chain of
+ * writes ending in an fsync completes in order and the fsync covers them.
+ * An fsync closes its chain: ops queued after it may run concurrently
+ * with it (several fsyncs in a row run in parallel). Submit in between
+ * when a later write must wait for an fsync.
+ *
+ * After a failure the rest of the batch is skipped and the next
+ * io_engine_submit() reports it. An engine is not thread-safe: each user
+ * owns one and serializes its batches.
+ */
+
+#ifndef RAZORFS_IO_ENGINE_H
+#define RAZORFS_IO_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults */
+#define IO_ENGINE_DEFAULT_DEPTH  64     /* Ops per submission */
+#define IO_ENGINE_MAX_FILES      80     /* Registered file slots */
+
+enum io_engine_kind {
+    IO_ENGINE_PSYNC = 0,         /* pwrite + fdatasync on the calling thread */
+    IO_ENGINE_URING = 1,         /* Batched io_uring submission */
+};
+
+/**
+ * Engine statistics
+ */
+struct io_engine_stats {
+    uint64_t submits;            /* Batches completed */
+    uint64_t ops;                /* Writes and fsyncs executed */
+    uint64_t fixed_files;        /* ... through a registered file */
+    uint64_t fixed_buffers;      /* Writes from the registered buffer */
+    uint64_t resumed;            /* Short or cancelled ops finished with pwrite */
+    uint64_t failed;             /* Batches that reported an error */
+};
+
+/**
+ * One queued op
+ */
+struct io_engine_op {
+    uint8_t opcode;              /* IO_ENGINE_OP_* (io_engine.c) */
+    int fd;
+    const void *buf;
+    uint64_t len;
+    uint64_t offset;
+    int32_t res;                 /* Completion result */
+};
+
+/**
+ * I/O engine
+ */
+struct io_engine {
+    enum io_engine_kind kind;
+    unsigned int depth;
+
+    /* io_uring instance (kind == IO_ENGINE_URING) */
+    int ring_fd;
+    void *sq_map;
+    size_t sq_map_len;
+    void *cq_map;                /* == sq_map with a single ring mapping */
+    size_t cq_map_len;
+    void *sqes;
+    size_t sqes_len;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    /* Registered files (-1 = free slot) and buffer */
+    int files_registered;
+    int files[IO_ENGINE_MAX_FILES];
+    const char *buffer;
+    size_t buffer_len;
+
+    /* Current batch */
+    struct io_engine_op *ops;    /* depth entries */
+    unsigned int queued;
+    int error;                   /* errno of the first failure (0 = none) */
+
+    struct io_engine_stats stats;
+};
+
+/**
+ * Initialize an engine
+ * An io_uring engine the kernel refuses (old kernel, seccomp, ...) falls
+ * back to IO_ENGINE_PSYNC; check engine->kind for what was set up.
+ *
+ * @param depth Ops per submission (0 = IO_ENGINE_DEFAULT_DEPTH)
+ * @return 0 on success, -1 on error
+ */
+int io_engine_init(struct io_engine *io, enum io_engine_kind kind, unsigned int depth);
+
+/**
+ * Complete the pending batch and release the engine
+ */
+void io_engine_destroy(struct io_engine *io);
+
+/**
+ * Engine name ("psync" or "uring")
+ */
+const char *io_engine_name(enum io_engine_kind kind);
+
+/**
+ * Parse an engine name
+ * @return 0 on success, -1 if the name is unknown
+ */
+int io_engine_parse(const char *name, enum io_engine_kind *kind);
+
+/**
+ * Register a file: later ops on fd skip the per-op file lookup
+ * Registering a registered fd is a no-op. The fd must be unregistered
+ * before it is closed.
+ *
+ * @return 0 on success, -1 if it cannot be registered (ops still work)
+ */
+int io_engine_register_file(struct io_engine *io, int fd);
+
+/**
+ * Unregister a file
+ */
+void io_engine_unregister_file(struct io_engine *io, int fd);
+
+/**
+ * Register one buffer: writes whose source lies inside it are issued
+ * as fixed-buffer writes (pages pinned once, not per op)
+ * Replaces an earlier registration; NULL unregisters. The memory must
+ * stay valid until it is unregistered or the engine is destroyed.
+ *
+ * @return 0 on success, -1 if it cannot be registered (ops still work)
+ */
+int io_engine_register_buffer(struct io_engine *io, void *buf, size_t len);
+
+/**
+ * Queue a write of [buf, buf + len) at offset
+ * buf must stay valid until the batch is submitted.
+ *
+ * @return 0 on success, -1 if the batch already failed
+ */
+int io_engine_write(struct io_engine *io, int fd, const void *buf, size_t len,
+                    uint64_t offset);
+
+/**
+ * Queue an fdatasync of fd, after the writes queued before it
+ * @return 0 on success, -1 if the batch already failed
+ */
+int io_engine_fsync(struct io_engine *io, int fd);
+
+/**
+ * Submit the batch and wait for all of it
+ * @return 0 on success, -1 with errno set if any op failed
+ */
+int io_engine_submit(struct io_engine *io);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_IO_ENGINE_H */
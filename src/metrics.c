@@ -0,0 +1,362 @@
+/**
+ * Runtime Metrics Implementation - RAZORFS Latency Histograms and Counters
+ */
+
+#define _GNU_SOURCE
+#include "metrics.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define METRICS_SUB  (1u << METRICS_SUB_BITS)
+
+/* Prometheus buckets: every power of two from 1 us (2^10 ns) to ~4.3 s */
+#define METRICS_PROM_FIRST_BUCKET  ((10 - METRICS_SUB_BITS) * METRICS_SUB + METRICS_SUB - 1)
+
+struct metrics g_metrics;
+
+/* Lock kinds held by this thread: depth and start of the outermost hold */
+static __thread struct {
+    uint32_t depth;
+    uint64_t since;
+} t_held[METRICS_LOCK_KINDS];
+
+/* Fallback shard of threads sched_getcpu() cannot place */
+static __thread int t_shard = -1;
+static unsigned int g_next_shard;
+
+static const char *const g_hist_names[METRICS_HIST_COUNT] = {
+    [METRICS_OP_LOOKUP] = "lookup",
+    [METRICS_OP_GETATTR] = "getattr",
+    [METRICS_OP_SETATTR] = "setattr",
+    [METRICS_OP_ACCESS] = "access",
+    [METRICS_OP_OPENDIR] = "opendir",
+    [METRICS_OP_READDIR] = "readdir",
+    [METRICS_OP_RELEASEDIR] = "releasedir",
+    [METRICS_OP_MKDIR] = "mkdir",
+    [METRICS_OP_RMDIR] = "rmdir",
+    [METRICS_OP_CREATE] = "create",
+    [METRICS_OP_UNLINK] = "unlink",
+    [METRICS_OP_RENAME] = "rename",
+    [METRICS_OP_OPEN] = "open",
+    [METRICS_OP_READ] = "read",
+    [METRICS_OP_WRITE] = "write",
+    [METRICS_OP_FLUSH] = "flush",
+    [METRICS_OP_RELEASE] = "release",
+    [METRICS_OP_FSYNC] = "fsync",
+    [METRICS_OP_TRUNCATE] = "truncate",
+    [METRICS_OP_FALLOCATE] = "fallocate",
+    [METRICS_OP_LSEEK] = "lseek",
+    [METRICS_OP_XATTR] = "xattr",
+    [METRICS_OP_IOCTL] = "ioctl",
+    [METRICS_TREE_LOCK_WAIT] = "tree_lock_wait",
+    [METRICS_TREE_LOCK_HOLD] = "tree_lock_hold",
+    [METRICS_NODE_LOCK_WAIT] = "node_lock_wait",
+    [METRICS_NODE_LOCK_HOLD] = "node_lock_hold",
+    [METRICS_FILE_LOCK_WAIT] = "file_lock_wait",
+    [METRICS_FILE_LOCK_HOLD] = "file_lock_hold",
+    [METRICS_WAL_LOCK_WAIT] = "wal_lock_wait",
+    [METRICS_WAL_LOCK_HOLD] = "wal_lock_hold",
+    [METRICS_WAL_SYNC] = "wal_sync",
+    [METRICS_COMPRESS] = "compress",
+    [METRICS_DECOMPRESS] = "decompress",
+};
+
+static const char *const g_lock_names[METRICS_LOCK_KINDS] = {
+    [METRICS_LOCK_TREE] = "tree",
+    [METRICS_LOCK_NODE] = "node",
+    [METRICS_LOCK_FILE] = "file",
+    [METRICS_LOCK_WAL] = "wal",
+};
+
+static const char *const g_level_names[] = {
+    [METRICS_OFF] = "off",
+    [METRICS_OPS] = "ops",
+    [METRICS_FULL] = "full",
+};
+
+/* === Lifecycle === */
+
+int metrics_init(enum metrics_level level) {
+    metrics_destroy();
+    clock_gettime(CLOCK_MONOTONIC, &g_metrics.started);
+    if (level == METRICS_OFF) return 0;
+
+    long cpus = sysconf(_SC_NPROCESSORS_CONF);
+    unsigned int count = 1;
+    while (count < METRICS_MAX_SHARDS && (long)count < cpus) count <<= 1;
+
+    struct metrics_shard *shards = aligned_alloc(64, count * sizeof(*shards));
+    if (!shards) return -1;
+    memset(shards, 0, count * sizeof(*shards));
+
+    g_metrics.shards = shards;
+    g_metrics.shard_mask = count - 1;
+    __atomic_store_n(&g_metrics.level, level, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void metrics_destroy(void) {
+    __atomic_store_n(&g_metrics.level, METRICS_OFF, __ATOMIC_RELEASE);
+    free(g_metrics.shards);
+    g_metrics.shards = NULL;
+    g_metrics.shard_mask = 0;
+}
+
+const char *metrics_level_name(enum metrics_level level) {
+    return (unsigned int)level <= METRICS_FULL ? g_level_names[level] : "unknown";
+}
+
+int metrics_level_parse(const char *name, enum metrics_level *level) {
+    for (unsigned int i = 0; i <= METRICS_FULL; i++) {
+        if (strcmp(name, g_level_names[i]) == 0) {
+            *level = (enum metrics_level)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* === Recording === */
+
+static inline unsigned int bucket_of(uint64_t ns) {
+    if (ns < METRICS_SUB) return (unsigned int)ns;
+    unsigned int msb = 63u - (unsigned int)__builtin_clzll(ns);
+    unsigned int sub = (unsigned int)(ns >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB - 1);
+    unsigned int bucket = (msb - METRICS_SUB_BITS + 1) * METRICS_SUB + sub;
+    return bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1;
+}
+
+static inline struct metrics_shard *my_shard(void) {
+    int cpu = sched_getcpu();
+    if (cpu < 0) {
+        if (t_shard < 0) {
+            t_shard = (int)__atomic_fetch_add(&g_next_shard, 1, __ATOMIC_RELAXED);
+        }
+        cpu = t_shard;
+    }
+    return &g_metrics.shards[(unsigned int)cpu & g_metrics.shard_mask];
+}
+
+void metrics_record(enum metrics_hist hist, uint64_t ns) {
+    if (!metrics_on()) return;
+
+    struct metrics_hist_data *h = &my_shard()->hist[hist];
+    __atomic_fetch_add(&h->buckets[bucket_of(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_count(unsigned int counter, uint64_t n) {
+    if (!metrics_on()) return;
+    __atomic_fetch_add(&my_shard()->counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void metrics_lock_wait(enum metrics_lock kind, int shared, uint64_t start) {
+    (void)shared;
+    metrics_record(METRICS_LOCK_WAIT(kind), metrics_clock_ns() - start);
+}
+
+void metrics_lock_acquired(enum metrics_lock kind, int shared, int contended) {
+    struct metrics_shard *shard = my_shard();
+    unsigned int c = METRICS_LOCK_COUNTER(kind, shared ? METRICS_LOCK_SHARED
+                                                       : METRICS_LOCK_EXCLUSIVE);
+    __atomic_fetch_add(&shard->counters[c], 1, __ATOMIC_RELAXED);
+    if (contended) {
+        c = METRICS_LOCK_COUNTER(kind, METRICS_LOCK_CONTENDED);
+        __atomic_fetch_add(&shard->counters[c], 1, __ATOMIC_RELAXED);
+    }
+
+    if (t_held[kind].depth++ == 0) {
+        t_held[kind].since =
+            __atomic_load_n(&g_metrics.level, __ATOMIC_RELAXED) == METRICS_FULL ?
+            metrics_clock_ns() : 0;
+    }
+}
+
+void metrics_lock_released(enum metrics_lock kind) {
+    /* Locks taken with metrics off were never counted in */
+    if (t_held[kind].depth == 0 || --t_held[kind].depth > 0) return;
+    if (t_held[kind].since) {
+        metrics_record(METRICS_LOCK_HOLD(kind), metrics_clock_ns() - t_held[kind].since);
+    }
+}
+
+/* === Reading === */
+
+void metrics_snapshot(struct metrics_shard *out) {
+    memset(out, 0, sizeof(*out));
+    struct metrics_shard *shards = g_metrics.shards;
+    if (!shards) return;
+
+    for (unsigned int s = 0; s <= g_metrics.shard_mask; s++) {
+        const struct metrics_shard *shard = &shards[s];
+        for (unsigned int h = 0; h < METRICS_HIST_COUNT; h++) {
+            const struct metrics_hist_data *src = &shard->hist[h];
+            struct metrics_hist_data *dst = &out->hist[h];
+            dst->count += __atomic_load_n(&src->count, __ATOMIC_RELAXED);
+            dst->sum_ns += __atomic_load_n(&src->sum_ns, __ATOMIC_RELAXED);
+            for (unsigned int b = 0; b < METRICS_BUCKETS; b++) {
+                dst->buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+            }
+        }
+        for (unsigned int c = 0; c < METRICS_COUNTER_COUNT; c++) {
+            out->counters[c] += __atomic_load_n(&shard->counters[c], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+uint64_t metrics_bucket_limit(unsigned int bucket) {
+    if (bucket >= METRICS_BUCKETS - 1) return UINT64_MAX;
+    if (bucket < METRICS_SUB) return bucket + 1;
+    unsigned int major = bucket / METRICS_SUB;
+    unsigned int sub = bucket % METRICS_SUB;
+    return (uint64_t)(METRICS_SUB + sub + 1) << (major - 1);
+}
+
+/* Middle of a bucket in ns (the last one: its lower bound) */
+static uint64_t bucket_value(unsigned int bucket) {
+    if (bucket < METRICS_SUB) return bucket;
+    unsigned int major = bucket / METRICS_SUB;
+    unsigned int sub = bucket % METRICS_SUB;
+    uint64_t low = (uint64_t)(METRICS_SUB + sub) << (major - 1);
+    return bucket == METRICS_BUCKETS - 1 ? low : low + ((1ULL << (major - 1)) >> 1);
+}
+
+uint64_t metrics_percentile(const struct metrics_hist_data *h, double p) {
+    uint64_t total = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS; b++) total += h->buckets[b];
+    if (total == 0) return 0;
+
+    uint64_t target = (uint64_t)(p * (double)total + 0.999999);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= target) return bucket_value(b);
+    }
+    return bucket_value(METRICS_BUCKETS - 1);
+}
+
+const char *metrics_hist_name(enum metrics_hist hist) {
+    return (unsigned int)hist < METRICS_HIST_COUNT ? g_hist_names[hist] : "unknown";
+}
+
+const char *metrics_lock_name(enum metrics_lock kind) {
+    return (unsigned int)kind < METRICS_LOCK_KINDS ? g_lock_names[kind] : "unknown";
+}
+
+double metrics_uptime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - g_metrics.started.tv_sec) +
+           (double)(now.tv_nsec - g_metrics.started.tv_nsec) / 1e9;
+}
+
+/* === Output === */
+
+static void write_hist_row(FILE *out, const char *name, const struct metrics_hist_data *h) {
+    fprintf(out, "  %-16s %10llu %10.1f %10.1f %10.1f %10.1f\n", name,
+            (unsigned long long)h->count,
+            h->count ? (double)h->sum_ns / (double)h->count / 1000 : 0.0,
+            (double)metrics_percentile(h, 0.50) / 1000,
+            (double)metrics_percentile(h, 0.99) / 1000,
+            (double)metrics_percentile(h, 0.999) / 1000);
+}
+
+void metrics_write_text(FILE *out, const struct metrics_shard *snap) {
+    int level = __atomic_load_n(&g_metrics.level, __ATOMIC_RELAXED);
+    fprintf(out, "Metrics: %s, %.0f s\n\n", metrics_level_name(level), metrics_uptime());
+
+    fprintf(out, "Operations (us)         count       mean        p50        p99       p999\n");
+    for (unsigned int op = 0; op < METRICS_OP_COUNT; op++) {
+        if (snap->hist[op].count) write_hist_row(out, g_hist_names[op], &snap->hist[op]);
+    }
+
+    fprintf(out, "\nLocks (us)           shared  exclusive  contended   wait p99   hold p50   hold p99\n");
+    for (unsigned int k = 0; k < METRICS_LOCK_KINDS; k++) {
+        const struct metrics_hist_data *hold = &snap->hist[METRICS_LOCK_HOLD(k)];
+        fprintf(out, "  %-16s %10llu %10llu %10llu %10.1f %10.1f %10.1f\n", g_lock_names[k],
+                (unsigned long long)snap->counters[METRICS_LOCK_COUNTER(k, METRICS_LOCK_SHARED)],
+                (unsigned long long)snap->counters[METRICS_LOCK_COUNTER(k, METRICS_LOCK_EXCLUSIVE)],
+                (unsigned long long)snap->counters[METRICS_LOCK_COUNTER(k, METRICS_LOCK_CONTENDED)],
+                (double)metrics_percentile(&snap->hist[METRICS_LOCK_WAIT(k)], 0.99) / 1000,
+                (double)metrics_percentile(hold, 0.50) / 1000,
+                (double)metrics_percentile(hold, 0.99) / 1000);
+    }
+
+    fprintf(out, "\nPersistence (us)        count       mean        p50        p99       p999\n");
+    for (unsigned int h = METRICS_WAL_SYNC; h < METRICS_HIST_COUNT; h++) {
+        write_hist_row(out, g_hist_names[h], &snap->hist[h]);
+    }
+}
+
+/* One histogram series (cumulative buckets, sum and count, in seconds) */
+static void write_prometheus_hist(FILE *out, const char *name, const char *label,
+                                  const char *value, const struct metrics_hist_data *h) {
+    uint64_t cumulative = 0;
+    unsigned int next = 0;
+    for (unsigned int b = METRICS_PROM_FIRST_BUCKET; b < METRICS_BUCKETS - 1; b += METRICS_SUB) {
+        while (next <= b) cumulative += h->buckets[next++];
+        fprintf(out, "%s_bucket{%s=\"%s\",le=\"%.9g\"} %llu\n", name, label, value,
+                (double)metrics_bucket_limit(b) / 1e9, (unsigned long long)cumulative);
+    }
+    while (next < METRICS_BUCKETS) cumulative += h->buckets[next++];
+    fprintf(out, "%s_bucket{%s=\"%s\",le=\"+Inf\"} %llu\n", name, label, value,
+            (unsigned long long)cumulative);
+    fprintf(out, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, (double)h->sum_ns / 1e9);
+    fprintf(out, "%s_count{%s=\"%s\"} %llu\n", name, label, value,
+            (unsigned long long)h->count);
+}
+
+void metrics_write_prometheus_value(FILE *out, const char *name, const char *type,
+                                    const char *help, double value) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+}
+
+void metrics_write_prometheus(FILE *out, const struct metrics_shard *snap) {
+    fprintf(out, "# HELP razorfs_op_duration_seconds FUSE request latency\n"
+                 "# TYPE razorfs_op_duration_seconds histogram\n");
+    for (unsigned int op = 0; op < METRICS_OP_COUNT; op++) {
+        write_prometheus_hist(out, "razorfs_op_duration_seconds", "op", g_hist_names[op],
+                              &snap->hist[op]);
+    }
+
+    fprintf(out, "# HELP razorfs_lock_wait_seconds Time spent waiting for a busy lock\n"
+                 "# TYPE razorfs_lock_wait_seconds histogram\n");
+    for (unsigned int k = 0; k < METRICS_LOCK_KINDS; k++) {
+        write_prometheus_hist(out, "razorfs_lock_wait_seconds", "lock", g_lock_names[k],
+                              &snap->hist[METRICS_LOCK_WAIT(k)]);
+    }
+    fprintf(out, "# HELP razorfs_lock_hold_seconds Time a lock kind was held (metrics=full)\n"
+                 "# TYPE razorfs_lock_hold_seconds histogram\n");
+    for (unsigned int k = 0; k < METRICS_LOCK_KINDS; k++) {
+        write_prometheus_hist(out, "razorfs_lock_hold_seconds", "lock", g_lock_names[k],
+                              &snap->hist[METRICS_LOCK_HOLD(k)]);
+    }
+
+    static const char *const modes[] = { "shared", "exclusive" };
+    fprintf(out, "# HELP razorfs_lock_acquisitions_total Lock acquisitions\n"
+                 "# TYPE razorfs_lock_acquisitions_total counter\n");
+    for (unsigned int k = 0; k < METRICS_LOCK_KINDS; k++) {
+        for (unsigned int m = 0; m < 2; m++) {
+            fprintf(out, "razorfs_lock_acquisitions_total{lock=\"%s\",mode=\"%s\"} %llu\n",
+                    g_lock_names[k], modes[m],
+                    (unsigned long long)snap->counters[METRICS_LOCK_COUNTER(k, m)]);
+        }
+    }
+    fprintf(out, "# HELP razorfs_lock_contended_total Acquisitions that found the lock busy\n"
+                 "# TYPE razorfs_lock_contended_total counter\n");
+    for (unsigned int k = 0; k < METRICS_LOCK_KINDS; k++) {
+        fprintf(out, "razorfs_lock_contended_total{lock=\"%s\"} %llu\n", g_lock_names[k],
+                (unsigned long long)snap->counters[METRICS_LOCK_COUNTER(k, METRICS_LOCK_CONTENDED)]);
+    }
+
+    fprintf(out, "# HELP razorfs_io_duration_seconds WAL flush and compression time\n"
+                 "# TYPE razorfs_io_duration_seconds histogram\n");
+    for (unsigned int h = METRICS_WAL_SYNC; h < METRICS_HIST_COUNT; h++) {
+        write_prometheus_hist(out, "razorfs_io_duration_seconds", "stage", g_hist_names[h],
+                              &snap->hist[h]);
+    }
+}
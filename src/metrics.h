@@ -0,0 +1,336 @@
+/**
+ * Runtime Metrics - RAZORFS Latency Histograms and Counters
+ *
+ * Process-wide, lock-free recording for the hot paths:
+ * - Per-request latency of every FUSE operation (both front ends)
+ * - Lock waits and hold times of the tree lock, node locks, file data
+ *   locks and the WAL log lock (metrics_*lock wrappers below)
+ * - WAL flush time, compression and decompression time
+ *
+ * Each CPU records into its own shard (cache-line aligned, relaxed atomic
+ * adds, so a thread migrating mid-update stays correct); readers sum the
+ * shards. Histograms are log-linear: 4 buckets per power of two of
+ * nanoseconds (<= 25% wide), from 0 to ~8 s, the last one open-ended.
+ *
+ * Levels (-o metrics=...):
+ * - METRICS_OFF: nothing is recorded, the wrappers are plain lock calls
+ * - METRICS_OPS: operation latency, flush and compression time, lock
+ *   acquisitions; waits are timed only when the lock was busy (a failed
+ *   trylock), so an uncontended lock costs one trylock
+ * - METRICS_FULL: also lock hold times (two clock reads per outermost
+ *   acquisition of each lock kind on a thread)
+ *
+ * The level is chosen by metrics_init() before any thread records.
+ */
+
+#ifndef RAZORFS_METRICS_H
+#define RAZORFS_METRICS_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Configuration */
+#define METRICS_MAX_SHARDS   64      /* Shards (CPUs beyond share them) */
+#define METRICS_SUB_BITS     2       /* 4 buckets per power of two */
+#define METRICS_BUCKETS      128     /* Up to ~8 s, the last one open-ended */
+
+enum metrics_level {
+    METRICS_OFF = 0,
+    METRICS_OPS = 1,
+    METRICS_FULL = 2,
+};
+
+/**
+ * Histograms
+ * FUSE operations come first (METRICS_OP_COUNT of them), then two per
+ * lock kind (see METRICS_LOCK_WAIT/HOLD), then the persistence timings.
+ */
+enum metrics_hist {
+    METRICS_OP_LOOKUP,
+    METRICS_OP_GETATTR,
+    METRICS_OP_SETATTR,          /* chmod, chown, utimens (setattr) */
+    METRICS_OP_ACCESS,
+    METRICS_OP_OPENDIR,
+    METRICS_OP_READDIR,
+    METRICS_OP_RELEASEDIR,
+    METRICS_OP_MKDIR,
+    METRICS_OP_RMDIR,
+    METRICS_OP_CREATE,
+    METRICS_OP_UNLINK,
+    METRICS_OP_RENAME,
+    METRICS_OP_OPEN,
+    METRICS_OP_READ,
+    METRICS_OP_WRITE,
+    METRICS_OP_FLUSH,
+    METRICS_OP_RELEASE,
+    METRICS_OP_FSYNC,            /* fsync and fsyncdir */
+    METRICS_OP_TRUNCATE,
+    METRICS_OP_FALLOCATE,
+    METRICS_OP_LSEEK,
+    METRICS_OP_XATTR,            /* get/set/list/removexattr */
+    METRICS_OP_IOCTL,
+    METRICS_OP_COUNT,
+
+    METRICS_TREE_LOCK_WAIT = METRICS_OP_COUNT,
+    METRICS_TREE_LOCK_HOLD,
+    METRICS_NODE_LOCK_WAIT,
+    METRICS_NODE_LOCK_HOLD,
+    METRICS_FILE_LOCK_WAIT,
+    METRICS_FILE_LOCK_HOLD,
+    METRICS_WAL_LOCK_WAIT,
+    METRICS_WAL_LOCK_HOLD,
+
+    METRICS_WAL_SYNC,            /* Group commit flush (msync/fdatasync) */
+    METRICS_COMPRESS,            /* One buffer or block compressed */
+    METRICS_DECOMPRESS,
+    METRICS_HIST_COUNT,
+};
+
+/**
+ * Instrumented locks
+ */
+enum metrics_lock {
+    METRICS_LOCK_TREE,           /* nary_tree_mt tree_lock */
+    METRICS_LOCK_NODE,           /* Per-node rwlocks */
+    METRICS_LOCK_FILE,           /* fs_file_data data_lock */
+    METRICS_LOCK_WAL,            /* WAL log_lock */
+    METRICS_LOCK_KINDS,
+};
+
+#define METRICS_LOCK_WAIT(kind)  ((enum metrics_hist)(METRICS_TREE_LOCK_WAIT + 2 * (kind)))
+#define METRICS_LOCK_HOLD(kind)  ((enum metrics_hist)(METRICS_TREE_LOCK_HOLD + 2 * (kind)))
+
+/**
+ * Counters: three per lock kind
+ */
+enum metrics_counter {
+    METRICS_LOCK_SHARED,         /* + 3 * kind: read acquisitions */
+    METRICS_LOCK_EXCLUSIVE,      /* Write / mutex acquisitions */
+    METRICS_LOCK_CONTENDED,      /* ... that found the lock busy */
+    METRICS_COUNTER_COUNT = 3 * METRICS_LOCK_KINDS,
+};
+
+#define METRICS_LOCK_COUNTER(kind, c)  ((unsigned int)(3 * (kind) + (c)))
+
+/**
+ * One histogram
+ */
+struct metrics_hist_data {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t buckets[METRICS_BUCKETS];
+};
+
+/**
+ * One shard (or the sum of all, see metrics_snapshot)
+ */
+struct metrics_shard {
+    struct metrics_hist_data hist[METRICS_HIST_COUNT];
+    uint64_t counters[METRICS_COUNTER_COUNT];
+} __attribute__((aligned(64)));
+
+/**
+ * Recorder state (one per process)
+ */
+struct metrics {
+    int level;                   /* enum metrics_level (__atomic) */
+    struct metrics_shard *shards;
+    unsigned int shard_mask;     /* Shard count - 1 (power of two) */
+    struct timespec started;     /* CLOCK_MONOTONIC at metrics_init */
+};
+
+extern struct metrics g_metrics;
+
+/* === Lifecycle === */
+
+/**
+ * Start recording at a level (METRICS_OFF only resets)
+ * Not thread-safe against recorders: call before starting threads.
+ * @return 0 on success, -1 if the shards cannot be allocated (stays off)
+ */
+int metrics_init(enum metrics_level level);
+
+/**
+ * Stop recording and free the shards
+ */
+void metrics_destroy(void);
+
+/**
+ * Level name ("off", "ops", "full") and parsing
+ * @return 0 on success, -1 if the name is unknown
+ */
+const char *metrics_level_name(enum metrics_level level);
+int metrics_level_parse(const char *name, enum metrics_level *level);
+
+/* === Recording === */
+
+static inline uint64_t metrics_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline int metrics_on(void) {
+    return __atomic_load_n(&g_metrics.level, __ATOMIC_RELAXED) != METRICS_OFF;
+}
+
+/**
+ * Start timing: a timestamp, or 0 with metrics off
+ */
+static inline uint64_t metrics_start(void) {
+    return metrics_on() ? metrics_clock_ns() : 0;
+}
+
+/**
+ * Add one sample of ns nanoseconds
+ */
+void metrics_record(enum metrics_hist hist, uint64_t ns);
+
+/**
+ * Add the time since a metrics_start() (nothing if it returned 0)
+ */
+static inline void metrics_record_since(enum metrics_hist hist, uint64_t start) {
+    if (start) metrics_record(hist, metrics_clock_ns() - start);
+}
+
+/**
+ * Add to a counter
+ */
+void metrics_count(unsigned int counter, uint64_t n);
+
+/* === Lock Wrappers === */
+
+/* Slow paths (metrics.c) */
+void metrics_lock_wait(enum metrics_lock kind, int shared, uint64_t start);
+void metrics_lock_acquired(enum metrics_lock kind, int shared, int contended);
+void metrics_lock_released(enum metrics_lock kind);
+
+/*
+ * Drop-in replacements for pthread_rwlock_rdlock/wrlock/unlock and
+ * pthread_mutex_lock/unlock, same return values. All acquisitions and
+ * releases of an instrumented lock must go through them (hold times are
+ * tracked per thread and lock kind, outermost acquisition to last release).
+ */
+static inline int metrics_rwlock_rdlock(pthread_rwlock_t *lock, enum metrics_lock kind) {
+    if (!metrics_on()) return pthread_rwlock_rdlock(lock);
+    int contended = 0;
+    int ret = pthread_rwlock_tryrdlock(lock);
+    if (ret == EBUSY || ret == EAGAIN) {
+        uint64_t start = metrics_clock_ns();
+        ret = pthread_rwlock_rdlock(lock);
+        metrics_lock_wait(kind, 1, start);
+        contended = 1;
+    }
+    if (ret == 0) metrics_lock_acquired(kind, 1, contended);
+    return ret;
+}
+
+static inline int metrics_rwlock_wrlock(pthread_rwlock_t *lock, enum metrics_lock kind) {
+    if (!metrics_on()) return pthread_rwlock_wrlock(lock);
+    int contended = 0;
+    int ret = pthread_rwlock_trywrlock(lock);
+    if (ret == EBUSY) {
+        uint64_t start = metrics_clock_ns();
+        ret = pthread_rwlock_wrlock(lock);
+        metrics_lock_wait(kind, 0, start);
+        contended = 1;
+    }
+    if (ret == 0) metrics_lock_acquired(kind, 0, contended);
+    return ret;
+}
+
+static inline int metrics_rwlock_trywrlock(pthread_rwlock_t *lock, enum metrics_lock kind) {
+    int ret = pthread_rwlock_trywrlock(lock);
+    if (ret == 0 && metrics_on()) metrics_lock_acquired(kind, 0, 0);
+    return ret;
+}
+
+static inline int metrics_rwlock_unlock(pthread_rwlock_t *lock, enum metrics_lock kind) {
+    metrics_lock_released(kind);
+    return pthread_rwlock_unlock(lock);
+}
+
+static inline int metrics_mutex_lock(pthread_mutex_t *lock, enum metrics_lock kind) {
+    if (!metrics_on()) return pthread_mutex_lock(lock);
+    int contended = 0;
+    int ret = pthread_mutex_trylock(lock);
+    if (ret == EBUSY) {
+        uint64_t start = metrics_clock_ns();
+        ret = pthread_mutex_lock(lock);
+        metrics_lock_wait(kind, 0, start);
+        contended = 1;
+    }
+    if (ret == 0) metrics_lock_acquired(kind, 0, contended);
+    return ret;
+}
+
+static inline int metrics_mutex_unlock(pthread_mutex_t *lock, enum metrics_lock kind) {
+    metrics_lock_released(kind);
+    return pthread_mutex_unlock(lock);
+}
+
+/* === Reading === */
+
+/**
+ * Sum of all shards
+ * Each value is exact on its own; values recorded while reading may show
+ * in some and not yet in others.
+ */
+void metrics_snapshot(struct metrics_shard *out);
+
+/**
+ * Latency below which a fraction p of the samples fall (bucket midpoint)
+ * @return Nanoseconds (0 for an empty histogram)
+ */
+uint64_t metrics_percentile(const struct metrics_hist_data *h, double p);
+
+/**
+ * Upper bound of a bucket in ns (UINT64_MAX for the last one)
+ */
+uint64_t metrics_bucket_limit(unsigned int bucket);
+
+/**
+ * Histogram and lock names: "getattr", "tree_lock_wait", "wal_sync", ...
+ * and "tree", "node", "file", "wal"
+ */
+const char *metrics_hist_name(enum metrics_hist hist);
+const char *metrics_lock_name(enum metrics_lock kind);
+
+/**
+ * Seconds since metrics_init
+ */
+double metrics_uptime(void);
+
+/* === Output === */
+
+/**
+ * Text report of the recorded metrics: one table of operations, one of
+ * locks, then the persistence timings
+ */
+void metrics_write_text(FILE *out, const struct metrics_shard *snap);
+
+/**
+ * The same in the Prometheus text exposition format (razorfs_* names,
+ * histograms in seconds)
+ */
+void metrics_write_prometheus(FILE *out, const struct metrics_shard *snap);
+
+/**
+ * One Prometheus sample with its HELP/TYPE header
+ * @param type "counter" or "gauge"
+ */
+void metrics_write_prometheus_value(FILE *out, const char *name, const char *type,
+                                    const char *help, double value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_METRICS_H */
@@ -11,7 +11,10 @@
  *   - Delete: O(d × log k + k) (lookup + linear removal)
  *   - Find child: O(log k) using binary search on sorted children
  *
- * Children Array: Maintained in sorted order by filename for binary search
+ * Children Array: Maintained in sorted order by filename for binary search.
+ * Up to NARY_INLINE_CHILDREN live in the node itself; wider directories
+ * (up to NARY_MAX_CHILDREN) keep theirs in a B+-tree of out-of-line child
+ * blocks (see nary_child_block).
  * Reference: https://github.com/ncandio/n-ary_python_package
  */
 
@@ -22,7 +25,11 @@
 #include <sys/stat.h>
 
 /* Configuration */
-#define NARY_BRANCHING_FACTOR 16   /* 16 children per node for O(log₁₆ n) */
+#define NARY_BRANCHING_FACTOR 16   /* 16 children per leaf block for O(log₁₆ n) */
+#define NARY_INLINE_CHILDREN 8     /* Children that fit in the node itself */
+#define NARY_BLOCK_FANOUT 8        /* Subtrees per interior child block */
+#define NARY_CHILD_MAX_HEIGHT 8    /* Interior levels of a directory's block tree */
+#define NARY_MAX_CHILDREN 0xFFFF   /* Entries per directory (16-bit num_children) */
 #define CACHE_LINE_SIZE 64         /* Standard x86_64 cache line */
 
 /**
@@ -36,20 +43,23 @@
  * Uses indices instead of pointers for:
  * 1. Cache-friendly contiguous array layout
  * 2. No pointer chasing overhead
- * 3. Compact representation (16-bit indices support 65K nodes)
+ * 3. Compact representation (32-bit indices, 8 of them inline)
  */
 struct __attribute__((aligned(CACHE_LINE_SIZE))) nary_node {
     /* Identity (12 bytes) */
     uint32_t inode;                                 /* Unique inode number */
     uint32_t parent_idx;                            /* Parent node index in array */
-    uint16_t num_children;                          /* Count of children (0-16) */
+    uint16_t num_children;                          /* Count of children */
     uint16_t mode;                                  /* File type and permissions */
 
     /* Naming (4 bytes) */
     uint32_t name_offset;                           /* Offset in string table */
 
-    /* Children indices (32 bytes) */
-    uint16_t children[NARY_BRANCHING_FACTOR];       /* Child node indices */
+    /* Children indices (32 bytes)
+     * num_children <= NARY_INLINE_CHILDREN: the child indices themselves
+     * num_children >  NARY_INLINE_CHILDREN: children[0] is the root child
+     *   block, children[1] the number of interior levels above the leaves */
+    uint32_t children[NARY_INLINE_CHILDREN];
 
     /* Metadata (16 bytes) */
     uint64_t size;                                  /* File size in bytes */
@@ -69,15 +79,41 @@ struct __attribute__((aligned(CACHE_LINE_SIZE))) nary_node {
                    "nary_node MUST be exactly 64 bytes for cache alignment");
 #endif
 
+/**
+ * One cache line of a directory's child B+-tree (each block belongs to
+ * exactly one directory; entries are sorted by name and packed at the
+ * front, unused slots are NARY_INVALID_IDX)
+ *
+ * Leaf:     children[i] is a child node index
+ * Interior: children[2i] is a subtree block and children[2i+1] the first
+ *           child node in that subtree, whose name separates it from
+ *           its left sibling
+ */
+struct __attribute__((aligned(CACHE_LINE_SIZE))) nary_child_block {
+    uint32_t children[NARY_BRANCHING_FACTOR];       /* Child or block indices */
+};
+
+#ifdef __cplusplus
+    static_assert(sizeof(struct nary_child_block) == 64,
+                  "nary_child_block MUST be exactly 64 bytes");
+#else
+    _Static_assert(sizeof(struct nary_child_block) == 64,
+                   "nary_child_block MUST be exactly 64 bytes");
+#endif
+
 /* Special index values */
-#define NARY_INVALID_IDX 0xFFFF     /* Invalid/null index */
+#define NARY_INVALID_IDX 0xFFFFFFFF /* Invalid/null index */
 #define NARY_ROOT_IDX 0             /* Root directory is always index 0 */
 
+/* Block tree of a directory with more than NARY_INLINE_CHILDREN children */
+#define NARY_CHILD_ROOT(node)   ((node)->children[0])
+#define NARY_CHILD_HEIGHT(node) ((node)->children[1])
+
 /* Node type checking macros */
 #define NARY_IS_DIR(node)  (S_ISDIR((node)->mode))
 #define NARY_IS_FILE(node) (S_ISREG((node)->mode))
 
-/* Maximum nodes with 16-bit indices */
-#define NARY_MAX_NODES 65535
+/* Maximum nodes with 32-bit indices (keeps capacity doubling in range) */
+#define NARY_MAX_NODES 0x80000000u
 
 #endif /* RAZORFS_NARY_NODE_H */
@@ -51,7 +51,7 @@ struct nary_tree {
     uint32_t op_count;              /* Operations since last rebalance */
 
     /* Free list for deleted nodes */
-    uint16_t *free_list;            /* Stack of free indices */
+    uint32_t *free_list;            /* Stack of free indices */
     uint32_t free_count;            /* Number of free indices */
 };
 
@@ -80,8 +80,8 @@ void nary_tree_destroy(struct nary_tree *tree);
  * @param name      Child name to find
  * @return          Child index, or NARY_INVALID_IDX if not found
  */
-uint16_t nary_find_child(const struct nary_tree *tree,
-                         uint16_t parent_idx,
+uint32_t nary_find_child(const struct nary_tree *tree,
+                         uint32_t parent_idx,
                          const char *name);
 
 /**
@@ -95,8 +95,8 @@ uint16_t nary_find_child(const struct nary_tree *tree,
  * @param mode      File type and permissions
  * @return          New node index, or NARY_INVALID_IDX on error
  */
-uint16_t nary_insert(struct nary_tree *tree,
-                     uint16_t parent_idx,
+uint32_t nary_insert(struct nary_tree *tree,
+                     uint32_t parent_idx,
                      const char *name,
                      uint16_t mode);
 
@@ -110,7 +110,7 @@ uint16_t nary_insert(struct nary_tree *tree,
  * @param idx   Node index to delete
  * @return      0 on success, negative error code on failure
  */
-int nary_delete(struct nary_tree *tree, uint16_t idx);
+int nary_delete(struct nary_tree *tree, uint32_t idx);
 
 /* === Path Resolution === */
 
@@ -123,7 +123,7 @@ int nary_delete(struct nary_tree *tree, uint16_t idx);
  * @param path  Absolute path (must start with '/')
  * @return      Node index, or NARY_INVALID_IDX if not found
  */
-uint16_t nary_path_lookup(const struct nary_tree *tree, const char *path);
+uint32_t nary_path_lookup(const struct nary_tree *tree, const char *path);
 
 /**
  * Split path into parent directory and filename
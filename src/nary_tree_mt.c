@@ -28,6 +28,14 @@
  * - tree->used is atomic to allow lock-free reads in bounds checks
  * - Modifications to tree->used are still protected by tree_lock
  *
+ * Node Storage:
+ * - Heap trees reserve address space for all nodes up front and commit it
+ *   in slabs of NARY_SLAB_NODES, so tree->nodes never moves: node pointers
+ *   and node locks stay valid while another thread grows the tree
+ * - With huge pages on (numa_set_huge_pages), slabs are grouped to fill
+ *   whole 2MB pages; lookups prefetch the nodes and names they will
+ *   compare next unless tree->prefetch is 0
+ *
  * Return Values:
  * - Functions return -1 on error (invalid params or lock failure)
  * - NARY_INVALID_IDX indicates not found or allocation failure
@@ -52,12 +60,25 @@
 #include <stdatomic.h>
 #include <assert.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include "numa_support.h"
+#include "metrics.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 /* Forward declarations */
-static uint16_t allocate_node_mt(struct nary_tree_mt *tree);
+static uint32_t allocate_node_mt(struct nary_tree_mt *tree);
+static uint32_t slab_nodes_mt(void);
+static int reserve_nodes_mt(struct nary_tree_mt *tree);
+static int commit_slabs_mt(struct nary_tree_mt *tree, uint32_t from, uint32_t to);
+static int commit_blocks_mt(struct nary_tree_mt *tree, uint32_t from, uint32_t to);
+static void release_nodes_mt(struct nary_tree_mt *tree);
+static int rebalance_mt(struct nary_tree_mt *tree, uint32_t *track);
 static void init_node_mt(struct nary_node_mt *node, uint32_t inode,
                         uint32_t parent_idx, const char *name,
                         struct string_table *strings, uint16_t mode);
+static void snapshot_save_node(struct nary_tree_mt *tree, uint32_t idx);
 
 int nary_tree_mt_init(struct nary_tree_mt *tree) __attribute__((unused));
 int nary_tree_mt_init(struct nary_tree_mt *tree) {
@@ -65,48 +86,69 @@ int nary_tree_mt_init(struct nary_tree_mt *tree) {
 
     memset(tree, 0, sizeof(*tree));
 
-    /* Allocate initial node array with 128-byte alignment */
-    size_t size = NARY_INITIAL_CAPACITY * sizeof(struct nary_node_mt);
-    if (posix_memalign((void **)&tree->nodes, 128, size) != 0) {
+    /* Reserve the node array and commit the first slabs (zero-filled) */
+    uint32_t initial = NARY_INITIAL_CAPACITY > slab_nodes_mt() ?
+                       NARY_INITIAL_CAPACITY : slab_nodes_mt();
+    size_t size = initial * sizeof(struct nary_node_mt);
+    if (reserve_nodes_mt(tree) != 0) {
+        return -1;
+    }
+    if (commit_slabs_mt(tree, 0, initial) != 0) {
+        release_nodes_mt(tree);
         return -1;
     }
-    memset(tree->nodes, 0, size);
 
     /* Allocate free list */
-    tree->free_list = malloc(NARY_INITIAL_CAPACITY * sizeof(uint16_t));
+    tree->free_list = malloc(initial * sizeof(uint32_t));
     if (!tree->free_list) {
-        free(tree->nodes);
+        release_nodes_mt(tree);
+        return -1;
+    }
+
+    /* Commit the first child blocks (and their fingerprints) for wide
+     * directories; they were reserved with the nodes */
+    size_t block_size = NARY_CHILD_BLOCKS(initial) * sizeof(struct nary_child_block);
+    size_t fp_size = NARY_CHILD_BLOCKS(initial) * sizeof(struct nary_child_fp);
+    if (commit_blocks_mt(tree, 0, NARY_CHILD_BLOCKS(initial)) != 0) {
+        free(tree->free_list);
+        release_nodes_mt(tree);
         return -1;
     }
 
     /* Initialize string table */
     if (string_table_init(&tree->strings) != 0) {
         free(tree->free_list);
-        free(tree->nodes);
+        release_nodes_mt(tree);
         return -1;
     }
 
-    tree->capacity = NARY_INITIAL_CAPACITY;
+    tree->capacity = initial;
     tree->used = 0;
+    tree->prefetch = 1;
     tree->next_inode = 1;
     tree->op_count = 0;
     tree->free_count = 0;
+    tree->block_capacity = NARY_CHILD_BLOCKS(initial);
+    tree->block_used = 0;
+    tree->block_free = NARY_INVALID_IDX;
 
     /* Initialize memory management */
     tree->max_memory_bytes = NARY_MT_DEFAULT_MAX_MEMORY;
-    tree->current_memory_bytes = (uint64_t)size +
-                                 (NARY_INITIAL_CAPACITY * sizeof(uint16_t));
+    tree->current_memory_bytes = (uint64_t)size + block_size + fp_size +
+                                 (initial * sizeof(uint32_t));
 
     /* Initialize tree lock */
     if (pthread_rwlock_init(&tree->tree_lock, NULL) != 0) {
         string_table_destroy(&tree->strings);
         free(tree->free_list);
-        free(tree->nodes);
+        release_nodes_mt(tree);
         return -1;
     }
+    tree->snap_next_id = 1;
+    pthread_mutex_init(&tree->snap_lock, NULL);
 
     /* Create root directory at index 0 */
-    uint16_t root_idx = allocate_node_mt(tree);
+    uint32_t root_idx = allocate_node_mt(tree);
     if (root_idx != NARY_ROOT_IDX) {
         nary_tree_mt_destroy(tree);
         return -1;
@@ -131,33 +173,318 @@ void nary_tree_mt_destroy(struct nary_tree_mt *tree) {
 
     pthread_rwlock_destroy(&tree->tree_lock);
 
-    if (tree->nodes) {
-        free(tree->nodes);
-        tree->nodes = NULL;
-    }
+    /* Snapshots hold name references: before the string table goes */
+    nary_snapshots_destroy_mt(tree);
+    release_nodes_mt(tree);
 
     if (tree->free_list) {
         free(tree->free_list);
         tree->free_list = NULL;
     }
 
+    free(tree->inode_slots);
+    tree->inode_slots = NULL;
+    free(tree->retired);
+    tree->retired = NULL;
+    tree->retired_count = tree->retired_capacity = 0;
+
     string_table_destroy(&tree->strings);
 
     tree->capacity = 0;
     tree->used = 0;
 }
 
-static uint16_t allocate_node_mt(struct nary_tree_mt *tree) {
+/* === Node Slabs === */
+
+#if NARY_INITIAL_CAPACITY % NARY_SLAB_NODES != 0
+#error "NARY_INITIAL_CAPACITY must be a whole number of slabs"
+#endif
+
+/* Nodes committed at a time: a slab, or with huge pages as many slabs as
+ * fill one, so each commit maps whole huge pages */
+static uint32_t slab_nodes_mt(void) {
+    size_t granule = numa_commit_granule() / sizeof(struct nary_node_mt);
+    return granule > NARY_SLAB_NODES ? (uint32_t)granule : NARY_SLAB_NODES;
+}
+
+/* Fingerprint bytes for block_len bytes of child blocks */
+static size_t block_fp_len(size_t block_len) {
+    return block_len / sizeof(struct nary_child_block) * sizeof(struct nary_child_fp);
+}
+
+/* Reserve (but do not commit) address space for the node array and
+ * its side arrays (sequence counters, heat, then snapshot epochs), and
+ * for the child blocks and their fingerprints */
+static int reserve_nodes_mt(struct nary_tree_mt *tree) {
+    /* Under an address space limit (ulimit -v), settle for fewer nodes */
+    for (uint64_t max_nodes = NARY_MAX_NODES; max_nodes >= NARY_INITIAL_CAPACITY;
+         max_nodes /= 2) {
+        size_t len = (size_t)max_nodes * sizeof(struct nary_node_mt);
+        size_t seq_len = 3 * (size_t)max_nodes * sizeof(uint32_t);
+        size_t block_len = (size_t)NARY_CHILD_BLOCKS(max_nodes) * sizeof(struct nary_child_block);
+        void *base = numa_reserve(len);
+        void *seq = base ? numa_reserve(seq_len) : NULL;
+        void *blocks = seq ? numa_reserve(block_len) : NULL;
+        void *fp = blocks ? numa_reserve(block_fp_len(block_len)) : NULL;
+        if (!fp) {
+            numa_release(blocks, block_len);
+            numa_release(seq, seq_len);
+            numa_release(base, len);
+            continue;
+        }
+        tree->nodes = base;
+        tree->node_seq = seq;
+        tree->node_heat = tree->node_seq + max_nodes;
+        tree->node_cow = tree->node_seq + 2 * max_nodes;
+        tree->node_reserve = len;
+        tree->child_blocks = blocks;
+        tree->block_fp = fp;
+        tree->block_reserve = block_len;
+        return 0;
+    }
+    return -1;
+}
+
+/* Make nodes [from, to) usable; both are slab multiples. Each slab goes on
+ * the NUMA node of the thread that needs it first (and on huge pages if
+ * enabled, see numa_commit). */
+static int commit_slabs_mt(struct nary_tree_mt *tree, uint32_t from, uint32_t to) {
+    char *start = (char *)&tree->nodes[from];
+    size_t len = (size_t)(to - from) * sizeof(struct nary_node_mt);
+
+    size_t side_len = (size_t)(to - from) * sizeof(uint32_t);
+    if (numa_commit(start, len, NUMA_MEM_METADATA, -1) != 0 ||
+        mprotect(&tree->node_seq[from], side_len, PROT_READ | PROT_WRITE) != 0 ||
+        mprotect(&tree->node_heat[from], side_len, PROT_READ | PROT_WRITE) != 0 ||
+        mprotect(&tree->node_cow[from], side_len, PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Make child blocks [from, to) usable, fingerprints included. Whole
+ * granules are committed at a time, so the first of them may already be. */
+static int commit_blocks_mt(struct nary_tree_mt *tree, uint32_t from, uint32_t to) {
+    size_t granule = numa_commit_granule();
+    size_t sizes[2] = { sizeof(struct nary_child_block), sizeof(struct nary_child_fp) };
+    char *bases[2] = { (char *)tree->child_blocks, (char *)tree->block_fp };
+
+    for (int i = 0; i < 2; i++) {
+        size_t start = ((size_t)from * sizes[i] + granule - 1) / granule * granule;
+        size_t end = ((size_t)to * sizes[i] + granule - 1) / granule * granule;
+        size_t limit = i == 0 ? tree->block_reserve : block_fp_len(tree->block_reserve);
+        if (end > limit) {
+            end = limit;
+        }
+        if (end > start &&
+            numa_commit(bases[i] + start, end - start, NUMA_MEM_METADATA, -1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void release_nodes_mt(struct nary_tree_mt *tree) {
+    if (tree->nodes && tree->node_reserve) {
+        numa_release(tree->nodes, tree->node_reserve);
+        numa_release(tree->node_seq,
+                     3 * (tree->node_reserve / sizeof(struct nary_node_mt)) * sizeof(uint32_t));
+    }
+    if (tree->child_blocks && tree->block_reserve) {
+        numa_release(tree->child_blocks, tree->block_reserve);
+        numa_release(tree->block_fp, block_fp_len(tree->block_reserve));
+    }
+    tree->nodes = NULL;
+    tree->node_seq = NULL;
+    tree->node_heat = NULL;
+    tree->node_cow = NULL;
+    tree->node_reserve = 0;
+    tree->child_blocks = NULL;
+    tree->block_fp = NULL;
+    tree->block_reserve = 0;
+}
+
+/* === Node Sequence Counters ===
+ *
+ * Writers already hold the node's write lock; they also make its counter
+ * odd for the duration of the change. Readers copy what they need
+ * without touching the lock, then check the counter was even and did
+ * not move: nothing is written, so lookups on all cores share the cache
+ * lines clean. A child list lives in its directory node, so changes to a
+ * directory's child blocks count as changes to the directory.
+ *
+ * A reader may still be mid-copy when a writer frees or reuses what it
+ * is reading, so everything it can reach must stay mapped: the nodes and
+ * their side arrays, the string table, and the child blocks with their
+ * fingerprints are all committed in place as they grow, never moved.
+ *
+ * ThreadSanitizer cannot tell validated racy reads from real races:
+ * sanitized builds keep reading under the node locks, which still
+ * checks the locking. */
+
+#if defined(__SANITIZE_THREAD__)
+#define NARY_OPTIMISTIC_READS 0
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define NARY_OPTIMISTIC_READS 0
+#endif
+#endif
+#ifndef NARY_OPTIMISTIC_READS
+#define NARY_OPTIMISTIC_READS 1
+#endif
+
+static inline void node_write_begin(struct nary_tree_mt *tree, uint32_t idx) {
+    /* First change since the newest snapshot: save the node as it was */
+    uint32_t epoch = __atomic_load_n(&tree->snap_epoch, __ATOMIC_ACQUIRE);
+    if (epoch && tree->node_cow[idx] != epoch) {
+        snapshot_save_node(tree, idx);
+    }
+
+    if (!tree->node_seq) return;
+    uint32_t seq = __atomic_load_n(&tree->node_seq[idx], __ATOMIC_RELAXED);
+    __atomic_store_n(&tree->node_seq[idx], seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  /* Odd before any change */
+}
+
+static inline void node_write_end(struct nary_tree_mt *tree, uint32_t idx) {
+    if (!tree->node_seq) return;
+    uint32_t seq = __atomic_load_n(&tree->node_seq[idx], __ATOMIC_RELAXED);
+    __atomic_store_n(&tree->node_seq[idx], seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Counter to validate against, or an odd value if a writer is active */
+static inline uint32_t node_read_begin(const struct nary_tree_mt *tree, uint32_t idx) {
+    return __atomic_load_n(&tree->node_seq[idx], __ATOMIC_ACQUIRE);
+}
+
+/* Whether everything read since node_read_begin() returned seq is consistent */
+static inline bool node_read_valid(const struct nary_tree_mt *tree, uint32_t idx, uint32_t seq) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);  /* Reads done before the recheck */
+    return (seq & 1) == 0 &&
+           __atomic_load_n(&tree->node_seq[idx], __ATOMIC_RELAXED) == seq;
+}
+
+/* Mapped trees lock until their fingerprints are rebuilt */
+static inline bool node_reads_optimistic(const struct nary_tree_mt *tree) {
+    return NARY_OPTIMISTIC_READS && tree->node_seq != NULL && tree->block_fp != NULL;
+}
+
+static inline void node_read_fallback(struct nary_tree_mt *tree) {
+    __atomic_fetch_add(&tree->stats.read_fallbacks, 1, __ATOMIC_RELAXED);
+}
+
+/* Exclusive compaction passes, for the pause histogram */
+static uint64_t pause_clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void record_pause(struct nary_tree_mt *tree, uint64_t start_ns) {
+    uint64_t ns = pause_clock_ns() - start_ns;
+    uint32_t bucket = 0;
+    for (uint64_t us = ns / 1000; us > 0 && bucket < NARY_PAUSE_BUCKETS - 1; us >>= 1) {
+        bucket++;
+    }
+    tree->stats.rebalance_steps++;
+    tree->stats.pause_hist[bucket]++;
+    if (ns > tree->stats.pause_max_ns) {
+        tree->stats.pause_max_ns = ns;
+    }
+}
+
+/* === Directory Heat ===
+ *
+ * One lookup in NARY_HEAT_SAMPLE per thread bumps its directory's heat,
+ * so hot directories are found without every lookup writing shared
+ * memory. A directory crossing NARY_HEAT_HOT enters the hot ring, which
+ * the next compaction step works from. */
+
+static __thread uint32_t heat_tick;
+
+static inline void note_lookup(struct nary_tree_mt *tree, uint32_t dir_idx) {
+    if (!tree->node_heat || (++heat_tick % NARY_HEAT_SAMPLE) != 0) return;
+
+    uint32_t heat = __atomic_add_fetch(&tree->node_heat[dir_idx], 1, __ATOMIC_RELAXED);
+    if (heat == NARY_HEAT_HOT) {
+        uint32_t slot = __atomic_fetch_add(&tree->hot_next, 1, __ATOMIC_RELAXED) % NARY_HOT_RING;
+        __atomic_store_n(&tree->hot_ring[slot], dir_idx, __ATOMIC_RELAXED);
+    }
+}
+
+/* Grow the node array and free list to new_capacity
+ * (tree_lock held for write). Existing nodes stay where they are. */
+static int grow_nodes_mt(struct nary_tree_mt *tree, uint32_t new_capacity) {
+    if (new_capacity > NARY_MAX_NODES) {
+        return -1;
+    }
+
+    /* Mapped images are created at their full capacity */
+    if (tree->is_mapped) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    /* Whole slabs, within the reservation */
+    uint32_t slab = slab_nodes_mt();
+    uint64_t rounded = ((uint64_t)new_capacity + slab - 1) / slab * slab;
+    if (rounded > tree->node_reserve / sizeof(struct nary_node_mt)) {
+        errno = ENOSPC;
+        return -1;
+    }
+    new_capacity = (uint32_t)rounded;
+    if (new_capacity <= tree->capacity) {
+        return 0;
+    }
+
+    /* Check memory limit before allocation */
+    size_t new_size = (size_t)new_capacity * sizeof(struct nary_node_mt);
+    size_t old_size = (size_t)tree->capacity * sizeof(struct nary_node_mt);
+    size_t new_free_list_size = (size_t)new_capacity * sizeof(uint32_t);
+    size_t old_free_list_size = (size_t)tree->capacity * sizeof(uint32_t);
+    uint64_t additional_memory = (new_size - old_size) +
+                                 (new_free_list_size - old_free_list_size);
+
+    if (tree->max_memory_bytes != NARY_MT_NO_LIMIT) {
+        uint64_t projected_usage = tree->current_memory_bytes + additional_memory;
+        if (projected_usage > tree->max_memory_bytes) {
+            /* Memory limit exceeded - return ENOSPC via backpressure */
+            tree->stats.memory_limit_hits++;
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+
+    /* Free list first: if it fails, nothing has changed */
+    uint32_t *new_free_list = realloc(tree->free_list,
+                                      new_free_list_size);
+    if (!new_free_list) {
+        return -1;
+    }
+    tree->free_list = new_free_list;
+
+    /* Commit the next slabs in place: nothing is copied */
+    if (commit_slabs_mt(tree, tree->capacity, new_capacity) != 0) {
+        return -1;
+    }
+    tree->capacity = new_capacity;
+
+    /* Update memory tracking */
+    tree->current_memory_bytes += additional_memory;
+    return 0;
+}
+
+static uint32_t allocate_node_mt(struct nary_tree_mt *tree) {
     /* Caller must hold tree_lock for write */
 
     /* Debug: Verify caller holds write lock (will fail with EBUSY if locked)
      * Note: This is disabled as it causes false positives. The lock requirement
      * is documented in the function comment and enforced by code review. */
     #if 0
-    int lock_test = pthread_rwlock_trywrlock(&tree->tree_lock);
+    int lock_test = metrics_rwlock_trywrlock(&tree->tree_lock, METRICS_LOCK_TREE);
     if (lock_test == 0) {
         /* We got the lock, which means caller didn't hold it - this is a bug */
-        pthread_rwlock_unlock(&tree->tree_lock);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
         assert(0 && "allocate_node_mt: caller must hold tree_lock");
     }
     #endif
@@ -170,59 +497,14 @@ static uint16_t allocate_node_mt(struct nary_tree_mt *tree) {
 
     /* Check capacity */
     if (tree->used >= tree->capacity) {
-        /* Grow array */
-        uint32_t new_capacity = tree->capacity * 2;
-        if (new_capacity > NARY_MAX_NODES) {
-            return NARY_INVALID_IDX;
-        }
-
-        /* Check memory limit before allocation */
-        size_t new_size = new_capacity * sizeof(struct nary_node_mt);
-        size_t old_size = tree->capacity * sizeof(struct nary_node_mt);
-        size_t new_free_list_size = new_capacity * sizeof(uint16_t);
-        size_t old_free_list_size = tree->capacity * sizeof(uint16_t);
-        uint64_t additional_memory = (new_size - old_size) +
-                                     (new_free_list_size - old_free_list_size);
-
-        if (tree->max_memory_bytes != NARY_MT_NO_LIMIT) {
-            uint64_t projected_usage = tree->current_memory_bytes + additional_memory;
-            if (projected_usage > tree->max_memory_bytes) {
-                /* Memory limit exceeded - return ENOSPC via backpressure */
-                tree->stats.memory_limit_hits++;
-                errno = ENOSPC;
-                return NARY_INVALID_IDX;
-            }
-        }
-
-        /* Reallocate with 128-byte alignment */
-        struct nary_node_mt *new_nodes = NULL;
-        if (posix_memalign((void **)&new_nodes, 128, new_size) != 0) {
-            return NARY_INVALID_IDX;
-        }
-
-        /* Copy existing nodes */
-        memcpy(new_nodes, tree->nodes, tree->used * sizeof(struct nary_node_mt));
-
-        /* Free old array */
-        free(tree->nodes);
-        tree->nodes = new_nodes;
-        tree->capacity = new_capacity;
-
-        /* Also grow free list */
-        uint16_t *new_free_list = realloc(tree->free_list,
-                                          new_capacity * sizeof(uint16_t));
-        if (!new_free_list) {
+        if (grow_nodes_mt(tree, tree->capacity * 2) != 0) {
             return NARY_INVALID_IDX;
         }
-        tree->free_list = new_free_list;
-
-        /* Update memory tracking */
-        tree->current_memory_bytes += additional_memory;
     }
 
     /* Use atomic fetch_add to safely increment used counter
      * This is protected by tree_lock in callers, but atomic for TSan */
-    uint16_t idx = __atomic_fetch_add(&tree->used, 1, __ATOMIC_RELEASE);
+    uint32_t idx = __atomic_fetch_add(&tree->used, 1, __ATOMIC_RELEASE);
 
     /* Initialize node lock */
     if (pthread_rwlock_init(&tree->nodes[idx].lock, NULL) != 0) {
@@ -233,294 +515,1303 @@ static uint16_t allocate_node_mt(struct nary_tree_mt *tree) {
     return idx;
 }
 
-static void init_node_mt(struct nary_node_mt *node, uint32_t inode,
-                        uint32_t parent_idx, const char *name,
-                        struct string_table *strings, uint16_t mode) {
-    node->node.inode = inode;
-    node->node.parent_idx = parent_idx;
-    node->node.num_children = 0;
-    node->node.mode = mode;
-    node->node.name_offset = string_table_intern(strings, name);
-    node->node.size = 0;
-    node->node.mtime = time(NULL);
+int nary_reserve_mt(struct nary_tree_mt *tree, uint32_t count) {
+    if (!tree) return -1;
 
-    /* Initialize children array to invalid */
-    for (int i = 0; i < NARY_BRANCHING_FACTOR; i++) {
-        node->node.children[i] = NARY_INVALID_IDX;
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return -1;
     }
-    
-    /* Clear padding */
-    memset(node->padding, 0, sizeof(node->padding));
-}
 
-uint16_t nary_find_child_mt(struct nary_tree_mt *tree,
-                            uint16_t parent_idx,
-                            const char *name) {
-    /* Check for NULL tree first before accessing tree->used */
-    if (!tree || !name) {
-        return NARY_INVALID_IDX;
+    /* Free slots are reused first; only the rest needs new capacity */
+    int ret = 0;
+    uint32_t spare = tree->capacity - tree->used + tree->free_count;
+    if (count > spare) {
+        uint32_t needed = tree->used + (count - tree->free_count);
+        uint64_t new_capacity = tree->capacity ? tree->capacity : 1;
+        while (new_capacity < needed && new_capacity < NARY_MAX_NODES) {
+            new_capacity *= 2;
+        }
+        if (new_capacity > NARY_MAX_NODES) {
+            new_capacity = NARY_MAX_NODES;
+        }
+        if (new_capacity < needed || grow_nodes_mt(tree, (uint32_t)new_capacity) != 0) {
+            ret = -1;
+        }
     }
 
-    /* Use atomic load for bounds check to avoid race with allocate_node_mt */
-    uint32_t used_snapshot = __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE);
-    if (parent_idx >= used_snapshot) {
-        return NARY_INVALID_IDX;
-    }
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    return ret;
+}
 
-    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+/* === Child Block Trees === */
 
-    /* Lock parent for reading */
-    if (pthread_rwlock_rdlock(&parent->lock) != 0) {
-        return NARY_INVALID_IDX;
+/* Compare a child's name with name (a missing name sorts first) */
+static int child_name_cmp(const struct nary_tree_mt *tree, uint32_t idx, const char *name) {
+    const char *child_name = idx < __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE) ?
+        string_table_get(&tree->strings, tree->nodes[idx].node.name_offset) : NULL;
+    return strcmp(child_name ? child_name : "", name);
+}
+
+/* Entries in a leaf (stride 1) or interior block (stride 2) */
+static uint32_t block_count(const struct nary_child_block *block, uint32_t stride) {
+    uint32_t n = 0;
+    while (n * stride < NARY_BRANCHING_FACTOR &&
+           block->children[n * stride] != NARY_INVALID_IDX) {
+        n++;
     }
+    return n;
+}
 
-    uint16_t num_children = parent->node.num_children;
+/* 8-bit fingerprint of a name (FNV-1a, folded) */
+static uint8_t name_fp(const char *name) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    h ^= h >> 16;
+    return (uint8_t)(h ^ (h >> 8));
+}
 
-    /* Optimization: Use linear search for small arrays, binary search for large
-     * Threshold at 8: linear search is faster for small N due to cache locality
-     * and avoiding the overhead of binary search comparisons */
-    if (num_children <= 8) {
-        /* Linear search for small number of children */
-        for (uint16_t i = 0; i < num_children; i++) {
-            uint16_t child_idx = parent->node.children[i];
-            if (child_idx == NARY_INVALID_IDX) break;
+static uint8_t child_fp_of(const struct nary_tree_mt *tree, uint32_t idx) {
+    const char *child_name = idx < __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE) ?
+        string_table_get(&tree->strings, tree->nodes[idx].node.name_offset) : NULL;
+    return name_fp(child_name ? child_name : "");
+}
 
-            const struct nary_node_mt *child = &tree->nodes[child_idx];
-            const char *child_name = string_table_get(&tree->strings,
-                                                      child->node.name_offset);
+/* Inline fingerprints sit beside the node in its nary_node_mt */
+static inline uint8_t *inline_fp(const struct nary_node *node) {
+    return ((struct nary_node_mt *)node)->child_fp;
+}
 
-            if (child_name && strcmp(child_name, name) == 0) {
-                pthread_rwlock_unlock(&parent->lock);
-                return child_idx;
-            }
-        }
-    } else {
-        /* Binary search through sorted children array
-         * Children are kept sorted by filename during insert/delete
-         * Complexity: O(log k) where k is branching factor
-         * Note: No need to lock children - parent lock prevents modification
-         * of children array, and name_offset is immutable once set */
-        int left = 0;
-        int right = (int)num_children - 1;
-
-        while (left <= right) {
-            int mid = left + (right - left) / 2;
-            uint16_t child_idx = parent->node.children[mid];
-
-            if (child_idx == NARY_INVALID_IDX) {
-                /* Should never happen in a properly maintained tree */
-                break;
-            }
+/* Bit i set where fps[i] == fp, for 8 fingerprints at once (SWAR) */
+static inline uint32_t fp_match8(const uint8_t *fps, uint8_t fp) {
+    uint64_t v;
+    memcpy(&v, fps, sizeof(v));
+    v ^= 0x0101010101010101ULL * fp;       /* Matching bytes become zero */
+    uint64_t t = ((v & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | v;
+    uint64_t zero = ~t & 0x8080808080808080ULL;
+    return (uint32_t)(((zero >> 7) * 0x0102040810204080ULL) >> 56);
+}
 
-            const struct nary_node_mt *child = &tree->nodes[child_idx];
-            const char *child_name = string_table_get(&tree->strings,
-                                                      child->node.name_offset);
+/* Same for the 16 fingerprints of a leaf block */
+static inline uint32_t fp_match16(const uint8_t *fps, uint8_t fp) {
+#if defined(__SSE2__)
+    __m128i v = _mm_loadu_si128((const __m128i *)fps);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char)fp)));
+#else
+    return fp_match8(fps, fp) | (fp_match8(fps + 8, fp) << 8);
+#endif
+}
 
-            if (!child_name) {
-                /* Corrupted tree state - abort search */
-                break;
-            }
+/* Grow the child block array of a heap tree (tree_lock held for write).
+ * Lookups walk the blocks holding only a node lock, or no lock at all
+ * (see Node Sequence Counters): more of the reservation is committed in
+ * place, so nothing they hold ever moves. */
+static int grow_blocks_mt(struct nary_tree_mt *tree) {
+    /* Mapped images are created at their full capacity */
+    uint64_t max_blocks = tree->block_reserve / sizeof(struct nary_child_block);
+    if (tree->is_mapped || tree->block_capacity >= max_blocks) {
+        errno = ENOSPC;
+        return -1;
+    }
 
-            int cmp = strcmp(child_name, name);
-            if (cmp == 0) {
-                /* Found exact match */
-                pthread_rwlock_unlock(&parent->lock);
-                return child_idx;
-            } else if (cmp < 0) {
-                /* child_name < name, search right half */
-                left = mid + 1;
-            } else {
-                /* child_name > name, search left half */
-                right = mid - 1;
-            }
-        }
+    uint64_t grown = tree->block_capacity ? (uint64_t)tree->block_capacity * 2 : 64;
+    uint32_t new_capacity = (uint32_t)(grown < max_blocks ? grown : max_blocks);
+    size_t new_size = (size_t)new_capacity *
+                      (sizeof(struct nary_child_block) + sizeof(struct nary_child_fp));
+    size_t old_size = (size_t)tree->block_capacity *
+                      (sizeof(struct nary_child_block) + sizeof(struct nary_child_fp));
+
+    if (tree->max_memory_bytes != NARY_MT_NO_LIMIT &&
+        tree->current_memory_bytes + (new_size - old_size) > tree->max_memory_bytes) {
+        tree->stats.memory_limit_hits++;
+        errno = ENOSPC;
+        return -1;
     }
 
-    pthread_rwlock_unlock(&parent->lock);
-    return NARY_INVALID_IDX;
+    if (commit_blocks_mt(tree, tree->block_capacity, new_capacity) != 0) {
+        return -1;
+    }
+    /* Committed before published: a reader in bounds reads mapped memory */
+    __atomic_store_n(&tree->block_capacity, new_capacity, __ATOMIC_RELEASE);
+    tree->current_memory_bytes += new_size - old_size;
+    return 0;
 }
 
-uint16_t nary_find_parent_mt(struct nary_tree_mt *tree, uint16_t child_idx) {
-    if (!tree || child_idx >= tree->used) {
-        return NARY_INVALID_IDX;
+/* Take an empty child block off the free chain or the unused tail
+ * (tree_lock held for write) */
+static uint32_t allocate_block_mt(struct nary_tree_mt *tree) {
+    uint32_t block;
+    if (tree->block_free != NARY_INVALID_IDX) {
+        block = tree->block_free;
+        tree->block_free = tree->child_blocks[block].children[0];
+    } else {
+        if (tree->block_used >= tree->block_capacity && grow_blocks_mt(tree) != 0) {
+            return NARY_INVALID_IDX;
+        }
+        block = tree->block_used++;
     }
+    memset(&tree->child_blocks[block], 0xFF, sizeof(struct nary_child_block));
+    return block;
+}
 
-    struct nary_node_mt *child_node = &tree->nodes[child_idx];
+static void free_block_mt(struct nary_tree_mt *tree, uint32_t block) {
+    tree->child_blocks[block].children[0] = tree->block_free;
+    tree->block_free = block;
+}
 
-    /* Lock child for reading to safely access parent_idx */
-    if (pthread_rwlock_rdlock(&child_node->lock) != 0) {
-        return NARY_INVALID_IDX;
+/* Free every block of a (sub)tree */
+static void free_child_tree(struct nary_tree_mt *tree, uint32_t block, uint32_t height) {
+    if (height > 0) {
+        const uint32_t *entries = tree->child_blocks[block].children;
+        uint32_t n = block_count(&tree->child_blocks[block], 2);
+        for (uint32_t i = 0; i < n; i++) {
+            free_child_tree(tree, entries[2 * i], height - 1);
+        }
     }
+    free_block_mt(tree, block);
+}
 
-    uint16_t parent_idx = child_node->node.parent_idx;
+/* Blocks from a directory's root down to one leaf */
+struct child_path {
+    uint32_t depth;                              /* Levels recorded, leaf last */
+    uint32_t block[NARY_CHILD_MAX_HEIGHT + 1];
+    uint32_t slot[NARY_CHILD_MAX_HEIGHT + 1];    /* Subtree taken per interior level */
+};
+
+/* Descend to the leaf that holds (or would hold) name */
+static void child_descend(const struct nary_tree_mt *tree, const struct nary_node *node,
+                          const char *name, struct child_path *path) {
+    uint32_t height = NARY_CHILD_HEIGHT(node);
+    uint32_t block = NARY_CHILD_ROOT(node);
+    uint32_t limit = __atomic_load_n(&tree->block_capacity, __ATOMIC_ACQUIRE);
+
+    /* Optimistic readers may meet a change half made: stay in bounds
+     * (depth 0 = no leaf), they throw the result away anyway */
+    path->depth = 0;
+    if (height > NARY_CHILD_MAX_HEIGHT || block >= limit) {
+        return;
+    }
+    for (uint32_t level = 0; level < height; level++) {
+        const uint32_t *entries = tree->child_blocks[block].children;
+        uint32_t n = block_count(&tree->child_blocks[block], 2);
+
+        /* Last subtree whose first child sorts <= name, else the first */
+        uint32_t lo = 1, hi = n;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            /* Both possible next probes load while this one compares */
+            if (mid + 1 < hi) {
+                nary_prefetch_node_mt(tree, entries[2 * ((mid + 1 + hi) / 2) + 1]);
+            }
+            if (lo < mid) {
+                nary_prefetch_node_mt(tree, entries[2 * ((lo + mid) / 2) + 1]);
+            }
+            if (child_name_cmp(tree, entries[2 * mid + 1], name) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
 
-    pthread_rwlock_unlock(&child_node->lock);
+        path->block[path->depth] = block;
+        path->slot[path->depth] = lo - 1;
+        path->depth++;
+        block = entries[2 * (lo - 1)];
+        if (block >= limit) {
+            path->depth = 0;
+            return;
+        }
+    }
 
-    return parent_idx;
+    path->block[path->depth] = block;
+    path->slot[path->depth] = 0;
+    path->depth++;
 }
 
-uint16_t nary_insert_mt(struct nary_tree_mt *tree,
-                        uint16_t parent_idx,
-                        const char *name,
-                        uint16_t mode) {
-    if (!tree || !name || parent_idx >= tree->used) {
-        return NARY_INVALID_IDX;
+/* First position in a sorted run of children whose name is >= name */
+static uint32_t children_lower_bound(const struct nary_tree_mt *tree, const uint32_t *children,
+                                     uint32_t n, const char *name, bool *found) {
+    uint32_t lo = 0, hi = n;
+    *found = false;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = child_name_cmp(tree, children[mid], name);
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            if (cmp == 0) *found = true;
+            hi = mid;
+        }
     }
+    return lo;
+}
 
-    /*
-     * CRITICAL LOCK ORDERING FIX:
-     * Must maintain consistent lock order: tree_lock → parent_lock → child_lock
-     * This prevents deadlock with nary_delete_mt which also uses tree_lock → parent → child
-     *
-     * Previous implementation locked parent first, then tree_lock, creating potential deadlock:
-     *   Thread A (insert): parent_lock → tree_lock
-     *   Thread B (delete): tree_lock → parent_lock
-     *   Result: DEADLOCK
-     */
+/* Child of node named name (node lock held, or validated afterwards)
+ *
+ * Candidates are picked by fingerprint, 8 or 16 at once, so a name is
+ * only dereferenced (child node, then string table) on a fingerprint
+ * match instead of once per probe. With several candidates, all their
+ * nodes are prefetched up front and each name while the one before it
+ * is compared. */
+static uint32_t child_lookup(const struct nary_tree_mt *tree, const struct nary_node *node,
+                             const char *name) {
+    uint16_t num_children = node->num_children;
+    uint8_t fp = name_fp(name);
+    const uint32_t *children;
+    uint32_t match;
+
+    if (num_children <= NARY_INLINE_CHILDREN) {
+        children = node->children;
+        match = fp_match8(inline_fp(node), fp) & ((1u << num_children) - 1);
+    } else {
+        /* O(log k) through the interior blocks to the leaf */
+        struct child_path path;
+        child_descend(tree, node, name, &path);
+        if (path.depth == 0) {
+            return NARY_INVALID_IDX;
+        }
+        uint32_t leaf = path.block[path.depth - 1];
+        children = tree->child_blocks[leaf].children;
+        match = fp_match16(tree->block_fp[leaf].fp, fp) &
+                ((1u << block_count(&tree->child_blocks[leaf], 1)) - 1);
+    }
 
-    /* Acquire tree-level lock FIRST to maintain consistent lock order */
-    if (pthread_rwlock_wrlock(&tree->tree_lock) != 0) {
-        return NARY_INVALID_IDX;
+    if (match & (match - 1)) {
+        for (uint32_t rest = match; rest; rest &= rest - 1) {
+            nary_prefetch_node_mt(tree, children[__builtin_ctz(rest)]);
+        }
+    }
+    while (match) {
+        uint32_t i = (uint32_t)__builtin_ctz(match);
+        match &= match - 1;
+        if (match) {
+            nary_prefetch_name_mt(tree, children[__builtin_ctz(match)]);
+        }
+        if (child_name_cmp(tree, children[i], name) == 0) {
+            return children[i];
+        }
     }
+    return NARY_INVALID_IDX;
+}
 
-    /* Verify parent_idx is still valid after acquiring tree_lock */
-    if (parent_idx >= tree->used) {
-        pthread_rwlock_unlock(&tree->tree_lock);
-        return NARY_INVALID_IDX;
+/* The subtree at path level `level` has a new first child: update the
+ * separators above it */
+static void child_fix_first(struct nary_tree_mt *tree, const struct child_path *path,
+                            uint32_t level, uint32_t first) {
+    while (level > 0) {
+        level--;
+        tree->child_blocks[path->block[level]].children[2 * path->slot[level] + 1] = first;
+        if (path->slot[level] != 0) break;
     }
+}
 
-    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+void nary_child_iter_init(struct nary_child_iter *it, const struct nary_tree_mt *tree,
+                          const struct nary_node *node) {
+    it->tree = tree;
+    it->remaining = node->num_children;
+    it->height = 0;
+    it->slot[0] = 0;
 
-    /* Now lock parent for writing */
-    if (pthread_rwlock_wrlock(&parent->lock) != 0) {
-        pthread_rwlock_unlock(&tree->tree_lock);
-        return NARY_INVALID_IDX;
+    if (node->num_children <= NARY_INLINE_CHILDREN) {
+        it->inline_children = node->children;
+        return;
     }
 
-    /* Check if parent is a directory */
-    if (!NARY_IS_DIR(&parent->node)) {
-        pthread_rwlock_unlock(&parent->lock);
-        pthread_rwlock_unlock(&tree->tree_lock);
-        return NARY_INVALID_IDX;
+    /* Leftmost leaf */
+    it->inline_children = NULL;
+    it->height = NARY_CHILD_HEIGHT(node);
+    uint32_t block = NARY_CHILD_ROOT(node);
+    for (uint32_t level = 0; level < it->height; level++) {
+        it->block[level] = block;
+        it->slot[level] = 0;
+        block = tree->child_blocks[block].children[0];
     }
+    it->block[it->height] = block;
+    it->slot[it->height] = 0;
+}
 
-    /* Check if parent is full */
-    if (parent->node.num_children >= NARY_BRANCHING_FACTOR) {
-        pthread_rwlock_unlock(&parent->lock);
-        pthread_rwlock_unlock(&tree->tree_lock);
+uint32_t nary_child_iter_next(struct nary_child_iter *it) {
+    if (it->remaining == 0) {
         return NARY_INVALID_IDX;
     }
 
-    /* Check for duplicate name
-     * Note: No need to lock children - parent write lock prevents modification
-     * of children array, and name_offset is immutable once set */
-    for (uint16_t i = 0; i < parent->node.num_children; i++) {
-        uint16_t child_idx = parent->node.children[i];
-        if (child_idx == NARY_INVALID_IDX) break;
-
-        const struct nary_node_mt *child = &tree->nodes[child_idx];
-
-        const char *child_name = string_table_get(&tree->strings,
-                                                  child->node.name_offset);
+    if (it->inline_children) {
+        it->remaining--;
+        return it->inline_children[it->slot[0]++];
+    }
 
-        if (child_name && strcmp(child_name, name) == 0) {
-            pthread_rwlock_unlock(&parent->lock);
-            pthread_rwlock_unlock(&tree->tree_lock);
-            return NARY_INVALID_IDX;  /* Duplicate name */
+    const struct nary_child_block *blocks = it->tree->child_blocks;
+    uint32_t leaf = it->height;
+    while (it->slot[leaf] >= NARY_BRANCHING_FACTOR ||
+           blocks[it->block[leaf]].children[it->slot[leaf]] == NARY_INVALID_IDX) {
+        /* Leaf exhausted: next subtree of the nearest level that has one */
+        uint32_t level = leaf;
+        do {
+            if (level == 0) {
+                it->remaining = 0;
+                return NARY_INVALID_IDX;
+            }
+            level--;
+            it->slot[level]++;
+        } while (it->slot[level] >= NARY_BLOCK_FANOUT ||
+                 blocks[it->block[level]].children[2 * it->slot[level]] == NARY_INVALID_IDX);
+
+        for (; level < leaf; level++) {
+            it->block[level + 1] = blocks[it->block[level]].children[2 * it->slot[level]];
+            it->slot[level + 1] = 0;
         }
     }
 
-    /* Allocate new node (tree_lock already held) */
-    uint16_t child_idx = allocate_node_mt(tree);
-    if (child_idx == NARY_INVALID_IDX) {
-        pthread_rwlock_unlock(&parent->lock);
-        pthread_rwlock_unlock(&tree->tree_lock);
-        return NARY_INVALID_IDX;
+    it->remaining--;
+    return blocks[it->block[leaf]].children[it->slot[leaf]++];
+}
+
+int nary_child_insert_mt(struct nary_tree_mt *tree, struct nary_node *node,
+                         uint32_t child_idx) {
+    uint32_t count = node->num_children;
+    const char *name = string_table_get(&tree->strings, tree->nodes[child_idx].node.name_offset);
+    if (count >= NARY_MAX_CHILDREN || !name) {
+        return -1;
     }
 
-    /* Re-fetch parent pointer in case of realloc */
-    parent = &tree->nodes[parent_idx];
+    uint8_t fp = name_fp(name);
+    if (count < NARY_INLINE_CHILDREN) {
+        uint8_t *fps = inline_fp(node);
+        uint32_t pos = 0;
+        while (pos < count && child_name_cmp(tree, node->children[pos], name) < 0) {
+            pos++;
+        }
+        memmove(&node->children[pos + 1], &node->children[pos], (count - pos) * sizeof(uint32_t));
+        memmove(&fps[pos + 1], &fps[pos], count - pos);
+        node->children[pos] = child_idx;
+        fps[pos] = fp;
+        node->num_children = (uint16_t)(count + 1);
+        return 0;
+    }
 
-    /* Initialize child node */
-    init_node_mt(&tree->nodes[child_idx], tree->next_inode++, parent_idx, name, &tree->strings, mode);
+    if (count == NARY_INLINE_CHILDREN) {
+        /* Outgrowing the node: the inline children become the first leaf */
+        uint32_t leaf = allocate_block_mt(tree);
+        if (leaf == NARY_INVALID_IDX) {
+            return -1;
+        }
+        memcpy(tree->child_blocks[leaf].children, node->children, sizeof(node->children));
+        memcpy(tree->block_fp[leaf].fp, inline_fp(node), NARY_INLINE_CHILDREN);
+        memset(node->children, 0xFF, sizeof(node->children));
+        NARY_CHILD_ROOT(node) = leaf;
+        NARY_CHILD_HEIGHT(node) = 0;
+    }
 
-    /* Insert child into parent's children array in sorted order
-     * This maintains the invariant that children are sorted by name for binary search
-     * Complexity: O(k) where k is branching factor (typically 16)
-     * Trade-off: Slower insert but much faster lookup O(log k) */
-    uint16_t insert_pos = parent->node.num_children;
-
-    /* Find insertion position using binary search on existing children */
-    if (parent->node.num_children > 0) {
-        int left = 0;
-        int right = (int)parent->node.num_children - 1;
-        insert_pos = 0;
-
-        /* Binary search to find insertion position */
-        while (left <= right) {
-            int mid = left + (right - left) / 2;
-            uint16_t existing_idx = parent->node.children[mid];
-            const struct nary_node_mt *existing_child = &tree->nodes[existing_idx];
-            const char *existing_name = string_table_get(&tree->strings,
-                                                         existing_child->node.name_offset);
-
-            if (existing_name) {
-                int cmp = strcmp(name, existing_name);
-                if (cmp < 0) {
-                    /* name < existing_name, insert before mid */
-                    right = mid - 1;
-                    insert_pos = mid;
-                } else {
-                    /* name > existing_name, insert after mid */
-                    left = mid + 1;
-                    insert_pos = left;
-                }
-            } else {
-                /* Corrupted entry, insert at end */
-                insert_pos = parent->node.num_children;
-                break;
+    struct child_path path;
+    child_descend(tree, node, name, &path);
+    uint32_t leaf_level = path.depth - 1;
+
+    /* Reserve a block per level that has to split (plus a new root) before
+     * changing anything, so a failed allocation leaves the tree intact */
+    uint32_t splits = 0;
+    if (block_count(&tree->child_blocks[path.block[leaf_level]], 1) == NARY_BRANCHING_FACTOR) {
+        splits = 1;
+        while (splits < path.depth &&
+               block_count(&tree->child_blocks[path.block[leaf_level - splits]], 2) == NARY_BLOCK_FANOUT) {
+            splits++;
+        }
+        if (splits == path.depth) {
+            if (NARY_CHILD_HEIGHT(node) >= NARY_CHILD_MAX_HEIGHT) {
+                return -1;
             }
+            splits++;
         }
+    }
 
-        /* Shift elements right to make space for new child */
-        for (uint16_t i = parent->node.num_children; i > insert_pos; i--) {
-            parent->node.children[i] = parent->node.children[i - 1];
+    uint32_t spare[NARY_CHILD_MAX_HEIGHT + 2];
+    for (uint32_t i = 0; i < splits; i++) {
+        spare[i] = allocate_block_mt(tree);
+        if (spare[i] == NARY_INVALID_IDX) {
+            while (i > 0) free_block_mt(tree, spare[--i]);
+            return -1;
         }
     }
 
-    /* Insert new child at sorted position */
-    parent->node.children[insert_pos] = child_idx;
-    parent->node.num_children++;
-    parent->node.mtime = time(NULL);
+    struct nary_child_block *blocks = tree->child_blocks;
+    uint32_t *leaf = blocks[path.block[leaf_level]].children;
+    uint8_t *leaf_fp = tree->block_fp[path.block[leaf_level]].fp;
+    uint32_t n = block_count(&blocks[path.block[leaf_level]], 1);
+    bool found;
+    uint32_t pos = children_lower_bound(tree, leaf, n, name, &found);
+    node->num_children = (uint16_t)(count + 1);
+
+    if (n < NARY_BRANCHING_FACTOR) {
+        memmove(&leaf[pos + 1], &leaf[pos], (n - pos) * sizeof(uint32_t));
+        memmove(&leaf_fp[pos + 1], &leaf_fp[pos], n - pos);
+        leaf[pos] = child_idx;
+        leaf_fp[pos] = fp;
+        if (pos == 0) {
+            child_fix_first(tree, &path, leaf_level, child_idx);
+        }
+        return 0;
+    }
 
-    /* Release locks in reverse order: parent, then tree */
-    pthread_rwlock_unlock(&parent->lock);
-    pthread_rwlock_unlock(&tree->tree_lock);
+    /* Split the leaf: the upper half moves to a new right sibling */
+    uint32_t entries[NARY_BRANCHING_FACTOR + 1];
+    memcpy(entries, leaf, pos * sizeof(uint32_t));
+    entries[pos] = child_idx;
+    memcpy(&entries[pos + 1], &leaf[pos], (n - pos) * sizeof(uint32_t));
+    uint8_t entry_fp[NARY_BRANCHING_FACTOR + 1];
+    memcpy(entry_fp, leaf_fp, pos);
+    entry_fp[pos] = fp;
+    memcpy(&entry_fp[pos + 1], &leaf_fp[pos], n - pos);
+
+    uint32_t left_n = (NARY_BRANCHING_FACTOR + 2) / 2;
+    uint32_t used_spare = 0;
+    uint32_t right = spare[used_spare++];
+    memset(leaf, 0xFF, sizeof(blocks[0].children));
+    memcpy(leaf, entries, left_n * sizeof(uint32_t));
+    memcpy(blocks[right].children, &entries[left_n],
+           (NARY_BRANCHING_FACTOR + 1 - left_n) * sizeof(uint32_t));
+    memcpy(leaf_fp, entry_fp, left_n);
+    memcpy(tree->block_fp[right].fp, &entry_fp[left_n], NARY_BRANCHING_FACTOR + 1 - left_n);
+    if (pos == 0) {
+        child_fix_first(tree, &path, leaf_level, child_idx);
+    }
 
-    /* Track operations for lazy rebalancing */
-    tree->op_count++;
-    if (tree->op_count >= NARY_REBALANCE_THRESHOLD) {
-        /* Trigger lazy BFS rebalancing for cache locality */
-        nary_rebalance_mt(tree);
-        tree->op_count = 0;
+    /* Hand the new sibling up, splitting full interior blocks on the way */
+    uint32_t carry_block = right;
+    uint32_t carry_first = entries[left_n];
+    for (uint32_t level = leaf_level; level-- > 0; ) {
+        uint32_t *pairs = blocks[path.block[level]].children;
+        uint32_t m = block_count(&blocks[path.block[level]], 2);
+        uint32_t at = path.slot[level] + 1;
+
+        if (m < NARY_BLOCK_FANOUT) {
+            memmove(&pairs[2 * (at + 1)], &pairs[2 * at], (m - at) * 2 * sizeof(uint32_t));
+            pairs[2 * at] = carry_block;
+            pairs[2 * at + 1] = carry_first;
+            return 0;
+        }
+
+        uint32_t merged[2 * (NARY_BLOCK_FANOUT + 1)];
+        memcpy(merged, pairs, at * 2 * sizeof(uint32_t));
+        merged[2 * at] = carry_block;
+        merged[2 * at + 1] = carry_first;
+        memcpy(&merged[2 * (at + 1)], &pairs[2 * at], (m - at) * 2 * sizeof(uint32_t));
+
+        uint32_t left_m = (NARY_BLOCK_FANOUT + 2) / 2;
+        uint32_t sibling = spare[used_spare++];
+        memset(pairs, 0xFF, sizeof(blocks[0].children));
+        memcpy(pairs, merged, left_m * 2 * sizeof(uint32_t));
+        memcpy(blocks[sibling].children, &merged[2 * left_m],
+               (NARY_BLOCK_FANOUT + 1 - left_m) * 2 * sizeof(uint32_t));
+
+        carry_block = sibling;
+        carry_first = merged[2 * left_m + 1];
+    }
+
+    /* The root split: grow a level */
+    uint32_t old_root = NARY_CHILD_ROOT(node);
+    uint32_t new_root = spare[used_spare++];
+    uint32_t *root = blocks[new_root].children;
+    root[0] = old_root;
+    root[1] = NARY_CHILD_HEIGHT(node) > 0 ? blocks[old_root].children[1]
+                                          : blocks[old_root].children[0];
+    root[2] = carry_block;
+    root[3] = carry_first;
+    NARY_CHILD_ROOT(node) = new_root;
+    NARY_CHILD_HEIGHT(node)++;
+    return 0;
+}
+
+/* Path to child_idx and its position in the leaf */
+static bool child_locate(const struct nary_tree_mt *tree, const struct nary_node *node,
+                         uint32_t child_idx, struct child_path *path, uint32_t *pos) {
+    /* By name when the child is intact */
+    if (child_idx < tree->used) {
+        const char *name = string_table_get(&tree->strings, tree->nodes[child_idx].node.name_offset);
+        if (name) {
+            child_descend(tree, node, name, path);
+            const struct nary_child_block *leaf = &tree->child_blocks[path->block[path->depth - 1]];
+            bool found;
+            *pos = children_lower_bound(tree, leaf->children, block_count(leaf, 1), name, &found);
+            if (found && leaf->children[*pos] == child_idx) {
+                return true;
+            }
+        }
+    }
+
+    /* Otherwise (e.g. a broken link) scan every leaf */
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, tree, node);
+    uint32_t idx;
+    while ((idx = nary_child_iter_next(&it)) != NARY_INVALID_IDX) {
+        if (idx == child_idx) {
+            path->depth = it.height + 1;
+            memcpy(path->block, it.block, path->depth * sizeof(uint32_t));
+            memcpy(path->slot, it.slot, path->depth * sizeof(uint32_t));
+            *pos = it.slot[it.height] - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+int nary_child_remove_mt(struct nary_tree_mt *tree, struct nary_node *node,
+                         uint32_t child_idx) {
+    uint32_t count = node->num_children;
+
+    if (count <= NARY_INLINE_CHILDREN) {
+        for (uint32_t i = 0; i < count; i++) {
+            if (node->children[i] == child_idx) {
+                uint8_t *fps = inline_fp(node);
+                memmove(&node->children[i], &node->children[i + 1],
+                        (count - 1 - i) * sizeof(uint32_t));
+                memmove(&fps[i], &fps[i + 1], count - 1 - i);
+                node->children[count - 1] = NARY_INVALID_IDX;
+                node->num_children = (uint16_t)(count - 1);
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    struct child_path path;
+    uint32_t pos;
+    if (!child_locate(tree, node, child_idx, &path, &pos)) {
+        return -1;
+    }
+
+    struct nary_child_block *blocks = tree->child_blocks;
+    uint32_t leaf_level = path.depth - 1;
+    uint32_t *leaf = blocks[path.block[leaf_level]].children;
+    uint8_t *leaf_fp = tree->block_fp[path.block[leaf_level]].fp;
+    uint32_t n = block_count(&blocks[path.block[leaf_level]], 1);
+    memmove(&leaf[pos], &leaf[pos + 1], (n - 1 - pos) * sizeof(uint32_t));
+    memmove(&leaf_fp[pos], &leaf_fp[pos + 1], n - 1 - pos);
+    leaf[n - 1] = NARY_INVALID_IDX;
+
+    if (count - 1 == NARY_INLINE_CHILDREN) {
+        /* Fits inline again: give the blocks back */
+        uint32_t inline_children[NARY_INLINE_CHILDREN];
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, tree, node);
+        for (uint32_t i = 0; i < NARY_INLINE_CHILDREN; i++) {
+            inline_children[i] = nary_child_iter_next(&it);
+        }
+        free_child_tree(tree, NARY_CHILD_ROOT(node), NARY_CHILD_HEIGHT(node));
+        memcpy(node->children, inline_children, sizeof(node->children));
+        for (uint32_t i = 0; i < NARY_INLINE_CHILDREN; i++) {
+            inline_fp(node)[i] = child_fp_of(tree, inline_children[i]);
+        }
+        node->num_children = NARY_INLINE_CHILDREN;
+        return 0;
+    }
+    node->num_children = (uint16_t)(count - 1);
+
+    if (pos == 0 && n > 1) {
+        child_fix_first(tree, &path, leaf_level, leaf[0]);
+    }
+
+    /* Drop empty blocks and merge siblings that fit in one, bottom up */
+    for (uint32_t level = leaf_level; level > 0; level--) {
+        uint32_t stride = level == leaf_level ? 1 : 2;
+        uint32_t cap = level == leaf_level ? NARY_BRANCHING_FACTOR : NARY_BLOCK_FANOUT;
+        uint32_t *pairs = blocks[path.block[level - 1]].children;
+        uint32_t pm = block_count(&blocks[path.block[level - 1]], 2);
+        uint32_t slot = path.slot[level - 1];
+        uint32_t victim;
+
+        if (block_count(&blocks[path.block[level]], stride) == 0) {
+            victim = slot;
+        } else {
+            uint32_t left, right;
+            if (slot > 0) {
+                left = slot - 1;
+                right = slot;
+            } else if (slot + 1 < pm) {
+                left = slot;
+                right = slot + 1;
+            } else {
+                break;
+            }
+
+            uint32_t lb = pairs[2 * left], rb = pairs[2 * right];
+            uint32_t lm = block_count(&blocks[lb], stride);
+            uint32_t rm = block_count(&blocks[rb], stride);
+            if (lm + rm > cap) {
+                break;
+            }
+            memcpy(&blocks[lb].children[lm * stride], blocks[rb].children,
+                   rm * stride * sizeof(uint32_t));
+            if (stride == 1) {
+                memcpy(&tree->block_fp[lb].fp[lm], tree->block_fp[rb].fp, rm);
+            }
+            victim = right;
+        }
+
+        free_block_mt(tree, pairs[2 * victim]);
+        memmove(&pairs[2 * victim], &pairs[2 * (victim + 1)],
+                (pm - 1 - victim) * 2 * sizeof(uint32_t));
+        pairs[2 * (pm - 1)] = NARY_INVALID_IDX;
+        pairs[2 * (pm - 1) + 1] = NARY_INVALID_IDX;
+        if (victim == 0 && pm > 1) {
+            child_fix_first(tree, &path, level - 1, pairs[1]);
+        }
+    }
+
+    /* Collapse roots left with a single subtree */
+    while (NARY_CHILD_HEIGHT(node) > 0) {
+        uint32_t root = NARY_CHILD_ROOT(node);
+        if (block_count(&blocks[root], 2) != 1) break;
+        NARY_CHILD_ROOT(node) = blocks[root].children[0];
+        NARY_CHILD_HEIGHT(node)--;
+        free_block_mt(tree, root);
+    }
+    return 0;
+}
+
+/* Validate a (sub)tree, adding up its children */
+static int check_child_tree(const struct nary_tree_mt *tree, uint32_t block,
+                            uint32_t height, uint32_t *count) {
+    if (block >= tree->block_used) {
+        return -1;
+    }
+
+    const struct nary_child_block *b = &tree->child_blocks[block];
+    if (height == 0) {
+        uint32_t n = block_count(b, 1);
+        *count += n;
+        return n > 0 ? 0 : -1;
+    }
+
+    uint32_t n = block_count(b, 2);
+    if (n == 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (check_child_tree(tree, b->children[2 * i], height - 1, count) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int nary_child_check_mt(const struct nary_tree_mt *tree, const struct nary_node *node) {
+    if (node->num_children <= NARY_INLINE_CHILDREN) {
+        return 0;
+    }
+    if (NARY_CHILD_HEIGHT(node) > NARY_CHILD_MAX_HEIGHT) {
+        return -1;
+    }
+
+    uint32_t count = 0;
+    if (check_child_tree(tree, NARY_CHILD_ROOT(node), NARY_CHILD_HEIGHT(node), &count) != 0) {
+        return -1;
+    }
+    return count == node->num_children ? 0 : -1;
+}
+
+/* Recompute the leaf fingerprints of a (sub)tree */
+static void fp_rebuild_tree(struct nary_tree_mt *tree, uint32_t block, uint32_t height) {
+    const uint32_t *entries = tree->child_blocks[block].children;
+    if (height == 0) {
+        uint32_t n = block_count(&tree->child_blocks[block], 1);
+        for (uint32_t i = 0; i < n; i++) {
+            tree->block_fp[block].fp[i] = child_fp_of(tree, entries[i]);
+        }
+        return;
+    }
+
+    uint32_t n = block_count(&tree->child_blocks[block], 2);
+    for (uint32_t i = 0; i < n; i++) {
+        fp_rebuild_tree(tree, entries[2 * i], height - 1);
+    }
+}
+
+int nary_child_fp_rebuild_mt(struct nary_tree_mt *tree) {
+    if (!tree) return -1;
+
+    if (!tree->block_fp && tree->block_capacity > 0) {
+        tree->block_fp = calloc(tree->block_capacity, sizeof(struct nary_child_fp));
+        if (!tree->block_fp) {
+            return -1;
+        }
+    }
+
+    for (uint32_t i = 0; i < tree->used; i++) {
+        struct nary_node_mt *node = &tree->nodes[i];
+        if (node->node.inode == 0) continue;
+
+        if (node->node.num_children <= NARY_INLINE_CHILDREN) {
+            for (uint16_t c = 0; c < node->node.num_children; c++) {
+                node->child_fp[c] = child_fp_of(tree, node->node.children[c]);
+            }
+        } else if (nary_child_check_mt(tree, &node->node) == 0) {
+            fp_rebuild_tree(tree, NARY_CHILD_ROOT(&node->node), NARY_CHILD_HEIGHT(&node->node));
+        }
+    }
+    return 0;
+}
+
+/* Rewrite the node indices held in a (sub)tree */
+static void remap_child_tree(struct nary_tree_mt *tree, uint32_t block, uint32_t height,
+                             const uint32_t *index_map) {
+    uint32_t *entries = tree->child_blocks[block].children;
+    if (height == 0) {
+        uint32_t n = block_count(&tree->child_blocks[block], 1);
+        for (uint32_t i = 0; i < n; i++) {
+            entries[i] = index_map[entries[i]];
+        }
+        return;
+    }
+
+    uint32_t n = block_count(&tree->child_blocks[block], 2);
+    for (uint32_t i = 0; i < n; i++) {
+        entries[2 * i + 1] = index_map[entries[2 * i + 1]];
+        remap_child_tree(tree, entries[2 * i], height - 1, index_map);
+    }
+}
+
+/* Point a directory's entry for old_idx (still named) at new_idx */
+static void child_replace(struct nary_tree_mt *tree, struct nary_node *dir,
+                          uint32_t old_idx, uint32_t new_idx) {
+    if (dir->num_children <= NARY_INLINE_CHILDREN) {
+        for (uint16_t c = 0; c < dir->num_children; c++) {
+            if (dir->children[c] == old_idx) dir->children[c] = new_idx;
+        }
+        return;
+    }
+
+    /* The leaf holding it, and the separators above where it comes first */
+    const char *name = string_table_get(&tree->strings, tree->nodes[old_idx].node.name_offset);
+    struct child_path path;
+    child_descend(tree, dir, name ? name : "", &path);
+    for (uint32_t level = 0; level + 1 < path.depth; level++) {
+        uint32_t *entries = tree->child_blocks[path.block[level]].children;
+        for (uint32_t i = 0; i < NARY_BLOCK_FANOUT; i++) {
+            if (entries[2 * i + 1] == old_idx) entries[2 * i + 1] = new_idx;
+        }
+    }
+    uint32_t *leaf = tree->child_blocks[path.block[path.depth - 1]].children;
+    for (uint32_t i = 0; i < NARY_BRANCHING_FACTOR; i++) {
+        if (leaf[i] == old_idx) leaf[i] = new_idx;
+    }
+}
+
+static void init_node_mt(struct nary_node_mt *node, uint32_t inode,
+                        uint32_t parent_idx, const char *name,
+                        struct string_table *strings, uint16_t mode) {
+    node->node.inode = inode;
+    node->node.parent_idx = parent_idx;
+    node->node.num_children = 0;
+    node->node.mode = mode;
+    node->node.name_offset = string_table_intern(strings, name);
+    node->node.size = 0;
+    node->node.mtime = time(NULL);
+    node->node.xattr_head = 0;  /* A reused slot keeps the old chain otherwise */
+
+    /* Initialize children array to invalid */
+    for (int i = 0; i < NARY_INLINE_CHILDREN; i++) {
+        node->node.children[i] = NARY_INVALID_IDX;
+    }
+    
+    /* No children yet */
+    memset(node->child_fp, 0, sizeof(node->child_fp));
+}
+
+uint32_t nary_find_child_mt(struct nary_tree_mt *tree,
+                            uint32_t parent_idx,
+                            const char *name) {
+    /* Check for NULL tree first before accessing tree->used */
+    if (!tree || !name) {
+        return NARY_INVALID_IDX;
+    }
+
+    /* Use atomic load for bounds check to avoid race with allocate_node_mt */
+    uint32_t used_snapshot = __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE);
+    if (parent_idx >= used_snapshot) {
+        return NARY_INVALID_IDX;
+    }
+
+    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+    note_lookup(tree, parent_idx);
+
+    if (node_reads_optimistic(tree)) {
+        /* Search a copy of the parent; its child blocks are read in place,
+         * the counter says whether they held still */
+        struct nary_node_mt snap;
+        for (int attempt = 0; attempt < NARY_SEQ_READ_RETRIES; attempt++) {
+            uint32_t seq = node_read_begin(tree, parent_idx);
+            if (seq & 1) continue;
+            memcpy(&snap.node, &parent->node, sizeof(snap.node));
+            memcpy(snap.child_fp, parent->child_fp, sizeof(snap.child_fp));
+            uint32_t child_idx = child_lookup(tree, &snap.node, name);
+            if (node_read_valid(tree, parent_idx, seq)) {
+                return child_idx;
+            }
+        }
+        node_read_fallback(tree);
+    }
+
+    /* Lock parent for reading */
+    if (metrics_rwlock_rdlock(&parent->lock, METRICS_LOCK_NODE) != 0) {
+        return NARY_INVALID_IDX;
     }
 
+    /* Note: No need to lock children - parent lock prevents modification
+     * of the children, and names only change under the parent's write lock */
+    uint32_t child_idx = child_lookup(tree, &parent->node, name);
+
+    metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
     return child_idx;
 }
 
-int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int wal_enabled) {
-    if (!tree || idx >= tree->used || idx == NARY_ROOT_IDX) {
+uint32_t nary_find_parent_mt(struct nary_tree_mt *tree, uint32_t child_idx) {
+    if (!tree || child_idx >= tree->used) {
+        return NARY_INVALID_IDX;
+    }
+
+    struct nary_node_mt *child_node = &tree->nodes[child_idx];
+
+    if (node_reads_optimistic(tree)) {
+        for (int attempt = 0; attempt < NARY_SEQ_READ_RETRIES; attempt++) {
+            uint32_t seq = node_read_begin(tree, child_idx);
+            uint32_t parent_idx = child_node->node.parent_idx;
+            if (node_read_valid(tree, child_idx, seq)) {
+                return parent_idx;
+            }
+        }
+        node_read_fallback(tree);
+    }
+
+    /* Lock child for reading to safely access parent_idx */
+    if (metrics_rwlock_rdlock(&child_node->lock, METRICS_LOCK_NODE) != 0) {
+        return NARY_INVALID_IDX;
+    }
+
+    uint32_t parent_idx = child_node->node.parent_idx;
+
+    metrics_rwlock_unlock(&child_node->lock, METRICS_LOCK_NODE);
+
+    return parent_idx;
+}
+
+/* === Inode index (built on first lookup, tree_lock held for write) === */
+
+static inline uint32_t inode_slot_of(uint32_t inode) {
+    return inode * 2654435761u;
+}
+
+static void inode_index_put(struct nary_inode_slot *slots, uint32_t mask,
+                            uint32_t inode, uint32_t idx) {
+    uint32_t slot = inode_slot_of(inode) & mask;
+    while (slots[slot].inode != 0 && slots[slot].inode != inode) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot].inode = inode;
+    slots[slot].idx = idx;
+}
+
+/* (Re)build the index from the node array, at most half full */
+static int inode_index_build(struct nary_tree_mt *tree, uint32_t live) {
+    uint32_t slots = 64;
+    while (slots < 2 * live) {
+        slots *= 2;
+    }
+
+    struct nary_inode_slot *table = calloc(slots, sizeof(*table));
+    if (!table) {
+        free(tree->inode_slots);
+        tree->inode_slots = NULL;
         return -1;
     }
 
-    struct nary_node_mt *node = &tree->nodes[idx];
-    uint16_t parent_idx = node->node.parent_idx;
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < tree->used; i++) {
+        uint32_t inode = tree->nodes[i].node.inode;
+        if (inode != 0) {
+            inode_index_put(table, slots - 1, inode, i);
+            count++;
+        }
+    }
+
+    free(tree->inode_slots);
+    tree->inode_slots = table;
+    tree->inode_slot_mask = slots - 1;
+    tree->inode_count = count;
+    return 0;
+}
+
+/* Record a new node (already initialized) */
+static void inode_index_add(struct nary_tree_mt *tree, uint32_t idx) {
+    if (!tree->inode_slots) return;
+
+    if (2 * (tree->inode_count + 1) > tree->inode_slot_mask + 1) {
+        /* Dropped on failure: the next lookup builds it again */
+        inode_index_build(tree, tree->inode_count + 1);
+        return;
+    }
+    inode_index_put(tree->inode_slots, tree->inode_slot_mask,
+                    tree->nodes[idx].node.inode, idx);
+    tree->inode_count++;
+}
+
+/* Forget an inode: backward-shift deletion keeps probe chains intact */
+static void inode_index_del(struct nary_tree_mt *tree, uint32_t inode) {
+    if (!tree->inode_slots) return;
 
+    struct nary_inode_slot *slots = tree->inode_slots;
+    uint32_t mask = tree->inode_slot_mask;
+    uint32_t hole = inode_slot_of(inode) & mask;
+    while (slots[hole].inode != inode) {
+        if (slots[hole].inode == 0) return;
+        hole = (hole + 1) & mask;
+    }
+
+    for (uint32_t next = (hole + 1) & mask; slots[next].inode != 0; next = (next + 1) & mask) {
+        uint32_t home = inode_slot_of(slots[next].inode) & mask;
+        /* Move back unless its home lies cyclically in (hole, next] */
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole].inode = 0;
+    tree->inode_count--;
+}
+
+uint32_t nary_inode_lookup_mt(struct nary_tree_mt *tree, uint32_t inode) {
+    if (!tree || inode == 0) return NARY_INVALID_IDX;
+
+    if (metrics_rwlock_rdlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return NARY_INVALID_IDX;
+    }
+    if (!tree->inode_slots) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+            return NARY_INVALID_IDX;
+        }
+        if (!tree->inode_slots) {
+            uint32_t live = 0;
+            for (uint32_t i = 0; i < tree->used; i++) {
+                live += tree->nodes[i].node.inode != 0;
+            }
+            inode_index_build(tree, live);
+        }
+    }
+
+    uint32_t idx = NARY_INVALID_IDX;
+    if (tree->inode_slots) {
+        uint32_t mask = tree->inode_slot_mask;
+        for (uint32_t slot = inode_slot_of(inode) & mask;
+             tree->inode_slots[slot].inode != 0; slot = (slot + 1) & mask) {
+            if (tree->inode_slots[slot].inode == inode) {
+                idx = tree->inode_slots[slot].idx;
+                break;
+            }
+        }
+    }
+
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    return idx;
+}
+
+uint32_t nary_insert_mt(struct nary_tree_mt *tree,
+                        uint32_t parent_idx,
+                        const char *name,
+                        uint16_t mode) {
+    if (!tree || !name || parent_idx >= tree->used) {
+        return NARY_INVALID_IDX;
+    }
+
+    /*
+     * CRITICAL LOCK ORDERING FIX:
+     * Must maintain consistent lock order: tree_lock → parent_lock → child_lock
+     * This prevents deadlock with nary_delete_mt which also uses tree_lock → parent → child
+     *
+     * Previous implementation locked parent first, then tree_lock, creating potential deadlock:
+     *   Thread A (insert): parent_lock → tree_lock
+     *   Thread B (delete): tree_lock → parent_lock
+     *   Result: DEADLOCK
+     */
+
+    /* Acquire tree-level lock FIRST to maintain consistent lock order */
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return NARY_INVALID_IDX;
+    }
+
+    /* Verify parent_idx is still valid after acquiring tree_lock */
     if (parent_idx >= tree->used) {
-        return -1;
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+
+    /* Now lock parent for writing */
+    if (metrics_rwlock_wrlock(&parent->lock, METRICS_LOCK_NODE) != 0) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    /* Check if parent is a (live) directory: a compaction step may have
+     * moved it since the caller looked it up */
+    if (parent->node.inode == 0 || !NARY_IS_DIR(&parent->node)) {
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    /* Check if parent is full */
+    if (parent->node.num_children >= NARY_MAX_CHILDREN) {
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    /* Check for duplicate name: O(log k) through the sorted children
+     * Note: No need to lock children - parent write lock prevents modification
+     * of children array, and name_offset is immutable once set */
+    if (child_lookup(tree, &parent->node, name) != NARY_INVALID_IDX) {
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;  /* Duplicate name */
+    }
+
+    /* Allocate new node (tree_lock already held) */
+    uint32_t child_idx = allocate_node_mt(tree);
+    if (child_idx == NARY_INVALID_IDX) {
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    /* Initialize child node (a reused slot may still have readers) */
+    node_write_begin(tree, child_idx);
+    init_node_mt(&tree->nodes[child_idx], tree->next_inode++, parent_idx, name, &tree->strings, mode);
+    if (tree->nodes[child_idx].node.name_offset == UINT32_MAX) {
+        /* String table full */
+        tree->nodes[child_idx].node.inode = 0;
+        node_write_end(tree, child_idx);
+        if (tree->free_count < tree->capacity) {
+            tree->free_list[tree->free_count++] = child_idx;
+        }
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+
+    /* Insert child into parent's children in sorted order
+     * This maintains the invariant that children are sorted by name for binary search
+     * Complexity: O(log k) to find the leaf, O(16) to shift within it */
+    node_write_begin(tree, parent_idx);
+    if (nary_child_insert_mt(tree, &parent->node, child_idx) != 0) {
+        /* No room for another child block: give the node back */
+        node_write_end(tree, parent_idx);
+        string_table_release(&tree->strings, tree->nodes[child_idx].node.name_offset);
+        tree->nodes[child_idx].node.inode = 0;
+        node_write_end(tree, child_idx);
+        if (tree->free_count < tree->capacity) {
+            tree->free_list[tree->free_count++] = child_idx;
+        }
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return NARY_INVALID_IDX;
+    }
+    parent->node.mtime = time(NULL);
+    node_write_end(tree, parent_idx);
+    node_write_end(tree, child_idx);
+    inode_index_add(tree, child_idx);
+
+    /* Release locks in reverse order: parent, then tree */
+    metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+
+    /* Locality is restored in the background (nary_rebalance_step_mt),
+     * never by stalling a create */
+    tree->op_count++;
+
+    return child_idx;
+}
+
+static int batch_name_cmp(const void *a, const void *b) {
+    return strcmp((*(struct nary_batch_entry *const *)a)->name,
+                  (*(struct nary_batch_entry *const *)b)->name);
+}
+
+/* Give back the first n nodes of a batch (tree_lock and parent lock held) */
+static void batch_unwind(struct nary_tree_mt *tree, struct nary_node *parent,
+                         struct nary_batch_entry **order, uint32_t n, uint32_t linked) {
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = order[i]->idx;
+        if (i < linked) {
+            nary_child_remove_mt(tree, parent, idx);
+            inode_index_del(tree, tree->nodes[idx].node.inode);
+        }
+        node_write_begin(tree, idx);
+        string_table_release(&tree->strings, tree->nodes[idx].node.name_offset);
+        tree->nodes[idx].node.inode = 0;
+        node_write_end(tree, idx);
+        if (tree->free_count < tree->capacity) {
+            tree->free_list[tree->free_count++] = idx;
+        }
+        order[i]->idx = NARY_INVALID_IDX;
+    }
+}
+
+int nary_insert_batch_mt(struct nary_tree_mt *tree, uint32_t parent_idx,
+                         struct nary_batch_entry *entries, uint32_t count,
+                         struct wal *wal, int wal_enabled) {
+    if (!tree || (!entries && count > 0)) return -EINVAL;
+    if (count == 0) return 0;
+    if (count > NARY_MAX_CHILDREN) return -ENOSPC;
+
+    /* Sorted once up front: repeats sit next to each other, and the
+     * children are linked in ascending order */
+    struct nary_batch_entry **order = malloc(count * sizeof(*order));
+    if (!order) return -ENOSPC;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!entries[i].name || entries[i].name[0] == '\0') {
+            free(order);
+            return -EINVAL;
+        }
+        entries[i].idx = NARY_INVALID_IDX;
+        order[i] = &entries[i];
+    }
+    qsort(order, count, sizeof(*order), batch_name_cmp);
+    for (uint32_t i = 1; i < count; i++) {
+        if (strcmp(order[i - 1]->name, order[i]->name) == 0) {
+            free(order);
+            return -EINVAL;
+        }
+    }
+
+    /* Lock order as in nary_insert_mt: tree_lock, then the parent */
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        free(order);
+        return -EIO;
+    }
+    if (parent_idx >= tree->used || tree->nodes[parent_idx].node.inode == 0) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        free(order);
+        return -ENOENT;
     }
 
     struct nary_node_mt *parent = &tree->nodes[parent_idx];
+    metrics_rwlock_wrlock(&parent->lock, METRICS_LOCK_NODE);
+
+    int ret = 0;
+    uint32_t made = 0, linked = 0;
+    if (!NARY_IS_DIR(&parent->node)) {
+        ret = -ENOTDIR;
+        goto out;
+    }
+    if (parent->node.num_children + count > NARY_MAX_CHILDREN) {
+        ret = -ENOSPC;
+        goto out;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (child_lookup(tree, &parent->node, order[i]->name) != NARY_INVALID_IDX) {
+            ret = -EEXIST;
+            goto out;
+        }
+    }
+
+    /* Make the nodes; nothing links to them yet */
+    for (; made < count; made++) {
+        uint32_t idx = allocate_node_mt(tree);
+        if (idx == NARY_INVALID_IDX) {
+            ret = -ENOSPC;
+            goto out;
+        }
+        node_write_begin(tree, idx);
+        init_node_mt(&tree->nodes[idx], tree->next_inode++, parent_idx, order[made]->name,
+                     &tree->strings, order[made]->mode);
+        node_write_end(tree, idx);
+        order[made]->idx = idx;
+        if (tree->nodes[idx].node.name_offset == UINT32_MAX) {
+            tree->nodes[idx].node.inode = 0;
+            if (tree->free_count < tree->capacity) {
+                tree->free_list[tree->free_count++] = idx;
+            }
+            order[made]->idx = NARY_INVALID_IDX;
+            ret = -ENOSPC;
+            goto out;
+        }
+    }
+
+    /* One transaction for the whole batch, logged before anything links */
+    uint64_t tx_id = 0;
+    if (wal_enabled && wal_begin_tx(wal, &tx_id) != 0) {
+        wal_enabled = 0;
+    }
+    for (uint32_t i = 0; wal_enabled && i < count; i++) {
+        const struct nary_node *node = &tree->nodes[order[i]->idx].node;
+        struct wal_insert_data insert_data = {
+            .parent_idx = parent_idx,
+            .inode = node->inode,
+            .name_offset = node->name_offset,
+            .mode = node->mode,
+            .timestamp = node->mtime,
+        };
+        wal_log_insert(wal, tx_id, &insert_data);
+    }
+
+    /* Link them all under one parent write section */
+    node_write_begin(tree, parent_idx);
+    for (; linked < count; linked++) {
+        if (nary_child_insert_mt(tree, &parent->node, order[linked]->idx) != 0) {
+            ret = -ENOSPC;
+            break;
+        }
+        inode_index_add(tree, order[linked]->idx);
+    }
+    if (ret == 0) {
+        parent->node.mtime = time(NULL);
+    } else {
+        batch_unwind(tree, &parent->node, order, made, linked);
+        made = 0;
+    }
+    node_write_end(tree, parent_idx);
+
+    if (wal_enabled) {
+        if (ret == 0) {
+            wal_commit_tx(wal, tx_id);
+        } else {
+            wal_abort_tx(wal, tx_id);
+        }
+    }
+    if (ret == 0) {
+        tree->op_count += count;
+    }
+
+out:
+    if (ret != 0 && made > 0) {
+        batch_unwind(tree, &parent->node, order, made, 0);
+    }
+    metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    free(order);
+    return ret;
+}
+
+/* Is idx a live node linked under its parent? (tree_lock held, so
+ * children and parents hold still) */
+static bool node_linked(struct nary_tree_mt *tree, uint32_t idx) {
+    const struct nary_node *node = &tree->nodes[idx].node;
+    if (node->inode == 0 || node->parent_idx >= tree->used) {
+        return false;
+    }
+    const char *name = string_table_get(&tree->strings, node->name_offset);
+    return name && child_lookup(tree, &tree->nodes[node->parent_idx].node, name) == idx;
+}
+
+/* Delete idx if it still holds inode (0 = whatever it holds) */
+static int delete_node_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                          struct wal *wal, int wal_enabled) {
+    if (!tree || idx >= tree->used || idx == NARY_ROOT_IDX) {
+        return -1;
+    }
+
+    struct nary_node_mt *node = &tree->nodes[idx];
 
     /*
      * CRITICAL LOCK ORDERING FIX:
@@ -537,28 +1828,38 @@ int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int
      */
 
     /* Lock tree structure first to maintain consistent lock order */
-    if (pthread_rwlock_wrlock(&tree->tree_lock) != 0) {
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
         return -1;
     }
 
+    /* A compaction step may have moved the node since the caller found
+     * idx: its old slot is retired (or already holds another node), and
+     * must be left alone */
+    if (!node_linked(tree, idx) || (inode != 0 && node->node.inode != inode)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return -ESTALE;
+    }
+    uint32_t parent_idx = node->node.parent_idx;
+    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+
     /* Now lock parent, then child - prevents race conditions */
-    if (pthread_rwlock_wrlock(&parent->lock) != 0) {
-        pthread_rwlock_unlock(&tree->tree_lock);
+    if (metrics_rwlock_wrlock(&parent->lock, METRICS_LOCK_NODE) != 0) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
         return -1;
     }
 
     /* Lock child for writing */
-    if (pthread_rwlock_wrlock(&node->lock) != 0) {
-        pthread_rwlock_unlock(&parent->lock);
-        pthread_rwlock_unlock(&tree->tree_lock);
+    if (metrics_rwlock_wrlock(&node->lock, METRICS_LOCK_NODE) != 0) {
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
         return -1;
     }
 
     /* Check if directory is empty (now safe with all locks held) */
     if (NARY_IS_DIR(&node->node) && node->node.num_children > 0) {
-        pthread_rwlock_unlock(&node->lock);
-        pthread_rwlock_unlock(&parent->lock);
-        pthread_rwlock_unlock(&tree->tree_lock);
+        metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
         return -ENOTEMPTY;
     }
 
@@ -575,37 +1876,39 @@ int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int
         wal_log_delete(wal, 0, &delete_data);
     }
 
-    /* Remove from parent's children array
-     * Children are kept sorted, so we could use binary search, but since we're
-     * searching by index (not name), linear search is simpler and still O(k) */
-    bool found = false;
-    for (uint16_t i = 0; i < parent->node.num_children; i++) {
-        if (parent->node.children[i] == idx) {
-            /* Shift remaining children down to maintain sorted order and compactness */
-            for (uint16_t j = i; j < parent->node.num_children - 1; j++) {
-                parent->node.children[j] = parent->node.children[j + 1];
-            }
-            parent->node.children[parent->node.num_children - 1] = NARY_INVALID_IDX;
-            parent->node.num_children--;
-            parent->node.mtime = time(NULL);
-            found = true;
-            break;
+    nary_paths_invalidate_begin_mt(tree);
+    node_write_begin(tree, parent_idx);
+    node_write_begin(tree, idx);
+
+    /* Remove from parent's children (found by name, so O(log k)) */
+    bool found = nary_child_remove_mt(tree, &parent->node, idx) == 0;
+    if (found) {
+        parent->node.mtime = time(NULL);
+
+        /* Mark node as free; its name stays readable until reclaimed */
+        inode_index_del(tree, node->node.inode);
+        string_table_release(&tree->strings, node->node.name_offset);
+        node->node.inode = 0;
+        node->node.num_children = 0;
+        if (tree->node_heat) {
+            __atomic_store_n(&tree->node_heat[idx], 0, __ATOMIC_RELAXED);
         }
     }
 
-    /* Mark node as free */
-    node->node.inode = 0;
-    node->node.num_children = 0;
+    node_write_end(tree, idx);
+    node_write_end(tree, parent_idx);
+    nary_paths_invalidate_end_mt(tree);
 
-    /* Add to free list while holding tree_lock (no need for retry logic) */
-    if (tree->free_count < tree->capacity) {
+    /* Add to free list while holding tree_lock (no need for retry logic);
+     * a slot that was not unlinked is still in use */
+    if (found && tree->free_count < tree->capacity) {
         tree->free_list[tree->free_count++] = idx;
     }
 
     /* Unlock in reverse order: child, parent, tree */
-    pthread_rwlock_unlock(&node->lock);
-    pthread_rwlock_unlock(&parent->lock);
-    pthread_rwlock_unlock(&tree->tree_lock);
+    metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
+    metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
 
     if (!found) {
         return -1;
@@ -616,18 +1919,372 @@ int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int
     return 0;
 }
 
-uint16_t nary_path_lookup_mt(struct nary_tree_mt *tree, const char *path) {
+int nary_delete_mt(struct nary_tree_mt *tree, uint32_t idx, struct wal *wal, int wal_enabled) {
+    return delete_node_mt(tree, idx, 0, wal, wal_enabled);
+}
+
+int nary_delete_inode_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                         struct wal *wal, int wal_enabled) {
+    if (inode == 0) {
+        return -1;
+    }
+    return delete_node_mt(tree, idx, inode, wal, wal_enabled);
+}
+
+/* Is anc the node itself or one of its ancestors? (tree_lock held) */
+static bool is_ancestor_or_self(const struct nary_tree_mt *tree, uint32_t anc, uint32_t idx) {
+    for (uint32_t depth = 0; idx < tree->used && depth < tree->used; depth++) {
+        if (idx == anc) return true;
+        if (idx == NARY_ROOT_IDX) break;
+        idx = tree->nodes[idx].node.parent_idx;
+    }
+    return false;
+}
+
+/* Checks of rename(2), in its order of precedence; target may be
+ * NARY_INVALID_IDX (tree_lock held) */
+static int rename_check(const struct nary_tree_mt *tree, uint32_t idx, uint32_t old_parent_idx,
+                        uint32_t new_parent_idx, uint32_t target, unsigned int flags) {
+    const struct nary_node *node = &tree->nodes[idx].node;
+
+    /* A directory cannot move below itself */
+    if (is_ancestor_or_self(tree, idx, new_parent_idx)) return -EINVAL;
+
+    if (flags & NARY_RENAME_EXCHANGE) {
+        if (target == NARY_INVALID_IDX) return -ENOENT;
+        if (is_ancestor_or_self(tree, target, old_parent_idx)) return -EINVAL;
+        return 0;
+    }
+
+    if (target == NARY_INVALID_IDX) {
+        if (old_parent_idx != new_parent_idx &&
+            tree->nodes[new_parent_idx].node.num_children >= NARY_MAX_CHILDREN) {
+            return -ENOSPC;
+        }
+        return 0;
+    }
+
+    const struct nary_node *victim = &tree->nodes[target].node;
+    if (flags & NARY_RENAME_NOREPLACE) return -EEXIST;
+    if (NARY_IS_DIR(node) && !NARY_IS_DIR(victim)) return -ENOTDIR;
+    if (!NARY_IS_DIR(node) && NARY_IS_DIR(victim)) return -EISDIR;
+    if (NARY_IS_DIR(victim) && victim->num_children > 0) return -ENOTEMPTY;
+    return 0;
+}
+
+/* Rename idx if it still holds inode and new_parent_idx dir_inode
+ * (0 = whatever they hold) */
+static int rename_node_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                          uint32_t new_parent_idx, uint32_t dir_inode,
+                          const char *new_name, unsigned int flags, struct nary_node *replaced,
+                          struct wal *wal, int wal_enabled) {
+    if (replaced) replaced->inode = 0;
+    if (!tree || !new_name || idx == NARY_ROOT_IDX) {
+        return -EINVAL;
+    }
+    if ((flags & NARY_RENAME_EXCHANGE) && (flags & NARY_RENAME_NOREPLACE)) {
+        return -EINVAL;
+    }
+
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return -EIO;
+    }
+
+    /* A node moved by a compaction step leaves a retired slot behind,
+     * which may already hold another node */
+    if (idx >= tree->used || new_parent_idx >= tree->used ||
+        !node_linked(tree, idx) || tree->nodes[new_parent_idx].node.inode == 0 ||
+        (inode != 0 && tree->nodes[idx].node.inode != inode) ||
+        (dir_inode != 0 && tree->nodes[new_parent_idx].node.inode != dir_inode)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return inode != 0 ? -ESTALE : -ENOENT;
+    }
+    if (!NARY_IS_DIR(&tree->nodes[new_parent_idx].node)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return -ENOTDIR;
+    }
+
+    struct nary_node_mt *node = &tree->nodes[idx];
+    uint32_t old_parent_idx = node->node.parent_idx;
+    struct nary_node_mt *old_parent = &tree->nodes[old_parent_idx];
+    struct nary_node_mt *new_parent = &tree->nodes[new_parent_idx];
+
+    /* Children only change under tree_lock, held here */
+    uint32_t target = child_lookup(tree, &new_parent->node, new_name);
+    if (target == idx) {
+        /* Same name, same directory: nothing to do */
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return 0;
+    }
+
+    int ret = rename_check(tree, idx, old_parent_idx, new_parent_idx, target, flags);
+    if (ret != 0) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return ret;
+    }
+
+    bool exchange = (flags & NARY_RENAME_EXCHANGE) != 0;
+    bool replace = !exchange && target != NARY_INVALID_IDX;
+    struct nary_node_mt *other = target != NARY_INVALID_IDX ? &tree->nodes[target] : NULL;
+
+    uint32_t old_name = node->node.name_offset;
+    uint32_t new_name_offset = exchange ? other->node.name_offset
+                                        : string_table_intern(&tree->strings, new_name);
+    if (new_name_offset == UINT32_MAX) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return -ENOSPC;
+    }
+
+    /*
+     * Lock both parents, ancestor first when one is below the other (the
+     * order lookups descend in), then the moving nodes. Neither moving
+     * node is above a parent: rename_check ruled that out.
+     */
+    struct nary_node_mt *locks[4];
+    uint32_t nlocks = 0;
+    if (old_parent_idx == new_parent_idx) {
+        locks[nlocks++] = old_parent;
+    } else if (is_ancestor_or_self(tree, new_parent_idx, old_parent_idx)) {
+        locks[nlocks++] = new_parent;
+        locks[nlocks++] = old_parent;
+    } else {
+        locks[nlocks++] = old_parent;
+        locks[nlocks++] = new_parent;
+    }
+    locks[nlocks++] = node;
+    if (other) locks[nlocks++] = other;
+    for (uint32_t i = 0; i < nlocks; i++) {
+        metrics_rwlock_wrlock(&locks[i]->lock, METRICS_LOCK_NODE);
+    }
+
+    /* The whole move is one transaction: a replaced target is logged as a
+     * delete, then the relink */
+    uint64_t tx_id = 0;
+    if (wal_enabled && wal_begin_tx(wal, &tx_id) != 0) {
+        wal_enabled = 0;
+    }
+    if (wal_enabled) {
+        if (replace) {
+            struct wal_delete_data delete_data = {
+                .node_idx = target,
+                .parent_idx = new_parent_idx,
+                .inode = other->node.inode,
+                .name_offset = other->node.name_offset,
+                .mode = other->node.mode,
+                .timestamp = other->node.mtime,
+            };
+            wal_log_delete(wal, tx_id, &delete_data);
+        }
+        struct wal_rename_data rename_data = {
+            .node_idx = idx,
+            .inode = node->node.inode,
+            .old_parent_idx = old_parent_idx,
+            .new_parent_idx = new_parent_idx,
+            .old_name_offset = old_name,
+            .new_name_offset = new_name_offset,
+            .other_idx = exchange ? target : NARY_INVALID_IDX,
+            .other_inode = exchange ? other->node.inode : 0,
+            .flags = exchange ? WAL_RENAME_EXCHANGE : 0,
+            .timestamp = (uint64_t)time(NULL),
+        };
+        wal_log_rename(wal, tx_id, &rename_data);
+    }
+
+    nary_paths_invalidate_begin_mt(tree);
+    node_write_begin(tree, old_parent_idx);
+    if (new_parent_idx != old_parent_idx) node_write_begin(tree, new_parent_idx);
+    node_write_begin(tree, idx);
+    if (other) node_write_begin(tree, target);
+
+    /* Unlink both under their current names, then relink under the new */
+    nary_child_remove_mt(tree, &old_parent->node, idx);
+    if (other) nary_child_remove_mt(tree, &new_parent->node, target);
+
+    node->node.name_offset = new_name_offset;
+    node->node.parent_idx = new_parent_idx;
+    if (exchange) {
+        other->node.name_offset = old_name;
+        other->node.parent_idx = old_parent_idx;
+    }
+
+    bool linked = nary_child_insert_mt(tree, &new_parent->node, idx) == 0;
+    if (linked && exchange &&
+        nary_child_insert_mt(tree, &old_parent->node, target) != 0) {
+        nary_child_remove_mt(tree, &new_parent->node, idx);
+        linked = false;
+    }
+    if (!linked) {
+        /* No child block for the new link: put everything back */
+        node->node.name_offset = old_name;
+        node->node.parent_idx = old_parent_idx;
+        nary_child_insert_mt(tree, &old_parent->node, idx);
+        if (other) {
+            other->node.name_offset = new_name_offset;
+            other->node.parent_idx = new_parent_idx;
+            nary_child_insert_mt(tree, &new_parent->node, target);
+        }
+        if (!exchange) string_table_release(&tree->strings, new_name_offset);
+        ret = -ENOSPC;
+    } else {
+        time_t now = time(NULL);
+        old_parent->node.mtime = now;
+        new_parent->node.mtime = now;
+
+        if (!exchange) string_table_release(&tree->strings, old_name);
+        if (replace) {
+            /* Free the target the way nary_delete_mt does */
+            inode_index_del(tree, other->node.inode);
+            string_table_release(&tree->strings, other->node.name_offset);
+            if (replaced) *replaced = other->node;
+            other->node.inode = 0;
+            other->node.num_children = 0;
+            if (tree->node_heat) {
+                __atomic_store_n(&tree->node_heat[target], 0, __ATOMIC_RELAXED);
+            }
+            if (tree->free_count < tree->capacity) {
+                tree->free_list[tree->free_count++] = target;
+            }
+        }
+    }
+
+    if (other) node_write_end(tree, target);
+    node_write_end(tree, idx);
+    if (new_parent_idx != old_parent_idx) node_write_end(tree, new_parent_idx);
+    node_write_end(tree, old_parent_idx);
+    nary_paths_invalidate_end_mt(tree);
+
+    if (wal_enabled) {
+        if (ret == 0) {
+            wal_commit_tx(wal, tx_id);
+        } else {
+            wal_abort_tx(wal, tx_id);
+        }
+    }
+
+    for (uint32_t i = nlocks; i-- > 0;) {
+        metrics_rwlock_unlock(&locks[i]->lock, METRICS_LOCK_NODE);
+    }
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+
+    if (ret == 0) {
+        tree->op_count++;
+    }
+    return ret;
+}
+
+int nary_rename_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t new_parent_idx,
+                   const char *new_name, unsigned int flags, struct nary_node *replaced,
+                   struct wal *wal, int wal_enabled) {
+    return rename_node_mt(tree, idx, 0, new_parent_idx, 0, new_name, flags, replaced,
+                          wal, wal_enabled);
+}
+
+int nary_rename_inode_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                         uint32_t new_parent_idx, uint32_t dir_inode,
+                         const char *new_name, unsigned int flags, struct nary_node *replaced,
+                         struct wal *wal, int wal_enabled) {
+    if (replaced) replaced->inode = 0;
+    if (inode == 0 || dir_inode == 0) {
+        return -EINVAL;
+    }
+    return rename_node_mt(tree, idx, inode, new_parent_idx, dir_inode, new_name, flags,
+                          replaced, wal, wal_enabled);
+}
+
+int nary_repair_link_mt(struct nary_tree_mt *tree, const struct wal_repair_data *repair) {
+    if (!tree || !repair) return -1;
+
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return -1;
+    }
+
+    uint32_t parent_idx = repair->parent_idx;
+    if (parent_idx >= tree->used || tree->nodes[parent_idx].node.inode == 0 ||
+        !S_ISDIR(tree->nodes[parent_idx].node.mode)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return -1;
+    }
+
+    struct nary_node_mt *parent = &tree->nodes[parent_idx];
+    metrics_rwlock_wrlock(&parent->lock, METRICS_LOCK_NODE);
+
+    int ret = -1;
+    if (repair->kind == WAL_REPAIR_REATTACH) {
+        uint32_t idx = repair->node_idx;
+        struct nary_node *node = idx < tree->used && idx != parent_idx ?
+            &tree->nodes[idx].node : NULL;
+        if (node && node->inode == repair->inode) {
+            struct nary_child_iter it;
+            nary_child_iter_init(&it, tree, &parent->node);
+            uint32_t listed = 0;
+            for (uint32_t c = 0; c < parent->node.num_children && !listed; c++) {
+                listed = nary_child_iter_next(&it) == idx;
+            }
+
+            if (node->parent_idx < tree->used) {
+                ret = 1;  /* Has a parent (again) */
+            } else if (listed) {
+                /* Still listed: only the back link was lost */
+                node_write_begin(tree, idx);
+                node->parent_idx = parent_idx;
+                node_write_end(tree, idx);
+                ret = 0;
+            } else {
+                node_write_begin(tree, parent_idx);
+                nary_paths_invalidate_begin_mt(tree);
+                if (nary_child_insert_mt(tree, &parent->node, idx) == 0) {
+                    node->parent_idx = parent_idx;
+                    ret = 0;
+                }
+                nary_paths_invalidate_end_mt(tree);
+                node_write_end(tree, parent_idx);
+            }
+        }
+    } else if (repair->kind == WAL_REPAIR_UNLINK) {
+        ret = 1;  /* Not linked, or names a node by now */
+        if (repair->child_idx >= tree->used) {
+            node_write_begin(tree, parent_idx);
+            nary_paths_invalidate_begin_mt(tree);
+            if (nary_child_remove_mt(tree, &parent->node, repair->child_idx) == 0) {
+                ret = 0;
+            }
+            nary_paths_invalidate_end_mt(tree);
+            node_write_end(tree, parent_idx);
+        }
+    }
+
+    metrics_rwlock_unlock(&parent->lock, METRICS_LOCK_NODE);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    return ret;
+}
+
+static uint32_t path_lookup_once(struct nary_tree_mt *tree, const char *path);
+
+uint32_t nary_path_lookup_mt(struct nary_tree_mt *tree, const char *path) {
     if (!tree || !path || path[0] != '/') {
         return NARY_INVALID_IDX;
     }
 
+    /* A compaction step may move a directory between two components:
+     * a miss only counts if no index moved during the walk */
+    for (int attempt = 0; ; attempt++) {
+        uint64_t gen = nary_paths_generation_mt(tree);
+        uint32_t idx = path_lookup_once(tree, path);
+        if (idx != NARY_INVALID_IDX || attempt >= NARY_SEQ_READ_RETRIES ||
+            (gen != NARY_PATHS_UNSTABLE && gen == nary_paths_generation_mt(tree))) {
+            return idx;
+        }
+    }
+}
+
+static uint32_t path_lookup_once(struct nary_tree_mt *tree, const char *path) {
     /* Root directory */
     if (strcmp(path, "/") == 0) {
         return NARY_ROOT_IDX;
     }
 
     /* Parse path components with path traversal protection */
-    uint16_t current_idx = NARY_ROOT_IDX;
+    uint32_t current_idx = NARY_ROOT_IDX;
     char path_copy[PATH_MAX];
     strncpy(path_copy, path, PATH_MAX - 1);
     path_copy[PATH_MAX - 1] = '\0';
@@ -659,33 +2316,68 @@ uint16_t nary_path_lookup_mt(struct nary_tree_mt *tree, const char *path) {
         if (current_idx == NARY_INVALID_IDX) {
             return NARY_INVALID_IDX;
         }
+        /* Searched (or read by the caller) next: start loading it while
+         * the next component is split off and checked */
+        nary_prefetch_node_mt(tree, current_idx);
         token = strtok_r(NULL, "/", &saveptr);
     }
 
     return current_idx;
 }
 
-int nary_read_node_mt(struct nary_tree_mt *tree, uint16_t idx,
+uint64_t nary_paths_generation_mt(const struct nary_tree_mt *tree) {
+    if (!tree) return NARY_PATHS_UNSTABLE;
+
+    if (__atomic_load_n(&tree->path_invalidating, __ATOMIC_SEQ_CST) != 0) {
+        return NARY_PATHS_UNSTABLE;
+    }
+    return __atomic_load_n(&tree->path_generation, __ATOMIC_SEQ_CST);
+}
+
+void nary_paths_invalidate_begin_mt(struct nary_tree_mt *tree) {
+    __atomic_fetch_add(&tree->path_invalidating, 1, __ATOMIC_SEQ_CST);
+}
+
+void nary_paths_invalidate_end_mt(struct nary_tree_mt *tree) {
+    /* Bump before dropping the count so no reader sees the old
+     * generation once this change is visible */
+    __atomic_fetch_add(&tree->path_generation, 1, __ATOMIC_SEQ_CST);
+    __atomic_fetch_sub(&tree->path_invalidating, 1, __ATOMIC_SEQ_CST);
+}
+
+int nary_read_node_mt(struct nary_tree_mt *tree, uint32_t idx,
                       struct nary_node *out_node) {
     if (!tree || !out_node || idx >= tree->used) {
         return -1;
     }
 
-    struct nary_node_mt *node = &tree->nodes[idx];
-
+    struct nary_node_mt *node = &tree->nodes[idx];
+
+    if (node_reads_optimistic(tree)) {
+        for (int attempt = 0; attempt < NARY_SEQ_READ_RETRIES; attempt++) {
+            uint32_t seq = node_read_begin(tree, idx);
+            if (seq & 1) continue;
+            memcpy(out_node, &node->node, sizeof(struct nary_node));
+            if (node_read_valid(tree, idx, seq)) {
+                return 0;
+            }
+        }
+        node_read_fallback(tree);
+    }
+
     /* Lock node for reading */
-    if (pthread_rwlock_rdlock(&node->lock) != 0) {
+    if (metrics_rwlock_rdlock(&node->lock, METRICS_LOCK_NODE) != 0) {
         return -1;
     }
 
     /* Copy node data */
     memcpy(out_node, &node->node, sizeof(struct nary_node));
 
-    pthread_rwlock_unlock(&node->lock);
+    metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
     return 0;
 }
 
-int nary_update_node_mt(struct nary_tree_mt *tree, uint16_t idx,
+int nary_update_node_mt(struct nary_tree_mt *tree, uint32_t idx,
                         const struct nary_node *new_node) {
     if (!tree || !new_node || idx >= tree->used) {
         return -1;
@@ -694,20 +2386,40 @@ int nary_update_node_mt(struct nary_tree_mt *tree, uint16_t idx,
     struct nary_node_mt *node = &tree->nodes[idx];
 
     /* Lock node for writing */
-    if (pthread_rwlock_wrlock(&node->lock) != 0) {
+    if (metrics_rwlock_wrlock(&node->lock, METRICS_LOCK_NODE) != 0) {
         return -1;
     }
 
     /* Update safe fields: mode, size, mtime */
+    node_write_begin(tree, idx);
     node->node.mode = new_node->mode;
     node->node.size = new_node->size;
     node->node.mtime = new_node->mtime;
+    node_write_end(tree, idx);
+
+    metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
+    return 0;
+}
+
+int nary_set_xattr_head_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t head) {
+    if (!tree || idx >= tree->used) {
+        return -1;
+    }
+
+    struct nary_node_mt *node = &tree->nodes[idx];
+    if (metrics_rwlock_wrlock(&node->lock, METRICS_LOCK_NODE) != 0) {
+        return -1;
+    }
+
+    node_write_begin(tree, idx);
+    node->node.xattr_head = head;
+    node_write_end(tree, idx);
 
-    pthread_rwlock_unlock(&node->lock);
+    metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
     return 0;
 }
 
-int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint16_t idx, size_t new_size, time_t new_mtime) {
+int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint32_t idx, size_t new_size, time_t new_mtime) {
     if (!tree || idx >= tree->used) {
         return -1;
     }
@@ -715,32 +2427,39 @@ int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint16_t idx, size_t ne
     struct nary_node_mt *node = &tree->nodes[idx];
 
     /* Lock node for writing */
-    if (pthread_rwlock_wrlock(&node->lock) != 0) {
+    if (metrics_rwlock_wrlock(&node->lock, METRICS_LOCK_NODE) != 0) {
         return -1;
     }
 
     /* Update size and mtime */
+    node_write_begin(tree, idx);
     node->node.size = new_size;
     node->node.mtime = new_mtime;
+    node_write_end(tree, idx);
 
-    pthread_rwlock_unlock(&node->lock);
+    metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
     return 0;
 }
 
-int nary_lock_read(struct nary_tree_mt *tree, uint16_t idx) {
+int nary_lock_read(struct nary_tree_mt *tree, uint32_t idx) {
     if (!tree || idx >= tree->used) return -1;
-    return pthread_rwlock_rdlock(&tree->nodes[idx].lock);
+    return metrics_rwlock_rdlock(&tree->nodes[idx].lock, METRICS_LOCK_NODE);
 }
 
-int nary_lock_write(struct nary_tree_mt *tree, uint16_t idx) __attribute__((unused));
-int nary_lock_write(struct nary_tree_mt *tree, uint16_t idx) {
+int nary_lock_write(struct nary_tree_mt *tree, uint32_t idx) __attribute__((unused));
+int nary_lock_write(struct nary_tree_mt *tree, uint32_t idx) {
     if (!tree || idx >= tree->used) return -1;
-    return pthread_rwlock_wrlock(&tree->nodes[idx].lock);
+    return metrics_rwlock_wrlock(&tree->nodes[idx].lock, METRICS_LOCK_NODE);
 }
 
-int nary_unlock(struct nary_tree_mt *tree, uint16_t idx) {
+int nary_unlock(struct nary_tree_mt *tree, uint32_t idx) {
     if (!tree || idx >= tree->used) return -1;
-    return pthread_rwlock_unlock(&tree->nodes[idx].lock);
+    return metrics_rwlock_unlock(&tree->nodes[idx].lock, METRICS_LOCK_NODE);
+}
+
+uint32_t nary_node_version_mt(const struct nary_tree_mt *tree, uint32_t idx) {
+    if (!tree || !tree->node_seq || idx >= tree->used) return 1;
+    return node_read_begin(tree, idx);
 }
 
 /**
@@ -754,9 +2473,9 @@ int nary_unlock(struct nary_tree_mt *tree, uint16_t idx) {
  * 1. Acquire exclusive tree lock (prevents all concurrent modifications)
  * 2. Perform BFS traversal starting from root
  * 3. Build mapping from old indices to new BFS-ordered indices
- * 4. Compact nodes into new array in BFS order
+ * 4. Compact nodes in place in BFS order
  * 5. Update all parent/child pointers to new indices
- * 6. Update free list with compacted indices
+ * 6. Reset the free list (compaction leaves no holes)
  *
  * Thread Safety:
  * - Acquires exclusive write lock on tree_lock for entire operation
@@ -765,26 +2484,38 @@ int nary_unlock(struct nary_tree_mt *tree, uint16_t idx) {
  *
  * Performance:
  * - Complexity: O(n) where n is number of active nodes
- * - Memory: Allocates temporary arrays for mapping and BFS queue
+ * - Memory: Allocates temporary arrays for mapping, BFS queue and staged nodes
  * - Triggered every NARY_REBALANCE_THRESHOLD operations (lazy)
  */
-int nary_rebalance_mt(struct nary_tree_mt *tree) {
+/* Rebalance, also moving *track (if given) to its node's new index */
+static int rebalance_mt(struct nary_tree_mt *tree, uint32_t *track) {
     if (!tree || tree->used == 0) return 0;
 
     /* Acquire exclusive tree lock for entire rebalancing operation */
-    if (pthread_rwlock_wrlock(&tree->tree_lock) != 0) {
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
         return -1;
     }
 
-    /* Allocate temporary arrays for rebalancing */
-    uint16_t *index_map = malloc(tree->used * sizeof(uint16_t));
-    uint16_t *bfs_queue = malloc(tree->used * sizeof(uint16_t));
-    struct nary_node_mt *new_nodes = NULL;
+    /* Snapshots refer to nodes by index: nothing moves while one is held */
+    if (__atomic_load_n(&tree->snap_epoch, __ATOMIC_RELAXED)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return 0;
+    }
+    uint64_t pause_start = pause_clock_ns();
+
+    /* Allocate temporary arrays for rebalancing; nodes are staged and
+     * written back in place, so mapped images can be compacted too */
+    uint32_t *index_map = malloc(tree->used * sizeof(uint32_t));
+    uint32_t *bfs_queue = malloc(tree->used * sizeof(uint32_t));
+    struct nary_node *staged = malloc(tree->used * sizeof(struct nary_node));
+    uint8_t (*staged_fp)[NARY_INLINE_CHILDREN] = malloc(tree->used * sizeof(*staged_fp));
 
-    if (!index_map || !bfs_queue) {
+    if (!index_map || !bfs_queue || !staged || !staged_fp) {
         free(index_map);
         free(bfs_queue);
-        pthread_rwlock_unlock(&tree->tree_lock);
+        free(staged);
+        free(staged_fp);
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
         return -1;
     }
 
@@ -793,16 +2524,6 @@ int nary_rebalance_mt(struct nary_tree_mt *tree) {
         index_map[i] = NARY_INVALID_IDX;
     }
 
-    /* Allocate new node array with same capacity and alignment */
-    size_t new_size = tree->capacity * sizeof(struct nary_node_mt);
-    if (posix_memalign((void **)&new_nodes, 128, new_size) != 0) {
-        free(index_map);
-        free(bfs_queue);
-        pthread_rwlock_unlock(&tree->tree_lock);
-        return -1;
-    }
-    memset(new_nodes, 0, new_size);
-
     /* BFS traversal to determine new ordering */
     uint32_t queue_head = 0;
     uint32_t queue_tail = 0;
@@ -813,126 +2534,817 @@ int nary_rebalance_mt(struct nary_tree_mt *tree) {
     index_map[NARY_ROOT_IDX] = new_idx++;
 
     while (queue_head < queue_tail) {
-        uint16_t old_idx = bfs_queue[queue_head++];
+        uint32_t old_idx = bfs_queue[queue_head++];
         struct nary_node_mt *old_node = &tree->nodes[old_idx];
 
         /* Lock node for reading to safely access children */
-        if (pthread_rwlock_rdlock(&old_node->lock) != 0) {
+        if (metrics_rwlock_rdlock(&old_node->lock, METRICS_LOCK_NODE) != 0) {
             /* Lock failure - abort rebalancing */
-            free(new_nodes);
+            free(staged_fp);
+            free(staged);
             free(bfs_queue);
             free(index_map);
-            pthread_rwlock_unlock(&tree->tree_lock);
+            metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
             return -1;
         }
 
         /* Skip logically deleted nodes */
         if (old_node->node.inode == 0) {
-            pthread_rwlock_unlock(&old_node->lock);
+            memset(&staged[index_map[old_idx]], 0, sizeof(struct nary_node));
+            memset(staged_fp[index_map[old_idx]], 0, sizeof(staged_fp[0]));
+            metrics_rwlock_unlock(&old_node->lock, METRICS_LOCK_NODE);
             continue;
         }
 
         /* Enqueue children for BFS traversal */
-        for (uint16_t i = 0; i < old_node->node.num_children; i++) {
-            uint16_t child_idx = old_node->node.children[i];
-            if (child_idx == NARY_INVALID_IDX) break;
-
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, tree, &old_node->node);
+        uint32_t child_idx;
+        while ((child_idx = nary_child_iter_next(&it)) != NARY_INVALID_IDX) {
             /* Assign new index to child */
-            if (index_map[child_idx] == NARY_INVALID_IDX) {
+            if (child_idx < tree->used && index_map[child_idx] == NARY_INVALID_IDX) {
                 index_map[child_idx] = new_idx++;
                 bfs_queue[queue_tail++] = child_idx;
             }
         }
 
-        pthread_rwlock_unlock(&old_node->lock);
+        /* Stage the node at its new position */
+        memcpy(&staged[index_map[old_idx]], &old_node->node, sizeof(struct nary_node));
+        memcpy(staged_fp[index_map[old_idx]], old_node->child_fp, sizeof(old_node->child_fp));
+
+        metrics_rwlock_unlock(&old_node->lock, METRICS_LOCK_NODE);
+    }
+
+    /* Nothing can fail from here on: every index is about to change */
+    nary_paths_invalidate_begin_mt(tree);
+    uint32_t old_used = tree->used;
+    for (uint32_t i = 0; i < old_used; i++) {
+        node_write_begin(tree, i);
+    }
+
+    /* Destroy old node locks */
+    for (uint32_t i = 0; i < tree->used; i++) {
+        if (tree->nodes[i].node.inode != 0) {
+            pthread_rwlock_destroy(&tree->nodes[i].lock);
+        }
+    }
+
+    /* Write nodes back in BFS order with their indices updated */
+    for (uint32_t i = 0; i < new_idx; i++) {
+        struct nary_node *node = &staged[i];
+
+        /* Update parent index */
+        if (node->parent_idx != NARY_INVALID_IDX) {
+            node->parent_idx = index_map[node->parent_idx];
+        }
+
+        /* Update children indices (child blocks stay where they are) */
+        if (node->num_children > NARY_INLINE_CHILDREN) {
+            remap_child_tree(tree, NARY_CHILD_ROOT(node), NARY_CHILD_HEIGHT(node), index_map);
+        } else {
+            for (uint16_t c = 0; c < node->num_children; c++) {
+                uint32_t old_child_idx = node->children[c];
+                if (old_child_idx == NARY_INVALID_IDX) break;
+                node->children[c] = index_map[old_child_idx];
+            }
+        }
+
+        memcpy(&tree->nodes[i].node, node, sizeof(struct nary_node));
+        memcpy(tree->nodes[i].child_fp, staged_fp[i], sizeof(staged_fp[i]));
+        pthread_rwlock_init(&tree->nodes[i].lock, NULL);
     }
 
-    /* Copy nodes to new array in BFS order and update indices */
-    for (uint32_t old_i = 0; old_i < tree->used; old_i++) {
-        if (index_map[old_i] == NARY_INVALID_IDX) continue;
+    /* Clear the slots left behind by compaction */
+    memset(&tree->nodes[new_idx], 0,
+           (old_used - new_idx) * sizeof(struct nary_node_mt));
+    tree->used = new_idx;
+    for (uint32_t i = 0; i < old_used; i++) {
+        node_write_end(tree, i);
+    }
 
-        uint16_t new_i = index_map[old_i];
-        struct nary_node_mt *old_node = &tree->nodes[old_i];
-        struct nary_node_mt *new_node = &new_nodes[new_i];
+    /* Every index >= used is free again, no free list needed */
+    tree->free_count = 0;
+    tree->retired_count = 0;
 
-        /* Lock old node for reading */
-        if (pthread_rwlock_rdlock(&old_node->lock) != 0) {
-            /* Lock failure - abort */
-            free(new_nodes);
-            free(bfs_queue);
-            free(index_map);
-            pthread_rwlock_unlock(&tree->tree_lock);
+    /* Heat belonged to the old indices */
+    for (uint32_t i = 0; tree->node_heat && i < old_used; i++) {
+        __atomic_store_n(&tree->node_heat[i], 0, __ATOMIC_RELAXED);
+    }
+
+    /* Re-point the inode index at the new slots */
+    if (tree->inode_slots) {
+        inode_index_build(tree, tree->inode_count);
+    }
+
+    nary_paths_invalidate_end_mt(tree);
+
+    if (track && *track < old_used) {
+        *track = index_map[*track];
+    }
+    tree->stats.nodes_moved += new_idx;
+    record_pause(tree, pause_start);
+
+    /* Cleanup temporary arrays */
+    free(staged_fp);
+    free(staged);
+    free(bfs_queue);
+    free(index_map);
+
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    return 0;
+}
+
+int nary_rebalance_mt(struct nary_tree_mt *tree) {
+    return rebalance_mt(tree, NULL);
+}
+
+int nary_strings_recount_mt(struct nary_tree_mt *tree) {
+    if (!tree) return -1;
+
+    uint32_t missing = 0;
+    for (uint32_t i = 0; i < tree->used; i++) {
+        const struct nary_node *node = &tree->nodes[i].node;
+        if (node->inode != 0 &&
+            string_table_ref(&tree->strings, node->name_offset) != 0) {
+            missing++;
+        }
+    }
+    return missing ? -1 : 0;
+}
+
+/* === Incremental Compaction === */
+
+/* Everything below runs with tree_lock held for write */
+
+/* Slots vacated by the previous step: stale indices had a whole step
+ * interval to drain, now they may hold new nodes */
+static void release_retired(struct nary_tree_mt *tree) {
+    for (uint32_t i = 0; i < tree->retired_count; i++) {
+        if (tree->free_count < tree->capacity) {
+            tree->free_list[tree->free_count++] = tree->retired[i];
+        }
+    }
+    tree->retired_count = 0;
+}
+
+/* Try-lock a node's children for writing; on failure nothing stays locked
+ * @return Children locked (into held), or -1 */
+static int lock_children(struct nary_tree_mt *tree, const struct nary_node *node,
+                         uint32_t *held, uint32_t max) {
+    uint32_t n = 0;
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, tree, node);
+    uint32_t child;
+    while ((child = nary_child_iter_next(&it)) != NARY_INVALID_IDX) {
+        if (n >= max || child >= tree->used ||
+            metrics_rwlock_trywrlock(&tree->nodes[child].lock, METRICS_LOCK_NODE) != 0) {
+            while (n > 0) metrics_rwlock_unlock(&tree->nodes[held[--n]].lock, METRICS_LOCK_NODE);
             return -1;
         }
+        held[n++] = child;
+    }
+    return (int)n;
+}
 
-        /* Copy node data */
-        memcpy(&new_node->node, &old_node->node, sizeof(struct nary_node));
+/* Move node from (a child of dir; dir, from and from's children write
+ * locked, dir inside a write section) to the fresh slot at the end */
+static uint32_t move_node(struct nary_tree_mt *tree, struct nary_node *dir,
+                          uint32_t from, const uint32_t *kids, uint32_t kid_count) {
+    uint32_t to = tree->used;
+    struct nary_node_mt *src = &tree->nodes[from];
+    struct nary_node_mt *dst = &tree->nodes[to];
+
+    pthread_rwlock_init(&dst->lock, NULL);
+    node_write_begin(tree, to);
+    dst->node = src->node;
+    memcpy(dst->child_fp, src->child_fp, sizeof(dst->child_fp));
+    node_write_end(tree, to);
+    __atomic_store_n(&tree->used, to + 1, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&tree->node_heat[to],
+                     __atomic_exchange_n(&tree->node_heat[from], 0, __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+
+    child_replace(tree, dir, from, to);
+    for (uint32_t i = 0; i < kid_count; i++) {
+        node_write_begin(tree, kids[i]);
+        tree->nodes[kids[i]].node.parent_idx = to;
+        node_write_end(tree, kids[i]);
+    }
+    if (tree->inode_slots) {
+        inode_index_put(tree->inode_slots, tree->inode_slot_mask, dst->node.inode, to);
+    }
 
-        /* Update parent index */
-        if (new_node->node.parent_idx != NARY_INVALID_IDX) {
-            new_node->node.parent_idx = index_map[new_node->node.parent_idx];
+    /* Nothing left to find through a stale index: the name reference
+     * and the link now belong to the copy */
+    node_write_begin(tree, from);
+    src->node.inode = 0;
+    src->node.num_children = 0;
+    src->node.parent_idx = NARY_INVALID_IDX;
+    src->node.name_offset = UINT32_MAX;
+    node_write_end(tree, from);
+    tree->retired[tree->retired_count++] = from;
+    return to;
+}
+
+/* Gather up to budget nodes' worth of dir's children at the end of the
+ * array, continuing a run an earlier step started
+ * @return Nodes moved; *done set once dir needs no more work */
+static uint32_t gather_children(struct nary_tree_mt *tree, uint32_t dir_idx, uint32_t budget,
+                                uint32_t *scratch, int *invalidating, int *done) {
+    struct nary_node_mt *dir = &tree->nodes[dir_idx];
+    *done = 0;
+    if (metrics_rwlock_trywrlock(&dir->lock, METRICS_LOCK_NODE) != 0) {
+        return 0;  /* In use: next step */
+    }
+    if (dir->node.inode == 0 || !NARY_IS_DIR(&dir->node) || dir->node.num_children < 2) {
+        metrics_rwlock_unlock(&dir->lock, METRICS_LOCK_NODE);
+        *done = 1;
+        return 0;
+    }
+
+    /* Already gathered prefix; moving resumes there only if it ends the array */
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, tree, &dir->node);
+    uint32_t prev = nary_child_iter_next(&it), prefix = 1, child;
+    while ((child = nary_child_iter_next(&it)) != NARY_INVALID_IDX && child == prev + 1) {
+        prev = child;
+        prefix++;
+    }
+    if (prefix == dir->node.num_children) {
+        metrics_rwlock_unlock(&dir->lock, METRICS_LOCK_NODE);
+        *done = 1;
+        return 0;
+    }
+    uint32_t skip = prev + 1 == tree->used ? prefix : 0;
+
+    uint32_t moved = 0;
+    int entered = 0;
+    nary_child_iter_init(&it, tree, &dir->node);
+    for (uint32_t pos = 0; (child = nary_child_iter_next(&it)) != NARY_INVALID_IDX; pos++) {
+        if (pos < skip) continue;
+        if (moved >= budget || child >= tree->used) break;
+
+        struct nary_node_mt *node = &tree->nodes[child];
+        if (metrics_rwlock_trywrlock(&node->lock, METRICS_LOCK_NODE) != 0) break;
+
+        /* Its children learn the new parent index too */
+        int kids = NARY_IS_DIR(&node->node) ?
+                   lock_children(tree, &node->node, scratch, budget - moved - 1) : 0;
+        if (kids < 0 ||
+            (tree->used >= tree->capacity && grow_nodes_mt(tree, tree->capacity * 2) != 0)) {
+            for (int i = 0; i < kids; i++) metrics_rwlock_unlock(&tree->nodes[scratch[i]].lock, METRICS_LOCK_NODE);
+            metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
+            if (moved == 0 && kids < 0) *done = 1;  /* Too wide to move with this budget */
+            break;
         }
 
-        /* Update children indices */
-        for (uint16_t i = 0; i < new_node->node.num_children; i++) {
-            uint16_t old_child_idx = new_node->node.children[i];
-            if (old_child_idx == NARY_INVALID_IDX) break;
-            new_node->node.children[i] = index_map[old_child_idx];
+        if (!*invalidating) {
+            nary_paths_invalidate_begin_mt(tree);
+            *invalidating = 1;
         }
+        if (!entered) {
+            node_write_begin(tree, dir_idx);
+            entered = 1;
+        }
+        move_node(tree, &dir->node, child, scratch, (uint32_t)kids);
+        moved += 1 + (uint32_t)kids;
 
-        pthread_rwlock_unlock(&old_node->lock);
+        for (int i = 0; i < kids; i++) metrics_rwlock_unlock(&tree->nodes[scratch[i]].lock, METRICS_LOCK_NODE);
+        metrics_rwlock_unlock(&node->lock, METRICS_LOCK_NODE);
+    }
 
-        /* Initialize new node lock */
-        if (pthread_rwlock_init(&new_node->lock, NULL) != 0) {
-            /* Cleanup already initialized locks */
-            for (uint16_t j = 0; j < new_i; j++) {
-                pthread_rwlock_destroy(&new_nodes[j].lock);
-            }
-            free(new_nodes);
-            free(bfs_queue);
-            free(index_map);
-            pthread_rwlock_unlock(&tree->tree_lock);
+    if (entered) {
+        node_write_end(tree, dir_idx);
+    }
+    metrics_rwlock_unlock(&dir->lock, METRICS_LOCK_NODE);
+    return moved;
+}
+
+int nary_rebalance_step_mt(struct nary_tree_mt *tree, uint32_t max_nodes) {
+    if (!tree || max_nodes == 0) return -1;
+    if (!tree->node_heat) return 0;
+
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        return -1;
+    }
+    if (__atomic_load_n(&tree->snap_epoch, __ATOMIC_RELAXED)) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return 0;  /* Paused while snapshots are held (see rebalance_mt) */
+    }
+    uint64_t pause_start = pause_clock_ns();
+
+    release_retired(tree);
+    if (tree->retired_capacity < max_nodes) {
+        uint32_t *retired = realloc(tree->retired, max_nodes * sizeof(uint32_t));
+        if (!retired) {
+            metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
             return -1;
         }
+        tree->retired = retired;
+        tree->retired_capacity = max_nodes;
+    }
+    uint32_t *scratch = malloc(max_nodes * sizeof(uint32_t));
+    if (!scratch) {
+        metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+        return -1;
     }
 
-    /* Destroy old node locks */
-    for (uint32_t i = 0; i < tree->used; i++) {
-        if (tree->nodes[i].node.inode != 0) {
-            pthread_rwlock_destroy(&tree->nodes[i].lock);
+    /* Hot directories, hottest first */
+    uint32_t hot[NARY_HOT_RING];
+    uint32_t hot_count = 0;
+    for (uint32_t i = 0; i < NARY_HOT_RING; i++) {
+        uint32_t d = __atomic_load_n(&tree->hot_ring[i], __ATOMIC_RELAXED);
+        if (d >= tree->used ||
+            __atomic_load_n(&tree->node_heat[d], __ATOMIC_RELAXED) < NARY_HEAT_HOT) {
+            continue;
         }
+        uint32_t pos = hot_count;
+        bool seen = false;
+        for (uint32_t j = 0; j < hot_count; j++) seen |= hot[j] == d;
+        if (seen) continue;
+        while (pos > 0 && __atomic_load_n(&tree->node_heat[hot[pos - 1]], __ATOMIC_RELAXED) <
+                          __atomic_load_n(&tree->node_heat[d], __ATOMIC_RELAXED)) {
+            hot[pos] = hot[pos - 1];
+            pos--;
+        }
+        hot[pos] = d;
+        hot_count++;
     }
 
-    /* Replace old array with new BFS-ordered array */
-    free(tree->nodes);
-    tree->nodes = new_nodes;
-    tree->used = new_idx;
+    uint32_t moved = 0;
+    int invalidating = 0;
+    for (uint32_t i = 0; i < hot_count && moved < max_nodes; i++) {
+        int done;
+        moved += gather_children(tree, hot[i], max_nodes - moved, scratch, &invalidating, &done);
+        if (done) {
+            __atomic_store_n(&tree->node_heat[hot[i]], 0, __ATOMIC_RELAXED);
+        }
+    }
 
-    /* Rebuild free list - all indices >= new_idx are free */
-    tree->free_count = 0;
-    for (uint32_t i = tree->used; i < tree->capacity; i++) {
-        tree->free_list[tree->free_count++] = i;
+    if (invalidating) {
+        nary_paths_invalidate_end_mt(tree);
+    }
+    if (moved > 0) {  /* Idle steps are not pauses worth counting */
+        tree->stats.nodes_moved += moved;
+        record_pause(tree, pause_start);
     }
 
-    /* Cleanup temporary arrays */
-    free(bfs_queue);
-    free(index_map);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+    free(scratch);
+    return (int)moved;
+}
+
+/* === Snapshots ===
+ *
+ * node_write_begin() saves a node into the newest snapshot the first time
+ * it changes after that snapshot was taken (node_cow remembers for which
+ * snapshot it last did), so whatever a snapshot needs is saved in it, in
+ * a newer one, or still live. Saving runs under the node's write lock,
+ * before the change, and takes snap_lock last. Readers of a snapshot
+ * therefore never hold snap_lock while locking a node: they look for a
+ * saved copy, read the live node if there is none, and look again. A
+ * copy saved in between is what the node was before the change they may
+ * have seen.
+ */
+
+static struct nary_snap_node *snap_alloc_slots(uint32_t count) {
+    struct nary_snap_node *slots;
+    if (posix_memalign((void **)&slots, CACHE_LINE_SIZE, count * sizeof(*slots)) != 0) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i].idx = NARY_INVALID_IDX;
+        slots[i].children = NULL;
+    }
+    return slots;
+}
+
+/* Slot holding idx, or the empty slot where it would go */
+static struct nary_snap_node *snap_slot(const struct nary_snapshot *snap, uint32_t idx) {
+    uint32_t slot = (idx * 2654435761u) & snap->saved_mask;
+    while (snap->saved[slot].idx != NARY_INVALID_IDX && snap->saved[slot].idx != idx) {
+        slot = (slot + 1) & snap->saved_mask;
+    }
+    return &snap->saved[slot];
+}
+
+/* Slot for idx, growing the table to stay at most half full (NULL = no memory) */
+static struct nary_snap_node *snap_claim(struct nary_snapshot *snap, uint32_t idx) {
+    uint32_t slots = snap->saved_mask + 1;
+    if ((snap->saved_count + 1) * 2 > slots) {
+        struct nary_snap_node *old = snap->saved;
+        struct nary_snap_node *grown = snap_alloc_slots(slots * 2);
+        if (!grown) return NULL;
+        snap->saved = grown;
+        snap->saved_mask = slots * 2 - 1;
+        for (uint32_t i = 0; i < slots; i++) {
+            if (old[i].idx != NARY_INVALID_IDX) {
+                *snap_slot(snap, old[i].idx) = old[i];
+            }
+        }
+        free(old);
+    }
+    return snap_slot(snap, idx);
+}
+
+static void snap_free_node(struct nary_tree_mt *tree, struct nary_snap_node *saved) {
+    free(saved->children);
+    string_table_release(&tree->strings, saved->node.name_offset);
+}
+
+/* Save live node idx into the newest snapshot before it changes (caller
+ * holds the node's write lock, or tree_lock for write) */
+static void snapshot_save_node(struct nary_tree_mt *tree, uint32_t idx) {
+    pthread_mutex_lock(&tree->snap_lock);
+    struct nary_snapshot *snap = tree->snap_newest;
+    if (!snap) {
+        pthread_mutex_unlock(&tree->snap_lock);
+        return;
+    }
+
+    /* Nodes created since (or free then) are not part of it */
+    const struct nary_node *node = &tree->nodes[idx].node;
+    if (idx < snap->used && node->inode != 0 && node->inode < snap->next_inode &&
+        snap_slot(snap, idx)->idx != idx) {
+        uint32_t count = NARY_IS_DIR(node) ? node->num_children : 0;
+        uint32_t *children = count > 0 ? malloc(count * sizeof(uint32_t)) : NULL;
+        struct nary_snap_node *slot = count == 0 || children ? snap_claim(snap, idx) : NULL;
+        if (!slot) {
+            /* The change goes ahead: the snapshot sees it */
+            free(children);
+            tree->stats.snap_lost++;
+            pthread_mutex_unlock(&tree->snap_lock);
+            return;
+        }
+
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, tree, node);
+        for (uint32_t i = 0; i < count; i++) {
+            children[i] = nary_child_iter_next(&it);
+        }
+        slot->node = *node;
+        slot->idx = idx;
+        slot->children = children;
+        snap->saved_count++;
+        string_table_ref(&tree->strings, node->name_offset);
+        tree->stats.snap_saved++;
+    }
+    tree->node_cow[idx] = snap->id;
+    pthread_mutex_unlock(&tree->snap_lock);
+}
+
+static struct nary_snapshot *snap_find(const struct nary_tree_mt *tree, uint32_t id) {
+    struct nary_snapshot *snap = tree->snap_newest;
+    while (snap && snap->id != id) {
+        snap = snap->older;
+    }
+    return snap;
+}
+
+int nary_snapshot_create_mt(struct nary_tree_mt *tree, uint32_t *id_out) {
+    if (!tree || !id_out) return -EINVAL;
+
+    struct nary_snapshot *snap = calloc(1, sizeof(*snap));
+    struct nary_snap_node *slots = snap_alloc_slots(NARY_SNAPSHOT_INITIAL_SLOTS);
+    if (!snap || !slots) {
+        free(snap);
+        free(slots);
+        return -ENOMEM;
+    }
+    snap->saved = slots;
+    snap->saved_mask = NARY_SNAPSHOT_INITIAL_SLOTS - 1;
+
+    /* No insert, delete or rename in flight: the snapshot sees each whole */
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
+        free(slots);
+        free(snap);
+        return -EIO;
+    }
+    pthread_mutex_lock(&tree->snap_lock);
+
+    int ret = 0;
+    if (!tree->node_cow) {
+        ret = -ENOMEM;
+    } else if (tree->snap_count >= NARY_SNAPSHOT_MAX || tree->snap_next_id == UINT32_MAX) {
+        ret = -ENOSPC;
+    } else {
+        snap->id = tree->snap_next_id++;
+        snap->used = tree->used;
+        snap->next_inode = tree->next_inode;
+        snap->created = time(NULL);
+        snap->older = tree->snap_newest;
+        if (snap->older) snap->older->newer = snap;
+        tree->snap_newest = snap;
+        tree->snap_count++;
+        __atomic_store_n(&tree->snap_epoch, snap->id, __ATOMIC_RELEASE);
+        *id_out = snap->id;
+    }
+
+    pthread_mutex_unlock(&tree->snap_lock);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+
+    if (ret != 0) {
+        free(slots);
+        free(snap);
+    }
+    return ret;
+}
+
+int nary_snapshot_drop_mt(struct nary_tree_mt *tree, uint32_t id) {
+    if (!tree) return -EINVAL;
+
+    pthread_mutex_lock(&tree->snap_lock);
+    struct nary_snapshot *snap = snap_find(tree, id);
+    if (!snap) {
+        pthread_mutex_unlock(&tree->snap_lock);
+        return -ENOENT;
+    }
+
+    /* A node unchanged between the older snapshot and this one looks the
+     * same in both: the older one takes the copy unless it has its own */
+    struct nary_snapshot *older = snap->older;
+    for (uint32_t i = 0; i <= snap->saved_mask; i++) {
+        struct nary_snap_node *saved = &snap->saved[i];
+        if (saved->idx == NARY_INVALID_IDX) continue;
+
+        if (older && saved->idx < older->used && saved->node.inode < older->next_inode) {
+            struct nary_snap_node *slot = snap_claim(older, saved->idx);
+            if (slot && slot->idx != saved->idx) {
+                *slot = *saved;
+                older->saved_count++;
+                continue;
+            }
+            if (!slot) tree->stats.snap_lost++;
+        }
+        snap_free_node(tree, saved);
+    }
+
+    if (older) older->newer = snap->newer;
+    if (snap->newer) {
+        snap->newer->older = older;
+    } else {
+        tree->snap_newest = older;
+        __atomic_store_n(&tree->snap_epoch, older ? older->id : 0, __ATOMIC_RELEASE);
+    }
+    tree->snap_count--;
+    pthread_mutex_unlock(&tree->snap_lock);
+
+    free(snap->saved);
+    free(snap);
+    return 0;
+}
+
+void nary_snapshots_destroy_mt(struct nary_tree_mt *tree) {
+    if (!tree || tree->snap_next_id == 0) return;  /* Never set up */
+
+    while (tree->snap_newest) {
+        struct nary_snapshot *snap = tree->snap_newest;
+        tree->snap_newest = snap->older;
+        for (uint32_t i = 0; i <= snap->saved_mask; i++) {
+            if (snap->saved[i].idx != NARY_INVALID_IDX) {
+                snap_free_node(tree, &snap->saved[i]);
+            }
+        }
+        free(snap->saved);
+        free(snap);
+    }
+    tree->snap_count = 0;
+    tree->snap_epoch = 0;
+
+    /* Heap trees keep it in the node reservation */
+    if (tree->is_mapped) {
+        free(tree->node_cow);
+        tree->node_cow = NULL;
+    }
+    pthread_mutex_destroy(&tree->snap_lock);
+    tree->snap_next_id = 0;
+}
+
+/*
+ * Copy what snapshot id (or a newer one) saved of idx (snap_lock held)
+ * Returns 1 if copied, 0 if the live node is the snapshot's, or -errno;
+ * *next_inode_out bounds the inode numbers the snapshot knows.
+ */
+static int snap_copy_saved(const struct nary_tree_mt *tree, uint32_t id, uint32_t idx,
+                           struct nary_node *out, uint32_t **children, uint32_t *count,
+                           uint32_t *next_inode_out) {
+    const struct nary_snapshot *snap = snap_find(tree, id);
+    if (!snap || idx >= snap->used) return -ENOENT;
+    *next_inode_out = snap->next_inode;
+
+    for (; snap; snap = snap->newer) {
+        const struct nary_snap_node *saved = snap_slot(snap, idx);
+        if (saved->idx != idx) continue;
+
+        *out = saved->node;
+        if (children) {
+            uint32_t n = NARY_IS_DIR(&saved->node) ? saved->node.num_children : 0;
+            *children = n > 0 ? malloc(n * sizeof(uint32_t)) : NULL;
+            if (n > 0 && !*children) return -ENOMEM;
+            if (n > 0) memcpy(*children, saved->children, n * sizeof(uint32_t));
+            *count = n;
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* A node (and, if asked for, its children) as snapshot id saw it */
+static int snap_view(struct nary_tree_mt *tree, uint32_t id, uint32_t idx,
+                     struct nary_node *out, uint32_t **children, uint32_t *count) {
+    uint32_t next_inode = 0;
+    pthread_mutex_lock(&tree->snap_lock);
+    int ret = snap_copy_saved(tree, id, idx, out, children, count, &next_inode);
+    pthread_mutex_unlock(&tree->snap_lock);
+    if (ret != 0) {
+        return ret < 0 ? ret : 0;
+    }
+
+    /* Unchanged so far: the live node */
+    struct nary_node live;
+    uint32_t *live_children = NULL;
+    uint32_t live_count = 0;
+    if (children) {
+        if (nary_lock_read(tree, idx) != 0) return -EIO;
+        live = tree->nodes[idx].node;
+        uint32_t n = NARY_IS_DIR(&live) ? live.num_children : 0;
+        if (n > 0) {
+            live_children = malloc(n * sizeof(uint32_t));
+            if (!live_children) {
+                nary_unlock(tree, idx);
+                return -ENOMEM;
+            }
+            struct nary_child_iter it;
+            nary_child_iter_init(&it, tree, &live);
+            for (uint32_t i = 0; i < n; i++) {
+                live_children[i] = nary_child_iter_next(&it);
+            }
+            live_count = n;
+        }
+        nary_unlock(tree, idx);
+    } else if (nary_read_node_mt(tree, idx, &live) != 0) {
+        return -EIO;
+    }
+
+    /* Saved meanwhile: then it changed after the snapshot, maybe before the read */
+    pthread_mutex_lock(&tree->snap_lock);
+    ret = snap_copy_saved(tree, id, idx, out, children, count, &next_inode);
+    pthread_mutex_unlock(&tree->snap_lock);
+    if (ret != 0) {
+        free(live_children);
+        return ret < 0 ? ret : 0;
+    }
 
-    pthread_rwlock_unlock(&tree->tree_lock);
+    if (live.inode == 0 || live.inode >= next_inode) {
+        free(live_children);
+        return -ENOENT;  /* Free then, or created since */
+    }
+    *out = live;
+    if (children) {
+        *children = live_children;
+        *count = live_count;
+    }
     return 0;
 }
 
+int nary_snapshot_read_node_mt(struct nary_tree_mt *tree, uint32_t id, uint32_t idx,
+                               struct nary_node *out_node) {
+    if (!tree || !out_node || idx >= __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE)) {
+        return -ENOENT;
+    }
+    return snap_view(tree, id, idx, out_node, NULL, NULL);
+}
+
+int nary_snapshot_children_mt(struct nary_tree_mt *tree, uint32_t id, uint32_t dir_idx,
+                              uint32_t **children_out, uint32_t *count_out) {
+    if (!tree || !children_out || !count_out ||
+        dir_idx >= __atomic_load_n(&tree->used, __ATOMIC_ACQUIRE)) {
+        return -ENOENT;
+    }
+
+    struct nary_node dir;
+    *children_out = NULL;
+    *count_out = 0;
+    int ret = snap_view(tree, id, dir_idx, &dir, children_out, count_out);
+    if (ret == 0 && !NARY_IS_DIR(&dir)) {
+        free(*children_out);
+        *children_out = NULL;
+        *count_out = 0;
+        ret = -ENOTDIR;
+    }
+    return ret;
+}
+
+uint32_t nary_snapshot_find_child_mt(struct nary_tree_mt *tree, uint32_t id,
+                                     uint32_t dir_idx, const char *name) {
+    uint32_t *children;
+    uint32_t count;
+    if (!name || nary_snapshot_children_mt(tree, id, dir_idx, &children, &count) != 0) {
+        return NARY_INVALID_IDX;
+    }
+
+    /* Children are in name order, and names as the snapshot saw them */
+    uint32_t found = NARY_INVALID_IDX;
+    uint32_t lo = 0, hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        struct nary_node child;
+        if (snap_view(tree, id, children[mid], &child, NULL, NULL) != 0) break;
+
+        const char *child_name = string_table_get(&tree->strings, child.name_offset);
+        int cmp = strcmp(child_name ? child_name : "", name);
+        if (cmp == 0) {
+            found = children[mid];
+            break;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    free(children);
+    return found;
+}
+
+uint32_t nary_snapshot_path_lookup_mt(struct nary_tree_mt *tree, uint32_t id,
+                                      const char *path) {
+    if (!tree || !path || path[0] != '/') {
+        return NARY_INVALID_IDX;
+    }
+
+    /* The root alone still has to exist in the snapshot */
+    struct nary_node root;
+    if (nary_snapshot_read_node_mt(tree, id, NARY_ROOT_IDX, &root) != 0) {
+        return NARY_INVALID_IDX;
+    }
+
+    uint32_t current_idx = NARY_ROOT_IDX;
+    char path_copy[PATH_MAX];
+    strncpy(path_copy, path, PATH_MAX - 1);
+    path_copy[PATH_MAX - 1] = '\0';
+
+    char *saveptr;
+    for (char *token = strtok_r(path_copy + 1, "/", &saveptr); token != NULL;
+         token = strtok_r(NULL, "/", &saveptr)) {
+        if (strcmp(token, ".") == 0) continue;
+        if (strcmp(token, "..") == 0) return NARY_INVALID_IDX;  /* As nary_path_lookup_mt */
+
+        current_idx = nary_snapshot_find_child_mt(tree, id, current_idx, token);
+        if (current_idx == NARY_INVALID_IDX) {
+            return NARY_INVALID_IDX;
+        }
+    }
+
+    return current_idx;
+}
+
+uint32_t nary_snapshot_inode_lookup_mt(struct nary_tree_mt *tree, uint32_t id,
+                                       uint32_t inode) {
+    if (!tree || inode == 0) return NARY_INVALID_IDX;
+
+    struct nary_node node;
+    uint32_t idx = nary_inode_lookup_mt(tree, inode);
+    if (idx != NARY_INVALID_IDX && snap_view(tree, id, idx, &node, NULL, NULL) == 0 &&
+        node.inode == inode) {
+        return idx;
+    }
+
+    /* Gone since: one of the snapshots from this one on saved it */
+    idx = NARY_INVALID_IDX;
+    pthread_mutex_lock(&tree->snap_lock);
+    for (const struct nary_snapshot *snap = snap_find(tree, id);
+         snap && idx == NARY_INVALID_IDX; snap = snap->newer) {
+        for (uint32_t i = 0; i <= snap->saved_mask; i++) {
+            if (snap->saved[i].idx != NARY_INVALID_IDX && snap->saved[i].node.inode == inode) {
+                idx = snap->saved[i].idx;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&tree->snap_lock);
+
+    /* A node created after the snapshot is not in it */
+    if (idx != NARY_INVALID_IDX &&
+        (snap_view(tree, id, idx, &node, NULL, NULL) != 0 || node.inode != inode)) {
+        idx = NARY_INVALID_IDX;
+    }
+    return idx;
+}
+
 int nary_set_memory_limit_mt(struct nary_tree_mt *tree, uint64_t max_bytes) {
     if (!tree) return -1;
 
     /* Acquire tree lock to ensure thread-safe update */
-    if (pthread_rwlock_wrlock(&tree->tree_lock) != 0) {
+    if (metrics_rwlock_wrlock(&tree->tree_lock, METRICS_LOCK_TREE) != 0) {
         return -1;
     }
 
     tree->max_memory_bytes = max_bytes;
 
-    pthread_rwlock_unlock(&tree->tree_lock);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
     return 0;
 }
 
@@ -941,11 +3353,14 @@ uint64_t nary_get_memory_usage_mt(const struct nary_tree_mt *tree) {
 
     /* Memory usage breakdown:
      * 1. Node array: capacity * sizeof(nary_node_mt)
-     * 2. Free list: capacity * sizeof(uint16_t)
-     * 3. String table: approximated via string_table_stats
+     * 2. Free list: capacity * sizeof(uint32_t)
+     * 3. Child blocks: block_capacity * (sizeof(nary_child_block) + fingerprints)
+     * 4. String table: approximated via string_table_stats
      */
     uint64_t node_array_bytes = (uint64_t)tree->capacity * sizeof(struct nary_node_mt);
-    uint64_t free_list_bytes = (uint64_t)tree->capacity * sizeof(uint16_t);
+    uint64_t free_list_bytes = (uint64_t)tree->capacity * sizeof(uint32_t);
+    uint64_t block_bytes = (uint64_t)tree->block_capacity *
+                           (sizeof(struct nary_child_block) + sizeof(struct nary_child_fp));
 
     /* Get string table size */
     uint32_t st_total_size = 0;
@@ -953,7 +3368,7 @@ uint64_t nary_get_memory_usage_mt(const struct nary_tree_mt *tree) {
     string_table_stats((struct string_table *)&tree->strings, &st_total_size, &st_used_size);
     uint64_t string_table_bytes = st_total_size;
 
-    return node_array_bytes + free_list_bytes + string_table_bytes;
+    return node_array_bytes + free_list_bytes + block_bytes + string_table_bytes;
 }
 
 void nary_get_mt_stats(struct nary_tree_mt *tree,
@@ -962,15 +3377,59 @@ void nary_get_mt_stats(struct nary_tree_mt *tree,
 
     memset(stats, 0, sizeof(*stats));
 
+    /* Lock counters come from the metrics recorder (tree and node locks of
+     * the process, zero with -o metrics=off) */
+    struct metrics_shard *snap = malloc(sizeof(*snap));
+    if (snap) {
+        metrics_snapshot(snap);
+        uint64_t wait_ns = 0;
+        for (int kind = METRICS_LOCK_TREE; kind <= METRICS_LOCK_NODE; kind++) {
+            stats->read_locks += snap->counters[METRICS_LOCK_COUNTER(kind, METRICS_LOCK_SHARED)];
+            stats->write_locks += snap->counters[METRICS_LOCK_COUNTER(kind, METRICS_LOCK_EXCLUSIVE)];
+            stats->lock_conflicts += snap->counters[METRICS_LOCK_COUNTER(kind, METRICS_LOCK_CONTENDED)];
+            wait_ns += snap->hist[METRICS_LOCK_WAIT(kind)].sum_ns;
+        }
+        uint64_t acquisitions = stats->read_locks + stats->write_locks;
+        stats->avg_lock_time_ns = acquisitions ? (double)wait_ns / (double)acquisitions : 0;
+        free(snap);
+    }
+
+    /* Consistent with a compaction step running in the background */
+    metrics_rwlock_rdlock(&tree->tree_lock, METRICS_LOCK_TREE);
     stats->total_nodes = tree->used;
     stats->free_nodes = tree->free_count;
-    stats->read_locks = tree->stats.read_locks;
-    stats->write_locks = tree->stats.write_locks;
-    stats->lock_conflicts = tree->stats.lock_conflicts;
-    stats->avg_lock_time_ns = 0;
     stats->current_memory_bytes = tree->current_memory_bytes;
     stats->max_memory_bytes = tree->max_memory_bytes;
     stats->memory_limit_hits = tree->stats.memory_limit_hits;
+    stats->read_fallbacks = __atomic_load_n(&tree->stats.read_fallbacks, __ATOMIC_RELAXED);
+    stats->rebalance_steps = tree->stats.rebalance_steps;
+    stats->nodes_moved = tree->stats.nodes_moved;
+    stats->pause_max_ns = tree->stats.pause_max_ns;
+    memcpy(stats->pause_hist, tree->stats.pause_hist, sizeof(stats->pause_hist));
+    pthread_mutex_lock(&tree->snap_lock);
+    stats->snapshots = tree->snap_count;
+    for (const struct nary_snapshot *snap = tree->snap_newest; snap; snap = snap->older) {
+        stats->snapshot_nodes += snap->saved_count;
+    }
+    stats->snapshot_lost = tree->stats.snap_lost;
+    pthread_mutex_unlock(&tree->snap_lock);
+    metrics_rwlock_unlock(&tree->tree_lock, METRICS_LOCK_TREE);
+
+    /* Where the metadata actually lives; without page queries it all
+     * counts as node 0 */
+    stats->numa_nodes = (uint32_t)numa_node_count();
+    if (stats->numa_nodes > NUMA_MAX_NODES) stats->numa_nodes = NUMA_MAX_NODES;
+    size_t node_bytes = (size_t)tree->capacity * sizeof(struct nary_node_mt);
+    int queried = tree->nodes &&
+                  numa_resident_bytes(tree->nodes, node_bytes, stats->node_memory_bytes) == 0;
+    if (queried && tree->strings.data) {
+        queried = numa_resident_bytes(tree->strings.data, tree->strings.capacity,
+                                      stats->node_memory_bytes) == 0;
+    }
+    if (!queried) {
+        memset(stats->node_memory_bytes, 0, sizeof(stats->node_memory_bytes));
+        stats->node_memory_bytes[0] = node_bytes + tree->strings.capacity;
+    }
 }
 
 int nary_check_deadlocks(struct nary_tree_mt *tree) __attribute__((unused));
@@ -11,6 +11,7 @@
 #include "nary_tree.h"
 #include "string_table.h"
 #include "wal.h"
+#include "numa_support.h"
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -21,8 +22,26 @@ extern "C" {
 
 /* Configuration */
 #define NARY_MT_INITIAL_CAPACITY 1024          /* Initial node array size */
-#define NARY_MT_REBALANCE_THRESHOLD 1000      /* Rebalance every N operations */
 #define NARY_MT_LOCK_TIMEOUT_MS 5000          /* Lock timeout (5 seconds) */
+#define NARY_SLAB_NODES 1024                  /* Nodes committed at a time (heap trees) */
+#define NARY_SEQ_READ_RETRIES 4               /* Optimistic node reads before locking */
+
+/* Incremental compaction */
+#define NARY_REBALANCE_STEP_NODES 64          /* Nodes moved per step (default budget) */
+#define NARY_HEAT_SAMPLE 64                   /* One directory lookup in N counts as heat */
+#define NARY_HEAT_HOT 16                      /* Sampled lookups that make a directory hot */
+#define NARY_HOT_RING 64                      /* Hot directories remembered for the next step */
+#define NARY_PAUSE_BUCKETS 16                 /* Exclusive pauses by log2(microseconds) */
+
+/* Snapshots */
+#define NARY_SNAPSHOT_MAX 256                 /* Snapshots held at once */
+#define NARY_SNAPSHOT_INITIAL_SLOTS 64        /* Saved node slots of a new snapshot */
+
+/* Child blocks provisioned for a node capacity: only directories with more
+ * than NARY_INLINE_CHILDREN children own blocks, and sibling blocks are
+ * merged once they fit in one. Mapped images are sized by it; heap trees
+ * grow their blocks on demand. */
+#define NARY_CHILD_BLOCKS(capacity) ((capacity) / 4 + 1)
 
 /* Memory Limits */
 #define NARY_MT_DEFAULT_MAX_MEMORY (1ULL * 1024 * 1024 * 1024)  /* 1GB default */
@@ -41,8 +60,10 @@ struct __attribute__((aligned(128))) nary_node_mt {
     /* Lock on separate cache line (prevents false sharing) */
     pthread_rwlock_t lock;
 
-    /* Padding to reach 128 bytes */
-    char padding[128 - sizeof(struct nary_node) - sizeof(pthread_rwlock_t)];
+    /* Name fingerprints of the inline children, parallel to node.children;
+     * they share the lock's cache line, which every lookup touches anyway
+     * (the rest of the 128 bytes is alignment padding) */
+    uint8_t child_fp[NARY_INLINE_CHILDREN];
 };
 
 /* Static assertion to verify size */
@@ -54,11 +75,63 @@ struct __attribute__((aligned(128))) nary_node_mt {
                    "nary_node_mt must be exactly 128 bytes (2 cache lines)");
 #endif
 
+/**
+ * Name fingerprints of one leaf child block, parallel to its entries
+ * Lookups compare these (16 at a time) before touching any name.
+ */
+struct nary_child_fp {
+    uint8_t fp[NARY_BRANCHING_FACTOR];
+};
+
+/**
+ * Inode index slot (open addressing, inode 0 = empty)
+ */
+struct nary_inode_slot {
+    uint32_t inode;
+    uint32_t idx;
+};
+
+/**
+ * A node as it was when a snapshot was taken
+ * node.children is not used: child blocks keep changing, so a directory's
+ * children are copied out, in name order.
+ */
+struct nary_snap_node {
+    struct nary_node node;
+    uint32_t idx;                      /* Slot key (NARY_INVALID_IDX = empty) */
+    uint32_t *children;                /* Directory: child indices (heap) */
+};
+
+/**
+ * Point-in-time view of the tree (see nary_snapshot_create_mt)
+ *
+ * Holds only the nodes changed since it was taken: each node is saved by
+ * its first change after the newest snapshot, into that snapshot. The
+ * view of a node is the first copy found from this snapshot towards the
+ * newer ones, or the live node if none of them saved it.
+ */
+struct nary_snapshot {
+    uint32_t id;                       /* Never reused, newer ones are larger */
+    uint32_t used;                     /* Nodes at the time: higher indices came later */
+    uint32_t next_inode;               /* Likewise for inode numbers */
+    uint32_t saved_count;
+    uint32_t saved_mask;               /* Slots - 1 (power of two) */
+    struct nary_snap_node *saved;      /* Open addressing by index */
+    time_t created;
+    struct nary_snapshot *older;
+    struct nary_snapshot *newer;
+};
+
 /**
  * Multithreaded Tree Structure
  */
 struct nary_tree_mt {
-    struct nary_node_mt *nodes;        /* Contiguous array of MT-safe nodes */
+    struct nary_node_mt *nodes;        /* Contiguous array of MT-safe nodes (never moves) */
+    uint32_t *node_seq;                /* Per-node sequence counters, odd while a writer
+                                          changes the node (never moves; NULL = readers
+                                          always lock) */
+    uint32_t *node_heat;               /* Sampled lookups per directory (never moves;
+                                          NULL = no incremental compaction) */
     struct string_table strings;        /* Interned filename storage */
 
     uint32_t capacity;                 /* Total allocated nodes */
@@ -66,12 +139,54 @@ struct nary_tree_mt {
     uint32_t next_inode;               /* Next available inode number */
     uint32_t op_count;                 /* Operations since last rebalance */
 
-    uint16_t *free_list;               /* Stack of free indices */
+    uint32_t *free_list;               /* Stack of free indices */
     uint32_t free_count;               /* Number of free indices */
 
+    /* Child B+-trees of wide directories */
+    struct nary_child_block *child_blocks;  /* Never moves: lookups read it
+                                               without tree_lock */
+    uint32_t block_capacity;           /* NARY_CHILD_BLOCKS(capacity) */
+    uint32_t block_used;               /* High-water mark of allocated blocks */
+    uint32_t block_free;               /* Free block chain via children[0] */
+    struct nary_child_fp *block_fp;    /* Leaf fingerprints (block_capacity, never
+                                          moves; heap even for mapped trees) */
+    size_t block_reserve;              /* Address space reserved for child blocks
+                                          (heap trees; fingerprints alike) */
+
+    /* Inode number → node index (heap, built on first nary_inode_lookup_mt) */
+    struct nary_inode_slot *inode_slots;
+    uint32_t inode_slot_mask;          /* Slot count - 1 (power of two) */
+    uint32_t inode_count;              /* Indexed inodes */
+
+    int is_mapped;                     /* Arrays live in a mapped image (fixed size) */
+    size_t node_reserve;               /* Address space reserved for nodes (heap trees) */
+    int prefetch;                      /* Prefetch child nodes and names on lookups */
+
     /* Tree structure lock (only for topology changes) */
     pthread_rwlock_t tree_lock;
 
+    /* Path generation: moves on whenever an existing path may stop
+     * resolving to the same index (delete, rename, rebalance) */
+    uint64_t path_generation;
+    uint32_t path_invalidating;        /* Invalidations in progress */
+
+    /* Incremental compaction (see nary_rebalance_step_mt) */
+    uint32_t hot_ring[NARY_HOT_RING];  /* Directories that turned hot (lossy) */
+    uint32_t hot_next;                 /* Ring slot the next one goes to */
+    uint32_t *retired;                 /* Slots vacated by the last step */
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+
+    /* Copy-on-write snapshots (see nary_snapshot_create_mt) */
+    struct nary_snapshot *snap_newest;
+    uint32_t snap_epoch;               /* Id of the newest snapshot, 0 = none (__atomic) */
+    uint32_t snap_next_id;
+    uint32_t snap_count;
+    uint32_t *node_cow;                /* Per node: the snapshot it was last saved for
+                                          (never moves; NULL = no snapshots) */
+    pthread_mutex_t snap_lock;         /* Snapshot list and saved nodes; taken after
+                                          any node lock, never before one */
+
     /* Memory management */
     uint64_t max_memory_bytes;         /* Maximum memory usage (0=unlimited) */
     uint64_t current_memory_bytes;     /* Current estimated memory usage */
@@ -83,6 +198,13 @@ struct nary_tree_mt {
         uint64_t write_locks;
         uint64_t lock_conflicts;
         uint64_t memory_limit_hits;    /* Count of ENOSPC due to memory limits */
+        uint64_t read_fallbacks;       /* Optimistic reads that had to lock */
+        uint64_t rebalance_steps;      /* Full rebalances and steps that moved nodes */
+        uint64_t nodes_moved;          /* Nodes given a new index by compaction */
+        uint64_t pause_max_ns;         /* Longest exclusive compaction pass */
+        uint64_t pause_hist[NARY_PAUSE_BUCKETS];
+        uint64_t snap_saved;           /* Nodes saved for snapshots */
+        uint64_t snap_lost;            /* Nodes a snapshot could not save (no memory) */
     } stats;
 };
 
@@ -95,10 +217,20 @@ struct nary_mt_stats {
     uint64_t read_locks;
     uint64_t write_locks;
     uint64_t lock_conflicts;
-    double avg_lock_time_ns;
+    double avg_lock_time_ns;           /* Mean tree/node lock wait per acquisition */
     uint64_t current_memory_bytes;     /* Current memory usage */
     uint64_t max_memory_bytes;         /* Configured limit (0=unlimited) */
     uint64_t memory_limit_hits;        /* Times allocation failed due to limit */
+    uint64_t read_fallbacks;           /* Optimistic reads that raced writers and locked */
+    uint64_t rebalance_steps;          /* Full rebalances and steps that moved nodes */
+    uint64_t nodes_moved;              /* Nodes renumbered by compaction */
+    uint64_t pause_max_ns;             /* Longest of those passes */
+    uint64_t pause_hist[NARY_PAUSE_BUCKETS]; /* Pass i took < 2^i us (last: longer) */
+    uint32_t snapshots;                /* Snapshots held */
+    uint64_t snapshot_nodes;           /* Nodes saved for them, now held */
+    uint64_t snapshot_lost;            /* Changes that a snapshot missed (no memory) */
+    uint32_t numa_nodes;               /* Entries used in node_memory_bytes */
+    uint64_t node_memory_bytes[NUMA_MAX_NODES]; /* Resident nodes + names per NUMA node */
 };
 
 /* === Lifecycle Functions === */
@@ -114,23 +246,46 @@ int nary_tree_mt_init(struct nary_tree_mt *tree) __attribute__((unused));
  */
 void nary_tree_mt_destroy(struct nary_tree_mt *tree);
 
+/**
+ * Make room for count more nodes without moving the node array
+ * (e.g. before inserting from several threads that hold node pointers)
+ *
+ * Locking: Acquires tree_lock for write
+ * Returns 0 on success, -1 if the capacity or memory limit is reached
+ */
+int nary_reserve_mt(struct nary_tree_mt *tree, uint32_t count);
+
 /* === Thread-Safe Operations === */
 
 /**
  * Find child with name in parent directory (concurrent reads allowed)
  *
- * Locking: Acquires shared lock on parent
+ * Locking: None while no writer changes the parent (validated against
+ * its sequence counter); shared lock on parent after
+ * NARY_SEQ_READ_RETRIES collisions with writers
  */
-uint16_t nary_find_child_mt(struct nary_tree_mt *tree,
-                            uint16_t parent_idx,
+uint32_t nary_find_child_mt(struct nary_tree_mt *tree,
+                            uint32_t parent_idx,
                             const char *name);
 
 /**
  * Find parent of a given node index
  *
- * Locking: Acquires shared lock on the node
+ * Locking: Optimistic like nary_find_child_mt
+ */
+uint32_t nary_find_parent_mt(struct nary_tree_mt *tree, uint32_t child_idx);
+
+/**
+ * Find the node holding an inode number
+ *
+ * Node indices move on rebalance, inode numbers never do, so callers that
+ * hand out stable handles (the low-level FUSE front end) keep inodes and
+ * come back here. The index is built on first use and then kept up to
+ * date by insert, delete and rebalance.
+ *
+ * Locking: Acquires shared tree_lock (exclusive on first use)
  */
-uint16_t nary_find_parent_mt(struct nary_tree_mt *tree, uint16_t child_idx);
+uint32_t nary_inode_lookup_mt(struct nary_tree_mt *tree, uint32_t inode);
 
 /**
  * Insert new node as child of parent (exclusive write)
@@ -138,18 +293,105 @@ uint16_t nary_find_parent_mt(struct nary_tree_mt *tree, uint16_t child_idx);
  * Locking: Acquires write lock on parent, then child
  * Order: parent before child (prevents deadlock)
  */
-uint16_t nary_insert_mt(struct nary_tree_mt *tree,
-                        uint16_t parent_idx,
+uint32_t nary_insert_mt(struct nary_tree_mt *tree,
+                        uint32_t parent_idx,
                         const char *name,
                         uint16_t mode);
 
+/* One entry of nary_insert_batch_mt */
+struct nary_batch_entry {
+    const char *name;
+    uint16_t mode;
+    uint32_t idx;                      /* Out: the new node */
+};
+
+/**
+ * Insert many nodes under one parent (exclusive write)
+ *
+ * The entries are sorted by name and linked into the parent's children
+ * in ascending order under one parent lock, so each lands next to the one
+ * before it. Either all of them are inserted or none; the batch is logged
+ * as one WAL transaction.
+ *
+ * Locking: Acquires tree_lock, then the parent, once for the whole batch
+ *
+ * @return 0 on success, or -EINVAL (empty or repeated name), -ENOENT,
+ *         -ENOTDIR, -EEXIST or -ENOSPC
+ */
+int nary_insert_batch_mt(struct nary_tree_mt *tree, uint32_t parent_idx,
+                         struct nary_batch_entry *entries, uint32_t count,
+                         struct wal *wal, int wal_enabled);
+
 /**
  * Delete node from tree (exclusive write)
  *
- * Locking: Acquires write lock on parent, then node
+ * Locking: Acquires tree_lock, then write locks on parent, then node
  * Order: parent before child (prevents deadlock)
+ *
+ * @return 0 on success, -ENOTEMPTY for a directory with children,
+ *         -ESTALE if idx no longer holds a linked node (a compaction
+ *         step moved it, see nary_rebalance_step_mt), -1 on bad arguments
  */
-int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int wal_enabled);
+int nary_delete_mt(struct nary_tree_mt *tree, uint32_t idx, struct wal *wal, int wal_enabled);
+
+/**
+ * Delete the node holding inode, found at idx (exclusive write)
+ *
+ * As nary_delete_mt, but also -ESTALE if idx has since been handed to
+ * another node. Callers holding an index from an earlier lookup find
+ * the node again with nary_inode_lookup_mt and retry.
+ */
+int nary_delete_inode_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                         struct wal *wal, int wal_enabled);
+
+/* nary_rename_mt flags (the values of renameat2's) */
+#define NARY_RENAME_NOREPLACE  (1u << 0)   /* Fail with -EEXIST if the target exists */
+#define NARY_RENAME_EXCHANGE   (1u << 1)   /* Swap with the target */
+
+/**
+ * Move a node to new_name under new_parent_idx (exclusive write)
+ *
+ * The node is unlinked from its parent and linked into the new one in
+ * place, so the cost does not depend on the size of the file or subtree.
+ * An existing target is replaced in the same step (a file by a file, an
+ * empty directory by a directory), or swapped with the node under
+ * NARY_RENAME_EXCHANGE. The move is logged as one WAL transaction.
+ *
+ * Locking: Acquires tree_lock, then both parents (ancestor first), then
+ * the node and the target
+ *
+ * @param replaced Set to a copy of a replaced target (inode 0 if none);
+ *                 its file data and xattrs are the caller's to drop
+ * @return 0 on success, or -EINVAL (a directory below itself), -ENOENT,
+ *         -ENOTDIR, -EISDIR, -EEXIST, -ENOTEMPTY or -ENOSPC
+ */
+int nary_rename_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t new_parent_idx,
+                   const char *new_name, unsigned int flags, struct nary_node *replaced,
+                   struct wal *wal, int wal_enabled);
+
+/**
+ * Move the node holding inode, found at idx, into the directory holding
+ * dir_inode, found at new_parent_idx (exclusive write)
+ *
+ * As nary_rename_mt, but -ESTALE if either index no longer holds its
+ * node (see nary_delete_inode_mt).
+ */
+int nary_rename_inode_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t inode,
+                         uint32_t new_parent_idx, uint32_t dir_inode,
+                         const char *new_name, unsigned int flags, struct nary_node *replaced,
+                         struct wal *wal, int wal_enabled);
+
+/**
+ * Apply a link repair found by razorfsck (see struct wal_repair_data)
+ * Not logged: the caller logs the repairs as one transaction first, and
+ * recovery calls this again to redo them.
+ *
+ * Locking: Acquires tree_lock, then the parent
+ *
+ * @return 0 if applied, 1 if already in place (nothing to do), -1 if the
+ *         repair does not fit the tree (or the directory is full)
+ */
+int nary_repair_link_mt(struct nary_tree_mt *tree, const struct wal_repair_data *repair);
 
 /**
  * Path lookup (concurrent reads)
@@ -157,26 +399,57 @@ int nary_delete_mt(struct nary_tree_mt *tree, uint16_t idx, struct wal *wal, int
  * Locking: Acquires shared locks as descending tree
  * Unlocks previous before locking next
  */
-uint16_t nary_path_lookup_mt(struct nary_tree_mt *tree, const char *path);
+uint32_t nary_path_lookup_mt(struct nary_tree_mt *tree, const char *path);
+
+/* Returned by nary_paths_generation_mt while paths are being invalidated */
+#define NARY_PATHS_UNSTABLE UINT64_MAX
 
 /**
- * Read node metadata (shared lock)
+ * Current path generation, for caching nary_path_lookup_mt results
+ *
+ * A resolution made after reading generation G stays valid for as long as
+ * the generation is still G. Returns NARY_PATHS_UNSTABLE while an
+ * invalidation is in progress (nothing may be cached then).
+ */
+uint64_t nary_paths_generation_mt(const struct nary_tree_mt *tree);
+
+/**
+ * Bracket a change that can make an existing path resolve differently
+ *
+ * Delete and rebalance do this themselves; callers changing names or
+ * parents in place (rename) wrap the update in begin/end.
+ */
+void nary_paths_invalidate_begin_mt(struct nary_tree_mt *tree);
+void nary_paths_invalidate_end_mt(struct nary_tree_mt *tree);
+
+/**
+ * Read node metadata
+ *
+ * Copies the node without writing shared memory; retries if a writer was
+ * active and takes the shared lock after NARY_SEQ_READ_RETRIES attempts.
  */
 int nary_read_node_mt(struct nary_tree_mt *tree,
-                      uint16_t idx,
+                      uint32_t idx,
                       struct nary_node *out_node);
 
 /**
- * Update node metadata (exclusive lock)
+ * Update node metadata (exclusive lock, moves the node's sequence counter)
  */
 int nary_update_node_mt(struct nary_tree_mt *tree,
-                        uint16_t idx,
+                        uint32_t idx,
                         const struct nary_node *new_node);
 
 /**
- * Atomically update node size and mtime (exclusive lock)
+ * Point a node at its chain of extended attributes (see xattr.h)
+ * (exclusive lock, moves the node's sequence counter)
  */
-int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint16_t idx, size_t new_size, time_t new_mtime);
+int nary_set_xattr_head_mt(struct nary_tree_mt *tree, uint32_t idx, uint32_t head);
+
+/**
+ * Atomically update node size and mtime (exclusive lock, moves the
+ * node's sequence counter)
+ */
+int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint32_t idx, size_t new_size, time_t new_mtime);
 
 /* === Lock Management Helpers === */
 
@@ -192,11 +465,15 @@ int nary_update_size_mtime_mt(struct nary_tree_mt *tree, uint16_t idx, size_t ne
  * Note: Caller must handle lock failures. Do NOT proceed with
  * operation if lock acquisition fails. Return error to caller.
  */
-int nary_lock_read(struct nary_tree_mt *tree, uint16_t idx);
+int nary_lock_read(struct nary_tree_mt *tree, uint32_t idx);
 
 /**
  * Acquire write lock on node
  *
+ * Holds off locked readers only: nary_read_node_mt and
+ * nary_find_child_mt read optimistically and do not see this lock, so
+ * change nodes through the nary_*_mt update functions.
+ *
  * Returns: 0 on success, pthread error code on failure
  * Common errors:
  * - EINVAL: Invalid lock or idx out of range
@@ -206,7 +483,7 @@ int nary_lock_read(struct nary_tree_mt *tree, uint16_t idx);
  * Note: Caller must handle lock failures. Do NOT proceed with
  * operation if lock acquisition fails. Return error to caller.
  */
-int nary_lock_write(struct nary_tree_mt *tree, uint16_t idx) __attribute__((unused));
+int nary_lock_write(struct nary_tree_mt *tree, uint32_t idx) __attribute__((unused));
 
 /**
  * Release lock on node
@@ -219,22 +496,131 @@ int nary_lock_write(struct nary_tree_mt *tree, uint16_t idx) __attribute__((unus
  * Note: Should not fail in normal operation if called after
  * successful lock acquisition.
  */
-int nary_unlock(struct nary_tree_mt *tree, uint16_t idx);
+int nary_unlock(struct nary_tree_mt *tree, uint32_t idx);
+
+/**
+ * Change counter of a node, for noticing changes between two reads
+ *
+ * Moves on with every change to the node (its children included). Even
+ * while the node is unchanged; odd while a writer is active, and always
+ * odd (never to be trusted) for trees without sequence counters.
+ * Indices move with rebalancing: check the path generation as well.
+ */
+uint32_t nary_node_version_mt(const struct nary_tree_mt *tree, uint32_t idx);
 
 /**
  * Acquire locks on parent and child (in correct order)
  * Prevents deadlock by always locking parent first
  */
 int nary_lock_parent_child(struct nary_tree_mt *tree,
-                           uint16_t parent_idx,
-                           uint16_t child_idx,
+                           uint32_t parent_idx,
+                           uint32_t child_idx,
                            bool write);
 
+/* === Software Prefetch ===
+ *
+ * Hints only: an index out of range is ignored, and nothing is issued
+ * while tree->prefetch is 0. Nothing here takes a lock.
+ */
+
+/**
+ * Prefetch a node (and its sequence counter) for reading
+ */
+static inline void nary_prefetch_node_mt(const struct nary_tree_mt *tree, uint32_t idx) {
+    if (tree->prefetch && idx < __atomic_load_n(&tree->used, __ATOMIC_RELAXED)) {
+        __builtin_prefetch(&tree->nodes[idx], 0, 3);
+        if (tree->node_seq) __builtin_prefetch(&tree->node_seq[idx], 0, 3);
+    }
+}
+
+/**
+ * Prefetch a node's name from the string table
+ * Reads the node's name_offset: best issued once the node is on its way
+ */
+static inline void nary_prefetch_name_mt(const struct nary_tree_mt *tree, uint32_t idx) {
+    if (tree->prefetch && idx < __atomic_load_n(&tree->used, __ATOMIC_RELAXED)) {
+        uint32_t offset = tree->nodes[idx].node.name_offset;
+        if (offset < __atomic_load_n(&tree->strings.used, __ATOMIC_RELAXED)) {
+            __builtin_prefetch(tree->strings.data + offset, 0, 3);
+        }
+    }
+}
+
+/* === Children Array === */
+
+/**
+ * In-order cursor over a directory's children
+ */
+struct nary_child_iter {
+    const struct nary_tree_mt *tree;
+    const uint32_t *inline_children;    /* Small directories */
+    uint32_t remaining;                 /* Children not yet returned */
+    uint32_t height;                    /* Interior levels above the leaf */
+    uint32_t block[NARY_CHILD_MAX_HEIGHT + 1];  /* Block per level, leaf last */
+    uint32_t slot[NARY_CHILD_MAX_HEIGHT + 1];   /* Position per level */
+};
+
+/**
+ * Start iterating a node's children in name order
+ *
+ * Locking: Caller holds the node's lock (read or write) until done
+ */
+void nary_child_iter_init(struct nary_child_iter *it, const struct nary_tree_mt *tree,
+                          const struct nary_node *node);
+
+/**
+ * Next child index, or NARY_INVALID_IDX after the last one
+ */
+uint32_t nary_child_iter_next(struct nary_child_iter *it);
+
+/**
+ * Insert a child into a node's children in name order, moving them into
+ * a block tree when the node outgrows the inline slots and splitting
+ * blocks as they fill
+ *
+ * node must be one of tree->nodes: its children's name fingerprints are
+ * kept beside it (nary_node_mt.child_fp) and in tree->block_fp.
+ *
+ * Locking: Caller holds tree_lock and the node's lock for write
+ * Returns 0 on success, -1 if the node is full or no block is available
+ */
+int nary_child_insert_mt(struct nary_tree_mt *tree, struct nary_node *node,
+                         uint32_t child_idx);
+
+/**
+ * Remove a child from a node's children, merging blocks that fit together
+ * and moving the children back inline once they fit
+ *
+ * Locking: Caller holds tree_lock and the node's lock for write
+ * Returns 0 on success, -1 if child_idx is not a child of the node
+ */
+int nary_child_remove_mt(struct nary_tree_mt *tree, struct nary_node *node,
+                         uint32_t child_idx);
+
+/**
+ * Check the structure of a node's block tree (block indices in range,
+ * height, entry count matching num_children) before walking it
+ * Returns 0 if it is sound (or the children are inline), -1 otherwise
+ */
+int nary_child_check_mt(const struct nary_tree_mt *tree, const struct nary_node *node);
+
+/**
+ * Recompute every child name fingerprint
+ *
+ * Fingerprints are not part of persisted images: call this after binding
+ * a tree to a mapped image (allocates tree->block_fp if needed).
+ *
+ * Locking: Caller has exclusive access to the tree
+ * Returns 0 on success, -1 on allocation failure
+ */
+int nary_child_fp_rebuild_mt(struct nary_tree_mt *tree);
+
 /**
  * Rebalance tree in BFS order for cache locality
  *
  * Reorganizes tree nodes in breadth-first order to improve cache performance.
- * This is a lazy operation, automatically triggered every NARY_MT_REBALANCE_THRESHOLD ops.
+ * Stop-the-world: nothing triggers it any more (see nary_rebalance_step_mt),
+ * it is for offline compaction and tests.
  *
  * Thread Safety: Acquires exclusive tree_lock for entire operation.
  * Complexity: O(n) where n is number of active nodes.
@@ -243,6 +629,110 @@ int nary_lock_parent_child(struct nary_tree_mt *tree,
  */
 int nary_rebalance_mt(struct nary_tree_mt *tree);
 
+/**
+ * Count every node's reference to its name in the string table
+ *
+ * Reference counts are not persisted: call this once after restoring a
+ * tree and its string table, before anything is reclaimed.
+ *
+ * Locking: Caller has exclusive access to the tree
+ * Returns: 0 on success, -1 if some node names no interned string
+ */
+int nary_strings_recount_mt(struct nary_tree_mt *tree);
+
+/**
+ * One bounded step of incremental compaction
+ *
+ * Lookups sample their directory's heat; a step takes the hottest
+ * directories and moves their children next to each other at the end of
+ * the node array, so a hot directory's entries share cache lines and
+ * pages. Wide directories are gathered over several steps. At most
+ * max_nodes nodes are touched (moved children plus the grandchildren
+ * whose parent index changes), and nodes locked by other threads are
+ * skipped, so the exclusive part stays short. Lookups are not held up
+ * (optimistic reads), path lookups that raced a move retry, and slots
+ * vacated by a step are only reused after the next one.
+ *
+ * Locking: Acquires tree_lock for write for the duration of the step
+ * Returns: Nodes moved (0 = nothing to do, or snapshots are held), -1 on error
+ */
+int nary_rebalance_step_mt(struct nary_tree_mt *tree, uint32_t max_nodes);
+
+/* === Snapshots === */
+
+/**
+ * Take a snapshot of the whole tree
+ *
+ * Nothing is copied here: from now on the first change to each node that
+ * existed saves the node (and a directory's children) before it changes,
+ * so a snapshot costs the nodes changed since it was taken. Compaction
+ * pauses while any snapshot is held, since it renumbers nodes. Snapshots
+ * live in memory and are not persisted.
+ *
+ * Locking: Acquires tree_lock for write (waits for topology changes)
+ *
+ * @param id_out Receives the snapshot's id
+ * @return 0, -ENOSPC (NARY_SNAPSHOT_MAX held), -ENOMEM or -EIO
+ */
+int nary_snapshot_create_mt(struct nary_tree_mt *tree, uint32_t *id_out);
+
+/**
+ * Drop a snapshot
+ * Nodes it saved that the next older snapshot still needs move there;
+ * the rest are freed.
+ *
+ * @return 0 or -ENOENT
+ */
+int nary_snapshot_drop_mt(struct nary_tree_mt *tree, uint32_t id);
+
+/**
+ * Drop every snapshot and release the per-node bookkeeping (teardown)
+ *
+ * Locking: Caller has exclusive access to the tree
+ */
+void nary_snapshots_destroy_mt(struct nary_tree_mt *tree);
+
+/**
+ * A node as it was in a snapshot (children[] not valid, see
+ * nary_snapshot_children_mt)
+ *
+ * @return 0, or -ENOENT if the snapshot or the node (then) does not exist
+ */
+int nary_snapshot_read_node_mt(struct nary_tree_mt *tree, uint32_t id, uint32_t idx,
+                               struct nary_node *out_node);
+
+/**
+ * A directory's children as they were in a snapshot, in name order
+ *
+ * @param children_out Receives a malloc'd array (NULL if there are none)
+ * @return 0, -ENOENT, -ENOTDIR or -ENOMEM
+ */
+int nary_snapshot_children_mt(struct nary_tree_mt *tree, uint32_t id, uint32_t dir_idx,
+                              uint32_t **children_out, uint32_t *count_out);
+
+/**
+ * Find a child by name in a snapshot's view of a directory
+ * Returns the child's index, or NARY_INVALID_IDX
+ */
+uint32_t nary_snapshot_find_child_mt(struct nary_tree_mt *tree, uint32_t id,
+                                     uint32_t dir_idx, const char *name);
+
+/**
+ * Path lookup in a snapshot ("/" is the snapshot's root)
+ * Returns the node's index, or NARY_INVALID_IDX
+ */
+uint32_t nary_snapshot_path_lookup_mt(struct nary_tree_mt *tree, uint32_t id,
+                                      const char *path);
+
+/**
+ * Index of a node of a snapshot by inode number
+ * Nodes still alive are found through the inode index (they cannot move
+ * while snapshots are held); others by a scan of the saved copies.
+ * Returns the node's index, or NARY_INVALID_IDX
+ */
+uint32_t nary_snapshot_inode_lookup_mt(struct nary_tree_mt *tree, uint32_t id,
+                                       uint32_t inode);
+
 /**
  * Set maximum memory usage limit for tree
  *
@@ -260,7 +750,8 @@ int nary_set_memory_limit_mt(struct nary_tree_mt *tree, uint64_t max_bytes);
  *
  * Returns approximate memory usage including:
  * - Node array (capacity * sizeof(nary_node_mt))
- * - Free list (capacity * sizeof(uint16_t))
+ * - Free list (capacity * sizeof(uint32_t))
+ * - Child blocks (NARY_CHILD_BLOCKS(capacity) * sizeof(nary_child_block))
  * - String table internals
  *
  * @param tree  Tree structure
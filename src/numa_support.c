@@ -22,6 +22,8 @@
 #define MPOL_F_NODE (1<<0)
 #define MPOL_F_ADDR (1<<1)
 
+#define MPOL_MF_MOVE (1<<1)
+
 /* Syscall numbers for x86_64 */
 #ifndef __NR_mbind
 #define __NR_mbind 237
@@ -31,8 +33,18 @@
 #define __NR_get_mempolicy 239
 #endif
 
+#ifndef __NR_move_pages
+#define __NR_move_pages 279
+#endif
+
+/* Pages queried per move_pages call */
+#define NUMA_QUERY_BATCH 512
+
 static int g_numa_nodes = 1;
 static int g_numa_available = 0;
+static enum numa_policy g_numa_policy = NUMA_POLICY_DEFAULT;
+static enum numa_huge_pages g_huge_pages = NUMA_HUGE_OFF;
+static int g_hugetlb_short = 0;  /* The pool ran out once (reported once) */
 
 /* Direct syscall wrappers */
 static long sys_mbind(void *addr, unsigned long len, int mode,
@@ -61,7 +73,7 @@ int numa_init(void) {
 
         /* Count NUMA nodes from /sys/devices/system/node/ */
         g_numa_nodes = 1;
-        for (int i = 0; i < 8; i++) {
+        for (int i = 0; i < NUMA_MAX_NODES; i++) {
             char path[256];
             snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", i);
             if (access(path, F_OK) == 0) {
@@ -154,3 +166,276 @@ void numa_free(void *ptr, size_t size) {
         free(ptr);
     }
 }
+
+int numa_node_count(void) {
+    return g_numa_nodes;
+}
+
+static const char *const g_policy_names[] = {
+    [NUMA_POLICY_DEFAULT] = "default",
+    [NUMA_POLICY_INTERLEAVE] = "interleave",
+    [NUMA_POLICY_LOCAL] = "local",
+    [NUMA_POLICY_SUBTREE] = "subtree",
+};
+
+int numa_policy_parse(const char *name, enum numa_policy *out) {
+    if (!name || !out) return -1;
+
+    for (size_t i = 0; i < sizeof(g_policy_names) / sizeof(g_policy_names[0]); i++) {
+        if (strcmp(name, g_policy_names[i]) == 0) {
+            *out = (enum numa_policy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *numa_policy_name(enum numa_policy policy) {
+    if ((size_t)policy >= sizeof(g_policy_names) / sizeof(g_policy_names[0])) {
+        return "unknown";
+    }
+    return g_policy_names[policy];
+}
+
+void numa_set_policy(enum numa_policy policy) {
+    __atomic_store_n(&g_numa_policy, policy, __ATOMIC_RELAXED);
+}
+
+enum numa_policy numa_get_policy(void) {
+    return __atomic_load_n(&g_numa_policy, __ATOMIC_RELAXED);
+}
+
+int numa_place(void *addr, size_t len, enum numa_mem_class cls, int node) {
+    if (!g_numa_available || !addr || len == 0) {
+        return 0;
+    }
+
+    /* Whole pages only */
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len) & ~(page - 1);
+    if (end <= start) {
+        return 0;
+    }
+
+    if (node < 0 || node >= g_numa_nodes) {
+        node = numa_get_current_node();
+    }
+
+    int mode;
+    unsigned long nodemask;
+    switch (numa_get_policy()) {
+    case NUMA_POLICY_INTERLEAVE:
+    case NUMA_POLICY_SUBTREE:
+        if (cls == NUMA_MEM_METADATA) {
+            mode = MPOL_INTERLEAVE;
+            nodemask = (1UL << g_numa_nodes) - 1;
+        } else {
+            mode = MPOL_PREFERRED;
+            nodemask = 1UL << (numa_get_policy() == NUMA_POLICY_SUBTREE ?
+                               node : numa_get_current_node());
+        }
+        break;
+    case NUMA_POLICY_LOCAL:
+        mode = MPOL_PREFERRED;
+        nodemask = 1UL << numa_get_current_node();
+        break;
+    case NUMA_POLICY_DEFAULT:
+    default:
+        if (cls == NUMA_MEM_FILE_DATA) {
+            return 0;  /* First touch */
+        }
+        mode = MPOL_BIND;
+        nodemask = 1UL << node;
+        break;
+    }
+
+    if (sys_mbind((void *)start, end - start, mode, &nodemask,
+                  sizeof(nodemask) * 8, MPOL_MF_MOVE) == 0) {
+        return 0;
+    }
+    return -1;
+}
+
+static const char *const g_huge_names[] = {
+    [NUMA_HUGE_OFF] = "off",
+    [NUMA_HUGE_THP] = "thp",
+    [NUMA_HUGE_HUGETLB] = "hugetlb",
+};
+
+int numa_huge_pages_parse(const char *name, enum numa_huge_pages *out) {
+    if (!name || !out) return -1;
+
+    for (size_t i = 0; i < sizeof(g_huge_names) / sizeof(g_huge_names[0]); i++) {
+        if (strcmp(name, g_huge_names[i]) == 0) {
+            *out = (enum numa_huge_pages)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *numa_huge_pages_name(enum numa_huge_pages mode) {
+    if ((size_t)mode >= sizeof(g_huge_names) / sizeof(g_huge_names[0])) {
+        return "unknown";
+    }
+    return g_huge_names[mode];
+}
+
+void numa_set_huge_pages(enum numa_huge_pages mode) {
+    __atomic_store_n(&g_huge_pages, mode, __ATOMIC_RELAXED);
+}
+
+enum numa_huge_pages numa_get_huge_pages(void) {
+    return __atomic_load_n(&g_huge_pages, __ATOMIC_RELAXED);
+}
+
+size_t numa_commit_granule(void) {
+    if (numa_get_huge_pages() != NUMA_HUGE_OFF) {
+        return NUMA_HUGE_PAGE_SIZE;
+    }
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+static size_t huge_round(size_t len) {
+    return (len + NUMA_HUGE_PAGE_SIZE - 1) & ~(NUMA_HUGE_PAGE_SIZE - 1);
+}
+
+void *numa_reserve(size_t len) {
+    if (len == 0) {
+        return NULL;
+    }
+
+    /* One huge page of slack, trimmed off again, buys a 2MB-aligned start
+     * (whatever the mode: it may be switched on before the region grows) */
+    size_t size = huge_round(len);
+    size_t span = size + NUMA_HUGE_PAGE_SIZE;
+    char *raw = mmap(NULL, span, PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *base = (char *)(((uintptr_t)raw + NUMA_HUGE_PAGE_SIZE - 1) &
+                          ~(uintptr_t)(NUMA_HUGE_PAGE_SIZE - 1));
+    if (base > raw) {
+        munmap(raw, (size_t)(base - raw));
+    }
+    munmap(base + size, (size_t)(raw + span - (base + size)));
+
+#ifdef MADV_HUGEPAGE
+    /* Kept by the pieces mprotect() later splits off */
+    if (numa_get_huge_pages() != NUMA_HUGE_OFF) {
+        madvise(base, size, MADV_HUGEPAGE);
+    }
+#endif
+    return base;
+}
+
+void numa_release(void *addr, size_t len) {
+    if (addr && len) {
+        munmap(addr, huge_round(len));
+    }
+}
+
+/* Map [addr, addr + len) (2MB aligned) from the huge page pool, or with
+ * base pages if the pool cannot cover it */
+static int commit_hugetlb(void *addr, size_t len) {
+#ifdef MAP_HUGETLB
+    /* Without MAP_NORESERVE the pages are reserved now: a short pool fails
+     * here instead of with SIGBUS on first touch */
+    if (mmap(addr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0) != MAP_FAILED) {
+        return 0;
+    }
+#endif
+    if (!__atomic_exchange_n(&g_hugetlb_short, 1, __ATOMIC_RELAXED)) {
+        printf("ℹ️  Huge pages: pool exhausted, using transparent huge pages\n");
+    }
+
+    /* A failed MAP_FIXED call may have unmapped the range: map it again */
+    if (mmap(addr, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        return -1;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(addr, len, MADV_HUGEPAGE);
+#endif
+    return 0;
+}
+
+int numa_commit(void *addr, size_t len, enum numa_mem_class cls, int node) {
+    if (!addr || len == 0) {
+        return 0;
+    }
+
+    /* Pieces outside whole huge pages (or all of it) are made usable in place */
+    char *start = addr;
+    char *end = start + len;
+    char *huge_start = start, *huge_end = start;
+    if (numa_get_huge_pages() == NUMA_HUGE_HUGETLB) {
+        huge_start = (char *)(((uintptr_t)start + NUMA_HUGE_PAGE_SIZE - 1) &
+                              ~(uintptr_t)(NUMA_HUGE_PAGE_SIZE - 1));
+        huge_end = (char *)((uintptr_t)end & ~(uintptr_t)(NUMA_HUGE_PAGE_SIZE - 1));
+        if (huge_end <= huge_start) {
+            huge_start = huge_end = start;
+        } else if (commit_hugetlb(huge_start, (size_t)(huge_end - huge_start)) != 0) {
+            return -1;
+        }
+    }
+    if (huge_start > start &&
+        mprotect(start, (size_t)(huge_start - start), PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+    if (end > huge_end &&
+        mprotect(huge_end, (size_t)(end - huge_end), PROT_READ | PROT_WRITE) != 0) {
+        return -1;
+    }
+
+    /* Placement only: without NUMA the kernel's default policy applies */
+    numa_place(addr, len, cls, node);
+    return 0;
+}
+
+int numa_advise_huge(void *addr, size_t len) {
+    if (numa_get_huge_pages() == NUMA_HUGE_OFF || !addr || len == 0) {
+        return 0;
+    }
+#ifdef MADV_HUGEPAGE
+    return madvise(addr, len, MADV_HUGEPAGE) == 0 ? 0 : -1;
+#else
+    return -1;
+#endif
+}
+
+int numa_resident_bytes(const void *addr, size_t len, uint64_t *bytes_per_node) {
+    if (!g_numa_available || !addr || !bytes_per_node) {
+        return -1;
+    }
+
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);
+    uintptr_t end = ((uintptr_t)addr + len + page - 1) & ~(page - 1);
+
+    void *pages[NUMA_QUERY_BATCH];
+    int status[NUMA_QUERY_BATCH];
+
+    for (uintptr_t p = start; p < end; ) {
+        unsigned long count = 0;
+        while (count < NUMA_QUERY_BATCH && p < end) {
+            pages[count++] = (void *)p;
+            p += page;
+        }
+
+        /* No target nodes: only report where each page lives */
+        if (syscall(__NR_move_pages, 0, count, pages, NULL, status, 0) != 0) {
+            return -1;
+        }
+        for (unsigned long i = 0; i < count; i++) {
+            /* Negative status: not resident (never touched) */
+            if (status[i] >= 0 && status[i] < NUMA_MAX_NODES) {
+                bytes_per_node[status[i]] += page;
+            }
+        }
+    }
+    return 0;
+}
@@ -5,6 +5,10 @@
  * - Detect NUMA nodes
  * - Bind memory to CPU's NUMA node
  * - Uses mbind() for shared memory regions
+ * - A process-wide placement policy (chosen at mount time) decides where
+ *   metadata (tree nodes, string table) and file data pages go
+ * - An optional huge page mode backs the large metadata regions with 2MB
+ *   pages, so path walks across them take fewer TLB misses
  */
 
 #ifndef RAZORFS_NUMA_SUPPORT_H
@@ -17,6 +21,51 @@
 extern "C" {
 #endif
 
+/* Largest node count tracked (detection stops here) */
+#define NUMA_MAX_NODES 8
+
+/**
+ * Placement policy
+ *
+ *                 metadata                   file data
+ *   DEFAULT       bound to the given node    first touch (kernel default)
+ *   INTERLEAVE    interleaved over nodes     preferred on the local node
+ *   LOCAL         preferred on local node    preferred on the local node
+ *   SUBTREE       interleaved over nodes     preferred on the given node
+ *                                            (the node owning the subtree)
+ */
+enum numa_policy {
+    NUMA_POLICY_DEFAULT = 0,
+    NUMA_POLICY_INTERLEAVE,
+    NUMA_POLICY_LOCAL,
+    NUMA_POLICY_SUBTREE,
+};
+
+/**
+ * Huge page backing of metadata regions
+ *
+ *   OFF       base pages
+ *   THP       transparent huge pages (madvise(MADV_HUGEPAGE)); heap regions
+ *             are committed 2MB at a time so whole huge pages can fault in
+ *   HUGETLB   explicit huge pages (MAP_HUGETLB) for heap regions, from the
+ *             reserved pool; regions the pool cannot cover fall back to THP.
+ *             Shared memory and image mappings get THP (tmpfs huge pages
+ *             also depend on /sys/kernel/mm/transparent_hugepage/shmem_enabled)
+ */
+enum numa_huge_pages {
+    NUMA_HUGE_OFF = 0,
+    NUMA_HUGE_THP,
+    NUMA_HUGE_HUGETLB,
+};
+
+#define NUMA_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+/* What a placed region holds */
+enum numa_mem_class {
+    NUMA_MEM_METADATA,
+    NUMA_MEM_FILE_DATA,
+};
+
 /**
  * Initialize NUMA support
  * Returns number of NUMA nodes (1 if NUMA not available)
@@ -49,6 +98,103 @@ void numa_free(void *ptr, size_t size) __attribute__((unused));
  */
 int numa_available(void);
 
+/**
+ * Number of NUMA nodes detected by numa_init (1 without NUMA)
+ */
+int numa_node_count(void);
+
+/**
+ * Parse a policy name ("default", "interleave", "local", "subtree")
+ * @return 0 on success, -1 if unknown
+ */
+int numa_policy_parse(const char *name, enum numa_policy *out);
+
+/**
+ * Name of a policy
+ */
+const char *numa_policy_name(enum numa_policy policy);
+
+/**
+ * Set / get the process-wide placement policy
+ */
+void numa_set_policy(enum numa_policy policy);
+enum numa_policy numa_get_policy(void);
+
+/**
+ * Apply the placement policy to a region
+ * Only whole pages inside [addr, addr + len) are affected, so heap
+ * buffers sharing pages with other allocations are left alone. Pages
+ * already touched are migrated.
+ *
+ * @param cls What the region holds
+ * @param node Node for DEFAULT metadata and SUBTREE file data
+ *             (-1 = the calling thread's node)
+ * @return 0 on success or if nothing applies, -1 on failure
+ */
+int numa_place(void *addr, size_t len, enum numa_mem_class cls, int node);
+
+/**
+ * Parse a huge page mode ("off", "thp", "hugetlb")
+ * @return 0 on success, -1 if unknown
+ */
+int numa_huge_pages_parse(const char *name, enum numa_huge_pages *out);
+
+/**
+ * Name of a huge page mode
+ */
+const char *numa_huge_pages_name(enum numa_huge_pages mode);
+
+/**
+ * Set / get the process-wide huge page mode (before regions are reserved)
+ */
+void numa_set_huge_pages(enum numa_huge_pages mode);
+enum numa_huge_pages numa_get_huge_pages(void);
+
+/**
+ * Granularity in which growing heap regions should be committed:
+ * NUMA_HUGE_PAGE_SIZE with huge pages, else the base page size
+ */
+size_t numa_commit_granule(void);
+
+/**
+ * Reserve (PROT_NONE, not committed) address space for a heap region
+ * The start is 2MB aligned, so committed huge-page-sized pieces map
+ * whole huge pages. Release with numa_release().
+ *
+ * @return The region, or NULL on failure
+ */
+void *numa_reserve(size_t len);
+
+/**
+ * Release a region from numa_reserve() (same len)
+ */
+void numa_release(void *addr, size_t len);
+
+/**
+ * Commit [addr, addr + len) of a reserved region read/write and place it
+ * In HUGETLB mode, 2MB-aligned pieces are remapped from the huge page pool
+ * when it has room. Committed pages read as zero.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int numa_commit(void *addr, size_t len, enum numa_mem_class cls, int node);
+
+/**
+ * Ask for transparent huge pages on an existing mapping (shared memory,
+ * image files) when huge pages are enabled
+ *
+ * @return 0 on success or if off, -1 if the kernel refused
+ */
+int numa_advise_huge(void *addr, size_t len);
+
+/**
+ * Count the resident pages of a region per NUMA node
+ * Adds the bytes found on node N to bytes_per_node[N] (N < NUMA_MAX_NODES).
+ *
+ * @return 0 on success, -1 if page placement cannot be queried
+ */
+int numa_resident_bytes(const void *addr, size_t len, uint64_t *bytes_per_node);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,127 @@
+/**
+ * Path Resolution Cache Implementation - RAZORFS Dentry Cache
+ */
+
+#include "path_cache.h"
+#include "nary_node.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* FNV-1a over the path, also returning its length */
+static uint32_t hash_path(const char *path, size_t *len_out) {
+    uint32_t h = 2166136261u;
+    const unsigned char *p = (const unsigned char *)path;
+    while (*p) {
+        h = (h ^ *p++) * 16777619u;
+    }
+    *len_out = (size_t)(p - (const unsigned char *)path);
+    return h;
+}
+
+static inline struct path_cache_set *set_for(struct path_cache *cache, uint32_t hash) {
+    return &cache->sets[hash & (PATH_CACHE_SETS - 1)];
+}
+
+int path_cache_init(struct path_cache *cache) {
+    if (!cache) return -1;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->sets = calloc(PATH_CACHE_SETS, sizeof(struct path_cache_set));
+    if (!cache->sets) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < PATH_CACHE_SETS; i++) {
+        pthread_mutex_init(&cache->sets[i].lock, NULL);
+    }
+    return 0;
+}
+
+void path_cache_destroy(struct path_cache *cache) {
+    if (!cache || !cache->sets) return;
+
+    for (uint32_t i = 0; i < PATH_CACHE_SETS; i++) {
+        pthread_mutex_destroy(&cache->sets[i].lock);
+    }
+    free(cache->sets);
+    cache->sets = NULL;
+}
+
+uint32_t path_cache_lookup(struct path_cache *cache, const char *path, uint64_t generation) {
+    if (!cache || !cache->sets || !path) return NARY_INVALID_IDX;
+
+    size_t len;
+    uint32_t hash = hash_path(path, &len);
+    if (len >= PATH_CACHE_MAX_PATH) {
+        return NARY_INVALID_IDX;
+    }
+
+    struct path_cache_set *set = set_for(cache, hash);
+    uint32_t idx = NARY_INVALID_IDX;
+
+    pthread_mutex_lock(&set->lock);
+    for (int w = 0; w < PATH_CACHE_WAYS; w++) {
+        const struct path_cache_entry *e = &set->entries[w];
+        if (e->len == len && e->hash == hash && e->generation == generation &&
+            memcmp(e->path, path, len) == 0) {
+            idx = e->node_idx;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    if (idx != NARY_INVALID_IDX) {
+        __atomic_fetch_add(&cache->stats.hits, 1, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_add(&cache->stats.misses, 1, __ATOMIC_RELAXED);
+    }
+    return idx;
+}
+
+void path_cache_insert(struct path_cache *cache, const char *path,
+                       uint32_t node_idx, uint64_t generation) {
+    if (!cache || !cache->sets || !path || node_idx == NARY_INVALID_IDX) return;
+
+    size_t len;
+    uint32_t hash = hash_path(path, &len);
+    if (len == 0 || len >= PATH_CACHE_MAX_PATH) {
+        return;
+    }
+
+    struct path_cache_set *set = set_for(cache, hash);
+    pthread_mutex_lock(&set->lock);
+
+    /* Same path, then an empty or stale way, then round-robin */
+    int victim = -1;
+    for (int w = 0; w < PATH_CACHE_WAYS; w++) {
+        const struct path_cache_entry *e = &set->entries[w];
+        if (e->len == len && e->hash == hash && memcmp(e->path, path, len) == 0) {
+            victim = w;
+            break;
+        }
+        if (victim < 0 && (e->len == 0 || e->generation != generation)) {
+            victim = w;
+        }
+    }
+    if (victim < 0) {
+        victim = (int)(set->next_victim++ % PATH_CACHE_WAYS);
+    }
+
+    struct path_cache_entry *e = &set->entries[victim];
+    e->generation = generation;
+    e->hash = hash;
+    e->node_idx = node_idx;
+    e->len = (uint16_t)len;
+    memcpy(e->path, path, len);
+
+    pthread_mutex_unlock(&set->lock);
+    __atomic_fetch_add(&cache->stats.inserts, 1, __ATOMIC_RELAXED);
+}
+
+void path_cache_get_stats(struct path_cache *cache, struct path_cache_stats *stats) {
+    if (!cache || !stats) return;
+
+    stats->hits = __atomic_load_n(&cache->stats.hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&cache->stats.misses, __ATOMIC_RELAXED);
+    stats->inserts = __atomic_load_n(&cache->stats.inserts, __ATOMIC_RELAXED);
+}
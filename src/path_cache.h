@@ -0,0 +1,110 @@
+/**
+ * Path Resolution Cache - RAZORFS Dentry Cache
+ *
+ * Full path → node index cache in front of nary_path_lookup_mt, so a
+ * repeated stat/write on the same path is one hash probe instead of a
+ * locked walk per component:
+ * - Set-associative (PATH_CACHE_WAYS per set), one mutex per set
+ * - Every entry carries the tree's path generation it was resolved in;
+ *   a rename/unlink/rmdir or rebalance moves the generation on, which
+ *   stales every entry at once (no per-entry invalidation)
+ * - Only hits are cached; paths longer than PATH_CACHE_MAX_PATH bypass it
+ *
+ * The caller supplies the generation (see nary_paths_generation_mt): it
+ * must be read before the tree walk whose result is inserted.
+ */
+
+#ifndef RAZORFS_PATH_CACHE_H
+#define RAZORFS_PATH_CACHE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Configuration */
+#define PATH_CACHE_SETS      1024    /* Power of two */
+#define PATH_CACHE_WAYS      4
+#define PATH_CACHE_MAX_PATH  200     /* Longest cached path (bytes) */
+
+/**
+ * Cached resolution
+ */
+struct path_cache_entry {
+    uint64_t generation;         /* Path generation it was resolved in */
+    uint32_t hash;
+    uint32_t node_idx;
+    uint16_t len;                /* 0 = empty slot */
+    char path[PATH_CACHE_MAX_PATH];
+};
+
+/**
+ * One set of ways, replaced round-robin once none is empty or stale
+ */
+struct path_cache_set {
+    pthread_mutex_t lock;
+    uint32_t next_victim;
+    struct path_cache_entry entries[PATH_CACHE_WAYS];
+};
+
+/**
+ * Cache statistics
+ */
+struct path_cache_stats {
+    uint64_t hits;
+    uint64_t misses;             /* Includes stale entries */
+    uint64_t inserts;
+};
+
+/**
+ * Path cache
+ */
+struct path_cache {
+    struct path_cache_set *sets;
+    struct path_cache_stats stats;   /* Updated with __atomic builtins */
+};
+
+/**
+ * Initialize an empty cache
+ * @return 0 on success, -1 on allocation failure
+ */
+int path_cache_init(struct path_cache *cache);
+
+/**
+ * Free the cache (safe on a cache that failed to initialize)
+ */
+void path_cache_destroy(struct path_cache *cache);
+
+/**
+ * Look up a path resolved in the given generation
+ *
+ * @param cache Path cache
+ * @param path Absolute path as passed to nary_path_lookup_mt
+ * @param generation Current path generation
+ * @return Node index, or NARY_INVALID_IDX on a miss
+ */
+uint32_t path_cache_lookup(struct path_cache *cache, const char *path, uint64_t generation);
+
+/**
+ * Remember a resolution
+ *
+ * @param cache Path cache
+ * @param path Absolute path
+ * @param node_idx Node it resolved to
+ * @param generation Path generation read before resolving it
+ */
+void path_cache_insert(struct path_cache *cache, const char *path,
+                       uint32_t node_idx, uint64_t generation);
+
+/**
+ * Copy the counters
+ */
+void path_cache_get_stats(struct path_cache *cache, struct path_cache_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_PATH_CACHE_H */
@@ -0,0 +1,81 @@
+/**
+ * Background Compaction Implementation - RAZORFS Tree Locality
+ */
+
+#define _GNU_SOURCE
+#include "rebalancer.h"
+#include <string.h>
+#include <time.h>
+
+static void *rebalancer_main(void *arg) {
+    struct rebalancer *rb = arg;
+
+    pthread_mutex_lock(&rb->lock);
+    while (rb->running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (time_t)(rb->interval_ms / 1000);
+        deadline.tv_nsec += (long)(rb->interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&rb->wake, &rb->lock, &deadline);
+        if (!rb->running) break;
+
+        pthread_mutex_unlock(&rb->lock);
+        nary_rebalance_step_mt(rb->tree, rb->step_nodes);
+        pthread_mutex_lock(&rb->lock);
+    }
+    pthread_mutex_unlock(&rb->lock);
+
+    return NULL;
+}
+
+int rebalancer_init(struct rebalancer *rb, struct nary_tree_mt *tree,
+                    uint32_t interval_ms, uint32_t step_nodes) {
+    if (!rb || !tree) return -1;
+
+    memset(rb, 0, sizeof(*rb));
+    if (interval_ms == 0) {
+        return 0;  /* Compaction off */
+    }
+
+    rb->tree = tree;
+    rb->interval_ms = interval_ms;
+    rb->step_nodes = step_nodes ? step_nodes : NARY_REBALANCE_STEP_NODES;
+    rb->running = 1;
+
+    pthread_mutex_init(&rb->lock, NULL);
+
+    /* Deadlines are computed on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&rb->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&rb->thread, NULL, rebalancer_main, rb) != 0) {
+        pthread_cond_destroy(&rb->wake);
+        pthread_mutex_destroy(&rb->lock);
+        rb->running = 0;
+        return -1;
+    }
+    rb->started = 1;
+    return 0;
+}
+
+void rebalancer_destroy(struct rebalancer *rb) {
+    if (!rb || !rb->started) return;
+
+    pthread_mutex_lock(&rb->lock);
+    rb->running = 0;
+    pthread_cond_broadcast(&rb->wake);
+    pthread_mutex_unlock(&rb->lock);
+
+    pthread_join(rb->thread, NULL);
+    rb->started = 0;
+
+    pthread_cond_destroy(&rb->wake);
+    pthread_mutex_destroy(&rb->lock);
+}
@@ -0,0 +1,62 @@
+/**
+ * Background Compaction - RAZORFS Tree Locality
+ *
+ * Creates never renumber the tree themselves; a thread keeps hot
+ * directories compact instead:
+ * - Every interval_ms it runs one bounded step (nary_rebalance_step_mt)
+ *   of at most step_nodes nodes, driven by sampled lookup heat
+ * - The interval is also the grace period for indices a step retired,
+ *   so steps are never run back to back
+ * - An idle tree costs one scan of the hot ring per interval
+ */
+
+#ifndef RAZORFS_REBALANCER_H
+#define RAZORFS_REBALANCER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "nary_tree_mt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults */
+#define REBALANCER_DEFAULT_INTERVAL_MS  100    /* Time between steps */
+
+/**
+ * Compaction thread
+ */
+struct rebalancer {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         /* Shutdown */
+
+    pthread_t thread;
+    int started;                 /* Thread running */
+    int running;
+    uint32_t interval_ms;
+    uint32_t step_nodes;         /* Budget per step */
+
+    struct nary_tree_mt *tree;
+};
+
+/**
+ * Start compacting a tree in the background
+ *
+ * @param interval_ms Time between steps (0 = no thread, nothing is started)
+ * @param step_nodes Nodes per step (0 = NARY_REBALANCE_STEP_NODES)
+ * @return 0 on success, -1 on failure
+ */
+int rebalancer_init(struct rebalancer *rb, struct nary_tree_mt *tree,
+                    uint32_t interval_ms, uint32_t step_nodes);
+
+/**
+ * Stop the thread (a step in progress completes first)
+ */
+void rebalancer_destroy(struct rebalancer *rb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_REBALANCER_H */
@@ -4,18 +4,51 @@
 
 #include "recovery.h"
 #include "string_table.h"
+#include "compression.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <time.h>
+#include <pthread.h>
+
+/* Slot of tx_id in tx_hash (its entry, or the empty slot to claim) */
+static uint32_t tx_slot(const struct recovery_ctx *ctx, uint64_t tx_id) {
+    uint32_t mask = ctx->tx_hash_size - 1;
+    uint32_t slot = (uint32_t)((tx_id * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (ctx->tx_hash[slot] != 0 &&
+           ctx->tx_table[ctx->tx_hash[slot] - 1].tx_id != tx_id) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* Index of a transaction in tx_table, or RECOVERY_NO_TX */
+static uint32_t find_tx(const struct recovery_ctx *ctx, uint64_t tx_id) {
+    uint32_t slot = tx_slot(ctx, tx_id);
+    return ctx->tx_hash[slot] ? ctx->tx_hash[slot] - 1 : RECOVERY_NO_TX;
+}
+
+/* Double tx_hash and re-insert every transaction */
+static int grow_tx_hash(struct recovery_ctx *ctx) {
+    uint32_t new_size = ctx->tx_hash_size * 2;
+    uint32_t *new_hash = calloc(new_size, sizeof(uint32_t));
+    if (!new_hash) return -1;
+
+    free(ctx->tx_hash);
+    ctx->tx_hash = new_hash;
+    ctx->tx_hash_size = new_size;
+    for (uint32_t i = 0; i < ctx->tx_count; i++) {
+        ctx->tx_hash[tx_slot(ctx, ctx->tx_table[i].tx_id)] = i + 1;
+    }
+    return 0;
+}
 
 /* Helper to find or create transaction in table */
 static struct tx_info* find_or_create_tx(struct recovery_ctx *ctx, uint64_t tx_id) {
     /* Search for existing */
-    for (uint32_t i = 0; i < ctx->tx_count; i++) {
-        if (ctx->tx_table[i].tx_id == tx_id) {
-            return &ctx->tx_table[i];
-        }
+    uint32_t slot = tx_slot(ctx, tx_id);
+    if (ctx->tx_hash[slot] != 0) {
+        return &ctx->tx_table[ctx->tx_hash[slot] - 1];
     }
 
     /* Create new */
@@ -30,6 +63,12 @@ static struct tx_info* find_or_create_tx(struct recovery_ctx *ctx, uint64_t tx_i
         ctx->tx_capacity = new_cap;
     }
 
+    /* Keep the hash at most half full */
+    if ((ctx->tx_count + 1) * 2 > ctx->tx_hash_size) {
+        if (grow_tx_hash(ctx) != 0) return NULL;
+        slot = tx_slot(ctx, tx_id);
+    }
+
     struct tx_info *tx = &ctx->tx_table[ctx->tx_count++];
     memset(tx, 0, sizeof(*tx));
     tx->tx_id = tx_id;
@@ -37,10 +76,39 @@ static struct tx_info* find_or_create_tx(struct recovery_ctx *ctx, uint64_t tx_i
     tx->first_lsn = 0;
     tx->last_lsn = 0;
     tx->op_count = 0;
+    ctx->tx_hash[slot] = ctx->tx_count;
 
     return tx;
 }
 
+/* Record a valid entry in the entry index */
+static int add_entry(struct recovery_ctx *ctx, uint64_t offset, uint32_t tx) {
+    if (ctx->entry_count >= ctx->entry_capacity) {
+        uint32_t new_cap = ctx->entry_capacity ? ctx->entry_capacity * 2 : 1024;
+        struct recovery_entry *new_entries = realloc(ctx->entries,
+                                                     new_cap * sizeof(struct recovery_entry));
+        if (!new_entries) return -1;
+
+        ctx->entries = new_entries;
+        ctx->entry_capacity = new_cap;
+    }
+
+    ctx->entries[ctx->entry_count].offset = offset;
+    ctx->entries[ctx->entry_count].tx = tx;
+    ctx->entry_count++;
+    return 0;
+}
+
+static inline const struct wal_entry *indexed_entry(const struct recovery_ctx *ctx,
+                                                    const struct recovery_entry *e) {
+    return (const struct wal_entry *)(ctx->wal->log_buffer + e->offset);
+}
+
+/* Statistics are bumped from parallel redo workers */
+static inline void count_op(uint32_t *counter) {
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+}
+
 /* Initialize recovery context */
 int recovery_init(struct recovery_ctx *ctx, struct wal *wal,
                   struct nary_tree_mt *tree, struct string_table *strings) {
@@ -59,6 +127,14 @@ int recovery_init(struct recovery_ctx *ctx, struct wal *wal,
     }
     ctx->tx_count = 0;
 
+    ctx->tx_hash_size = 64;
+    ctx->tx_hash = calloc(ctx->tx_hash_size, sizeof(uint32_t));
+    if (!ctx->tx_hash) {
+        free(ctx->tx_table);
+        ctx->tx_table = NULL;
+        return -1;
+    }
+
     ctx->verbose = 1;  // Can be enabled for debugging
 
     return 0;
@@ -72,6 +148,10 @@ void recovery_destroy(struct recovery_ctx *ctx) {
         free(ctx->tx_table);
         ctx->tx_table = NULL;
     }
+    free(ctx->tx_hash);
+    free(ctx->entries);
+    free(ctx->inode_keys);
+    free(ctx->inode_nodes);
 
     memset(ctx, 0, sizeof(*ctx));
 }
@@ -80,8 +160,9 @@ void recovery_destroy(struct recovery_ctx *ctx) {
 int wal_needs_recovery(const struct wal *wal) {
     if (!wal || !wal->header) return 0;
 
-    /* No entries = clean */
-    if (wal->header->entry_count == 0) {
+    /* No entries, or all reclaimed by the last checkpoint = clean */
+    if (wal->header->entry_count == 0 ||
+        wal->header->head_offset == wal->header->tail_offset) {
         return 0;
     }
 
@@ -99,8 +180,7 @@ int wal_needs_recovery(const struct wal *wal) {
 }
 
 /* Read entry at given offset in WAL */
-static struct wal_entry* read_entry_at(const struct wal *wal, uint64_t offset,
-                                       void **data_out) {
+static struct wal_entry* read_entry_at(const struct wal *wal, uint64_t offset) {
     if (offset >= wal->buffer_size) {
         return NULL;
     }
@@ -119,41 +199,36 @@ static struct wal_entry* read_entry_at(const struct wal *wal, uint64_t offset,
         return NULL; // Corrupted data_len or entry extends beyond buffer
     }
 
-    /* Validate checksum */
-    struct wal_entry temp_entry;
-    memcpy(&temp_entry, entry, sizeof(struct wal_entry));
-    temp_entry.checksum = 0; // Zero out checksum in the copy, not the original
-
-    uint32_t header_checksum = wal_crc32(&temp_entry, sizeof(struct wal_entry));
-    uint32_t expected_checksum;
-
-    if (entry->data_len > 0) {
-        void *data_ptr = wal->log_buffer + offset + sizeof(struct wal_entry);
-        uint32_t data_checksum = wal_crc32(data_ptr, entry->data_len);
-        expected_checksum = wal_crc32_combine(header_checksum, data_checksum, entry->data_len);
-    } else {
-        expected_checksum = header_checksum;
-    }
+    /* Validate checksum (polynomial follows the log format version) */
+    const void *data_ptr = wal->log_buffer + offset + sizeof(struct wal_entry);
+    uint32_t expected_checksum = wal_entry_checksum(wal, entry, data_ptr, entry->data_len);
 
     if (entry->checksum != expected_checksum) {
         return NULL;  /* Corrupted */
     }
 
-    /* Extract data if present */
-    if (data_out) {
-        *data_out = NULL;  // Initialize to NULL
-        if (entry->data_len > 0) {
-            *data_out = malloc(entry->data_len);
-            if (*data_out) {
-                memcpy(*data_out, wal->log_buffer + offset + sizeof(struct wal_entry),
-                       entry->data_len);
-            }
-        }
-    }
-
     return entry;
 }
 
+/*
+ * An append that does not fit before the end of the buffer goes to its
+ * start, leaving stale bytes behind. Follow the LSN sequence across that
+ * gap: when the bytes at offset are not the entry with the expected LSN but
+ * offset 0 holds it, the log continues at 0.
+ */
+static uint64_t follow_wrap(const struct wal *wal, uint64_t offset,
+                            uint64_t head, uint64_t expected_lsn) {
+    if (offset == 0 || offset == head) {
+        return offset;
+    }
+    const struct wal_entry *at = read_entry_at(wal, offset);
+    if (at && at->lsn == expected_lsn) {
+        return offset;
+    }
+    const struct wal_entry *start = read_entry_at(wal, 0);
+    return (start && start->lsn == expected_lsn) ? 0 : offset;
+}
+
 /* Analysis phase: scan WAL and build transaction table */
 int recovery_analysis(struct recovery_ctx *ctx) {
     if (!ctx) return -1;
@@ -162,62 +237,79 @@ int recovery_analysis(struct recovery_ctx *ctx) {
         printf("[RECOVERY] Starting analysis phase...\n");
     }
 
-
-
-    if (ctx->verbose) {
-        printf("[RECOVERY] Starting analysis phase...\n");
-    }
+    ctx->entry_count = 0;
 
     /* Scan from tail to head */
-    uint64_t offset = ctx->wal->header->tail_offset;
     uint64_t head = ctx->wal->header->head_offset;
+    /* A tail left by checkpoint reclaim sits right after the checkpoint */
+    uint64_t offset = follow_wrap(ctx->wal, ctx->wal->header->tail_offset, head,
+                                  ctx->wal->header->checkpoint_lsn + 1);
+    int past_checkpoint = 0;
 
     while (offset != head) {
-        const struct wal_entry *entry = read_entry_at(ctx->wal, offset, NULL);
+        const struct wal_entry *entry = read_entry_at(ctx->wal, offset);
         if (!entry) {
             /* Corrupted entry - stop here */
             break;
         }
 
-        ctx->entries_scanned++;
-
-        /* Find or create transaction */
-        struct tx_info *tx = find_or_create_tx(ctx, entry->tx_id);
-        if (!tx) {
-            return -1;  // Out of memory
+        /* Transactions are only tracked up to the checkpoint; later entries
+         * are still indexed for redo/undo */
+        if (!past_checkpoint && entry->op_type == WAL_OP_CHECKPOINT) {
+            past_checkpoint = 1;
         }
 
-        /* Update transaction state based on operation */
-        switch (entry->op_type) {
-            case WAL_OP_BEGIN:
-                tx->state = TX_ACTIVE;
-                tx->first_lsn = entry->lsn;
-                break;
-
-            case WAL_OP_COMMIT:
-                tx->state = TX_COMMITTED;
-                tx->last_lsn = entry->lsn;
-                break;
-
-            case WAL_OP_ABORT:
-                tx->state = TX_ABORTED;
-                tx->last_lsn = entry->lsn;
-                break;
-
-            case WAL_OP_INSERT:
-            case WAL_OP_DELETE:
-            case WAL_OP_UPDATE:
-            case WAL_OP_WRITE:
-                tx->op_count++;
-                tx->last_lsn = entry->lsn;
-                break;
-
-            case WAL_OP_CHECKPOINT:
-                /* Stop at checkpoint */
-                goto done;
+        uint32_t tx_index = RECOVERY_NO_TX;
+        if (entry->tx_id != 0) {
+            if (past_checkpoint) {
+                tx_index = find_tx(ctx, entry->tx_id);
+            } else {
+                /* Find or create transaction */
+                struct tx_info *tx = find_or_create_tx(ctx, entry->tx_id);
+                if (!tx) {
+                    return -1;  // Out of memory
+                }
+                tx_index = (uint32_t)(tx - ctx->tx_table);
+
+                /* Update transaction state based on operation */
+                switch (entry->op_type) {
+                    case WAL_OP_BEGIN:
+                        tx->state = TX_ACTIVE;
+                        tx->first_lsn = entry->lsn;
+                        break;
+
+                    case WAL_OP_COMMIT:
+                        tx->state = TX_COMMITTED;
+                        tx->last_lsn = entry->lsn;
+                        break;
+
+                    case WAL_OP_ABORT:
+                        tx->state = TX_ABORTED;
+                        tx->last_lsn = entry->lsn;
+                        break;
+
+                    case WAL_OP_INSERT:
+                    case WAL_OP_DELETE:
+                    case WAL_OP_UPDATE:
+                    case WAL_OP_WRITE:
+                    case WAL_OP_RENAME:
+                    case WAL_OP_WRITE_DATA:
+                    case WAL_OP_REPAIR:
+                        tx->op_count++;
+                        tx->last_lsn = entry->lsn;
+                        break;
+
+                    default:
+                        break;
+                }
+            }
+        }
 
-            default:
-                break;
+        if (!past_checkpoint) {
+            ctx->entries_scanned++;
+        }
+        if (add_entry(ctx, offset, tx_index) != 0) {
+            return -1;  // Out of memory
         }
 
         /* Move to next entry */
@@ -225,9 +317,9 @@ int recovery_analysis(struct recovery_ctx *ctx) {
         if (offset >= ctx->wal->buffer_size) {
             offset = 0;  // Wraparound
         }
+        offset = follow_wrap(ctx->wal, offset, head, entry->lsn + 1);
     }
 
-done:
     if (ctx->verbose) {
         printf("[RECOVERY] Analysis complete: %u transactions, %u entries\n",
                ctx->tx_count, ctx->entries_scanned);
@@ -236,23 +328,258 @@ done:
     return 0;
 }
 
+/* === Record payloads === */
+
+/* Record layouts of logs before WAL_VERSION_IDX32 (16-bit node indices) */
+struct wal_insert_data_idx16 {
+    uint16_t parent_idx;
+    uint32_t inode;
+    uint32_t name_offset;
+    uint16_t mode;
+    uint64_t timestamp;
+} __attribute__((packed));
+
+struct wal_delete_data_idx16 {
+    uint16_t node_idx;
+    uint16_t parent_idx;
+    uint32_t inode;
+    uint32_t name_offset;
+    uint16_t mode;
+    uint64_t timestamp;
+} __attribute__((packed));
+
+struct wal_update_data_idx16 {
+    uint16_t node_idx;
+    uint32_t inode;
+    uint64_t old_size;
+    uint64_t new_size;
+    uint64_t old_mtime;
+    uint64_t new_mtime;
+    uint16_t mode;
+} __attribute__((packed));
+
+struct wal_write_data_idx16 {
+    uint16_t node_idx;
+    uint32_t inode;
+    uint64_t offset;
+    uint32_t length;
+    uint64_t old_size;
+    uint64_t new_size;
+    uint32_t data_checksum;
+} __attribute__((packed));
+
+/* Widened copy of a legacy record */
+union recovery_payload {
+    struct wal_insert_data insert;
+    struct wal_delete_data delete_op;
+    struct wal_update_data update;
+    struct wal_write_data write;
+};
+
+static inline uint32_t widen_idx(uint16_t idx) {
+    return idx == 0xFFFF ? NARY_INVALID_IDX : idx;
+}
+
+/* Operation data of an entry in the current record layout (legacy records
+ * are widened into buf); NULL if the entry is too short for its type */
+static const void *entry_payload(const struct recovery_ctx *ctx,
+                                 const struct wal_entry *entry,
+                                 union recovery_payload *buf) {
+    int legacy = ctx->wal->version < WAL_VERSION_IDX32;
+
+    switch (entry->op_type) {
+        case WAL_OP_INSERT: {
+            if (!legacy) {
+                return entry->data_len >= sizeof(struct wal_insert_data) ? entry->data : NULL;
+            }
+            if (entry->data_len < sizeof(struct wal_insert_data_idx16)) return NULL;
+            const struct wal_insert_data_idx16 *d = (const void *)entry->data;
+            buf->insert.parent_idx = widen_idx(d->parent_idx);
+            buf->insert.inode = d->inode;
+            buf->insert.name_offset = d->name_offset;
+            buf->insert.mode = d->mode;
+            buf->insert.timestamp = d->timestamp;
+            return &buf->insert;
+        }
+        case WAL_OP_DELETE: {
+            if (!legacy) {
+                return entry->data_len >= sizeof(struct wal_delete_data) ? entry->data : NULL;
+            }
+            if (entry->data_len < sizeof(struct wal_delete_data_idx16)) return NULL;
+            const struct wal_delete_data_idx16 *d = (const void *)entry->data;
+            buf->delete_op.node_idx = widen_idx(d->node_idx);
+            buf->delete_op.parent_idx = widen_idx(d->parent_idx);
+            buf->delete_op.inode = d->inode;
+            buf->delete_op.name_offset = d->name_offset;
+            buf->delete_op.mode = d->mode;
+            buf->delete_op.timestamp = d->timestamp;
+            return &buf->delete_op;
+        }
+        case WAL_OP_UPDATE: {
+            if (!legacy) {
+                return entry->data_len >= sizeof(struct wal_update_data) ? entry->data : NULL;
+            }
+            if (entry->data_len < sizeof(struct wal_update_data_idx16)) return NULL;
+            const struct wal_update_data_idx16 *d = (const void *)entry->data;
+            buf->update.node_idx = widen_idx(d->node_idx);
+            buf->update.inode = d->inode;
+            buf->update.old_size = d->old_size;
+            buf->update.new_size = d->new_size;
+            buf->update.old_mtime = d->old_mtime;
+            buf->update.new_mtime = d->new_mtime;
+            buf->update.mode = d->mode;
+            return &buf->update;
+        }
+        case WAL_OP_WRITE: {
+            if (!legacy) {
+                return entry->data_len >= sizeof(struct wal_write_data) ? entry->data : NULL;
+            }
+            if (entry->data_len < sizeof(struct wal_write_data_idx16)) return NULL;
+            const struct wal_write_data_idx16 *d = (const void *)entry->data;
+            buf->write.node_idx = widen_idx(d->node_idx);
+            buf->write.inode = d->inode;
+            buf->write.offset = d->offset;
+            buf->write.length = d->length;
+            buf->write.old_size = d->old_size;
+            buf->write.new_size = d->new_size;
+            buf->write.data_checksum = d->data_checksum;
+            return &buf->write;
+        }
+        case WAL_OP_RENAME:
+            /* Only written since WAL_VERSION_IDX32 */
+            return entry->data_len >= sizeof(struct wal_rename_data) ? entry->data : NULL;
+        case WAL_OP_REPAIR:
+            return !legacy && entry->data_len >= sizeof(struct wal_repair_data) ?
+                entry->data : NULL;
+        case WAL_OP_WRITE_DATA: {
+            /* Variable length: used in place, bytes included */
+            const struct wal_write_payload *p = (const void *)entry->data;
+            if (legacy || entry->data_len < sizeof(*p) ||
+                entry->data_len - sizeof(*p) < p->stored_len) {
+                return NULL;
+            }
+            return p;
+        }
+        default:
+            return entry->data;
+    }
+}
+
+/* === Inode index === */
+
+static inline uint32_t inode_hash(uint32_t inode) {
+    return inode * 2654435761u;
+}
+
+/* Record inode -> node index; safe against concurrent callers as long as
+ * each inode is only ever written by one thread (true within a partition) */
+static void inode_index_set(struct recovery_ctx *ctx, uint32_t inode, uint32_t idx) {
+    if (!ctx->inode_keys || inode == 0) return;
+
+    uint32_t mask = ctx->inode_slots - 1;
+    uint32_t slot = inode_hash(inode) & mask;
+    for (uint32_t probes = 0; probes < ctx->inode_slots; probes++) {
+        uint32_t key = __atomic_load_n(&ctx->inode_keys[slot], __ATOMIC_ACQUIRE);
+        if (key == 0) {
+            uint32_t expected = 0;
+            if (__atomic_compare_exchange_n(&ctx->inode_keys[slot], &expected, inode, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                key = inode;
+            } else {
+                key = expected;
+            }
+        }
+        if (key == inode) {
+            __atomic_store_n(&ctx->inode_nodes[slot], idx, __ATOMIC_RELEASE);
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/* Build the inode index from the current tree, sized for every indexed entry */
+static void build_inode_index(struct recovery_ctx *ctx) {
+    free(ctx->inode_keys);
+    free(ctx->inode_nodes);
+    ctx->inode_keys = NULL;
+    ctx->inode_nodes = NULL;
+
+    uint64_t wanted = 2 * ((uint64_t)ctx->tree->used + ctx->entry_count);
+    uint32_t slots = 64;
+    while (slots < wanted && slots < (1u << 31)) {
+        slots <<= 1;
+    }
+
+    ctx->inode_keys = calloc(slots, sizeof(uint32_t));
+    ctx->inode_nodes = calloc(slots, sizeof(uint32_t));
+    if (!ctx->inode_keys || !ctx->inode_nodes) {
+        /* Lookups fall back to scanning the tree */
+        free(ctx->inode_keys);
+        free(ctx->inode_nodes);
+        ctx->inode_keys = NULL;
+        ctx->inode_nodes = NULL;
+        return;
+    }
+    ctx->inode_slots = slots;
+
+    for (uint32_t i = 0; i < ctx->tree->used; i++) {
+        inode_index_set(ctx, ctx->tree->nodes[i].node.inode, i);
+    }
+}
+
+/* Find the live node holding an inode (NARY_INVALID_IDX if none) */
+static uint32_t find_node_by_inode(const struct recovery_ctx *ctx, uint32_t inode) {
+    if (inode == 0) return NARY_INVALID_IDX;
+
+    if (!ctx->inode_keys) {
+        for (uint32_t i = 0; i < ctx->tree->used; i++) {
+            if (ctx->tree->nodes[i].node.inode == inode) {
+                return i;
+            }
+        }
+        return NARY_INVALID_IDX;
+    }
+
+    uint32_t mask = ctx->inode_slots - 1;
+    uint32_t slot = inode_hash(inode) & mask;
+    for (uint32_t probes = 0; probes < ctx->inode_slots; probes++) {
+        uint32_t key = __atomic_load_n(&ctx->inode_keys[slot], __ATOMIC_ACQUIRE);
+        if (key == 0) break;
+        if (key == inode) {
+            uint32_t idx = __atomic_load_n(&ctx->inode_nodes[slot], __ATOMIC_ACQUIRE);
+            /* Deleted (or reused) nodes no longer carry the inode */
+            if (idx < ctx->tree->used && ctx->tree->nodes[idx].node.inode == inode) {
+                return idx;
+            }
+            return NARY_INVALID_IDX;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NARY_INVALID_IDX;
+}
+
+/* Node an operation refers to: the logged index if it still holds the
+ * logged inode, otherwise wherever replay placed that inode */
+static uint32_t resolve_node(const struct recovery_ctx *ctx, uint32_t node_idx, uint32_t inode) {
+    if (node_idx < ctx->tree->used && ctx->tree->nodes[node_idx].node.inode == inode) {
+        return node_idx;
+    }
+    uint32_t found = find_node_by_inode(ctx, inode);
+    return found != NARY_INVALID_IDX ? found : node_idx;
+}
+
 /* Check if insert was already applied (idempotency) */
 static int check_insert_applied(const struct recovery_ctx *ctx,
                                const struct wal_insert_data *data) {
     /* Look up by inode */
-    for (uint32_t i = 0; i < ctx->tree->used; i++) {
-        if (ctx->tree->nodes[i].node.inode == data->inode) {
-            return 1;  // Already exists
-        }
-    }
-    return 0;
+    return find_node_by_inode(ctx, data->inode) != NARY_INVALID_IDX;
 }
 
 /* Replay insert operation */
 static int replay_insert(struct recovery_ctx *ctx, const struct wal_insert_data *data) {
     /* Check idempotency */
     if (check_insert_applied(ctx, data)) {
-        ctx->ops_skipped++;
+        count_op(&ctx->ops_skipped);
         return 1;  // Already applied
     }
 
@@ -263,7 +590,7 @@ static int replay_insert(struct recovery_ctx *ctx, const struct wal_insert_data
     }
 
     /* Insert node */
-    uint16_t idx = nary_insert_mt(ctx->tree, data->parent_idx, name, data->mode);
+    uint32_t idx = nary_insert_mt(ctx->tree, data->parent_idx, name, data->mode);
     if (idx == NARY_INVALID_IDX) {
         return -1;
     }
@@ -271,19 +598,19 @@ static int replay_insert(struct recovery_ctx *ctx, const struct wal_insert_data
     /* Set inode and timestamp */
     ctx->tree->nodes[idx].node.inode = data->inode;
     ctx->tree->nodes[idx].node.mtime = data->timestamp;
+    inode_index_set(ctx, data->inode, idx);
 
-    ctx->ops_redone++;
+    count_op(&ctx->ops_redone);
     return 0;
 }
 
 /* Check if delete was already applied */
-static int check_delete_applied(const struct recovery_ctx *ctx,
-                               const struct wal_delete_data *data) {
-    if (data->node_idx >= ctx->tree->used) {
+static int check_delete_applied(const struct recovery_ctx *ctx, uint32_t node_idx) {
+    if (node_idx >= ctx->tree->used) {
         return 1;  // Node doesn't exist
     }
 
-    if (ctx->tree->nodes[data->node_idx].node.inode == 0) {
+    if (ctx->tree->nodes[node_idx].node.inode == 0) {
         return 1;  // Already deleted
     }
 
@@ -292,31 +619,33 @@ static int check_delete_applied(const struct recovery_ctx *ctx,
 
 /* Replay delete operation */
 static int replay_delete(struct recovery_ctx *ctx, const struct wal_delete_data *data) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+
     /* Check idempotency */
-    if (check_delete_applied(ctx, data)) {
-        ctx->ops_skipped++;
+    if (check_delete_applied(ctx, node_idx)) {
+        count_op(&ctx->ops_skipped);
         return 1;
     }
 
     /* Delete node by index */
-    int ret = nary_delete_mt(ctx->tree, data->node_idx, ctx->wal, 0);
+    int ret = nary_delete_mt(ctx->tree, node_idx, ctx->wal, 0);
     if (ret != 0) {
         return -1;
     }
 
-    ctx->ops_redone++;
+    count_op(&ctx->ops_redone);
     return 0;
 }
 
 /* Check if update was already applied */
-static int check_update_applied(const struct recovery_ctx *ctx,
+static int check_update_applied(const struct recovery_ctx *ctx, uint32_t node_idx,
                                const struct wal_update_data *data) {
-    if (data->node_idx >= ctx->tree->used) {
+    if (node_idx >= ctx->tree->used) {
         return -1;  // Invalid node
     }
 
     /* Check by timestamp */
-    if (ctx->tree->nodes[data->node_idx].node.mtime >= data->new_mtime) {
+    if (ctx->tree->nodes[node_idx].node.mtime >= data->new_mtime) {
         return 1;  // Already updated
     }
 
@@ -325,10 +654,12 @@ static int check_update_applied(const struct recovery_ctx *ctx,
 
 /* Replay update operation */
 static int replay_update(struct recovery_ctx *ctx, const struct wal_update_data *data) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+
     /* Check idempotency */
-    int applied = check_update_applied(ctx, data);
+    int applied = check_update_applied(ctx, node_idx, data);
     if (applied == 1) {
-        ctx->ops_skipped++;
+        count_op(&ctx->ops_skipped);
         return 1;
     }
     if (applied < 0) {
@@ -336,96 +667,475 @@ static int replay_update(struct recovery_ctx *ctx, const struct wal_update_data
     }
 
     /* Apply update */
-    struct nary_node *node = &ctx->tree->nodes[data->node_idx].node;
+    struct nary_node *node = &ctx->tree->nodes[node_idx].node;
     node->size = data->new_size;
     node->mtime = data->new_mtime;
     node->mode = data->mode;
 
-    ctx->ops_redone++;
+    count_op(&ctx->ops_redone);
     return 0;
 }
 
 /* Replay write operation */
 static int replay_write(struct recovery_ctx *ctx, const struct wal_entry *entry, const struct wal_write_data *data) {
-    if (data->node_idx >= ctx->tree->used) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used) {
         return -1;  /* Invalid node */
     }
 
     /* Apply update */
-    struct nary_node *node = &ctx->tree->nodes[data->node_idx].node;
+    struct nary_node *node = &ctx->tree->nodes[node_idx].node;
     node->size = data->new_size;
     node->mtime = entry->timestamp / 1000000;
 
-    ctx->ops_redone++;
+    count_op(&ctx->ops_redone);
     return 0;
 }
 
-/* Replay a single operation */
+/* Hand a write payload's change to the file data store */
+static int apply_payload(struct recovery_ctx *ctx, const struct wal_write_payload *p) {
+    const struct wal_write_data *data = &p->write;
+    if (p->kind != WAL_DATA_WRITE) {
+        return ctx->apply_data(ctx->apply_arg, p, NULL);
+    }
+
+    const void *bytes = p->bytes;
+    char *raw = NULL;
+    if (p->flags & WAL_PAYLOAD_COMPRESSED) {
+        raw = malloc(data->length ? data->length : 1);
+        if (!raw || decompress_block(p->bytes, p->stored_len, raw, data->length) != 0) {
+            free(raw);
+            return -1;
+        }
+        bytes = raw;
+    } else if (p->stored_len != data->length) {
+        return -1;
+    }
+
+    int ret = -1;
+    if (wal_checksum(ctx->wal, bytes, data->length) == data->data_checksum) {
+        ret = ctx->apply_data(ctx->apply_arg, p, bytes);
+    }
+    free(raw);
+    return ret;
+}
+
+/**
+ * Replay a write payload: the file data change (through apply_data), then
+ * the size. Writes only ever grow the size: a later write or truncate in
+ * the log sets it again, and sizes logged by concurrent writers may be
+ * stale. Files removed since are skipped.
+ */
+static int replay_write_data(struct recovery_ctx *ctx, const struct wal_entry *entry,
+                             const struct wal_write_payload *p) {
+    const struct wal_write_data *data = &p->write;
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used || ctx->tree->nodes[node_idx].node.inode != data->inode) {
+        count_op(&ctx->ops_skipped);
+        return 1;
+    }
+
+    if (ctx->apply_data) {
+        if (apply_payload(ctx, p) != 0) {
+            return -1;
+        }
+        count_op(&ctx->data_redone);
+    }
+
+    struct nary_node *node = &ctx->tree->nodes[node_idx].node;
+    if (p->kind == WAL_DATA_TRUNCATE ||
+        (p->kind == WAL_DATA_WRITE && node->size < data->new_size)) {
+        node->size = data->new_size;
+    }
+    node->mtime = entry->timestamp / 1000000;
+
+    count_op(&ctx->ops_redone);
+    return 0;
+}
+
+/* Is the node already linked as name under parent_idx? */
+static int rename_applied(const struct recovery_ctx *ctx, uint32_t node_idx,
+                          uint32_t parent_idx, const char *name) {
+    const struct nary_node *node = &ctx->tree->nodes[node_idx].node;
+    const char *now = string_table_get(&ctx->tree->strings, node->name_offset);
+    return node->parent_idx == parent_idx && now && strcmp(now, name) == 0;
+}
+
+/* Replay rename operation */
+static int replay_rename(struct recovery_ctx *ctx, const struct wal_rename_data *data) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used || ctx->tree->nodes[node_idx].node.inode != data->inode) {
+        return -1;
+    }
+
+    const char *name = string_table_get(ctx->strings, data->new_name_offset);
+    if (!name) {
+        return -1;
+    }
+
+    /* Check idempotency */
+    if (rename_applied(ctx, node_idx, data->new_parent_idx, name)) {
+        count_op(&ctx->ops_skipped);
+        return 1;
+    }
+
+    /* A replaced target was deleted by the record before this one */
+    unsigned int flags = (data->flags & WAL_RENAME_EXCHANGE) ? NARY_RENAME_EXCHANGE
+                                                              : NARY_RENAME_NOREPLACE;
+    if (nary_rename_mt(ctx->tree, node_idx, data->new_parent_idx, name, flags,
+                       NULL, ctx->wal, 0) != 0) {
+        return -1;
+    }
+
+    count_op(&ctx->ops_redone);
+    return 0;
+}
+
+/* Replay a razorfsck repair (it checks itself whether it is in place) */
+static int replay_repair(struct recovery_ctx *ctx, const struct wal_repair_data *data) {
+    int ret = nary_repair_link_mt(ctx->tree, data);
+    if (ret < 0) {
+        return -1;
+    }
+    count_op(ret == 0 ? &ctx->ops_redone : &ctx->ops_skipped);
+    return ret;
+}
+
+/* Replay a single operation (data from entry_payload) */
 static int replay_operation(struct recovery_ctx *ctx, const struct wal_entry *entry,
-                           void *data) {
+                           const void *data) {
     if (!data) return -1;
 
     switch (entry->op_type) {
         case WAL_OP_INSERT:
-            if (entry->data_len < sizeof(struct wal_insert_data)) return -1; // Corrupted data_len
-            return replay_insert(ctx, (struct wal_insert_data *)data);
+            return replay_insert(ctx, (const struct wal_insert_data *)data);
 
         case WAL_OP_DELETE:
-            if (entry->data_len < sizeof(struct wal_delete_data)) return -1; // Corrupted data_len
-            return replay_delete(ctx, (struct wal_delete_data *)data);
+            return replay_delete(ctx, (const struct wal_delete_data *)data);
 
         case WAL_OP_UPDATE:
-            if (entry->data_len < sizeof(struct wal_update_data)) return -1; // Corrupted data_len
-            return replay_update(ctx, (struct wal_update_data *)data);
+            return replay_update(ctx, (const struct wal_update_data *)data);
 
         case WAL_OP_WRITE:
-            if (entry->data_len < sizeof(struct wal_write_data)) return -1; // Corrupted data_len
-            return replay_write(ctx, entry, (struct wal_write_data *)data);
+            return replay_write(ctx, entry, (const struct wal_write_data *)data);
+
+        case WAL_OP_RENAME:
+            return replay_rename(ctx, (const struct wal_rename_data *)data);
+
+        case WAL_OP_WRITE_DATA:
+            return replay_write_data(ctx, entry, (const struct wal_write_payload *)data);
+
+        case WAL_OP_REPAIR:
+            return replay_repair(ctx, (const struct wal_repair_data *)data);
 
         default:
             return 0;
     }
 }
 
-/* Redo phase: replay committed transactions */
-int recovery_redo(struct recovery_ctx *ctx) {
-    if (!ctx) return -1;
+/* Replay if the transaction was committed or not part of a transaction */
+static int needs_redo(const struct recovery_ctx *ctx, const struct recovery_entry *e) {
+    const struct wal_entry *entry = indexed_entry(ctx, e);
+    if ((entry->op_type < WAL_OP_INSERT || entry->op_type > WAL_OP_WRITE) &&
+        entry->op_type != WAL_OP_RENAME && entry->op_type != WAL_OP_WRITE_DATA &&
+        entry->op_type != WAL_OP_REPAIR) {
+        return 0;
+    }
+    return e->tx == RECOVERY_NO_TX || ctx->tx_table[e->tx].state == TX_COMMITTED;
+}
 
-    if (ctx->verbose) {
-        printf("[RECOVERY] Starting redo phase...\n");
+static void redo_entry(struct recovery_ctx *ctx, const struct recovery_entry *e) {
+    const struct wal_entry *entry = indexed_entry(ctx, e);
+    union recovery_payload buf;
+    replay_operation(ctx, entry, entry_payload(ctx, entry, &buf));
+}
+
+/* === Parallel redo === */
+
+/* Run of ctx->entries positions (in redo_work.order) replayed by one worker */
+struct redo_partition {
+    uint32_t first;
+    uint32_t count;
+};
+
+struct redo_work {
+    struct recovery_ctx *ctx;
+    const uint32_t *order;               /* Entry positions grouped by partition */
+    const struct redo_partition *parts;
+    uint32_t part_count;
+    uint32_t next;                       /* Next partition to claim */
+};
+
+static uint32_t uf_find(uint32_t *parent, uint32_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];  /* Path halving */
+        x = parent[x];
     }
+    return x;
+}
 
-    /* Scan WAL again, replay operations from committed transactions */
-    uint64_t offset = ctx->wal->header->tail_offset;
-    uint64_t head = ctx->wal->header->head_offset;
+static void uf_union(uint32_t *parent, uint32_t a, uint32_t b) {
+    a = uf_find(parent, a);
+    b = uf_find(parent, b);
+    if (a != b) {
+        parent[a < b ? b : a] = a < b ? a : b;
+    }
+}
 
-    while (offset != head) {
-        void *data = NULL;
-        const struct wal_entry *entry = read_entry_at(ctx->wal, offset, &data);
-        if (!entry) break;
-
-        /* Find transaction */
-        const struct tx_info *tx = NULL;
-        for (uint32_t i = 0; i < ctx->tx_count; i++) {
-            if (ctx->tx_table[i].tx_id == entry->tx_id) {
-                tx = &ctx->tx_table[i];
-                break;
-            }
+/* Dependency keys: node indices and inodes live in separate key spaces */
+#define REDO_KEY_NODE(idx)    ((1ULL << 32) | (uint64_t)(idx))
+#define REDO_KEY_INODE(ino)   ((2ULL << 32) | (uint64_t)(ino))
+#define REDO_MAX_KEYS 5
+
+/* Keys an operation depends on; parents are included for inserts, deletes
+ * and renames because they change their children */
+static int redo_keys(const struct recovery_ctx *ctx, const struct wal_entry *entry,
+                     uint64_t *keys) {
+    union recovery_payload buf;
+    const void *data = entry_payload(ctx, entry, &buf);
+    if (!data) return 0;
+
+    switch (entry->op_type) {
+        case WAL_OP_INSERT: {
+            const struct wal_insert_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->parent_idx);
+            keys[1] = REDO_KEY_INODE(d->inode);
+            return 2;
+        }
+        case WAL_OP_DELETE: {
+            const struct wal_delete_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->node_idx);
+            keys[1] = REDO_KEY_NODE(d->parent_idx);
+            keys[2] = REDO_KEY_INODE(d->inode);
+            return 3;
+        }
+        case WAL_OP_UPDATE: {
+            const struct wal_update_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->node_idx);
+            keys[1] = REDO_KEY_INODE(d->inode);
+            return 2;
+        }
+        case WAL_OP_WRITE:
+        case WAL_OP_WRITE_DATA: {
+            /* A payload record starts with its wal_write_data */
+            const struct wal_write_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->node_idx);
+            keys[1] = REDO_KEY_INODE(d->inode);
+            return 2;
         }
+        case WAL_OP_RENAME: {
+            const struct wal_rename_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->node_idx);
+            keys[1] = REDO_KEY_INODE(d->inode);
+            keys[2] = REDO_KEY_NODE(d->old_parent_idx);
+            keys[3] = REDO_KEY_NODE(d->new_parent_idx);
+            if (!d->other_inode) return 4;
+            keys[4] = REDO_KEY_INODE(d->other_inode);
+            return 5;
+        }
+        case WAL_OP_REPAIR: {
+            const struct wal_repair_data *d = data;
+            keys[0] = REDO_KEY_NODE(d->parent_idx);
+            keys[1] = REDO_KEY_NODE(d->kind == WAL_REPAIR_REATTACH ? d->node_idx : d->child_idx);
+            return 2;
+        }
+        default:
+            return 0;
+    }
+}
+
+static int compare_partitions(const void *a, const void *b) {
+    const struct redo_partition *pa = a, *pb = b;
+    return pa->count < pb->count ? 1 : (pa->count > pb->count ? -1 : 0);
+}
+
+/*
+ * Group redo entries into independent partitions.
+ * Unit of grouping is the transaction (entries without one stand alone);
+ * two units are merged when any of their operations share a key.
+ */
+static int build_partitions(struct recovery_ctx *ctx, uint32_t **order_out,
+                            struct redo_partition **parts_out, uint32_t *part_count_out,
+                            uint32_t *inserts_out) {
+    uint32_t units = ctx->tx_count + ctx->entry_count;
+    uint32_t key_slots = 64;
+    while (key_slots < 2ULL * REDO_MAX_KEYS * ctx->entry_count && key_slots < (1u << 31)) {
+        key_slots <<= 1;
+    }
 
-        /* Only replay if transaction was committed or not part of a transaction */
-        if (!tx || tx->state == TX_COMMITTED) {
-            if (entry->op_type >= WAL_OP_INSERT && entry->op_type <= WAL_OP_WRITE) {
-                replay_operation(ctx, entry, data);
+    uint32_t *uf = malloc(units * sizeof(uint32_t));
+    uint64_t *key_tab = calloc(key_slots, sizeof(uint64_t));
+    uint32_t *key_unit = malloc(key_slots * sizeof(uint32_t));
+    uint32_t *part_of = malloc(units * sizeof(uint32_t));
+    uint32_t *entry_part = malloc(ctx->entry_count * sizeof(uint32_t));
+    uint32_t *order = malloc(ctx->entry_count * sizeof(uint32_t));
+    struct redo_partition *parts = calloc(ctx->entry_count + 1, sizeof(struct redo_partition));
+    if (!uf || !key_tab || !key_unit || !part_of || !entry_part || !order || !parts) {
+        free(uf); free(key_tab); free(key_unit); free(part_of);
+        free(entry_part); free(order); free(parts);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < units; i++) {
+        uf[i] = i;
+        part_of[i] = UINT32_MAX;
+    }
+
+    uint32_t inserts = 0;
+    for (uint32_t i = 0; i < ctx->entry_count; i++) {
+        const struct recovery_entry *e = &ctx->entries[i];
+        if (!needs_redo(ctx, e)) continue;
+
+        const struct wal_entry *entry = indexed_entry(ctx, e);
+        if (entry->op_type == WAL_OP_INSERT) inserts++;
+
+        uint32_t unit = e->tx != RECOVERY_NO_TX ? e->tx : ctx->tx_count + i;
+        uint64_t keys[REDO_MAX_KEYS];
+        int nkeys = redo_keys(ctx, entry, keys);
+        for (int k = 0; k < nkeys; k++) {
+            uint32_t slot = (uint32_t)((keys[k] * 0x9E3779B97F4A7C15ULL) >> 32) & (key_slots - 1);
+            while (key_tab[slot] != 0 && key_tab[slot] != keys[k]) {
+                slot = (slot + 1) & (key_slots - 1);
+            }
+            if (key_tab[slot] == 0) {
+                key_tab[slot] = keys[k];
+                key_unit[slot] = unit;
+            } else {
+                uf_union(uf, unit, key_unit[slot]);
             }
         }
+    }
 
-        if (data) free(data);
+    /* Number partitions in order of first appearance and size them */
+    uint32_t part_count = 0;
+    for (uint32_t i = 0; i < ctx->entry_count; i++) {
+        const struct recovery_entry *e = &ctx->entries[i];
+        if (!needs_redo(ctx, e)) continue;
 
-        /* Move to next entry */
-        offset += sizeof(struct wal_entry) + entry->data_len;
-        if (offset >= ctx->wal->buffer_size) {
-            offset = 0;
+        uint32_t root = uf_find(uf, e->tx != RECOVERY_NO_TX ? e->tx : ctx->tx_count + i);
+        if (part_of[root] == UINT32_MAX) {
+            part_of[root] = part_count++;
+        }
+        entry_part[i] = part_of[root];
+        parts[entry_part[i]].count++;
+    }
+
+    uint32_t next = 0;
+    for (uint32_t p = 0; p < part_count; p++) {
+        parts[p].first = next;
+        next += parts[p].count;
+        parts[p].count = 0;
+    }
+
+    /* Fill in log order so each partition replays in its original order */
+    for (uint32_t i = 0; i < ctx->entry_count; i++) {
+        if (!needs_redo(ctx, &ctx->entries[i])) continue;
+        struct redo_partition *part = &parts[entry_part[i]];
+        order[part->first + part->count++] = i;
+    }
+
+    /* Largest first, so the long tail starts early */
+    qsort(parts, part_count, sizeof(struct redo_partition), compare_partitions);
+
+    free(uf);
+    free(key_tab);
+    free(key_unit);
+    free(part_of);
+    free(entry_part);
+
+    *order_out = order;
+    *parts_out = parts;
+    *part_count_out = part_count;
+    *inserts_out = inserts;
+    return 0;
+}
+
+static void *redo_worker(void *arg) {
+    struct redo_work *work = arg;
+
+    for (;;) {
+        uint32_t p = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED);
+        if (p >= work->part_count) break;
+
+        const struct redo_partition *part = &work->parts[p];
+        for (uint32_t i = 0; i < part->count; i++) {
+            redo_entry(work->ctx, &work->ctx->entries[work->order[part->first + i]]);
+        }
+    }
+    return NULL;
+}
+
+/* Replay partitions on a worker pool; returns -1 to fall back to serial */
+static int redo_parallel(struct recovery_ctx *ctx) {
+    uint32_t *order = NULL;
+    struct redo_partition *parts = NULL;
+    uint32_t part_count = 0, inserts = 0;
+
+    if (build_partitions(ctx, &order, &parts, &part_count, &inserts) != 0) {
+        return -1;
+    }
+    ctx->partitions = part_count;
+
+    /* Workers hold node pointers across inserts: the node array must not
+     * move under them */
+    if (part_count < 2 || nary_reserve_mt(ctx->tree, inserts) != 0) {
+        free(order);
+        free(parts);
+        return -1;
+    }
+
+    struct redo_work work = {
+        .ctx = ctx,
+        .order = order,
+        .parts = parts,
+        .part_count = part_count,
+        .next = 0
+    };
+
+    uint32_t threads = ctx->redo_threads;
+    if (threads > RECOVERY_MAX_THREADS) threads = RECOVERY_MAX_THREADS;
+    if (threads > part_count) threads = part_count;
+
+    pthread_t tids[RECOVERY_MAX_THREADS];
+    uint32_t started = 0;
+    for (uint32_t t = 1; t < threads; t++) {
+        if (pthread_create(&tids[started], NULL, redo_worker, &work) != 0) {
+            break;  /* Fewer workers; the rest of the queue still drains */
+        }
+        started++;
+    }
+
+    redo_worker(&work);
+    for (uint32_t t = 0; t < started; t++) {
+        pthread_join(tids[t], NULL);
+    }
+
+    if (ctx->verbose) {
+        printf("[RECOVERY] Replayed %u partitions on %u threads\n",
+               part_count, started + 1);
+    }
+
+    free(order);
+    free(parts);
+    return 0;
+}
+
+/* Redo phase: replay committed transactions */
+int recovery_redo(struct recovery_ctx *ctx) {
+    if (!ctx) return -1;
+
+    if (ctx->verbose) {
+        printf("[RECOVERY] Starting redo phase...\n");
+    }
+
+    build_inode_index(ctx);
+
+    /* Walk the entry index from analysis, replaying committed operations */
+    if (ctx->redo_threads <= 1 || redo_parallel(ctx) != 0) {
+        for (uint32_t i = 0; i < ctx->entry_count; i++) {
+            if (needs_redo(ctx, &ctx->entries[i])) {
+                redo_entry(ctx, &ctx->entries[i]);
+            }
         }
     }
 
@@ -439,28 +1149,24 @@ int recovery_redo(struct recovery_ctx *ctx) {
 
 static int undo_insert(struct recovery_ctx *ctx, const struct wal_insert_data *data) {
     /* Find the node by inode - it should exist if insert was applied */
-    for (uint32_t i = 0; i < ctx->tree->used; i++) {
-        if (ctx->tree->nodes[i].node.inode == 0) {
-            continue; // Skip logically deleted nodes
+    uint32_t i = find_node_by_inode(ctx, data->inode);
+    if (i != NARY_INVALID_IDX) {
+        if (ctx->verbose) {
+            printf("[RECOVERY] undo_insert: Found node with inode %u at index %u. Attempting delete.\n", data->inode, i);
         }
-        if (ctx->tree->nodes[i].node.inode == data->inode) {
-            if (ctx->verbose) {
-                printf("[RECOVERY] undo_insert: Found node with inode %u at index %u. Attempting delete.\n", data->inode, i);
-            }
-            /* Found it, now delete it */
-            int delete_ret = nary_delete_mt(ctx->tree, i, ctx->wal, 0);
-            if (delete_ret == 0) {
-                ctx->ops_undone++;
-                if (ctx->verbose) {
-                    printf("[RECOVERY] undo_insert: nary_delete_mt successful. ops_undone: %u\n", ctx->ops_undone);
-                }
-                return 0;
-            }
+        /* Found it, now delete it */
+        int delete_ret = nary_delete_mt(ctx->tree, i, ctx->wal, 0);
+        if (delete_ret == 0) {
+            ctx->ops_undone++;
             if (ctx->verbose) {
-                printf("[RECOVERY] undo_insert: nary_delete_mt failed with code %d.\n", delete_ret);
+                printf("[RECOVERY] undo_insert: nary_delete_mt successful. ops_undone: %u\n", ctx->ops_undone);
             }
-            return -1; /* Failed to delete */
+            return 0;
         }
+        if (ctx->verbose) {
+            printf("[RECOVERY] undo_insert: nary_delete_mt failed with code %d.\n", delete_ret);
+        }
+        return -1; /* Failed to delete */
     }
     if (ctx->verbose) {
         printf("[RECOVERY] undo_insert: Node with inode %u not found. Skipping undo.\n", data->inode);
@@ -476,7 +1182,7 @@ static int undo_delete(struct recovery_ctx *ctx, const struct wal_delete_data *d
         return -1;
     }
 
-    uint16_t new_idx = nary_insert_mt(ctx->tree, data->parent_idx, name, data->mode);
+    uint32_t new_idx = nary_insert_mt(ctx->tree, data->parent_idx, name, data->mode);
     if (new_idx == NARY_INVALID_IDX) {
         return -1; /* Failed to re-insert */
     }
@@ -485,6 +1191,7 @@ static int undo_delete(struct recovery_ctx *ctx, const struct wal_delete_data *d
     struct nary_node *node = &ctx->tree->nodes[new_idx].node;
     node->inode = data->inode;
     node->mtime = data->timestamp;
+    inode_index_set(ctx, data->inode, new_idx);
 
     ctx->ops_undone++;
     return 0;
@@ -492,12 +1199,13 @@ static int undo_delete(struct recovery_ctx *ctx, const struct wal_delete_data *d
 
 /* Undo a single update operation */
 static int undo_update(struct recovery_ctx *ctx, const struct wal_update_data *data) {
-    if (data->node_idx >= ctx->tree->used) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used) {
         return 0; /* Node doesn't exist, update was not applied */
     }
 
     /* Restore old attributes */
-    struct nary_node *node = &ctx->tree->nodes[data->node_idx].node;
+    struct nary_node *node = &ctx->tree->nodes[node_idx].node;
     node->size = data->old_size;
     node->mtime = data->old_mtime;
     /* Mode is not changed in update, so no need to restore */
@@ -508,21 +1216,49 @@ static int undo_update(struct recovery_ctx *ctx, const struct wal_update_data *d
 
 /* Undo a single write operation */
 static int undo_write(struct recovery_ctx *ctx, const struct wal_write_data *data) {
-    if (data->node_idx >= ctx->tree->used) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used) {
         return 0; /* Node doesn't exist, so write was not applied */
     }
 
     /* Restore old file size. This is critical to prevent corruption
      * where a file has a larger size than its actual content post-recovery. */
-    struct nary_node *node = &ctx->tree->nodes[data->node_idx].node;
+    struct nary_node *node = &ctx->tree->nodes[node_idx].node;
     node->size = data->old_size;
 
     ctx->ops_undone++;
     return 0;
 }
 
-/* Undo a single operation */
-static int undo_operation(struct recovery_ctx *ctx, const struct wal_entry *entry, void *data) {
+/* Undo a single rename: move the node back (swapping back on exchange) */
+static int undo_rename(struct recovery_ctx *ctx, const struct wal_rename_data *data) {
+    uint32_t node_idx = resolve_node(ctx, data->node_idx, data->inode);
+    if (node_idx >= ctx->tree->used || ctx->tree->nodes[node_idx].node.inode != data->inode) {
+        return 0; /* Node doesn't exist, rename was not applied */
+    }
+
+    const char *new_name = string_table_get(ctx->strings, data->new_name_offset);
+    const char *name = string_table_get(ctx->strings, data->old_name_offset);
+    if (!new_name || !name) {
+        return -1;
+    }
+    if (!rename_applied(ctx, node_idx, data->new_parent_idx, new_name)) {
+        return 0; /* Not moved */
+    }
+
+    unsigned int flags = (data->flags & WAL_RENAME_EXCHANGE) ? NARY_RENAME_EXCHANGE
+                                                              : NARY_RENAME_NOREPLACE;
+    if (nary_rename_mt(ctx->tree, node_idx, data->old_parent_idx, name, flags,
+                       NULL, ctx->wal, 0) != 0) {
+        return -1;
+    }
+
+    ctx->ops_undone++;
+    return 0;
+}
+
+/* Undo a single operation (data from entry_payload) */
+static int undo_operation(struct recovery_ctx *ctx, const struct wal_entry *entry, const void *data) {
     if (!data) return -1;
     if (ctx->verbose) {
         printf("[RECOVERY] Undoing op_type: %u, tx_id: %lu, lsn: %lu\n",
@@ -531,113 +1267,22 @@ static int undo_operation(struct recovery_ctx *ctx, const struct wal_entry *entr
 
     switch (entry->op_type) {
         case WAL_OP_INSERT:
-            if (entry->data_len < sizeof(struct wal_insert_data)) return -1; // Corrupted data_len
-            return undo_insert(ctx, (struct wal_insert_data *)data);
+            return undo_insert(ctx, (const struct wal_insert_data *)data);
         case WAL_OP_DELETE:
-            if (entry->data_len < sizeof(struct wal_delete_data)) return -1; // Corrupted data_len
-            return undo_delete(ctx, (struct wal_delete_data *)data);
+            return undo_delete(ctx, (const struct wal_delete_data *)data);
         case WAL_OP_UPDATE:
-            if (entry->data_len < sizeof(struct wal_update_data)) return -1; // Corrupted data_len
-            return undo_update(ctx, (struct wal_update_data *)data);
+            return undo_update(ctx, (const struct wal_update_data *)data);
         case WAL_OP_WRITE:
-            if (entry->data_len < sizeof(struct wal_write_data)) return -1; // Corrupted data_len
-            return undo_write(ctx, (struct wal_write_data *)data);
+        case WAL_OP_WRITE_DATA:
+            /* Sizes only: data written by an unfinished transaction stays */
+            return undo_write(ctx, (const struct wal_write_data *)data);
+        case WAL_OP_RENAME:
+            return undo_rename(ctx, (const struct wal_rename_data *)data);
         default:
             return 0;
     }
 }
 
-/* Read entry at previous offset in WAL (for backward scan) */
-/* Structure to cache entry offsets for efficient backward traversal */
-struct offset_cache {
-    uint64_t *offsets;
-    uint32_t count;
-    uint32_t capacity;
-};
-
-static struct offset_cache* build_offset_cache(const struct wal *wal) {
-    struct offset_cache *cache = calloc(1, sizeof(struct offset_cache));
-    if (!cache) return NULL;
-
-    cache->capacity = 1024;  /* Initial capacity */
-    cache->offsets = malloc(cache->capacity * sizeof(uint64_t));
-    if (!cache->offsets) {
-        free(cache);
-        return NULL;
-    }
-
-    /* Scan forward from tail to head, recording all entry offsets */
-    uint64_t offset = wal->header->tail_offset;
-    uint64_t head = wal->header->head_offset;
-
-    while (offset != head) {
-        /* Grow cache if needed */
-        if (cache->count >= cache->capacity) {
-            uint32_t new_capacity = cache->capacity * 2;
-            uint64_t *new_offsets = realloc(cache->offsets, new_capacity * sizeof(uint64_t));
-            if (!new_offsets) {
-                free(cache->offsets);
-                free(cache);
-                return NULL;
-            }
-            cache->offsets = new_offsets;
-            cache->capacity = new_capacity;
-        }
-
-        cache->offsets[cache->count++] = offset;
-
-        /* Read entry to get size */
-        struct wal_entry *entry = (struct wal_entry *)(wal->log_buffer + offset);
-        if (entry->data_len > wal->buffer_size) {
-            /* Corruption detected */
-            free(cache->offsets);
-            free(cache);
-            return NULL;
-        }
-
-        /* Advance to next entry */
-        uint64_t entry_size = sizeof(struct wal_entry) + entry->data_len;
-        offset += entry_size;
-        if (offset >= wal->buffer_size) {
-            offset = 0;  /* Wrap around circular buffer */
-        }
-    }
-
-    return cache;
-}
-
-static void free_offset_cache(struct offset_cache *cache) {
-    if (cache) {
-        free(cache->offsets);
-        free(cache);
-    }
-}
-
-static struct wal_entry* read_prev_entry_at(const struct wal *wal, uint64_t *offset,
-                                            void **data_out, struct offset_cache *cache) {
-    if (!cache || cache->count == 0) {
-        return NULL;
-    }
-
-    /* Find current offset in cache */
-    int32_t current_idx = -1;
-    for (uint32_t i = 0; i < cache->count; i++) {
-        if (cache->offsets[i] == *offset) {
-            current_idx = (int32_t)i;
-            break;
-        }
-    }
-
-    if (current_idx <= 0) {
-        return NULL;  /* At beginning or not found */
-    }
-
-    /* Get previous offset */
-    *offset = cache->offsets[current_idx - 1];
-    return read_entry_at(wal, *offset, data_out);
-}
-
-
 /* Undo phase: roll back uncommitted transactions */
 int recovery_undo(struct recovery_ctx *ctx) {
     if (!ctx) return -1;
@@ -646,12 +1291,10 @@ int recovery_undo(struct recovery_ctx *ctx) {
         printf("[RECOVERY] Starting undo phase...\n");
     }
 
-    /* Create a set of active transaction IDs for quick lookup */
-    uint64_t active_tx_ids[ctx->tx_count];
     uint32_t active_tx_count = 0;
     for (uint32_t i = 0; i < ctx->tx_count; i++) {
         if (ctx->tx_table[i].state == TX_ACTIVE) {
-            active_tx_ids[active_tx_count++] = ctx->tx_table[i].tx_id;
+            active_tx_count++;
         }
     }
 
@@ -662,47 +1305,19 @@ int recovery_undo(struct recovery_ctx *ctx) {
         return 0; /* Nothing to do */
     }
 
-    /* Build offset cache for efficient backward traversal (O(n) instead of O(n^2)) */
-    struct offset_cache *cache = build_offset_cache(ctx->wal);
-    if (!cache) {
-        fprintf(stderr, "[RECOVERY] Failed to build offset cache for undo phase\n");
-        return -1;
-    }
-
-    if (ctx->verbose) {
-        printf("[RECOVERY] Built offset cache with %u entries for backward scan\n", cache->count);
-    }
-
-    /* Scan WAL backwards from head to tail using cached offsets */
-    uint64_t offset = ctx->wal->header->head_offset;
-    while (offset != ctx->wal->header->tail_offset) {
-        if (ctx->verbose) {
-            printf("[RECOVERY] Undo loop: current offset = %lu\n", offset);
-        }
-        void *data = NULL;
-        struct wal_entry *entry = read_prev_entry_at(ctx->wal, &offset, &data, cache);
-        if (!entry) break;
+    /* Scan the entry index from analysis backwards, head to tail */
+    for (uint32_t i = ctx->entry_count; i-- > 0;) {
+        const struct recovery_entry *e = &ctx->entries[i];
 
         /* Check if this entry belongs to an active transaction */
-        int is_active = 0;
-        for (uint32_t i = 0; i < active_tx_count; i++) {
-            if (entry->tx_id == active_tx_ids[i]) {
-                is_active = 1;
-                break;
-            }
-        }
-
-        if (is_active) {
+        if (e->tx != RECOVERY_NO_TX && ctx->tx_table[e->tx].state == TX_ACTIVE) {
             /* This operation needs to be undone */
-            undo_operation(ctx, entry, data);
+            const struct wal_entry *entry = indexed_entry(ctx, e);
+            union recovery_payload buf;
+            undo_operation(ctx, entry, entry_payload(ctx, entry, &buf));
         }
-
-        if (data) free(data);
     }
 
-    /* Free the offset cache */
-    free_offset_cache(cache);
-
     if (ctx->verbose) {
         printf("[RECOVERY] Undo complete: %u operations rolled back\n", ctx->ops_undone);
     }
@@ -764,6 +1379,7 @@ void recovery_print_stats(const struct recovery_ctx *ctx) {
     printf("Operations redone:  %u\n", ctx->ops_redone);
     printf("Operations undone:  %u\n", ctx->ops_undone);
     printf("Operations skipped: %u\n", ctx->ops_skipped);
+    printf("File data redone:   %u\n", ctx->data_redone);
     printf("Recovery time:      %lu μs (%.2f ms)\n",
            ctx->recovery_time_us, ctx->recovery_time_us / 1000.0);
     printf("===========================\n\n");
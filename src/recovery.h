@@ -25,6 +25,12 @@ enum tx_state {
     TX_ABORTED = 3       // Transaction aborted
 };
 
+/* Entry index: entry is not part of a tracked transaction (autocommit) */
+#define RECOVERY_NO_TX UINT32_MAX
+
+/* Upper bound on parallel redo workers */
+#define RECOVERY_MAX_THREADS 16
+
 /**
  * Transaction Information
  * Tracked during analysis phase
@@ -37,6 +43,15 @@ struct tx_info {
     uint32_t op_count;           // Number of operations
 };
 
+/**
+ * Log entry recorded by the analysis phase
+ * Redo and undo walk this index instead of rescanning the log.
+ */
+struct recovery_entry {
+    uint64_t offset;             // Entry offset in the log buffer
+    uint32_t tx;                 // Index into tx_table (RECOVERY_NO_TX = none)
+};
+
 /**
  * Recovery Context
  * Maintains state during recovery process
@@ -50,6 +65,18 @@ struct recovery_ctx {
     struct tx_info *tx_table;    // Array of transaction info
     uint32_t tx_count;           // Number of transactions
     uint32_t tx_capacity;        // Capacity of tx_table
+    uint32_t *tx_hash;           // tx_id -> tx_table index + 1 (open addressing)
+    uint32_t tx_hash_size;       // Slots in tx_hash (power of 2)
+
+    /* Entry index (log order, tail to head) */
+    struct recovery_entry *entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+
+    /* Inode -> node index (built for redo, written concurrently by partitions) */
+    uint32_t *inode_keys;        // Inode per slot (0 = empty)
+    uint32_t *inode_nodes;       // Node index per slot
+    uint32_t inode_slots;        // Slots (power of 2)
 
     /* Statistics */
     uint32_t entries_scanned;    // Entries scanned during analysis
@@ -58,8 +85,20 @@ struct recovery_ctx {
     uint32_t ops_skipped;        // Operations skipped (idempotent)
     uint64_t recovery_time_us;   // Total recovery time
 
+    uint32_t partitions;         // Independent partitions replayed by redo
+    uint32_t data_redone;        // Write payloads applied to file data
+
     /* Options */
     int verbose;                 // Print recovery progress
+    uint32_t redo_threads;       // Parallel redo workers (<= 1 = serial)
+
+    /* File data redo: called for every replayed WAL_OP_WRITE_DATA record
+     * with its bytes (raw, checksum verified; NULL for truncates and
+     * punches). Records of one inode arrive in log order, those of
+     * different inodes possibly at once. NULL = only sizes are redone. */
+    int (*apply_data)(void *arg, const struct wal_write_payload *record,
+                      const void *bytes);
+    void *apply_arg;
 };
 
 /* Core Recovery Functions */
@@ -86,6 +125,8 @@ int recovery_run(struct recovery_ctx *ctx) __attribute__((unused));
 
 /**
  * Analysis phase: scan WAL and build transaction table
+ * Also records the offset of every valid entry for redo and undo.
+ * tx_id 0 marks operations outside any transaction; they are not tracked.
  *
  * @param ctx Recovery context
  * @return 0 on success, -1 on error
@@ -95,6 +136,10 @@ int recovery_analysis(struct recovery_ctx *ctx);
 /**
  * Redo phase: replay committed transactions
  *
+ * With redo_threads > 1, committed transactions are grouped into partitions
+ * that share no node index, parent or inode; partitions are replayed on a
+ * worker pool, each in log order.
+ *
  * @param ctx Recovery context
  * @return 0 on success, -1 on error
  */
@@ -4,14 +4,17 @@
  */
 
 #include "s3_backend.h"
+#include "tiering.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
 
-/* Static error buffer */
-static char s3_error_buffer[512] = {0};
+/* Last error of the calling thread (transfers run parts on several) */
+static __thread char s3_error_buffer[512] = {0};
 
 /* Set last error message */
 static void s3_set_error(const char* msg) {
@@ -55,6 +58,11 @@ int s3_backend_init(struct s3_backend* backend,
         strncpy(backend->endpoint, S3_DEFAULT_ENDPOINT, sizeof(backend->endpoint) - 1);
     }
     
+    backend->part_size = S3_DEFAULT_PART_SIZE;
+    backend->concurrency = S3_DEFAULT_CONCURRENCY;
+    backend->max_retries = S3_DEFAULT_MAX_RETRIES;
+    backend->retry_base_ms = S3_DEFAULT_RETRY_BASE_MS;
+    
     backend->initialized = true;
     backend->use_ssl = true;
     
@@ -83,6 +91,28 @@ int s3_backend_configure_credentials(struct s3_backend* backend,
     return 0;
 }
 
+int s3_backend_configure_transfer(struct s3_backend* backend,
+                                  size_t part_size,
+                                  uint32_t concurrency,
+                                  uint32_t max_retries) {
+    if (!backend || (part_size && part_size < S3_MIN_PART_SIZE)) {
+        s3_set_error("Invalid parameters: part size below the S3 minimum");
+        return -1;
+    }
+    
+    if (!backend->initialized) {
+        s3_set_error("Backend not initialized");
+        return -1;
+    }
+    
+    if (part_size) backend->part_size = part_size;
+    if (concurrency) backend->concurrency = concurrency;
+    if (max_retries) backend->max_retries = max_retries;
+    
+    s3_set_error(NULL); /* Clear error */
+    return 0;
+}
+
 #ifdef HAS_AWS_SDK
 
 #include <aws/core/Aws.h>
@@ -92,14 +122,27 @@ int s3_backend_configure_credentials(struct s3_backend* backend,
 #include <aws/s3/model/GetObjectRequest.h>
 #include <aws/s3/model/DeleteObjectRequest.h>
 #include <aws/s3/model/HeadObjectRequest.h>
+#include <aws/s3/model/DeleteObjectsRequest.h>
+#include <aws/s3/model/Delete.h>
+#include <aws/s3/model/ObjectIdentifier.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompletedMultipartUpload.h>
+#include <aws/s3/model/CompletedPart.h>
+#include <aws/core/utils/stream/PreallocatedStreamBuf.h>
 #include <aws/core/utils/memory/stl/AWSString.h>
 #include <aws/core/utils/memory/AWSMemory.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <functional>
+#include <vector>
 
 /* AWS SDK initialization guard */
 static bool aws_sdk_initialized = false;
+static pthread_mutex_t s3_client_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* Initialize AWS SDK if needed */
 static int ensure_aws_sdk_initialized(void) {
@@ -111,6 +154,244 @@ static int ensure_aws_sdk_initialized(void) {
     return 0;
 }
 
+/* Create the S3 client on first use (shared by all threads of a transfer) */
+static Aws::S3::S3Client* get_client(struct s3_backend* backend) {
+    pthread_mutex_lock(&s3_client_lock);
+    if (!backend->s3_client) {
+        Aws::Client::ClientConfiguration config;
+        config.region = backend->region;
+        config.endpointOverride = backend->endpoint;
+        config.maxConnections = backend->concurrency > config.maxConnections ?
+                                backend->concurrency : config.maxConnections;
+        
+        if (backend->access_key[0] && backend->secret_key[0]) {
+            Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
+            backend->s3_client = new Aws::S3::S3Client(credentials, config);
+        } else {
+            backend->s3_client = new Aws::S3::S3Client(config);
+        }
+    }
+    Aws::S3::S3Client* client = backend->s3_client;
+    pthread_mutex_unlock(&s3_client_lock);
+    return client;
+}
+
+/* Record a failed request; true if it is worth another attempt */
+template <typename Outcome>
+static bool request_failed(const Outcome& outcome, const char* what) {
+    char error_msg[256];
+    snprintf(error_msg, sizeof(error_msg), "S3 %s failed: %s", what,
+             outcome.GetError().GetMessage().c_str());
+    s3_set_error(error_msg);
+    return outcome.GetError().ShouldRetry();
+}
+
+/* Run one request with retries; request() returns 0, or 1 to retry, -1 to give up */
+template <typename Request>
+static int with_retries(struct s3_backend* backend, Request request) {
+    unsigned int seed = (unsigned int)time(NULL) ^ (unsigned int)(uintptr_t)&seed;
+    for (uint32_t attempt = 0; ; attempt++) {
+        int ret;
+        try {
+            ret = request();
+        } catch (const std::exception& e) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg), "Exception during S3 request: %s", e.what());
+            s3_set_error(error_msg);
+            ret = 1;
+        }
+        if (ret <= 0 || attempt >= backend->max_retries) {
+            return ret == 0 ? 0 : -1;
+        }
+        
+        /* Exponential backoff with full jitter, capped at ~10 s */
+        uint64_t cap = (uint64_t)backend->retry_base_ms << (attempt < 7 ? attempt : 7);
+        usleep((useconds_t)((rand_r(&seed) % (cap + 1)) * 1000));
+    }
+}
+
+/* Run work(part) for parts [0, count), `concurrency` at a time */
+struct part_pool {
+    uint32_t count;
+    uint32_t next;               /* Next part to claim (__atomic) */
+    int failed;                  /* Stop claiming (__atomic) */
+    char error[512];             /* Error of the first failed part */
+    std::function<int(uint32_t)> work;
+};
+
+static void* part_worker(void* arg) {
+    struct part_pool* pool = static_cast<struct part_pool*>(arg);
+    while (!__atomic_load_n(&pool->failed, __ATOMIC_RELAXED)) {
+        uint32_t part = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (part >= pool->count) break;
+        if (pool->work(part) != 0) {
+            /* Errors are per thread: hand the first one to the caller */
+            int expected = 0;
+            if (__atomic_compare_exchange_n(&pool->failed, &expected, 1, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                snprintf(pool->error, sizeof(pool->error), "%s", s3_error_buffer);
+            }
+        }
+    }
+    return NULL;
+}
+
+static int run_parts(struct s3_backend* backend, uint32_t count,
+                     std::function<int(uint32_t)> work) {
+    struct part_pool pool;
+    pool.count = count;
+    pool.next = 0;
+    pool.failed = 0;
+    pool.work = work;
+    
+    uint32_t threads = backend->concurrency < count ? backend->concurrency : count;
+    std::vector<pthread_t> workers;
+    for (uint32_t i = 1; i < threads; i++) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, part_worker, &pool) != 0) break;
+        workers.push_back(t);
+    }
+    part_worker(&pool);  /* The caller is one of the workers */
+    for (pthread_t t : workers) {
+        pthread_join(t, NULL);
+    }
+    
+    if (pool.failed) {
+        s3_set_error(pool.error);
+        return -1;
+    }
+    return 0;
+}
+
+/* Part size for an object: the configured one, grown to stay within S3_MAX_PARTS */
+static size_t part_size_for(const struct s3_backend* backend, size_t size) {
+    size_t part = backend->part_size;
+    while ((size + part - 1) / part > S3_MAX_PARTS) {
+        part *= 2;
+    }
+    return part;
+}
+
+static int put_whole_object(struct s3_backend* backend, Aws::S3::S3Client* client,
+                            const char* key, const void* data, size_t size,
+                            const struct s3_object_metadata* metadata) {
+    return with_retries(backend, [&]() {
+        Aws::S3::Model::PutObjectRequest request;
+        request.SetBucket(backend->bucket_name);
+        request.SetKey(key);
+        
+        /* Stream straight out of the caller's buffer */
+        Aws::Utils::Stream::PreallocatedStreamBuf buf(
+            (unsigned char*)const_cast<void*>(data), size);
+        request.SetBody(Aws::MakeShared<Aws::IOStream>("PutObjectStream", &buf));
+        request.SetContentLength((long long)size);
+        
+        /* Set metadata if provided */
+        if (metadata) {
+            Aws::Map<Aws::String, Aws::String> meta_map;
+            meta_map["content-type"] = metadata->content_type;
+            request.SetMetadata(meta_map);
+        }
+        
+        auto outcome = client->PutObject(request);
+        if (outcome.IsSuccess()) return 0;
+        return request_failed(outcome, "PutObject") ? 1 : -1;
+    });
+}
+
+static int put_multipart(struct s3_backend* backend, Aws::S3::S3Client* client,
+                         const char* key, const void* data, size_t size,
+                         const struct s3_object_metadata* metadata) {
+    size_t part_size = part_size_for(backend, size);
+    uint32_t parts = (uint32_t)((size + part_size - 1) / part_size);
+    
+    Aws::String upload_id;
+    int ret = with_retries(backend, [&]() {
+        Aws::S3::Model::CreateMultipartUploadRequest request;
+        request.SetBucket(backend->bucket_name);
+        request.SetKey(key);
+        if (metadata) {
+            Aws::Map<Aws::String, Aws::String> meta_map;
+            meta_map["content-type"] = metadata->content_type;
+            request.SetMetadata(meta_map);
+        }
+        
+        auto outcome = client->CreateMultipartUpload(request);
+        if (outcome.IsSuccess()) {
+            upload_id = outcome.GetResult().GetUploadId();
+            return 0;
+        }
+        return request_failed(outcome, "CreateMultipartUpload") ? 1 : -1;
+    });
+    if (ret != 0) return -1;
+    
+    /* Each part retries on its own; the first that gives up fails the upload */
+    std::vector<Aws::String> etags(parts);
+    ret = run_parts(backend, parts, [&](uint32_t part) {
+        size_t offset = (size_t)part * part_size;
+        size_t len = size - offset < part_size ? size - offset : part_size;
+        return with_retries(backend, [&]() {
+            Aws::S3::Model::UploadPartRequest request;
+            request.SetBucket(backend->bucket_name);
+            request.SetKey(key);
+            request.SetUploadId(upload_id);
+            request.SetPartNumber((int)part + 1);
+            
+            Aws::Utils::Stream::PreallocatedStreamBuf buf(
+                (unsigned char*)const_cast<void*>(data) + offset, len);
+            request.SetBody(Aws::MakeShared<Aws::IOStream>("UploadPartStream", &buf));
+            request.SetContentLength((long long)len);
+            
+            auto outcome = client->UploadPart(request);
+            if (outcome.IsSuccess()) {
+                etags[part] = outcome.GetResult().GetETag();
+                return 0;
+            }
+            return request_failed(outcome, "UploadPart") ? 1 : -1;
+        });
+    });
+    
+    if (ret == 0) {
+        ret = with_retries(backend, [&]() {
+            Aws::S3::Model::CompletedMultipartUpload completed;
+            for (uint32_t part = 0; part < parts; part++) {
+                completed.AddParts(Aws::S3::Model::CompletedPart()
+                                       .WithETag(etags[part])
+                                       .WithPartNumber((int)part + 1));
+            }
+            
+            Aws::S3::Model::CompleteMultipartUploadRequest request;
+            request.SetBucket(backend->bucket_name);
+            request.SetKey(key);
+            request.SetUploadId(upload_id);
+            request.SetMultipartUpload(completed);
+            
+            auto outcome = client->CompleteMultipartUpload(request);
+            if (outcome.IsSuccess()) return 0;
+            return request_failed(outcome, "CompleteMultipartUpload") ? 1 : -1;
+        });
+    }
+    
+    if (ret != 0) {
+        /* Uploaded parts are billed until the upload is aborted */
+        char error_msg[512];
+        snprintf(error_msg, sizeof(error_msg), "%s", s3_error_buffer);
+        with_retries(backend, [&]() {
+            Aws::S3::Model::AbortMultipartUploadRequest request;
+            request.SetBucket(backend->bucket_name);
+            request.SetKey(key);
+            request.SetUploadId(upload_id);
+            
+            auto outcome = client->AbortMultipartUpload(request);
+            if (outcome.IsSuccess()) return 0;
+            return request_failed(outcome, "AbortMultipartUpload") ? 1 : -1;
+        });
+        s3_set_error(error_msg);  /* Report why the upload failed */
+        return -1;
+    }
+    return 0;
+}
+
 int s3_upload_object(struct s3_backend* backend,
                     const char* key,
                     const void* data,
@@ -132,58 +413,40 @@ int s3_upload_object(struct s3_backend* backend,
         return -1;
     }
     
-    try {
-        /* Create S3 client if needed */
-        if (!backend->s3_client) {
-            Aws::Client::ClientConfiguration config;
-            config.region = backend->region;
-            config.endpointOverride = backend->endpoint;
-            
-            if (backend->access_key[0] && backend->secret_key[0]) {
-                Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
-                backend->s3_client = new Aws::S3::S3Client(credentials, config);
-            } else {
-                backend->s3_client = new Aws::S3::S3Client(config);
-            }
-        }
-        
-        /* Create put object request */
-        Aws::S3::Model::PutObjectRequest request;
+    Aws::S3::S3Client* client = get_client(backend);
+    int ret = size > backend->part_size ?
+              put_multipart(backend, client, key, data, size, metadata) :
+              put_whole_object(backend, client, key, data, size, metadata);
+    if (ret == 0) s3_set_error(NULL);
+    return ret;
+}
+
+/* GET bytes [offset, offset + size) into buf, with retries */
+static int get_range(struct s3_backend* backend, Aws::S3::S3Client* client,
+                     const char* key, uint64_t offset, size_t size, void* buf) {
+    return with_retries(backend, [&]() {
+        Aws::S3::Model::GetObjectRequest request;
         request.SetBucket(backend->bucket_name);
         request.SetKey(key);
         
-        /* Create stream from data */
-        auto data_stream = Aws::MakeShared<Aws::StringStream>("PutObjectStream");
-        data_stream->write(static_cast<const char*>(data), size);
-        request.SetBody(data_stream);
+        char range[64];
+        snprintf(range, sizeof(range), "bytes=%llu-%llu",
+                 (unsigned long long)offset, (unsigned long long)(offset + size - 1));
+        request.SetRange(range);
         
-        /* Set metadata if provided */
-        if (metadata) {
-            Aws::Map<Aws::String, Aws::String> meta_map;
-            meta_map["content-type"] = metadata->content_type;
-            request.SetMetadata(meta_map);
+        auto outcome = client->GetObject(request);
+        if (!outcome.IsSuccess()) {
+            return request_failed(outcome, "GetObject") ? 1 : -1;
         }
         
-        /* Execute request */
-        auto outcome = backend->s3_client->PutObject(request);
-        
-        if (outcome.IsSuccess()) {
-            s3_set_error(NULL);
-            return 0;
-        } else {
-            char error_msg[256];
-            snprintf(error_msg, sizeof(error_msg), "S3 PutObject failed: %s", 
-                     outcome.GetError().GetMessage().c_str());
-            s3_set_error(error_msg);
-            return -1;
+        auto& body = outcome.GetResult().GetBody();
+        body.read(static_cast<char*>(buf), (std::streamsize)size);
+        if ((size_t)body.gcount() != size) {
+            s3_set_error("S3 GetObject returned a short range");
+            return 1;  /* Connection dropped mid-body */
         }
-        
-    } catch (const std::exception& e) {
-        char error_msg[256];
-        snprintf(error_msg, sizeof(error_msg), "Exception during S3 upload: %s", e.what());
-        s3_set_error(error_msg);
-        return -1;
-    }
+        return 0;
+    });
 }
 
 int s3_download_object(struct s3_backend* backend,
@@ -206,64 +469,83 @@ int s3_download_object(struct s3_backend* backend,
         return -1;
     }
     
-    try {
-        /* Create S3 client if needed */
-        if (!backend->s3_client) {
-            Aws::Client::ClientConfiguration config;
-            config.region = backend->region;
-            config.endpointOverride = backend->endpoint;
-            
-            if (backend->access_key[0] && backend->secret_key[0]) {
-                Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
-                backend->s3_client = new Aws::S3::S3Client(credentials, config);
-            } else {
-                backend->s3_client = new Aws::S3::S3Client(config);
-            }
-        }
-        
-        /* Create get object request */
-        Aws::S3::Model::GetObjectRequest request;
-        request.SetBucket(backend->bucket_name);
-        request.SetKey(key);
-        
-        /* Execute request */
-        auto outcome = backend->s3_client->GetObject(request);
-        
-        if (outcome.IsSuccess()) {
-            auto& body = outcome.GetResult().GetBody();
-            
-            /* Get content length */
-            size_t content_length = outcome.GetResult().GetContentLength();
-            
-            /* Allocate buffer */
-            void* buffer = malloc(content_length);
-            if (!buffer) {
-                s3_set_error("Memory allocation failed");
-                return -1;
-            }
-            
-            /* Read data into buffer */
-            body.read(static_cast<char*>(buffer), content_length);
-            
-            *data_out = buffer;
-            *size_out = content_length;
-            
-            s3_set_error(NULL);
-            return 0;
-        } else {
-            char error_msg[256];
-            snprintf(error_msg, sizeof(error_msg), "S3 GetObject failed: %s", 
-                     outcome.GetError().GetMessage().c_str());
-            s3_set_error(error_msg);
-            return -1;
-        }
-        
-    } catch (const std::exception& e) {
-        char error_msg[256];
-        snprintf(error_msg, sizeof(error_msg), "Exception during S3 download: %s", e.what());
-        s3_set_error(error_msg);
+    /* Size first, so the parts can be fetched in parallel into one buffer */
+    struct s3_object_metadata metadata;
+    memset(&metadata, 0, sizeof(metadata));
+    if (s3_get_object_metadata(backend, key, &metadata) != 0) {
+        return -1;
+    }
+    
+    size_t size = metadata.size;
+    char* buffer = static_cast<char*>(malloc(size ? size : 1));
+    if (!buffer) {
+        s3_set_error("Memory allocation failed");
+        return -1;
+    }
+    
+    Aws::S3::S3Client* client = get_client(backend);
+    int ret = 0;
+    if (size > backend->part_size) {
+        size_t part_size = backend->part_size;
+        uint32_t parts = (uint32_t)((size + part_size - 1) / part_size);
+        ret = run_parts(backend, parts, [&](uint32_t part) {
+            size_t offset = (size_t)part * part_size;
+            size_t len = size - offset < part_size ? size - offset : part_size;
+            return get_range(backend, client, key, offset, len, buffer + offset);
+        });
+    } else if (size > 0) {
+        ret = get_range(backend, client, key, 0, size, buffer);
+    }
+    
+    if (ret != 0) {
+        free(buffer);
+        return -1;
+    }
+    
+    *data_out = buffer;
+    *size_out = size;
+    s3_set_error(NULL);
+    return 0;
+}
+
+int s3_download_range(struct s3_backend* backend,
+                      const char* key,
+                      uint64_t offset,
+                      size_t size,
+                      void* buf) {
+    if (!backend || !key || !buf || size == 0) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+    
+    if (!backend->initialized) {
+        s3_set_error("Backend not initialized");
         return -1;
     }
+    
+    /* Ensure AWS SDK is initialized */
+    if (ensure_aws_sdk_initialized() != 0) {
+        s3_set_error("Failed to initialize AWS SDK");
+        return -1;
+    }
+    
+    Aws::S3::S3Client* client = get_client(backend);
+    int ret;
+    if (size > backend->part_size) {
+        size_t part_size = backend->part_size;
+        uint32_t parts = (uint32_t)((size + part_size - 1) / part_size);
+        ret = run_parts(backend, parts, [&](uint32_t part) {
+            size_t pos = (size_t)part * part_size;
+            size_t len = size - pos < part_size ? size - pos : part_size;
+            return get_range(backend, client, key, offset + pos, len,
+                             static_cast<char*>(buf) + pos);
+        });
+    } else {
+        ret = get_range(backend, client, key, offset, size, buf);
+    }
+    
+    if (ret == 0) s3_set_error(NULL);
+    return ret;
 }
 
 int s3_delete_object(struct s3_backend* backend,
@@ -285,19 +567,7 @@ int s3_delete_object(struct s3_backend* backend,
     }
     
     try {
-        /* Create S3 client if needed */
-        if (!backend->s3_client) {
-            Aws::Client::ClientConfiguration config;
-            config.region = backend->region;
-            config.endpointOverride = backend->endpoint;
-            
-            if (backend->access_key[0] && backend->secret_key[0]) {
-                Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
-                backend->s3_client = new Aws::S3::S3Client(credentials, config);
-            } else {
-                backend->s3_client = new Aws::S3::S3Client(config);
-            }
-        }
+        Aws::S3::S3Client* client = get_client(backend);
         
         /* Create delete object request */
         Aws::S3::Model::DeleteObjectRequest request;
@@ -305,7 +575,7 @@ int s3_delete_object(struct s3_backend* backend,
         request.SetKey(key);
         
         /* Execute request */
-        auto outcome = backend->s3_client->DeleteObject(request);
+        auto outcome = client->DeleteObject(request);
         
         if (outcome.IsSuccess()) {
             s3_set_error(NULL);
@@ -346,19 +616,7 @@ int s3_get_object_metadata(struct s3_backend* backend,
     }
     
     try {
-        /* Create S3 client if needed */
-        if (!backend->s3_client) {
-            Aws::Client::ClientConfiguration config;
-            config.region = backend->region;
-            config.endpointOverride = backend->endpoint;
-            
-            if (backend->access_key[0] && backend->secret_key[0]) {
-                Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
-                backend->s3_client = new Aws::S3::S3Client(credentials, config);
-            } else {
-                backend->s3_client = new Aws::S3::S3Client(config);
-            }
-        }
+        Aws::S3::S3Client* client = get_client(backend);
         
         /* Create head object request */
         Aws::S3::Model::HeadObjectRequest request;
@@ -366,7 +624,7 @@ int s3_get_object_metadata(struct s3_backend* backend,
         request.SetKey(key);
         
         /* Execute request */
-        auto outcome = backend->s3_client->HeadObject(request);
+        auto outcome = client->HeadObject(request);
         
         if (outcome.IsSuccess()) {
             const auto& result = outcome.GetResult();
@@ -425,19 +683,7 @@ int s3_object_exists(struct s3_backend* backend,
     }
     
     try {
-        /* Create S3 client if needed */
-        if (!backend->s3_client) {
-            Aws::Client::ClientConfiguration config;
-            config.region = backend->region;
-            config.endpointOverride = backend->endpoint;
-            
-            if (backend->access_key[0] && backend->secret_key[0]) {
-                Aws::Auth::AWSCredentials credentials(backend->access_key, backend->secret_key);
-                backend->s3_client = new Aws::S3::S3Client(credentials, config);
-            } else {
-                backend->s3_client = new Aws::S3::S3Client(config);
-            }
-        }
+        Aws::S3::S3Client* client = get_client(backend);
         
         /* Create head object request */
         Aws::S3::Model::HeadObjectRequest request;
@@ -445,7 +691,7 @@ int s3_object_exists(struct s3_backend* backend,
         request.SetKey(key);
         
         /* Execute request */
-        auto outcome = backend->s3_client->HeadObject(request);
+        auto outcome = client->HeadObject(request);
         
         if (outcome.IsSuccess()) {
             s3_set_error(NULL);
@@ -473,6 +719,75 @@ int s3_object_exists(struct s3_backend* backend,
     }
 }
 
+int s3_delete_objects(struct s3_backend* backend,
+                      const char* const* keys,
+                      size_t count,
+                      int* status_out) {
+    if (!backend || (count && !keys)) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+    
+    if (!backend->initialized) {
+        s3_set_error("Backend not initialized");
+        return -1;
+    }
+    
+    /* Ensure AWS SDK is initialized */
+    if (ensure_aws_sdk_initialized() != 0) {
+        s3_set_error("Failed to initialize AWS SDK");
+        return -1;
+    }
+    
+    Aws::S3::S3Client* client = get_client(backend);
+    int ret = 0;
+    for (size_t first = 0; first < count; first += S3_DELETE_BATCH_MAX) {
+        size_t n = count - first < S3_DELETE_BATCH_MAX ? count - first : S3_DELETE_BATCH_MAX;
+        
+        /* Quiet mode: the reply lists only the keys that failed */
+        Aws::Vector<Aws::String> failed;
+        int batch = with_retries(backend, [&]() {
+            Aws::S3::Model::Delete del;
+            for (size_t i = 0; i < n; i++) {
+                del.AddObjects(Aws::S3::Model::ObjectIdentifier().WithKey(keys[first + i]));
+            }
+            del.SetQuiet(true);
+            
+            Aws::S3::Model::DeleteObjectsRequest request;
+            request.SetBucket(backend->bucket_name);
+            request.SetDelete(del);
+            
+            auto outcome = client->DeleteObjects(request);
+            if (!outcome.IsSuccess()) {
+                return request_failed(outcome, "DeleteObjects") ? 1 : -1;
+            }
+            failed.clear();
+            for (const auto& error : outcome.GetResult().GetErrors()) {
+                failed.push_back(error.GetKey());
+            }
+            return 0;
+        });
+        
+        for (size_t i = 0; i < n; i++) {
+            int status = batch;
+            for (const auto& key : failed) {
+                if (key == keys[first + i]) status = -1;
+            }
+            if (status_out) status_out[first + i] = status;
+            if (status != 0) ret = -1;
+        }
+        if (batch == 0 && !failed.empty()) {
+            char error_msg[256];
+            snprintf(error_msg, sizeof(error_msg), "S3 DeleteObjects failed for %zu key(s)",
+                     failed.size());
+            s3_set_error(error_msg);
+        }
+    }
+    
+    if (ret == 0) s3_set_error(NULL);
+    return ret;
+}
+
 #else /* HAS_AWS_SDK not defined */
 
 /* Stub implementations when AWS SDK is not available */
@@ -494,12 +809,32 @@ int s3_download_object(struct s3_backend* backend,
     return -1;
 }
 
+int s3_download_range(struct s3_backend* backend,
+                      const char* key,
+                      uint64_t offset,
+                      size_t size,
+                      void* buf) {
+    s3_set_error("AWS SDK not available - S3 integration disabled");
+    return -1;
+}
+
 int s3_delete_object(struct s3_backend* backend,
                      const char* key) {
     s3_set_error("AWS SDK not available - S3 integration disabled");
     return -1;
 }
 
+int s3_delete_objects(struct s3_backend* backend,
+                      const char* const* keys,
+                      size_t count,
+                      int* status_out) {
+    for (size_t i = 0; status_out && i < count; i++) {
+        status_out[i] = -1;
+    }
+    s3_set_error("AWS SDK not available - S3 integration disabled");
+    return -1;
+}
+
 int s3_get_object_metadata(struct s3_backend* backend,
                           const char* key,
                           struct s3_object_metadata* metadata_out) {
@@ -531,4 +866,338 @@ void s3_backend_shutdown(struct s3_backend* backend) {
     memset(backend->secret_key, 0, sizeof(backend->secret_key));
     
     backend->initialized = false;
-}
\ No newline at end of file
+}
+
+/* Tier adapter */
+
+static int s3_tier_put(void* ctx, const char* key, const void* data, size_t size) {
+    return s3_upload_object((struct s3_backend*)ctx, key, data, size, NULL);
+}
+
+static int s3_tier_get(void* ctx, const char* key, void** data_out, size_t* size_out) {
+    return s3_download_object((struct s3_backend*)ctx, key, data_out, size_out);
+}
+
+static int s3_tier_remove(void* ctx, const char* key) {
+    return s3_delete_object((struct s3_backend*)ctx, key);
+}
+
+static int s3_tier_remove_many(void* ctx, const char* const* keys, size_t count) {
+    return s3_delete_objects((struct s3_backend*)ctx, keys, count, NULL);
+}
+
+int s3_tier_backend(struct s3_backend* backend, struct tier_backend* out) {
+    if (!backend || !out || !backend->initialized) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+
+    out->put = s3_tier_put;
+    out->get = s3_tier_get;
+    out->remove = s3_tier_remove;
+    out->remove_many = s3_tier_remove_many;
+    out->release = NULL;
+    out->ctx = backend;
+    return 0;
+}
+
+/* === Asynchronous Requests === */
+
+enum {
+    S3_REQ_PUT,
+    S3_REQ_GET,
+    S3_REQ_GET_RANGE,
+    S3_REQ_DELETE,
+};
+
+/* Hand a finished request to its callback (queue lock not held) */
+static void finish_request(struct s3_queue* queue, struct s3_request* req,
+                           int status, void* data, size_t size) {
+    /* Free the slot first: a callback may submit the next request */
+    pthread_mutex_lock(&queue->lock);
+    queue->in_flight--;
+    queue->completing++;
+    pthread_cond_signal(&queue->room);
+    pthread_mutex_unlock(&queue->lock);
+    
+    if (req->done) req->done(req->ctx, status, data, size);
+    free(req->key);
+    free(req);
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->completing--;
+    if (queue->in_flight == 0 && queue->completing == 0) {
+        pthread_cond_broadcast(&queue->idle);
+    }
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void run_request(struct s3_queue* queue, struct s3_request* req) {
+    void* data = NULL;
+    size_t size = 0;
+    int status;
+    
+    switch (req->op) {
+    case S3_REQ_PUT:
+        status = s3_upload_object(queue->backend, req->key, req->data, req->size, NULL);
+        break;
+    case S3_REQ_GET:
+        status = s3_download_object(queue->backend, req->key, &data, &size);
+        break;
+    default:
+        status = s3_download_range(queue->backend, req->key, req->offset,
+                                   req->size, req->data);
+        data = req->data;
+        size = req->size;
+        break;
+    }
+    finish_request(queue, req, status, data, size);
+}
+
+static void run_deletes(struct s3_queue* queue, struct s3_request* batch, uint32_t count) {
+    const char** keys = (const char**)malloc(count * sizeof(*keys));
+    int* status = (int*)malloc(count * sizeof(*status));
+    
+    uint32_t n = 0;
+    for (struct s3_request* req = batch; req; req = req->next) {
+        if (keys) keys[n] = req->key;
+        if (status) status[n] = -1;
+        n++;
+    }
+    if (keys && status) {
+        s3_delete_objects(queue->backend, keys, count, status);
+        __atomic_fetch_add(&queue->delete_batches,
+                           (count + S3_DELETE_BATCH_MAX - 1) / S3_DELETE_BATCH_MAX,
+                           __ATOMIC_RELAXED);
+    }
+    
+    n = 0;
+    while (batch) {
+        struct s3_request* next = batch->next;
+        finish_request(queue, batch, status ? status[n] : -1, NULL, 0);
+        batch = next;
+        n++;
+    }
+    free(keys);
+    free(status);
+}
+
+/* Milliseconds from a to b */
+static long elapsed_ms(const struct timespec* a, const struct timespec* b) {
+    return (long)(b->tv_sec - a->tv_sec) * 1000 + (b->tv_nsec - a->tv_nsec) / 1000000;
+}
+
+static void* queue_worker(void* arg) {
+    struct s3_queue* queue = (struct s3_queue*)arg;
+    
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        if (queue->head) {
+            struct s3_request* req = queue->head;
+            queue->head = req->next;
+            if (!queue->head) queue->tail = NULL;
+            pthread_mutex_unlock(&queue->lock);
+            
+            run_request(queue, req);
+            
+            pthread_mutex_lock(&queue->lock);
+            continue;
+        }
+        
+        if (queue->deletes) {
+            /* Send once the batch is full, old enough, or someone waits */
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long waited = elapsed_ms(&queue->delete_since, &now);
+            if (queue->delete_count >= S3_DELETE_BATCH_MAX || queue->draining ||
+                !queue->running || waited >= S3_QUEUE_DELETE_DELAY_MS) {
+                struct s3_request* batch = queue->deletes;
+                uint32_t count = queue->delete_count;
+                queue->deletes = NULL;
+                queue->delete_count = 0;
+                pthread_mutex_unlock(&queue->lock);
+                
+                run_deletes(queue, batch, count);
+                
+                pthread_mutex_lock(&queue->lock);
+                continue;
+            }
+            
+            struct timespec deadline = queue->delete_since;
+            deadline.tv_nsec += (long)S3_QUEUE_DELETE_DELAY_MS * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&queue->work, &queue->lock, &deadline);
+            continue;
+        }
+        
+        if (!queue->running) break;
+        pthread_cond_wait(&queue->work, &queue->lock);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    
+    return NULL;
+}
+
+int s3_queue_init(struct s3_queue* queue,
+                  struct s3_backend* backend,
+                  uint32_t workers,
+                  uint32_t window) {
+    if (!queue || !backend || !backend->initialized) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+    
+    memset(queue, 0, sizeof(*queue));
+    queue->backend = backend;
+    queue->window = window ? window : S3_QUEUE_DEFAULT_WINDOW;
+    queue->thread_count = workers ? workers : S3_QUEUE_DEFAULT_WORKERS;
+    
+    /* All workers share the backend's client: size its pool for them */
+    if (backend->concurrency < queue->thread_count) {
+        backend->concurrency = queue->thread_count;
+    }
+    
+    queue->threads = (pthread_t*)calloc(queue->thread_count, sizeof(pthread_t));
+    if (!queue->threads) {
+        s3_set_error("Memory allocation failed");
+        return -1;
+    }
+    
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->room, NULL);
+    pthread_cond_init(&queue->idle, NULL);
+    
+    /* Delete batching deadlines are on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->work, &attr);
+    pthread_condattr_destroy(&attr);
+    
+    queue->running = 1;
+    uint32_t started = 0;
+    while (started < queue->thread_count &&
+           pthread_create(&queue->threads[started], NULL, queue_worker, queue) == 0) {
+        started++;
+    }
+    queue->thread_count = started;
+    if (started == 0) {
+        s3_queue_destroy(queue);
+        s3_set_error("Failed to start queue workers");
+        return -1;
+    }
+    
+    s3_set_error(NULL);
+    return 0;
+}
+
+static int submit(struct s3_queue* queue, int op, const char* key, void* data,
+                  size_t size, uint64_t offset, s3_done_fn done, void* ctx) {
+    if (!queue || !key || (op != S3_REQ_DELETE && !done)) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+    
+    struct s3_request* req = (struct s3_request*)calloc(1, sizeof(*req));
+    if (!req || !(req->key = strdup(key))) {
+        free(req);
+        s3_set_error("Memory allocation failed");
+        return -1;
+    }
+    req->op = op;
+    req->data = data;
+    req->size = size;
+    req->offset = offset;
+    req->done = done;
+    req->ctx = ctx;
+    
+    pthread_mutex_lock(&queue->lock);
+    while (queue->running && queue->in_flight >= queue->window) {
+        pthread_cond_wait(&queue->room, &queue->lock);
+    }
+    if (!queue->running) {
+        pthread_mutex_unlock(&queue->lock);
+        free(req->key);
+        free(req);
+        s3_set_error("Queue stopped");
+        return -1;
+    }
+    queue->in_flight++;
+    
+    if (op == S3_REQ_DELETE) {
+        if (!queue->deletes) clock_gettime(CLOCK_MONOTONIC, &queue->delete_since);
+        req->next = queue->deletes;
+        queue->deletes = req;
+        queue->delete_count++;
+    } else if (queue->tail) {
+        queue->tail->next = req;
+        queue->tail = req;
+    } else {
+        queue->head = queue->tail = req;
+    }
+    pthread_cond_signal(&queue->work);
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+int s3_queue_put(struct s3_queue* queue, const char* key,
+                 const void* data, size_t size, s3_done_fn done, void* ctx) {
+    return submit(queue, S3_REQ_PUT, key, (void*)data, size, 0, done, ctx);
+}
+
+int s3_queue_get(struct s3_queue* queue, const char* key,
+                 s3_done_fn done, void* ctx) {
+    return submit(queue, S3_REQ_GET, key, NULL, 0, 0, done, ctx);
+}
+
+int s3_queue_get_range(struct s3_queue* queue, const char* key,
+                       uint64_t offset, size_t size, void* buf,
+                       s3_done_fn done, void* ctx) {
+    if (!buf) {
+        s3_set_error("Invalid parameters");
+        return -1;
+    }
+    return submit(queue, S3_REQ_GET_RANGE, key, buf, size, offset, done, ctx);
+}
+
+int s3_queue_delete(struct s3_queue* queue, const char* key,
+                    s3_done_fn done, void* ctx) {
+    return submit(queue, S3_REQ_DELETE, key, NULL, 0, 0, done, ctx);
+}
+
+void s3_queue_drain(struct s3_queue* queue) {
+    if (!queue || !queue->threads) return;
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->draining++;
+    pthread_cond_broadcast(&queue->work);
+    while (queue->in_flight > 0 || queue->completing > 0) {
+        pthread_cond_wait(&queue->idle, &queue->lock);
+    }
+    queue->draining--;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void s3_queue_destroy(struct s3_queue* queue) {
+    if (!queue || !queue->threads) return;
+    
+    s3_queue_drain(queue);
+    
+    pthread_mutex_lock(&queue->lock);
+    queue->running = 0;
+    pthread_cond_broadcast(&queue->work);
+    pthread_cond_broadcast(&queue->room);
+    pthread_mutex_unlock(&queue->lock);
+    
+    for (uint32_t i = 0; i < queue->thread_count; i++) {
+        pthread_join(queue->threads[i], NULL);
+    }
+    free(queue->threads);
+    queue->threads = NULL;
+    
+    pthread_cond_destroy(&queue->work);
+    pthread_cond_destroy(&queue->room);
+    pthread_cond_destroy(&queue->idle);
+    pthread_mutex_destroy(&queue->lock);
+}
@@ -10,6 +10,7 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <time.h>
+#include <pthread.h>
 
 #ifdef HAS_AWS_SDK
 #include <aws/core/Aws.h>
@@ -23,6 +24,20 @@
 #define S3_DEFAULT_REGION "us-east-1"
 #define S3_DEFAULT_ENDPOINT "https://s3.amazonaws.com"
 
+/* Transfers: objects above one part go up in parts and come down in ranges */
+#define S3_MIN_PART_SIZE (5 * 1024 * 1024)        /* S3 minimum (except the last part) */
+#define S3_MAX_PARTS 10000                         /* S3 maximum per upload */
+#define S3_DEFAULT_PART_SIZE (8 * 1024 * 1024)
+#define S3_DEFAULT_CONCURRENCY 4                   /* Parts in flight per transfer */
+#define S3_DEFAULT_MAX_RETRIES 4                   /* Retries of one request */
+#define S3_DEFAULT_RETRY_BASE_MS 100               /* Backoff doubles from here */
+
+/* Asynchronous queue */
+#define S3_DELETE_BATCH_MAX 1000                   /* Keys per DeleteObjects (S3 limit) */
+#define S3_QUEUE_DEFAULT_WORKERS 8                 /* Requests running at once */
+#define S3_QUEUE_DEFAULT_WINDOW 256                /* Requests submitted, not yet done */
+#define S3_QUEUE_DELETE_DELAY_MS 50                /* Wait for more deletes to batch */
+
 /* S3 Backend Context */
 struct s3_backend {
     char bucket_name[256];
@@ -35,6 +50,12 @@ struct s3_backend {
     struct Aws::S3::S3Client* s3_client;
 #endif
     
+    /* Transfer settings (see s3_backend_configure_transfer) */
+    size_t part_size;
+    uint32_t concurrency;
+    uint32_t max_retries;
+    uint32_t retry_base_ms;
+    
     bool initialized;
     bool use_ssl;
 };
@@ -72,8 +93,27 @@ int s3_backend_configure_credentials(struct s3_backend* backend,
                                     const char* access_key,
                                     const char* secret_key);
 
+/**
+ * Configure how large objects are transferred
+ * Objects larger than one part are uploaded as a multipart upload and
+ * downloaded with ranged GETs, `concurrency` parts at a time. Each request
+ * is retried up to `max_retries` times on retryable errors, with
+ * exponential backoff and jitter. Zero keeps the current setting.
+ * @param backend Backend context
+ * @param part_size Part size in bytes (at least S3_MIN_PART_SIZE)
+ * @param concurrency Parts in flight per transfer
+ * @param max_retries Retries per request
+ * @return 0 on success, -1 on failure
+ */
+int s3_backend_configure_transfer(struct s3_backend* backend,
+                                  size_t part_size,
+                                  uint32_t concurrency,
+                                  uint32_t max_retries);
+
 /**
  * Upload data to S3
+ * Uploads larger than the part size go up as parallel multipart uploads
+ * (aborted on failure, so no parts are left behind).
  * @param backend Backend context
  * @param key Object key/name
  * @param data Data to upload
@@ -89,6 +129,7 @@ int s3_upload_object(struct s3_backend* backend,
 
 /**
  * Download data from S3
+ * Objects larger than the part size come down as parallel ranged GETs.
  * @param backend Backend context
  * @param key Object key/name
  * @param data_out Output buffer (caller must free)
@@ -100,6 +141,21 @@ int s3_download_object(struct s3_backend* backend,
                        void** data_out,
                        size_t* size_out);
 
+/**
+ * Download part of an object
+ * @param backend Backend context
+ * @param key Object key/name
+ * @param offset First byte to read
+ * @param size Bytes to read (all must exist)
+ * @param buf Output buffer of at least size bytes
+ * @return 0 on success, -1 on failure
+ */
+int s3_download_range(struct s3_backend* backend,
+                      const char* key,
+                      uint64_t offset,
+                      size_t size,
+                      void* buf);
+
 /**
  * Delete object from S3
  * @param backend Backend context
@@ -140,12 +196,151 @@ int s3_list_objects(struct s3_backend* backend,
 int s3_object_exists(struct s3_backend* backend,
                     const char* key);
 
+/**
+ * Delete many objects with as few requests as possible
+ * Keys go out in DeleteObjects batches of up to S3_DELETE_BATCH_MAX.
+ * Deleting a key that does not exist succeeds.
+ * @param backend Backend context
+ * @param keys Object keys
+ * @param count Number of keys
+ * @param status_out Optional per-key result (0 deleted, -1 failed)
+ * @return 0 if all were deleted, -1 otherwise
+ */
+int s3_delete_objects(struct s3_backend* backend,
+                      const char* const* keys,
+                      size_t count,
+                      int* status_out);
+
+/* === Asynchronous Requests === */
+
+/**
+ * Completion of a queued request, called on a queue worker thread
+ * @param status 0 on success, -1 on failure
+ * @param data GET: the object (malloc'd, now owned by the callback);
+ *             ranged GET: the caller's buffer; NULL otherwise
+ * @param size Bytes in data
+ */
+typedef void (*s3_done_fn)(void* ctx, int status, void* data, size_t size);
+
+/* Queued request (internal) */
+struct s3_request {
+    int op;
+    char* key;
+    void* data;
+    size_t size;
+    uint64_t offset;
+    s3_done_fn done;
+    void* ctx;
+    struct s3_request* next;
+};
+
+/**
+ * Request queue in front of a backend
+ *
+ * Workers run queued requests on the backend's one S3 client, so its
+ * connection pool is shared. Submitting blocks while `window` requests
+ * are unfinished. Deletes wait up to S3_QUEUE_DELETE_DELAY_MS for company
+ * and go out together as DeleteObjects.
+ */
+struct s3_queue {
+    struct s3_backend* backend;
+    
+    pthread_mutex_t lock;
+    pthread_cond_t work;         /* Requests or deletes to run */
+    pthread_cond_t room;         /* Window has space */
+    pthread_cond_t idle;         /* Nothing unfinished */
+    
+    struct s3_request* head;     /* Requests other than deletes, FIFO */
+    struct s3_request* tail;
+    struct s3_request* deletes;  /* Deletes waiting for a batch */
+    uint32_t delete_count;
+    struct timespec delete_since; /* Oldest waiting delete (CLOCK_MONOTONIC) */
+    
+    uint32_t window;
+    uint32_t in_flight;          /* Submitted, not yet finished */
+    uint32_t completing;         /* Finished, callback running */
+    uint32_t draining;           /* Threads in s3_queue_drain (deletes go now) */
+    
+    pthread_t* threads;
+    uint32_t thread_count;
+    int running;
+    
+    uint64_t delete_batches;     /* DeleteObjects requests sent */
+};
+
+/**
+ * Start a request queue
+ * @param queue Queue to initialize
+ * @param backend Initialized backend (must outlive the queue)
+ * @param workers Worker threads (0 for the default)
+ * @param window Unfinished requests before submitters block (0 for the default)
+ * @return 0 on success, -1 on failure
+ */
+int s3_queue_init(struct s3_queue* queue,
+                  struct s3_backend* backend,
+                  uint32_t workers,
+                  uint32_t window);
+
+/**
+ * Queue an upload
+ * data must stay valid until done runs.
+ * @return 0 if queued, -1 on failure (done is not called)
+ */
+int s3_queue_put(struct s3_queue* queue, const char* key,
+                 const void* data, size_t size, s3_done_fn done, void* ctx);
+
+/**
+ * Queue a download of a whole object
+ * @return 0 if queued, -1 on failure (done is not called)
+ */
+int s3_queue_get(struct s3_queue* queue, const char* key,
+                 s3_done_fn done, void* ctx);
+
+/**
+ * Queue a download of a byte range into buf
+ * @return 0 if queued, -1 on failure (done is not called)
+ */
+int s3_queue_get_range(struct s3_queue* queue, const char* key,
+                       uint64_t offset, size_t size, void* buf,
+                       s3_done_fn done, void* ctx);
+
+/**
+ * Queue a delete (batched with other deletes)
+ * @param done Optional
+ * @return 0 if queued, -1 on failure (done is not called)
+ */
+int s3_queue_delete(struct s3_queue* queue, const char* key,
+                    s3_done_fn done, void* ctx);
+
+/**
+ * Wait until every submitted request has completed and its callback
+ * returned; waiting deletes are sent right away (not from a callback)
+ */
+void s3_queue_drain(struct s3_queue* queue);
+
+/**
+ * Drain the queue and stop its workers
+ */
+void s3_queue_destroy(struct s3_queue* queue);
+
 /**
  * Shutdown S3 backend
  * @param backend Backend context
  */
 void s3_backend_shutdown(struct s3_backend* backend);
 
+struct tier_backend;
+
+/**
+ * Expose the backend as a storage tier for cold file data
+ * put/get/remove map to upload/download/delete; the backend stays owned by
+ * the caller (release is NULL).
+ * @param backend Initialized backend context
+ * @param out Tier backend to fill
+ * @return 0 on success, -1 on failure
+ */
+int s3_tier_backend(struct s3_backend* backend, struct tier_backend* out);
+
 /**
  * Get last error message
  * @return Last error message (do not free)
@@ -5,6 +5,8 @@
 #define _GNU_SOURCE
 #include "shm_persist.h"
 #include "numa_support.h"
+#include "compression.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,15 +17,309 @@
 #include <fcntl.h>
 #include <pthread.h>
 
+/* Offset of the child blocks in a tree image */
+static size_t shm_blocks_offset(uint32_t capacity) {
+    return sizeof(struct shm_tree_header) +
+           ((size_t)capacity * sizeof(struct nary_node_mt));
+}
+
+/* Offset of the free list in a tree image */
+static size_t shm_free_list_offset(uint32_t capacity) {
+    return shm_blocks_offset(capacity) +
+           ((size_t)NARY_CHILD_BLOCKS(capacity) * sizeof(struct nary_child_block));
+}
+
 /* Calculate total shared memory size needed */
 static size_t calculate_shm_size(uint32_t capacity) {
-    return sizeof(struct shm_tree_header) +
-           (capacity * sizeof(struct nary_node_mt)) +
-           (capacity * sizeof(uint16_t));  /* free_list */
+    return shm_free_list_offset(capacity) +
+           ((size_t)capacity * sizeof(uint32_t));  /* free_list */
 }
 
-/* String table size for shared memory */
-#define STRING_TABLE_SHM_SIZE (1024 * 1024)  /* 1MB for strings */
+/* Initialize the header of a new (zero-filled) tree image */
+static void shm_header_init(struct shm_tree_header *hdr) {
+    hdr->magic = SHM_MAGIC;
+    hdr->version = SHM_VERSION;
+    hdr->capacity = SHM_TREE_CAPACITY;
+    hdr->used = 0;
+    hdr->next_inode = 1;
+    hdr->free_count = 0;
+    hdr->block_capacity = NARY_CHILD_BLOCKS(SHM_TREE_CAPACITY);
+    hdr->block_used = 0;
+    hdr->block_free = NARY_INVALID_IDX;
+}
+
+/* Point the tree's arrays into a mapped image and load its counters */
+static void shm_tree_bind(struct nary_tree_mt *tree, struct shm_tree_header *hdr) {
+    tree->nodes = (struct nary_node_mt *)(hdr + 1);
+    tree->child_blocks = (struct nary_child_block *)
+        ((char *)hdr + shm_blocks_offset(hdr->capacity));
+    tree->free_list = (uint32_t *)((char *)hdr + shm_free_list_offset(hdr->capacity));
+
+    tree->capacity = hdr->capacity;
+    tree->used = hdr->used;
+    tree->next_inode = hdr->next_inode;
+    tree->op_count = 0;
+    tree->free_count = hdr->free_count;
+    tree->block_capacity = hdr->block_capacity;
+    tree->block_used = hdr->block_used;
+    tree->block_free = hdr->block_free;
+    tree->block_fp = NULL;             /* Not persisted, see nary_child_fp_rebuild_mt */
+    tree->inode_slots = NULL;          /* Built on demand, see nary_inode_lookup_mt */
+    tree->inode_slot_mask = 0;
+    tree->inode_count = 0;
+    tree->path_generation = 0;
+    tree->path_invalidating = 0;
+    tree->is_mapped = 1;
+    tree->node_reserve = 0;            /* Nodes belong to the image */
+    tree->prefetch = 1;
+    tree->node_seq = NULL;             /* Allocated once the image is up */
+    tree->node_heat = NULL;
+    tree->retired = NULL;
+    tree->retired_count = tree->retired_capacity = 0;
+    tree->snap_newest = NULL;          /* Snapshots are not persisted */
+    tree->snap_epoch = 0;
+    tree->snap_next_id = 1;
+    tree->snap_count = 0;
+    tree->node_cow = NULL;
+    pthread_mutex_init(&tree->snap_lock, NULL);
+}
+
+/* === Version 1 image migration === */
+
+/* v1 layout: packed 24-byte header, 128-byte nodes holding 16 inline
+ * 16-bit children, 16-bit free list; 0xFFFF was the invalid index */
+struct shm_tree_header_v1 {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t used;
+    uint32_t next_inode;
+    uint32_t free_count;
+};
+
+struct nary_node_v1 {
+    uint32_t inode;
+    uint32_t parent_idx;
+    uint16_t num_children;
+    uint16_t mode;
+    uint32_t name_offset;
+    uint16_t children[NARY_BRANCHING_FACTOR];
+    uint64_t size;
+    uint32_t mtime;
+    uint32_t xattr_head;
+} __attribute__((packed));
+
+#define SHM_V1_NODE_SIZE 128
+
+static inline uint32_t widen_v1_idx(uint32_t idx) {
+    return idx == 0xFFFF ? NARY_INVALID_IDX : idx;
+}
+
+/* Check a v1 image before anything is overwritten */
+static int v1_image_valid(const uint8_t *old, size_t old_size) {
+    struct shm_tree_header_v1 oh;
+    if (old_size < sizeof(oh)) return 0;
+    memcpy(&oh, old, sizeof(oh));
+
+    if (oh.capacity > SHM_TREE_CAPACITY || oh.used > oh.capacity ||
+        oh.free_count > oh.capacity) {
+        return 0;
+    }
+    size_t need = sizeof(oh) + (size_t)oh.capacity * SHM_V1_NODE_SIZE +
+                  (size_t)oh.capacity * sizeof(uint16_t);
+    return old_size >= need;
+}
+
+/* Rebuild a v1 image into a zero-filled image of the current version */
+static void convert_v1_image(const uint8_t *old, struct shm_tree_header *hdr) {
+    struct shm_tree_header_v1 oh;
+    memcpy(&oh, old, sizeof(oh));
+    const uint8_t *old_nodes = old + sizeof(oh);
+    const uint8_t *old_free = old_nodes + (size_t)oh.capacity * SHM_V1_NODE_SIZE;
+
+    shm_header_init(hdr);
+    hdr->used = oh.used;
+    hdr->next_inode = oh.next_inode;
+    hdr->free_count = oh.free_count;
+
+    struct nary_node_mt *nodes = (struct nary_node_mt *)(hdr + 1);
+    struct nary_child_block *blocks = (struct nary_child_block *)
+        ((char *)hdr + shm_blocks_offset(hdr->capacity));
+    uint32_t *free_list = (uint32_t *)((char *)hdr + shm_free_list_offset(hdr->capacity));
+
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+    for (uint32_t i = 0; i < oh.used; i++) {
+        struct nary_node_v1 on;
+        memcpy(&on, old_nodes + (size_t)i * SHM_V1_NODE_SIZE, sizeof(on));
+
+        struct nary_node *n = &nodes[i].node;
+        n->inode = on.inode;
+        n->parent_idx = widen_v1_idx(on.parent_idx);
+        n->num_children = on.num_children > NARY_BRANCHING_FACTOR ?
+                          NARY_BRANCHING_FACTOR : on.num_children;
+        n->mode = on.mode;
+        n->name_offset = on.name_offset;
+        n->size = on.size;
+        n->mtime = on.mtime;
+        n->xattr_head = on.xattr_head;
+
+        uint32_t *children = n->children;
+        for (int j = 0; j < NARY_INLINE_CHILDREN; j++) {
+            n->children[j] = NARY_INVALID_IDX;
+        }
+        if (n->num_children > NARY_INLINE_CHILDREN) {
+            uint32_t b = hdr->block_used++;
+            NARY_CHILD_ROOT(n) = b;
+            NARY_CHILD_HEIGHT(n) = 0;      /* A single leaf */
+            children = blocks[b].children;
+            for (int j = 0; j < NARY_BRANCHING_FACTOR; j++) {
+                children[j] = NARY_INVALID_IDX;
+            }
+        }
+        for (uint16_t j = 0; j < n->num_children; j++) {
+            children[j] = widen_v1_idx(on.children[j]);
+        }
+
+        pthread_rwlock_init(&nodes[i].lock, &attr);
+    }
+    pthread_rwlockattr_destroy(&attr);
+
+    for (uint32_t i = 0; i < oh.free_count; i++) {
+        uint16_t idx;
+        memcpy(&idx, old_free + (size_t)i * sizeof(idx), sizeof(idx));
+        free_list[i] = idx;
+    }
+}
+
+/**
+ * Migrate the v1 tree image open at fd to the current format
+ * Shared memory is rewritten in place. A disk image is written to a
+ * temporary file that atomically replaces it; fd is then re-pointed
+ * at the new file.
+ *
+ * @param fd Open image
+ * @param disk_path Path of a disk image, NULL for shared memory
+ * @return 0 on success, -1 on failure (a disk image is left untouched)
+ */
+static int migrate_v1_image(int fd, const char *disk_path) {
+    struct stat st;
+    if (fstat(fd, &st) < 0) return -1;
+
+    size_t old_size = (size_t)st.st_size;
+    uint8_t *old = malloc(old_size ? old_size : 1);
+    if (!old) return -1;
+
+    size_t done = 0;
+    while (done < old_size) {
+        ssize_t n = pread(fd, old + done, old_size - done, (off_t)done);
+        if (n <= 0) {
+            free(old);
+            return -1;
+        }
+        done += (size_t)n;
+    }
+
+    if (!v1_image_valid(old, old_size)) {
+        fprintf(stderr, "Corrupted version 1 tree image\n");
+        free(old);
+        return -1;
+    }
+
+    char tmp_path[512];
+    int out_fd = fd;
+    if (disk_path) {
+        snprintf(tmp_path, sizeof(tmp_path), "%s.migrate", disk_path);
+        out_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (out_fd < 0) {
+            free(old);
+            return -1;
+        }
+    } else if (ftruncate(fd, 0) < 0) {
+        free(old);
+        return -1;
+    }
+
+    size_t new_size = calculate_shm_size(SHM_TREE_CAPACITY);
+    void *addr = MAP_FAILED;
+    if (ftruncate(out_fd, (off_t)new_size) == 0) {
+        addr = mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, out_fd, 0);
+    }
+    if (addr == MAP_FAILED) {
+        if (disk_path) {
+            close(out_fd);
+            unlink(tmp_path);
+        }
+        free(old);
+        return -1;
+    }
+
+    convert_v1_image(old, (struct shm_tree_header *)addr);
+    free(old);
+    msync(addr, new_size, MS_SYNC);
+    munmap(addr, new_size);
+
+    if (disk_path) {
+        if (fsync(out_fd) < 0 || rename(tmp_path, disk_path) < 0 ||
+            dup2(out_fd, fd) < 0) {
+            close(out_fd);
+            unlink(tmp_path);
+            return -1;
+        }
+        close(out_fd);
+    }
+
+    printf("🔄 Migrated tree image to version %u\n", SHM_VERSION);
+    return 0;
+}
+
+/**
+ * Validate an existing tree image (migrating v1 images) and map it
+ *
+ * @param fd Open image
+ * @param disk_path Path of a disk image, NULL for shared memory
+ * @param size_out Set to the mapping size
+ * @return Mapped image, or MAP_FAILED
+ */
+static void *map_existing_image(int fd, const char *disk_path, size_t *size_out) {
+    struct shm_tree_header hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) < (ssize_t)offsetof(struct shm_tree_header, block_capacity)) {
+        fprintf(stderr, "Truncated tree image\n");
+        return MAP_FAILED;
+    }
+
+    /* Validate magic */
+    if (hdr.magic != SHM_MAGIC) {
+        fprintf(stderr, "Invalid tree image magic: 0x%x\n", hdr.magic);
+        return MAP_FAILED;
+    }
+
+    if (hdr.version == SHM_VERSION_V1) {
+        if (migrate_v1_image(fd, disk_path) != 0 ||
+            pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            fprintf(stderr, "Failed to migrate version 1 tree image\n");
+            return MAP_FAILED;
+        }
+    }
+
+    struct stat st;
+    if (hdr.version != SHM_VERSION || hdr.capacity == 0 ||
+        hdr.capacity >= NARY_MAX_NODES || hdr.used > hdr.capacity ||
+        hdr.block_capacity != NARY_CHILD_BLOCKS(hdr.capacity) ||
+        fstat(fd, &st) < 0 || (size_t)st.st_size < calculate_shm_size(hdr.capacity)) {
+        fprintf(stderr, "Unsupported or corrupted tree image (version %u)\n", hdr.version);
+        return MAP_FAILED;
+    }
+
+    *size_out = calculate_shm_size(hdr.capacity);
+    return mmap(NULL, *size_out, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+}
+
+/* String table size for new shared memory segments: sparse, so only
+ * pages holding names use memory (attach uses the segment's own size) */
+#define STRING_TABLE_SHM_SIZE STRING_TABLE_MAX_SIZE
 
 int shm_tree_exists(void) {
     int fd = shm_open(SHM_TREE_NODES, O_RDONLY, 0);
@@ -44,7 +340,7 @@ int shm_tree_init(struct nary_tree_mt *tree) {
 
     int is_new = !shm_tree_exists();
     int flags = O_RDWR | (is_new ? O_CREAT : 0);
-    size_t shm_size = calculate_shm_size(NARY_MT_INITIAL_CAPACITY);
+    size_t shm_size = calculate_shm_size(SHM_TREE_CAPACITY);
 
     /* Open/create shared memory */
     int fd = shm_open(SHM_TREE_NODES, flags, 0600);
@@ -64,8 +360,9 @@ int shm_tree_init(struct nary_tree_mt *tree) {
     }
 
     /* Map shared memory */
-    void *addr = mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
-                      MAP_SHARED, fd, 0);
+    void *addr = is_new ?
+        mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+        map_existing_image(fd, NULL, &shm_size);
     close(fd);  /* Can close fd after mmap */
 
     if (addr == MAP_FAILED) {
@@ -74,13 +371,17 @@ int shm_tree_init(struct nary_tree_mt *tree) {
         return -1;
     }
 
-    /* Bind to NUMA node if available */
+    /* Place on NUMA nodes per the mount policy, if available */
     if (numa_available()) {
-        if (numa_bind_memory(addr, shm_size, numa_node) == 0) {
-            printf("📍 NUMA: Bound shared memory to node %d\n", numa_node);
+        if (numa_place(addr, shm_size, NUMA_MEM_METADATA, numa_node) == 0) {
+            printf("📍 NUMA: Placed shared memory (%s policy, node %d)\n",
+                   numa_policy_name(numa_get_policy()), numa_node);
         }
     }
 
+    /* Path walks hop across the whole image: fewer TLB misses on huge pages */
+    numa_advise_huge(addr, shm_size);
+
     /* Setup tree structure */
     struct shm_tree_header *hdr = (struct shm_tree_header *)addr;
 
@@ -88,22 +389,10 @@ int shm_tree_init(struct nary_tree_mt *tree) {
         /* Initialize new shared memory */
         printf("🆕 Creating new persistent filesystem\n");
 
-        hdr->magic = SHM_MAGIC;
-        hdr->version = SHM_VERSION;
-        hdr->capacity = NARY_MT_INITIAL_CAPACITY;
-        hdr->used = 0;
-        hdr->next_inode = 1;
-        hdr->free_count = 0;
+        shm_header_init(hdr);
 
         /* Setup pointers */
-        tree->nodes = (struct nary_node_mt *)(hdr + 1);
-        tree->free_list = (uint16_t *)(tree->nodes + hdr->capacity);
-
-        tree->capacity = hdr->capacity;
-        tree->used = 0;
-        tree->next_inode = 1;
-        tree->op_count = 0;
-        tree->free_count = 0;
+        shm_tree_bind(tree, hdr);
 
         /* Create string table shared memory */
         int str_fd = shm_open(SHM_STRING_TABLE, O_RDWR | O_CREAT, 0600);
@@ -134,6 +423,7 @@ int shm_tree_init(struct nary_tree_mt *tree) {
             shm_unlink(SHM_STRING_TABLE);
             return -1;
         }
+        numa_advise_huge(str_buf, STRING_TABLE_SHM_SIZE);
 
         /* Initialize string table in shared memory */
         if (string_table_init_shm(&tree->strings, str_buf, STRING_TABLE_SHM_SIZE, 0) != 0) {
@@ -167,7 +457,7 @@ int shm_tree_init(struct nary_tree_mt *tree) {
         tree->nodes[0].node.size = 0;
         tree->nodes[0].node.mtime = time(NULL);
 
-        for (int i = 0; i < NARY_BRANCHING_FACTOR; i++) {
+        for (int i = 0; i < NARY_INLINE_CHILDREN; i++) {
             tree->nodes[0].node.children[i] = NARY_INVALID_IDX;
         }
 
@@ -179,22 +469,8 @@ int shm_tree_init(struct nary_tree_mt *tree) {
         /* Attach to existing shared memory */
         printf("♻️  Attaching to existing persistent filesystem\n");
 
-        /* Validate magic */
-        if (hdr->magic != SHM_MAGIC) {
-            fprintf(stderr, "Invalid shared memory magic: 0x%x\n", hdr->magic);
-            munmap(addr, shm_size);
-            return -1;
-        }
-
-        /* Setup pointers */
-        tree->nodes = (struct nary_node_mt *)(hdr + 1);
-        tree->free_list = (uint16_t *)(tree->nodes + hdr->capacity);
-
-        tree->capacity = hdr->capacity;
-        tree->used = hdr->used;
-        tree->next_inode = hdr->next_inode;
-        tree->op_count = 0;
-        tree->free_count = hdr->free_count;
+        /* Setup pointers (image validated by map_existing_image) */
+        shm_tree_bind(tree, hdr);
 
         /* Attach to existing string table shared memory */
         int str_fd = shm_open(SHM_STRING_TABLE, O_RDWR, 0600);
@@ -204,7 +480,18 @@ int shm_tree_init(struct nary_tree_mt *tree) {
             return -1;
         }
 
-        void *str_buf = mmap(NULL, STRING_TABLE_SHM_SIZE, PROT_READ | PROT_WRITE,
+        /* Segments from before the table could grow are smaller */
+        struct stat str_st;
+        if (fstat(str_fd, &str_st) < 0 || str_st.st_size < (off_t)sizeof(uint32_t)) {
+            perror("fstat (strings)");
+            close(str_fd);
+            munmap(addr, shm_size);
+            return -1;
+        }
+        size_t str_size = (size_t)str_st.st_size < STRING_TABLE_MAX_SIZE ?
+                          (size_t)str_st.st_size : STRING_TABLE_MAX_SIZE;
+
+        void *str_buf = mmap(NULL, str_size, PROT_READ | PROT_WRITE,
                              MAP_SHARED, str_fd, 0);
         close(str_fd);
 
@@ -213,18 +500,44 @@ int shm_tree_init(struct nary_tree_mt *tree) {
             munmap(addr, shm_size);
             return -1;
         }
+        numa_advise_huge(str_buf, str_size);
 
         /* Attach to existing string table in shared memory */
-        if (string_table_init_shm(&tree->strings, str_buf, STRING_TABLE_SHM_SIZE, 1) != 0) {
-            munmap(str_buf, STRING_TABLE_SHM_SIZE);
+        if (string_table_init_shm(&tree->strings, str_buf, str_size, 1) != 0) {
+            munmap(str_buf, str_size);
             munmap(addr, shm_size);
             return -1;
         }
 
-        /* Tree lock is already initialized in shared memory */
+        /* Name reference counts are rebuilt from the nodes using them */
+        if (nary_strings_recount_mt(tree) != 0) {
+            fprintf(stderr, "⚠️  Some nodes name no stored string\n");
+        }
+
+        /* The tree lock lives in the caller's structure, not the image */
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_rwlock_init(&tree->tree_lock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+
         printf("📊 Restored %u nodes, next inode: %u\n", tree->used, tree->next_inode);
     }
 
+    /* Name fingerprints live outside the image */
+    if (nary_child_fp_rebuild_mt(tree) != 0) {
+        munmap(tree->strings.data, tree->strings.capacity);
+        string_table_destroy(&tree->strings);
+        munmap(addr, shm_size);
+        return -1;
+    }
+
+    /* Sequence counters and heat are not persisted either; without them
+     * readers just lock and compaction steps do nothing */
+    tree->node_seq = calloc(tree->capacity, sizeof(uint32_t));
+    tree->node_heat = calloc(tree->capacity, sizeof(uint32_t));
+    tree->node_cow = calloc(tree->capacity, sizeof(uint32_t));  /* NULL = no snapshots */
+
     memset(&tree->stats, 0, sizeof(tree->stats));
     tree->stats.total_nodes = tree->used;
 
@@ -234,11 +547,22 @@ int shm_tree_init(struct nary_tree_mt *tree) {
 void shm_tree_detach(struct nary_tree_mt *tree) {
     if (!tree || !tree->nodes) return;
 
+    /* Snapshots hold name references: release them while the names are up */
+    nary_snapshots_destroy_mt(tree);
+
+    /* Slots vacated by the last compaction step are free once detached */
+    for (uint32_t i = 0; i < tree->retired_count && tree->free_count < tree->capacity; i++) {
+        tree->free_list[tree->free_count++] = tree->retired[i];
+    }
+    tree->retired_count = 0;
+
     /* Sync header before detaching */
     struct shm_tree_header *hdr = ((struct shm_tree_header *)tree->nodes) - 1;
     hdr->used = tree->used;
     hdr->next_inode = tree->next_inode;
     hdr->free_count = tree->free_count;
+    hdr->block_used = tree->block_used;
+    hdr->block_free = tree->block_free;
 
     /* Ensure all changes written to shared memory */
     size_t shm_size = calculate_shm_size(tree->capacity);
@@ -248,16 +572,27 @@ void shm_tree_detach(struct nary_tree_mt *tree) {
     if (!tree->strings.is_shm) {
         // Try to save string table to disk if using file-backed persistence
         if (disk_tree_exists()) {
-            disk_string_table_save(&tree->strings, DISK_STRING_TABLE);
+            disk_string_table_sync(&tree->strings);
         }
+        disk_data_log_close();
     } else if (tree->strings.data) {
         /* For shared memory mode, sync string table */
-        msync(tree->strings.data, STRING_TABLE_SHM_SIZE, MS_SYNC);
-        munmap(tree->strings.data, STRING_TABLE_SHM_SIZE);
+        msync(tree->strings.data, tree->strings.used, MS_SYNC);
+        munmap(tree->strings.data, tree->strings.capacity);
     }
 
     /* Unmap but don't destroy */
     munmap(hdr, shm_size);
+    free(tree->block_fp);
+    tree->block_fp = NULL;
+    free(tree->inode_slots);
+    tree->inode_slots = NULL;
+    free(tree->node_seq);
+    tree->node_seq = NULL;
+    free(tree->node_heat);
+    tree->node_heat = NULL;
+    free(tree->retired);
+    tree->retired = NULL;
 
     /* Clean up string table structure */
     string_table_destroy(&tree->strings);
@@ -269,15 +604,27 @@ void shm_tree_destroy(struct nary_tree_mt *tree) __attribute__((unused));
 void shm_tree_destroy(struct nary_tree_mt *tree) {
     if (!tree || !tree->nodes) return;
 
+    nary_snapshots_destroy_mt(tree);
+
     /* Unmap string table shared memory */
     if (tree->strings.is_shm && tree->strings.data) {
-        munmap(tree->strings.data, STRING_TABLE_SHM_SIZE);
+        munmap(tree->strings.data, tree->strings.capacity);
     }
 
     /* Unmap shared memory */
     struct shm_tree_header *hdr = ((struct shm_tree_header *)tree->nodes) - 1;
     size_t shm_size = calculate_shm_size(tree->capacity);
     munmap(hdr, shm_size);
+    free(tree->block_fp);
+    tree->block_fp = NULL;
+    free(tree->inode_slots);
+    tree->inode_slots = NULL;
+    free(tree->node_seq);
+    tree->node_seq = NULL;
+    free(tree->node_heat);
+    tree->node_heat = NULL;
+    free(tree->retired);
+    tree->retired = NULL;
 
     /* Destroy locks */
     pthread_rwlock_destroy(&tree->tree_lock);
@@ -297,19 +644,6 @@ void shm_tree_destroy(struct nary_tree_mt *tree) {
 
 /* === File Data Persistence === */
 
-/**
- * File data header in shared memory
- */
-struct shm_file_header {
-    uint32_t magic;              /* Magic number for validation */
-    uint32_t inode;              /* Inode number */
-    size_t size;                 /* Uncompressed file size */
-    size_t data_size;            /* Actual data size (may be compressed) */
-    int is_compressed;           /* 1 if data is compressed */
-};
-
-#define SHM_FILE_MAGIC 0x46494C45  /* "FILE" */
-
 /**
  * Save file data to shared memory
  * Creates/updates /dev/shm/razorfs_file_<inode>
@@ -481,11 +815,68 @@ int disk_tree_exists(void) {
     return (stat(DISK_TREE_NODES, &st) == 0);
 }
 
+int disk_tree_map(struct nary_tree_mt *tree, const char *path, int writable) {
+    if (!tree || !path) return -1;
+
+    int fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct shm_tree_header hdr;
+    struct stat st;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) || fstat(fd, &st) < 0 ||
+        hdr.magic != SHM_MAGIC || hdr.version != SHM_VERSION ||
+        hdr.capacity == 0 || hdr.capacity >= NARY_MAX_NODES || hdr.used > hdr.capacity ||
+        hdr.block_capacity != NARY_CHILD_BLOCKS(hdr.capacity) ||
+        (size_t)st.st_size < calculate_shm_size(hdr.capacity)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = calculate_shm_size(hdr.capacity);
+    void *addr = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
+
+    memset(tree, 0, sizeof(*tree));
+    shm_tree_bind(tree, (struct shm_tree_header *)addr);
+    return 0;
+}
+
+void disk_tree_unmap(struct nary_tree_mt *tree) {
+    if (!tree || !tree->nodes) return;
+
+    struct shm_tree_header *hdr = ((struct shm_tree_header *)tree->nodes) - 1;
+    size_t size = calculate_shm_size(tree->capacity);
+
+    /* Repairs may take or give back child blocks; a read-only image is
+     * never changed, so its counters always match */
+    if (hdr->block_used != tree->block_used || hdr->block_free != tree->block_free) {
+        hdr->block_used = tree->block_used;
+        hdr->block_free = tree->block_free;
+    }
+    msync(hdr, size, MS_SYNC);  /* Nothing to write back if read-only */
+    munmap(hdr, size);
+
+    free(tree->block_fp);
+    pthread_mutex_destroy(&tree->snap_lock);
+    tree->nodes = NULL;
+    tree->child_blocks = NULL;
+    tree->free_list = NULL;
+    tree->block_fp = NULL;
+}
+
 /* Global variable to track which storage path is actually being used */
 static const char *g_active_data_dir = NULL;
 static const char *g_active_tree_nodes = NULL;
 static const char *g_active_string_table = NULL;
 static const char *g_active_file_prefix = NULL;
+static const char *g_active_data_log = NULL;
+static const char *g_active_xattrs = NULL;
 
 /**
  * Create data directory if it doesn't exist
@@ -511,6 +902,8 @@ static int ensure_data_dir(void) {
         g_active_tree_nodes = DISK_TREE_NODES;
         g_active_string_table = DISK_STRING_TABLE;
         g_active_file_prefix = DISK_FILE_PREFIX;
+        g_active_data_log = DISK_DATA_LOG;
+        g_active_xattrs = DISK_XATTRS;
         printf("💾 Using persistent storage: %s\n", g_active_data_dir);
         return 0;
     }
@@ -521,6 +914,8 @@ static int ensure_data_dir(void) {
         g_active_tree_nodes = DISK_TREE_NODES;
         g_active_string_table = DISK_STRING_TABLE;
         g_active_file_prefix = DISK_FILE_PREFIX;
+        g_active_data_log = DISK_DATA_LOG;
+        g_active_xattrs = DISK_XATTRS;
         printf("💾 Created persistent storage: %s\n", g_active_data_dir);
         return 0;
     }
@@ -531,6 +926,8 @@ static int ensure_data_dir(void) {
         g_active_tree_nodes = DISK_TREE_NODES;
         g_active_string_table = DISK_STRING_TABLE;
         g_active_file_prefix = DISK_FILE_PREFIX;
+        g_active_data_log = DISK_DATA_LOG;
+        g_active_xattrs = DISK_XATTRS;
         return 0;
     }
 
@@ -545,6 +942,8 @@ static int ensure_data_dir(void) {
         g_active_tree_nodes = DISK_TREE_NODES_FALLBACK;
         g_active_string_table = DISK_STRING_TABLE_FALLBACK;
         g_active_file_prefix = DISK_FILE_PREFIX_FALLBACK;
+        g_active_data_log = DISK_DATA_LOG_FALLBACK;
+        g_active_xattrs = DISK_XATTRS_FALLBACK;
         printf("💾 Using fallback storage: %s\n", g_active_data_dir);
         return 0;
     }
@@ -561,6 +960,8 @@ static int ensure_data_dir(void) {
     g_active_tree_nodes = DISK_TREE_NODES_FALLBACK;
     g_active_string_table = DISK_STRING_TABLE_FALLBACK;
     g_active_file_prefix = DISK_FILE_PREFIX_FALLBACK;
+    g_active_data_log = DISK_DATA_LOG_FALLBACK;
+    g_active_xattrs = DISK_XATTRS_FALLBACK;
     printf("💾 Created fallback storage: %s\n", g_active_data_dir);
 
     return 0;
@@ -587,6 +988,67 @@ static const char *get_file_prefix(void) {
     return g_active_file_prefix ? g_active_file_prefix : DISK_FILE_PREFIX;
 }
 
+/**
+ * Get the active data log path (after ensure_data_dir has been called)
+ */
+static const char *get_data_log_path(void) {
+    return g_active_data_log ? g_active_data_log : DISK_DATA_LOG;
+}
+
+/**
+ * Get the active xattr file path (after ensure_data_dir has been called)
+ */
+static const char *get_xattrs_path(void) {
+    return g_active_xattrs ? g_active_xattrs : DISK_XATTRS;
+}
+
+/* === File Data Log === */
+
+static struct data_log g_data_log;
+static int g_data_log_open = 0;
+static pthread_mutex_t g_data_log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Get the file data log, opening it on first use
+ * @return The log, or NULL if it cannot be opened
+ */
+struct data_log *disk_data_log(void) {
+    pthread_mutex_lock(&g_data_log_mutex);
+    if (!g_data_log_open && ensure_data_dir() == 0) {
+        if (data_log_open(&g_data_log, get_data_log_path()) == 0) {
+            g_data_log_open = 1;
+            printf("💾 File data log: %s (%u files, %lu bytes)\n", get_data_log_path(),
+                   g_data_log.file_count, (unsigned long)g_data_log.tail);
+        }
+    }
+    struct data_log *log = g_data_log_open ? &g_data_log : NULL;
+    pthread_mutex_unlock(&g_data_log_mutex);
+    return log;
+}
+
+/* Where remote chunks are read from (set while a tier is attached) */
+static struct disk_remote_ops g_remote;
+static pthread_rwlock_t g_remote_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+void disk_set_remote(const struct disk_remote_ops *ops) {
+    pthread_rwlock_wrlock(&g_remote_lock);
+    if (ops) {
+        g_remote = *ops;
+    } else {
+        memset(&g_remote, 0, sizeof(g_remote));
+    }
+    pthread_rwlock_unlock(&g_remote_lock);
+}
+
+void disk_data_log_close(void) {
+    pthread_mutex_lock(&g_data_log_mutex);
+    if (g_data_log_open) {
+        data_log_close(&g_data_log);
+        g_data_log_open = 0;
+    }
+    pthread_mutex_unlock(&g_data_log_mutex);
+}
+
 int disk_tree_init(struct nary_tree_mt *tree) {
     if (!tree) return -1;
 
@@ -595,6 +1057,12 @@ int disk_tree_init(struct nary_tree_mt *tree) {
         return -1;
     }
 
+    /* File contents: one mapping and index for all files */
+    if (!disk_data_log()) {
+        fprintf(stderr, "Failed to open file data log\n");
+        return -1;
+    }
+
     /* Initialize NUMA support */
     numa_init();
     int numa_node = numa_get_current_node();
@@ -602,7 +1070,7 @@ int disk_tree_init(struct nary_tree_mt *tree) {
     const char *tree_nodes_path = get_tree_nodes_path();
     int is_new = !disk_tree_exists();
     int flags = O_RDWR | (is_new ? O_CREAT : 0);
-    size_t shm_size = calculate_shm_size(NARY_MT_INITIAL_CAPACITY);
+    size_t shm_size = calculate_shm_size(SHM_TREE_CAPACITY);
 
     /* Open/create disk-backed file for tree nodes */
     int fd = open(tree_nodes_path, flags, 0600);
@@ -622,8 +1090,9 @@ int disk_tree_init(struct nary_tree_mt *tree) {
     }
 
     /* Map file to memory */
-    void *addr = mmap(NULL, shm_size, PROT_READ | PROT_WRITE,
-                      MAP_SHARED, fd, 0);
+    void *addr = is_new ?
+        mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) :
+        map_existing_image(fd, tree_nodes_path, &shm_size);
     close(fd);  /* Can close fd after mmap */
 
     if (addr == MAP_FAILED) {
@@ -632,13 +1101,17 @@ int disk_tree_init(struct nary_tree_mt *tree) {
         return -1;
     }
 
-    /* Bind to NUMA node if available */
+    /* Place on NUMA nodes per the mount policy, if available */
     if (numa_available()) {
-        if (numa_bind_memory(addr, shm_size, numa_node) == 0) {
-            printf("📍 NUMA: Bound disk-backed memory to node %d\n", numa_node);
+        if (numa_place(addr, shm_size, NUMA_MEM_METADATA, numa_node) == 0) {
+            printf("📍 NUMA: Placed disk-backed memory (%s policy, node %d)\n",
+                   numa_policy_name(numa_get_policy()), numa_node);
         }
     }
 
+    /* Huge pages if enabled, as for shared memory */
+    numa_advise_huge(addr, shm_size);
+
     /* Setup tree structure */
     struct shm_tree_header *hdr = (struct shm_tree_header *)addr;
 
@@ -646,22 +1119,10 @@ int disk_tree_init(struct nary_tree_mt *tree) {
         /* Initialize new disk-backed storage */
         printf("🆕 Creating new PERSISTENT filesystem (disk-backed)\n");
 
-        hdr->magic = SHM_MAGIC;
-        hdr->version = SHM_VERSION;
-        hdr->capacity = NARY_MT_INITIAL_CAPACITY;
-        hdr->used = 0;
-        hdr->next_inode = 1;
-        hdr->free_count = 0;
+        shm_header_init(hdr);
 
         /* Setup pointers */
-        tree->nodes = (struct nary_node_mt *)(hdr + 1);
-        tree->free_list = (uint16_t *)(tree->nodes + hdr->capacity);
-
-        tree->capacity = hdr->capacity;
-        tree->used = 0;
-        tree->next_inode = 1;
-        tree->op_count = 0;
-        tree->free_count = 0;
+        shm_tree_bind(tree, hdr);
 
         /* Initialize string table in heap mode (we'll persist separately) */
         if (string_table_init(&tree->strings) != 0) {
@@ -693,7 +1154,7 @@ int disk_tree_init(struct nary_tree_mt *tree) {
         tree->nodes[0].node.size = 0;
         tree->nodes[0].node.mtime = time(NULL);
 
-        for (int i = 0; i < NARY_BRANCHING_FACTOR; i++) {
+        for (int i = 0; i < NARY_INLINE_CHILDREN; i++) {
             tree->nodes[0].node.children[i] = NARY_INVALID_IDX;
         }
 
@@ -713,22 +1174,8 @@ int disk_tree_init(struct nary_tree_mt *tree) {
         /* Attach to existing disk-backed storage */
         printf("♻️  Attaching to existing PERSISTENT filesystem (disk-backed)\n");
 
-        /* Validate magic */
-        if (hdr->magic != SHM_MAGIC) {
-            fprintf(stderr, "Invalid disk storage magic: 0x%x\n", hdr->magic);
-            munmap(addr, shm_size);
-            return -1;
-        }
-
-        /* Setup pointers */
-        tree->nodes = (struct nary_node_mt *)(hdr + 1);
-        tree->free_list = (uint16_t *)(tree->nodes + hdr->capacity);
-
-        tree->capacity = hdr->capacity;
-        tree->used = hdr->used;
-        tree->next_inode = hdr->next_inode;
-        tree->op_count = 0;
-        tree->free_count = hdr->free_count;
+        /* Setup pointers (image validated by map_existing_image) */
+        shm_tree_bind(tree, hdr);
 
         /* Initialize string table in heap mode and load from disk */
         if (string_table_init(&tree->strings) != 0) {
@@ -745,10 +1192,34 @@ int disk_tree_init(struct nary_tree_mt *tree) {
             return -1;
         }
 
-        /* Tree lock is already initialized in disk storage */
+        /* Name reference counts are rebuilt from the nodes using them */
+        if (nary_strings_recount_mt(tree) != 0) {
+            fprintf(stderr, "⚠️  Some nodes name no stored string\n");
+        }
+
+        /* The tree lock lives in the caller's structure, not the image */
+        pthread_rwlockattr_t attr;
+        pthread_rwlockattr_init(&attr);
+        pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_rwlock_init(&tree->tree_lock, &attr);
+        pthread_rwlockattr_destroy(&attr);
+
         printf("📊 Restored %u nodes, next inode: %u (from disk)\n", tree->used, tree->next_inode);
     }
 
+    /* Name fingerprints live outside the image */
+    if (nary_child_fp_rebuild_mt(tree) != 0) {
+        string_table_destroy(&tree->strings);
+        munmap(addr, shm_size);
+        return -1;
+    }
+
+    /* Sequence counters and heat are not persisted either; without them
+     * readers just lock and compaction steps do nothing */
+    tree->node_seq = calloc(tree->capacity, sizeof(uint32_t));
+    tree->node_heat = calloc(tree->capacity, sizeof(uint32_t));
+    tree->node_cow = calloc(tree->capacity, sizeof(uint32_t));  /* NULL = no snapshots */
+
     memset(&tree->stats, 0, sizeof(tree->stats));
     tree->stats.total_nodes = tree->used;
 
@@ -889,7 +1360,405 @@ int disk_file_data_restore(uint32_t inode, void **data_out, size_t *size_out,
     return 0;
 }
 
+/* Check whether a buffer is entirely zero (used to keep holes sparse) */
+static int is_zero_block(const char *buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i]) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Append chunks [first, last] of a file to the data log
+ * With dirty_only, payloads go out only for dirty chunks and for chunks
+ * past a pending shrink. A file the log does not hold yet is written whole.
+ */
+static int extents_write(uint32_t inode, const struct extent_store *es,
+                         uint64_t first, uint64_t last, int dirty_only) {
+    struct data_log *log = disk_data_log();
+    if (!log) return -1;
+
+    uint32_t span = extent_store_chunk_span(es);
+
+    /* Chunks from `keep` on were truncated away since they were written */
+    uint32_t keep = es->shrunk_span < span ? es->shrunk_span : span;
+
+    if (!data_log_contains(log, inode)) {
+        if (es->absent_count) return -1;  /* Nowhere to take those from */
+        first = 0;
+        last = span ? span - 1 : 0;
+        keep = 0;
+        dirty_only = 0;
+    } else if (keep < span) {
+        /* Re-grown past a shrink: everything from `keep` on goes out again */
+        if (first > keep) first = keep;
+        last = span - 1;
+    }
+    if (last >= span) last = span ? span - 1 : 0;
+
+    struct data_log_put *puts = NULL;
+    uint32_t count = 0;
+    if (span > 0 && first <= last) {
+        puts = calloc((size_t)(last - first + 1), sizeof(*puts));
+        if (!puts) return -1;
+
+        for (uint64_t i = first; i <= last; i++) {
+            uint32_t raw_len = 0, stored_len = 0;
+            const char *payload = extent_store_chunk(es, (uint32_t)i, &raw_len, &stored_len);
+            if (dirty_only && i < keep && !extent_store_chunk_dirty(es, (uint32_t)i)) {
+                continue;  /* Logged payload is current */
+            }
+            if (!payload || raw_len == 0) {
+                /* Hole; below `keep` the log may still hold data (punched) */
+                if (i >= keep || extent_store_chunk_absent(es, (uint32_t)i)) continue;
+                puts[count++].idx = (uint32_t)i;
+                continue;
+            }
+
+            puts[count].idx = (uint32_t)i;
+            puts[count].raw_size = raw_len;
+            puts[count].stored_size = stored_len;
+            puts[count].data = payload;
+            count++;
+        }
+    }
+
+    int ret = data_log_append(log, inode, es->size, keep, puts, count);
+    free(puts);
+    return ret;
+}
+
+int disk_file_extents_save(uint32_t inode, const struct extent_store *es,
+                           uint64_t offset, uint64_t length) {
+    if (!es) return -1;
+
+    /* A zero-length range still refreshes the chunk holding `offset`
+     * (e.g. the zeroed tail after a truncate) */
+    uint64_t end = offset + (length ? length : 1);
+    if (end < offset) end = UINT64_MAX;
+
+    return extents_write(inode, es, EXTENT_CHUNK_INDEX(offset),
+                         EXTENT_CHUNK_INDEX(end - 1), 0);
+}
+
+int disk_file_extents_flush(uint32_t inode, const struct extent_store *es) {
+    if (!es) return -1;
+    if (!extent_store_is_dirty(es)) return 0;
+
+    /* Only dirty payloads are written; a size-only change is a bare record */
+    uint32_t span = extent_store_chunk_span(es);
+    uint64_t first = UINT64_MAX, last = 0;
+    for (uint32_t i = 0; i < span && i < es->map_capacity; i++) {
+        if (extent_store_chunk_dirty(es, i)) {
+            if (first == UINT64_MAX) first = i;
+            last = i;
+        }
+    }
+
+    return extents_write(inode, es, first, last, 1);
+}
+
+/* Install one logged chunk (the payload is copied out of the mapping) */
+static int install_logged_chunk(void *ctx, uint32_t idx, const char *payload,
+                                uint32_t raw_size, uint32_t stored_size) {
+    if (!payload || raw_size > EXTENT_CHUNK_SIZE) return -1;  /* Remote: fault it */
+
+    char *copy = malloc(stored_size);
+    if (!copy) return -1;
+    memcpy(copy, payload, stored_size);
+    return extent_store_install_chunk((struct extent_store *)ctx, idx, copy,
+                                      raw_size, stored_size);
+}
+
+/* Restore a blocked image: install payloads as-is, no recompression */
+static int restore_blocked(int fd, uint32_t inode, const struct shm_file_header *hdr,
+                           struct extent_store *es) {
+    const off_t container = sizeof(struct shm_file_header);
+    struct compression_blocked_header bhdr;
+
+    if (pread(fd, &bhdr, sizeof(bhdr), container) != (ssize_t)sizeof(bhdr) ||
+        bhdr.magic != COMPRESSION_BLOCKED_MAGIC || bhdr.block_size != EXTENT_CHUNK_SIZE ||
+        bhdr.block_count > bhdr.table_capacity ||
+        bhdr.original_size > ((uint64_t)bhdr.block_count << EXTENT_CHUNK_SHIFT)) {
+        fprintf(stderr, "Invalid blocked file data for inode %u\n", inode);
+        return -1;
+    }
+
+    size_t table_size = (size_t)bhdr.block_count * sizeof(struct compression_seek_entry);
+    struct compression_seek_entry *table = malloc(table_size ? table_size : 1);
+    if (!table) return -1;
+    if (pread(fd, table, table_size, container + sizeof(bhdr)) != (ssize_t)table_size) {
+        free(table);
+        return -1;
+    }
+
+    int ret = 0;
+    for (uint32_t i = 0; i < bhdr.block_count; i++) {
+        const struct compression_seek_entry *entry = &table[i];
+        if (entry->raw_size == 0) continue;  /* Hole */
+
+        if (entry->raw_size > EXTENT_CHUNK_SIZE || entry->stored_size == 0 ||
+            entry->stored_size > entry->raw_size) {
+            fprintf(stderr, "Corrupt seek entry %u for inode %u\n", i, inode);
+            ret = -1;
+            break;
+        }
+
+        char *payload = malloc(entry->stored_size);
+        if (!payload) {
+            ret = -1;
+            break;
+        }
+        if (pread(fd, payload, entry->stored_size, container + (off_t)entry->offset) !=
+            (ssize_t)entry->stored_size) {
+            free(payload);
+            ret = -1;
+            break;
+        }
+        if (extent_store_install_chunk(es, i, payload, entry->raw_size,
+                                       entry->stored_size) != 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    free(table);
+    if (ret == 0) ret = extent_store_truncate(es, hdr->size);
+    if (ret == 0) extent_store_mark_clean(es);  /* Matches the image */
+    return ret;
+}
+
+/* Restore from a per-inode image written before the data log */
+static int legacy_extents_restore(uint32_t inode, struct extent_store *es) {
+    char filepath[256];
+    const char *file_prefix = get_file_prefix();
+    snprintf(filepath, sizeof(filepath), "%s%u", file_prefix, inode);
+
+    int fd = open(filepath, O_RDONLY, 0);
+    if (fd < 0) {
+        /* File has no persisted data (not an error) */
+        return -1;
+    }
+
+    struct shm_file_header hdr;
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+        fprintf(stderr, "Invalid file data size for inode %u\n", inode);
+        close(fd);
+        return -1;
+    }
+
+    if (hdr.magic != SHM_FILE_MAGIC) {
+        fprintf(stderr, "Invalid file data magic for inode %u: 0x%x\n",
+                inode, hdr.magic);
+        close(fd);
+        return -1;
+    }
+
+    if (hdr.is_compressed == SHM_FILE_FORMAT_BLOCKED) {
+        int ret = restore_blocked(fd, inode, &hdr, es);
+        close(fd);
+        return ret;
+    }
+
+    if (hdr.is_compressed == SHM_FILE_FORMAT_COMPRESSED) {
+        /* Legacy whole-file compressed image: inflate once into chunks */
+        struct stat st;
+        if (fstat(fd, &st) < 0 ||
+            hdr.data_size > (size_t)st.st_size - sizeof(hdr)) {
+            fprintf(stderr, "Truncated file data for inode %u\n", inode);
+            close(fd);
+            return -1;
+        }
+
+        void *blob = malloc(hdr.data_size);
+        if (!blob) {
+            close(fd);
+            return -1;
+        }
+        if (pread(fd, blob, hdr.data_size, sizeof(hdr)) != (ssize_t)hdr.data_size) {
+            free(blob);
+            close(fd);
+            return -1;
+        }
+        close(fd);
+
+        size_t plain_size = 0;
+        void *plain = decompress_data(blob, hdr.data_size, &plain_size);
+        free(blob);
+        if (!plain) return -1;
+
+        int ret = 0;
+        if (plain_size > 0 &&
+            extent_store_write(es, plain, plain_size, 0) != (ssize_t)plain_size) {
+            ret = -1;
+        }
+        free(plain);
+        if (ret == 0) ret = extent_store_truncate(es, hdr.size);
+        if (ret == 0) extent_store_compress_range(es, 0, es->size);
+        return ret;
+    }
+
+    /* Raw image: read chunk by chunk, keeping all-zero chunks as holes */
+    char *buf = malloc(EXTENT_CHUNK_SIZE);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+
+    int ret = 0;
+    for (uint64_t pos = 0; pos < hdr.size; pos += EXTENT_CHUNK_SIZE) {
+        size_t want = hdr.size - pos < EXTENT_CHUNK_SIZE ?
+                      (size_t)(hdr.size - pos) : EXTENT_CHUNK_SIZE;
+        ssize_t got = pread(fd, buf, want, (off_t)(sizeof(hdr) + pos));
+        if (got < 0) {
+            perror("pread (file extents)");
+            ret = -1;
+            break;
+        }
+        if (got == 0) break;  /* Image shorter than header claims: rest is zeros */
+
+        if (!is_zero_block(buf, (size_t)got) &&
+            extent_store_write(es, buf, (size_t)got, pos) != got) {
+            ret = -1;
+            break;
+        }
+    }
+
+    free(buf);
+    close(fd);
+
+    if (ret == 0) ret = extent_store_truncate(es, hdr.size);
+    if (ret == 0) extent_store_compress_range(es, 0, es->size);
+    return ret;
+}
+
+int disk_file_extents_restore(uint32_t inode, struct extent_store *es) {
+    if (!es) return -1;
+
+    struct data_log *log = disk_data_log();
+    if (log) {
+        uint64_t size = 0;
+        int found = data_log_restore(log, inode, install_logged_chunk, es, &size);
+        if (found <= 0) {
+            if (found < 0 || extent_store_truncate(es, size) != 0) return -1;
+            extent_store_mark_clean(es);  /* Matches the log */
+            return 0;
+        }
+    }
+
+    if (legacy_extents_restore(inode, es) != 0) {
+        return -1;
+    }
+
+    /* Move it into the log; the old image goes once the log has it */
+    if (log && extents_write(inode, es, 0, 0, 0) == 0) {
+        extent_store_mark_clean(es);
+        char filepath[256];
+        snprintf(filepath, sizeof(filepath), "%s%u", get_file_prefix(), inode);
+        unlink(filepath);
+    }
+    return 0;
+}
+
+/* Record one logged chunk as absent; its payload stays in the log */
+static int mark_logged_chunk_absent(void *ctx, uint32_t idx, const char *payload,
+                                    uint32_t raw_size, uint32_t stored_size) {
+    (void)payload;
+    (void)stored_size;
+    if (raw_size > EXTENT_CHUNK_SIZE) return -1;
+    return extent_store_mark_absent((struct extent_store *)ctx, idx, raw_size);
+}
+
+int disk_file_extents_attach(uint32_t inode, struct extent_store *es) {
+    if (!es) return -1;
+
+    struct data_log *log = disk_data_log();
+    if (log) {
+        uint64_t size = 0;
+        int found = data_log_restore(log, inode, mark_logged_chunk_absent, es, &size);
+        if (found <= 0) {
+            if (found < 0 || extent_store_truncate(es, size) != 0) return -1;
+            extent_store_mark_clean(es);  /* Matches the log */
+            return 0;
+        }
+    }
+
+    /* Per-inode images are loaded (and migrated) in full */
+    return disk_file_extents_restore(inode, es);
+}
+
+/* Load one remote chunk through the attached tier */
+static int fault_remote_chunk(uint32_t inode, struct extent_store *es, uint32_t idx,
+                              const struct data_log_chunk_ref *ref) {
+    char *payload = malloc(ref->stored_size);
+    if (!payload) return -1;
+
+    pthread_rwlock_rdlock(&g_remote_lock);
+    int ret = g_remote.read ?
+              g_remote.read(g_remote.ctx, inode, ref->offset, ref->stored_size, payload) : -1;
+    pthread_rwlock_unlock(&g_remote_lock);
+
+    if (ret != 0) {
+        free(payload);
+        return -1;
+    }
+    return extent_store_install_chunk(es, idx, payload, ref->raw_size, ref->stored_size);
+}
+
+int disk_file_extents_fault(uint32_t inode, struct extent_store *es,
+                            uint64_t offset, uint64_t length) {
+    if (!es) return -1;
+    if (!extent_store_range_absent(es, offset, length)) return 0;
+
+    struct data_log *log = disk_data_log();
+    if (!log) return -1;
+
+    uint64_t end = offset + length;
+    if (end < offset || end > es->size) end = es->size;
+
+    uint64_t last = EXTENT_CHUNK_INDEX(end - 1);
+    for (uint64_t i = EXTENT_CHUNK_INDEX(offset); i <= last; i++) {
+        if (!extent_store_chunk_absent(es, (uint32_t)i)) continue;
+
+        int ret = data_log_restore_chunk(log, inode, (uint32_t)i, install_logged_chunk, es);
+        if (ret == 2) {
+            /* Offloaded: the index entry says where in the tier object */
+            struct data_log_chunk_ref ref;
+            ret = data_log_lookup(log, inode, (uint32_t)i, &ref) == 0 &&
+                  (ref.flags & DATA_LOG_CHUNK_REMOTE) ?
+                  fault_remote_chunk(inode, es, (uint32_t)i, &ref) : -1;
+        }
+        if (ret != 0) {
+            return -1;  /* Gone from the log, tier unreachable or out of memory */
+        }
+    }
+    return 0;
+}
+
+size_t disk_file_extents_evict(uint32_t inode, struct extent_store *es) {
+    if (!es || es->chunk_count == 0) return 0;
+
+    /* Clean chunks are only on disk once the log holds the file */
+    struct data_log *log = disk_data_log();
+    if (!log || !data_log_contains(log, inode)) return 0;
+
+    return extent_store_evict_clean(es);
+}
+
 void disk_file_data_remove(uint32_t inode) {
+    struct data_log *log = disk_data_log();
+    if (log) {
+        int remote = data_log_has_remote(log, inode);
+        data_log_remove(log, inode);
+
+        if (remote) {
+            /* Its tier object is garbage now */
+            pthread_rwlock_rdlock(&g_remote_lock);
+            if (g_remote.forget) g_remote.forget(g_remote.ctx, inode);
+            pthread_rwlock_unlock(&g_remote_lock);
+        }
+    }
+
     char filepath[256];
     const char *file_prefix = get_file_prefix();
     snprintf(filepath, sizeof(filepath), "%s%u", file_prefix, inode);
@@ -898,11 +1767,31 @@ void disk_file_data_remove(uint32_t inode) {
 
 /* === Disk-Backed String Table Persistence === */
 
+/* Writes one range of the table at its place in the file */
+static int string_file_write(void *ctx, uint32_t offset, const char *data, uint32_t size) {
+    int fd = *(int *)ctx;
+    off_t pos = (off_t)sizeof(uint32_t) + offset;
+
+    while (size > 0) {
+        ssize_t n = pwrite(fd, data, size, pos);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("pwrite (string table)");
+            return -1;
+        }
+        data += n;
+        size -= (uint32_t)n;
+        pos += n;
+    }
+    return 0;
+}
+
 /**
  * Save string table to disk
- * Creates/persists string table to disk file
+ * Only what changed since the last save is written: names are stored
+ * in place, then the used size at the start of the file says they are there.
  */
-int disk_string_table_save(const struct string_table *st, const char *filepath) {
+int disk_string_table_save(struct string_table *st, const char *filepath) {
     if (!st || !filepath) return -1;
     if (!st->data) return -1;
 
@@ -917,41 +1806,46 @@ int disk_string_table_save(const struct string_table *st, const char *filepath)
         return -1;
     }
 
-    /* Set file size */
-    size_t total_size = sizeof(uint32_t) + st->used;  /* used size stored at beginning */
-    if (ftruncate(fd, total_size) < 0) {
-        perror("ftruncate (string table)");
+    /* Rewrite it all unless the file is the one we saved last */
+    uint32_t saved_used = 0;
+    struct stat st_info;
+    int full = fstat(fd, &st_info) != 0 ||
+               st_info.st_size < (off_t)(sizeof(uint32_t) + st->persisted) ||
+               pread(fd, &saved_used, sizeof(saved_used), 0) != (ssize_t)sizeof(saved_used) ||
+               saved_used != st->persisted;
+
+    uint32_t used;
+    if (string_table_flush(st, full, string_file_write, &fd, &used) != 0) {
         close(fd);
         return -1;
     }
 
-    /* Map file for writing */
-    void *addr = mmap(NULL, total_size, PROT_READ | PROT_WRITE,
-                      MAP_SHARED, fd, 0);
-    close(fd);
-
-    if (addr == MAP_FAILED) {
-        perror("mmap (string table save)");
+    /* A rewrite drops whatever an older, longer table left behind */
+    if (full && ftruncate(fd, (off_t)(sizeof(uint32_t) + used)) < 0) {
+        perror("ftruncate (string table)");
+        st->persisted = 0;
+        close(fd);
         return -1;
     }
 
-    /* Write used size first, then string data */
-    memcpy(addr, &st->used, sizeof(uint32_t));
-    memcpy((char*)addr + sizeof(uint32_t), st->data, st->used);
-
-    /* Sync to disk */
-    if (msync(addr, total_size, MS_SYNC) != 0) {
-        perror("msync (string table)");
-        munmap(addr, total_size);
+    /* Names first, then the size that makes them visible */
+    if (fdatasync(fd) != 0 ||
+        pwrite(fd, &used, sizeof(used), 0) != (ssize_t)sizeof(used) ||
+        fdatasync(fd) != 0) {
+        perror("sync (string table)");
+        st->persisted = 0;  /* Unknown on disk: rewrite next time */
+        close(fd);
         return -1;
     }
 
-    /* Unmap */
-    munmap(addr, total_size);
-
+    close(fd);
     return 0;
 }
 
+int disk_string_table_sync(struct string_table *st) {
+    return disk_string_table_save(st, get_string_table_path());
+}
+
 /**
  * Load string table from disk
  * Loads string table from disk file
@@ -988,30 +1882,83 @@ int disk_string_table_load(struct string_table *st, const char *filepath) {
         return -1;
     }
 
-    /* Read used size first */
-    memcpy(&st->used, addr, sizeof(uint32_t));
-    
-    /* Calculate actual data size */
-    size_t data_size = st_info.st_size - sizeof(uint32_t);
-    
-    /* Allocate space for data */
-    st->data = malloc(data_size);
-    if (!st->data) {
+    /* Used size first, then the strings */
+    uint32_t used;
+    memcpy(&used, addr, sizeof(uint32_t));
+    if (used > st_info.st_size - sizeof(uint32_t)) {
+        fprintf(stderr, "Invalid string table size %u\n", used);
         munmap(addr, st_info.st_size);
         return -1;
     }
 
-    /* Copy string data */
-    memcpy(st->data, (char*)addr + sizeof(uint32_t), data_size);
+    /* Copied into the (initialized) table, which indexes it again */
+    int ret = string_table_load(st, (const char *)addr + sizeof(uint32_t), used);
     munmap(addr, st_info.st_size);
+    return ret;
+}
 
-    /* Set up capacity based on data read */
-    st->capacity = data_size;
-    st->is_shm = 0;  /* Not in shared memory mode for loaded string table */
+int disk_string_table_map(struct string_table *st, const char *filepath) {
+    if (!st || !filepath) return -1;
+
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st_info;
+    if (fstat(fd, &st_info) < 0 || st_info.st_size < (off_t)sizeof(uint32_t) ||
+        (uint64_t)st_info.st_size > STRING_TABLE_MAX_SIZE + sizeof(uint32_t)) {
+        close(fd);
+        return -1;
+    }
+
+    void *addr = mmap(NULL, st_info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return -1;
+    }
 
-    /* Rebuild hash table from loaded strings (basic implementation) */
-    /* In a full implementation, we'd need to reconstruct the hash table */
-    /* For now, we'll just mark that we need to rebuild it elsewhere if needed */
+    /* Used size first, then the strings */
+    uint32_t used;
+    memcpy(&used, addr, sizeof(uint32_t));
+    uint32_t capacity = (uint32_t)(st_info.st_size - sizeof(uint32_t));
+    if (used > capacity) {
+        munmap(addr, st_info.st_size);
+        return -1;
+    }
 
+    memset(st, 0, sizeof(*st));
+    st->data = (char *)addr + sizeof(uint32_t);
+    st->capacity = capacity;
+    st->used = used;
+    st->is_shm = 1;
     return 0;
 }
+
+void disk_string_table_unmap(struct string_table *st) {
+    if (!st || !st->data) return;
+    munmap(st->data - sizeof(uint32_t), (size_t)st->capacity + sizeof(uint32_t));
+    st->data = NULL;
+    st->capacity = st->used = 0;
+}
+
+int disk_xattrs_save(struct xattr_store *xs) {
+    if (ensure_data_dir() < 0) {
+        return -1;
+    }
+    return xattr_store_save(xs, get_xattrs_path());
+}
+
+int disk_xattrs_flush(struct xattr_store *xs) {
+    if (ensure_data_dir() < 0) {
+        return -1;
+    }
+    return xattr_store_flush(xs, get_xattrs_path());
+}
+
+int disk_xattrs_load(struct xattr_store *xs) {
+    if (ensure_data_dir() < 0) {
+        return -1;
+    }
+    return xattr_store_load(xs, get_xattrs_path());
+}
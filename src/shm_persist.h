@@ -6,12 +6,20 @@
  * - String table in another region
  * - File data in individual regions
  * - No daemon needed - survives mount/unmount
+ *
+ * Disk-backed mounts keep three segments: the node image (nodes.dat), the
+ * string table (strings.dat) and the contents of all files in one data
+ * log (data.log, see data_log.h), each mapped once at mount. Extended
+ * attributes are saved beside them (xattrs.dat, see xattr.h).
  */
 
 #ifndef RAZORFS_SHM_PERSIST_H
 #define RAZORFS_SHM_PERSIST_H
 
 #include "nary_tree_mt.h"
+#include "extent_store.h"
+#include "data_log.h"
+#include "xattr.h"
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -35,23 +43,60 @@ extern "C" {
 #define DISK_DATA_DIR_FALLBACK "/tmp/razorfs_data"
 #define DISK_TREE_NODES   "/var/lib/razorfs/nodes.dat"
 #define DISK_STRING_TABLE "/var/lib/razorfs/strings.dat"
-#define DISK_FILE_PREFIX  "/var/lib/razorfs/file_"
+#define DISK_FILE_PREFIX  "/var/lib/razorfs/file_"     /* Per-inode images before data.log */
+#define DISK_DATA_LOG     "/var/lib/razorfs/data.log"
+#define DISK_XATTRS       "/var/lib/razorfs/xattrs.dat"
 #define DISK_TREE_NODES_FALLBACK   "/tmp/razorfs_data/nodes.dat"
 #define DISK_STRING_TABLE_FALLBACK "/tmp/razorfs_data/strings.dat"
 #define DISK_FILE_PREFIX_FALLBACK  "/tmp/razorfs_data/file_"
+#define DISK_DATA_LOG_FALLBACK     "/tmp/razorfs_data/data.log"
+#define DISK_XATTRS_FALLBACK       "/tmp/razorfs_data/xattrs.dat"
 
-/* Shared memory tree structure header */
-struct shm_tree_header {
+/**
+ * Shared memory tree structure header
+ *
+ * Image layout: [header][nodes][child blocks][free list], all sized for
+ * `capacity` nodes when the image is created (the file is sparse, so
+ * unused capacity costs no storage). Padded so the node array stays
+ * aligned to its 128-byte nodes.
+ */
+struct __attribute__((aligned(128))) shm_tree_header {
     uint32_t magic;            /* Magic number for validation */
     uint32_t version;          /* Format version */
     uint32_t capacity;         /* Total node capacity */
     uint32_t used;             /* Nodes in use */
     uint32_t next_inode;       /* Next inode number */
     uint32_t free_count;       /* Free list count */
+    uint32_t block_capacity;   /* Child block capacity */
+    uint32_t block_used;       /* Child blocks high-water mark */
+    uint32_t block_free;       /* Free child block chain */
 };
 
 #define SHM_MAGIC 0x52415A4F    /* "RAZO" */
-#define SHM_VERSION 1
+#define SHM_VERSION_V1 1        /* 16-bit indices, 1024 nodes (migrated on attach) */
+#define SHM_VERSION 2           /* 32-bit indices with child blocks */
+
+/* Node capacity of new tree images (mapped trees cannot grow) */
+#define SHM_TREE_CAPACITY (1u << 20)
+
+/**
+ * File data image header (one image per inode)
+ * is_compressed selects the layout of the bytes that follow.
+ */
+struct shm_file_header {
+    uint32_t magic;              /* Magic number for validation */
+    uint32_t inode;              /* Inode number */
+    size_t size;                 /* Uncompressed file size */
+    size_t data_size;            /* Actual data size (may be compressed) */
+    int is_compressed;           /* SHM_FILE_FORMAT_* */
+};
+
+#define SHM_FILE_MAGIC 0x46494C45  /* "FILE" */
+
+/* File image formats */
+#define SHM_FILE_FORMAT_RAW        0  /* Plain file bytes */
+#define SHM_FILE_FORMAT_COMPRESSED 1  /* One compress_data() blob (legacy) */
+#define SHM_FILE_FORMAT_BLOCKED    2  /* Blocked container, one slot per chunk */
 
 /**
  * Initialize tree from shared memory (attach if exists, create if not)
@@ -62,11 +107,29 @@ int shm_tree_init(struct nary_tree_mt *tree);
 
 /**
  * Initialize tree from disk-backed files (attach if exists, create if not)
+ * Also opens the file data log, so file contents need no I/O until read.
  * PERSISTENT: Data survives reboot
  * Returns 0 on success, -1 on failure
  */
 int disk_tree_init(struct nary_tree_mt *tree);
 
+/**
+ * Map a disk-backed tree image without attaching to it (razorfsck)
+ * Binds the nodes, child blocks and free list of the image at path to
+ * tree and nothing else: no string table, locks, fingerprints or data log.
+ * A read-only mapping is shared, so it follows the changes of a mount
+ * using the image; version 1 images must be mounted once (migrated) first.
+ *
+ * @param writable 1 to map for writing (nobody else may use the image)
+ * @return 0 on success, -1 if the image is missing or invalid
+ */
+int disk_tree_map(struct nary_tree_mt *tree, const char *path, int writable);
+
+/**
+ * Unmap an image mapped by disk_tree_map (writable images are synced)
+ */
+void disk_tree_unmap(struct nary_tree_mt *tree);
+
 /**
  * Detach from shared memory (data persists)
  */
@@ -90,25 +153,65 @@ int shm_tree_exists(void);
 int disk_tree_exists(void);
 
 /**
- * Initialize string table persistence to disk
- * Creates/persists string table to disk file
+ * Persist string table to disk
+ * Writes only the names added or reused since the last save to the same
+ * file (everything if the file is new or not the one saved last), then
+ * the used size, each followed by fdatasync.
  *
  * @param st String table to persist
  * @param filepath Path to persistence file
  * @return 0 on success, -1 on failure
  */
-int disk_string_table_save(const struct string_table *st, const char *filepath);
+int disk_string_table_save(struct string_table *st, const char *filepath);
+
+/**
+ * Persist string table to the file the disk-backed tree uses
+ * @return 0 on success, -1 on failure
+ */
+int disk_string_table_sync(struct string_table *st);
 
 /**
  * Load string table from disk persistence
  * Loads string table from disk file
  *
- * @param st String table to load into
+ * @param st Initialized (heap-mode) string table to load into
  * @param filepath Path to persistence file
  * @return 0 on success, -1 on failure
  */
 int disk_string_table_load(struct string_table *st, const char *filepath);
 
+/**
+ * Map a persisted string table read-only, for string_table_get() only
+ * (the table has no index: nothing can be interned into it)
+ *
+ * @return 0 on success, -1 if the file is missing or invalid
+ */
+int disk_string_table_map(struct string_table *st, const char *filepath);
+
+/**
+ * Unmap a string table mapped by disk_string_table_map
+ */
+void disk_string_table_unmap(struct string_table *st);
+
+/**
+ * Save the extended attributes (xattrs.dat in the data directory)
+ * @return 0 on success, -1 on failure
+ */
+int disk_xattrs_save(struct xattr_store *xs);
+
+/**
+ * Persist the extended attributes changed since the last save or flush
+ * (appended to xattrs.dat; see xattr_store_flush)
+ * @return 0 on success, -1 on failure
+ */
+int disk_xattrs_flush(struct xattr_store *xs);
+
+/**
+ * Load the extended attributes saved by disk_xattrs_save
+ * @return 0 on success, -1 if there are none or the file is invalid
+ */
+int disk_xattrs_load(struct xattr_store *xs);
+
 /**
  * Save file data to shared memory
  * Creates/updates /dev/shm/razorfs_file_<inode>
@@ -147,7 +250,8 @@ void shm_file_data_remove(uint32_t inode);
 
 /**
  * Disk-backed file data operations (PERSISTENT)
- * Same interface as shm_* but uses disk files instead
+ * Same interface as shm_* but uses per-inode disk files instead.
+ * disk_file_data_remove() also drops the file from the data log.
  */
 int disk_file_data_save(uint32_t inode, const void *data, size_t size,
                         size_t data_size, int is_compressed);
@@ -155,6 +259,116 @@ int disk_file_data_restore(uint32_t inode, void **data_out, size_t *size_out,
                            size_t *data_size_out, int *is_compressed_out);
 void disk_file_data_remove(uint32_t inode);
 
+/**
+ * Persist part of a chunked file to disk
+ * Appends one record to the data log holding the new size and the chunks
+ * of the modified range in their stored form (raw or compressed). Chunks
+ * truncated away since the last write-back are dropped; if any were, the
+ * chunks from there to the end are written too. The first write-back of
+ * a file writes all of it.
+ *
+ * @param inode Inode number
+ * @param es Extent store holding the file contents
+ * @param offset Start of the modified range
+ * @param length Length of the modified range (0 = just the chunk holding
+ *               offset, e.g. the new tail after a truncate)
+ * @return 0 on success, -1 on failure
+ */
+int disk_file_extents_save(uint32_t inode, const struct extent_store *es,
+                           uint64_t offset, uint64_t length);
+
+/**
+ * Write back everything that changed since the store was last marked clean
+ * Only dirty chunk payloads are appended (plus the new size); a clean store
+ * is a no-op. On success the caller clears the dirty state with
+ * extent_store_mark_clean() while still excluding writers.
+ *
+ * @param inode Inode number
+ * @param es Extent store holding the file contents
+ * @return 0 on success, -1 on failure (dirty state is left untouched)
+ */
+int disk_file_extents_flush(uint32_t inode, const struct extent_store *es);
+
+/**
+ * Restore a file from disk into an (empty) extent store
+ * Chunks are copied out of the mapped data log as stored, without
+ * recompression, and come back clean. Files still in a per-inode image
+ * from before the data log are loaded from it (raw and legacy whole-file
+ * compressed images are split into chunks and compressed), then moved
+ * into the log.
+ *
+ * @param inode Inode number
+ * @param es Initialized, empty extent store
+ * @return 0 on success, -1 if not found or error
+ */
+int disk_file_extents_restore(uint32_t inode, struct extent_store *es);
+
+/**
+ * Attach a file on disk to an (empty) extent store without reading it
+ * Only the data log index is consulted: each logged chunk is recorded as
+ * absent with its size, and the store takes the logged file size, clean.
+ * Payloads stay in the log until disk_file_extents_fault(). Files still in
+ * a per-inode image are restored in full instead.
+ *
+ * @param inode Inode number
+ * @param es Initialized, empty extent store
+ * @return 0 on success, -1 if not found or error
+ */
+int disk_file_extents_attach(uint32_t inode, struct extent_store *es);
+
+/**
+ * Load the absent chunks overlapping [offset, offset + length)
+ * The caller holds the store exclusively. Chunks come back clean, as
+ * stored (no recompression); a range with nothing absent is a no-op.
+ *
+ * @param inode Inode number
+ * @param es Extent store filled by disk_file_extents_attach()
+ * @return 0 on success, -1 on failure (chunks loaded so far stay)
+ */
+int disk_file_extents_fault(uint32_t inode, struct extent_store *es,
+                            uint64_t offset, uint64_t length);
+
+/**
+ * Drop the clean chunks of a file from memory
+ * They become absent and fault back in from the data log on access;
+ * dirty chunks stay. Nothing is dropped unless the log holds the file.
+ * The caller holds the store exclusively.
+ *
+ * @return Heap bytes freed
+ */
+size_t disk_file_extents_evict(uint32_t inode, struct extent_store *es);
+
+/**
+ * The file data log, opened on first use
+ * @return The log, or NULL if it cannot be opened
+ */
+struct data_log *disk_data_log(void);
+
+/**
+ * Reads of offloaded (remote) chunks, provided by the tier that holds them
+ */
+struct disk_remote_ops {
+    /* Copy `size` bytes at `offset` of the inode's tier object into buf;
+     * 0 on success, -1 on failure */
+    int (*read)(void *ctx, uint32_t inode, uint64_t offset, uint32_t size, void *buf);
+    /* A file with remote chunks was deleted (may be NULL) */
+    void (*forget)(void *ctx, uint32_t inode);
+    void *ctx;
+};
+
+/**
+ * Attach the tier remote chunks are read from (NULL detaches it)
+ * Without one, faulting a remote chunk fails with EIO.
+ */
+void disk_set_remote(const struct disk_remote_ops *ops);
+
+/**
+ * Checkpoint and close the file data log
+ * Done by shm_tree_detach() for disk-backed trees; later file data calls
+ * open it again.
+ */
+void disk_data_log_close(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,385 @@
+/**
+ * Snapshots Implementation
+ */
+
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* === Saved files === */
+
+static inline uint32_t file_bucket(uint32_t inode) {
+    return (inode * 2654435761u) % SNAPSHOT_FILE_BUCKETS;
+}
+
+static struct snapshot_file *file_find(const struct snapshot *snap, uint32_t inode) {
+    struct snapshot_file *f = snap->files[file_bucket(inode)];
+    while (f && f->inode != inode) {
+        f = f->next;
+    }
+    return f;
+}
+
+static struct snapshot_file *file_get(struct snapshot *snap, uint32_t inode) {
+    struct snapshot_file *f = file_find(snap, inode);
+    if (f) return f;
+
+    f = calloc(1, sizeof(*f));
+    if (!f) return NULL;
+    if (extent_store_init(&f->pre) != 0) {
+        free(f);
+        return NULL;
+    }
+    f->inode = inode;
+
+    uint32_t bucket = file_bucket(inode);
+    f->next = snap->files[bucket];
+    snap->files[bucket] = f;
+    return f;
+}
+
+static void file_free(struct snapshot_file *f) {
+    extent_store_destroy(&f->pre);
+    free(f->captured);
+    free(f);
+}
+
+static inline int file_has(const struct snapshot_file *f, uint32_t chunk) {
+    return chunk < f->captured_bits && (f->captured[chunk / 8] & (1u << (chunk % 8)));
+}
+
+/* Mark chunk saved, growing the bitmap (-1 = no memory) */
+static int file_mark(struct snapshot_file *f, uint32_t chunk) {
+    if (chunk >= f->captured_bits) {
+        uint32_t bits = f->captured_bits ? f->captured_bits : 64;
+        while (bits <= chunk) {
+            bits = bits > UINT32_MAX / 2 ? UINT32_MAX : bits * 2;
+        }
+        size_t have = ((size_t)f->captured_bits + 7) / 8;
+        size_t want = ((size_t)bits + 7) / 8;
+        uint8_t *captured = realloc(f->captured, want);
+        if (!captured) return -1;
+        memset(captured + have, 0, want - have);
+        f->captured = captured;
+        f->captured_bits = bits;
+    }
+    f->captured[chunk / 8] |= 1u << (chunk % 8);
+    return 0;
+}
+
+/* Copy one chunk of `from` in its stored form into f (holes copy nothing) */
+static int file_copy_chunk(struct snapshot_file *f, const struct extent_store *from,
+                           uint32_t chunk) {
+    if (extent_store_chunk_absent(from, chunk)) return -1;
+
+    uint32_t raw = 0, stored = 0;
+    const char *payload = extent_store_chunk(from, chunk, &raw, &stored);
+    if (payload) {
+        char *copy = malloc(stored);
+        if (!copy) return -1;
+        memcpy(copy, payload, stored);
+
+        uint64_t end = ((uint64_t)chunk + 1) << EXTENT_CHUNK_SHIFT;
+        if (f->pre.size < end && extent_store_truncate(&f->pre, end) != 0) {
+            free(copy);
+            return -1;
+        }
+        if (extent_store_install_chunk(&f->pre, chunk, copy, raw, stored) != 0) {
+            return -1;
+        }
+    }
+    return file_mark(f, chunk);
+}
+
+static void snapshot_free(struct snapshot *snap) {
+    for (uint32_t b = 0; b < SNAPSHOT_FILE_BUCKETS; b++) {
+        struct snapshot_file *f = snap->files[b];
+        while (f) {
+            struct snapshot_file *next = f->next;
+            file_free(f);
+            f = next;
+        }
+    }
+    free(snap);
+}
+
+/* === Set === */
+
+int snapshot_set_init(struct snapshot_set *set) {
+    memset(set, 0, sizeof(*set));
+    return pthread_rwlock_init(&set->lock, NULL) == 0 ? 0 : -1;
+}
+
+void snapshot_set_destroy(struct snapshot_set *set) {
+    while (set->newest) {
+        struct snapshot *snap = set->newest;
+        set->newest = snap->older;
+        snapshot_free(snap);
+    }
+    set->count = 0;
+    set->active = 0;
+    pthread_rwlock_destroy(&set->lock);
+}
+
+static struct snapshot *find_by_name(const struct snapshot_set *set, const char *name) {
+    struct snapshot *snap = set->newest;
+    while (snap && strcmp(snap->name, name) != 0) {
+        snap = snap->older;
+    }
+    return snap;
+}
+
+static struct snapshot *find_by_id(const struct snapshot_set *set, uint32_t id) {
+    struct snapshot *snap = set->newest;
+    while (snap && snap->id != id) {
+        snap = snap->older;
+    }
+    return snap;
+}
+
+int snapshot_create(struct snapshot_set *set, struct nary_tree_mt *tree,
+                    const char *name, uint32_t *id_out) {
+    size_t len = name ? strnlen(name, SNAPSHOT_NAME_MAX + 1) : 0;
+    if (len == 0 || strchr(name, '/') || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        return -EINVAL;
+    }
+    if (len > SNAPSHOT_NAME_MAX) {
+        return -ENAMETOOLONG;
+    }
+
+    struct snapshot *snap = calloc(1, sizeof(*snap));
+    if (!snap) return -ENOMEM;
+    memcpy(snap->name, name, len + 1);
+
+    /* Held across the tree snapshot: no write saves data for the wrong one */
+    pthread_rwlock_wrlock(&set->lock);
+    if (find_by_name(set, name)) {
+        pthread_rwlock_unlock(&set->lock);
+        free(snap);
+        return -EEXIST;
+    }
+
+    int ret = nary_snapshot_create_mt(tree, &snap->id);
+    if (ret != 0) {
+        pthread_rwlock_unlock(&set->lock);
+        free(snap);
+        return ret;
+    }
+    /* Read after the tree snapshot: at worst files created since are saved too */
+    snap->inode_limit = __atomic_load_n(&tree->next_inode, __ATOMIC_ACQUIRE);
+    snap->created = time(NULL);
+
+    snap->older = set->newest;
+    if (snap->older) snap->older->newer = snap;
+    set->newest = snap;
+    set->count++;
+    __atomic_store_n(&set->active, 1, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(&set->lock);
+
+    if (id_out) *id_out = snap->id;
+    return 0;
+}
+
+/*
+ * What snap saved of a file is what the next older snapshot saw too,
+ * unless it saved its own copy of a chunk first: move the rest there
+ * (set lock held for writing)
+ */
+static void merge_into_older(struct snapshot_set *set, struct snapshot *snap) {
+    struct snapshot *older = snap->older;
+
+    for (uint32_t b = 0; b < SNAPSHOT_FILE_BUCKETS; b++) {
+        for (struct snapshot_file *f = snap->files[b]; f; f = f->next) {
+            if (!older || f->inode >= older->inode_limit) continue;
+
+            struct snapshot_file *into = file_get(older, f->inode);
+            for (uint32_t c = 0; c < f->captured_bits; c++) {
+                if (!file_has(f, c) || (into && file_has(into, c))) continue;
+                if (!into || file_copy_chunk(into, &f->pre, c) != 0) {
+                    set->lost++;
+                }
+            }
+            if (into && f->retired) into->retired = 1;
+        }
+    }
+}
+
+int snapshot_delete(struct snapshot_set *set, struct nary_tree_mt *tree, const char *name) {
+    if (!name) return -ENOENT;
+
+    pthread_rwlock_wrlock(&set->lock);
+    struct snapshot *snap = find_by_name(set, name);
+    if (!snap) {
+        pthread_rwlock_unlock(&set->lock);
+        return -ENOENT;
+    }
+
+    nary_snapshot_drop_mt(tree, snap->id);
+    merge_into_older(set, snap);
+
+    if (snap->older) snap->older->newer = snap->newer;
+    if (snap->newer) {
+        snap->newer->older = snap->older;
+    } else {
+        set->newest = snap->older;
+    }
+    set->count--;
+    __atomic_store_n(&set->active, set->newest != NULL, __ATOMIC_RELEASE);
+    pthread_rwlock_unlock(&set->lock);
+
+    snapshot_free(snap);
+    return 0;
+}
+
+uint32_t snapshot_find(struct snapshot_set *set, const char *name) {
+    if (!name) return 0;
+
+    pthread_rwlock_rdlock(&set->lock);
+    struct snapshot *snap = find_by_name(set, name);
+    uint32_t id = snap ? snap->id : 0;
+    pthread_rwlock_unlock(&set->lock);
+    return id;
+}
+
+uint32_t snapshot_get(struct snapshot_set *set, uint32_t pos, char *name_out,
+                      time_t *created_out) {
+    pthread_rwlock_rdlock(&set->lock);
+    struct snapshot *snap = NULL;
+    if (pos < set->count) {
+        snap = set->newest;
+        for (uint32_t i = set->count - 1; i > pos; i--) {
+            snap = snap->older;
+        }
+    }
+
+    uint32_t id = 0;
+    if (snap) {
+        id = snap->id;
+        if (name_out) strcpy(name_out, snap->name);
+        if (created_out) *created_out = snap->created;
+    }
+    pthread_rwlock_unlock(&set->lock);
+    return id;
+}
+
+/* === Copy-on-write === */
+
+/* Save chunks [first, last] of a live file into the newest snapshot */
+static void capture_chunks(struct snapshot_set *set, uint32_t inode,
+                           const struct extent_store *live, uint32_t first, uint32_t last,
+                           int retire) {
+    /* Most writes find their chunks saved already: check under the read lock */
+    pthread_rwlock_rdlock(&set->lock);
+    struct snapshot *snap = set->newest;
+    if (!snap || inode >= snap->inode_limit) {
+        pthread_rwlock_unlock(&set->lock);
+        return;
+    }
+    const struct snapshot_file *f = file_find(snap, inode);
+    int saved = f && (!retire || f->retired);
+    for (uint32_t c = first; saved && c <= last; c++) {
+        saved = file_has(f, c);
+    }
+    pthread_rwlock_unlock(&set->lock);
+    if (saved) return;
+
+    pthread_rwlock_wrlock(&set->lock);
+    snap = set->newest;
+    if (snap && inode < snap->inode_limit) {
+        struct snapshot_file *into = file_get(snap, inode);
+        for (uint32_t c = first; c <= last; c++) {
+            if (into && file_has(into, c)) continue;
+            if (!into || file_copy_chunk(into, live, c) != 0) {
+                set->lost++;
+            }
+        }
+        if (into && retire) into->retired = 1;
+    }
+    pthread_rwlock_unlock(&set->lock);
+}
+
+void snapshot_capture(struct snapshot_set *set, uint32_t inode,
+                      const struct extent_store *live, uint64_t offset, uint64_t length) {
+    if (!snapshot_set_active(set) || length == 0) return;
+
+    /* Chunks past the end are holes in every snapshot that has no copy */
+    uint32_t span = extent_store_chunk_span(live);
+    uint64_t first = EXTENT_CHUNK_INDEX(offset);
+    if (first >= span) return;
+    uint64_t last = offset + length < offset ? span - 1 : EXTENT_CHUNK_INDEX(offset + length - 1);
+    if (last >= span) last = span - 1;
+
+    capture_chunks(set, inode, live, (uint32_t)first, (uint32_t)last, 0);
+}
+
+void snapshot_retire(struct snapshot_set *set, uint32_t inode,
+                     const struct extent_store *live) {
+    if (!snapshot_set_active(set)) return;
+
+    /* An empty file still retires: its older sizes read as zeros */
+    uint32_t span = extent_store_chunk_span(live);
+    if (span == 0) {
+        capture_chunks(set, inode, live, 1, 0, 1);
+    } else {
+        capture_chunks(set, inode, live, 0, span - 1, 1);
+    }
+}
+
+int snapshot_overlay(struct snapshot_set *set, uint32_t id, uint32_t inode,
+                     char *buf, size_t size, uint64_t offset) {
+    pthread_rwlock_rdlock(&set->lock);
+    struct snapshot *snap = find_by_id(set, id);
+    if (!snap) {
+        pthread_rwlock_unlock(&set->lock);
+        return -ENOENT;
+    }
+
+    int ret = 0;
+    size_t done = 0;
+    while (done < size && ret == 0) {
+        uint64_t pos = offset + done;
+        uint32_t chunk = (uint32_t)EXTENT_CHUNK_INDEX(pos);
+        size_t n = EXTENT_CHUNK_SIZE - EXTENT_CHUNK_OFFSET(pos);
+        if (n > size - done) n = size - done;
+
+        /* The first copy from this snapshot on; none = the live bytes */
+        for (struct snapshot *s = snap; s; s = s->newer) {
+            const struct snapshot_file *f = file_find(s, inode);
+            if (!f) continue;
+            if (file_has(f, chunk)) {
+                memset(buf + done, 0, n);
+                if (extent_store_read(&f->pre, buf + done, n, pos) < 0) ret = -EIO;
+                break;
+            }
+            if (f->retired) {
+                memset(buf + done, 0, n);
+                break;
+            }
+        }
+        done += n;
+    }
+
+    pthread_rwlock_unlock(&set->lock);
+    return ret;
+}
+
+void snapshot_get_stats(struct snapshot_set *set, struct snapshot_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+
+    pthread_rwlock_rdlock(&set->lock);
+    stats->snapshots = set->count;
+    stats->lost = set->lost;
+    for (const struct snapshot *snap = set->newest; snap; snap = snap->older) {
+        for (uint32_t b = 0; b < SNAPSHOT_FILE_BUCKETS; b++) {
+            for (const struct snapshot_file *f = snap->files[b]; f; f = f->next) {
+                stats->files++;
+                stats->bytes += f->pre.data_bytes;
+                for (uint32_t c = 0; c < f->captured_bits; c++) {
+                    stats->chunks += file_has(f, c);
+                }
+            }
+        }
+    }
+    pthread_rwlock_unlock(&set->lock);
+}
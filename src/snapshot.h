@@ -0,0 +1,173 @@
+/**
+ * Snapshots - RAZORFS Point-in-Time Copies of Namespace and File Data
+ *
+ * A snapshot is a tree snapshot (see nary_snapshot_create_mt) plus the
+ * file data it needs, kept copy-on-write at chunk granularity:
+ * - Before a chunk of a file changes for the first time after the newest
+ *   snapshot was taken, its stored form (compressed or raw, or the fact
+ *   that it was a hole) is copied into that snapshot
+ * - An unlinked file hands all its chunks to the newest snapshot and is
+ *   marked retired there: chunks it did not capture read as zeros
+ * - A chunk of snapshot S is the first copy found from S towards newer
+ *   snapshots; without one the live chunk is still S's
+ * - Dropping a snapshot hands the copies the next older one still needs
+ *   to it, so any snapshot can go at any time
+ *
+ * Files created after the newest snapshot cost nothing. Snapshots live in
+ * memory only and are gone after a remount.
+ *
+ * Locking: `lock` covers the list and the copies. Writers take it (after
+ * their file's data_lock) only while snapshots exist; readers take it
+ * after copying the live range, so a copy made in between is what they
+ * may have read before the change.
+ */
+
+#ifndef RAZORFS_SNAPSHOT_H
+#define RAZORFS_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "extent_store.h"
+#include "nary_tree_mt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SNAPSHOT_NAME_MAX      255     /* As file names */
+#define SNAPSHOT_FILE_BUCKETS  256     /* Hash buckets of a snapshot's files */
+
+/**
+ * File data one snapshot saved
+ */
+struct snapshot_file {
+    uint32_t inode;
+    int retired;                 /* Unlinked since: chunks not captured are zeros */
+    uint8_t *captured;           /* Bit per chunk: saved in `pre` (or was a hole) */
+    uint32_t captured_bits;      /* Chunks the bitmap covers */
+    struct extent_store pre;     /* The saved chunks, as they were stored */
+    struct snapshot_file *next;  /* Hash chain */
+};
+
+/**
+ * One snapshot
+ */
+struct snapshot {
+    uint32_t id;                 /* Of the tree snapshot */
+    char name[SNAPSHOT_NAME_MAX + 1];
+    time_t created;
+    uint32_t inode_limit;        /* Files from this inode on came later */
+    struct snapshot_file *files[SNAPSHOT_FILE_BUCKETS];
+    struct snapshot *older;
+    struct snapshot *newer;
+};
+
+/**
+ * Statistics
+ */
+struct snapshot_stats {
+    uint32_t snapshots;          /* Held */
+    uint32_t files;              /* Files with saved chunks */
+    uint64_t chunks;             /* Chunks saved, holes included */
+    uint64_t bytes;              /* Heap held by saved chunks */
+    uint64_t lost;               /* Chunks a snapshot could not save */
+};
+
+/**
+ * All snapshots, newest first
+ */
+struct snapshot_set {
+    pthread_rwlock_t lock;       /* See the file comment */
+    struct snapshot *newest;
+    uint32_t count;
+    int active;                  /* newest != NULL (__atomic, read unlocked) */
+    uint64_t lost;               /* Under lock */
+};
+
+/* Whether writers have anything to save (cheap, no lock) */
+static inline int snapshot_set_active(const struct snapshot_set *set) {
+    return __atomic_load_n(&set->active, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Initialize an empty set
+ * @return 0 on success, -1 on failure
+ */
+int snapshot_set_init(struct snapshot_set *set);
+
+/**
+ * Free every snapshot's data (the tree's snapshots go with the tree)
+ */
+void snapshot_set_destroy(struct snapshot_set *set);
+
+/**
+ * Take a snapshot of the tree and start saving file data for it
+ *
+ * @param name Unique, non-empty, no '/', not "." or ".."
+ * @param id_out Receives the tree snapshot's id (may be NULL)
+ * @return 0, -EINVAL, -ENAMETOOLONG, -EEXIST, or what
+ *         nary_snapshot_create_mt() returns
+ */
+int snapshot_create(struct snapshot_set *set, struct nary_tree_mt *tree,
+                    const char *name, uint32_t *id_out);
+
+/**
+ * Drop a snapshot, in the tree as well
+ * @return 0 or -ENOENT
+ */
+int snapshot_delete(struct snapshot_set *set, struct nary_tree_mt *tree, const char *name);
+
+/**
+ * Tree snapshot id of a snapshot by name
+ * @return The id, or 0 if there is none of that name
+ */
+uint32_t snapshot_find(struct snapshot_set *set, const char *name);
+
+/**
+ * The pos-th snapshot, oldest first
+ * @param name_out SNAPSHOT_NAME_MAX + 1 bytes
+ * @return The tree snapshot id, or 0 past the last one
+ */
+uint32_t snapshot_get(struct snapshot_set *set, uint32_t pos, char *name_out,
+                      time_t *created_out);
+
+/**
+ * Save the chunks covering [offset, offset + length) of a live file
+ * before they change
+ * Only chunks the newest snapshot has not saved yet are copied. The
+ * caller holds the file's data_lock for writing, with the range faulted
+ * in; a chunk that cannot be saved is counted as lost and the change
+ * goes ahead.
+ */
+void snapshot_capture(struct snapshot_set *set, uint32_t inode,
+                      const struct extent_store *live, uint64_t offset, uint64_t length);
+
+/**
+ * Save everything of a file about to lose its data (unlinked or replaced)
+ * Same conditions as snapshot_capture(), for the whole file.
+ */
+void snapshot_retire(struct snapshot_set *set, uint32_t inode,
+                     const struct extent_store *live);
+
+/**
+ * Turn a copy of the live range [offset, offset + size) into snapshot
+ * id's contents of that range
+ * Call after copying the live bytes (zeros where the file has none).
+ *
+ * @return 0, -ENOENT if the snapshot is gone, or -EIO (corrupt copy)
+ */
+int snapshot_overlay(struct snapshot_set *set, uint32_t id, uint32_t inode,
+                     char *buf, size_t size, uint64_t offset);
+
+/**
+ * Current statistics
+ */
+void snapshot_get_stats(struct snapshot_set *set, struct snapshot_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_SNAPSHOT_H */
@@ -7,26 +7,248 @@
  */
 
 #include "string_table.h"
+#include "numa_support.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
 
-/* Configuration */
-#define STRING_TABLE_INITIAL_SIZE (64 * 1024)      /* 64KB initial */
-#define STRING_TABLE_MAX_SIZE (16 * 1024 * 1024)   /* 16MB maximum */
-#define MAX_FILENAME_LENGTH 255                     /* POSIX limit */
-
-/* Simple hash function (djb2) */
+/* djb2 with a final mix: the top bits pick the shard, the low bits the slot */
 static uint32_t hash_string(const char *str) {
     uint32_t hash = 5381;
     int c;
     while ((c = *str++)) {
         hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
     }
-    return hash % STRING_HASH_TABLE_SIZE;
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static inline struct string_shard *shard_of(const struct string_table *st, uint32_t hash) {
+    return &st->shards[(hash >> 24) % STRING_TABLE_SHARDS];
+}
+
+/* === Index === */
+
+static struct string_slot *alloc_slots(uint32_t count) {
+    struct string_slot *slots = malloc(count * sizeof(struct string_slot));
+    if (!slots) return NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i].offset = STRING_SLOT_EMPTY;
+    }
+    return slots;
+}
+
+/* Place an entry in a slot array known to have room */
+static void slots_put(struct string_slot *slots, uint32_t mask,
+                      uint32_t hash, uint32_t offset, uint32_t refs) {
+    uint32_t i = hash & mask;
+    while (slots[i].offset != STRING_SLOT_EMPTY) {
+        i = (i + 1) & mask;
+    }
+    slots[i].hash = hash;
+    slots[i].offset = offset;
+    slots[i].refs = refs;
+}
+
+/* Keep at least a quarter of the slots empty so probes stay short and end;
+ * rehashing also drops deleted slots (shard lock held) */
+static int shard_make_room(struct string_shard *shard) {
+    uint32_t count = shard->mask + 1;
+    if ((uint64_t)(shard->occupied + 1) * 4 <= (uint64_t)count * 3) {
+        return 0;
+    }
+
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (shard->slots[i].offset < STRING_SLOT_DELETED) live++;
+    }
+    uint32_t new_count = (uint64_t)(live + 1) * 2 > count ? count * 2 : count;
+    struct string_slot *slots = alloc_slots(new_count);
+    if (!slots) {
+        return shard->occupied + 1 < count ? 0 : -1;  /* Denser, still correct */
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct string_slot *s = &shard->slots[i];
+        if (s->offset < STRING_SLOT_DELETED) {
+            slots_put(slots, new_count - 1, s->hash, s->offset, s->refs);
+        }
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->mask = new_count - 1;
+    shard->occupied = live;
+    return 0;
+}
+
+/* Slot holding exactly this offset (shard lock held) */
+static struct string_slot *shard_find_offset(struct string_shard *shard,
+                                             uint32_t hash, uint32_t offset) {
+    for (uint32_t i = hash & shard->mask;; i = (i + 1) & shard->mask) {
+        struct string_slot *slot = &shard->slots[i];
+        if (slot->offset == STRING_SLOT_EMPTY) return NULL;
+        if (slot->offset == offset) return slot;
+    }
+}
+
+static int index_init(struct string_table *st) {
+    st->shards = calloc(STRING_TABLE_SHARDS, sizeof(struct string_shard));
+    st->free_lists = calloc(MAX_FILENAME_LENGTH + 2, sizeof(struct string_free_list));
+    if (!st->shards || !st->free_lists) {
+        free(st->shards);
+        free(st->free_lists);
+        st->shards = NULL;
+        st->free_lists = NULL;
+        return -1;
+    }
+
+    for (int i = 0; i < STRING_TABLE_SHARDS; i++) {
+        struct string_shard *shard = &st->shards[i];
+        shard->slots = alloc_slots(STRING_SHARD_INITIAL_SLOTS);
+        if (!shard->slots) {
+            while (--i >= 0) {
+                free(st->shards[i].slots);
+                pthread_mutex_destroy(&st->shards[i].lock);
+            }
+            free(st->shards);
+            free(st->free_lists);
+            st->shards = NULL;
+            st->free_lists = NULL;
+            return -1;
+        }
+        shard->mask = STRING_SHARD_INITIAL_SLOTS - 1;
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    pthread_mutex_init(&st->append_lock, NULL);
+    st->unreferenced_bytes = 0;
+    st->free_bytes = 0;
+    st->persisted = 0;
+    st->dirty_count = 0;
+    return 0;
+}
+
+/* Index every string stored from offset on, each one unreferenced
+ * (exclusive access; a torn last string is cut off) */
+static void index_strings(struct string_table *st, uint32_t offset) {
+    while (offset < st->used) {
+        const char *str = st->data + offset;
+        size_t len = strnlen(str, st->used - offset);
+        if (len == st->used - offset) {
+            st->used = offset;
+            break;
+        }
+
+        uint32_t hash = hash_string(str);
+        struct string_shard *shard = shard_of(st, hash);
+        if (shard_make_room(shard) != 0) {
+            break;  /* Later names stay readable, just not deduplicated */
+        }
+        slots_put(shard->slots, shard->mask, hash, offset, 0);
+        shard->occupied++;
+        st->unreferenced_bytes += len + 1;
+
+        offset += len + 1;
+    }
 }
 
+/* === Space === */
+
+/* Commit heap-mode buffer space up to at least size bytes (append_lock held) */
+static int commit_space(struct string_table *st, uint64_t size) {
+    if (size <= st->capacity) return 0;
+    if (st->is_shm || size > STRING_TABLE_MAX_SIZE) return -1;
+
+    uint64_t new_capacity = st->capacity;
+    while (new_capacity < size) {
+        new_capacity *= 2;
+    }
+    /* Whole huge pages when they are on */
+    uint64_t granule = numa_commit_granule();
+    new_capacity = (new_capacity + granule - 1) / granule * granule;
+    if (new_capacity > STRING_TABLE_MAX_SIZE) {
+        new_capacity = STRING_TABLE_MAX_SIZE;
+    }
+
+    if (numa_commit(st->data + st->capacity, new_capacity - st->capacity,
+                    NUMA_MEM_METADATA, -1) != 0) {
+        return -1;
+    }
+    st->capacity = (uint32_t)new_capacity;
+    return 0;
+}
+
+static void free_list_push(struct string_table *st, uint32_t offset, uint32_t size) {
+    struct string_free_list *list = &st->free_lists[size];
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 16;
+        uint32_t *offsets = realloc(list->offsets, capacity * sizeof(uint32_t));
+        if (!offsets) return;  /* Space stays unused */
+        list->offsets = offsets;
+        list->capacity = capacity;
+    }
+    list->offsets[list->count++] = offset;
+    __atomic_add_fetch(&st->free_bytes, size, __ATOMIC_RELAXED);
+}
+
+/* Store a string: in reclaimed space of its size or larger (the rest is
+ * kept for later), else at the end
+ * @return Offset, or UINT32_MAX when full */
+static uint32_t place_string(struct string_table *st, const char *str, uint32_t needed) {
+    pthread_mutex_lock(&st->append_lock);
+
+    for (uint32_t size = needed; size <= MAX_FILENAME_LENGTH + 1; size++) {
+        struct string_free_list *list = &st->free_lists[size];
+        if (list->count == 0) continue;
+
+        uint32_t offset = list->offsets[--list->count];
+        __atomic_sub_fetch(&st->free_bytes, size, __ATOMIC_RELAXED);
+        memcpy(st->data + offset, str, needed);
+        if (offset < st->persisted) {
+            /* Storage has the old name here; past the tracking limit just
+             * rewrite from this point on */
+            if (st->dirty_count < STRING_TABLE_DIRTY_MAX) {
+                st->dirty[st->dirty_count].offset = offset;
+                st->dirty[st->dirty_count].size = needed;
+                st->dirty_count++;
+            } else {
+                st->persisted = offset;
+            }
+        }
+        /* The remainder still ends in the old name's terminator */
+        if (size - needed >= 2) {
+            free_list_push(st, offset + needed, size - needed);
+        }
+        pthread_mutex_unlock(&st->append_lock);
+        return offset;
+    }
+
+    if (commit_space(st, (uint64_t)st->used + needed) != 0 ||
+        (uint64_t)st->used + needed > st->capacity) {
+        pthread_mutex_unlock(&st->append_lock);
+        return UINT32_MAX;  /* Table full */
+    }
+
+    uint32_t offset = st->used;
+    memcpy(st->data + offset, str, needed);
+    __atomic_store_n(&st->used, offset + needed, __ATOMIC_RELEASE);
+
+    /* Update shared memory header if in shm mode */
+    if (st->is_shm) {
+        uint32_t used = offset + needed;
+        memcpy(st->data, &used, sizeof(uint32_t));
+    }
+
+    pthread_mutex_unlock(&st->append_lock);
+    return offset;
+}
+
+/* === Lifecycle === */
+
 /**
  * Initialize string table (heap mode)
  * Returns 0 on success, -1 on failure
@@ -34,18 +256,28 @@ static uint32_t hash_string(const char *str) {
 int string_table_init(struct string_table *st) {
     if (!st) return -1;
 
-    st->data = malloc(STRING_TABLE_INITIAL_SIZE);
-    if (!st->data) {
+    /* Reserve the maximum so the buffer never moves under readers */
+    void *base = numa_reserve(STRING_TABLE_MAX_SIZE);
+    if (!base) {
+        return -1;
+    }
+    size_t initial = numa_commit_granule() > STRING_TABLE_INITIAL_SIZE ?
+                     numa_commit_granule() : STRING_TABLE_INITIAL_SIZE;
+    if (numa_commit(base, initial, NUMA_MEM_METADATA, -1) != 0) {
+        numa_release(base, STRING_TABLE_MAX_SIZE);
         return -1;
     }
 
-    st->capacity = STRING_TABLE_INITIAL_SIZE;
+    st->data = base;
+    st->capacity = (uint32_t)initial;
     st->used = 0;
     st->is_shm = 0;  /* Heap mode */
 
-    /* Initialize hash table */
-    for (int i = 0; i < STRING_HASH_TABLE_SIZE; i++) {
-        st->hash_table[i] = NULL;
+    if (index_init(st) != 0) {
+        numa_release(base, STRING_TABLE_MAX_SIZE);
+        st->data = NULL;
+        st->capacity = 0;
+        return -1;
     }
 
     return 0;
@@ -59,45 +291,73 @@ int string_table_init(struct string_table *st) {
  * Returns 0 on success, -1 on failure
  */
 int string_table_init_shm(struct string_table *st, void *buf, size_t size, int existing) {
-    if (!st || !buf || size == 0) return -1;
+    if (!st || !buf || size < sizeof(uint32_t) || size > STRING_TABLE_MAX_SIZE) return -1;
+
+    uint32_t used = sizeof(uint32_t);
+    if (existing) {
+        /* Attaching to existing - read used bytes from first uint32_t */
+        memcpy(&used, buf, sizeof(uint32_t));
+        if (used < sizeof(uint32_t) || used > size) {
+            return -1;
+        }
+    }
 
     st->data = (char *)buf;
     st->capacity = size;
+    st->used = used;
     st->is_shm = 1;  /* Shared memory mode */
 
-    /* Initialize hash table */
-    for (int i = 0; i < STRING_HASH_TABLE_SIZE; i++) {
-        st->hash_table[i] = NULL;
+    if (index_init(st) != 0) {
+        st->data = NULL;
+        return -1;
     }
 
     if (existing) {
-        /* Attaching to existing - read used bytes from first uint32_t */
-        memcpy(&st->used, buf, sizeof(uint32_t));
-
-        /* Rebuild hash table from existing strings */
-        uint32_t offset = sizeof(uint32_t);
-        while (offset < st->used) {
-            const char *str = st->data + offset;
-            uint32_t hash = hash_string(str);
-
-            struct string_hash_entry *entry = malloc(sizeof(struct string_hash_entry));
-            if (entry) {
-                entry->offset = offset;
-                entry->next = st->hash_table[hash];
-                st->hash_table[hash] = entry;
-            }
+        /* Rebuild the index from existing strings */
+        index_strings(st, sizeof(uint32_t));
+    }
+    /* New buffer starts with used = sizeof(uint32_t); a cut-off tail shrinks it */
+    memcpy(buf, &st->used, sizeof(uint32_t));
+
+    return 0;
+}
+
+int string_table_load(struct string_table *st, const char *buf, uint32_t used) {
+    if (!st || !buf || !st->shards || st->is_shm) return -1;
+
+    pthread_mutex_lock(&st->append_lock);
+    int ret = commit_space(st, used);
+    pthread_mutex_unlock(&st->append_lock);
+    if (ret != 0) {
+        return -1;
+    }
 
-            offset += strlen(str) + 1;
+    /* Forget what was there */
+    for (int i = 0; i < STRING_TABLE_SHARDS; i++) {
+        struct string_shard *shard = &st->shards[i];
+        for (uint32_t s = 0; s <= shard->mask; s++) {
+            shard->slots[s].offset = STRING_SLOT_EMPTY;
         }
-    } else {
-        /* New buffer - initialize with used = sizeof(uint32_t) */
-        st->used = sizeof(uint32_t);
-        memcpy(buf, &st->used, sizeof(uint32_t));
+        shard->occupied = 0;
     }
+    for (uint32_t size = 0; size <= MAX_FILENAME_LENGTH + 1; size++) {
+        st->free_lists[size].count = 0;
+    }
+    st->unreferenced_bytes = 0;
+    st->free_bytes = 0;
+
+    memcpy(st->data, buf, used);
+    st->used = used;
+    index_strings(st, 0);
 
+    /* It came from storage */
+    st->persisted = st->used;
+    st->dirty_count = 0;
     return 0;
 }
 
+/* === Interning and References === */
+
 /**
  * Intern a string - store and return offset
  * If string already exists, returns existing offset.
@@ -105,70 +365,147 @@ int string_table_init_shm(struct string_table *st, void *buf, size_t size, int e
  * Returns: offset on success, UINT32_MAX on error
  */
 uint32_t string_table_intern(struct string_table *st, const char *str) {
-    if (!st || !str) return UINT32_MAX;
+    if (!st || !str || !st->shards) return UINT32_MAX;
 
     size_t len = strlen(str);
     if (len > MAX_FILENAME_LENGTH) {
         return UINT32_MAX;
     }
+    uint32_t needed = (uint32_t)len + 1;  /* Include null terminator */
 
-    /* Calculate hash */
     uint32_t hash = hash_string(str);
+    struct string_shard *shard = shard_of(st, hash);
+    pthread_mutex_lock(&shard->lock);
 
-    /* Check if string already exists using hash table */
-    struct string_hash_entry *entry = st->hash_table[hash];
-    while (entry) {
-        const char *existing = st->data + entry->offset;
-        if (strcmp(existing, str) == 0) {
-            return entry->offset;  /* Found duplicate */
+    if (shard_make_room(shard) != 0) {
+        pthread_mutex_unlock(&shard->lock);
+        return UINT32_MAX;
+    }
+
+    /* Existing entry, or the first reusable slot on the probe path */
+    struct string_slot *target = NULL;
+    for (uint32_t i = hash & shard->mask;; i = (i + 1) & shard->mask) {
+        struct string_slot *slot = &shard->slots[i];
+        if (slot->offset == STRING_SLOT_EMPTY) {
+            if (!target) target = slot;
+            break;
+        }
+        if (slot->offset == STRING_SLOT_DELETED) {
+            if (!target) target = slot;
+            continue;
+        }
+        if (slot->hash == hash && strcmp(st->data + slot->offset, str) == 0) {
+            if (slot->refs++ == 0) {
+                __atomic_sub_fetch(&st->unreferenced_bytes, needed, __ATOMIC_RELAXED);
+            }
+            uint32_t offset = slot->offset;
+            pthread_mutex_unlock(&shard->lock);
+            return offset;  /* Found duplicate */
         }
-        entry = entry->next;
     }
 
     /* String not found - add it */
-    size_t needed = len + 1;  /* Include null terminator */
-
-    /* Grow buffer if needed (heap mode only) */
-    if (st->used + needed > st->capacity) {
-        if (st->is_shm) {
-            /* Shared memory mode - cannot grow, table full */
-            return UINT32_MAX;
+    uint32_t offset = place_string(st, str, needed);
+    if (offset != UINT32_MAX) {
+        if (target->offset == STRING_SLOT_EMPTY) {
+            shard->occupied++;
         }
+        target->hash = hash;
+        target->offset = offset;
+        target->refs = 1;
+    }
 
-        /* Heap mode - can realloc */
-        uint32_t new_capacity = st->capacity * 2;
-        if (new_capacity > STRING_TABLE_MAX_SIZE) {
-            return UINT32_MAX;  /* Table full */
-        }
+    pthread_mutex_unlock(&shard->lock);
+    return offset;
+}
 
-        char *new_data = realloc(st->data, new_capacity);
-        if (!new_data) {
-            return UINT32_MAX;
-        }
+/* Count a reference up or down (delta +1 / -1) */
+static int adjust_refs(struct string_table *st, uint32_t offset, int delta) {
+    const char *str = string_table_get(st, offset);
+    if (!str || !st->shards) return -1;
 
-        st->data = new_data;
-        st->capacity = new_capacity;
+    uint32_t hash = hash_string(str);
+    uint32_t size = (uint32_t)strlen(str) + 1;
+    struct string_shard *shard = shard_of(st, hash);
+    pthread_mutex_lock(&shard->lock);
+
+    struct string_slot *slot = shard_find_offset(shard, hash, offset);
+    if (!slot || (delta < 0 && slot->refs == 0)) {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    if (delta > 0) {
+        if (slot->refs++ == 0) {
+            __atomic_sub_fetch(&st->unreferenced_bytes, size, __ATOMIC_RELAXED);
+        }
+    } else if (--slot->refs == 0) {
+        __atomic_add_fetch(&st->unreferenced_bytes, size, __ATOMIC_RELAXED);
     }
 
-    /* Copy string to buffer */
-    uint32_t new_offset = st->used;
-    memcpy(st->data + new_offset, str, needed);
-    st->used += needed;
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+int string_table_ref(struct string_table *st, uint32_t offset) {
+    return adjust_refs(st, offset, +1);
+}
+
+void string_table_release(struct string_table *st, uint32_t offset) {
+    adjust_refs(st, offset, -1);
+}
 
-    /* Add to hash table */
-    struct string_hash_entry *new_entry = malloc(sizeof(struct string_hash_entry));
-    if (new_entry) {
-        new_entry->offset = new_offset;
-        new_entry->next = st->hash_table[hash];
-        st->hash_table[hash] = new_entry;
+uint32_t string_table_reclaim(struct string_table *st) {
+    if (!st || !st->shards) return 0;
+
+    uint32_t reclaimed = 0;
+    for (int i = 0; i < STRING_TABLE_SHARDS; i++) {
+        struct string_shard *shard = &st->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        for (uint32_t s = 0; s <= shard->mask; s++) {
+            struct string_slot *slot = &shard->slots[s];
+            if (slot->offset >= STRING_SLOT_DELETED || slot->refs > 0) continue;
+
+            uint32_t size = (uint32_t)strlen(st->data + slot->offset) + 1;
+            if (size >= 2) {  /* An empty name's byte is not worth keeping */
+                pthread_mutex_lock(&st->append_lock);
+                free_list_push(st, slot->offset, size);
+                pthread_mutex_unlock(&st->append_lock);
+            }
+            __atomic_sub_fetch(&st->unreferenced_bytes, size, __ATOMIC_RELAXED);
+            slot->offset = STRING_SLOT_DELETED;
+            reclaimed += size;
+        }
+        pthread_mutex_unlock(&shard->lock);
     }
+    return reclaimed;
+}
 
-    /* Update shared memory header if in shm mode */
-    if (st->is_shm) {
-        memcpy(st->data, &st->used, sizeof(uint32_t));
+int string_table_flush(struct string_table *st, int full,
+                       string_table_write_fn write, void *ctx, uint32_t *used_out) {
+    if (!st || !write || !st->shards) return -1;
+
+    pthread_mutex_lock(&st->append_lock);
+    uint32_t from = full ? 0 : st->persisted;
+    uint32_t used = st->used;
+    int ret = 0;
+
+    for (uint32_t i = 0; i < st->dirty_count && ret == 0; i++) {
+        const struct string_range *r = &st->dirty[i];
+        if (r->offset < from) {
+            ret = write(ctx, r->offset, st->data + r->offset, r->size);
+        }
+    }
+    if (ret == 0 && used > from) {
+        ret = write(ctx, from, st->data + from, used - from);
+    }
+    if (ret == 0) {
+        st->persisted = used;
+        st->dirty_count = 0;
+        if (used_out) *used_out = used;
     }
 
-    return new_offset;
+    pthread_mutex_unlock(&st->append_lock);
+    return ret;
 }
 
 /**
@@ -176,7 +513,7 @@ uint32_t string_table_intern(struct string_table *st, const char *str) {
  * Returns: pointer to string, or NULL if invalid offset
  */
 const char *string_table_get(const struct string_table *st, uint32_t offset) {
-    if (!st || offset >= st->used) {
+    if (!st || offset >= __atomic_load_n(&st->used, __ATOMIC_ACQUIRE)) {
         return NULL;
     }
     return st->data + offset;
@@ -189,26 +526,33 @@ const char *string_table_get(const struct string_table *st, uint32_t offset) {
 void string_table_destroy(struct string_table *st) {
     if (!st) return;
 
-    /* Free hash table entries */
-    for (int i = 0; i < STRING_HASH_TABLE_SIZE; i++) {
-        struct string_hash_entry *entry = st->hash_table[i];
-        while (entry) {
-            struct string_hash_entry *next = entry->next;
-            free(entry);
-            entry = next;
+    /* Free the index */
+    if (st->shards) {
+        for (int i = 0; i < STRING_TABLE_SHARDS; i++) {
+            free(st->shards[i].slots);
+            pthread_mutex_destroy(&st->shards[i].lock);
+        }
+        for (uint32_t size = 0; size <= MAX_FILENAME_LENGTH + 1; size++) {
+            free(st->free_lists[size].offsets);
         }
-        st->hash_table[i] = NULL;
+        pthread_mutex_destroy(&st->append_lock);
+        free(st->shards);
+        free(st->free_lists);
+        st->shards = NULL;
+        st->free_lists = NULL;
     }
 
     if (st->data && !st->is_shm) {
-        /* Only free if heap mode */
-        free(st->data);
+        /* Only unmap if heap mode */
+        numa_release(st->data, STRING_TABLE_MAX_SIZE);
     }
 
     st->data = NULL;
     st->capacity = 0;
     st->used = 0;
     st->is_shm = 0;
+    st->unreferenced_bytes = 0;
+    st->free_bytes = 0;
 }
 
 /**
@@ -224,4 +568,4 @@ void string_table_stats(const struct string_table *st,
 
     if (total_size) *total_size = st->capacity;
     if (used_size) *used_size = st->used;
-}
\ No newline at end of file
+}
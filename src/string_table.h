@@ -8,6 +8,10 @@
  * - Cache-friendly: strings stored contiguously
  * - Space-efficient: duplicate names stored once
  * - Fast comparison: offset equality check
+ * - Thread-safe: interning is striped over STRING_TABLE_SHARDS locks,
+ *   reads take no lock at all (the buffer never moves)
+ * - Reclaimable: names are reference counted, unreferenced space is
+ *   handed out again after string_table_reclaim()
  */
 
 #ifndef RAZORFS_STRING_TABLE_H
@@ -15,37 +19,100 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* Configuration */
 #define STRING_TABLE_INITIAL_SIZE (64 * 1024)      /* 64KB initial */
-#define STRING_TABLE_MAX_SIZE (16 * 1024 * 1024)   /* 16MB maximum */
+#define STRING_TABLE_MAX_SIZE (16 * 1024 * 1024)   /* 16MB maximum (address space reserved up front) */
 #define MAX_FILENAME_LENGTH 255                     /* POSIX limit */
-#define STRING_HASH_TABLE_SIZE 1024                 /* Hash table buckets */
+#define STRING_TABLE_SHARDS 16                      /* Independently locked parts of the index */
+#define STRING_SHARD_INITIAL_SLOTS 256              /* Open-addressing slots per shard (power of two) */
+#define STRING_TABLE_DIRTY_MAX 64                   /* Reused ranges tracked for persistence */
 
 /**
- * Hash table entry for fast string lookup
+ * Index slot: one interned string
+ * offset is STRING_SLOT_EMPTY for a never used slot and
+ * STRING_SLOT_DELETED for a reclaimed one (probing continues past it).
  */
-struct string_hash_entry {
+#define STRING_SLOT_EMPTY   UINT32_MAX
+#define STRING_SLOT_DELETED (UINT32_MAX - 1)
+
+struct string_slot {
+    uint32_t hash;                          /* Full 32-bit hash of the string */
     uint32_t offset;                        /* Offset in string buffer */
-    struct string_hash_entry *next;         /* Next entry in chain */
+    uint32_t refs;                          /* Nodes using this name */
+};
+
+/**
+ * One part of the string -> offset index
+ * A string lives in the shard picked by the top bits of its hash.
+ */
+struct string_shard {
+    pthread_mutex_t lock;
+    struct string_slot *slots;
+    uint32_t mask;                          /* Slot count - 1 */
+    uint32_t occupied;                      /* Live and deleted slots */
+} __attribute__((aligned(64)));
+
+/**
+ * Reclaimed space of one size (name length + 1)
+ */
+struct string_free_list {
+    uint32_t *offsets;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+/**
+ * Bytes of the buffer
+ */
+struct string_range {
+    uint32_t offset;
+    uint32_t size;
 };
 
+/**
+ * Writes one range of the buffer to persistent storage
+ * (data is the buffer at offset). Returns 0 on success, -1 on failure.
+ */
+typedef int (*string_table_write_fn)(void *ctx, uint32_t offset, const char *data, uint32_t size);
+
 /**
  * String Table Structure
  *
- * Design: contiguous buffer of null-terminated strings with hash table for fast lookup.
- * Hash table maps string -> offset for O(1) duplicate detection.
+ * Design: contiguous buffer of null-terminated strings with a sharded
+ * open-addressing hash index for O(1) duplicate detection.
  *
  * Two modes:
- * 1. Heap mode (is_shm = 0): data allocated with malloc/realloc
+ * 1. Heap mode (is_shm = 0): STRING_TABLE_MAX_SIZE of address space is
+ *    reserved at init and committed as the table grows, so data never moves
  * 2. Shared memory mode (is_shm = 1): data points to fixed-size shared memory
+ *
+ * Offsets below used always hold complete strings. Appending (and reusing
+ * reclaimed space) is serialized by append_lock, which is taken after a
+ * shard lock, never before.
  */
 struct string_table {
     char *data;                             /* Contiguous string buffer */
-    uint32_t capacity;                      /* Total allocated size */
+    uint32_t capacity;                      /* Committed size */
     uint32_t used;                          /* Bytes currently used */
     int is_shm;                             /* 1 if backed by shared memory, 0 if heap */
-    struct string_hash_entry *hash_table[STRING_HASH_TABLE_SIZE];  /* Hash table for lookups */
+
+    struct string_shard *shards;            /* STRING_TABLE_SHARDS (NULL = not initialized) */
+    pthread_mutex_t append_lock;            /* used, capacity and free lists */
+    struct string_free_list *free_lists;    /* Indexed by size, 2..MAX_FILENAME_LENGTH + 1 */
+    uint32_t unreferenced_bytes;            /* Interned names no node uses */
+    uint32_t free_bytes;                    /* Reclaimed space waiting for reuse */
+
+    /* Persistence (string_table_flush): storage holds [0, persisted) except
+     * the reused ranges in dirty */
+    uint32_t persisted;
+    struct string_range dirty[STRING_TABLE_DIRTY_MAX];
+    uint32_t dirty_count;
 };
 
 /**
@@ -63,14 +130,60 @@ int string_table_init(struct string_table *st);
  */
 int string_table_init_shm(struct string_table *st, void *buf, size_t size, int existing);
 
+/**
+ * Replace the contents of a heap-mode table with saved strings
+ * (indexed again, every name unreferenced until counted)
+ * Returns 0 on success, -1 if it does not fit or the table is in shm mode
+ */
+int string_table_load(struct string_table *st, const char *buf, uint32_t used);
+
 /**
  * Intern a string - store and return offset
  * If string already exists, returns existing offset.
+ * Either way the name gains a reference (see string_table_release).
  *
  * Returns: offset on success, UINT32_MAX on error
  */
 uint32_t string_table_intern(struct string_table *st, const char *str);
 
+/**
+ * Add a reference to an interned name (counting the users of a
+ * restored table)
+ * Returns 0 on success, -1 if offset is not an interned name
+ */
+int string_table_ref(struct string_table *st, uint32_t offset);
+
+/**
+ * Drop a reference; an unreferenced name stays interned (and is found
+ * again by string_table_intern) until string_table_reclaim
+ */
+void string_table_release(struct string_table *st, uint32_t offset);
+
+/**
+ * Make the space of every unreferenced name available to new names
+ *
+ * Only call this once nothing can refer to those offsets any more:
+ * every user holds a counted reference and the WAL holds no records
+ * naming them.
+ *
+ * Returns: bytes reclaimed
+ */
+uint32_t string_table_reclaim(struct string_table *st);
+
+/**
+ * Write what changed since the last flush: reused ranges, then the bytes
+ * appended after the persisted watermark
+ *
+ * Interning waits while this runs, so write() should only queue or
+ * write, not sync.
+ *
+ * @param full Write everything (storage lost or new)
+ * @param used_out Bytes now persisted, for the caller's header
+ * @return 0 on success, -1 if a write failed (retried by the next flush)
+ */
+int string_table_flush(struct string_table *st, int full,
+                       string_table_write_fn write, void *ctx, uint32_t *used_out);
+
 /**
  * Get string by offset
  * Returns: pointer to string, or NULL if invalid offset
@@ -89,4 +202,8 @@ void string_table_stats(const struct string_table *st,
                         uint32_t *total_size,
                         uint32_t *used_size) __attribute__((unused));
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* RAZORFS_STRING_TABLE_H */
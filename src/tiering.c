@@ -0,0 +1,582 @@
+/**
+ * Tiered Storage Implementation - RAZORFS Cold File Offload
+ */
+
+#define _GNU_SOURCE
+#include "tiering.h"
+#include "crc32c.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+void tier_object_key(uint32_t inode, char *key, size_t len) {
+    snprintf(key, len, "razorfs-%u.obj", inode);
+}
+
+/* === Directory Backend === */
+
+struct tier_dir {
+    char path[256];
+};
+
+static void dir_object_path(const struct tier_dir *dir, const char *key,
+                            const char *suffix, char *out, size_t len) {
+    snprintf(out, len, "%s/%s%s", dir->path, key, suffix);
+}
+
+static int dir_put(void *ctx, const char *key, const void *data, size_t size) {
+    char tmp[512], path[512];
+    dir_object_path(ctx, key, ".tmp", tmp, sizeof(tmp));
+    dir_object_path(ctx, key, "", path, sizeof(path));
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+
+    const char *p = data;
+    size_t left = size;
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        left -= (size_t)n;
+    }
+
+    /* Whole and durable before it replaces an older copy */
+    int ret = left == 0 && fsync(fd) == 0 ? 0 : -1;
+    close(fd);
+    if (ret == 0 && rename(tmp, path) != 0) ret = -1;
+    if (ret != 0) unlink(tmp);
+    return ret;
+}
+
+static int dir_get(void *ctx, const char *key, void **data_out, size_t *size_out) {
+    char path[512];
+    dir_object_path(ctx, key, "", path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    char *buf = NULL;
+    if (fstat(fd, &st) != 0 || !(buf = malloc(st.st_size ? (size_t)st.st_size : 1))) {
+        close(fd);
+        return -1;
+    }
+
+    size_t got = 0;
+    while (got < (size_t)st.st_size) {
+        ssize_t n = pread(fd, buf + got, (size_t)st.st_size - got, (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+
+    if (got != (size_t)st.st_size) {
+        free(buf);
+        return -1;
+    }
+    *data_out = buf;
+    *size_out = got;
+    return 0;
+}
+
+static int dir_remove(void *ctx, const char *key) {
+    char path[512];
+    dir_object_path(ctx, key, "", path, sizeof(path));
+    return unlink(path) == 0 || errno == ENOENT ? 0 : -1;
+}
+
+int tier_backend_dir(struct tier_backend *backend, const char *dir) {
+    if (!backend || !dir) return -1;
+
+    struct tier_dir *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) return -1;
+    if (strlen(dir) >= sizeof(ctx->path) ||
+        (mkdir(dir, 0700) != 0 && errno != EEXIST)) {
+        free(ctx);
+        return -1;
+    }
+    strcpy(ctx->path, dir);
+
+    backend->put = dir_put;
+    backend->get = dir_get;
+    backend->remove = dir_remove;
+    backend->remove_many = NULL;
+    backend->release = free;
+    backend->ctx = ctx;
+    return 0;
+}
+
+/* === Read Cache (cache_lock held) === */
+
+static void cache_path(const struct tier *t, uint32_t inode, char *out, size_t len) {
+    snprintf(out, len, "%s/%u", t->cache_dir, inode);
+}
+
+static struct tier_cache_entry *cache_find(struct tier *t, uint32_t inode) {
+    struct tier_cache_entry *e = t->cache;
+    while (e && e->inode != inode) {
+        e = e->next;
+    }
+    return e;
+}
+
+static void cache_drop(struct tier *t, uint32_t inode) {
+    struct tier_cache_entry **link = &t->cache;
+    while (*link && (*link)->inode != inode) {
+        link = &(*link)->next;
+    }
+
+    struct tier_cache_entry *e = *link;
+    if (!e) return;
+
+    char path[512];
+    cache_path(t, inode, path, sizeof(path));
+    unlink(path);  /* Readers that opened it keep their copy */
+
+    *link = e->next;
+    t->cache_used -= e->bytes;
+    free(e);
+}
+
+/* Evict least recently used objects until `need` more bytes fit */
+static void cache_make_room(struct tier *t, uint64_t need) {
+    while (t->cache && t->cache_used + need > t->cache_limit) {
+        struct tier_cache_entry *oldest = t->cache;
+        for (struct tier_cache_entry *e = t->cache->next; e; e = e->next) {
+            if (e->last_use < oldest->last_use) oldest = e;
+        }
+        cache_drop(t, oldest->inode);
+    }
+}
+
+/* Empty the cache directory (contents of an earlier mount may be stale) */
+static void cache_clear_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return;
+
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.') continue;
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+/* Read from the cached copy; 1 if the object is not cached */
+static int cache_read(struct tier *t, uint32_t inode, uint64_t offset, uint32_t size,
+                      void *buf) {
+    pthread_mutex_lock(&t->cache_lock);
+    struct tier_cache_entry *e = cache_find(t, inode);
+    if (!e || offset + size > e->bytes) {
+        pthread_mutex_unlock(&t->cache_lock);
+        return 1;
+    }
+    e->last_use = ++t->cache_clock;
+
+    char path[512];
+    cache_path(t, inode, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    pthread_mutex_unlock(&t->cache_lock);
+    if (fd < 0) return 1;
+
+    ssize_t n = pread(fd, buf, size, (off_t)offset);
+    close(fd);
+    return n == (ssize_t)size ? 0 : 1;
+}
+
+/* Keep a fetched object; failing to is not an error */
+static void cache_insert(struct tier *t, uint32_t inode, const void *data, size_t size) {
+    if (size > t->cache_limit) return;
+
+    char path[512], tmp[520];
+    cache_path(t, inode, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return;
+    ssize_t n = write(fd, data, size);
+    close(fd);
+    if (n != (ssize_t)size) {
+        unlink(tmp);
+        return;
+    }
+
+    struct tier_cache_entry *e = calloc(1, sizeof(*e));
+    if (!e) {
+        unlink(tmp);
+        return;
+    }
+
+    pthread_mutex_lock(&t->cache_lock);
+    cache_drop(t, inode);  /* A racing fetch of the same object */
+    cache_make_room(t, size);
+    if (rename(tmp, path) != 0) {
+        pthread_mutex_unlock(&t->cache_lock);
+        unlink(tmp);
+        free(e);
+        return;
+    }
+    e->inode = inode;
+    e->bytes = size;
+    e->last_use = ++t->cache_clock;
+    e->next = t->cache;
+    t->cache = e;
+    t->cache_used += size;
+    pthread_mutex_unlock(&t->cache_lock);
+}
+
+/* === Objects === */
+
+/* Download and check an object */
+static int fetch_object(struct tier *t, uint32_t inode, void **data_out, size_t *size_out) {
+    char key[TIER_KEY_MAX];
+    tier_object_key(inode, key, sizeof(key));
+
+    void *data = NULL;
+    size_t size = 0;
+    if (t->backend.get(t->backend.ctx, key, &data, &size) != 0) {
+        fprintf(stderr, "Tier: cannot fetch %s\n", key);
+        return -1;
+    }
+
+    const struct tier_object_header *hdr = data;
+    if (size < sizeof(*hdr) || hdr->magic != TIER_OBJECT_MAGIC || hdr->inode != inode ||
+        hdr->payload_len != size - sizeof(*hdr) ||
+        crc32c(0, hdr + 1, hdr->payload_len) != hdr->crc) {
+        fprintf(stderr, "Tier: object %s is corrupt\n", key);
+        free(data);
+        return -1;
+    }
+
+    __atomic_fetch_add(&t->stats.fetches, 1, __ATOMIC_RELAXED);
+    *data_out = data;
+    *size_out = size;
+    return 0;
+}
+
+int tier_read(struct tier *t, uint32_t inode, uint64_t offset, uint32_t size, void *buf) {
+    if (!t || !buf || offset < sizeof(struct tier_object_header)) return -1;
+
+    __atomic_fetch_add(&t->stats.remote_reads, 1, __ATOMIC_RELAXED);
+    if (cache_read(t, inode, offset, size, buf) == 0) {
+        __atomic_fetch_add(&t->stats.cache_hits, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    void *data;
+    size_t len;
+    if (fetch_object(t, inode, &data, &len) != 0) return -1;
+
+    int ret = -1;
+    if (offset + size <= len) {
+        memcpy(buf, (const char *)data + offset, size);
+        ret = 0;
+    }
+    cache_insert(t, inode, data, len);
+    free(data);
+    return ret;
+}
+
+int tier_offload(struct tier *t, uint32_t inode) {
+    if (!t) return -1;
+
+    struct data_log_chunk_ref *refs = NULL;
+    uint32_t count = 0;
+    char *payload = NULL;
+    uint64_t payload_len = 0;
+    int ret = data_log_export(t->log, inode, &refs, &count, &payload, &payload_len);
+    if (ret != 0) {
+        return ret > 0 ? 0 : -1;  /* Not in the log or already remote */
+    }
+    if (count == 0) {
+        free(refs);
+        free(payload);
+        return 0;  /* All holes */
+    }
+
+    struct tier_object_header hdr = {
+        .magic = TIER_OBJECT_MAGIC,
+        .inode = inode,
+        .payload_len = payload_len,
+        .crc = crc32c(0, payload, payload_len),
+    };
+    size_t size = sizeof(hdr) + payload_len;
+    char *object = malloc(size);
+    struct data_log_put *puts = calloc(count, sizeof(*puts));
+    if (!object || !puts) {
+        ret = -1;
+        goto out;
+    }
+    memcpy(object, &hdr, sizeof(hdr));
+    memcpy(object + sizeof(hdr), payload, payload_len);
+
+    /* The chunks sit in the object in the order they were exported */
+    uint64_t pos = sizeof(hdr);
+    for (uint32_t i = 0; i < count; i++) {
+        puts[i].idx = refs[i].idx;
+        puts[i].raw_size = refs[i].raw_size;
+        puts[i].stored_size = refs[i].stored_size;
+        puts[i].flags = DATA_LOG_CHUNK_REMOTE;
+        puts[i].offset = pos;
+        pos += refs[i].stored_size;
+    }
+
+    /* A cached copy of an older object is stale from here on */
+    pthread_mutex_lock(&t->cache_lock);
+    cache_drop(t, inode);
+    pthread_mutex_unlock(&t->cache_lock);
+
+    char key[TIER_KEY_MAX];
+    tier_object_key(inode, key, sizeof(key));
+    if (t->backend.put(t->backend.ctx, key, object, size) != 0) {
+        fprintf(stderr, "Tier: cannot upload %s\n", key);
+        ret = -1;
+        goto out;
+    }
+
+    /* Chunks rewritten during the upload stay local */
+    ret = data_log_swap(t->log, inode, refs, puts, count);
+    if (ret > 0) {
+        uint64_t moved = 0;
+        for (uint32_t i = 0; i < count; i++) moved += refs[i].stored_size;
+        __atomic_fetch_add(&t->stats.offloaded_files, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&t->stats.offloaded_bytes, moved, __ATOMIC_RELAXED);
+    } else if (ret == 0) {
+        t->backend.remove(t->backend.ctx, key);  /* Nothing refers to it */
+    }
+
+out:
+    free(puts);
+    free(object);
+    free(refs);
+    free(payload);
+    return ret;
+}
+
+void tier_forget(struct tier *t, uint32_t inode) {
+    if (!t) return;
+
+    pthread_mutex_lock(&t->cache_lock);
+    cache_drop(t, inode);
+    pthread_mutex_unlock(&t->cache_lock);
+
+    pthread_mutex_lock(&t->lock);
+    if (t->forgotten_count == t->forgotten_capacity) {
+        uint32_t capacity = t->forgotten_capacity ? t->forgotten_capacity * 2 : 64;
+        uint32_t *grown = realloc(t->forgotten, capacity * sizeof(*grown));
+        if (!grown) {
+            pthread_mutex_unlock(&t->lock);
+            return;  /* The object leaks in the tier, the file is gone anyway */
+        }
+        t->forgotten = grown;
+        t->forgotten_capacity = capacity;
+    }
+    t->forgotten[t->forgotten_count++] = inode;
+    pthread_mutex_unlock(&t->lock);
+}
+
+/* Delete the objects of deleted files */
+static void delete_forgotten(struct tier *t) {
+    pthread_mutex_lock(&t->lock);
+    uint32_t *inodes = t->forgotten;
+    uint32_t count = t->forgotten_count;
+    t->forgotten = NULL;
+    t->forgotten_count = 0;
+    t->forgotten_capacity = 0;
+    pthread_mutex_unlock(&t->lock);
+
+    /* Batched if the backend can (a directory of offloaded files is
+     * deleted in a handful of requests) */
+    char (*keys)[TIER_KEY_MAX] = t->backend.remove_many && count > 1 ?
+                                 malloc(count * sizeof(*keys)) : NULL;
+    const char **list = keys ? malloc(count * sizeof(*list)) : NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        char key[TIER_KEY_MAX];
+        tier_object_key(inodes[i], list ? keys[i] : key, TIER_KEY_MAX);
+        if (list) {
+            list[i] = keys[i];
+        } else {
+            t->backend.remove(t->backend.ctx, key);
+        }
+    }
+    if (list) t->backend.remove_many(t->backend.ctx, list, count);
+
+    free(list);
+    free(keys);
+    free(inodes);
+}
+
+/* === Scanner === */
+
+struct scan_candidates {
+    uint64_t min_bytes;
+    uint32_t *inodes;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static void collect_candidate(void *ctx, uint32_t inode, uint64_t size) {
+    struct scan_candidates *c = ctx;
+    if (size < c->min_bytes) return;
+
+    if (c->count == c->capacity) {
+        uint32_t capacity = c->capacity ? c->capacity * 2 : 256;
+        uint32_t *grown = realloc(c->inodes, capacity * sizeof(*grown));
+        if (!grown) return;  /* Picked up by a later scan */
+        c->inodes = grown;
+        c->capacity = capacity;
+    }
+    c->inodes[c->count++] = inode;
+}
+
+uint32_t tier_scan(struct tier *t) {
+    if (!t) return 0;
+
+    delete_forgotten(t);
+
+    /* Listed under the log's index lock, offloaded after it is dropped */
+    struct scan_candidates c = { .min_bytes = t->min_bytes };
+    data_log_for_each(t->log, collect_candidate, &c);
+
+    time_t cutoff = time(NULL) - (time_t)t->cold_s;
+    uint32_t offloaded = 0;
+    for (uint32_t i = 0; i < c.count; i++) {
+        uint32_t inode = c.inodes[i];
+        if (data_log_has_remote(t->log, inode)) continue;
+        if (t->is_cold && !t->is_cold(t->cold_ctx, inode, cutoff)) continue;
+        if (tier_offload(t, inode) > 0) offloaded++;
+    }
+    free(c.inodes);
+    return offloaded;
+}
+
+static void *tier_main(void *arg) {
+    struct tier *t = arg;
+
+    pthread_mutex_lock(&t->lock);
+    while (t->running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += (time_t)(t->scan_ms / 1000);
+        deadline.tv_nsec += (long)(t->scan_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&t->wake, &t->lock, &deadline);
+        if (!t->running) break;
+
+        pthread_mutex_unlock(&t->lock);
+        uint32_t n = tier_scan(t);
+        if (n > 0) {
+            printf("🧊 Tier: offloaded %u cold file(s)\n", n);
+        }
+        pthread_mutex_lock(&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+
+    return NULL;
+}
+
+/* === Lifecycle === */
+
+int tier_init(struct tier *t, const struct tier_config *cfg,
+              const struct tier_backend *backend, struct data_log *log,
+              tier_is_cold_fn is_cold, void *cold_ctx) {
+    if (!t || !cfg || !backend || !log || !cfg->cache_dir ||
+        strlen(cfg->cache_dir) >= sizeof(t->cache_dir)) {
+        if (backend && backend->release) backend->release(backend->ctx);
+        return -1;
+    }
+
+    memset(t, 0, sizeof(*t));
+    t->backend = *backend;
+    t->log = log;
+    t->is_cold = is_cold;
+    t->cold_ctx = cold_ctx;
+    t->cold_s = cfg->cold_s;
+    t->scan_ms = cfg->scan_ms;
+    t->min_bytes = cfg->min_bytes;
+    t->cache_limit = cfg->cache_bytes;
+    strcpy(t->cache_dir, cfg->cache_dir);
+
+    if (mkdir(t->cache_dir, 0700) != 0 && errno != EEXIST) {
+        perror("mkdir (tier cache)");
+        if (backend->release) backend->release(backend->ctx);
+        return -1;
+    }
+    cache_clear_dir(t->cache_dir);
+
+    pthread_mutex_init(&t->cache_lock, NULL);
+    pthread_mutex_init(&t->lock, NULL);
+
+    /* Deadlines are computed on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&t->wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (t->scan_ms > 0) {
+        t->running = 1;
+        if (pthread_create(&t->thread, NULL, tier_main, t) != 0) {
+            t->running = 0;
+            tier_destroy(t);
+            return -1;
+        }
+        t->started = 1;
+    }
+    return 0;
+}
+
+void tier_destroy(struct tier *t) {
+    if (!t || !t->backend.put) return;
+
+    if (t->started) {
+        pthread_mutex_lock(&t->lock);
+        t->running = 0;
+        pthread_cond_broadcast(&t->wake);
+        pthread_mutex_unlock(&t->lock);
+
+        pthread_join(t->thread, NULL);
+        t->started = 0;
+    }
+
+    delete_forgotten(t);
+
+    while (t->cache) {
+        struct tier_cache_entry *next = t->cache->next;
+        free(t->cache);
+        t->cache = next;
+    }
+    cache_clear_dir(t->cache_dir);
+
+    if (t->backend.release) t->backend.release(t->backend.ctx);
+    memset(&t->backend, 0, sizeof(t->backend));
+
+    pthread_cond_destroy(&t->wake);
+    pthread_mutex_destroy(&t->lock);
+    pthread_mutex_destroy(&t->cache_lock);
+}
+
+void tier_get_stats(struct tier *t, struct tier_stats *stats) {
+    if (!t || !stats) return;
+
+    stats->offloaded_files = __atomic_load_n(&t->stats.offloaded_files, __ATOMIC_RELAXED);
+    stats->offloaded_bytes = __atomic_load_n(&t->stats.offloaded_bytes, __ATOMIC_RELAXED);
+    stats->remote_reads = __atomic_load_n(&t->stats.remote_reads, __ATOMIC_RELAXED);
+    stats->cache_hits = __atomic_load_n(&t->stats.cache_hits, __ATOMIC_RELAXED);
+    stats->fetches = __atomic_load_n(&t->stats.fetches, __ATOMIC_RELAXED);
+}
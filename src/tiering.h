@@ -0,0 +1,208 @@
+/**
+ * Tiered Storage - RAZORFS Cold File Offload
+ *
+ * Files nobody touched for a while move their contents to a cheaper tier
+ * (an S3 bucket, or any directory such as a network mount):
+ * - A thread scans the data log every scan_ms and offloads files that are
+ *   at least min_bytes and untouched for cold_s (the filesystem decides
+ *   what "touched" means through a callback)
+ * - Offloading uploads one object per file holding its chunks as stored
+ *   (raw or compressed), then turns the chunk refs in the data log into
+ *   remote refs pointing into the object. The node and the refs are the
+ *   local stub; the payloads become log garbage, reclaimed by compaction
+ * - Reads of remote chunks fetch the whole object once into a local read
+ *   cache (an SSD directory, LRU-bounded) and are served from there
+ * - A rewritten chunk is local again; deleting the file deletes the
+ *   object from the tier in the background
+ *
+ * The tier only ever holds copies the log still describes: an object is
+ * uploaded before any ref points at it, and chunks written while it was
+ * uploading are left local.
+ */
+
+#ifndef RAZORFS_TIERING_H
+#define RAZORFS_TIERING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <pthread.h>
+#include "data_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Object format */
+#define TIER_OBJECT_MAGIC        0x52465430  /* "RFT0" */
+
+/* Defaults */
+#define TIER_DEFAULT_COLD_S      (7 * 24 * 3600)   /* Untouched for a week */
+#define TIER_DEFAULT_SCAN_MS     60000             /* One scan a minute */
+#define TIER_DEFAULT_MIN_BYTES   (1024 * 1024)     /* Smaller files stay local */
+#define TIER_DEFAULT_CACHE_MB    1024              /* Local read cache */
+#define TIER_DEFAULT_CACHE_DIR   "/var/tmp/razorfs_tier_cache"
+#define TIER_KEY_MAX             64
+
+/**
+ * Object header; the chunk payloads follow back to back
+ */
+struct tier_object_header {
+    uint32_t magic;
+    uint32_t inode;
+    uint64_t payload_len;
+    uint32_t crc;                /* CRC32C of the payloads */
+    uint32_t reserved;
+};
+
+/**
+ * Where objects go
+ * put/get/remove return 0 on success and -1 on failure; get hands back a
+ * malloc'd buffer.
+ */
+struct tier_backend {
+    int (*put)(void *ctx, const char *key, const void *data, size_t size);
+    int (*get)(void *ctx, const char *key, void **data_out, size_t *size_out);
+    int (*remove)(void *ctx, const char *key);
+    /* Delete many objects in few requests (may be NULL: one remove each) */
+    int (*remove_many)(void *ctx, const char *const *keys, size_t count);
+    void (*release)(void *ctx);  /* Called by tier_destroy() (may be NULL) */
+    void *ctx;
+};
+
+/**
+ * Tier settings
+ */
+struct tier_config {
+    uint32_t cold_s;             /* Idle time before a file is offloaded */
+    uint32_t scan_ms;            /* Time between scans (0 = no thread) */
+    uint64_t min_bytes;          /* Smallest file worth offloading */
+    const char *cache_dir;       /* Local read cache (emptied on start) */
+    uint64_t cache_bytes;        /* Read cache size limit */
+};
+
+/**
+ * Decide whether a file counts as cold
+ * @param cutoff Files last touched before this are cold
+ * @return 1 if cold, 0 otherwise
+ */
+typedef int (*tier_is_cold_fn)(void *ctx, uint32_t inode, time_t cutoff);
+
+/**
+ * One object in the read cache
+ */
+struct tier_cache_entry {
+    uint32_t inode;
+    uint64_t bytes;
+    uint64_t last_use;           /* Cache clock at the last read */
+    struct tier_cache_entry *next;
+};
+
+/**
+ * Statistics
+ */
+struct tier_stats {
+    uint64_t offloaded_files;
+    uint64_t offloaded_bytes;    /* Payload bytes moved off the log */
+    uint64_t remote_reads;       /* Chunks read from the tier */
+    uint64_t cache_hits;         /* ... of which from the read cache */
+    uint64_t fetches;            /* Objects downloaded */
+};
+
+/**
+ * Tiering engine
+ */
+struct tier {
+    struct tier_backend backend;
+    struct data_log *log;
+    tier_is_cold_fn is_cold;
+    void *cold_ctx;
+
+    uint32_t cold_s;
+    uint32_t scan_ms;
+    uint64_t min_bytes;
+
+    /* Read cache */
+    pthread_mutex_t cache_lock;
+    char cache_dir[256];
+    uint64_t cache_limit;
+    uint64_t cache_used;
+    uint64_t cache_clock;
+    struct tier_cache_entry *cache;
+
+    /* Scanner */
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         /* Shutdown */
+    pthread_t thread;
+    int started;                 /* Thread running */
+    int running;
+    uint32_t *forgotten;         /* Inodes whose objects are to be deleted */
+    uint32_t forgotten_count;
+    uint32_t forgotten_capacity;
+
+    struct tier_stats stats;     /* Updated with __atomic builtins */
+};
+
+/**
+ * Start tiering a data log
+ * Takes over the backend (released by tier_destroy(), also on failure).
+ *
+ * @param cfg Settings (cache_dir is required)
+ * @param is_cold Coldness check for offload candidates
+ * @return 0 on success, -1 on failure
+ */
+int tier_init(struct tier *t, const struct tier_config *cfg,
+              const struct tier_backend *backend, struct data_log *log,
+              tier_is_cold_fn is_cold, void *cold_ctx);
+
+/**
+ * Stop the scanner, delete forgotten objects and release the backend
+ * Remote chunks stay remote; the next tier_init() serves them again.
+ */
+void tier_destroy(struct tier *t);
+
+/**
+ * Offload one file now, whether cold or not
+ * @return Chunks moved to the tier, 0 if there was nothing to move (not in
+ *         the log or already offloaded), -1 on failure
+ */
+int tier_offload(struct tier *t, uint32_t inode);
+
+/**
+ * One scan: offload every cold file, delete forgotten objects
+ * @return Files offloaded
+ */
+uint32_t tier_scan(struct tier *t);
+
+/**
+ * Read part of a file's object (through the read cache)
+ * @return 0 on success, -1 on failure
+ */
+int tier_read(struct tier *t, uint32_t inode, uint64_t offset, uint32_t size, void *buf);
+
+/**
+ * Drop a deleted file's object (deleted by the next scan or tier_destroy)
+ */
+void tier_forget(struct tier *t, uint32_t inode);
+
+/**
+ * Object key of a file
+ */
+void tier_object_key(uint32_t inode, char *key, size_t len);
+
+/**
+ * Backend storing objects as files in a local directory
+ * @return 0 on success, -1 if the directory cannot be used
+ */
+int tier_backend_dir(struct tier_backend *backend, const char *dir);
+
+/**
+ * Copy out the statistics
+ */
+void tier_get_stats(struct tier *t, struct tier_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_TIERING_H */
@@ -3,6 +3,10 @@
  */
 
 #include "wal.h"
+#include "crc32c.h"
+#include "compression.h"
+#include "metrics.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -12,6 +16,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sched.h>
+#include <limits.h>
 
 /* CRC32 lookup table */
 static uint32_t crc32_table[256];
@@ -54,78 +60,57 @@ uint64_t wal_timestamp(void) {
     return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
-#define GF2_DIM 32
+uint32_t wal_crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+    return crc32_combine_poly(CRC32_POLY, crc1, crc2, len2);
+}
 
-static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec) {
-    uint32_t sum = 0;
-    int i = 0;
-    while (vec) {
-        if (vec & 1) {
-            sum ^= mat[i];
-        }
-        vec >>= 1;
-        i++;
+/* Checksum with the polynomial of a log format version */
+static uint32_t checksum_for_version(uint32_t version, const void *data, size_t len) {
+    if (version == WAL_VERSION_CRC32) {
+        return wal_crc32(data, len);
     }
-    return sum;
+    return crc32c(0, data, len);
 }
 
-static void gf2_matrix_square(uint32_t *square, const uint32_t *mat) {
-    for (int i = 0; i < GF2_DIM; i++) {
-        square[i] = gf2_matrix_times(mat, mat[i]);
-    }
+uint32_t wal_checksum(const struct wal *wal, const void *data, size_t len) {
+    return checksum_for_version(wal->version, data, len);
 }
 
-uint32_t wal_crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
-    if (len2 == 0) {
-        return crc1;
+uint32_t wal_entry_checksum(const struct wal *wal, const struct wal_entry *entry,
+                            const void *data, size_t data_len) {
+    /* The checksum field itself is covered as 0 */
+    struct wal_entry copy;
+    memcpy(&copy, entry, sizeof(copy));
+    copy.checksum = 0;
+
+    if (wal->version == WAL_VERSION_CRC32) {
+        uint32_t checksum = wal_crc32(&copy, sizeof(copy));
+        if (data_len > 0) {
+            uint32_t data_checksum = wal_crc32(data, data_len);
+            checksum = wal_crc32_combine(checksum, data_checksum, data_len);
+        }
+        return checksum;
     }
 
-    uint32_t even[GF2_DIM];
-    uint32_t odd[GF2_DIM];
-
-    // operator for one zero bit
-    odd[0] = 0xEDB88320L;          // CRC-32 polynomial
-    uint32_t row = 1;
-    for (int i = 1; i < GF2_DIM; i++) {
-        odd[i] = row;
-        row <<= 1;
+    /* CRC32C continues across header and payload, no combine step */
+    uint32_t checksum = crc32c(0, &copy, sizeof(copy));
+    if (data_len > 0) {
+        checksum = crc32c(checksum, data, data_len);
     }
-
-    // square to get operator for two zero bits
-    gf2_matrix_square(even, odd);
-
-    // square to get operator for four zero bits
-    gf2_matrix_square(odd, even);
-
-    // apply len2 zeros to crc1
-    do {
-        // apply matrix multiplication for each bit of len2
-        gf2_matrix_square(even, odd);
-        if (len2 & 1) {
-            crc1 = gf2_matrix_times(even, crc1);
-        }
-        len2 >>= 1;
-
-        if (len2 == 0) {
-            break;
-        }
-
-        gf2_matrix_square(odd, even);
-        if (len2 & 1) {
-            crc1 = gf2_matrix_times(odd, crc1);
-        }
-        len2 >>= 1;
-    } while (len2 != 0);
-
-    crc1 ^= crc2;
-    return crc1;
+    return checksum;
 }
 
 /* Calculate header checksum (excluding checksum field itself) */
 static uint32_t calc_header_checksum(const struct wal_header *header) {
     /* Checksum everything except the checksum field */
     size_t offset = offsetof(struct wal_header, checksum);
-    return wal_crc32(header, offset);
+    uint32_t checksum = checksum_for_version(header->version, header, offset);
+    if (header->segment_count != 0) {
+        /* Segment geometry sits after the checksum field; segmented logs
+         * (always CRC32C) cover it too */
+        checksum = crc32c(checksum, &header->segment_count, 2 * sizeof(uint32_t));
+    }
+    return checksum;
 }
 
 /* Validate WAL header */
@@ -133,7 +118,7 @@ static int validate_header(const struct wal_header *header) {
     if (header->magic != WAL_MAGIC) {
         return -1;
     }
-    if (header->version != WAL_VERSION) {
+    if (header->version < WAL_VERSION_CRC32 || header->version > WAL_VERSION) {
         return -1;
     }
 
@@ -150,6 +135,164 @@ static void update_header_checksum(struct wal_header *header) {
     header->checksum = calc_header_checksum(header);
 }
 
+/* WAL contents reach stable storage (msync) only in these modes */
+static inline int wal_is_durable(const struct wal *wal) {
+    return wal->is_shm || wal->fd >= 0;
+}
+
+/* msync [offset, offset + len) of the log buffer.
+ * msync needs a page-aligned start and the log begins right after the
+ * 64-byte header, so round down to the page boundary. */
+static int sync_pages(const struct wal *wal, uint64_t offset, uint64_t len) {
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(wal->log_buffer + offset);
+    uintptr_t aligned = start & ~(page - 1);
+    return msync((void *)aligned, (size_t)(start + len - aligned), MS_SYNC);
+}
+
+/* Flush the parts of [from, to) that lie in segments on one device */
+static int sync_device_range(const struct wal *wal, uint32_t device,
+                             uint64_t from, uint64_t to) {
+    uint64_t seg = wal->segment_size;
+    int err = 0;
+    for (uint64_t s = from / seg; s * seg < to; s++) {
+        if (wal->segment_device[s] != device) continue;
+        uint64_t start = s * seg > from ? s * seg : from;
+        uint64_t end = (s + 1) * seg < to ? (s + 1) * seg : to;
+        if (sync_pages(wal, start, end - start) != 0) {
+            err = -1;
+        }
+    }
+    return err;
+}
+
+struct device_sync {
+    const struct wal *wal;
+    uint32_t device;
+    uint64_t from, to;
+    int err;
+};
+
+static void *device_sync_thread(void *arg) {
+    struct device_sync *job = arg;
+    job->err = sync_device_range(job->wal, job->device, job->from, job->to);
+    return NULL;
+}
+
+/* Flush [offset, offset + len) of the log buffer; in a segmented log,
+ * segment by segment with one flusher per device the range touches */
+static int wal_sync_log(const struct wal *wal, uint64_t offset, uint64_t len) {
+    if (len == 0) return 0;
+    if (wal->segment_count == 0) {
+        return sync_pages(wal, offset, len);
+    }
+
+    uint64_t end = offset + len;
+    uint64_t touched = 0;
+    for (uint64_t s = offset / wal->segment_size; s * wal->segment_size < end; s++) {
+        touched |= 1ULL << wal->segment_device[s];
+    }
+    if ((touched & (touched - 1)) == 0) {
+        return sync_device_range(wal, (uint32_t)__builtin_ctzll(touched), offset, end);
+    }
+
+    /* This thread takes the first device, helpers the others (inline if
+     * one cannot be started) */
+    struct device_sync jobs[WAL_MAX_SEGMENTS];
+    pthread_t threads[WAL_MAX_SEGMENTS];
+    int started[WAL_MAX_SEGMENTS];
+    uint32_t n = 0;
+    for (uint32_t d = 0; d < wal->device_count; d++) {
+        if (touched & (1ULL << d)) {
+            jobs[n++] = (struct device_sync){ .wal = wal, .device = d,
+                                              .from = offset, .to = end, .err = 0 };
+        }
+    }
+    for (uint32_t i = 1; i < n; i++) {
+        started[i] = pthread_create(&threads[i], NULL, device_sync_thread, &jobs[i]) == 0;
+        if (!started[i]) {
+            device_sync_thread(&jobs[i]);
+        }
+    }
+    device_sync_thread(&jobs[0]);
+
+    int err = jobs[0].err;
+    for (uint32_t i = 1; i < n; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+        if (jobs[i].err != 0) {
+            err = -1;
+        }
+    }
+    return err;
+}
+
+/* Flush [from, to) of the log, wrapping past its end, through the I/O
+ * engine: an fdatasync of every file the range touches, in one batch.
+ * The pages were dirtied through the shared mapping, so the fdatasync of
+ * the file writes them back just like msync would. */
+static int wal_sync_log_io(struct wal *wal, uint64_t from, uint64_t to) {
+    if (from == to) return 0;
+    if (wal->segment_count == 0) {
+        io_engine_fsync(wal->io, wal->fd);
+        return io_engine_submit(wal->io);
+    }
+
+    uint64_t seg = wal->segment_size;
+    uint64_t touched = 0;
+    uint64_t end = to > from ? to : wal->buffer_size;
+    for (uint64_t s = from / seg; s * seg < end; s++) {
+        touched |= 1ULL << s;
+    }
+    for (uint64_t s = 0; to < from && s * seg < to; s++) {
+        touched |= 1ULL << s;
+    }
+    for (uint32_t s = 0; s < wal->segment_count; s++) {
+        if (touched & (1ULL << s)) {
+            io_engine_fsync(wal->io, wal->segment_fds[s]);
+        }
+    }
+    return io_engine_submit(wal->io);
+}
+
+/* Initialize group commit state and the write stage; everything already
+ * logged counts as durable */
+static int init_group_commit(struct wal *wal) {
+    if (pthread_mutex_init(&wal->commit_lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_cond_init(&wal->commit_cond, NULL) != 0) {
+        pthread_mutex_destroy(&wal->commit_lock);
+        return -1;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    int err = pthread_cond_init(&wal->sync_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err != 0) {
+        pthread_cond_destroy(&wal->commit_cond);
+        pthread_mutex_destroy(&wal->commit_lock);
+        return -1;
+    }
+    if (pthread_mutex_init(&wal->stage_lock, NULL) != 0) {
+        pthread_cond_destroy(&wal->sync_cond);
+        pthread_cond_destroy(&wal->commit_cond);
+        pthread_mutex_destroy(&wal->commit_lock);
+        return -1;
+    }
+
+    wal->group_commit = 0;
+    wal->deferred = 0;
+    wal->sync_thread_running = 0;
+    wal->commit_in_progress = 0;
+    wal->durable_lsn = wal->header->next_lsn - 1;
+    wal->appended_lsn = wal->durable_lsn;
+    wal->sync_offset = wal->header->head_offset;
+    return 0;
+}
+
 /* Initialize WAL in heap mode */
 int wal_init(struct wal *wal, size_t size) __attribute__((unused));
 int wal_init(struct wal *wal, size_t size) {
@@ -171,10 +314,12 @@ int wal_init(struct wal *wal, size_t size) {
     wal->log_buffer = (char *)buffer + sizeof(struct wal_header);
     wal->buffer_size = size;
     wal->is_shm = 0;
+    wal->fd = -1;
 
     /* Initialize header */
     wal->header->magic = WAL_MAGIC;
     wal->header->version = WAL_VERSION;
+    wal->version = WAL_VERSION;
     wal->header->next_tx_id = 1;
     wal->header->next_lsn = 1;
     wal->header->head_offset = 0;
@@ -211,6 +356,14 @@ int wal_init(struct wal *wal, size_t size) {
         free(buffer);
         return -1;
     }
+    if (init_group_commit(wal) != 0) {
+        pthread_cond_destroy(&wal->checkpoint_cond);
+        pthread_mutex_destroy(&wal->checkpoint_lock);
+        pthread_mutex_destroy(&wal->tx_lock);
+        pthread_mutex_destroy(&wal->log_lock);
+        free(buffer);
+        return -1;
+    }
 
     return 0;
 }
@@ -236,12 +389,14 @@ int wal_init_shm(struct wal *wal, void *shm_buffer, size_t size, int existing) {
         if (validate_header(wal->header) != 0) {
             return -1;
         }
+        wal->version = wal->header->version;
     } else {
         /* Create new WAL */
         memset(shm_buffer, 0, size);
 
         wal->header->magic = WAL_MAGIC;
         wal->header->version = WAL_VERSION;
+        wal->version = WAL_VERSION;
         wal->header->next_tx_id = 1;
         wal->header->next_lsn = 1;
         wal->header->head_offset = 0;
@@ -272,6 +427,42 @@ int wal_init_shm(struct wal *wal, void *shm_buffer, size_t size, int existing) {
             return -1;
         }
     }
+    return init_group_commit(wal);
+}
+
+/* Locks, checkpoint and group commit state of a file-backed WAL whose
+ * header and log are mapped; undoes itself on failure */
+static int init_file_state(struct wal *wal) {
+    if (pthread_mutex_init(&wal->log_lock, NULL) != 0) {
+        return -1;
+    }
+    if (pthread_mutex_init(&wal->tx_lock, NULL) != 0) {
+        pthread_mutex_destroy(&wal->log_lock);
+        return -1;
+    }
+
+    /* Initialize checkpoint automation fields */
+    wal->auto_checkpoint = 0;
+    wal->checkpoint_thread_running = 0;
+    wal->last_checkpoint_time = wal_timestamp();
+    if (pthread_mutex_init(&wal->checkpoint_lock, NULL) != 0) {
+        pthread_mutex_destroy(&wal->tx_lock);
+        pthread_mutex_destroy(&wal->log_lock);
+        return -1;
+    }
+    if (pthread_cond_init(&wal->checkpoint_cond, NULL) != 0) {
+        pthread_mutex_destroy(&wal->checkpoint_lock);
+        pthread_mutex_destroy(&wal->tx_lock);
+        pthread_mutex_destroy(&wal->log_lock);
+        return -1;
+    }
+    if (init_group_commit(wal) != 0) {
+        pthread_cond_destroy(&wal->checkpoint_cond);
+        pthread_mutex_destroy(&wal->checkpoint_lock);
+        pthread_mutex_destroy(&wal->tx_lock);
+        pthread_mutex_destroy(&wal->log_lock);
+        return -1;
+    }
     return 0;
 }
 
@@ -295,6 +486,15 @@ int wal_init_file(struct wal *wal, const char *filepath, size_t size) {
     /* Get file size */
     struct stat st;
     int existing = 0;
+    struct wal_header old;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(old) &&
+        pread(fd, &old, sizeof(old), 0) == (ssize_t)sizeof(old) &&
+        validate_header(&old) == 0 && old.segment_count != 0 &&
+        old.head_offset != old.tail_offset) {
+        /* Segmented log with entries to replay: open it in its layout */
+        close(fd);
+        return wal_init_segmented(wal, filepath, NULL, 0, old.segment_size, old.segment_count);
+    }
     if (fstat(fd, &st) == 0 && st.st_size >= (off_t)total_size) {
         existing = 1;
     } else {
@@ -324,6 +524,14 @@ int wal_init_file(struct wal *wal, const char *filepath, size_t size) {
         if (validate_header(wal->header) != 0) {
             /* Invalid header - reinitialize */
             existing = 0;
+        } else if (wal->header->version != WAL_VERSION &&
+                   wal->header->head_offset == wal->header->tail_offset) {
+            /* Older format with nothing to replay: start over in the
+             * current one */
+            existing = 0;
+        } else {
+            /* Entries left to replay keep the checksum they were written with */
+            wal->version = wal->header->version;
         }
     }
 
@@ -332,6 +540,7 @@ int wal_init_file(struct wal *wal, const char *filepath, size_t size) {
         memset(addr, 0, total_size);
         wal->header->magic = WAL_MAGIC;
         wal->header->version = WAL_VERSION;
+        wal->version = WAL_VERSION;
         wal->header->next_tx_id = 1;
         wal->header->next_lsn = 1;
         wal->header->head_offset = 0;
@@ -355,39 +564,195 @@ int wal_init_file(struct wal *wal, const char *filepath, size_t size) {
         }
     }
 
-    /* Initialize locks */
-    if (pthread_mutex_init(&wal->log_lock, NULL) != 0) {
+    if (init_file_state(wal) != 0) {
         munmap(addr, total_size);
         close(fd);
         return -1;
     }
-    if (pthread_mutex_init(&wal->tx_lock, NULL) != 0) {
-        pthread_mutex_destroy(&wal->log_lock);
-        munmap(addr, total_size);
+    return 0;
+}
+
+/* === Segmented Log === */
+
+int wal_segment_path(char *buf, size_t len, const char *filepath, uint32_t index) {
+    int n = snprintf(buf, len, "%s.%u", filepath, index);
+    return n > 0 && (size_t)n < len ? 0 : -1;
+}
+
+/* Create segment index in dir (or next to filepath), preallocated so that
+ * appends never allocate blocks, and link it from its name in the log.
+ * Returns its file descriptor, -1 on error. */
+static int create_segment(const char *filepath, const char *dir, uint32_t index, size_t size) {
+    char link[PATH_MAX], path[PATH_MAX];
+    if (wal_segment_path(link, sizeof(link), filepath, index) != 0) return -1;
+
+    const char *target = link;
+    if (dir) {
+        const char *base = strrchr(filepath, '/');
+        base = base ? base + 1 : filepath;
+        int n = snprintf(path, sizeof(path), "%s/%s.%u", dir, base, index);
+        if (n < 0 || (size_t)n >= sizeof(path)) return -1;
+        target = path;
+    }
+
+    /* Truncate first: nothing from an earlier log may look like an entry */
+    int fd = open(target, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) return -1;
+    int err = posix_fallocate(fd, 0, (off_t)size);
+    if (err == EOPNOTSUPP || err == EINVAL) {
+        err = ftruncate(fd, (off_t)size) != 0 ? errno : 0;
+    }
+
+    /* dir may well be the log's own directory: link only another file */
+    struct stat own, linked;
+    if (err == 0 && target != link && fstat(fd, &own) == 0 &&
+        !(stat(link, &linked) == 0 && linked.st_dev == own.st_dev &&
+          linked.st_ino == own.st_ino)) {
+        unlink(link);
+        if (symlink(target, link) != 0) {
+            err = errno;
+        }
+    }
+    if (err != 0) {
         close(fd);
+        errno = err;
         return -1;
     }
+    return fd;
+}
 
-    /* Initialize checkpoint automation fields */
-    wal->auto_checkpoint = 0;
-    wal->checkpoint_thread_running = 0;
-    wal->last_checkpoint_time = wal_timestamp();
-    if (pthread_mutex_init(&wal->checkpoint_lock, NULL) != 0) {
-        pthread_mutex_destroy(&wal->tx_lock);
-        pthread_mutex_destroy(&wal->log_lock);
-        munmap(addr, total_size);
+/* Unmap and close a segmented log with `opened` segment files */
+static void unmap_segmented(struct wal *wal, uint32_t opened) {
+    if (wal->log_buffer) {
+        munmap(wal->log_buffer, wal->buffer_size);  /* Segments included */
+    }
+    for (uint32_t i = 0; i < opened; i++) {
+        close(wal->segment_fds[i]);
+    }
+    if (wal->header) {
+        munmap(wal->header, sizeof(struct wal_header));
+    }
+    close(wal->fd);
+}
+
+int wal_init_segmented(struct wal *wal, const char *filepath, const char *const *dirs,
+                       size_t ndirs, size_t segment_size, uint32_t segment_count) {
+    if (!wal || !filepath) return -1;
+    if (segment_count == 0 || segment_count > WAL_MAX_SEGMENTS) return -1;
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if (segment_size < WAL_SEGMENT_MIN_SIZE) segment_size = WAL_SEGMENT_MIN_SIZE;
+    segment_size = (segment_size + page - 1) & ~(page - 1);
+
+    memset(wal, 0, sizeof(*wal));
+
+    int fd = open(filepath, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+
+    /* Entries to replay keep the layout they were written in */
+    int existing = 0;
+    struct stat st;
+    struct wal_header old;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(old) &&
+        pread(fd, &old, sizeof(old), 0) == (ssize_t)sizeof(old) &&
+        validate_header(&old) == 0 && old.head_offset != old.tail_offset) {
+        if (old.segment_count == 0) {
+            close(fd);
+            return wal_init_file(wal, filepath, st.st_size - sizeof(struct wal_header));
+        }
+        existing = 1;
+        segment_count = old.segment_count;
+        segment_size = old.segment_size;
+    }
+    if (segment_count > WAL_MAX_SEGMENTS ||
+        (uint64_t)segment_size * segment_count < WAL_MIN_SIZE ||
+        (uint64_t)segment_size * segment_count > WAL_SEGMENTED_MAX_SIZE) {
         close(fd);
         return -1;
     }
-    if (pthread_cond_init(&wal->checkpoint_cond, NULL) != 0) {
-        pthread_mutex_destroy(&wal->checkpoint_lock);
-        pthread_mutex_destroy(&wal->tx_lock);
-        pthread_mutex_destroy(&wal->log_lock);
-        munmap(addr, total_size);
+    if (!existing && ftruncate(fd, sizeof(struct wal_header)) != 0) {
         close(fd);
         return -1;
     }
 
+    wal->fd = fd;
+    wal->is_shm = 0;
+    wal->segment_count = segment_count;
+    wal->segment_size = segment_size;
+    wal->buffer_size = segment_size * segment_count;
+
+    void *header = mmap(NULL, sizeof(struct wal_header), PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    wal->header = (struct wal_header *)header;
+
+    /* Reserve the whole range, then put each segment in its place */
+    void *range = mmap(NULL, wal->buffer_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range == MAP_FAILED) {
+        wal->log_buffer = NULL;
+        unmap_segmented(wal, 0);
+        return -1;
+    }
+    wal->log_buffer = (char *)range;
+
+    dev_t devices[WAL_MAX_SEGMENTS];
+    for (uint32_t i = 0; i < segment_count; i++) {
+        int sfd;
+        if (existing) {
+            char link[PATH_MAX];
+            sfd = wal_segment_path(link, sizeof(link), filepath, i) == 0
+                ? open(link, O_RDWR) : -1;
+        } else {
+            sfd = create_segment(filepath, ndirs > 0 ? dirs[i % ndirs] : NULL, i, segment_size);
+        }
+        struct stat sst;
+        if (sfd < 0 || fstat(sfd, &sst) != 0 || sst.st_size != (off_t)segment_size ||
+            mmap(wal->log_buffer + (size_t)i * segment_size, segment_size,
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, sfd, 0) == MAP_FAILED) {
+            if (sfd >= 0) close(sfd);
+            unmap_segmented(wal, i);
+            return -1;
+        }
+        wal->segment_fds[i] = sfd;
+
+        /* Segments on one device share a flusher */
+        uint32_t d = 0;
+        while (d < wal->device_count && devices[d] != sst.st_dev) d++;
+        if (d == wal->device_count) {
+            devices[wal->device_count++] = sst.st_dev;
+        }
+        wal->segment_device[i] = (uint8_t)d;
+    }
+
+    if (existing) {
+        wal->version = wal->header->version;
+    } else {
+        memset(wal->header, 0, sizeof(struct wal_header));
+        wal->header->magic = WAL_MAGIC;
+        wal->header->version = WAL_VERSION;
+        wal->version = WAL_VERSION;
+        wal->header->next_tx_id = 1;
+        wal->header->next_lsn = 1;
+        wal->header->segment_count = segment_count;
+        wal->header->segment_size = (uint32_t)segment_size;
+        update_header_checksum(wal->header);
+
+        if (msync(wal->header, sizeof(struct wal_header), MS_SYNC) != 0 || fsync(fd) != 0) {
+            unmap_segmented(wal, segment_count);
+            return -1;
+        }
+    }
+
+    if (init_file_state(wal) != 0) {
+        unmap_segmented(wal, segment_count);
+        return -1;
+    }
     return 0;
 }
 
@@ -401,13 +766,29 @@ void wal_destroy(struct wal *wal) {
     if (wal->checkpoint_thread_running) {
         wal_stop_checkpoint_thread(wal);
     }
+    wal_stop_sync_thread(wal);
+    wal_sync(wal);  /* Appends the staged write */
+    free(wal->stage_buf);
+    if (wal->io) {
+        io_engine_destroy(wal->io);  /* Lets go of the registered files */
+        free(wal->io);
+    }
 
+    pthread_mutex_destroy(&wal->stage_lock);
+    pthread_cond_destroy(&wal->sync_cond);
+    pthread_cond_destroy(&wal->commit_cond);
+    pthread_mutex_destroy(&wal->commit_lock);
     pthread_cond_destroy(&wal->checkpoint_cond);
     pthread_mutex_destroy(&wal->checkpoint_lock);
     pthread_mutex_destroy(&wal->log_lock);
     pthread_mutex_destroy(&wal->tx_lock);
 
-    if (wal->fd >= 0) {
+    if (wal->segment_count > 0) {
+        /* Segmented WAL - flush every segment, then unmap and close */
+        msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+        wal_sync_log(wal, 0, wal->buffer_size);
+        unmap_segmented(wal, wal->segment_count);
+    } else if (wal->fd >= 0) {
         /* File-backed WAL - unmap and close */
         size_t total_size = sizeof(struct wal_header) + wal->buffer_size;
         if (wal->header) {
@@ -447,62 +828,340 @@ int wal_is_valid(const struct wal *wal) {
     return validate_header(wal->header) == 0;
 }
 
-/* Append log entry to WAL */
-static int wal_append_entry(struct wal *wal, struct wal_entry *entry,
-                           const void *data, size_t data_len) {
+/**
+ * Wait until every entry up to `lsn` is durable (group commit)
+ * The first waiter to find no flush running becomes the leader: it takes
+ * the unflushed log range under log_lock, syncs it without the lock, then
+ * syncs the header (under log_lock, so it is never captured half-updated).
+ * Appenders that arrive meanwhile are covered by the next leader.
+ */
+static int wal_wait_durable(struct wal *wal, uint64_t lsn) {
+    int ret = 0;
+
+    pthread_mutex_lock(&wal->commit_lock);
+    while (wal->durable_lsn < lsn) {
+        if (wal->commit_in_progress) {
+            pthread_cond_wait(&wal->commit_cond, &wal->commit_lock);
+            continue;
+        }
+
+        /* Become the leader for everything appended so far */
+        wal->commit_in_progress = 1;
+        pthread_mutex_unlock(&wal->commit_lock);
+
+        metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+        uint64_t target = wal->appended_lsn;
+        uint64_t from = wal->sync_offset;
+        uint64_t to = wal->header->head_offset;
+        wal->sync_offset = to;
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+        uint64_t start = wal_timestamp();
+        uint64_t flush_start = metrics_start();
+
+        /* Appended entries are immutable, so the log needs no lock */
+        int err;
+        if (wal->io) {
+            err = wal_sync_log_io(wal, from, to);
+        } else if (to >= from) {
+            err = wal_sync_log(wal, from, to - from);
+        } else {
+            /* Wrapped since the last flush */
+            err = wal_sync_log(wal, from, wal->buffer_size - from);
+            if (err == 0) err = wal_sync_log(wal, 0, to);
+        }
+
+        if (err == 0) {
+            metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+            err = msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+            metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+        }
+
+        uint64_t elapsed = wal_timestamp() - start;
+        metrics_record_since(METRICS_WAL_SYNC, flush_start);
+
+        pthread_mutex_lock(&wal->commit_lock);
+        wal->commit_in_progress = 0;
+        if (err == 0) {
+            wal->synced_entries += target - wal->durable_lsn;
+            wal->durable_lsn = target;
+            wal->sync_batches++;
+            wal->sync_time_us += elapsed;
+        } else {
+            /* Let the next leader retry the same range */
+            metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+            wal->sync_offset = from;
+            metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+            ret = -1;
+        }
+        pthread_cond_broadcast(&wal->commit_cond);
+
+        if (ret != 0) break;
+    }
+    pthread_mutex_unlock(&wal->commit_lock);
+
+    if (ret != 0) {
+        errno = EIO;
+    }
+    return ret;
+}
+
+/* === Adaptive Checkpointing === */
+
+static inline int wal_controller_running(const struct wal *wal) {
+    return __atomic_load_n(&wal->checkpoint_thread_running, __ATOMIC_ACQUIRE);
+}
+
+/* Ask the checkpoint thread for a pass now */
+static void wal_kick_checkpoint(struct wal *wal) {
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    wal->checkpoint_kick = 1;
+    pthread_cond_broadcast(&wal->checkpoint_cond);
+    pthread_mutex_unlock(&wal->checkpoint_lock);
+}
+
+/**
+ * Delay an appender, so writers slow down as the log fills instead of
+ * stalling once it is full
+ * Only while the checkpoint thread runs: nothing else frees space.
+ */
+void wal_throttle(struct wal *wal) {
+    if (!wal_controller_running(wal)) return;
+
+    double fill = 1.0 - (double)wal_available_space(wal) / (double)wal->buffer_size;
+    if (fill < WAL_THROTTLE_START) return;
+
+    wal_kick_checkpoint(wal);
+    uint64_t delay = (uint64_t)(WAL_THROTTLE_MAX_US * (fill - WAL_THROTTLE_START) /
+                                (1.0 - WAL_THROTTLE_START));
+    if (delay == 0) return;
+
+    usleep((useconds_t)delay);
+    __atomic_add_fetch(&wal->throttled_appends, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wal->throttle_time_us, delay, __ATOMIC_RELAXED);
+}
+
+/**
+ * Wait for the checkpoint thread to make a pass that started after this
+ * call (an appender found the log full)
+ */
+int wal_wait_checkpoint(struct wal *wal) {
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    /* A pass already under way may have decided before the log filled */
+    uint64_t target = wal->checkpoint_passes + (wal->checkpoint_in_pass ? 2 : 1);
+    wal->checkpoint_kick = 1;
+    pthread_cond_broadcast(&wal->checkpoint_cond);
+    while (wal->checkpoint_thread_running && wal->checkpoint_passes < target) {
+        pthread_cond_wait(&wal->checkpoint_cond, &wal->checkpoint_lock);
+    }
+    int ret = wal->checkpoint_passes >= target ? 0 : -1;
+    pthread_mutex_unlock(&wal->checkpoint_lock);
+    return ret;
+}
+
+/* Whether an append may sleep or wait for room: not a payload append
+ * while a checkpoint hook runs (see wal_set_checkpoint_fn) */
+static inline int wal_append_may_wait(const struct wal *wal, const struct wal_entry *entry) {
+    return !wal->checkpoint_fn || entry->op_type != WAL_OP_WRITE_DATA;
+}
+
+/* Free space for an appender that found the log full */
+static int wal_make_room(struct wal *wal, const struct wal_entry *entry) {
+    if (!wal_append_may_wait(wal, entry)) {
+        return -1;
+    }
+    if (wal_controller_running(wal) && wal_wait_checkpoint(wal) == 0) {
+        return 0;
+    }
+    /* No checkpoint thread: checkpoint here, if allowed (a hook is only
+     * run by the thread) */
+    return wal->auto_checkpoint && !wal->checkpoint_fn ? wal_checkpoint(wal) : -1;
+}
+
+/* === Lock-Free Append === */
+
+/* Packed reservation cursor (buffer offsets always fit in 32 bits) */
+#define WAL_RESERVE_PACK(lsn, off) (((uint64_t)(uint32_t)(lsn) << 32) | (uint32_t)(off))
+
+/**
+ * Reserve log space and an LSN without taking log_lock
+ * Both come from one CAS on reserve_state, so log order and LSN order
+ * always agree. Mirrors the space/wraparound rules of the locked path.
+ *
+ * @return 0 with *offset_out and *lsn_out set, -1 if the log is full
+ */
+static int wal_reserve(struct wal *wal, size_t entry_size,
+                       uint64_t *offset_out, uint64_t *lsn_out) {
+    uint64_t state = __atomic_load_n(&wal->reserve_state, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        uint64_t head = (uint32_t)state;
+        uint64_t tail = __atomic_load_n(&wal->header->tail_offset, __ATOMIC_ACQUIRE);
+        uint64_t available = head >= tail ? wal->buffer_size - (head - tail) : tail - head;
+        if (entry_size > available) {
+            return -1;
+        }
+
+        uint64_t start = head;
+        if (start + entry_size > wal->buffer_size) {
+            if (entry_size > tail) {
+                return -1;
+            }
+            start = 0;  /* Wraparound */
+        }
+
+        uint64_t next = WAL_RESERVE_PACK((state >> 32) + 1, start + entry_size);
+        if (__atomic_compare_exchange_n(&wal->reserve_state, &state, next, 1,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /* Widen the 32-bit LSN: ours is unpublished, so it is at most
+             * 2^32 ahead of the publish cursor */
+            uint64_t published = __atomic_load_n(&wal->publish_lsn, __ATOMIC_ACQUIRE);
+            *lsn_out = published + (uint32_t)((uint32_t)(state >> 32) - (uint32_t)published);
+            *offset_out = start;
+            return 0;
+        }
+        /* CAS failed: state now holds the current cursor, retry */
+    }
+}
+
+/* Fill in LSN and checksum in the caller's staging copy, then copy it in */
+static void wal_fill_entry(struct wal *wal, struct wal_entry *entry, uint64_t lsn,
+                           uint64_t offset, const void *data, size_t data_len) {
+    entry->lsn = lsn;
+    entry->data_len = data_len;
+    entry->checksum = wal_entry_checksum(wal, entry, data, data_len);
+
+    memcpy(wal->log_buffer + offset, entry, sizeof(struct wal_entry));
+    if (data_len > 0 && data) {
+        memcpy(wal->log_buffer + offset + sizeof(struct wal_entry), data, data_len);
+    }
+}
+
+/* Sequence barrier: wait until every earlier LSN has been published */
+static void wal_wait_turn(struct wal *wal, uint64_t lsn) {
+    unsigned int spins = 0;
+    while (__atomic_load_n(&wal->publish_lsn, __ATOMIC_ACQUIRE) != lsn) {
+        if (++spins >= WAL_PUBLISH_SPINS) {
+            sched_yield();  /* Predecessor may be descheduled mid-copy */
+            spins = 0;
+        }
+    }
+}
+
+/* Let the next LSN publish */
+static inline void wal_publish(struct wal *wal, uint64_t lsn) {
+    __atomic_store_n(&wal->publish_lsn, lsn + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Append using lock-free reservation
+ * log_lock is only taken for the header rewrite at our turn in the
+ * barrier (the group commit leader holds it while syncing the header).
+ */
+static int wal_append_lockfree(struct wal *wal, struct wal_entry *entry,
+                               const void *data, size_t data_len) {
+    size_t entry_size = sizeof(struct wal_entry) + data_len;
+    uint64_t offset, lsn;
+
+    if (wal_reserve(wal, entry_size, &offset, &lsn) != 0) {
+        /* Have space freed (see wal_make_room), then retry once */
+        if (wal_make_room(wal, entry) != 0 ||
+            wal_reserve(wal, entry_size, &offset, &lsn) != 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+    }
+
+    wal_fill_entry(wal, entry, lsn, offset, data, data_len);
+    __atomic_add_fetch(&wal->bytes_appended, entry_size, __ATOMIC_RELAXED);
+
+    /* Publish in LSN order: head_offset only ever covers complete entries */
+    wal_wait_turn(wal, lsn);
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    wal->header->head_offset = offset + entry_size;
+    wal->header->entry_count++;
+    wal->header->next_lsn = lsn + 1;
+    update_header_checksum(wal->header);
+    wal->appended_lsn = lsn;
+    wal_publish(wal, lsn);
+
+    if (!wal_is_durable(wal) || wal->deferred) {
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+        return 0;
+    }
+
+    if (wal->group_commit) {
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+        return wal_wait_durable(wal, lsn);
+    }
+
+    wal_sync_log(wal, offset, entry_size);
+    msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+    wal->sync_offset = wal->header->head_offset;
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    pthread_mutex_lock(&wal->commit_lock);
+    if (wal->durable_lsn < lsn) {
+        wal->durable_lsn = lsn;
+    }
+    pthread_mutex_unlock(&wal->commit_lock);
+    return 0;
+}
+
+/* Append log entry to WAL, behind the staged write if any (see wal_append_entry) */
+static int wal_append_now(struct wal *wal, struct wal_entry *entry,
+                          const void *data, size_t data_len) {
     if (!wal || !entry) return -1;
 
+    if (wal_append_may_wait(wal, entry)) {
+        wal_throttle(wal);
+    }
+
+    if (wal->lockfree) {
+        return wal_append_lockfree(wal, entry, data, data_len);
+    }
+
     size_t entry_size = sizeof(struct wal_entry) + data_len;
     entry->data_len = data_len;
     entry->checksum = 0; // Will be calculated in-place later
 
-    pthread_mutex_lock(&wal->log_lock);
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
 
     /* Check available space */
     size_t available = wal_available_space(wal);
     if (entry_size > available) {
-        /* Attempt automatic checkpoint if enabled */
-        if (wal->auto_checkpoint) {
-            pthread_mutex_unlock(&wal->log_lock);
-
-            /* Trigger checkpoint to reclaim space */
-            if (wal_checkpoint(wal) == 0) {
-                /* Retry after checkpoint */
-                pthread_mutex_lock(&wal->log_lock);
-                available = wal_available_space(wal);
-                if (entry_size <= available) {
-                    /* Checkpoint freed enough space - continue below */
-                    goto space_available;
-                }
-                pthread_mutex_unlock(&wal->log_lock);
-            }
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
 
-            /* Checkpoint failed or didn't free enough space */
+        /* Have space freed (see wal_make_room), then retry once */
+        if (wal_make_room(wal, entry) != 0) {
+            errno = ENOSPC;
+            return -1;
+        }
+        metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+        if (entry_size > wal_available_space(wal)) {
+            metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
             errno = ENOSPC;
             return -1;
         }
-
-        /* Auto-checkpoint disabled - return ENOSPC */
-        pthread_mutex_unlock(&wal->log_lock);
-        errno = ENOSPC;
-        return -1;
     }
 
-space_available:
-
     uint64_t write_offset = wal->header->head_offset;
 
     /* Handle wraparound */
     if (write_offset + entry_size > wal->buffer_size) {
         /* Check if there's enough space at the beginning */
         if (entry_size > wal->header->tail_offset) {
-            pthread_mutex_unlock(&wal->log_lock);
+            metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
             errno = ENOSPC;
             return -1;
         }
         write_offset = 0;
     }
 
+    /* LSNs are assigned here, in log order */
+    entry->lsn = wal->header->next_lsn;
+
     /* Write entry and data to log buffer */
     memcpy(wal->log_buffer + write_offset, entry, sizeof(struct wal_entry));
     if (data_len > 0 && data) {
@@ -513,34 +1172,163 @@ space_available:
     /* Get a pointer to the entry in the log and calculate checksum in-place */
     struct wal_entry *entry_in_log = (struct wal_entry *)(wal->log_buffer + write_offset);
 
-    /* CRITICAL: Zero out checksum field before calculating checksum.
-     * The checksum must be calculated with checksum field set to 0,
+    /* Checksum covers the entry with checksum field = 0, then the data,
      * matching the validation logic in recovery.c */
-    entry_in_log->checksum = 0;
-
-    /* Calculate checksum over entry with checksum field = 0, then over data */
-    uint32_t checksum = wal_crc32(entry_in_log, sizeof(struct wal_entry));
-    if (data_len > 0) {
-        uint32_t data_checksum = wal_crc32(data, data_len);
-        checksum = wal_crc32_combine(checksum, data_checksum, data_len);
-    }
-
-    /* Now store the calculated checksum */
-    entry_in_log->checksum = checksum;
+    entry_in_log->checksum = wal_entry_checksum(wal, entry_in_log, data, data_len);
 
     /* Update header */
     wal->header->head_offset = write_offset + entry_size;
     wal->header->entry_count++;
     wal->header->next_lsn++;
     update_header_checksum(wal->header);
+    wal->appended_lsn = entry->lsn;
+    __atomic_add_fetch(&wal->bytes_appended, entry_size, __ATOMIC_RELAXED);
 
-    /* Flush to persistent storage if in shm mode or file-backed */
-    if (wal->is_shm || wal->fd >= 0) {
-        msync(wal->log_buffer + write_offset, entry_size, MS_SYNC);
-        msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+    if (!wal_is_durable(wal) || wal->deferred) {
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+        return 0;
+    }
+
+    if (wal->group_commit) {
+        /* Flush outside log_lock, batched with concurrent appenders */
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+        return wal_wait_durable(wal, entry->lsn);
+    }
+
+    /* Flush to persistent storage while holding the lock */
+    wal_sync_log(wal, write_offset, entry_size);
+    msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+    wal->sync_offset = wal->header->head_offset;
+
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    pthread_mutex_lock(&wal->commit_lock);
+    if (wal->durable_lsn < entry->lsn) {
+        wal->durable_lsn = entry->lsn;
+    }
+    pthread_mutex_unlock(&wal->commit_lock);
+    return 0;
+}
+
+/* === Write Payloads === */
+
+/* Append a WAL_OP_WRITE_DATA record; bytes are compressed if that saves space */
+static int wal_append_payload(struct wal *wal, uint64_t tx_id,
+                              const struct wal_write_data *data, uint8_t kind,
+                              const void *buf) {
+    uint32_t len = kind == WAL_DATA_WRITE ? data->length : 0;
+    struct wal_write_payload *payload = malloc(sizeof(*payload) + len);
+    if (!payload) return -1;
+
+    payload->write = *data;
+    payload->write.data_checksum = len ? wal_checksum(wal, buf, len) : 0;
+    payload->kind = kind;
+    payload->flags = 0;
+
+    size_t stored = len >= COMPRESSION_MIN_SIZE ?
+                    compress_block_for(COMPRESSION_INLINE, buf, len, payload->bytes, len - 1) : 0;
+    if (stored > 0) {
+        payload->flags |= WAL_PAYLOAD_COMPRESSED;
+    } else {
+        if (len) memcpy(payload->bytes, buf, len);
+        stored = len;
+    }
+    payload->stored_len = (uint32_t)stored;
+
+    struct wal_entry entry = {
+        .tx_id = tx_id,
+        .lsn = wal->header->next_lsn,
+        .op_type = WAL_OP_WRITE_DATA,
+        .data_len = (uint32_t)(sizeof(*payload) + stored),
+        .timestamp = wal_timestamp(),
+        .checksum = 0,
+        .reserved = 0
+    };
+
+    int ret = wal_append_now(wal, &entry, payload, sizeof(*payload) + stored);
+    free(payload);
+    if (ret == 0) {
+        __atomic_add_fetch(&wal->payload_bytes, len, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&wal->payload_stored, stored, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+/* Append the staged write and empty the stage (stage_lock held); a write
+ * that no longer fits is dropped from the log */
+static int wal_append_stage_locked(struct wal *wal) {
+    if (wal->stage_len == 0) return 0;
+
+    int ret = wal_append_payload(wal, 0, &wal->stage, WAL_DATA_WRITE, wal->stage_buf);
+    __atomic_store_n(&wal->stage_len, 0, __ATOMIC_RELEASE);
+    return ret;
+}
+
+/**
+ * Append the staged write, if any
+ * Without wait, gives up if the stage is busy: whoever holds it appends
+ * it next (a checkpoint reached from inside that append must not wait).
+ */
+static int wal_flush_stage(struct wal *wal, int wait) {
+    if (__atomic_load_n(&wal->stage_len, __ATOMIC_ACQUIRE) == 0) return 0;
+
+    if (wait) {
+        pthread_mutex_lock(&wal->stage_lock);
+    } else if (pthread_mutex_trylock(&wal->stage_lock) != 0) {
+        return 0;
+    }
+    int ret = wal_append_stage_locked(wal);
+    pthread_mutex_unlock(&wal->stage_lock);
+    return ret;
+}
+
+/* Append log entry to WAL; a staged write goes first, keeping log order */
+static int wal_append_entry(struct wal *wal, struct wal_entry *entry,
+                           const void *data, size_t data_len) {
+    if (!wal || !entry) return -1;
+
+    wal_flush_stage(wal, 1);
+    return wal_append_now(wal, entry, data, data_len);
+}
+
+/* Log a file data change with its bytes, staging small deferred writes */
+int wal_log_write_payload(struct wal *wal, uint64_t tx_id,
+                          const struct wal_write_data *data, uint8_t kind,
+                          const void *buf) {
+    if (!wal || !data || (kind == WAL_DATA_WRITE && data->length > 0 && !buf)) return -1;
+
+    if (kind != WAL_DATA_WRITE || tx_id != 0 || !wal->deferred ||
+        data->length == 0 || data->length >= WAL_COALESCE_MAX) {
+        wal_flush_stage(wal, 1);
+        return wal_append_payload(wal, tx_id, data, kind, buf);
+    }
+
+    pthread_mutex_lock(&wal->stage_lock);
+    if (!wal->stage_buf && !(wal->stage_buf = malloc(WAL_COALESCE_MAX))) {
+        pthread_mutex_unlock(&wal->stage_lock);
+        return wal_append_payload(wal, tx_id, data, kind, buf);
     }
 
-    pthread_mutex_unlock(&wal->log_lock);
+    /* Merge only a write continuing the staged one in the same file */
+    int merge = wal->stage_len > 0 && wal->stage.inode == data->inode &&
+                wal->stage.node_idx == data->node_idx &&
+                wal->stage.offset + wal->stage_len == data->offset &&
+                wal->stage_len + data->length <= WAL_COALESCE_MAX;
+    if (!merge) {
+        /* A failure here only drops the write staged before from the log */
+        wal_append_stage_locked(wal);
+        wal->stage = *data;
+        wal->stage.length = 0;
+    } else {
+        if (data->new_size > wal->stage.new_size) {
+            wal->stage.new_size = data->new_size;
+        }
+        __atomic_add_fetch(&wal->coalesced_writes, 1, __ATOMIC_RELAXED);
+    }
+    memcpy(wal->stage_buf + wal->stage.length, buf, data->length);
+    wal->stage.length += data->length;
+    __atomic_store_n(&wal->stage_len, wal->stage.length, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&wal->stage_lock);
     return 0;
 }
 
@@ -690,11 +1478,147 @@ int wal_log_write(struct wal *wal, uint64_t tx_id,
     return wal_append_entry(wal, &entry, data, sizeof(*data));
 }
 
-/* Perform a checkpoint */
-int wal_checkpoint(struct wal *wal) {
-    if (!wal) return -1;
+/* Log a rename operation */
+int wal_log_rename(struct wal *wal, uint64_t tx_id,
+                   const struct wal_rename_data *data) {
+    if (!wal || !data) return -1;
+
+    struct wal_entry entry = {
+        .tx_id = tx_id,
+        .lsn = wal->header->next_lsn,
+        .op_type = WAL_OP_RENAME,
+        .data_len = sizeof(struct wal_rename_data),
+        .timestamp = wal_timestamp(),
+        .checksum = 0,
+        .reserved = 0
+    };
+
+    return wal_append_entry(wal, &entry, data, sizeof(*data));
+}
+
+int wal_log_repair(struct wal *wal, uint64_t tx_id,
+                   const struct wal_repair_data *data) {
+    if (!wal || !data) return -1;
+
+    struct wal_entry entry = {
+        .tx_id = tx_id,
+        .lsn = wal->header->next_lsn,
+        .op_type = WAL_OP_REPAIR,
+        .data_len = sizeof(struct wal_repair_data),
+        .timestamp = wal_timestamp(),
+        .checksum = 0,
+        .reserved = 0
+    };
+
+    return wal_append_entry(wal, &entry, data, sizeof(*data));
+}
+
+/**
+ * Conservatively advance tail to reclaim space up to a checkpoint (log_lock held)
+ * In a full implementation, we'd scan for the oldest transaction that's
+ * still active and only advance tail up to that point. For now, we
+ * advance tail to the checkpoint LSN, assuming all earlier transactions
+ * are complete.
+ * The checkpoint record is the newest published entry, so the new tail is
+ * simply its end; scanning from the old tail would walk the stale bytes an
+ * append leaves before the end of the buffer when it wraps.
+ * checkpoint_end is not reduced modulo the buffer size: a tail equal to
+ * buffer_size next to an equal head still reads as an empty log.
+ * Always reclaims: a log of large payload records can fill long before
+ * it holds many entries.
+ * Returns the log bytes freed.
+ */
+static uint64_t wal_reclaim_to_checkpoint(struct wal *wal, uint64_t checkpoint_end) {
+    uint64_t old_tail = wal->header->tail_offset;
+    uint64_t new_tail = checkpoint_end;
+    /* Lock-free reservers read the tail without log_lock */
+    __atomic_store_n(&wal->header->tail_offset, new_tail, __ATOMIC_RELEASE);
+    update_header_checksum(wal->header);
+
+    if (wal_is_durable(wal)) {
+        msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+    }
+    uint64_t freed = (new_tail + wal->buffer_size - old_tail) % wal->buffer_size;
+    if (wal->segment_count > 0) {
+        /* Segment boundaries the tail crossed */
+        uint64_t recycled = (old_tail + freed) / wal->segment_size - old_tail / wal->segment_size;
+        __atomic_add_fetch(&wal->segments_recycled, recycled, __ATOMIC_RELAXED);
+    }
+    return freed;
+}
+
+/* Checkpoint through the lock-free reservation path */
+static int wal_checkpoint_lockfree(struct wal *wal, uint64_t *reclaimed) {
+    struct wal_entry entry = {
+        .tx_id = 0,  /* Checkpoint is not part of any transaction */
+        .op_type = WAL_OP_CHECKPOINT,
+        .data_len = 0,
+        .timestamp = wal_timestamp(),
+        .checksum = 0,
+        .reserved = 0
+    };
+    uint64_t entry_size = sizeof(struct wal_entry);
+    uint64_t write_offset, checkpoint_lsn;
+
+    if (wal_reserve(wal, entry_size, &write_offset, &checkpoint_lsn) != 0) {
+        return -1;  /* Not enough space for checkpoint record */
+    }
+    wal_fill_entry(wal, &entry, checkpoint_lsn, write_offset, NULL, 0);
+
+    /* Our turn: every earlier entry is published and the header is ours */
+    wal_wait_turn(wal, checkpoint_lsn);
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    wal->header->head_offset = write_offset + entry_size;
+    wal->header->next_lsn = checkpoint_lsn + 1;
+    wal->header->entry_count++;
+    wal->header->checkpoint_lsn = checkpoint_lsn;
+    update_header_checksum(wal->header);
+
+    if (wal_is_durable(wal)) {
+        wal_sync_log(wal, write_offset, entry_size);
+        msync(wal->header, sizeof(struct wal_header), MS_SYNC);
+    }
+
+    *reclaimed = wal_reclaim_to_checkpoint(wal, write_offset + entry_size);
+    wal_publish(wal, checkpoint_lsn);
+
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+    return 0;
+}
+
+int wal_reset(struct wal *wal) {
+    if (!wal || !wal->header) return -1;
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    /* LSNs and transaction IDs keep counting up */
+    wal->header->version = WAL_VERSION;
+    wal->version = WAL_VERSION;
+    wal->header->head_offset = 0;
+    wal->header->tail_offset = 0;
+    wal->header->checkpoint_lsn = 0;
+    wal->header->entry_count = 0;
+    update_header_checksum(wal->header);
+
+    wal->sync_offset = 0;
+    if (wal->lockfree) {
+        wal->reserve_state = WAL_RESERVE_PACK(wal->header->next_lsn, 0);
+        __atomic_store_n(&wal->publish_lsn, wal->header->next_lsn, __ATOMIC_RELEASE);
+    }
+
+    int ret = 0;
+    if (wal_is_durable(wal) && msync(wal->header, sizeof(struct wal_header), MS_SYNC) != 0) {
+        ret = -1;
+    }
+
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+    return ret;
+}
 
-    pthread_mutex_lock(&wal->log_lock);
+/* Checkpoint under log_lock */
+static int wal_checkpoint_locked(struct wal *wal, uint64_t *reclaimed) {
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
 
     /*
      * NOTE: This is a MINIMAL checkpoint implementation that writes a checkpoint
@@ -725,69 +1649,78 @@ int wal_checkpoint(struct wal *wal) {
     };
 
     /* Calculate checksum with checksum field zeroed */
-    uint32_t checksum = wal_crc32(&entry, sizeof(struct wal_entry));
-    entry.checksum = checksum;
+    entry.checksum = wal_entry_checksum(wal, &entry, NULL, 0);
 
     /* Calculate space needed */
     uint64_t entry_size = sizeof(struct wal_entry);
     uint64_t available = wal_available_space(wal);
 
     if (available < entry_size) {
-        pthread_mutex_unlock(&wal->log_lock);
+        metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
         return -1;  /* Not enough space for checkpoint record */
     }
 
-    /* Get write position */
+    /* Get write position, wrapping around like appends do */
     uint64_t write_offset = wal->header->head_offset;
+    if (write_offset + entry_size > wal->buffer_size) {
+        if (entry_size > wal->header->tail_offset) {
+            metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+            return -1;
+        }
+        write_offset = 0;
+    }
 
     /* Copy checkpoint entry to log buffer */
     memcpy(wal->log_buffer + write_offset, &entry, sizeof(struct wal_entry));
 
     /* Update header */
-    wal->header->head_offset = (write_offset + entry_size) % wal->buffer_size;
+    wal->header->head_offset = write_offset + entry_size;
     wal->header->next_lsn++;
     wal->header->entry_count++;
     wal->header->checkpoint_lsn = checkpoint_lsn;
     update_header_checksum(wal->header);
 
     /* Force checkpoint record to storage */
-    if (wal->is_shm || wal->fd >= 0) {
-        msync(wal->log_buffer + write_offset, entry_size, MS_SYNC);
+    if (wal_is_durable(wal)) {
+        wal_sync_log(wal, write_offset, entry_size);
         msync(wal->header, sizeof(struct wal_header), MS_SYNC);
     }
 
-    /* Conservatively advance tail to reclaim space up to the checkpoint.
-     * In a full implementation, we'd scan for the oldest transaction that's
-     * still active and only advance tail up to that point. For now, we
-     * advance tail to the checkpoint LSN, assuming all earlier transactions
-     * are complete. */
-    if (wal->header->entry_count > 100) {  /* Only reclaim if log is getting full */
-        /* Scan forward from current tail to find the checkpoint entry */
-        uint64_t scan_offset = wal->header->tail_offset;
-        uint64_t head = wal->header->head_offset;
-
-        while (scan_offset != head) {
-            struct wal_entry *scan_entry = (struct wal_entry *)(wal->log_buffer + scan_offset);
-
-            /* If we found the checkpoint entry, advance tail to just after it */
-            if (scan_entry->op_type == WAL_OP_CHECKPOINT && scan_entry->lsn == checkpoint_lsn) {
-                uint64_t checkpoint_size = sizeof(struct wal_entry) + scan_entry->data_len;
-                wal->header->tail_offset = (scan_offset + checkpoint_size) % wal->buffer_size;
-                update_header_checksum(wal->header);
-
-                if (wal->is_shm || wal->fd >= 0) {
-                    msync(wal->header, sizeof(struct wal_header), MS_SYNC);
-                }
-                break;
-            }
+    *reclaimed = wal_reclaim_to_checkpoint(wal, write_offset + entry_size);
 
-            /* Move to next entry */
-            uint64_t scan_size = sizeof(struct wal_entry) + scan_entry->data_len;
-            scan_offset = (scan_offset + scan_size) % wal->buffer_size;
-        }
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+    return 0;
+}
+
+/* Perform a checkpoint */
+int wal_checkpoint(struct wal *wal) {
+    if (!wal) return -1;
+
+    /* The staged write belongs before the checkpoint record */
+    wal_flush_stage(wal, 0);
+
+    uint64_t start = wal_timestamp();
+    uint64_t reclaimed = 0;
+    int ret = wal->lockfree ? wal_checkpoint_lockfree(wal, &reclaimed)
+                            : wal_checkpoint_locked(wal, &reclaimed);
+    if (ret != 0) {
+        return ret;
     }
 
-    pthread_mutex_unlock(&wal->log_lock);
+    uint64_t elapsed = wal_timestamp() - start;
+    __atomic_add_fetch(&wal->checkpoints, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wal->checkpoint_time_us, elapsed, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&wal->bytes_reclaimed, reclaimed, __ATOMIC_RELAXED);
+    __atomic_store_n(&wal->last_checkpoint_us, elapsed, __ATOMIC_RELAXED);
+    uint64_t longest = __atomic_load_n(&wal->max_checkpoint_us, __ATOMIC_RELAXED);
+    while (elapsed > longest &&
+           !__atomic_compare_exchange_n(&wal->max_checkpoint_us, &longest, elapsed, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    wal->last_checkpoint_time = wal_timestamp();
+    pthread_mutex_unlock(&wal->checkpoint_lock);
     return 0;
 }
 
@@ -796,9 +1729,9 @@ int wal_flush(struct wal *wal) __attribute__((unused));
 int wal_flush(struct wal *wal) {
     if (!wal || !wal->is_shm) return 0;
 
-    pthread_mutex_lock(&wal->log_lock);
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
     int ret = msync(wal->header, sizeof(struct wal_header) + wal->buffer_size, MS_SYNC);
-    pthread_mutex_unlock(&wal->log_lock);
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
 
     return ret;
 }
@@ -812,9 +1745,26 @@ void wal_get_stats(const struct wal *wal, struct wal_stats *stats) {
 
     stats->total_entries = wal->header->next_lsn - 1;
     stats->bytes_logged = wal->header->head_offset;
-    stats->total_checkpoints = 0; /* TODO: Track in header */
+    stats->total_checkpoints = __atomic_load_n(&wal->checkpoints, __ATOMIC_RELAXED);
     stats->total_commits = 0;     /* TODO: Track in header */
     stats->total_aborts = 0;      /* TODO: Track in header */
+
+    /* Group commit counters are only ever incremented; a racy read is fine */
+    stats->sync_batches = wal->sync_batches;
+    stats->synced_entries = wal->synced_entries;
+    stats->msync_time_us = wal->sync_time_us;
+
+    stats->checkpoint_time_us = __atomic_load_n(&wal->checkpoint_time_us, __ATOMIC_RELAXED);
+    stats->max_checkpoint_us = __atomic_load_n(&wal->max_checkpoint_us, __ATOMIC_RELAXED);
+    stats->last_checkpoint_us = __atomic_load_n(&wal->last_checkpoint_us, __ATOMIC_RELAXED);
+    stats->bytes_reclaimed = __atomic_load_n(&wal->bytes_reclaimed, __ATOMIC_RELAXED);
+    stats->fill_rate = wal->fill_rate;
+    stats->throttled_appends = __atomic_load_n(&wal->throttled_appends, __ATOMIC_RELAXED);
+    stats->throttle_time_us = __atomic_load_n(&wal->throttle_time_us, __ATOMIC_RELAXED);
+    stats->segments_recycled = __atomic_load_n(&wal->segments_recycled, __ATOMIC_RELAXED);
+    stats->payload_bytes = __atomic_load_n(&wal->payload_bytes, __ATOMIC_RELAXED);
+    stats->payload_stored = __atomic_load_n(&wal->payload_stored, __ATOMIC_RELAXED);
+    stats->coalesced_writes = __atomic_load_n(&wal->coalesced_writes, __ATOMIC_RELAXED);
 }
 
 /* === Checkpoint Automation === */
@@ -863,45 +1813,246 @@ int wal_set_auto_checkpoint(struct wal *wal, int enable) {
 }
 
 /**
- * Background checkpoint thread function
+ * Enable/disable group commit
  */
-static void *checkpoint_thread_func(void *arg) {
-    struct wal *wal = (struct wal *)arg;
+int wal_set_group_commit(struct wal *wal, int enable) {
+    if (!wal || !wal->header) return -1;
 
-    while (1) {
-        pthread_mutex_lock(&wal->checkpoint_lock);
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    wal->group_commit = enable ? 1 : 0;
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    return 0;
+}
+
+int wal_set_io_engine(struct wal *wal, enum io_engine_kind kind) {
+    if (!wal || !wal->header || wal->is_shm || wal->fd < 0) return -1;
 
-        /* Check if we should stop */
-        if (!wal->checkpoint_thread_running) {
-            pthread_mutex_unlock(&wal->checkpoint_lock);
-            break;
+    struct io_engine *io = NULL;
+    if (kind != IO_ENGINE_PSYNC) {
+        io = malloc(sizeof(*io));
+        if (!io || io_engine_init(io, kind, IO_ENGINE_DEFAULT_DEPTH) != 0) {
+            free(io);
+            return -1;
+        }
+        if (io->kind != kind) {
+            io_engine_destroy(io);
+            free(io);
+            return -1;
+        }
+        io_engine_register_file(io, wal->fd);
+        for (uint32_t s = 0; s < wal->segment_count; s++) {
+            io_engine_register_file(io, wal->segment_fds[s]);
         }
+    }
+
+    /* No leader may be flushing through the old engine */
+    pthread_mutex_lock(&wal->commit_lock);
+    while (wal->commit_in_progress) {
+        pthread_cond_wait(&wal->commit_cond, &wal->commit_lock);
+    }
+    struct io_engine *old = wal->io;
+    wal->io = io;
+    pthread_mutex_unlock(&wal->commit_lock);
+
+    if (old) {
+        io_engine_destroy(old);
+        free(old);
+    }
+    return 0;
+}
+
+/**
+ * Enable/disable deferred commit
+ */
+int wal_set_deferred(struct wal *wal, int enable) {
+    if (!wal || !wal->header) return -1;
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    wal->deferred = enable ? 1 : 0;
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    /* What was appended meanwhile is not left behind when switching back */
+    return enable ? 0 : wal_sync(wal);
+}
+
+/**
+ * Make every entry appended so far durable
+ */
+int wal_sync(struct wal *wal) {
+    if (!wal || !wal->header) return -1;
+    wal_flush_stage(wal, 1);
+    if (!wal_is_durable(wal)) return 0;
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    uint64_t lsn = wal->appended_lsn;
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    return wal_wait_durable(wal, lsn);
+}
+
+static void *sync_thread_func(void *arg) {
+    struct wal *wal = arg;
 
-        /* Wait for signal or timeout */
+    pthread_mutex_lock(&wal->commit_lock);
+    while (wal->sync_thread_running) {
         struct timespec ts;
-        clock_gettime(CLOCK_REALTIME, &ts);
-        ts.tv_sec += WAL_CHECKPOINT_TIME_INTERVAL;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t ns = (uint64_t)ts.tv_nsec + (uint64_t)wal->sync_interval_ms * 1000000ULL;
+        ts.tv_sec += (time_t)(ns / 1000000000ULL);
+        ts.tv_nsec = (long)(ns % 1000000000ULL);
+        pthread_cond_timedwait(&wal->sync_cond, &wal->commit_lock, &ts);
+
+        /* wal_wait_durable takes commit_lock itself */
+        pthread_mutex_unlock(&wal->commit_lock);
+        wal_sync(wal);
+        pthread_mutex_lock(&wal->commit_lock);
+    }
+    pthread_mutex_unlock(&wal->commit_lock);
+
+    return NULL;
+}
+
+/**
+ * Start the periodic sync thread
+ */
+int wal_start_sync_thread(struct wal *wal, uint32_t interval_ms) {
+    if (!wal || !wal->header || interval_ms == 0) return -1;
+
+    pthread_mutex_lock(&wal->commit_lock);
+    if (wal->sync_thread_running) {
+        pthread_mutex_unlock(&wal->commit_lock);
+        return 0;  /* Already running */
+    }
+
+    wal->sync_interval_ms = interval_ms;
+    wal->sync_thread_running = 1;
+    if (pthread_create(&wal->sync_thread, NULL, sync_thread_func, wal) != 0) {
+        wal->sync_thread_running = 0;
+        pthread_mutex_unlock(&wal->commit_lock);
+        return -1;
+    }
+    pthread_mutex_unlock(&wal->commit_lock);
+    return 0;
+}
+
+/**
+ * Stop the periodic sync thread
+ */
+int wal_stop_sync_thread(struct wal *wal) {
+    if (!wal) return -1;
+
+    pthread_mutex_lock(&wal->commit_lock);
+    if (!wal->sync_thread_running) {
+        pthread_mutex_unlock(&wal->commit_lock);
+        return 0;  /* Not running */
+    }
+    wal->sync_thread_running = 0;
+    pthread_cond_signal(&wal->sync_cond);
+    pthread_mutex_unlock(&wal->commit_lock);
+
+    /* The thread syncs once more on its way out */
+    pthread_join(wal->sync_thread, NULL);
+    return 0;
+}
+
+/**
+ * Enable/disable lock-free append
+ */
+int wal_set_lockfree_append(struct wal *wal, int enable) {
+    if (!wal || !wal->header) return -1;
+
+    metrics_mutex_lock(&wal->log_lock, METRICS_LOCK_WAL);
+    if (enable && !wal->lockfree) {
+        /* Resume reservations from the current end of the log */
+        wal->reserve_state = WAL_RESERVE_PACK(wal->header->next_lsn, wal->header->head_offset);
+        __atomic_store_n(&wal->publish_lsn, wal->header->next_lsn, __ATOMIC_RELEASE);
+    }
+    wal->lockfree = enable ? 1 : 0;
+    metrics_mutex_unlock(&wal->log_lock, METRICS_LOCK_WAL);
+
+    return 0;
+}
+
+/**
+ * Whether the controller should checkpoint now (checkpoint_lock held)
+ * Checkpoints once the fill expected by the time one started now is done
+ * (the next tick plus twice the last checkpoint's duration, at the
+ * sampled fill rate) reaches the high watermark, so a steady writer is
+ * caught up with before the log gets there.
+ */
+static int wal_checkpoint_due(const struct wal *wal, uint64_t now) {
+    /* Nothing logged since the last checkpoint: nothing to free */
+    if (wal->header->next_lsn <= wal->header->checkpoint_lsn + 1) {
+        return 0;
+    }
+
+    double size = (double)wal->buffer_size;
+    double used = size - (double)wal_available_space(wal);
+    double lead_s = (WAL_CHECKPOINT_TICK_MS * 1000.0 +
+                     2.0 * (double)__atomic_load_n(&wal->last_checkpoint_us,
+                                                   __ATOMIC_RELAXED)) / 1e6;
+    if (used + (double)wal->fill_rate * lead_s >= WAL_CHECKPOINT_HIGH_WATERMARK * size) {
+        return 1;
+    }
+
+    /* A slow trickle still gets checkpointed now and then */
+    return now - wal->last_checkpoint_time >=
+           (uint64_t)WAL_CHECKPOINT_TIME_INTERVAL * 1000000ULL;
+}
+
+/**
+ * Background checkpoint thread function
+ * One pass per tick, or sooner when an appender asks (wal_throttle,
+ * wal_wait_checkpoint): sample the fill rate, checkpoint if due, then
+ * let waiting appenders retry.
+ */
+static void *checkpoint_thread_func(void *arg) {
+    struct wal *wal = (struct wal *)arg;
+    uint64_t last_bytes = __atomic_load_n(&wal->bytes_appended, __ATOMIC_RELAXED);
+    uint64_t last_sample = wal_timestamp();
 
-        pthread_cond_timedwait(&wal->checkpoint_cond, &wal->checkpoint_lock, &ts);
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    while (wal->checkpoint_thread_running) {
+        if (!wal->checkpoint_kick) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            uint64_t ns = (uint64_t)ts.tv_nsec + WAL_CHECKPOINT_TICK_MS * 1000000ULL;
+            ts.tv_sec += (time_t)(ns / 1000000000ULL);
+            ts.tv_nsec = (long)(ns % 1000000000ULL);
+            pthread_cond_timedwait(&wal->checkpoint_cond, &wal->checkpoint_lock, &ts);
+            if (!wal->checkpoint_thread_running) {
+                break;
+            }
+        }
+        wal->checkpoint_kick = 0;
+        wal->checkpoint_in_pass = 1;
 
-        /* Check again if we should stop (spurious wakeup or signal) */
-        if (!wal->checkpoint_thread_running) {
-            pthread_mutex_unlock(&wal->checkpoint_lock);
-            break;
+        /* Fill rate, smoothed over the last few samples */
+        uint64_t now = wal_timestamp();
+        uint64_t bytes = __atomic_load_n(&wal->bytes_appended, __ATOMIC_RELAXED);
+        if (now > last_sample) {
+            uint64_t rate = (bytes - last_bytes) * 1000000ULL / (now - last_sample);
+            wal->fill_rate = (wal->fill_rate * 3 + rate) / 4;
         }
+        last_bytes = bytes;
+        last_sample = now;
 
+        int due = wal_checkpoint_due(wal, now);
         pthread_mutex_unlock(&wal->checkpoint_lock);
 
-        /* Check if checkpoint is needed */
-        if (wal_should_checkpoint(wal)) {
-            /* Perform checkpoint */
-            if (wal_checkpoint(wal) == 0) {
-                pthread_mutex_lock(&wal->checkpoint_lock);
-                wal->last_checkpoint_time = wal_timestamp();
-                pthread_mutex_unlock(&wal->checkpoint_lock);
-            }
+        if (due && wal->checkpoint_fn) {
+            wal->checkpoint_fn(wal->checkpoint_ctx);
+        } else if (due) {
+            wal_checkpoint(wal);
         }
+
+        pthread_mutex_lock(&wal->checkpoint_lock);
+        wal->checkpoint_in_pass = 0;
+        wal->checkpoint_passes++;
+        pthread_cond_broadcast(&wal->checkpoint_cond);
     }
+    pthread_mutex_unlock(&wal->checkpoint_lock);
 
     return NULL;
 }
@@ -919,11 +2070,12 @@ int wal_start_checkpoint_thread(struct wal *wal) {
         return 0;  /* Already running */
     }
 
-    wal->checkpoint_thread_running = 1;
+    /* Appenders check it without the lock (wal_throttle) */
+    __atomic_store_n(&wal->checkpoint_thread_running, 1, __ATOMIC_RELEASE);
     wal->auto_checkpoint = 1;  /* Enable auto-checkpoint */
 
     if (pthread_create(&wal->checkpoint_thread, NULL, checkpoint_thread_func, wal) != 0) {
-        wal->checkpoint_thread_running = 0;
+        __atomic_store_n(&wal->checkpoint_thread_running, 0, __ATOMIC_RELEASE);
         wal->auto_checkpoint = 0;
         pthread_mutex_unlock(&wal->checkpoint_lock);
         return -1;
@@ -933,6 +2085,20 @@ int wal_start_checkpoint_thread(struct wal *wal) {
     return 0;
 }
 
+/**
+ * Set the checkpoint hook
+ */
+int wal_set_checkpoint_fn(struct wal *wal, wal_checkpoint_fn fn, void *ctx) {
+    if (!wal) return -1;
+
+    pthread_mutex_lock(&wal->checkpoint_lock);
+    wal->checkpoint_fn = fn;
+    wal->checkpoint_ctx = ctx;
+    pthread_mutex_unlock(&wal->checkpoint_lock);
+
+    return 0;
+}
+
 /**
  * Stop background checkpoint thread
  */
@@ -946,9 +2112,9 @@ int wal_stop_checkpoint_thread(struct wal *wal) {
         return 0;  /* Not running */
     }
 
-    /* Signal thread to stop */
-    wal->checkpoint_thread_running = 0;
-    pthread_cond_signal(&wal->checkpoint_cond);
+    /* Signal thread to stop, and appenders waiting for its passes */
+    __atomic_store_n(&wal->checkpoint_thread_running, 0, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&wal->checkpoint_cond);
 
     pthread_mutex_unlock(&wal->checkpoint_lock);
 
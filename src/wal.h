@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stddef.h>
 #include <pthread.h>
+#include "io_engine.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,16 +19,43 @@ extern "C" {
 
 /* WAL Configuration */
 #define WAL_MAGIC 0x574C4F47              // 'WLOG'
-#define WAL_VERSION 1
+#define WAL_VERSION_CRC32 1               // Entries and header use CRC32 (IEEE)
+#define WAL_VERSION_CRC32C 2              // Entries and header use CRC32C
+#define WAL_VERSION_IDX32 3               // CRC32C, 32-bit node indices in records
+#define WAL_VERSION WAL_VERSION_IDX32     // Format of newly created logs
 #define WAL_DEFAULT_SIZE (8 * 1024 * 1024) // 8MB
 #define WAL_MIN_SIZE (1 * 1024 * 1024)     // 1MB
 #define WAL_MAX_SIZE (128 * 1024 * 1024)   // 128MB
 
+/* Segmented log (wal_init_segmented): fixed-size segment files, striped
+ * over directories and mapped back to back so the circular log spans
+ * them as one region. Offsets stay below 4GB (lock-free reservations
+ * pack them into 32 bits). */
+#define WAL_MAX_SEGMENTS 64
+#define WAL_SEGMENT_MIN_SIZE (256 * 1024)               // 256KB
+#define WAL_SEGMENT_DEFAULT_SIZE (16 * 1024 * 1024)     // 16MB
+#define WAL_SEGMENTED_MAX_SIZE (2048ULL * 1024 * 1024)  // 2GB
+
+/* Deferred writes outside transactions shorter than this are staged and
+ * merged with the next one when it continues them (wal_log_write_payload) */
+#define WAL_COALESCE_MAX 4096
+
+/* Lock-free append: spins on the publish barrier before yielding the CPU */
+#define WAL_PUBLISH_SPINS 128
+
 /* Checkpoint Thresholds */
 #define WAL_CHECKPOINT_SIZE_THRESHOLD 0.75  // Checkpoint at 75% full
 #define WAL_CHECKPOINT_ENTRY_THRESHOLD 1000 // Checkpoint every 1000 entries
 #define WAL_CHECKPOINT_TIME_INTERVAL 30     // Checkpoint every 30 seconds (if background thread enabled)
 
+/* Adaptive checkpointing (background thread): checkpoint before the log is
+ * expected to reach the high watermark, and slow writers down in proportion
+ * past the throttle point rather than letting them hit a full log */
+#define WAL_CHECKPOINT_TICK_MS 100          // Fill rate sampling period
+#define WAL_CHECKPOINT_HIGH_WATERMARK 0.50  // Fill the next checkpoint must beat
+#define WAL_THROTTLE_START 0.75             // Fill at which appends are delayed
+#define WAL_THROTTLE_MAX_US 2000            // Delay per append with the log full
+
 /* Operation Types */
 enum wal_op_type {
     WAL_OP_BEGIN = 1,        // Begin transaction
@@ -37,7 +65,10 @@ enum wal_op_type {
     WAL_OP_WRITE = 5,        // Write file data
     WAL_OP_COMMIT = 6,       // Commit transaction
     WAL_OP_ABORT = 7,        // Abort transaction
-    WAL_OP_CHECKPOINT = 8    // Checkpoint marker
+    WAL_OP_CHECKPOINT = 8,   // Checkpoint marker
+    WAL_OP_RENAME = 9,       // Move/rename node
+    WAL_OP_WRITE_DATA = 10,  // File data change with its bytes (redo-able)
+    WAL_OP_REPAIR = 11       // Link fixed by razorfsck (redo-able)
 };
 
 /**
@@ -53,8 +84,10 @@ struct wal_header {
     uint64_t tail_offset;        // Read position (oldest entry)
     uint64_t checkpoint_lsn;     // LSN of last checkpoint
     uint32_t entry_count;        // Number of entries in log
-    uint32_t checksum;           // CRC32 of header
-    char padding[16];            // Reserved for future use
+    uint32_t checksum;           // CRC of header (polynomial per version)
+    uint32_t segment_count;      // Segment files (0 = the log follows the header)
+    uint32_t segment_size;       // Bytes per segment (checksummed when segmented)
+    char padding[8];             // Reserved for future use
 } __attribute__((aligned(64)));
 
 /**
@@ -67,15 +100,17 @@ struct wal_entry {
     uint32_t op_type;            // Operation type (enum wal_op_type)
     uint32_t data_len;           // Length of operation data
     uint64_t timestamp;          // Microseconds since epoch
-    uint32_t checksum;           // CRC32 of entry + data
+    uint32_t checksum;           // CRC of entry + data (polynomial per version)
     uint32_t reserved;
     char data[];                 // Variable-length operation data
 } __attribute__((packed));
 
-/* Operation-Specific Data Structures */
+/* Operation-Specific Data Structures
+ * (logs before WAL_VERSION_IDX32 carry 16-bit node indices; recovery
+ * widens those records on read) */
 
 struct wal_insert_data {
-    uint16_t parent_idx;         // Parent node index
+    uint32_t parent_idx;         // Parent node index
     uint32_t inode;              // Inode number
     uint32_t name_offset;        // Name in string table
     uint16_t mode;               // File mode (permissions + type)
@@ -83,8 +118,8 @@ struct wal_insert_data {
 } __attribute__((packed));
 
 struct wal_delete_data {
-    uint16_t node_idx;           // Node to delete
-    uint16_t parent_idx;         // Parent node
+    uint32_t node_idx;           // Node to delete
+    uint32_t parent_idx;         // Parent node
     uint32_t inode;              // Inode number
     uint32_t name_offset;        // Name for verification
     uint16_t mode;               // Mode of deleted node
@@ -92,7 +127,7 @@ struct wal_delete_data {
 } __attribute__((packed));
 
 struct wal_update_data {
-    uint16_t node_idx;           // Node to update
+    uint32_t node_idx;           // Node to update
     uint32_t inode;              // Inode number
     uint64_t old_size;           // Previous size
     uint64_t new_size;           // New size
@@ -101,16 +136,72 @@ struct wal_update_data {
     uint16_t mode;               // File mode
 } __attribute__((packed));
 
+/* wal_rename_data.flags */
+#define WAL_RENAME_EXCHANGE  (1u << 1)   // Swapped with other_idx (RENAME_EXCHANGE)
+
+struct wal_rename_data {
+    uint32_t node_idx;           // Node being moved
+    uint32_t inode;              // Inode number
+    uint32_t old_parent_idx;     // Parent before the move
+    uint32_t new_parent_idx;     // Parent after the move
+    uint32_t old_name_offset;    // Name before the move
+    uint32_t new_name_offset;    // Name after the move
+    uint32_t other_idx;          // Node taking the old place (exchange only)
+    uint32_t other_inode;        // Its inode number (0 if none)
+    uint32_t flags;              // WAL_RENAME_*
+    uint64_t timestamp;          // Time of the move
+} __attribute__((packed));
+
 struct wal_write_data {
-    uint16_t node_idx;           // Node being written
+    uint32_t node_idx;           // Node being written
     uint32_t inode;              // Inode number
     uint64_t offset;             // Offset in file
     uint32_t length;             // Data length
     uint64_t old_size;           // Previous total size of the file
     uint64_t new_size;           // New total size of the file
-    uint32_t data_checksum;      // CRC32 of data
+    uint32_t data_checksum;      // wal_checksum() of data
 } __attribute__((packed));
 
+/* wal_write_payload.kind */
+#define WAL_DATA_WRITE       0          // bytes[] written at write.offset
+#define WAL_DATA_TRUNCATE    1          // File cut or extended to write.new_size
+#define WAL_DATA_PUNCH       2          // Hole punched over offset, length
+
+/* wal_write_payload.flags */
+#define WAL_PAYLOAD_COMPRESSED (1u << 0) // bytes[] is a compress_block() payload
+
+/* Physiological write record (WAL_OP_WRITE_DATA): the change and the bytes
+ * it wrote, so redo can rebuild file data that never reached the data store.
+ * Only written since WAL_VERSION_IDX32. */
+struct wal_write_payload {
+    struct wal_write_data write; // data_checksum covers the raw bytes
+    uint32_t stored_len;         // Bytes following (raw or compressed)
+    uint8_t kind;                // WAL_DATA_*
+    uint8_t flags;               // WAL_PAYLOAD_*
+    char bytes[];
+} __attribute__((packed));
+
+/* wal_repair_data.kind */
+#define WAL_REPAIR_REATTACH  1          // Orphan node linked under parent_idx
+#define WAL_REPAIR_UNLINK    2          // Dangling child_idx dropped from parent_idx
+
+/* Tree link repaired by razorfsck (WAL_OP_REPAIR); redo applies it unless
+ * it is already in place. Only written since WAL_VERSION_IDX32. */
+struct wal_repair_data {
+    uint32_t kind;               // WAL_REPAIR_*
+    uint32_t node_idx;           // Reattached node (WAL_REPAIR_REATTACH)
+    uint32_t inode;              // Its inode number
+    uint32_t parent_idx;         // Directory gaining or losing the link
+    uint32_t child_idx;          // Index dropped (WAL_REPAIR_UNLINK)
+} __attribute__((packed));
+
+/**
+ * Checkpoint hook (see wal_set_checkpoint_fn): makes durable what the
+ * log's records describe, then calls wal_checkpoint
+ * @return 0 on success, -1 if nothing was checkpointed
+ */
+typedef int (*wal_checkpoint_fn)(void *ctx);
+
 /**
  * WAL Context - Main structure
  */
@@ -119,7 +210,16 @@ struct wal {
     char *log_buffer;            // Circular log buffer
     size_t buffer_size;          // Total buffer size (excluding header)
     int is_shm;                  // In shared memory?
+    uint32_t version;            // Format of the mapped log (selects the checksum)
     int fd;                      // File descriptor (for disk-backed WAL)
+
+    /* Segmented log: log_buffer is one reserved address range with every
+     * segment file mapped at its place in it */
+    uint32_t segment_count;          // 0 = header and log share one file
+    size_t segment_size;
+    int segment_fds[WAL_MAX_SEGMENTS];
+    uint8_t segment_device[WAL_MAX_SEGMENTS]; // Flush group (same st_dev)
+    uint32_t device_count;
     pthread_mutex_t log_lock;    // Protects log buffer
     pthread_mutex_t tx_lock;     // Protects transaction state
 
@@ -130,6 +230,64 @@ struct wal {
     pthread_cond_t checkpoint_cond;  // Condition variable for checkpoint trigger
     pthread_mutex_t checkpoint_lock; // Protects checkpoint state
     uint64_t last_checkpoint_time;   // Last checkpoint timestamp (microseconds)
+    uint64_t fill_rate;              // Smoothed append rate, bytes/s (checkpoint_lock)
+    uint64_t checkpoint_passes;      // Controller passes; waiters on checkpoint_cond
+                                     // watch it change (checkpoint_lock)
+    int checkpoint_kick;             // A writer wants a pass now (checkpoint_lock)
+    int checkpoint_in_pass;          // The thread is in a pass (checkpoint_lock)
+    wal_checkpoint_fn checkpoint_fn; // Run by the thread instead of wal_checkpoint
+    void *checkpoint_ctx;
+
+    /* Counters for wal_get_stats (__atomic, relaxed) */
+    uint64_t bytes_appended;         // Entry bytes appended
+    uint64_t checkpoints;            // Checkpoints written
+    uint64_t checkpoint_time_us;     // Time spent in them
+    uint64_t max_checkpoint_us;      // Longest one
+    uint64_t last_checkpoint_us;     // Most recent one
+    uint64_t bytes_reclaimed;        // Log space they freed
+    uint64_t throttled_appends;      // Appends delayed near a full log
+    uint64_t throttle_time_us;       // Total delay
+    uint64_t segments_recycled;      // Segments the tail moved past
+
+    /* Group commit: appenders copy their entry under log_lock, then one
+     * leader flushes everything appended so far while the others wait */
+    int group_commit;                // Group commit enabled
+    pthread_mutex_t commit_lock;     // Protects the commit state below
+    pthread_cond_t commit_cond;      // Signalled when durable_lsn advances
+    int commit_in_progress;          // A leader is flushing
+    uint64_t durable_lsn;            // Entries up to this LSN are on disk
+    uint64_t appended_lsn;           // Last LSN appended (log_lock)
+    uint64_t sync_offset;            // First log byte not yet flushed (log_lock)
+    uint64_t sync_batches;           // Flushes performed (commit_lock)
+    uint64_t synced_entries;         // Entries made durable (commit_lock)
+    uint64_t sync_time_us;           // Time spent flushing (commit_lock)
+    struct io_engine *io;            // Leader flushes through it (NULL = msync)
+
+    /* Write coalescing: the newest small deferred write, not yet appended */
+    pthread_mutex_t stage_lock;      // Protects the stage
+    struct wal_write_data stage;     // Merged write (length = bytes staged)
+    char *stage_buf;                 // WAL_COALESCE_MAX bytes, allocated on first use
+    uint32_t stage_len;              // Bytes staged (__atomic; 0 = empty)
+    uint64_t payload_bytes;          // Raw bytes in payload records (__atomic)
+    uint64_t payload_stored;         // ... as stored in the log
+    uint64_t coalesced_writes;       // Writes merged into a staged one
+
+    /* Deferred commit: appends return once logged; wal_sync() or the sync
+     * thread (every sync_interval_ms) makes them durable */
+    int deferred;                    // Appends do not wait for durability
+    pthread_t sync_thread;           // Periodic wal_sync()
+    int sync_thread_running;         // (commit_lock)
+    uint32_t sync_interval_ms;
+    pthread_cond_t sync_cond;        // Stops the sync thread (commit_lock)
+
+    /* Lock-free append: space and LSN are claimed with one CAS on
+     * reserve_state, entries are filled and checksummed outside any lock,
+     * and a sequence barrier on publish_lsn makes them visible in LSN order */
+    int lockfree;                    // Lock-free append enabled
+    uint64_t reserve_state __attribute__((aligned(64)));
+                                     // Next LSN (low 32 bits) << 32 | next offset
+    uint64_t publish_lsn __attribute__((aligned(64)));
+                                     // Next LSN allowed to publish
 };
 
 /**
@@ -139,9 +297,22 @@ struct wal_stats {
     uint64_t total_entries;      // Total entries logged
     uint64_t total_commits;      // Committed transactions
     uint64_t total_aborts;       // Aborted transactions
-    uint64_t total_checkpoints;  // Checkpoint count
+    uint64_t total_checkpoints;  // Checkpoints written
     uint64_t bytes_logged;       // Total bytes written
     uint64_t msync_time_us;      // Time spent in msync
+    uint64_t sync_batches;       // Group commit flushes
+    uint64_t synced_entries;     // Entries covered by those flushes
+    uint64_t checkpoint_time_us; // Time spent checkpointing
+    uint64_t max_checkpoint_us;  // Longest checkpoint
+    uint64_t last_checkpoint_us; // Most recent checkpoint
+    uint64_t bytes_reclaimed;    // Log space freed by checkpoints
+    uint64_t fill_rate;          // Recent append rate, bytes/s (checkpoint thread)
+    uint64_t throttled_appends;  // Appends delayed near a full log
+    uint64_t throttle_time_us;   // Total delay
+    uint64_t segments_recycled;  // Segment files freed for reuse by checkpoints
+    uint64_t payload_bytes;      // File data logged by payload records
+    uint64_t payload_stored;     // ... as stored (after compression)
+    uint64_t coalesced_writes;   // Small writes merged into the one before
 };
 
 /* Core WAL Functions */
@@ -176,6 +347,37 @@ int wal_init_shm(struct wal *wal, void *shm_buffer, size_t size, int existing) _
  */
 int wal_init_file(struct wal *wal, const char *filepath, size_t size);
 
+/**
+ * Initialize a segmented WAL
+ * The header lives in filepath and the log in segment_count files of
+ * segment_size bytes, reachable as filepath.0, filepath.1, ... Segment i
+ * is created in dirs[i % ndirs] (and linked from there), so the log can
+ * be striped over dedicated devices. Segments are preallocated and reused
+ * in place once checkpoints move the tail past them; a flush that spans
+ * segments on different devices syncs them in parallel.
+ *
+ * A log with entries to replay is opened in the layout it was written
+ * with (a single-file log through wal_init_file); otherwise the log is
+ * recreated in the requested one.
+ *
+ * @param wal WAL context to initialize
+ * @param filepath Path of the header file
+ * @param dirs Directories to stripe segments over (NULL = next to filepath)
+ * @param ndirs Number of directories
+ * @param segment_size Bytes per segment (rounded up to whole pages)
+ * @param segment_count Number of segments (up to WAL_MAX_SEGMENTS)
+ * @return 0 on success, -1 on error
+ */
+int wal_init_segmented(struct wal *wal, const char *filepath, const char *const *dirs,
+                       size_t ndirs, size_t segment_size, uint32_t segment_count);
+
+/**
+ * Name of segment index of the log whose header is filepath
+ *
+ * @return 0 on success, -1 if it does not fit in len bytes
+ */
+int wal_segment_path(char *buf, size_t len, const char *filepath, uint32_t index);
+
 /**
  * Check if WAL needs recovery (has uncommitted transactions)
  *
@@ -266,8 +468,62 @@ int wal_log_update(struct wal *wal, uint64_t tx_id,
 int wal_log_write(struct wal *wal, uint64_t tx_id,
                   const struct wal_write_data *data) __attribute__((unused));
 
+/**
+ * Log a file data change with its bytes (WAL_OP_WRITE_DATA)
+ * For WAL_DATA_WRITE, data->length bytes of buf are logged (compressed
+ * when that saves space) and data_checksum is computed here; truncates
+ * and punches carry no bytes (buf may be NULL). In deferred mode, a write
+ * outside any transaction shorter than WAL_COALESCE_MAX is staged rather
+ * than appended, and the next one is merged into it if it continues it in
+ * the same file. The stage is appended ahead of any other entry, and by
+ * wal_sync(), wal_checkpoint() and wal_destroy().
+ *
+ * @param wal WAL context
+ * @param tx_id Transaction ID (0 = none)
+ * @param data The change (data_checksum is ignored)
+ * @param kind WAL_DATA_*
+ * @param buf Bytes written (WAL_DATA_WRITE)
+ * @return 0 on success, -1 on error (ENOSPC: the log is full)
+ */
+int wal_log_write_payload(struct wal *wal, uint64_t tx_id,
+                          const struct wal_write_data *data, uint8_t kind,
+                          const void *buf);
+
+/**
+ * Log a rename (a replaced target is logged as a delete in the same
+ * transaction, before the rename)
+ *
+ * @param wal WAL context
+ * @param tx_id Transaction ID
+ * @param data Rename operation data
+ * @return 0 on success, -1 on error
+ */
+int wal_log_rename(struct wal *wal, uint64_t tx_id,
+                   const struct wal_rename_data *data);
+
+/**
+ * Log a link repaired by razorfsck
+ *
+ * @param wal WAL context
+ * @param tx_id Transaction ID
+ * @param data Repair data
+ * @return 0 on success, -1 on error
+ */
+int wal_log_repair(struct wal *wal, uint64_t tx_id,
+                   const struct wal_repair_data *data);
+
 /* Checkpoint and Maintenance */
 
+/**
+ * Discard every entry and restart the log in the current format
+ * For use once recovery has applied the log (e.g. to retire an older
+ * format); no appends may be in flight.
+ *
+ * @param wal WAL context
+ * @return 0 on success, -1 on error
+ */
+int wal_reset(struct wal *wal);
+
 /**
  * Perform a checkpoint
  * Flushes all changes and advances tail to reclaim space
@@ -294,9 +550,87 @@ int wal_should_checkpoint(const struct wal *wal);
  */
 int wal_set_auto_checkpoint(struct wal *wal, int enable);
 
+/**
+ * Enable/disable group commit
+ * When enabled, an append still returns only once its entry is durable,
+ * but concurrent appenders share one flush instead of each syncing the log
+ * and header while holding log_lock. Only matters for file-backed and
+ * shared-memory WALs.
+ *
+ * @param wal WAL context
+ * @param enable 1 to enable, 0 to disable
+ * @return 0 on success, -1 on error
+ */
+int wal_set_group_commit(struct wal *wal, int enable);
+
+/**
+ * Choose the I/O engine group commit flushes go through
+ * With IO_ENGINE_URING the leader queues one fdatasync per log file the
+ * flushed range touches and submits them in one call; they run in
+ * parallel instead of one msync (or flusher thread) per device.
+ * File-backed WALs only; set it before the WAL is shared.
+ *
+ * @return 0 if the engine is in use, -1 if unavailable (msync stays)
+ */
+int wal_set_io_engine(struct wal *wal, enum io_engine_kind kind);
+
+/**
+ * Enable/disable deferred commit
+ * When enabled, an append returns as soon as its entry is in the log;
+ * it becomes durable with the next wal_sync() (fsync) or sync thread
+ * pass. A crash may lose the entries appended since. Only matters for
+ * file-backed and shared-memory WALs.
+ *
+ * @param wal WAL context
+ * @param enable 1 to enable, 0 to disable
+ * @return 0 on success, -1 on error
+ */
+int wal_set_deferred(struct wal *wal, int enable);
+
+/**
+ * Make every entry appended so far durable
+ * Shares the flush with concurrent committers (group commit leader).
+ *
+ * @param wal WAL context
+ * @return 0 on success, -1 on error
+ */
+int wal_sync(struct wal *wal);
+
+/**
+ * Start a thread running wal_sync() every interval_ms
+ * (stopped by wal_stop_sync_thread() or wal_destroy())
+ *
+ * @return 0 on success, -1 on error
+ */
+int wal_start_sync_thread(struct wal *wal, uint32_t interval_ms);
+
+/**
+ * Stop the sync thread after one last wal_sync()
+ */
+int wal_stop_sync_thread(struct wal *wal);
+
+/**
+ * Enable/disable lock-free append
+ * Appenders reserve log space and their LSN with a single atomic
+ * compare-and-swap and fill in and checksum their entry without holding
+ * log_lock. Entries are then published (head offset and header updated)
+ * strictly in LSN order. Only toggle while no appends are in flight.
+ *
+ * @param wal WAL context
+ * @param enable 1 to enable, 0 to disable
+ * @return 0 on success, -1 on error
+ */
+int wal_set_lockfree_append(struct wal *wal, int enable);
+
 /**
  * Start background checkpoint thread
- * Thread will perform periodic checkpoints based on time/size thresholds
+ * Every WAL_CHECKPOINT_TICK_MS the thread samples how fast the log fills
+ * and checkpoints once the fill expected by the end of its next pass
+ * (allowing twice the last checkpoint's duration) reaches
+ * WAL_CHECKPOINT_HIGH_WATERMARK, or WAL_CHECKPOINT_TIME_INTERVAL after the
+ * last one. While it runs, appends past WAL_THROTTLE_START are delayed in
+ * proportion to the fill and wake it; an append finding the log full
+ * waits for its next pass instead of checkpointing itself.
  *
  * @param wal WAL context
  * @return 0 on success, -1 on error
@@ -311,6 +645,39 @@ int wal_start_checkpoint_thread(struct wal *wal);
  */
 int wal_stop_checkpoint_thread(struct wal *wal);
 
+/**
+ * Have the checkpoint thread call fn instead of checkpointing itself (set
+ * before starting it)
+ * fn may take a lock payload appenders hold from their append on, so
+ * while it is set a WAL_OP_WRITE_DATA append is neither throttled nor
+ * waits for room: it fails with ENOSPC on a full log, and its caller
+ * throttles (wal_throttle) and waits (wal_wait_checkpoint) without that
+ * lock. Without the thread, a full log is then never checkpointed inline.
+ *
+ * @param wal WAL context
+ * @param fn Hook (NULL = wal_checkpoint)
+ * @param ctx Passed to fn
+ * @return 0 on success, -1 on error
+ */
+int wal_set_checkpoint_fn(struct wal *wal, wal_checkpoint_fn fn, void *ctx);
+
+/**
+ * Delay the caller in proportion to how far the log is past
+ * WAL_THROTTLE_START (WAL_THROTTLE_MAX_US when full) and wake the
+ * checkpoint thread; a no-op while the thread is not running
+ *
+ * @param wal WAL context
+ */
+void wal_throttle(struct wal *wal);
+
+/**
+ * Wait for a checkpoint thread pass that started after this call
+ *
+ * @param wal WAL context
+ * @return 0 after such a pass, -1 if the thread is not running
+ */
+int wal_wait_checkpoint(struct wal *wal);
+
 /**
  * Force WAL to persistent storage (msync)
  *
@@ -361,6 +728,25 @@ uint32_t wal_crc32(const void *data, size_t len);
  */
 uint32_t wal_crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
 
+/**
+ * Checksum data with the polynomial of this log's format
+ * (CRC32C for WAL_VERSION_CRC32C logs, CRC32 for older ones)
+ */
+uint32_t wal_checksum(const struct wal *wal, const void *data, size_t len);
+
+/**
+ * Compute the stored checksum of a log entry
+ * Covers the entry header (checksum field taken as 0) followed by its data.
+ *
+ * @param wal WAL the entry belongs to (selects the polynomial)
+ * @param entry Entry header
+ * @param data Entry payload (may be NULL when data_len is 0)
+ * @param data_len Payload length
+ * @return Checksum to store in / compare with entry->checksum
+ */
+uint32_t wal_entry_checksum(const struct wal *wal, const struct wal_entry *entry,
+                            const void *data, size_t data_len);
+
 /**
  * Get current timestamp in microseconds
  *
@@ -0,0 +1,283 @@
+/**
+ * Write-Back Flusher Implementation - RAZORFS File Data
+ */
+
+#define _GNU_SOURCE
+#include "writeback.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static inline uint32_t hash_inode(uint32_t inode) {
+    return inode % WRITEBACK_HASH_SIZE;
+}
+
+/* === Queue helpers (wb->lock held) === */
+
+static struct writeback_entry *find_entry(struct writeback *wb, uint32_t inode) {
+    struct writeback_entry *e = wb->hash[hash_inode(inode)];
+    while (e && e->inode != inode) {
+        e = e->hash_next;
+    }
+    return e;
+}
+
+static void list_unlink(struct writeback *wb, struct writeback_entry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else wb->head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else wb->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+/* Remove an entry from queue and hash and free it */
+static void drop_entry(struct writeback *wb, struct writeback_entry *e) {
+    list_unlink(wb, e);
+
+    struct writeback_entry **pp = &wb->hash[hash_inode(e->inode)];
+    while (*pp && *pp != e) {
+        pp = &(*pp)->hash_next;
+    }
+    if (*pp) *pp = e->hash_next;
+
+    wb->stats.dirty--;
+    free(e);
+}
+
+/* Queue an inode at the tail unless it is already queued */
+static int enqueue(struct writeback *wb, uint32_t inode, uint64_t due) {
+    if (find_entry(wb, inode)) return 0;  /* Keep the older deadline */
+
+    struct writeback_entry *e = calloc(1, sizeof(*e));
+    if (!e) return -1;
+
+    e->inode = inode;
+    e->due_ms = due;
+    uint32_t h = hash_inode(inode);
+    e->hash_next = wb->hash[h];
+    wb->hash[h] = e;
+
+    e->prev = wb->tail;
+    if (wb->tail) wb->tail->next = e;
+    else wb->head = e;
+    wb->tail = e;
+    wb->stats.dirty++;
+
+    if (wb->head == e) {
+        pthread_cond_signal(&wb->wake);
+    }
+    return 0;
+}
+
+/* === Flusher thread === */
+
+static void *flusher_main(void *arg) {
+    struct writeback *wb = arg;
+
+    pthread_mutex_lock(&wb->lock);
+    while (wb->running) {
+        struct writeback_entry *e = wb->head;
+        if (!e) {
+            pthread_cond_wait(&wb->wake, &wb->lock);
+            continue;
+        }
+
+        uint64_t now = now_ms();
+        if (e->due_ms > now) {
+            /* Sleep until the head is due (or the queue changes) */
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            uint64_t wait = e->due_ms - now;
+            deadline.tv_sec += (time_t)(wait / 1000);
+            deadline.tv_nsec += (long)(wait % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&wb->wake, &wb->lock, &deadline);
+            continue;
+        }
+
+        /* Claim the entry; writes during the flush queue the inode again */
+        uint32_t inode = e->inode;
+        drop_entry(wb, e);
+
+        wb->active++;
+        pthread_mutex_unlock(&wb->lock);
+
+        int result = wb->fn(wb->ctx, inode);
+
+        pthread_mutex_lock(&wb->lock);
+        wb->active--;
+        if (result != 0) {
+            wb->stats.failed++;
+            enqueue(wb, inode, now_ms() + wb->interval_ms);
+        } else {
+            wb->stats.flushed++;
+        }
+        pthread_cond_broadcast(&wb->done);
+    }
+    pthread_mutex_unlock(&wb->lock);
+
+    return NULL;
+}
+
+/* === Public API === */
+
+int writeback_init(struct writeback *wb, const struct writeback_config *config,
+                   writeback_fn fn, void *ctx) {
+    if (!wb || !fn) return -1;
+
+    memset(wb, 0, sizeof(*wb));
+    wb->interval_ms = config ? config->interval_ms : WRITEBACK_DEFAULT_INTERVAL_MS;
+    wb->fn = fn;
+    wb->ctx = ctx;
+    wb->running = 1;
+
+    pthread_mutex_init(&wb->lock, NULL);
+
+    /* Deadlines are computed on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wb->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&wb->done, NULL);
+
+    if (wb->interval_ms == 0) {
+        return 0;  /* Write-through: no flusher thread */
+    }
+
+    if (pthread_create(&wb->thread, NULL, flusher_main, wb) != 0) {
+        pthread_cond_destroy(&wb->done);
+        pthread_cond_destroy(&wb->wake);
+        pthread_mutex_destroy(&wb->lock);
+        return -1;
+    }
+    wb->started = 1;
+    return 0;
+}
+
+void writeback_destroy(struct writeback *wb) {
+    if (!wb || !wb->fn) return;
+
+    /* Dirty data must not be lost on a clean unmount */
+    writeback_sync(wb);
+
+    pthread_mutex_lock(&wb->lock);
+    wb->running = 0;
+    pthread_cond_broadcast(&wb->wake);
+    pthread_mutex_unlock(&wb->lock);
+
+    if (wb->started) {
+        pthread_join(wb->thread, NULL);
+        wb->started = 0;
+    }
+
+    /* Whatever is left failed to flush; nothing more can be done */
+    while (wb->head) {
+        drop_entry(wb, wb->head);
+    }
+
+    pthread_cond_destroy(&wb->done);
+    pthread_cond_destroy(&wb->wake);
+    pthread_mutex_destroy(&wb->lock);
+    wb->fn = NULL;
+}
+
+int writeback_mark_dirty(struct writeback *wb, uint32_t inode) {
+    if (!wb || !wb->fn) return 0;
+
+    if (!wb->started) {
+        /* Write-through */
+        int result = wb->fn(wb->ctx, inode);
+        pthread_mutex_lock(&wb->lock);
+        wb->stats.marked++;
+        if (result != 0) wb->stats.failed++;
+        else wb->stats.flushed++;
+        pthread_mutex_unlock(&wb->lock);
+        return result != 0 ? -1 : 0;
+    }
+
+    pthread_mutex_lock(&wb->lock);
+    wb->stats.marked++;
+    int ret = enqueue(wb, inode, now_ms() + wb->interval_ms);
+    pthread_mutex_unlock(&wb->lock);
+
+    /* Out of memory for the queue entry: fall back to flushing now */
+    if (ret != 0) {
+        return wb->fn(wb->ctx, inode) != 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+void writeback_schedule(struct writeback *wb, uint32_t inode) {
+    if (!wb || !wb->started) return;
+
+    pthread_mutex_lock(&wb->lock);
+    struct writeback_entry *e = find_entry(wb, inode);
+    if (e && e != wb->head) {
+        /* Jump the queue, keeping it ordered: never later than the head */
+        list_unlink(wb, e);
+        uint64_t now = now_ms();
+        e->due_ms = wb->head && wb->head->due_ms < now ? wb->head->due_ms : now;
+        e->next = wb->head;
+        if (wb->head) wb->head->prev = e;
+        else wb->tail = e;
+        wb->head = e;
+        pthread_cond_signal(&wb->wake);
+    } else if (e) {
+        e->due_ms = now_ms();
+        pthread_cond_signal(&wb->wake);
+    }
+    pthread_mutex_unlock(&wb->lock);
+}
+
+void writeback_cancel(struct writeback *wb, uint32_t inode) {
+    if (!wb || !wb->started) return;
+
+    pthread_mutex_lock(&wb->lock);
+    struct writeback_entry *e = find_entry(wb, inode);
+    if (e) {
+        drop_entry(wb, e);
+    }
+    pthread_mutex_unlock(&wb->lock);
+}
+
+void writeback_sync(struct writeback *wb) {
+    if (!wb || !wb->started) return;
+
+    pthread_mutex_lock(&wb->lock);
+
+    uint64_t start = now_ms();
+    for (struct writeback_entry *e = wb->head; e; e = e->next) {
+        e->due_ms = start;
+    }
+    pthread_cond_broadcast(&wb->wake);
+
+    /* Entries re-queued after a failure are due later than `start` */
+    while (wb->active > 0 || (wb->head && wb->head->due_ms <= start)) {
+        pthread_cond_wait(&wb->done, &wb->lock);
+    }
+
+    pthread_mutex_unlock(&wb->lock);
+}
+
+void writeback_get_stats(struct writeback *wb, struct writeback_stats *stats) {
+    if (!wb || !stats) return;
+
+    if (!wb->fn) {
+        *stats = wb->stats;
+        return;
+    }
+
+    pthread_mutex_lock(&wb->lock);
+    *stats = wb->stats;
+    pthread_mutex_unlock(&wb->lock);
+}
@@ -0,0 +1,141 @@
+/**
+ * Write-Back Flusher - RAZORFS File Data
+ *
+ * Writes only touch the in-memory extent store; file data reaches disk later:
+ * - Writers mark an inode dirty (cheap: one hash lookup, no I/O)
+ * - A flusher thread writes an inode back once it has been dirty for
+ *   interval_ms (the first write sets the deadline, later ones do not
+ *   push it out, so a busy file is still flushed regularly)
+ * - release schedules an immediate background flush, fsync flushes inline
+ *   through the same callback
+ *
+ * The queue is FIFO by first-dirty time, so the flusher only looks at the
+ * head and sleeps until it is due.
+ */
+
+#ifndef RAZORFS_WRITEBACK_H
+#define RAZORFS_WRITEBACK_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Defaults */
+#define WRITEBACK_DEFAULT_INTERVAL_MS  5000   /* Max age of dirty data */
+#define WRITEBACK_HASH_SIZE            1024
+
+/**
+ * Flush callback
+ * @param ctx Flusher context pointer
+ * @param inode Inode to write back
+ * @return 0 on success, -1 to retry after another interval
+ */
+typedef int (*writeback_fn)(void *ctx, uint32_t inode);
+
+/**
+ * Flusher configuration
+ */
+struct writeback_config {
+    uint32_t interval_ms;        /* Dirty data age limit (0 = write-through) */
+};
+
+/**
+ * Queued dirty inode
+ */
+struct writeback_entry {
+    uint32_t inode;
+    uint64_t due_ms;             /* Flush at this (monotonic) time */
+    struct writeback_entry *hash_next;
+    struct writeback_entry *prev;
+    struct writeback_entry *next;
+};
+
+/**
+ * Flusher statistics
+ */
+struct writeback_stats {
+    uint64_t marked;             /* mark_dirty calls */
+    uint64_t flushed;            /* Successful callbacks */
+    uint64_t failed;             /* Failed callbacks (re-queued) */
+    uint32_t dirty;              /* Inodes currently queued */
+};
+
+/**
+ * Write-back flusher
+ */
+struct writeback {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;         /* Queue changed / shutdown */
+    pthread_cond_t done;         /* A flush finished */
+
+    pthread_t thread;
+    int started;                 /* Flusher thread running */
+    int running;
+    uint32_t interval_ms;
+    uint32_t active;             /* Flusher inside the callback */
+
+    writeback_fn fn;
+    void *ctx;
+
+    struct writeback_entry *head;        /* Queue, ordered by due_ms */
+    struct writeback_entry *tail;
+    struct writeback_entry *hash[WRITEBACK_HASH_SIZE];
+
+    struct writeback_stats stats;
+};
+
+/**
+ * Start a flusher
+ *
+ * @param wb Flusher to initialize
+ * @param config Flush policy (NULL = defaults)
+ * @param fn Flush callback
+ * @param ctx Passed to fn
+ * @return 0 on success, -1 on failure
+ */
+int writeback_init(struct writeback *wb, const struct writeback_config *config,
+                   writeback_fn fn, void *ctx);
+
+/**
+ * Flush everything still queued, then stop the flusher
+ */
+void writeback_destroy(struct writeback *wb);
+
+/**
+ * Record a change to an inode
+ * With interval_ms == 0 the callback runs inline (write-through) and its
+ * result is returned.
+ *
+ * @return 0 on success, -1 if a write-through flush failed
+ */
+int writeback_mark_dirty(struct writeback *wb, uint32_t inode);
+
+/**
+ * Flush a queued inode in the background as soon as possible (e.g. on release)
+ */
+void writeback_schedule(struct writeback *wb, uint32_t inode);
+
+/**
+ * Drop an inode from the queue (e.g. on unlink)
+ */
+void writeback_cancel(struct writeback *wb, uint32_t inode);
+
+/**
+ * Make every queued inode due now and wait until they have been flushed
+ * (inodes whose flush failed are re-queued and not waited for)
+ */
+void writeback_sync(struct writeback *wb);
+
+/**
+ * Snapshot flusher statistics
+ */
+void writeback_get_stats(struct writeback *wb, struct writeback_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_WRITEBACK_H */
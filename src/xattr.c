@@ -0,0 +1,706 @@
+/**
+ * Extended Attribute Arena Implementation
+ */
+
+#include "xattr.h"
+#include "crc32c.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define XATTR_INITIAL_ENTRIES 64
+#define XATTR_INITIAL_HEAP    4096
+
+/**
+ * File layout: [header][entries][heap][names], where an entry's
+ * name_offset is the offset of its name in the names section (offsets in
+ * the string table do not survive a remount: unreferenced names are
+ * reclaimed before the arena is loaded)
+ */
+struct xattr_file_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t used;
+    uint32_t heap_used;
+    uint32_t names_len;
+    uint32_t reserved;
+};
+
+/**
+ * After the image, each flush appends one record per changed entry: the
+ * entry's next link, name and value as they are now (name_len 0 = freed).
+ * Replaying them in order on the image gives the arena of the last flush.
+ */
+struct xattr_record {
+    uint32_t magic;
+    uint32_t index;
+    uint32_t next;
+    uint32_t name_len;
+    uint32_t value_len;
+    uint32_t checksum;           /* CRC32C of the record (checksum 0), name, value */
+};
+
+/* === Entries === */
+
+static const char *entry_value(const struct xattr_store *xs, const struct xattr_entry *e) {
+    return e->value_len <= XATTR_INLINE_MAX ? e->inline_value : xs->heap + e->value_off;
+}
+
+/* Remember a changed entry for the next flush */
+static void entry_dirty(struct xattr_store *xs, uint32_t idx) {
+    if (xs->dirty_count > XATTR_DIRTY_MAX) return;  /* Already a full save */
+    for (uint32_t i = 0; i < xs->dirty_count; i++) {
+        if (xs->dirty[i] == idx) return;
+    }
+    if (xs->dirty_count < XATTR_DIRTY_MAX) {
+        xs->dirty[xs->dirty_count] = idx;
+    }
+    xs->dirty_count++;
+}
+
+static uint32_t entry_alloc(struct xattr_store *xs) {
+    if (xs->free_head != 0) {
+        uint32_t idx = xs->free_head;
+        xs->free_head = xs->entries[idx].next;
+        return idx;
+    }
+
+    if (xs->used == xs->capacity) {
+        uint32_t capacity = xs->capacity * 2;
+        struct xattr_entry *entries = realloc(xs->entries, capacity * sizeof(*entries));
+        if (!entries) return 0;
+        xs->entries = entries;
+        xs->capacity = capacity;
+    }
+    return xs->used++;
+}
+
+static void entry_free(struct xattr_store *xs, uint32_t idx) {
+    struct xattr_entry *e = &xs->entries[idx];
+    string_table_release(xs->names, e->name_offset);
+    if (e->value_len > XATTR_INLINE_MAX) {
+        xs->heap_garbage += e->value_len;
+    }
+    memset(e, 0, sizeof(*e));
+    e->name_offset = XATTR_FREE_NAME;
+    e->next = xs->free_head;
+    xs->free_head = idx;
+    xs->live--;
+    entry_dirty(xs, idx);
+}
+
+/* Entry named name in the chain (0 if none); *prev_out gets its predecessor */
+static uint32_t chain_find(const struct xattr_store *xs, uint32_t head, const char *name,
+                           uint32_t *prev_out) {
+    uint32_t prev = 0;
+    for (uint32_t idx = head; idx != 0 && idx < xs->used; idx = xs->entries[idx].next) {
+        const char *entry_name = string_table_get(xs->names, xs->entries[idx].name_offset);
+        if (entry_name && strcmp(entry_name, name) == 0) {
+            if (prev_out) *prev_out = prev;
+            return idx;
+        }
+        prev = idx;
+    }
+    return 0;
+}
+
+/* === Value heap === */
+
+/* Move every heap value to the front, dropping garbage */
+static void heap_compact(struct xattr_store *xs) {
+    char *heap = malloc(xs->heap_capacity);
+    if (!heap) return;  /* Garbage stays until the next attempt */
+
+    uint32_t used = 0;
+    for (uint32_t i = 1; i < xs->used; i++) {
+        struct xattr_entry *e = &xs->entries[i];
+        if (e->name_offset == XATTR_FREE_NAME || e->value_len <= XATTR_INLINE_MAX) continue;
+        memcpy(heap + used, xs->heap + e->value_off, e->value_len);
+        e->value_off = used;
+        used += e->value_len;
+    }
+
+    free(xs->heap);
+    xs->heap = heap;
+    xs->heap_used = used;
+    xs->heap_garbage = 0;
+}
+
+/* Room for len more bytes; returns their offset or UINT32_MAX */
+static uint32_t heap_alloc(struct xattr_store *xs, uint32_t len) {
+    if (xs->heap_garbage > xs->heap_used / 2) {
+        heap_compact(xs);
+    }
+
+    if (xs->heap_used + (uint64_t)len > xs->heap_capacity) {
+        uint64_t capacity = xs->heap_capacity ? xs->heap_capacity : XATTR_INITIAL_HEAP;
+        while (capacity < xs->heap_used + (uint64_t)len) capacity *= 2;
+        if (capacity > UINT32_MAX) return UINT32_MAX;
+        char *heap = realloc(xs->heap, capacity);
+        if (!heap) return UINT32_MAX;
+        xs->heap = heap;
+        xs->heap_capacity = (uint32_t)capacity;
+    }
+
+    uint32_t off = xs->heap_used;
+    xs->heap_used += len;
+    return off;
+}
+
+/* Store a value in an entry (an old heap value is the caller's garbage) */
+static int entry_store_value(struct xattr_store *xs, struct xattr_entry *e,
+                             const void *value, uint32_t len) {
+    if (len <= XATTR_INLINE_MAX) {
+        memcpy(e->inline_value, value, len);
+        e->value_off = 0;
+    } else {
+        uint32_t off = heap_alloc(xs, len);
+        if (off == UINT32_MAX) return -ENOSPC;
+        memcpy(xs->heap + off, value, len);
+        e->value_off = off;
+    }
+    e->value_len = len;
+    return 0;
+}
+
+/* === Store === */
+
+int xattr_store_init(struct xattr_store *xs, struct string_table *names) {
+    if (!xs || !names) return -1;
+
+    memset(xs, 0, sizeof(*xs));
+    xs->entries = calloc(XATTR_INITIAL_ENTRIES, sizeof(struct xattr_entry));
+    if (!xs->entries) return -1;
+    if (pthread_rwlock_init(&xs->lock, NULL) != 0) {
+        free(xs->entries);
+        xs->entries = NULL;
+        return -1;
+    }
+
+    xs->names = names;
+    xs->capacity = XATTR_INITIAL_ENTRIES;
+    xs->used = 1;  /* Index 0 means "no attributes" */
+    xs->entries[0].name_offset = XATTR_FREE_NAME;
+    return 0;
+}
+
+void xattr_store_destroy(struct xattr_store *xs) {
+    if (!xs || !xs->entries) return;
+
+    pthread_rwlock_destroy(&xs->lock);
+    free(xs->entries);
+    free(xs->heap);
+    memset(xs, 0, sizeof(*xs));
+}
+
+int xattr_get(struct xattr_store *xs, uint32_t head, const char *name,
+              void *value, size_t size) {
+    __atomic_add_fetch(&xs->stats.lookups, 1, __ATOMIC_RELAXED);
+
+    uint32_t idx = chain_find(xs, head, name, NULL);
+    if (idx == 0) return -ENODATA;
+
+    const struct xattr_entry *e = &xs->entries[idx];
+    if (size == 0) return (int)e->value_len;
+    if (size < e->value_len) return -ERANGE;
+    memcpy(value, entry_value(xs, e), e->value_len);
+    return (int)e->value_len;
+}
+
+int xattr_list(struct xattr_store *xs, uint32_t head, char *list, size_t size) {
+    __atomic_add_fetch(&xs->stats.lookups, 1, __ATOMIC_RELAXED);
+
+    size_t total = 0;
+    for (uint32_t idx = head; idx != 0 && idx < xs->used; idx = xs->entries[idx].next) {
+        const char *name = string_table_get(xs->names, xs->entries[idx].name_offset);
+        if (!name) continue;
+
+        size_t len = strlen(name) + 1;
+        if (size != 0) {
+            if (total + len > size) return -ERANGE;
+            memcpy(list + total, name, len);
+        }
+        total += len;
+    }
+    return total > XATTR_LIST_LEN_MAX ? -E2BIG : (int)total;
+}
+
+int xattr_set(struct xattr_store *xs, uint32_t *head, const char *name,
+              const void *value, size_t size, int flags) {
+    size_t name_len = strlen(name);
+    if (name_len == 0 || name_len > XATTR_NAME_LEN_MAX || size > XATTR_VALUE_MAX) {
+        return -ERANGE;
+    }
+
+    uint32_t idx = chain_find(xs, *head, name, NULL);
+    if (idx != 0) {
+        if (flags & XATTR_CREATE) return -EEXIST;
+
+        /* Replace the value in place; the old one stays until the new one
+         * is stored (the entry is untouched if the heap cannot grow) */
+        uint32_t old_len = xs->entries[idx].value_len;
+        int ret = entry_store_value(xs, &xs->entries[idx], value, (uint32_t)size);
+        if (ret != 0) return ret;
+        if (old_len > XATTR_INLINE_MAX) {
+            xs->heap_garbage += old_len;
+        }
+        entry_dirty(xs, idx);
+        return 0;
+    }
+    if (flags & XATTR_REPLACE) return -ENODATA;
+
+    uint32_t name_offset = string_table_intern(xs->names, name);
+    if (name_offset == UINT32_MAX) return -ENOSPC;
+
+    idx = entry_alloc(xs);
+    if (idx == 0) {
+        string_table_release(xs->names, name_offset);
+        return -ENOSPC;
+    }
+
+    struct xattr_entry *e = &xs->entries[idx];
+    memset(e, 0, sizeof(*e));
+    int ret = entry_store_value(xs, e, value, (uint32_t)size);
+    if (ret != 0) {
+        e->name_offset = XATTR_FREE_NAME;
+        e->next = xs->free_head;
+        xs->free_head = idx;
+        string_table_release(xs->names, name_offset);
+        entry_dirty(xs, idx);  /* It may be new to the file: records stay dense */
+        return ret;
+    }
+
+    /* Newest first: the chain head is the only link that changes */
+    e->name_offset = name_offset;
+    e->next = *head;
+    *head = idx;
+    xs->live++;
+    entry_dirty(xs, idx);
+    return 0;
+}
+
+int xattr_remove(struct xattr_store *xs, uint32_t *head, const char *name) {
+    uint32_t prev = 0;
+    uint32_t idx = chain_find(xs, *head, name, &prev);
+    if (idx == 0) return -ENODATA;
+
+    if (prev == 0) {
+        *head = xs->entries[idx].next;
+    } else {
+        xs->entries[prev].next = xs->entries[idx].next;
+        entry_dirty(xs, prev);
+    }
+    entry_free(xs, idx);
+    return 0;
+}
+
+void xattr_drop(struct xattr_store *xs, uint32_t head) {
+    uint32_t idx = head;
+    while (idx != 0 && idx < xs->used && xs->entries[idx].name_offset != XATTR_FREE_NAME) {
+        uint32_t next = xs->entries[idx].next;
+        entry_free(xs, idx);
+        idx = next;
+    }
+}
+
+uint32_t xattr_claim(struct xattr_store *xs, uint32_t head, uint8_t *claimed) {
+    uint32_t *link = &head;
+    uint32_t owner = 0;  /* Entry whose next is *link (0 = the head) */
+    while (*link != 0) {
+        uint32_t idx = *link;
+        if (idx >= xs->used || xs->entries[idx].name_offset == XATTR_FREE_NAME ||
+            (claimed[idx / 8] & (1u << (idx % 8)))) {
+            *link = 0;
+            if (owner != 0) entry_dirty(xs, owner);
+            break;
+        }
+        claimed[idx / 8] |= (uint8_t)(1u << (idx % 8));
+        owner = idx;
+        link = &xs->entries[idx].next;
+    }
+    return head;
+}
+
+uint32_t xattr_sweep(struct xattr_store *xs, const uint8_t *claimed) {
+    uint32_t freed = 0;
+    for (uint32_t i = 1; i < xs->used; i++) {
+        if (xs->entries[i].name_offset != XATTR_FREE_NAME &&
+            !(claimed[i / 8] & (1u << (i % 8)))) {
+            entry_free(xs, i);
+            freed++;
+        }
+    }
+    return freed;
+}
+
+/* === Persistence === */
+
+static int write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+int xattr_store_save(struct xattr_store *xs, const char *path) {
+    if (!xs || !path) return -1;
+
+    /* Garbage is not worth writing */
+    if (xs->heap_garbage > 0) {
+        heap_compact(xs);
+    }
+
+    /* Entries with their names moved into the file's names section */
+    struct xattr_entry *entries = malloc((size_t)xs->used * sizeof(*entries));
+    size_t names_cap = 4096, names_len = 0;
+    char *names = malloc(names_cap);
+    if (!entries || !names) {
+        free(entries);
+        free(names);
+        return -1;
+    }
+    memcpy(entries, xs->entries, (size_t)xs->used * sizeof(*entries));
+    for (uint32_t i = 1; i < xs->used; i++) {
+        if (entries[i].name_offset == XATTR_FREE_NAME) continue;
+        const char *name = string_table_get(xs->names, entries[i].name_offset);
+        size_t len = (name ? strlen(name) : 0) + 1;
+        if (names_len + len > names_cap) {
+            while (names_len + len > names_cap) names_cap *= 2;
+            char *grown = realloc(names, names_cap);
+            if (!grown) {
+                free(entries);
+                free(names);
+                return -1;
+            }
+            names = grown;
+        }
+        memcpy(names + names_len, name ? name : "", len);
+        entries[i].name_offset = (uint32_t)names_len;
+        names_len += len;
+    }
+
+    struct xattr_file_header hdr = {
+        .magic = XATTR_FILE_MAGIC,
+        .version = XATTR_FILE_VERSION,
+        .used = xs->used,
+        .heap_used = xs->heap_used,
+        .names_len = (uint32_t)names_len,
+        .reserved = 0,
+    };
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    int ret = -1;
+    if (fd >= 0) {
+        if (write_all(fd, &hdr, sizeof(hdr)) == 0 &&
+            write_all(fd, entries, (size_t)xs->used * sizeof(*entries)) == 0 &&
+            write_all(fd, xs->heap, xs->heap_used) == 0 &&
+            write_all(fd, names, names_len) == 0 &&
+            fdatasync(fd) == 0) {
+            ret = 0;
+        }
+        close(fd);
+        if (ret == 0 && rename(tmp, path) != 0) {
+            ret = -1;
+        }
+        if (ret != 0) {
+            unlink(tmp);
+        }
+    }
+
+    if (ret == 0) {
+        xs->image_size = sizeof(hdr) + (uint64_t)xs->used * sizeof(*entries) +
+                         xs->heap_used + names_len;
+        xs->file_end = xs->image_size;
+        xs->dirty_count = 0;
+    }
+    free(entries);
+    free(names);
+    return ret;
+}
+
+/* Append the record of entry idx as it is now to buf */
+static int record_append(const struct xattr_store *xs, uint32_t idx,
+                         char **buf, size_t *len, size_t *cap) {
+    const struct xattr_entry *e = &xs->entries[idx];
+    const char *name = NULL;
+    if (e->name_offset != XATTR_FREE_NAME) {
+        name = string_table_get(xs->names, e->name_offset);
+    }
+
+    struct xattr_record rec = {
+        .magic = XATTR_RECORD_MAGIC,
+        .index = idx,
+        .next = name ? e->next : 0,
+        .name_len = name ? (uint32_t)strlen(name) : 0,
+        .value_len = name ? e->value_len : 0,
+        .checksum = 0,
+    };
+    size_t need = sizeof(rec) + rec.name_len + rec.value_len;
+    if (*len + need > *cap) {
+        size_t grown_cap = *cap ? *cap : 4096;
+        while (*len + need > grown_cap) grown_cap *= 2;
+        char *grown = realloc(*buf, grown_cap);
+        if (!grown) return -1;
+        *buf = grown;
+        *cap = grown_cap;
+    }
+
+    const char *value = name ? entry_value(xs, e) : NULL;
+    rec.checksum = crc32c(0, &rec, sizeof(rec));
+    rec.checksum = crc32c(rec.checksum, name, rec.name_len);
+    rec.checksum = crc32c(rec.checksum, value, rec.value_len);
+
+    char *p = *buf + *len;
+    memcpy(p, &rec, sizeof(rec));
+    if (rec.name_len) memcpy(p + sizeof(rec), name, rec.name_len);
+    if (rec.value_len) memcpy(p + sizeof(rec) + rec.name_len, value, rec.value_len);
+    *len += need;
+    return 0;
+}
+
+int xattr_store_flush(struct xattr_store *xs, const char *path) {
+    if (!xs || !path) return -1;
+    if (xs->dirty_count == 0) return 0;
+    if (xs->image_size == 0 || xs->dirty_count > XATTR_DIRTY_MAX) {
+        return xattr_store_save(xs, path);
+    }
+
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    for (uint32_t i = 0; i < xs->dirty_count; i++) {
+        if (record_append(xs, xs->dirty[i], &buf, &len, &cap) != 0) {
+            free(buf);
+            return -1;
+        }
+    }
+
+    /* Records cost a replay on every load: past the image size, one
+     * rewrite is cheaper than carrying them */
+    uint64_t records = xs->file_end - xs->image_size + len;
+    if (records > xs->image_size && records > XATTR_LOG_MIN) {
+        free(buf);
+        return xattr_store_save(xs, path);
+    }
+
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        free(buf);
+        return xattr_store_save(xs, path);  /* The file is gone: start over */
+    }
+
+    /* Cut what the last load did not accept (a torn record), so nothing
+     * after the new records can be mistaken for one */
+    struct stat st;
+    int ret = -1;
+    if (fstat(fd, &st) == 0 &&
+        ((uint64_t)st.st_size <= xs->file_end || ftruncate(fd, (off_t)xs->file_end) == 0) &&
+        lseek(fd, (off_t)xs->file_end, SEEK_SET) == (off_t)xs->file_end &&
+        write_all(fd, buf, len) == 0 &&
+        fdatasync(fd) == 0) {
+        ret = 0;
+    }
+    close(fd);
+    free(buf);
+
+    if (ret == 0) {
+        xs->file_end += len;
+        xs->dirty_count = 0;
+    }
+    return ret;
+}
+
+/* Make room for entry idx, freeing the entries new to the arena */
+static int entry_reserve(struct xattr_store *xs, uint32_t idx) {
+    if (idx >= xs->capacity) {
+        uint32_t capacity = xs->capacity;
+        while (capacity <= idx) capacity *= 2;
+        struct xattr_entry *entries = realloc(xs->entries, capacity * sizeof(*entries));
+        if (!entries) return -1;
+        xs->entries = entries;
+        xs->capacity = capacity;
+    }
+    for (; xs->used <= idx; xs->used++) {
+        memset(&xs->entries[xs->used], 0, sizeof(struct xattr_entry));
+        xs->entries[xs->used].name_offset = XATTR_FREE_NAME;
+    }
+    return 0;
+}
+
+/* Apply the records in buf[0, len); returns the bytes of valid ones */
+static size_t records_replay(struct xattr_store *xs, const char *buf, size_t len) {
+    size_t pos = 0;
+    while (len - pos >= sizeof(struct xattr_record)) {
+        struct xattr_record rec;
+        memcpy(&rec, buf + pos, sizeof(rec));
+        size_t size = sizeof(rec) + (size_t)rec.name_len + rec.value_len;
+        if (rec.magic != XATTR_RECORD_MAGIC || rec.index == 0 ||
+            rec.index >= xs->used + XATTR_DIRTY_MAX ||
+            rec.name_len > XATTR_NAME_LEN_MAX || rec.value_len > XATTR_VALUE_MAX ||
+            (rec.name_len == 0 && rec.value_len != 0) || size > len - pos) {
+            break;
+        }
+        const char *name = buf + pos + sizeof(rec);
+        const char *value = name + rec.name_len;
+        uint32_t checksum = rec.checksum;
+        rec.checksum = 0;
+        uint32_t crc = crc32c(0, &rec, sizeof(rec));
+        crc = crc32c(crc, name, rec.name_len);
+        crc = crc32c(crc, value, rec.value_len);
+        if (crc != checksum || entry_reserve(xs, rec.index) != 0) {
+            break;
+        }
+        pos += size;
+
+        /* The entry's old contents go; the free list is rebuilt after */
+        struct xattr_entry *e = &xs->entries[rec.index];
+        if (e->name_offset != XATTR_FREE_NAME) {
+            string_table_release(xs->names, e->name_offset);
+            if (e->value_len > XATTR_INLINE_MAX) xs->heap_garbage += e->value_len;
+        }
+        memset(e, 0, sizeof(*e));
+        e->name_offset = XATTR_FREE_NAME;
+        if (rec.name_len == 0) continue;
+
+        char name_buf[XATTR_NAME_LEN_MAX + 1];
+        memcpy(name_buf, name, rec.name_len);
+        name_buf[rec.name_len] = '\0';
+        uint32_t name_offset = string_table_intern(xs->names, name_buf);
+        if (name_offset == UINT32_MAX) continue;
+        e = &xs->entries[rec.index];
+        if (entry_store_value(xs, e, value, rec.value_len) != 0) {
+            string_table_release(xs->names, name_offset);
+            continue;
+        }
+        e->name_offset = name_offset;
+        e->next = rec.next;
+    }
+    return pos;
+}
+
+int xattr_store_load(struct xattr_store *xs, const char *path) {
+    if (!xs || !path) return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct xattr_file_header hdr;
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    if (pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+        hdr.magic != XATTR_FILE_MAGIC ||
+        (hdr.version != XATTR_FILE_VERSION && hdr.version != 1) ||
+        hdr.used == 0) {
+        close(fd);
+        return -1;
+    }
+    uint64_t image_size = sizeof(hdr) + (uint64_t)hdr.used * sizeof(struct xattr_entry) +
+                          hdr.heap_used + hdr.names_len;
+    if ((uint64_t)file_size < image_size ||
+        (hdr.version == 1 && (uint64_t)file_size != image_size)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t entries_size = (size_t)hdr.used * sizeof(struct xattr_entry);
+    size_t records_size = (size_t)((uint64_t)file_size - image_size);
+    struct xattr_entry *entries = malloc(entries_size);
+    char *heap = hdr.heap_used ? malloc(hdr.heap_used) : NULL;
+    char *names = malloc((size_t)hdr.names_len + 1);
+    char *records = records_size ? malloc(records_size) : NULL;
+    int ok = entries && names && (hdr.heap_used == 0 || heap) &&
+             pread(fd, entries, entries_size, sizeof(hdr)) == (ssize_t)entries_size &&
+             pread(fd, heap, hdr.heap_used, sizeof(hdr) + entries_size) == (ssize_t)hdr.heap_used &&
+             pread(fd, names, hdr.names_len, sizeof(hdr) + entries_size + hdr.heap_used) ==
+                 (ssize_t)hdr.names_len;
+    /* Records that cannot be read are as good as torn: the image stands */
+    if (records && pread(fd, records, records_size, (off_t)image_size) != (ssize_t)records_size) {
+        records_size = 0;
+    }
+    close(fd);
+
+    /* Every live entry must point inside the file */
+    for (uint32_t i = 1; ok && i < hdr.used; i++) {
+        const struct xattr_entry *e = &entries[i];
+        if (e->name_offset == XATTR_FREE_NAME) continue;
+        ok = e->name_offset < hdr.names_len && e->value_len <= XATTR_VALUE_MAX &&
+             (e->value_len <= XATTR_INLINE_MAX ||
+              (uint64_t)e->value_off + e->value_len <= hdr.heap_used);
+    }
+    if (!ok) {
+        free(entries);
+        free(heap);
+        free(names);
+        free(records);
+        return -1;
+    }
+    names[hdr.names_len] = '\0';
+
+    /* Names become references in the (live) string table again */
+    for (uint32_t i = 1; i < hdr.used; i++) {
+        struct xattr_entry *e = &entries[i];
+        if (e->name_offset != XATTR_FREE_NAME) {
+            e->name_offset = string_table_intern(xs->names, names + e->name_offset);
+        }
+    }
+    entries[0].name_offset = XATTR_FREE_NAME;
+    free(names);
+
+    /* Drop the names of whatever the arena held before */
+    for (uint32_t i = 1; i < xs->used; i++) {
+        if (xs->entries[i].name_offset != XATTR_FREE_NAME) {
+            string_table_release(xs->names, xs->entries[i].name_offset);
+        }
+    }
+    free(xs->entries);
+    free(xs->heap);
+
+    xs->entries = entries;
+    xs->capacity = hdr.used;
+    xs->used = hdr.used;
+    xs->heap = heap;
+    xs->heap_capacity = hdr.heap_used;
+    xs->heap_used = hdr.heap_used;
+    xs->heap_garbage = 0;
+
+    size_t replayed = records_replay(xs, records, records_size);
+    free(records);
+
+    /* Free entries (and those whose name could not be interned) are
+     * chained again */
+    uint32_t live = 0, free_head = 0;
+    for (uint32_t i = xs->used; i-- > 1;) {
+        struct xattr_entry *e = &xs->entries[i];
+        if (e->name_offset == XATTR_FREE_NAME) {
+            memset(e, 0, sizeof(*e));
+            e->name_offset = XATTR_FREE_NAME;
+            e->next = free_head;
+            free_head = i;
+        } else {
+            live++;
+        }
+    }
+    xs->free_head = free_head;
+    xs->live = live;
+
+    xs->image_size = image_size;
+    xs->file_end = image_size + replayed;
+    xs->dirty_count = 0;
+    return 0;
+}
+
+void xattr_get_stats(struct xattr_store *xs, struct xattr_stats *stats) {
+    stats->lookups = __atomic_load_n(&xs->stats.lookups, __ATOMIC_RELAXED);
+    stats->negative = __atomic_load_n(&xs->stats.negative, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,200 @@
+/**
+ * Extended Attribute Arena - RAZORFS xattrs
+ *
+ * Extended attributes of all nodes live in one arena of fixed-size entries:
+ * - A node's attributes form a chain starting at nary_node.xattr_head
+ *   (entry index, 0 = none), so a node without xattrs answers "no data"
+ *   from its own node copy, without touching the arena
+ * - Names are interned in the tree's string table (one reference each)
+ * - Values up to XATTR_INLINE_MAX bytes sit in the entry; larger ones in a
+ *   value heap that is compacted when half of it is garbage
+ * - xattrs.dat holds the arena as of the last full save followed by one
+ *   record per entry changed since; a change appends only the entries it
+ *   touched, and the file is rewritten once the records outgrow the image.
+ *   On load, entries no live node reaches are freed
+ *
+ * The arena itself is not locked; callers serialize access with `lock`
+ * (shared for get/list, exclusive for set/remove, held across reading and
+ * storing the node's xattr_head).
+ */
+
+#ifndef RAZORFS_XATTR_H
+#define RAZORFS_XATTR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "string_table.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* File format */
+#define XATTR_FILE_MAGIC     0x52465841  /* "RFXA" */
+#define XATTR_FILE_VERSION   2   /* 1: no records after the image */
+#define XATTR_RECORD_MAGIC   0x52455841  /* "AXER" */
+
+/* Entries remembered for the next flush; more make it a full save */
+#define XATTR_DIRTY_MAX      64
+
+/* Records may grow to the image size, and at least this far, before a
+ * flush rewrites the file */
+#define XATTR_LOG_MIN        (64 * 1024)
+
+/* Limits (those of Linux) */
+#define XATTR_INLINE_MAX     16
+#define XATTR_NAME_LEN_MAX   255
+#define XATTR_VALUE_MAX      65536
+#define XATTR_LIST_LEN_MAX   65536
+
+/* setxattr flags, if the system headers did not define them */
+#ifndef XATTR_CREATE
+#define XATTR_CREATE  0x1    /* Fail with -EEXIST if the attribute exists */
+#define XATTR_REPLACE 0x2    /* Fail with -ENODATA if it does not */
+#endif
+
+/* Marks a free entry */
+#define XATTR_FREE_NAME      UINT32_MAX
+
+/**
+ * One attribute (32 bytes)
+ */
+struct xattr_entry {
+    uint32_t name_offset;        /* Interned name (XATTR_FREE_NAME = free) */
+    uint32_t next;               /* Next entry of the node (or free list), 0 = end */
+    uint32_t value_len;
+    uint32_t value_off;          /* Heap offset when value_len > XATTR_INLINE_MAX */
+    char inline_value[XATTR_INLINE_MAX];
+};
+
+/**
+ * Statistics
+ */
+struct xattr_stats {
+    uint64_t lookups;            /* get/list calls that reached the arena */
+    uint64_t negative;           /* Answered from xattr_head == 0 */
+};
+
+/**
+ * The arena
+ */
+struct xattr_store {
+    pthread_rwlock_t lock;       /* See the file comment */
+    struct string_table *names;  /* The tree's string table */
+
+    struct xattr_entry *entries; /* entries[0] is unused: index 0 = none */
+    uint32_t capacity;
+    uint32_t used;               /* Entries handed out so far (incl. [0]) */
+    uint32_t free_head;          /* Chain of freed entries */
+    uint32_t live;               /* Entries holding an attribute */
+
+    char *heap;                  /* Values over XATTR_INLINE_MAX */
+    uint32_t heap_capacity;
+    uint32_t heap_used;
+    uint32_t heap_garbage;       /* Bytes of removed values */
+
+    struct xattr_stats stats;    /* Updated with __atomic builtins */
+
+    /* Persistence (xattr_store_flush): the file is image_size bytes of
+     * image then records up to file_end (0/0 = never saved); dirty lists
+     * the entries changed since, dirty_count > XATTR_DIRTY_MAX = too many */
+    uint64_t image_size;
+    uint64_t file_end;
+    uint32_t dirty[XATTR_DIRTY_MAX];
+    uint32_t dirty_count;
+};
+
+/**
+ * Initialize an empty arena naming attributes in names
+ * @return 0 on success, -1 on failure
+ */
+int xattr_store_init(struct xattr_store *xs, struct string_table *names);
+
+/**
+ * Free the arena (names keep their references: the string table goes too)
+ */
+void xattr_store_destroy(struct xattr_store *xs);
+
+/**
+ * Copy out an attribute
+ * @param size Buffer size; 0 asks for the value size only
+ * @return Value size, -ENODATA if absent, -ERANGE if size is too small
+ */
+int xattr_get(struct xattr_store *xs, uint32_t head, const char *name,
+              void *value, size_t size);
+
+/**
+ * List attribute names as NUL-terminated strings back to back
+ * @param size Buffer size; 0 asks for the list size only
+ * @return List size, -ERANGE if size is too small
+ */
+int xattr_list(struct xattr_store *xs, uint32_t head, char *list, size_t size);
+
+/**
+ * Set an attribute of the chain at *head (updated when the chain changes)
+ * @param flags XATTR_CREATE or XATTR_REPLACE
+ * @return 0, -EEXIST / -ENODATA (flags), -ERANGE (name or value too long)
+ *         or -ENOSPC
+ */
+int xattr_set(struct xattr_store *xs, uint32_t *head, const char *name,
+              const void *value, size_t size, int flags);
+
+/**
+ * Remove an attribute of the chain at *head
+ * @return 0 or -ENODATA
+ */
+int xattr_remove(struct xattr_store *xs, uint32_t *head, const char *name);
+
+/**
+ * Free every attribute of a chain (its node is gone)
+ */
+void xattr_drop(struct xattr_store *xs, uint32_t head);
+
+/**
+ * Check a chain read from a node: the first entry that is out of range,
+ * free or already claimed cuts it off there
+ *
+ * @param claimed Bitmap of entries seen so far (capacity bits)
+ * @return The head to keep (0 if nothing usable is left)
+ */
+uint32_t xattr_claim(struct xattr_store *xs, uint32_t head, uint8_t *claimed);
+
+/**
+ * Free every live entry not set in claimed (the chains of removed nodes)
+ * @return Entries freed
+ */
+uint32_t xattr_sweep(struct xattr_store *xs, const uint8_t *claimed);
+
+/**
+ * Write the arena to path (through a temporary file and rename)
+ * @return 0 on success, -1 on failure
+ */
+int xattr_store_save(struct xattr_store *xs, const char *path);
+
+/**
+ * Persist the entries changed since the last save or flush by appending
+ * one record each to path; falls back to xattr_store_save when the file
+ * was never saved, too many entries changed or the records have outgrown
+ * the image
+ * @return 0 on success, -1 on failure (the changes stay for the next one)
+ */
+int xattr_store_flush(struct xattr_store *xs, const char *path);
+
+/**
+ * Replace the arena with the one saved at path, records applied in order
+ * up to the first torn or invalid one; names gain their references again
+ * @return 0 on success, -1 if the file is missing or invalid
+ */
+int xattr_store_load(struct xattr_store *xs, const char *path);
+
+/**
+ * Copy out the statistics
+ */
+void xattr_get_stats(struct xattr_store *xs, struct xattr_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* RAZORFS_XATTR_H */
@@ -0,0 +1,843 @@
+/**
+ * RAZORFS End-to-End Benchmark
+ *
+ * Runs a fixed workload matrix against a directory (normally a mounted
+ * razorfs_mt, see scripts/benchmarks/run_bench.sh) and reports latency
+ * percentiles and throughput as JSON:
+ * - metadata_storm: mkdir, create, rename, stat, unlink, rmdir per entry
+ * - small_files: create + 4KB write, stat, unlink (one phase each)
+ * - lookup: stat of random paths two directories deep, and full listings
+ *   of a directory holding as many entries (walks across the node array
+ *   and string table; see -o hugepages / -o prefetch)
+ * - seq_write / seq_read: 1MB I/Os over one file per thread, fsync included
+ * - rand_write / rand_read: 4KB I/Os at random offsets of that file
+ * Data workloads run with compressible and incompressible contents, and
+ * every workload at each thread count of the list.
+ *
+ * Each worker records every operation in its own log-linear histogram
+ * (16 sub-buckets per power of two, ~6% resolution); they are merged
+ * per phase. Throughput is taken over the wall time of the phase.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#define BENCH_FORMAT_VERSION  1
+#define BENCH_MAX_THREADS     256
+#define BENCH_SEQ_IO          (1u << 20)
+#define BENCH_RAND_IO         4096u
+#define BENCH_SMALL_FILE      4096u
+#define BENCH_LOOKUP_FANOUT   16u        /* Directories per level of the lookup tree */
+#define BENCH_LISTINGS        16u        /* Listings of the wide directory per thread */
+
+#define HIST_SUB_BITS  4
+#define HIST_SUB       (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS   (64 * HIST_SUB)
+
+/* === Configuration and results === */
+
+struct bench_config {
+    const char *dir;
+    const char *json_path;
+    const char *label;
+    const char *only;            /* Comma-separated workload names (NULL = all) */
+    unsigned int threads[32];
+    unsigned int thread_count;
+    unsigned int files;          /* Entries per thread (metadata, small files) */
+    unsigned int file_mb;        /* Per-thread file of the data workloads */
+    unsigned int io_ops;         /* Random I/Os per thread */
+    uint64_t seed;
+};
+
+struct bench_result {
+    char name[32];
+    char data[16];
+    unsigned int threads;
+    uint64_t ops;
+    uint64_t bytes;
+    double seconds;
+    double p50_us, p99_us, p999_us, max_us;
+};
+
+struct bench {
+    struct bench_config cfg;
+    char root[PATH_MAX / 4];
+    const char *data;            /* Contents of the current data workload */
+    struct bench_result *results;
+    size_t result_count;
+    size_t result_capacity;
+};
+
+struct worker {
+    struct bench *b;
+    unsigned int id;
+    pthread_t thread;
+    pthread_barrier_t *start;
+    int (*fn)(struct worker *w);
+
+    char dir[PATH_MAX / 2];
+    char *buf;                   /* BENCH_SEQ_IO bytes of the current data kind */
+    uint64_t rng;
+
+    uint64_t hist[HIST_BUCKETS];
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t max_ns;
+    int failed;
+};
+
+/* === Timing and histograms === */
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline unsigned int hist_index(uint64_t ns) {
+    if (ns < HIST_SUB) return (unsigned int)ns;
+    unsigned int msb = 63u - (unsigned int)__builtin_clzll(ns);
+    unsigned int sub = (unsigned int)(ns >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (msb - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+/* Middle of bucket idx, in ns */
+static double hist_value(unsigned int idx) {
+    if (idx < HIST_SUB) return idx;
+    unsigned int major = idx / HIST_SUB;
+    unsigned int sub = idx % HIST_SUB;
+    double low = (double)((uint64_t)(HIST_SUB + sub) << (major - 1));
+    return low + (double)(1ULL << (major - 1)) / 2;
+}
+
+static double hist_percentile(const uint64_t *hist, uint64_t count, double p) {
+    uint64_t target = (uint64_t)(p * (double)count + 0.999999);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= target) return hist_value(i);
+    }
+    return 0;
+}
+
+static inline void record(struct worker *w, uint64_t start, uint64_t bytes) {
+    uint64_t ns = now_ns() - start;
+    w->hist[hist_index(ns)]++;
+    w->ops++;
+    w->bytes += bytes;
+    if (ns > w->max_ns) w->max_ns = ns;
+}
+
+static int fail(struct worker *w, const char *what, const char *path) {
+    fprintf(stderr, "❌ worker %u: %s %s: %s\n", w->id, what, path, strerror(errno));
+    w->failed = 1;
+    return -1;
+}
+
+static uint64_t next_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/* === I/O helpers (whole buffer or failure) === */
+
+static int write_full(int fd, const char *buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0) errno = EIO;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int read_full(int fd, char *buf, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0) errno = EIO;  /* File shorter than written */
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* === Workloads === */
+
+static int metadata_storm(struct worker *w) {
+    char dir[PATH_MAX / 2 + 16], from[PATH_MAX], to[PATH_MAX];
+    struct stat st;
+
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        snprintf(dir, sizeof(dir), "%s/d%u", w->dir, i);
+        snprintf(from, sizeof(from), "%s/f", dir);
+        snprintf(to, sizeof(to), "%s/g", dir);
+
+        uint64_t t = now_ns();
+        if (mkdir(dir, 0755) != 0) return fail(w, "mkdir", dir);
+        record(w, t, 0);
+
+        t = now_ns();
+        int fd = open(from, O_CREAT | O_WRONLY | O_EXCL, 0644);
+        if (fd < 0) return fail(w, "create", from);
+        close(fd);
+        record(w, t, 0);
+
+        t = now_ns();
+        if (rename(from, to) != 0) return fail(w, "rename", from);
+        record(w, t, 0);
+
+        t = now_ns();
+        if (stat(to, &st) != 0) return fail(w, "stat", to);
+        record(w, t, 0);
+
+        t = now_ns();
+        if (unlink(to) != 0) return fail(w, "unlink", to);
+        record(w, t, 0);
+
+        t = now_ns();
+        if (rmdir(dir) != 0) return fail(w, "rmdir", dir);
+        record(w, t, 0);
+    }
+    return 0;
+}
+
+static void small_path(const struct worker *w, unsigned int i, char *path, size_t len) {
+    snprintf(path, len, "%s/s%u", w->dir, i);
+}
+
+static int small_create(struct worker *w) {
+    char path[PATH_MAX];
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        small_path(w, i, path, sizeof(path));
+        uint64_t t = now_ns();
+        int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        if (fd < 0) return fail(w, "create", path);
+        int ret = write_full(fd, w->buf, BENCH_SMALL_FILE, 0);
+        close(fd);
+        if (ret != 0) return fail(w, "write", path);
+        record(w, t, BENCH_SMALL_FILE);
+    }
+    return 0;
+}
+
+static int small_stat(struct worker *w) {
+    char path[PATH_MAX];
+    struct stat st;
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        small_path(w, i, path, sizeof(path));
+        uint64_t t = now_ns();
+        if (stat(path, &st) != 0) return fail(w, "stat", path);
+        record(w, t, 0);
+    }
+    return 0;
+}
+
+static int small_unlink(struct worker *w) {
+    char path[PATH_MAX];
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        small_path(w, i, path, sizeof(path));
+        uint64_t t = now_ns();
+        if (unlink(path) != 0) return fail(w, "unlink", path);
+        record(w, t, 0);
+    }
+    return 0;
+}
+
+/* Entry i of the lookup tree: L<a>/M<b>/f<i>, and W/f<i> in the wide directory */
+static void lookup_path(const struct worker *w, unsigned int i, char *path, size_t len) {
+    snprintf(path, len, "%s/L%u/M%u/f%u", w->dir, i % BENCH_LOOKUP_FANOUT,
+             i / BENCH_LOOKUP_FANOUT % BENCH_LOOKUP_FANOUT, i);
+}
+
+static void wide_path(const struct worker *w, unsigned int i, char *path, size_t len) {
+    snprintf(path, len, "%s/W/f%u", w->dir, i);
+}
+
+static int create_empty(struct worker *w, const char *path) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_EXCL, 0644);
+    if (fd < 0) return fail(w, "create", path);
+    close(fd);
+    return 0;
+}
+
+/* Setup (not timed): the lookup tree and the wide directory */
+static int lookup_build(struct worker *w) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/W", w->dir);
+    if (mkdir(path, 0755) != 0) return fail(w, "mkdir", path);
+    for (unsigned int a = 0; a < BENCH_LOOKUP_FANOUT; a++) {
+        snprintf(path, sizeof(path), "%s/L%u", w->dir, a);
+        if (mkdir(path, 0755) != 0) return fail(w, "mkdir", path);
+        for (unsigned int m = 0; m < BENCH_LOOKUP_FANOUT; m++) {
+            snprintf(path, sizeof(path), "%s/L%u/M%u", w->dir, a, m);
+            if (mkdir(path, 0755) != 0) return fail(w, "mkdir", path);
+        }
+    }
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        lookup_path(w, i, path, sizeof(path));
+        if (create_empty(w, path) != 0) return -1;
+        wide_path(w, i, path, sizeof(path));
+        if (create_empty(w, path) != 0) return -1;
+    }
+    return 0;
+}
+
+/* Random order: consecutive walks share no cache lines */
+static int lookup_stat(struct worker *w) {
+    char path[PATH_MAX];
+    struct stat st;
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        lookup_path(w, (unsigned int)(next_rand(&w->rng) % w->b->cfg.files), path, sizeof(path));
+        uint64_t t = now_ns();
+        if (stat(path, &st) != 0) return fail(w, "stat", path);
+        record(w, t, 0);
+    }
+    return 0;
+}
+
+/* One operation = one complete listing */
+static int lookup_readdir(struct worker *w) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/W", w->dir);
+    for (unsigned int pass = 0; pass < BENCH_LISTINGS; pass++) {
+        uint64_t t = now_ns();
+        DIR *dir = opendir(path);
+        if (!dir) return fail(w, "opendir", path);
+        unsigned int entries = 0;
+        while (readdir(dir)) entries++;
+        closedir(dir);
+        if (entries != w->b->cfg.files + 2) {
+            errno = EIO;  /* Entries missing from the listing */
+            return fail(w, "readdir", path);
+        }
+        record(w, t, 0);
+    }
+    return 0;
+}
+
+static int lookup_cleanup(struct worker *w) {
+    char path[PATH_MAX];
+    for (unsigned int i = 0; i < w->b->cfg.files; i++) {
+        lookup_path(w, i, path, sizeof(path));
+        if (unlink(path) != 0) return fail(w, "unlink", path);
+        wide_path(w, i, path, sizeof(path));
+        if (unlink(path) != 0) return fail(w, "unlink", path);
+    }
+    for (unsigned int a = 0; a < BENCH_LOOKUP_FANOUT; a++) {
+        for (unsigned int m = 0; m < BENCH_LOOKUP_FANOUT; m++) {
+            snprintf(path, sizeof(path), "%s/L%u/M%u", w->dir, a, m);
+            if (rmdir(path) != 0) return fail(w, "rmdir", path);
+        }
+        snprintf(path, sizeof(path), "%s/L%u", w->dir, a);
+        if (rmdir(path) != 0) return fail(w, "rmdir", path);
+    }
+    snprintf(path, sizeof(path), "%s/W", w->dir);
+    if (rmdir(path) != 0) return fail(w, "rmdir", path);
+    return 0;
+}
+
+static uint64_t data_file_size(const struct worker *w) {
+    return (uint64_t)w->b->cfg.file_mb << 20;
+}
+
+static void data_path(const struct worker *w, char *path, size_t len) {
+    snprintf(path, len, "%s/data", w->dir);
+}
+
+static int seq_write(struct worker *w) {
+    char path[PATH_MAX];
+    data_path(w, path, sizeof(path));
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) return fail(w, "create", path);
+
+    for (uint64_t off = 0; off < data_file_size(w); off += BENCH_SEQ_IO) {
+        uint64_t t = now_ns();
+        if (write_full(fd, w->buf, BENCH_SEQ_IO, (off_t)off) != 0) {
+            close(fd);
+            return fail(w, "write", path);
+        }
+        record(w, t, BENCH_SEQ_IO);
+    }
+
+    uint64_t t = now_ns();
+    if (fsync(fd) != 0) {
+        close(fd);
+        return fail(w, "fsync", path);
+    }
+    record(w, t, 0);
+    close(fd);
+    return 0;
+}
+
+static int seq_read(struct worker *w) {
+    char path[PATH_MAX];
+    data_path(w, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(w, "open", path);
+
+    char *buf = malloc(BENCH_SEQ_IO);
+    if (!buf) {
+        close(fd);
+        return fail(w, "malloc", path);
+    }
+    int ret = 0;
+    for (uint64_t off = 0; off < data_file_size(w); off += BENCH_SEQ_IO) {
+        uint64_t t = now_ns();
+        if (read_full(fd, buf, BENCH_SEQ_IO, (off_t)off) != 0) {
+            ret = fail(w, "read", path);
+            break;
+        }
+        record(w, t, BENCH_SEQ_IO);
+    }
+    free(buf);
+    close(fd);
+    return ret;
+}
+
+static off_t random_block(struct worker *w) {
+    uint64_t blocks = data_file_size(w) / BENCH_RAND_IO;
+    return (off_t)((next_rand(&w->rng) % blocks) * BENCH_RAND_IO);
+}
+
+static int rand_write(struct worker *w) {
+    char path[PATH_MAX];
+    data_path(w, path, sizeof(path));
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) return fail(w, "open", path);
+
+    for (unsigned int i = 0; i < w->b->cfg.io_ops; i++) {
+        off_t off = random_block(w);
+        const char *src = w->buf + (next_rand(&w->rng) % (BENCH_SEQ_IO / BENCH_RAND_IO)) *
+                                   BENCH_RAND_IO;
+        uint64_t t = now_ns();
+        if (write_full(fd, src, BENCH_RAND_IO, off) != 0) {
+            close(fd);
+            return fail(w, "write", path);
+        }
+        record(w, t, BENCH_RAND_IO);
+    }
+
+    uint64_t t = now_ns();
+    if (fsync(fd) != 0) {
+        close(fd);
+        return fail(w, "fsync", path);
+    }
+    record(w, t, 0);
+    close(fd);
+    return 0;
+}
+
+static int rand_read(struct worker *w) {
+    char path[PATH_MAX];
+    data_path(w, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(w, "open", path);
+
+    char buf[BENCH_RAND_IO];
+    for (unsigned int i = 0; i < w->b->cfg.io_ops; i++) {
+        off_t off = random_block(w);
+        uint64_t t = now_ns();
+        if (read_full(fd, buf, sizeof(buf), off) != 0) {
+            close(fd);
+            return fail(w, "read", path);
+        }
+        record(w, t, BENCH_RAND_IO);
+    }
+    close(fd);
+    return 0;
+}
+
+/* === Phases === */
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    pthread_barrier_wait(w->start);
+    w->fn(w);
+    return NULL;
+}
+
+static int add_result(struct bench *b, const struct bench_result *r) {
+    if (b->result_count == b->result_capacity) {
+        size_t capacity = b->result_capacity ? b->result_capacity * 2 : 64;
+        struct bench_result *grown = realloc(b->results, capacity * sizeof(*grown));
+        if (!grown) return -1;
+        b->results = grown;
+        b->result_capacity = capacity;
+    }
+    b->results[b->result_count++] = *r;
+    return 0;
+}
+
+/* Run fn on every worker at once and record the merged result (if keep) */
+static int run_phase_keep(struct bench *b, struct worker *workers, unsigned int threads,
+                          const char *name, int (*fn)(struct worker *w), int keep) {
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, threads + 1);
+
+    unsigned int started = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+        struct worker *w = &workers[i];
+        memset(w->hist, 0, sizeof(w->hist));
+        w->ops = w->bytes = w->max_ns = 0;
+        w->failed = 0;
+        w->fn = fn;
+        w->start = &start;
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) break;
+        started++;
+    }
+    if (started < threads) {
+        /* The barrier can never open: cannot happen short of ENOMEM, give up */
+        fprintf(stderr, "❌ Cannot start %u threads\n", threads);
+        exit(1);
+    }
+
+    /* Workers are held at the barrier until this thread reaches it */
+    uint64_t t0 = now_ns();
+    pthread_barrier_wait(&start);
+    for (unsigned int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    uint64_t elapsed = now_ns() - t0;
+    pthread_barrier_destroy(&start);
+
+    static uint64_t hist[HIST_BUCKETS];
+    memset(hist, 0, sizeof(hist));
+    struct bench_result r;
+    memset(&r, 0, sizeof(r));
+    uint64_t max_ns = 0;
+    int failed = 0;
+    for (unsigned int i = 0; i < threads; i++) {
+        const struct worker *w = &workers[i];
+        for (unsigned int k = 0; k < HIST_BUCKETS; k++) hist[k] += w->hist[k];
+        r.ops += w->ops;
+        r.bytes += w->bytes;
+        if (w->max_ns > max_ns) max_ns = w->max_ns;
+        failed |= w->failed;
+    }
+    if (failed) return -1;
+    if (!keep) return 0;
+
+    snprintf(r.name, sizeof(r.name), "%s", name);
+    snprintf(r.data, sizeof(r.data), "%s", b->data ? b->data : "none");
+    r.threads = threads;
+    r.seconds = (double)elapsed / 1e9;
+    r.max_us = (double)max_ns / 1000;
+    /* Bucket midpoints can exceed the largest sample on small runs */
+    r.p50_us = fmin(hist_percentile(hist, r.ops, 0.50) / 1000, r.max_us);
+    r.p99_us = fmin(hist_percentile(hist, r.ops, 0.99) / 1000, r.max_us);
+    r.p999_us = fmin(hist_percentile(hist, r.ops, 0.999) / 1000, r.max_us);
+
+    printf("  %-18s %-12s %3u thr  %9.0f ops/s  %8.1f MB/s  p50 %8.1f  p99 %9.1f  p999 %9.1f us\n",
+           r.name, r.data, r.threads, r.seconds > 0 ? (double)r.ops / r.seconds : 0,
+           r.seconds > 0 ? (double)r.bytes / r.seconds / 1048576 : 0,
+           r.p50_us, r.p99_us, r.p999_us);
+    fflush(stdout);
+    return add_result(b, &r);
+}
+
+static int run_phase(struct bench *b, struct worker *workers, unsigned int threads,
+                     const char *name, int (*fn)(struct worker *w)) {
+    return run_phase_keep(b, workers, threads, name, fn, 1);
+}
+
+static int wanted(const struct bench *b, const char *workload) {
+    if (!b->cfg.only) return 1;
+    size_t len = strlen(workload);
+    for (const char *p = b->cfg.only; *p; ) {
+        const char *end = strchrnul(p, ',');
+        if ((size_t)(end - p) == len && strncmp(p, workload, len) == 0) return 1;
+        p = *end ? end + 1 : end;
+    }
+    return 0;
+}
+
+/* Fill buf with the contents of one data kind */
+static void fill_data(char *buf, size_t len, const char *kind, uint64_t *rng) {
+    if (strcmp(kind, "compressible") == 0) {
+        static const char line[] = "razorfs benchmark record 0123456789 abcdefghijklmnopqrstuvwxyz\n";
+        for (size_t i = 0; i < len; i++) buf[i] = line[i % (sizeof(line) - 1)];
+        return;
+    }
+    for (size_t i = 0; i + 8 <= len; i += 8) {
+        uint64_t v = next_rand(rng);
+        memcpy(buf + i, &v, 8);
+    }
+}
+
+static int run_matrix(struct bench *b, unsigned int threads) {
+    struct worker *workers = calloc(threads, sizeof(*workers));
+    if (!workers) return -1;
+
+    int ret = 0;
+    for (unsigned int i = 0; i < threads && ret == 0; i++) {
+        struct worker *w = &workers[i];
+        w->b = b;
+        w->id = i;
+        w->rng = b->cfg.seed * 0x9E3779B97F4A7C15ULL + i + 1;
+        w->buf = malloc(BENCH_SEQ_IO);
+        snprintf(w->dir, sizeof(w->dir), "%s/t%u.w%u", b->root, threads, i);
+        if (!w->buf || mkdir(w->dir, 0755) != 0) {
+            perror(w->dir);
+            ret = -1;
+        }
+    }
+
+    b->data = NULL;
+    for (unsigned int i = 0; i < threads && ret == 0; i++) {
+        fill_data(workers[i].buf, BENCH_SEQ_IO, "random", &workers[i].rng);
+    }
+    if (ret == 0 && wanted(b, "metadata_storm")) {
+        ret = run_phase(b, workers, threads, "metadata_storm", metadata_storm);
+    }
+    if (ret == 0 && wanted(b, "small_files")) {
+        ret = run_phase(b, workers, threads, "small_files.create", small_create);
+        if (ret == 0) ret = run_phase(b, workers, threads, "small_files.stat", small_stat);
+        if (ret == 0) ret = run_phase(b, workers, threads, "small_files.unlink", small_unlink);
+    }
+    if (ret == 0 && wanted(b, "lookup")) {
+        ret = run_phase_keep(b, workers, threads, "lookup.build", lookup_build, 0);
+        if (ret == 0) ret = run_phase(b, workers, threads, "lookup.stat", lookup_stat);
+        if (ret == 0) ret = run_phase(b, workers, threads, "lookup.readdir", lookup_readdir);
+        if (ret == 0) ret = run_phase_keep(b, workers, threads, "lookup.cleanup", lookup_cleanup, 0);
+    }
+
+    static const char *const kinds[] = { "compressible", "random" };
+    for (unsigned int k = 0; k < 2 && ret == 0; k++) {
+        if (!wanted(b, "seq") && !wanted(b, "rand")) break;
+        b->data = kinds[k];
+        for (unsigned int i = 0; i < threads; i++) {
+            fill_data(workers[i].buf, BENCH_SEQ_IO, kinds[k], &workers[i].rng);
+        }
+
+        /* The random workloads need the file the sequential write leaves */
+        ret = run_phase_keep(b, workers, threads, "seq_write", seq_write, wanted(b, "seq"));
+        if (ret == 0 && wanted(b, "seq")) ret = run_phase(b, workers, threads, "seq_read", seq_read);
+        if (ret == 0 && wanted(b, "rand")) {
+            ret = run_phase(b, workers, threads, "rand_write", rand_write);
+            if (ret == 0) ret = run_phase(b, workers, threads, "rand_read", rand_read);
+        }
+        for (unsigned int i = 0; i < threads; i++) {
+            char path[PATH_MAX];
+            data_path(&workers[i], path, sizeof(path));
+            unlink(path);
+        }
+    }
+    b->data = NULL;
+
+    for (unsigned int i = 0; i < threads; i++) {
+        rmdir(workers[i].dir);
+        free(workers[i].buf);
+    }
+    free(workers);
+    return ret;
+}
+
+/* === Output === */
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', f);
+        if ((unsigned char)*s >= 0x20) fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static int write_json(const struct bench *b) {
+    FILE *f = strcmp(b->cfg.json_path, "-") == 0 ? stdout : fopen(b->cfg.json_path, "w");
+    if (!f) {
+        perror(b->cfg.json_path);
+        return -1;
+    }
+
+    struct utsname un;
+    memset(&un, 0, sizeof(un));
+    uname(&un);
+    time_t now = time(NULL);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n  \"format\": %d,\n  \"label\": ", BENCH_FORMAT_VERSION);
+    json_string(f, b->cfg.label ? b->cfg.label : "");
+    fprintf(f, ",\n  \"timestamp\": \"%s\",\n  \"host\": {\"kernel\": ", stamp);
+    json_string(f, un.release);
+    fprintf(f, ", \"machine\": ");
+    json_string(f, un.machine);
+    fprintf(f, ", \"cpus\": %ld},\n", sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(f, "  \"config\": {\"files\": %u, \"file_mb\": %u, \"io_ops\": %u, "
+               "\"seed\": %llu, \"threads\": [",
+            b->cfg.files, b->cfg.file_mb, b->cfg.io_ops, (unsigned long long)b->cfg.seed);
+    for (unsigned int i = 0; i < b->cfg.thread_count; i++) {
+        fprintf(f, "%s%u", i ? ", " : "", b->cfg.threads[i]);
+    }
+    fprintf(f, "]},\n  \"results\": [\n");
+
+    for (size_t i = 0; i < b->result_count; i++) {
+        const struct bench_result *r = &b->results[i];
+        double ops_s = r->seconds > 0 ? (double)r->ops / r->seconds : 0;
+        double mb_s = r->seconds > 0 ? (double)r->bytes / r->seconds / 1048576 : 0;
+        fprintf(f, "    {\"name\": \"%s\", \"data\": \"%s\", \"threads\": %u, "
+                   "\"ops\": %llu, \"bytes\": %llu, \"seconds\": %.6f, "
+                   "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+                   "\"latency_us\": {\"p50\": %.2f, \"p99\": %.2f, \"p999\": %.2f, \"max\": %.2f}}%s\n",
+                r->name, r->data, r->threads, (unsigned long long)r->ops,
+                (unsigned long long)r->bytes, r->seconds, ops_s, mb_s,
+                r->p50_us, r->p99_us, r->p999_us, r->max_us,
+                i + 1 < b->result_count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+
+    if (f != stdout) fclose(f);
+    return 0;
+}
+
+/* === Main === */
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --dir DIR [options]\n"
+            "  --dir DIR         Directory to run in (a razorfs mount)\n"
+            "  --json FILE       Write results as JSON (- = stdout)\n"
+            "  --threads N       Thread counts 1, 2, 4, ... up to N (default: CPUs)\n"
+            "  --thread-list L   Explicit thread counts, e.g. 1,4,16\n"
+            "  --files N         Entries per thread for metadata workloads (2000)\n"
+            "  --file-mb N       File size per thread for data workloads (64)\n"
+            "  --io-ops N        Random I/Os per thread (4096)\n"
+            "  --only LIST       Workloads: metadata_storm,small_files,lookup,seq,rand\n"
+            "  --seed N          Random seed (1)\n"
+            "  --label TEXT      Stored in the JSON (e.g. the git revision)\n",
+            prog);
+}
+
+static void power_list(struct bench_config *cfg, unsigned int max) {
+    cfg->thread_count = 0;
+    for (unsigned int t = 1; t < max && cfg->thread_count < 31; t *= 2) {
+        cfg->threads[cfg->thread_count++] = t;
+    }
+    cfg->threads[cfg->thread_count++] = max;
+}
+
+static int parse_list(struct bench_config *cfg, const char *list) {
+    cfg->thread_count = 0;
+    for (const char *p = list; *p; ) {
+        char *end;
+        unsigned long t = strtoul(p, &end, 10);
+        if (end == p || t == 0 || t > BENCH_MAX_THREADS || cfg->thread_count == 32) return -1;
+        cfg->threads[cfg->thread_count++] = (unsigned int)t;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return cfg->thread_count ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    struct bench b;
+    memset(&b, 0, sizeof(b));
+    b.cfg.files = 2000;
+    b.cfg.file_mb = 64;
+    b.cfg.io_ops = 4096;
+    b.cfg.seed = 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    power_list(&b.cfg, cpus > 0 && cpus <= BENCH_MAX_THREADS ? (unsigned int)cpus : 1);
+
+    static const struct option options[] = {
+        {"dir", required_argument, NULL, 'd'},
+        {"json", required_argument, NULL, 'j'},
+        {"threads", required_argument, NULL, 't'},
+        {"thread-list", required_argument, NULL, 'T'},
+        {"files", required_argument, NULL, 'f'},
+        {"file-mb", required_argument, NULL, 'm'},
+        {"io-ops", required_argument, NULL, 'i'},
+        {"only", required_argument, NULL, 'o'},
+        {"seed", required_argument, NULL, 's'},
+        {"label", required_argument, NULL, 'l'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "d:j:t:T:f:m:i:o:s:l:h", options, NULL)) != -1) {
+        unsigned long v = optarg ? strtoul(optarg, NULL, 10) : 0;
+        switch (c) {
+        case 'd': b.cfg.dir = optarg; break;
+        case 'j': b.cfg.json_path = optarg; break;
+        case 't':
+            if (v == 0 || v > BENCH_MAX_THREADS) {
+                usage(argv[0]);
+                return 2;
+            }
+            power_list(&b.cfg, (unsigned int)v);
+            break;
+        case 'T':
+            if (parse_list(&b.cfg, optarg) != 0) {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'f': b.cfg.files = (unsigned int)v; break;
+        case 'm': b.cfg.file_mb = (unsigned int)v; break;
+        case 'i': b.cfg.io_ops = (unsigned int)v; break;
+        case 'o': b.cfg.only = optarg; break;
+        case 's': b.cfg.seed = v; break;
+        case 'l': b.cfg.label = optarg; break;
+        default:
+            usage(argv[0]);
+            return c == 'h' ? 0 : 2;
+        }
+    }
+    if (!b.cfg.dir || b.cfg.files == 0 || b.cfg.file_mb == 0 || b.cfg.io_ops == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    /* A fresh directory per run: earlier runs cannot skew this one */
+    snprintf(b.root, sizeof(b.root), "%s/razorfs_bench.%ld", b.cfg.dir, (long)getpid());
+    if (mkdir(b.root, 0755) != 0) {
+        perror(b.root);
+        return 1;
+    }
+
+    printf("🏁 RAZORFS benchmark in %s\n", b.root);
+    int ret = 0;
+    for (unsigned int i = 0; i < b.cfg.thread_count && ret == 0; i++) {
+        ret = run_matrix(&b, b.cfg.threads[i]);
+    }
+    rmdir(b.root);
+
+    if (ret != 0) {
+        fprintf(stderr, "❌ Benchmark aborted (an operation failed)\n");
+        free(b.results);
+        return 1;
+    }
+    if (b.cfg.json_path && write_json(&b) != 0) ret = 1;
+    free(b.results);
+    return ret;
+}
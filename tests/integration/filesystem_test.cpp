@@ -44,19 +44,19 @@ protected:
 
 TEST_F(FilesystemIntegrationTest, CreateDirectoryTree) {
     // Create typical directory structure: /home/user/documents
-    uint16_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
+    uint32_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
                                    S_IFDIR | 0755);
     ASSERT_NE(home, NARY_INVALID_IDX);
 
-    uint16_t user = nary_insert_mt(tree, home, "user",
+    uint32_t user = nary_insert_mt(tree, home, "user",
                                    S_IFDIR | 0755);
     ASSERT_NE(user, NARY_INVALID_IDX);
 
-    uint16_t docs = nary_insert_mt(tree, user, "documents",
+    uint32_t docs = nary_insert_mt(tree, user, "documents",
                                    S_IFDIR | 0755);
     ASSERT_NE(docs, NARY_INVALID_IDX);
 
-    uint16_t pics = nary_insert_mt(tree, user, "pictures",
+    uint32_t pics = nary_insert_mt(tree, user, "pictures",
                                    S_IFDIR | 0755);
     ASSERT_NE(pics, NARY_INVALID_IDX);
 
@@ -69,16 +69,16 @@ TEST_F(FilesystemIntegrationTest, CreateDirectoryTree) {
 
 TEST_F(FilesystemIntegrationTest, CreateAndDeleteFiles) {
     // Create directory
-    uint16_t dir = nary_insert_mt(tree, NARY_ROOT_IDX, "testdir",
+    uint32_t dir = nary_insert_mt(tree, NARY_ROOT_IDX, "testdir",
                                   S_IFDIR | 0755);
     ASSERT_NE(dir, NARY_INVALID_IDX);
 
     // Create files
-    uint16_t file1 = nary_insert_mt(tree, dir, "file1.txt",
+    uint32_t file1 = nary_insert_mt(tree, dir, "file1.txt",
                                     S_IFREG | 0644);
-    uint16_t file2 = nary_insert_mt(tree, dir, "file2.txt",
+    uint32_t file2 = nary_insert_mt(tree, dir, "file2.txt",
                                     S_IFREG | 0644);
-    uint16_t file3 = nary_insert_mt(tree, dir, "file3.txt",
+    uint32_t file3 = nary_insert_mt(tree, dir, "file3.txt",
                                     S_IFREG | 0644);
 
     ASSERT_NE(file1, NARY_INVALID_IDX);
@@ -103,24 +103,24 @@ TEST_F(FilesystemIntegrationTest, CreateAndDeleteFiles) {
 
 TEST_F(FilesystemIntegrationTest, PersistenceWorkflow) {
     // Create complex structure
-    uint16_t projects = nary_insert_mt(tree, NARY_ROOT_IDX, "projects",
+    uint32_t projects = nary_insert_mt(tree, NARY_ROOT_IDX, "projects",
                                        S_IFDIR | 0755);
     ASSERT_NE(projects, NARY_INVALID_IDX);
 
-    uint16_t proj1 = nary_insert_mt(tree, projects, "project1",
+    uint32_t proj1 = nary_insert_mt(tree, projects, "project1",
                                     S_IFDIR | 0755);
-    uint16_t proj2 = nary_insert_mt(tree, projects, "project2",
+    uint32_t proj2 = nary_insert_mt(tree, projects, "project2",
                                     S_IFDIR | 0755);
 
     ASSERT_NE(proj1, NARY_INVALID_IDX);
     ASSERT_NE(proj2, NARY_INVALID_IDX);
 
     // Add files to projects
-    uint16_t readme1 = nary_insert_mt(tree, proj1, "README.md",
+    uint32_t readme1 = nary_insert_mt(tree, proj1, "README.md",
                                       S_IFREG | 0644);
-    uint16_t code1 = nary_insert_mt(tree, proj1, "main.c",
+    uint32_t code1 = nary_insert_mt(tree, proj1, "main.c",
                                     S_IFREG | 0644);
-    uint16_t readme2 = nary_insert_mt(tree, proj2, "README.md",
+    uint32_t readme2 = nary_insert_mt(tree, proj2, "README.md",
                                       S_IFREG | 0644);
 
     ASSERT_NE(readme1, NARY_INVALID_IDX);
@@ -137,11 +137,11 @@ TEST_F(FilesystemIntegrationTest, PersistenceWorkflow) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     // Verify entire structure persisted
-    uint16_t found_projects = nary_find_child_mt(tree, NARY_ROOT_IDX, "projects");
+    uint32_t found_projects = nary_find_child_mt(tree, NARY_ROOT_IDX, "projects");
     ASSERT_NE(found_projects, NARY_INVALID_IDX);
 
-    uint16_t found_proj1 = nary_find_child_mt(tree, found_projects, "project1");
-    uint16_t found_proj2 = nary_find_child_mt(tree, found_projects, "project2");
+    uint32_t found_proj1 = nary_find_child_mt(tree, found_projects, "project1");
+    uint32_t found_proj2 = nary_find_child_mt(tree, found_projects, "project2");
 
     ASSERT_NE(found_proj1, NARY_INVALID_IDX);
     ASSERT_NE(found_proj2, NARY_INVALID_IDX);
@@ -252,16 +252,16 @@ TEST_F(FilesystemIntegrationTest, CompressionStats) {
 
 TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
     // User creates home directory
-    uint16_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
+    uint32_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
                                    S_IFDIR | 0755);
     ASSERT_NE(home, NARY_INVALID_IDX);
 
-    uint16_t alice = nary_insert_mt(tree, home, "alice",
+    uint32_t alice = nary_insert_mt(tree, home, "alice",
                                     S_IFDIR | 0755);
     ASSERT_NE(alice, NARY_INVALID_IDX);
 
     // Alice creates documents
-    uint16_t docs = nary_insert_mt(tree, alice, "documents",
+    uint32_t docs = nary_insert_mt(tree, alice, "documents",
                                    S_IFDIR | 0755);
     ASSERT_NE(docs, NARY_INVALID_IDX);
 
@@ -270,13 +270,13 @@ TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
         char filename[32];
         snprintf(filename, sizeof(filename), "document_%d.txt", i);
 
-        uint16_t file = nary_insert_mt(tree, docs, filename,
+        uint32_t file = nary_insert_mt(tree, docs, filename,
                                        S_IFREG | 0644);
         EXPECT_NE(file, NARY_INVALID_IDX);
     }
 
     // Alice creates a backup directory
-    uint16_t backup = nary_insert_mt(tree, alice, "backup",
+    uint32_t backup = nary_insert_mt(tree, alice, "backup",
                                      S_IFDIR | 0700);
     ASSERT_NE(backup, NARY_INVALID_IDX);
 
@@ -288,9 +288,9 @@ TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     // Verify Alice's files are still there
-    uint16_t found_home = nary_find_child_mt(tree, NARY_ROOT_IDX, "home");
-    uint16_t found_alice = nary_find_child_mt(tree, found_home, "alice");
-    uint16_t found_docs = nary_find_child_mt(tree, found_alice, "documents");
+    uint32_t found_home = nary_find_child_mt(tree, NARY_ROOT_IDX, "home");
+    uint32_t found_alice = nary_find_child_mt(tree, found_home, "alice");
+    uint32_t found_docs = nary_find_child_mt(tree, found_alice, "documents");
 
     ASSERT_NE(found_docs, NARY_INVALID_IDX);
 
@@ -298,7 +298,7 @@ TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
         char filename[32];
         snprintf(filename, sizeof(filename), "document_%d.txt", i);
 
-        uint16_t file = nary_find_child_mt(tree, found_docs, filename);
+        uint32_t file = nary_find_child_mt(tree, found_docs, filename);
         EXPECT_NE(file, NARY_INVALID_IDX) << "Missing: " << filename;
     }
 
@@ -307,7 +307,7 @@ TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
         char filename[32];
         snprintf(filename, sizeof(filename), "document_%d.txt", i);
 
-        uint16_t file = nary_find_child_mt(tree, found_docs, filename);
+        uint32_t file = nary_find_child_mt(tree, found_docs, filename);
         if (file != NARY_INVALID_IDX) {
             EXPECT_EQ(nary_delete_mt(tree, file, nullptr, 0), 0);
         }
@@ -330,12 +330,12 @@ TEST_F(FilesystemIntegrationTest, SimulateUserWorkflow) {
 
 TEST_F(FilesystemIntegrationTest, MultipleUsersScenario) {
     // Create home directories for multiple users
-    uint16_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
+    uint32_t home = nary_insert_mt(tree, NARY_ROOT_IDX, "home",
                                    S_IFDIR | 0755);
     ASSERT_NE(home, NARY_INVALID_IDX);
 
     const char* users[] = {"alice", "bob", "charlie"};
-    uint16_t user_dirs[3];
+    uint32_t user_dirs[3];
 
     for (int i = 0; i < 3; i++) {
         user_dirs[i] = nary_insert_mt(tree, home, users[i],
@@ -347,7 +347,7 @@ TEST_F(FilesystemIntegrationTest, MultipleUsersScenario) {
             char filename[64];
             snprintf(filename, sizeof(filename), "%s_file_%d.txt", users[i], j);
 
-            uint16_t file = nary_insert_mt(tree, user_dirs[i], filename,
+            uint32_t file = nary_insert_mt(tree, user_dirs[i], filename,
                                            S_IFREG | 0644);
             EXPECT_NE(file, NARY_INVALID_IDX);
         }
@@ -361,18 +361,18 @@ TEST_F(FilesystemIntegrationTest, MultipleUsersScenario) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     // Verify all users and their files
-    uint16_t found_home = nary_find_child_mt(tree, NARY_ROOT_IDX, "home");
+    uint32_t found_home = nary_find_child_mt(tree, NARY_ROOT_IDX, "home");
     ASSERT_NE(found_home, NARY_INVALID_IDX);
 
     for (int i = 0; i < 3; i++) {
-        uint16_t found_user = nary_find_child_mt(tree, found_home, users[i]);
+        uint32_t found_user = nary_find_child_mt(tree, found_home, users[i]);
         ASSERT_NE(found_user, NARY_INVALID_IDX) << "Missing user: " << users[i];
 
         for (int j = 0; j < 5; j++) {
             char filename[64];
             snprintf(filename, sizeof(filename), "%s_file_%d.txt", users[i], j);
 
-            uint16_t file = nary_find_child_mt(tree, found_user, filename);
+            uint32_t file = nary_find_child_mt(tree, found_user, filename);
             EXPECT_NE(file, NARY_INVALID_IDX)
                 << "Missing file: " << filename << " for user " << users[i];
         }
@@ -50,10 +50,10 @@ TEST_F(ConcurrencyTest, ConcurrentReads) {
     constexpr int READS_PER_THREAD = 1000;
 
     // Create some test nodes first
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < 100; i++) {
         std::string name = "file" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(), S_IFREG | 0644);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(), S_IFREG | 0644);
         ASSERT_NE(idx, NARY_INVALID_IDX);
         indices.push_back(idx);
     }
@@ -64,7 +64,7 @@ TEST_F(ConcurrencyTest, ConcurrentReads) {
 
     auto reader_func = [&]() {
         for (int i = 0; i < READS_PER_THREAD; i++) {
-            uint16_t idx = indices[i % indices.size()];
+            uint32_t idx = indices[i % indices.size()];
             nary_node node;
             if (nary_read_node_mt(&tree, idx, &node) == 0) {
                 successful_reads++;
@@ -101,7 +101,7 @@ TEST_F(ConcurrencyTest, ConcurrentWrites) {
         for (int i = 0; i < WRITES_PER_THREAD; i++) {
             std::string name = "thread" + std::to_string(thread_id) +
                              "_file" + std::to_string(i);
-            uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+            uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                          S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 successful_writes++;
@@ -134,10 +134,10 @@ TEST_F(ConcurrencyTest, MixedReadWriteWorkload) {
     constexpr int OPS_PER_THREAD = 500;
 
     // Pre-populate tree
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < 50; i++) {
         std::string name = "initial" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                      S_IFREG | 0644);
         ASSERT_NE(idx, NARY_INVALID_IDX);
         indices.push_back(idx);
@@ -154,7 +154,7 @@ TEST_F(ConcurrencyTest, MixedReadWriteWorkload) {
         std::uniform_int_distribution<> dis(0, indices.size() - 1);
 
         while (!stop && reads < OPS_PER_THREAD) {
-            uint16_t idx = indices[dis(gen)];
+            uint32_t idx = indices[dis(gen)];
             nary_node node;
             if (nary_read_node_mt(&tree, idx, &node) == 0) {
                 reads++;
@@ -168,7 +168,7 @@ TEST_F(ConcurrencyTest, MixedReadWriteWorkload) {
         while (!stop && local_writes < OPS_PER_THREAD) {
             std::string name = "write_t" + std::to_string(thread_id) +
                              "_" + std::to_string(local_writes);
-            uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+            uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                          S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 local_writes++;
@@ -234,7 +234,7 @@ TEST_F(ConcurrencyTest, HighContentionStress) {
                 // Write operation
                 std::string name = "stress_" + std::to_string(thread_id) +
                                  "_" + std::to_string(operations.load());
-                uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+                uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                              S_IFREG | 0644);
                 if (idx != NARY_INVALID_IDX) {
                     operations++;
@@ -243,7 +243,7 @@ TEST_F(ConcurrencyTest, HighContentionStress) {
                 }
             } else {
                 // Lookup operation
-                uint16_t idx = nary_path_lookup_mt(&tree, "/");
+                uint32_t idx = nary_path_lookup_mt(&tree, "/");
                 if (idx == NARY_ROOT_IDX) {
                     operations++;
                 }
@@ -332,7 +332,7 @@ TEST_F(ConcurrencyTest, MemoryLimitEnforcement) {
         for (int i = 0; i < 500; i++) {
             std::string name = "mem_t" + std::to_string(thread_id) +
                              "_" + std::to_string(i);
-            uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+            uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                          S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 successful++;
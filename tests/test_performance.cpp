@@ -93,7 +93,7 @@ TEST_F(PerformanceTest, InsertionBenchmark) {
 
     auto avg_time = measure_operation(NUM_INSERTS, [&](int i) {
         std::string name = "bench_" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                      S_IFREG | 0644);
         ASSERT_NE(idx, NARY_INVALID_IDX);
     });
@@ -128,7 +128,7 @@ TEST_F(PerformanceTest, LookupBenchmark) {
 
     auto avg_time = measure_operation(NUM_LOOKUPS, [&](int) {
         const auto& path = paths[dis(gen)];
-        uint16_t idx = nary_path_lookup_mt(&tree, path.c_str());
+        uint32_t idx = nary_path_lookup_mt(&tree, path.c_str());
         ASSERT_NE(idx, NARY_INVALID_IDX);
     });
 
@@ -145,10 +145,10 @@ TEST_F(PerformanceTest, DeletionBenchmark) {
     constexpr int NUM_NODES = 5000;
 
     // Pre-populate
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < NUM_NODES; i++) {
         std::string name = "delete_" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                      S_IFREG | 0644);
         ASSERT_NE(idx, NARY_INVALID_IDX);
         indices.push_back(idx);
@@ -174,10 +174,10 @@ TEST_F(PerformanceTest, ReadNodeBenchmark) {
     constexpr int NUM_READS = 10000;
 
     // Pre-populate
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < NUM_NODES; i++) {
         std::string name = "read_" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                      S_IFREG | 0644);
         indices.push_back(idx);
     }
@@ -189,7 +189,7 @@ TEST_F(PerformanceTest, ReadNodeBenchmark) {
 
     nary_node node;
     auto avg_time = measure_operation(NUM_READS, [&](int) {
-        uint16_t idx = indices[dis(gen)];
+        uint32_t idx = indices[dis(gen)];
         int ret = nary_read_node_mt(&tree, idx, &node);
         ASSERT_EQ(ret, 0);
     });
@@ -239,7 +239,7 @@ TEST_F(PerformanceTest, AllocationBenchmark) {
 
     auto avg_time = measure_operation(NUM_ALLOCS, [&](int i) {
         std::string name = "alloc_" + std::to_string(i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(),
                                      S_IFREG | 0644);
         ASSERT_NE(idx, NARY_INVALID_IDX);
     });
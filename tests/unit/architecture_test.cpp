@@ -11,6 +11,7 @@
 #include <gmock/gmock.h>
 #include <cmath>
 #include <thread>
+#include <string>
 #include <vector>
 #include <chrono>
 
@@ -44,7 +45,7 @@ TEST_F(NaryArchitectureTest, SixteenWayBranchingFactor) {
         << "Tree should have a branching factor of 16";
 
     // Create directory and fill with 16 children
-    uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "test_dir",
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "test_dir",
                                   S_IFDIR | 0755);
     ASSERT_NE(dir, NARY_INVALID_IDX);
 
@@ -53,24 +54,25 @@ TEST_F(NaryArchitectureTest, SixteenWayBranchingFactor) {
         char name[32];
         snprintf(name, sizeof(name), "child_%02d", i);
 
-        uint16_t child = nary_insert_mt(&tree, dir, name, S_IFREG | 0644);
+        uint32_t child = nary_insert_mt(&tree, dir, name, S_IFREG | 0644);
         EXPECT_NE(child, NARY_INVALID_IDX) << "Failed at child " << i;
     }
 
     // Verify exactly 16 children were created
     struct nary_node_mt *node = &tree.nodes[dir];
     EXPECT_EQ(node->node.num_children, 16)
-        << "Directory should have exactly 16 children (max capacity)";
-
-    // 17th child should FAIL - fixed array size for cache optimization
-    // Node is 64 bytes with 16-child array to fit in single cache line
-    uint16_t overflow = nary_insert_mt(&tree, dir, "overflow", S_IFREG | 0644);
-    EXPECT_EQ(overflow, NARY_INVALID_IDX)
-        << "17th child should fail - branching factor is fixed at 16 for cache alignment";
-
-    // Child count should still be 16
-    EXPECT_EQ(node->node.num_children, 16)
-        << "Child count should remain at 16 (max capacity reached)";
+        << "Directory should have exactly 16 children (one full leaf block)";
+
+    // 17th child splits the leaf block instead of failing; the node
+    // itself stays one 64-byte cache line
+    uint32_t overflow = nary_insert_mt(&tree, dir, "overflow", S_IFREG | 0644);
+    EXPECT_NE(overflow, NARY_INVALID_IDX)
+        << "17th child should spill into the directory's block tree";
+
+    EXPECT_EQ(node->node.num_children, 17);
+    EXPECT_EQ(NARY_CHILD_HEIGHT(&node->node), 1u)
+        << "Two leaf blocks under one interior block";
+    EXPECT_EQ(nary_find_child_mt(&tree, dir, "overflow"), overflow);
 }
 
 TEST_F(NaryArchitectureTest, LogarithmicComplexity) {
@@ -80,27 +82,34 @@ TEST_F(NaryArchitectureTest, LogarithmicComplexity) {
     const int NUM_NODES = 4096;  // 16^3 = 4096
     const int EXPECTED_MAX_DEPTH = 4;  // log₁₆(4096) ≈ 3, +1 for root
 
-    uint16_t parent = NARY_ROOT_IDX;
+    // Fill a complete 16-way tree level by level; directories no longer
+    // stop at 16 entries, so the shape is built explicitly. Rebalancing
+    // renumbers nodes, so parents are looked up by path.
+    std::vector<std::string> level_paths = { "" };
     int actual_depth = 0;
 
-    // Fill tree level by level
-    for (int level = 0; level < EXPECTED_MAX_DEPTH && tree.used < NUM_NODES; level++) {
+    while (actual_depth < EXPECTED_MAX_DEPTH && tree.used < NUM_NODES) {
         actual_depth++;
-
-        // Create directory at this level
-        char name[32];
-        snprintf(name, sizeof(name), "level_%d", level);
-
-        uint16_t dir = nary_insert_mt(&tree, parent, name, S_IFDIR | 0755);
-        if (dir == NARY_INVALID_IDX) break;
-
-        // Fill with files up to capacity
-        for (int i = 0; i < 16 && tree.used < NUM_NODES; i++) {
-            snprintf(name, sizeof(name), "file_%d_%d", level, i);
-            nary_insert_mt(&tree, dir, name, S_IFREG | 0644);
+        bool leaves = (int)level_paths.size() * 16 >= NUM_NODES / 16;
+
+        std::vector<std::string> next;
+        for (const std::string &path : level_paths) {
+            for (int i = 0; i < 16; i++) {
+                uint32_t dir = path.empty() ? NARY_ROOT_IDX
+                                            : nary_path_lookup_mt(&tree, path.c_str());
+                ASSERT_NE(dir, NARY_INVALID_IDX) << path;
+
+                char name[32];
+                snprintf(name, sizeof(name), "%s_%d_%d", leaves ? "file" : "level",
+                         actual_depth, i);
+                ASSERT_NE(nary_insert_mt(&tree, dir, name,
+                                         leaves ? (S_IFREG | 0644) : (S_IFDIR | 0755)),
+                          NARY_INVALID_IDX) << path << "/" << name;
+                next.push_back(path + "/" + name);
+            }
         }
-
-        parent = dir;
+        level_paths.swap(next);
+        if (leaves) break;
     }
 
     // Verify logarithmic depth
@@ -126,7 +135,7 @@ TEST_F(NaryArchitectureTest, SixtyFourByteAlignment) {
 
     // Check multiple nodes
     for (int i = 0; i < 10; i++) {
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX,
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX,
                                       ("test_" + std::to_string(i)).c_str(),
                                       S_IFREG | 0644);
         if (idx != NARY_INVALID_IDX) {
@@ -257,8 +266,8 @@ TEST_F(LockingArchitectureTest, PerInodeLocking) {
     EXPECT_NE(root_lock, nullptr);
 
     // Create multiple nodes and verify independent locks
-    uint16_t idx1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1", S_IFREG | 0644);
-    uint16_t idx2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2", S_IFREG | 0644);
+    uint32_t idx1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1", S_IFREG | 0644);
+    uint32_t idx2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2", S_IFREG | 0644);
 
     ASSERT_NE(idx1, NARY_INVALID_IDX);
     ASSERT_NE(idx2, NARY_INVALID_IDX);
@@ -274,10 +283,10 @@ TEST_F(LockingArchitectureTest, PerInodeLocking) {
 TEST_F(LockingArchitectureTest, DeadlockPrevention_ParentBeforeChild) {
     // Test that parent is locked before child (prevents deadlock)
 
-    uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir", S_IFDIR | 0755);
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir", S_IFDIR | 0755);
     ASSERT_NE(dir, NARY_INVALID_IDX);
 
-    uint16_t file = nary_insert_mt(&tree, dir, "myfile", S_IFREG | 0644);
+    uint32_t file = nary_insert_mt(&tree, dir, "myfile", S_IFREG | 0644);
     ASSERT_NE(file, NARY_INVALID_IDX);
 
     // Lock parent first
@@ -292,7 +301,7 @@ TEST_F(LockingArchitectureTest, DeadlockPrevention_ParentBeforeChild) {
 }
 
 TEST_F(LockingArchitectureTest, ReaderWriterLockFunctionality) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "test", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "test", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
 
     // Multiple readers should succeed
@@ -309,8 +318,8 @@ TEST_F(LockingArchitectureTest, ReaderWriterLockFunctionality) {
 
 TEST_F(LockingArchitectureTest, ConcurrentAccessDifferentInodes) {
     // Create two files
-    uint16_t file1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1", S_IFREG | 0644);
-    uint16_t file2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2", S_IFREG | 0644);
+    uint32_t file1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1", S_IFREG | 0644);
+    uint32_t file2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2", S_IFREG | 0644);
 
     ASSERT_NE(file1, NARY_INVALID_IDX);
     ASSERT_NE(file2, NARY_INVALID_IDX);
@@ -346,7 +355,7 @@ TEST_F(LockingArchitectureTest, ConcurrentAccessDifferentInodes) {
 
 TEST_F(LockingArchitectureTest, LockContentionMetrics) {
     // Measure lock contention with multiple threads on same inode
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "contended", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "contended", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
 
     const int NUM_THREADS = 4;
@@ -436,27 +445,25 @@ TEST_F(NaryArchitectureTest, InsertPerformanceScaling) {
 
 TEST_F(NaryArchitectureTest, LookupPerformanceScaling) {
     // Create a hierarchical tree structure to test lookup performance
-    // With 16-way branching, each directory has MAX 16 children (fixed)
-    // Root can only hold 16 children, so we create fewer directories
-    const int NUM_DIRS = 8;  // Reduced to fit in root's 16-child limit
+    // With 16-way branching, each directory's children fill 16-entry leaves
+    const int NUM_DIRS = 8;
     const int FILES_PER_DIR = 10;  // 10 files per directory
 
-    std::vector<uint16_t> dir_indices;
+    std::vector<uint32_t> dir_indices;
 
     // Create directories in root
     for (int d = 0; d < NUM_DIRS; d++) {
         char dirname[32];
         snprintf(dirname, sizeof(dirname), "dir_%02d", d);
-        uint16_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
-        ASSERT_NE(dir_idx, NARY_INVALID_IDX) << "Failed to create directory " << d 
-                                             << " (root may be full - max 16 children)";
+        uint32_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
+        ASSERT_NE(dir_idx, NARY_INVALID_IDX) << "Failed to create directory " << d;
         dir_indices.push_back(dir_idx);
 
         // Fill each directory with files (well under branching factor limit)
         for (int f = 0; f < FILES_PER_DIR; f++) {
             char filename[32];
             snprintf(filename, sizeof(filename), "file_%04d", f);
-            uint16_t file_idx = nary_insert_mt(&tree, dir_idx, filename, S_IFREG | 0644);
+            uint32_t file_idx = nary_insert_mt(&tree, dir_idx, filename, S_IFREG | 0644);
             ASSERT_NE(file_idx, NARY_INVALID_IDX)
                 << "Failed to create file " << f << " in directory " << d;
         }
@@ -470,7 +477,7 @@ TEST_F(NaryArchitectureTest, LookupPerformanceScaling) {
         for (int f = 0; f < FILES_PER_DIR; f++) {
             char filename[32];
             snprintf(filename, sizeof(filename), "file_%04d", f);
-            uint16_t found = nary_find_child_mt(&tree, dir_indices[d], filename);
+            uint32_t found = nary_find_child_mt(&tree, dir_indices[d], filename);
             EXPECT_NE(found, NARY_INVALID_IDX);
             total_lookups++;
         }
@@ -0,0 +1,212 @@
+/**
+ * Compression Pool Unit Tests
+ * Tests for the background compression worker queue
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "compress_pool.h"
+#include "extent_store.h"
+}
+
+struct PoolRecorder {
+    std::atomic<int> calls{0};
+    std::atomic<uint32_t> last_inode{0};
+    std::atomic<int> retries_left{0};
+};
+
+static int record_cb(void *ctx, uint32_t inode) {
+    auto *rec = static_cast<PoolRecorder *>(ctx);
+    rec->last_inode = inode;
+    rec->calls++;
+    if (rec->retries_left > 0) {
+        rec->retries_left--;
+        return 1;
+    }
+    return 0;
+}
+
+class CompressPoolTest : public ::testing::Test {
+protected:
+    struct compress_pool pool;
+    PoolRecorder rec;
+
+    void StartPool(uint32_t threads, uint32_t idle_ms) {
+        struct compress_pool_config cfg = { threads, idle_ms };
+        ASSERT_EQ(compress_pool_init(&pool, &cfg, record_cb, &rec), 0);
+    }
+
+    void TearDown() override {
+        compress_pool_destroy(&pool);
+    }
+};
+
+// ============================================================================
+// Scheduling Tests
+// ============================================================================
+
+TEST_F(CompressPoolTest, WaitsForIdlePeriod) {
+    StartPool(1, 300);
+
+    compress_pool_mark_dirty(&pool, 7);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(rec.calls.load(), 0);  // Still inside the idle window
+
+    compress_pool_flush(&pool);
+    EXPECT_EQ(rec.calls.load(), 1);
+    EXPECT_EQ(rec.last_inode.load(), 7u);
+}
+
+TEST_F(CompressPoolTest, RepeatedWritesCoalesce) {
+    StartPool(1, 200);
+
+    for (int i = 0; i < 100; i++) {
+        compress_pool_mark_dirty(&pool, 3);
+    }
+
+    struct compress_pool_stats stats;
+    compress_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(stats.marked, 100u);
+    EXPECT_EQ(stats.pending, 1u);
+
+    compress_pool_flush(&pool);
+    EXPECT_EQ(rec.calls.load(), 1);
+}
+
+TEST_F(CompressPoolTest, CloseMakesEligibleNow) {
+    StartPool(2, 60000);
+
+    compress_pool_mark_dirty(&pool, 11);
+    compress_pool_mark_closed(&pool, 11);
+
+    for (int i = 0; i < 200 && rec.calls.load() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(rec.calls.load(), 1);
+    EXPECT_EQ(rec.last_inode.load(), 11u);
+}
+
+TEST_F(CompressPoolTest, CloseWithoutWriteIsIgnored) {
+    StartPool(1, 10);
+
+    compress_pool_mark_closed(&pool, 5);
+    compress_pool_flush(&pool);
+    EXPECT_EQ(rec.calls.load(), 0);
+}
+
+TEST_F(CompressPoolTest, CancelDropsEntry) {
+    StartPool(1, 60000);
+
+    compress_pool_mark_dirty(&pool, 9);
+    compress_pool_cancel(&pool, 9);
+    compress_pool_flush(&pool);
+
+    struct compress_pool_stats stats;
+    compress_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(rec.calls.load(), 0);
+    EXPECT_EQ(stats.cancelled, 1u);
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+TEST_F(CompressPoolTest, RetryRequeuesAfterIdle) {
+    StartPool(1, 20);
+    rec.retries_left = 1;
+
+    compress_pool_mark_dirty(&pool, 4);
+    compress_pool_flush(&pool);  // First attempt asks to retry
+    compress_pool_flush(&pool);  // Retry runs
+
+    struct compress_pool_stats stats;
+    compress_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(rec.calls.load(), 2);
+    EXPECT_EQ(stats.retried, 1u);
+    EXPECT_EQ(stats.completed, 1u);
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+TEST_F(CompressPoolTest, ManyInodesManyThreads) {
+    StartPool(4, 0);
+
+    for (uint32_t i = 1; i <= 500; i++) {
+        compress_pool_mark_dirty(&pool, i);
+    }
+    compress_pool_flush(&pool);
+
+    struct compress_pool_stats stats;
+    compress_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(rec.calls.load(), 500);
+    EXPECT_EQ(stats.completed, 500u);
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+TEST_F(CompressPoolTest, ZeroThreadsDisablesPool) {
+    StartPool(0, 0);
+
+    compress_pool_mark_dirty(&pool, 1);
+    compress_pool_mark_closed(&pool, 1);
+    compress_pool_flush(&pool);
+
+    struct compress_pool_stats stats;
+    compress_pool_get_stats(&pool, &stats);
+    EXPECT_EQ(rec.calls.load(), 0);
+    EXPECT_EQ(stats.marked, 0u);
+}
+
+// ============================================================================
+// Chunk Swap Tests
+// ============================================================================
+
+TEST(CompressChunkTest, CommitSwapsUnchangedChunk) {
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+
+    std::vector<char> data(EXTENT_CHUNK_SIZE + 1000, 'p');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+
+    // Partial tail chunks are compressed too once the file is cold
+    for (uint32_t i = 0; i < 2; i++) {
+        uint32_t stored = 0, version = 0;
+        char *payload = extent_store_compress_chunk(&es, i, &stored, &version);
+        ASSERT_NE(payload, nullptr);
+        EXPECT_EQ(extent_store_commit_chunk(&es, i, payload, stored, version), 1);
+    }
+    EXPECT_EQ(es.compressed_count, 2u);
+
+    // Already compressed: nothing to do
+    uint32_t stored = 0, version = 0;
+    EXPECT_EQ(extent_store_compress_chunk(&es, 0, &stored, &version), nullptr);
+
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&es, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+
+    extent_store_destroy(&es);
+}
+
+TEST(CompressChunkTest, CommitRejectsStalePayload) {
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+
+    std::vector<char> data(EXTENT_CHUNK_SIZE, 'q');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+
+    uint32_t stored = 0, version = 0;
+    char *payload = extent_store_compress_chunk(&es, 0, &stored, &version);
+    ASSERT_NE(payload, nullptr);
+
+    // A write lands between compressing and committing
+    ASSERT_EQ(extent_store_write(&es, "Z", 1, 42), 1);
+    EXPECT_EQ(extent_store_commit_chunk(&es, 0, payload, stored, version), 0);
+    EXPECT_EQ(es.compressed_count, 0u);
+
+    char c = 0;
+    ASSERT_EQ(extent_store_read(&es, &c, 1, 42), 1);
+    EXPECT_EQ(c, 'Z');
+
+    extent_store_destroy(&es);
+}
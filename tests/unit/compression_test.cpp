@@ -0,0 +1,227 @@
+/**
+ * Compression Unit Tests
+ * Tests for whole-buffer and blocked (seek table) compression, codecs
+ * and the entropy probe
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <cstring>
+#include <zlib.h>
+
+extern "C" {
+#include "compression.h"
+}
+
+static std::vector<char> make_text(size_t size) {
+    std::vector<char> data(size);
+    const char *pattern = "razorfs blocked compression test line\n";
+    size_t plen = strlen(pattern);
+    for (size_t i = 0; i < size; i++) data[i] = pattern[i % plen];
+    return data;
+}
+
+// ============================================================================
+// Whole-Buffer Tests
+// ============================================================================
+
+TEST(CompressionTest, RoundTrip) {
+    std::vector<char> data = make_text(8192);
+
+    size_t csize = 0;
+    void *compressed = compress_data(data.data(), data.size(), &csize);
+    ASSERT_NE(compressed, nullptr);
+    EXPECT_LT(csize, data.size());
+
+    size_t dsize = 0;
+    void *plain = decompress_data(compressed, csize, &dsize);
+    ASSERT_NE(plain, nullptr);
+    ASSERT_EQ(dsize, data.size());
+    EXPECT_EQ(memcmp(plain, data.data(), dsize), 0);
+
+    free(compressed);
+    free(plain);
+}
+
+static std::vector<char> make_random(size_t size) {
+    std::vector<char> data(size);
+    uint32_t x = 12345;
+    for (auto &c : data) {
+        x = x * 1103515245 + 12345;
+        c = (char)(x >> 16);
+    }
+    return data;
+}
+
+TEST(CompressionTest, HeaderNamesCodec) {
+    std::vector<char> data = make_text(8192);
+    size_t csize = 0;
+    void *compressed = compress_data(data.data(), data.size(), &csize);
+    ASSERT_NE(compressed, nullptr);
+
+    const auto *hdr = (const struct compression_header *)compressed;
+    EXPECT_EQ(hdr->magic, (uint32_t)COMPRESSION_MAGIC_CODEC);
+    EXPECT_EQ(hdr->codec, (uint32_t)compression_get_codec(COMPRESSION_BACKGROUND));
+    free(compressed);
+}
+
+TEST(CompressionTest, LegacyBlobStillReads) {
+    // 12-byte RZCP header followed by a zlib stream
+    std::vector<char> data = make_text(4096);
+    uLongf zsize = compressBound(data.size());
+    std::vector<char> blob(COMPRESSION_HEADER_V1_SIZE + zsize);
+    ASSERT_EQ(compress2((Bytef *)blob.data() + COMPRESSION_HEADER_V1_SIZE, &zsize,
+                        (const Bytef *)data.data(), data.size(), 1), Z_OK);
+    uint32_t header[3] = {COMPRESSION_MAGIC, (uint32_t)data.size(), (uint32_t)zsize};
+    memcpy(blob.data(), header, sizeof(header));
+
+    size_t dsize = 0;
+    void *plain = decompress_data(blob.data(), COMPRESSION_HEADER_V1_SIZE + zsize, &dsize);
+    ASSERT_NE(plain, nullptr);
+    ASSERT_EQ(dsize, data.size());
+    EXPECT_EQ(memcmp(plain, data.data(), dsize), 0);
+    free(plain);
+}
+
+// ============================================================================
+// Block Tests
+// ============================================================================
+
+TEST(CompressionTest, BlockRoundTrip) {
+    std::vector<char> data = make_text(COMPRESSION_BLOCK_SIZE);
+    std::vector<char> packed(COMPRESSION_BLOCK_SIZE);
+
+    size_t stored = compress_block(data.data(), data.size(), packed.data(), packed.size());
+    ASSERT_GT(stored, 0u);
+    EXPECT_LT(stored, data.size());
+
+    std::vector<char> out(data.size());
+    ASSERT_EQ(decompress_block(packed.data(), stored, out.data(), out.size()), 0);
+    EXPECT_EQ(out, data);
+
+    // Wrong expected size is rejected
+    EXPECT_NE(decompress_block(packed.data(), stored, out.data(), out.size() - 1), 0);
+}
+
+TEST(CompressionTest, IncompressibleBlockNotStored) {
+    std::vector<char> data = make_random(4096);
+    std::vector<char> packed(data.size());
+    EXPECT_EQ(compress_block(data.data(), data.size(), packed.data(), packed.size()), 0u);
+}
+
+TEST(CompressionTest, ProbeSkipsHighEntropyData) {
+    std::vector<char> noise = make_random(COMPRESSION_BLOCK_SIZE);
+    std::vector<char> text = make_text(COMPRESSION_BLOCK_SIZE);
+    std::vector<char> zeros(COMPRESSION_BLOCK_SIZE, 0);
+    EXPECT_EQ(compression_probe(noise.data(), noise.size()), 0);
+    EXPECT_EQ(compression_probe(text.data(), text.size()), 1);
+    EXPECT_EQ(compression_probe(zeros.data(), zeros.size()), 1);
+    EXPECT_EQ(compression_probe(noise.data(), COMPRESSION_PROBE_MIN - 1), 1);  // Too short
+
+    // Skipped without a compression attempt, and counted
+    reset_compression_stats();
+    std::vector<char> packed(noise.size());
+    uint64_t available = 0;
+    for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+        EXPECT_EQ(compress_block_as((enum compression_codec)c, noise.data(), noise.size(),
+                                    packed.data(), packed.size()), 0u);
+        available += compression_codec_available((enum compression_codec)c);
+    }
+    struct compression_stats stats;
+    get_compression_stats(&stats);
+    EXPECT_EQ(stats.probe_skips, available);
+    EXPECT_EQ(stats.total_writes, 0u);
+}
+
+TEST(CompressionTest, EveryCodecRoundTripsAndIsCounted) {
+    std::vector<char> data = make_text(COMPRESSION_BLOCK_SIZE);
+    reset_compression_stats();
+
+    for (int c = 0; c < COMPRESSION_CODEC_COUNT; c++) {
+        auto codec = (enum compression_codec)c;
+        std::vector<char> packed(data.size());
+        size_t stored = compress_block_as(codec, data.data(), data.size(),
+                                          packed.data(), packed.size());
+        if (!compression_codec_available(codec)) {
+            EXPECT_EQ(stored, 0u) << compression_codec_name(codec);
+            EXPECT_NE(compression_set_codec(COMPRESSION_INLINE, codec), 0);
+            continue;
+        }
+        ASSERT_GT(stored, 0u) << compression_codec_name(codec);
+        EXPECT_LT(stored, data.size());
+        EXPECT_EQ(compression_block_codec(packed.data(), stored), c);
+
+        std::vector<char> out(data.size());
+        ASSERT_EQ(decompress_block(packed.data(), stored, out.data(), out.size()), 0);
+        EXPECT_EQ(out, data);
+
+        struct compression_stats stats;
+        get_compression_stats(&stats);
+        EXPECT_EQ(stats.codecs[c].writes, 1u);
+        EXPECT_EQ(stats.codecs[c].bytes_in, data.size());
+        EXPECT_EQ(stats.codecs[c].bytes_out, stored);
+        EXPECT_EQ(stats.codecs[c].reads, 1u);
+    }
+
+    // The inline and background codecs can be switched to any built-in one
+    enum compression_codec saved = compression_get_codec(COMPRESSION_INLINE);
+    ASSERT_EQ(compression_set_codec(COMPRESSION_INLINE, COMPRESSION_CODEC_ZLIB), 0);
+    std::vector<char> packed(data.size());
+    size_t stored = compress_block(data.data(), data.size(), packed.data(), packed.size());
+    ASSERT_GT(stored, 0u);
+    EXPECT_EQ(compression_block_codec(packed.data(), stored), COMPRESSION_CODEC_ZLIB);
+    compression_set_codec(COMPRESSION_INLINE, saved);
+}
+
+// ============================================================================
+// Blocked Container Tests
+// ============================================================================
+
+TEST(CompressionTest, BlockedRangeReadsOnlyCoveredBlocks) {
+    const size_t size = 5 * COMPRESSION_BLOCK_SIZE + 777;
+    std::vector<char> data = make_text(size);
+    // Block 2 is all zeros and should become a hole
+    memset(data.data() + 2 * COMPRESSION_BLOCK_SIZE, 0, COMPRESSION_BLOCK_SIZE);
+
+    size_t blob_size = 0;
+    void *blob = compress_blocked(data.data(), data.size(), &blob_size);
+    ASSERT_NE(blob, nullptr);
+    EXPECT_LT(blob_size, size);
+
+    const auto *hdr = (const struct compression_blocked_header *)blob;
+    EXPECT_EQ(hdr->magic, (uint32_t)COMPRESSION_BLOCKED_MAGIC);
+    EXPECT_EQ(hdr->block_count, 6u);
+    EXPECT_EQ(hdr->original_size, size);
+    const auto *table = (const struct compression_seek_entry *)(hdr + 1);
+    EXPECT_EQ(table[2].raw_size, 0u);
+
+    // Range crossing a block boundary and the hole
+    uint64_t offset = 2 * COMPRESSION_BLOCK_SIZE - 100;
+    std::vector<char> out(300);
+    ASSERT_EQ(decompress_blocked_range(blob, blob_size, out.data(), out.size(), offset), 300);
+    EXPECT_EQ(memcmp(out.data(), data.data() + offset, out.size()), 0);
+
+    // Tail read is clipped at the original size
+    ASSERT_EQ(decompress_blocked_range(blob, blob_size, out.data(), out.size(), size - 10), 10);
+    EXPECT_EQ(memcmp(out.data(), data.data() + size - 10, 10), 0);
+    EXPECT_EQ(decompress_blocked_range(blob, blob_size, out.data(), out.size(), size), 0);
+
+    free(blob);
+}
+
+TEST(CompressionTest, BlockedRejectsCorruptContainer) {
+    std::vector<char> data = make_text(2 * COMPRESSION_BLOCK_SIZE);
+    size_t blob_size = 0;
+    void *blob = compress_blocked(data.data(), data.size(), &blob_size);
+    ASSERT_NE(blob, nullptr);
+
+    char buf[16];
+    EXPECT_EQ(decompress_blocked_range(blob, sizeof(struct compression_blocked_header),
+                                       buf, sizeof(buf), 0), -1);
+
+    auto *table = (struct compression_seek_entry *)((struct compression_blocked_header *)blob + 1);
+    table[0].offset = blob_size;  // Points past the end
+    EXPECT_EQ(decompress_blocked_range(blob, blob_size, buf, sizeof(buf), 0), -1);
+
+    free(blob);
+}
@@ -0,0 +1,431 @@
+/**
+ * Data Log Unit Tests
+ * Tests for the log-structured file data segment
+ */
+
+#include <gtest/gtest.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "data_log.h"
+}
+
+static const char *LOG_PATH = "/tmp/razorfs_data_log_test.log";
+static const char *COPY_PATH = "/tmp/razorfs_data_log_test_copy.log";
+
+// Chunks handed back by data_log_restore, by chunk number
+typedef std::map<uint32_t, std::string> Chunks;
+
+static int collect(void *ctx, uint32_t idx, const char *payload,
+                   uint32_t raw_size, uint32_t stored_size) {
+    EXPECT_EQ(raw_size, stored_size);
+    (*static_cast<Chunks *>(ctx))[idx] = std::string(payload, stored_size);
+    return 0;
+}
+
+static Chunks restore(struct data_log *log, uint32_t inode, uint64_t *size = nullptr) {
+    Chunks chunks;
+    uint64_t ignored;
+    EXPECT_EQ(data_log_restore(log, inode, collect, &chunks, size ? size : &ignored), 0);
+    return chunks;
+}
+
+static int append(struct data_log *log, uint32_t inode, uint64_t size, uint32_t keep,
+                  const std::map<uint32_t, std::string> &chunks) {
+    std::vector<struct data_log_put> puts;
+    for (const auto &c : chunks) {
+        struct data_log_put put = { .idx = c.first, .raw_size = (uint32_t)c.second.size(),
+                                    .stored_size = (uint32_t)c.second.size(),
+                                    .data = c.second.data(), .flags = 0, .offset = 0 };
+        puts.push_back(put);
+    }
+    return data_log_append(log, inode, size, keep, puts.data(), (uint32_t)puts.size());
+}
+
+// Copy the first `len` bytes of the open log, as a crash would leave it
+static void copy_prefix(const char *from, const char *to, off_t len) {
+    int in = open(from, O_RDONLY);
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    ASSERT_GE(in, 0);
+    ASSERT_GE(out, 0);
+    std::vector<char> buf(len);
+    ASSERT_EQ(pread(in, buf.data(), len, 0), len);
+    ASSERT_EQ(pwrite(out, buf.data(), len, 0), len);
+    close(in);
+    close(out);
+}
+
+static off_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? st.st_size : -1;
+}
+
+class DataLogTest : public ::testing::Test {
+protected:
+    struct data_log log;
+
+    void SetUp() override {
+        unlink(LOG_PATH);
+        unlink(COPY_PATH);
+        ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    }
+
+    void TearDown() override {
+        data_log_close(&log);
+        unlink(LOG_PATH);
+        unlink(COPY_PATH);
+        std::string tmp = std::string(LOG_PATH) + ".tmp";
+        unlink(tmp.c_str());
+    }
+};
+
+TEST_F(DataLogTest, AppendAndRestore) {
+    EXPECT_FALSE(data_log_contains(&log, 7));
+    Chunks none;
+    EXPECT_EQ(data_log_restore(&log, 7, collect, &none, nullptr), 1);
+
+    ASSERT_EQ(append(&log, 7, 70000, 2, {{0, "first"}, {1, "second"}}), 0);
+    EXPECT_TRUE(data_log_contains(&log, 7));
+
+    // Unchanged chunks keep their logged payload
+    ASSERT_EQ(append(&log, 7, 70000, 2, {{1, "SECOND"}}), 0);
+
+    uint64_t size = 0;
+    Chunks chunks = restore(&log, 7, &size);
+    EXPECT_EQ(size, 70000u);
+    ASSERT_EQ(chunks.size(), 2u);
+    EXPECT_EQ(chunks[0], "first");
+    EXPECT_EQ(chunks[1], "SECOND");
+}
+
+TEST_F(DataLogTest, KeepDropsTruncatedChunks) {
+    ASSERT_EQ(append(&log, 3, 4 * 65536, 4, {{0, "a"}, {1, "b"}, {2, "c"}, {3, "d"}}), 0);
+
+    // Truncated to one chunk, then chunk 2 rewritten after regrowing
+    ASSERT_EQ(append(&log, 3, 3 * 65536, 1, {{2, "C"}}), 0);
+
+    Chunks chunks = restore(&log, 3);
+    ASSERT_EQ(chunks.size(), 2u);
+    EXPECT_EQ(chunks[0], "a");
+    EXPECT_EQ(chunks[2], "C");
+}
+
+TEST_F(DataLogTest, EmptyPutPunchesChunk) {
+    ASSERT_EQ(append(&log, 4, 3 * 65536, 3, {{0, "a"}, {1, "b"}, {2, "c"}}), 0);
+    struct data_log_put hole = {1, 0, 0, nullptr, 0, 0};
+    ASSERT_EQ(data_log_append(&log, 4, 3 * 65536, 3, &hole, 1), 0);
+
+    // Replayed from the record (as a crash leaves the log), then from the
+    // checkpoint written at close
+    copy_prefix(LOG_PATH, COPY_PATH, (off_t)log.tail);
+    struct data_log copy;
+    ASSERT_EQ(data_log_open(&copy, COPY_PATH), 0);
+    Chunks replayed = restore(&copy, 4);
+    data_log_close(&copy);
+
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    uint64_t size = 0;
+    Chunks chunks = restore(&log, 4, &size);
+    EXPECT_EQ(size, 3u * 65536);
+
+    for (Chunks *c : {&replayed, &chunks}) {
+        ASSERT_EQ(c->size(), 2u);
+        EXPECT_EQ((*c)[0], "a");
+        EXPECT_EQ((*c)[2], "c");
+    }
+}
+
+TEST_F(DataLogTest, RemoveForgetsFile) {
+    ASSERT_EQ(append(&log, 5, 1, 1, {{0, "x"}}), 0);
+    ASSERT_EQ(data_log_remove(&log, 5), 0);
+    EXPECT_FALSE(data_log_contains(&log, 5));
+
+    // Unknown files are a no-op
+    uint64_t tail = log.tail;
+    EXPECT_EQ(data_log_remove(&log, 6), 0);
+    EXPECT_EQ(log.tail, tail);
+}
+
+TEST_F(DataLogTest, ReopenUsesCheckpointAndReplaysTail) {
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "one"}}), 0);
+    ASSERT_EQ(append(&log, 2, 5, 1, {{0, "two"}}), 0);
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    EXPECT_EQ(log.checkpoint_end, log.tail);
+
+    // After the checkpoint: an update and a removal, never checkpointed
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "ONE"}}), 0);
+    ASSERT_EQ(data_log_remove(&log, 2), 0);
+    copy_prefix(LOG_PATH, COPY_PATH, (off_t)log.tail);
+
+    struct data_log copy;
+    ASSERT_EQ(data_log_open(&copy, COPY_PATH), 0);
+    EXPECT_EQ(copy.tail, log.tail);
+    EXPECT_EQ(copy.file_count, 1u);
+    EXPECT_EQ(restore(&copy, 1)[0], "ONE");
+    EXPECT_FALSE(data_log_contains(&copy, 2));
+    data_log_close(&copy);
+}
+
+TEST_F(DataLogTest, TornAppendIsCutOff) {
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "kept"}}), 0);
+    uint64_t good = log.tail;
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, std::string(1000, 'z')}}), 0);
+
+    // Crash halfway through the second record
+    copy_prefix(LOG_PATH, COPY_PATH, (off_t)(good + (log.tail - good) / 2));
+
+    struct data_log copy;
+    ASSERT_EQ(data_log_open(&copy, COPY_PATH), 0);
+    EXPECT_EQ(copy.tail, good);
+    EXPECT_EQ(file_size(COPY_PATH), (off_t)good);
+    EXPECT_EQ(restore(&copy, 1)[0], "kept");
+
+    // Appends continue where the last whole record ended
+    ASSERT_EQ(append(&copy, 1, 5, 1, {{0, "next"}}), 0);
+    data_log_close(&copy);
+
+    ASSERT_EQ(data_log_open(&copy, COPY_PATH), 0);
+    EXPECT_EQ(restore(&copy, 1)[0], "next");
+    data_log_close(&copy);
+}
+
+TEST_F(DataLogTest, CorruptCheckpointFallsBackToOlderSlot) {
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "old"}}), 0);
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    uint64_t second = log.tail;
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "new"}}), 0);
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    copy_prefix(LOG_PATH, COPY_PATH, (off_t)log.tail);
+
+    // Damage the newest checkpoint record: the older one plus replay wins
+    int fd = open(COPY_PATH, O_RDWR);
+    ASSERT_GE(fd, 0);
+    uint64_t ckpt = log.tail - 8;
+    ASSERT_EQ(pwrite(fd, "XXXXXXXX", 8, (off_t)ckpt), 8);
+    close(fd);
+
+    struct data_log copy;
+    ASSERT_EQ(data_log_open(&copy, COPY_PATH), 0);
+    EXPECT_EQ(restore(&copy, 1)[0], "new");
+    EXPECT_LT(copy.tail, log.tail);
+    EXPECT_GT(copy.tail, second);
+    data_log_close(&copy);
+}
+
+TEST_F(DataLogTest, CompactionKeepsOnlyLiveChunks) {
+    // Rewrite the same 1MB file until garbage dwarfs it
+    std::string payload(65536, 'p');
+    std::map<uint32_t, std::string> chunks;
+    for (uint32_t i = 0; i < 16; i++) chunks[i] = payload;
+
+    uint64_t rounds = DATA_LOG_COMPACT_MIN_BYTES / (16 * 65536) + 2;
+    for (uint64_t r = 0; r < rounds; r++) {
+        chunks[r % 16] = std::string(65536, (char)('a' + r % 26));
+        ASSERT_EQ(append(&log, 9, 16 * 65536, 16, chunks), 0);
+    }
+    ASSERT_EQ(append(&log, 10, 3, 1, {{0, "tiny"}}), 0);
+
+    // Compacted once the log reached the threshold, by the append itself
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    EXPECT_LT(log.tail, DATA_LOG_COMPACT_MIN_BYTES / 8);
+    EXPECT_EQ(file_size(LOG_PATH), (off_t)log.tail);
+
+    Chunks restored = restore(&log, 9);
+    ASSERT_EQ(restored.size(), 16u);
+    for (uint32_t i = 0; i < 16; i++) EXPECT_EQ(restored[i], chunks[i]) << "chunk " << i;
+    EXPECT_EQ(restore(&log, 10)[0], "tiny");
+
+    // The compacted segment is the log from now on
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    EXPECT_EQ(restore(&log, 9).size(), 16u);
+    EXPECT_EQ(restore(&log, 10)[0], "tiny");
+}
+
+TEST_F(DataLogTest, OneOwnerAtATime) {
+    struct data_log other;
+    EXPECT_NE(data_log_open(&other, LOG_PATH), 0);
+}
+
+TEST_F(DataLogTest, DedupStoresIdenticalChunksOnce) {
+    ASSERT_EQ(data_log_enable_dedup(&log), 0);
+    std::string a(65536, 'a'), b(65536, 'b'), c(65536, 'c');
+
+    ASSERT_EQ(append(&log, 1, 2 * 65536, 2, {{0, a}, {1, b}}), 0);
+    uint64_t tail = log.tail;
+    ASSERT_EQ(append(&log, 2, 2 * 65536, 2, {{0, a}, {1, b}}), 0);
+    EXPECT_LT(log.tail - tail, 4096u);  // Refs only
+
+    // Twice in one record is written once too
+    tail = log.tail;
+    ASSERT_EQ(append(&log, 3, 2 * 65536, 2, {{0, c}, {1, c}}), 0);
+    EXPECT_LT(log.tail - tail, 65536u + 4096u);
+    EXPECT_EQ(log.live_bytes, 3 * 65536u);
+
+    struct data_log_dedup_stats stats;
+    data_log_dedup_stats(&log, &stats);
+    EXPECT_EQ(stats.blocks, 3u);
+    EXPECT_EQ(stats.shared_blocks, 3u);
+    EXPECT_EQ(stats.refs, 6u);
+    EXPECT_EQ(stats.saved_bytes, 3 * 65536u);
+    EXPECT_EQ(stats.hits, 3u);
+
+    // A shared payload outlives the first file to drop it
+    ASSERT_EQ(data_log_remove(&log, 1), 0);
+    EXPECT_EQ(log.live_bytes, 3 * 65536u);
+    ASSERT_EQ(append(&log, 3, 2 * 65536, 2, {{1, b}}), 0);
+    EXPECT_EQ(log.live_bytes, 3 * 65536u);
+
+    struct data_log_verify_report report;
+    EXPECT_EQ(data_log_verify(&log, &report), 0);
+    EXPECT_EQ(report.blocks, 3u);
+    EXPECT_EQ(report.refs, 4u);
+
+    // Shared refs replay without dedup, and index again with it
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    Chunks two = restore(&log, 2), three = restore(&log, 3);
+    EXPECT_EQ(two[0], a);
+    EXPECT_EQ(two[1], b);
+    EXPECT_EQ(three[0], c);
+    EXPECT_EQ(three[1], b);
+    ASSERT_EQ(data_log_enable_dedup(&log), 0);
+    EXPECT_EQ(log.live_bytes, 3 * 65536u);
+    EXPECT_EQ(data_log_verify(&log, &report), 0);
+}
+
+TEST_F(DataLogTest, DedupCompactionKeepsOneCopy) {
+    ASSERT_EQ(data_log_enable_dedup(&log), 0);
+    std::string shared(65536, 's');
+    ASSERT_EQ(append(&log, 1, 65536, 1, {{0, shared}}), 0);
+    ASSERT_EQ(append(&log, 2, 65536, 1, {{0, shared}}), 0);
+
+    // Distinct rewrites of another file until the log is worth compacting
+    uint64_t rounds = DATA_LOG_COMPACT_MIN_BYTES / 65536 + 2;
+    std::string unique(65536, 'u');
+    for (uint64_t r = 0; r < rounds; r++) {
+        memcpy(&unique[0], &r, sizeof(r));
+        ASSERT_EQ(append(&log, 3, 65536, 1, {{0, unique}}), 0);
+    }
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    EXPECT_LT(log.tail, DATA_LOG_COMPACT_MIN_BYTES / 8);
+
+    struct data_log_dedup_stats stats;
+    data_log_dedup_stats(&log, &stats);
+    EXPECT_EQ(stats.blocks, 2u);
+    EXPECT_EQ(stats.shared_blocks, 1u);
+    struct data_log_verify_report report;
+    EXPECT_EQ(data_log_verify(&log, &report), 0);
+
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    EXPECT_EQ(restore(&log, 1)[0], shared);
+    EXPECT_EQ(restore(&log, 2)[0], shared);
+    EXPECT_EQ(restore(&log, 3)[0], unique);
+}
+
+TEST_F(DataLogTest, DedupVerifyFindsChangedPayload) {
+    ASSERT_EQ(data_log_enable_dedup(&log), 0);
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "same!"}}), 0);
+    ASSERT_EQ(append(&log, 2, 5, 1, {{0, "same!"}}), 0);
+
+    struct data_log_chunk_ref ref;
+    ASSERT_EQ(data_log_lookup(&log, 2, 0, &ref), 0);
+    int fd = open(LOG_PATH, O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pwrite(fd, "S", 1, ref.offset), 1);
+    close(fd);
+
+    struct data_log_verify_report report;
+    EXPECT_EQ(data_log_verify(&log, &report), 1);
+    EXPECT_EQ(report.bad_payloads, 1u);
+}
+
+TEST_F(DataLogTest, ReadOnlyOpenSharesALogInUse) {
+    ASSERT_EQ(append(&log, 1, 5, 1, {{0, "first"}}), 0);
+    ASSERT_EQ(append(&log, 2, 5, 1, {{0, "other"}}), 0);
+    uint64_t tail = log.tail;
+
+    // Opened next to its owner, sees what was appended so far
+    struct data_log ro;
+    ASSERT_EQ(data_log_open_readonly(&ro, LOG_PATH), 0);
+    EXPECT_EQ(ro.tail, tail);
+    EXPECT_EQ(restore(&ro, 1)[0], "first");
+    EXPECT_NE(append(&ro, 1, 5, 1, {{0, "nope!"}}), 0);
+    EXPECT_NE(data_log_remove(&ro, 2), 0);
+
+    // Later appends are not indexed, and closing writes nothing
+    ASSERT_EQ(append(&log, 3, 5, 1, {{0, "third"}}), 0);
+    EXPECT_FALSE(data_log_contains(&ro, 3));
+    off_t size = file_size(LOG_PATH);
+    data_log_close(&ro);
+    EXPECT_EQ(file_size(LOG_PATH), size);
+    EXPECT_EQ(restore(&log, 2)[0], "other");
+}
+
+TEST_F(DataLogTest, ParallelVerifyMatchesSerial) {
+    ASSERT_EQ(data_log_enable_dedup(&log), 0);
+    for (uint32_t i = 0; i < 64; i++) {
+        std::string chunk(4096, (char)('a' + i % 26));
+        memcpy(&chunk[0], &i, sizeof(i));
+        ASSERT_EQ(append(&log, i + 1, 4096, 1, {{0, chunk}}), 0);
+        ASSERT_EQ(append(&log, i + 100, 4096, 1, {{0, chunk}}), 0);
+    }
+
+    struct data_log_verify_report serial, parallel;
+    EXPECT_EQ(data_log_verify(&log, &serial), 0);
+    EXPECT_EQ(data_log_verify_parallel(&log, &parallel, 4), 0);
+    EXPECT_EQ(parallel.blocks, serial.blocks);
+    EXPECT_EQ(parallel.refs, serial.refs);
+
+    // A changed payload is found whichever thread rehashes it
+    struct data_log_chunk_ref ref;
+    ASSERT_EQ(data_log_lookup(&log, 40, 0, &ref), 0);
+    int fd = open(LOG_PATH, O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(pwrite(fd, "!", 1, ref.offset + 100), 1);
+    close(fd);
+    EXPECT_EQ(data_log_verify_parallel(&log, &parallel, 4), 1);
+    EXPECT_EQ(parallel.bad_payloads, 1u);
+}
+
+TEST_F(DataLogTest, IoUringEngineBatchesAppends) {
+    if (data_log_set_io_engine(&log, IO_ENGINE_URING) != 0) {
+        GTEST_SKIP() << "io_uring unavailable here";
+    }
+    ASSERT_NE(log.io, nullptr);
+
+    ASSERT_EQ(append(&log, 1, 10, 2, {{0, "first"}, {1, "second"}}), 0);
+    ASSERT_EQ(append(&log, 2, 5, 1, {{0, "other"}}), 0);
+    ASSERT_EQ(data_log_checkpoint(&log), 0);
+    ASSERT_EQ(append(&log, 1, 10, 2, {{1, "SECOND"}}), 0);
+    EXPECT_EQ(file_size(LOG_PATH), (off_t)log.tail);
+
+    // Payloads, header and fdatasync of each append in one submission
+    EXPECT_GE(log.io->stats.ops, 3u * 3 + 4);
+    EXPECT_EQ(log.io->stats.failed, 0u);
+    if (log.stage) {
+        EXPECT_EQ(log.io->stats.fixed_buffers, 3u);
+    }
+
+    // Same bytes on disk as the psync path writes
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    Chunks one = restore(&log, 1);
+    EXPECT_EQ(one[0], "first");
+    EXPECT_EQ(one[1], "SECOND");
+    EXPECT_EQ(restore(&log, 2)[0], "other");
+
+    // And back
+    EXPECT_EQ(data_log_set_io_engine(&log, IO_ENGINE_PSYNC), 0);
+    EXPECT_EQ(log.io, nullptr);
+    ASSERT_EQ(append(&log, 2, 5, 1, {{0, "again"}}), 0);
+    EXPECT_EQ(restore(&log, 2)[0], "again");
+}
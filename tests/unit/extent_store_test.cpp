@@ -0,0 +1,450 @@
+/**
+ * Extent Store Unit Tests
+ * Tests for chunked file data storage
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+extern "C" {
+#include "extent_store.h"
+#include "shm_persist.h"
+}
+
+class ExtentStoreTest : public ::testing::Test {
+protected:
+    struct extent_store es;
+
+    void SetUp() override {
+        ASSERT_EQ(extent_store_init(&es), 0);
+    }
+
+    void TearDown() override {
+        extent_store_destroy(&es);
+    }
+};
+
+// ============================================================================
+// Basic Read/Write Tests
+// ============================================================================
+
+TEST_F(ExtentStoreTest, EmptyStore) {
+    char buf[16];
+    EXPECT_EQ(es.size, 0u);
+    EXPECT_EQ(extent_store_read(&es, buf, sizeof(buf), 0), 0);
+    EXPECT_EQ(extent_store_chunk_span(&es), 0u);
+}
+
+TEST_F(ExtentStoreTest, SmallWriteRead) {
+    const char *msg = "hello extents";
+    size_t len = strlen(msg);
+
+    ASSERT_EQ(extent_store_write(&es, msg, len, 0), (ssize_t)len);
+    EXPECT_EQ(es.size, len);
+    EXPECT_EQ(es.chunk_count, 1u);
+
+    char buf[64] = {0};
+    EXPECT_EQ(extent_store_read(&es, buf, sizeof(buf), 0), (ssize_t)len);
+    EXPECT_EQ(memcmp(buf, msg, len), 0);
+
+    // Small files should not pay for a full chunk
+    EXPECT_LT(extent_store_memory_usage(&es), (size_t)EXTENT_CHUNK_SIZE);
+}
+
+TEST_F(ExtentStoreTest, WriteSpanningChunks) {
+    std::vector<char> data(EXTENT_CHUNK_SIZE + 100);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i * 7);
+
+    uint64_t offset = EXTENT_CHUNK_SIZE - 50;
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), offset),
+              (ssize_t)data.size());
+    EXPECT_EQ(extent_store_chunk_span(&es), 3u);
+
+    std::vector<char> out(data.size());
+    EXPECT_EQ(extent_store_read(&es, out.data(), out.size(), offset), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+}
+
+TEST_F(ExtentStoreTest, ReadPastEnd) {
+    ASSERT_EQ(extent_store_write(&es, "abc", 3, 0), 3);
+
+    char buf[8];
+    EXPECT_EQ(extent_store_read(&es, buf, sizeof(buf), 3), 0);
+    EXPECT_EQ(extent_store_read(&es, buf, sizeof(buf), 1), 2);
+    EXPECT_EQ(memcmp(buf, "bc", 2), 0);
+}
+
+// ============================================================================
+// Hole and Truncate Tests
+// ============================================================================
+
+TEST_F(ExtentStoreTest, SparseWriteLeavesHoles) {
+    uint64_t offset = 10ULL * EXTENT_CHUNK_SIZE;
+    ASSERT_EQ(extent_store_write(&es, "x", 1, offset), 1);
+
+    EXPECT_EQ(es.size, offset + 1);
+    EXPECT_EQ(es.chunk_count, 1u);
+    EXPECT_EQ(extent_store_chunk(&es, 0, nullptr, nullptr), nullptr);
+
+    std::vector<char> buf(EXTENT_CHUNK_SIZE, 'z');
+    EXPECT_EQ(extent_store_read(&es, buf.data(), buf.size(), EXTENT_CHUNK_SIZE),
+              (ssize_t)buf.size());
+    for (char c : buf) ASSERT_EQ(c, 0);
+}
+
+TEST_F(ExtentStoreTest, TruncateShrinkThenExtendReadsZeros) {
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE, 'a');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    EXPECT_EQ(es.chunk_count, 3u);
+
+    ASSERT_EQ(extent_store_truncate(&es, 100), 0);
+    EXPECT_EQ(es.size, 100u);
+    EXPECT_EQ(es.chunk_count, 1u);
+
+    ASSERT_EQ(extent_store_truncate(&es, 2 * EXTENT_CHUNK_SIZE), 0);
+    EXPECT_EQ(es.chunk_count, 1u);  // Growing does not allocate
+
+    std::vector<char> out(2 * EXTENT_CHUNK_SIZE);
+    ASSERT_EQ(extent_store_read(&es, out.data(), out.size(), 0), (ssize_t)out.size());
+    for (size_t i = 0; i < 100; i++) ASSERT_EQ(out[i], 'a');
+    for (size_t i = 100; i < out.size(); i++) ASSERT_EQ(out[i], 0) << "at " << i;
+}
+
+TEST_F(ExtentStoreTest, LargeSequentialAppend) {
+    std::vector<char> block(4096);
+    const size_t total = 4 * 1024 * 1024;
+
+    for (size_t off = 0; off < total; off += block.size()) {
+        memset(block.data(), (int)(off / block.size()), block.size());
+        ASSERT_EQ(extent_store_write(&es, block.data(), block.size(), off),
+                  (ssize_t)block.size());
+    }
+
+    EXPECT_EQ(es.size, total);
+    EXPECT_EQ(es.chunk_count, total / EXTENT_CHUNK_SIZE);
+
+    char c;
+    ASSERT_EQ(extent_store_read(&es, &c, 1, total - 1), 1);
+    EXPECT_EQ((unsigned char)c, (unsigned char)((total - 1) / block.size()));
+}
+
+TEST_F(ExtentStoreTest, OverflowRejected) {
+    EXPECT_EQ(extent_store_write(&es, "a", 1, UINT64_MAX), -1);
+    EXPECT_EQ(es.size, 0u);
+}
+
+// ============================================================================
+// Per-Chunk Compression Tests
+// ============================================================================
+
+TEST_F(ExtentStoreTest, CompressFullChunksOnly) {
+    std::vector<char> data(2 * EXTENT_CHUNK_SIZE + 500, 'c');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+
+    // The partial tail chunk stays raw
+    EXPECT_EQ(extent_store_compress_range(&es, 0, es.size), 2u);
+    EXPECT_EQ(es.compressed_count, 2u);
+    EXPECT_LT(extent_store_memory_usage(&es), (size_t)EXTENT_CHUNK_SIZE);
+
+    // Already compressed chunks are skipped
+    EXPECT_EQ(extent_store_compress_range(&es, 0, es.size), 0u);
+
+    // Reads inflate transparently
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&es, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+}
+
+TEST_F(ExtentStoreTest, WriteIntoCompressedChunkInflatesOnlyThatChunk) {
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE, 'd');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(extent_store_compress_range(&es, 0, es.size), 3u);
+
+    ASSERT_EQ(extent_store_write(&es, "XY", 2, EXTENT_CHUNK_SIZE + 10), 2);
+    EXPECT_EQ(es.compressed_count, 2u);
+
+    char buf[4];
+    ASSERT_EQ(extent_store_read(&es, buf, 4, EXTENT_CHUNK_SIZE + 9), 4);
+    EXPECT_EQ(memcmp(buf, "dXYd", 4), 0);
+
+    // Truncating into a compressed chunk zeroes its tail
+    ASSERT_EQ(extent_store_truncate(&es, 2 * EXTENT_CHUNK_SIZE + 1), 0);
+    ASSERT_EQ(extent_store_truncate(&es, 3 * EXTENT_CHUNK_SIZE), 0);
+    ASSERT_EQ(extent_store_read(&es, buf, 2, 2 * EXTENT_CHUNK_SIZE), 2);
+    EXPECT_EQ(buf[0], 'd');
+    EXPECT_EQ(buf[1], 0);
+}
+
+// ============================================================================
+// Zero-Copy View Tests
+// ============================================================================
+
+static std::vector<char> flatten(const struct extent_view &view) {
+    std::vector<char> out;
+    for (uint32_t i = 0; i < view.count; i++) {
+        const char *p = (const char *)view.iov[i].iov_base;
+        out.insert(out.end(), p, p + view.iov[i].iov_len);
+    }
+    return out;
+}
+
+TEST_F(ExtentStoreTest, ViewMatchesReadWithoutCopying) {
+    std::vector<char> data(2 * EXTENT_CHUNK_SIZE + 300);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i * 7);
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    // Hole between the data and the last byte
+    ASSERT_EQ(extent_store_write(&es, "e", 1, 5ULL * EXTENT_CHUNK_SIZE), 1);
+
+    struct extent_view view;
+    size_t want = es.size - 100;
+    ASSERT_EQ(extent_store_view(&es, &view, want, 100), (ssize_t)want);
+    EXPECT_EQ(view.bytes, want);
+    EXPECT_EQ(view.scratch_count, 0u);
+
+    // Raw chunks are referenced in place
+    EXPECT_EQ(view.iov[0].iov_base, extent_store_chunk(&es, 0, nullptr, nullptr) + 100);
+
+    std::vector<char> expected(want);
+    ASSERT_EQ(extent_store_read(&es, expected.data(), want, 100), (ssize_t)want);
+    EXPECT_EQ(flatten(view), expected);
+    extent_view_release(&view);
+
+    // Past EOF and clamped at EOF
+    EXPECT_EQ(extent_store_view(&es, &view, 10, es.size), 0);
+    EXPECT_EQ(view.count, 0u);
+    EXPECT_EQ(extent_store_view(&es, &view, 10, es.size - 1), 1);
+    EXPECT_EQ(flatten(view), std::vector<char>{'e'});
+    extent_view_release(&view);
+}
+
+TEST_F(ExtentStoreTest, ViewInflatesCompressedChunks) {
+    std::vector<char> data(2 * EXTENT_CHUNK_SIZE, 'v');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(extent_store_compress_range(&es, 0, es.size), 2u);
+
+    struct extent_view view;
+    ASSERT_EQ(extent_store_view(&es, &view, data.size(), 0), (ssize_t)data.size());
+    EXPECT_EQ(view.scratch_count, 2u);
+    EXPECT_EQ(flatten(view), data);
+    extent_view_release(&view);
+    EXPECT_EQ(es.compressed_count, 2u);  // Store is untouched
+}
+
+TEST_F(ExtentStoreTest, ViewRejectsOversizedRange) {
+    size_t span = (EXTENT_VIEW_MAX_CHUNKS + 1) * (size_t)EXTENT_CHUNK_SIZE;
+    ASSERT_EQ(extent_store_truncate(&es, span), 0);
+
+    struct extent_view view;
+    errno = 0;
+    EXPECT_EQ(extent_store_view(&es, &view, span, 0), -1);
+    EXPECT_EQ(errno, E2BIG);
+
+    // Exactly the limit is fine, and an all-hole view reads zeros
+    size_t limit = EXTENT_VIEW_MAX_CHUNKS * (size_t)EXTENT_CHUNK_SIZE;
+    ASSERT_EQ(extent_store_view(&es, &view, limit, 0), (ssize_t)limit);
+    EXPECT_EQ(flatten(view), std::vector<char>(limit, 0));
+    extent_view_release(&view);
+}
+
+TEST_F(ExtentStoreTest, AbsentChunksRefuseAccessUntilInstalled) {
+    ASSERT_EQ(extent_store_mark_absent(&es, 1, 100), 0);
+    ASSERT_EQ(extent_store_truncate(&es, EXTENT_CHUNK_SIZE + 100), 0);
+    EXPECT_EQ(es.chunk_count, 0u);  // Holds no bytes
+
+    EXPECT_FALSE(extent_store_range_absent(&es, 0, EXTENT_CHUNK_SIZE));
+    EXPECT_TRUE(extent_store_range_absent(&es, EXTENT_CHUNK_SIZE - 1, 2));
+
+    char buf[16];
+    errno = 0;
+    EXPECT_EQ(extent_store_read(&es, buf, 2, EXTENT_CHUNK_SIZE - 1), -1);
+    EXPECT_EQ(errno, EIO);
+    errno = 0;
+    EXPECT_EQ(extent_store_write(&es, "x", 1, EXTENT_CHUNK_SIZE), -1);
+    EXPECT_EQ(errno, EIO);
+    EXPECT_EQ(extent_store_read(&es, buf, 4, 0), 4);  // Chunk 0 is a hole
+
+    char *payload = (char *)malloc(100);
+    memset(payload, 'a', 100);
+    ASSERT_EQ(extent_store_install_chunk(&es, 1, payload, 100, 100), 0);
+    EXPECT_EQ(es.absent_count, 0u);
+    EXPECT_FALSE(extent_store_range_absent(&es, 0, es.size));
+    ASSERT_EQ(extent_store_read(&es, buf, 2, EXTENT_CHUNK_SIZE), 2);
+    EXPECT_EQ(buf[1], 'a');
+
+    // Truncating an absent chunk away just forgets it
+    ASSERT_EQ(extent_store_mark_absent(&es, 3, 10), 0);
+    ASSERT_EQ(extent_store_truncate(&es, 3 * EXTENT_CHUNK_SIZE + 10), 0);
+    ASSERT_EQ(extent_store_truncate(&es, 2 * EXTENT_CHUNK_SIZE), 0);
+    EXPECT_EQ(es.absent_count, 0u);
+}
+
+TEST_F(ExtentStoreTest, EvictDropsOnlyCleanChunks) {
+    std::vector<char> data(2 * EXTENT_CHUNK_SIZE + 10, 'k');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    EXPECT_EQ(extent_store_memory_usage(&es),
+              es.map_capacity * sizeof(struct extent_chunk) + es.data_bytes);
+
+    extent_store_mark_clean(&es);
+    ASSERT_EQ(extent_store_write(&es, "d", 1, EXTENT_CHUNK_SIZE), 1);  // Chunk 1 dirty
+
+    uint64_t held = es.data_bytes;
+    size_t freed = extent_store_evict_clean(&es);
+    EXPECT_GT(freed, 0u);
+    EXPECT_EQ(es.data_bytes, held - freed);
+    EXPECT_EQ(es.absent_count, 2u);
+    EXPECT_TRUE(extent_store_chunk_absent(&es, 0));
+    EXPECT_FALSE(extent_store_chunk_absent(&es, 1));
+    EXPECT_TRUE(extent_store_chunk_absent(&es, 2));
+    EXPECT_EQ(es.chunk_count, 1u);
+}
+
+// ============================================================================
+// Persistence Tests
+// ============================================================================
+
+TEST_F(ExtentStoreTest, FarWriteAndPunchStaySparse) {
+    // 1GB file with one written chunk at the end
+    const uint64_t far = (uint64_t)16384 * EXTENT_CHUNK_SIZE;
+    ASSERT_EQ(extent_store_write(&es, "tail", 4, far), 4);
+    EXPECT_EQ(es.size, far + 4);
+    EXPECT_EQ(es.chunk_count, 1u);
+    EXPECT_LT(extent_store_memory_usage(&es), (size_t)1 << 20);
+
+    EXPECT_EQ(extent_store_seek(&es, 0, SEEK_DATA), (off_t)far);
+    EXPECT_EQ(extent_store_seek(&es, 0, SEEK_HOLE), 0);
+    EXPECT_EQ(extent_store_seek(&es, far + 1, SEEK_HOLE), (off_t)(far + 4));
+    errno = 0;
+    EXPECT_EQ(extent_store_seek(&es, far + 4, SEEK_DATA), -1);
+    EXPECT_EQ(errno, ENXIO);
+
+    // Three chunks of data; punch the middle one and half of the first
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE, 'p');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    extent_store_mark_clean(&es);
+    ASSERT_EQ(extent_store_punch(&es, EXTENT_CHUNK_SIZE / 2, EXTENT_CHUNK_SIZE * 3 / 2), 0);
+    EXPECT_EQ(es.size, far + 4);
+    EXPECT_EQ(es.chunk_count, 3u);
+    EXPECT_TRUE(extent_store_chunk_dirty(&es, 0));
+    EXPECT_TRUE(extent_store_chunk_dirty(&es, 1));
+    EXPECT_FALSE(extent_store_chunk_dirty(&es, 2));
+
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&es, out.data(), out.size(), 0), (ssize_t)out.size());
+    for (size_t i = 0; i < out.size(); i++) {
+        char want = i < EXTENT_CHUNK_SIZE / 2 || i >= 2 * EXTENT_CHUNK_SIZE ? 'p' : 0;
+        ASSERT_EQ(out[i], want) << i;
+    }
+    EXPECT_EQ(extent_store_seek(&es, 0, SEEK_HOLE), (off_t)EXTENT_CHUNK_SIZE);
+    EXPECT_EQ(extent_store_seek(&es, EXTENT_CHUNK_SIZE, SEEK_DATA), (off_t)(2 * EXTENT_CHUNK_SIZE));
+}
+
+TEST_F(ExtentStoreTest, DiskPunchedChunksStayHoles) {
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE, 'h');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(disk_file_extents_save(303, &es, 0, data.size()), 0);
+    extent_store_mark_clean(&es);
+
+    ASSERT_EQ(extent_store_punch(&es, EXTENT_CHUNK_SIZE, EXTENT_CHUNK_SIZE), 0);
+    ASSERT_EQ(disk_file_extents_flush(303, &es), 0);
+
+    struct extent_store restored;
+    ASSERT_EQ(extent_store_init(&restored), 0);
+    ASSERT_EQ(disk_file_extents_restore(303, &restored), 0);
+    EXPECT_EQ(restored.size, data.size());
+    EXPECT_EQ(restored.chunk_count, 2u);
+
+    memset(&data[EXTENT_CHUNK_SIZE], 0, EXTENT_CHUNK_SIZE);
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&restored, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+
+    extent_store_destroy(&restored);
+    disk_file_data_remove(303);
+}
+
+TEST_F(ExtentStoreTest, DiskSaveRestoreRoundTrip) {
+    std::vector<char> data(2 * EXTENT_CHUNK_SIZE + 123);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i % 251);
+
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(disk_file_extents_save(300, &es, 0, data.size()), 0);
+
+    // Patch one byte in the middle chunk and persist only that range
+    ASSERT_EQ(extent_store_write(&es, "Q", 1, EXTENT_CHUNK_SIZE + 5), 1);
+    data[EXTENT_CHUNK_SIZE + 5] = 'Q';
+    ASSERT_EQ(disk_file_extents_save(300, &es, EXTENT_CHUNK_SIZE + 5, 1), 0);
+
+    struct extent_store restored;
+    ASSERT_EQ(extent_store_init(&restored), 0);
+    ASSERT_EQ(disk_file_extents_restore(300, &restored), 0);
+    ASSERT_EQ(restored.size, data.size());
+
+    std::vector<char> out(data.size());
+    EXPECT_EQ(extent_store_read(&restored, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+
+    extent_store_destroy(&restored);
+    disk_file_data_remove(300);
+}
+
+TEST_F(ExtentStoreTest, DiskAttachFaultsChunksOnDemand) {
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE + 7);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i % 241);
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(disk_file_extents_save(302, &es, 0, data.size()), 0);
+
+    struct extent_store attached;
+    ASSERT_EQ(extent_store_init(&attached), 0);
+    ASSERT_EQ(disk_file_extents_attach(302, &attached), 0);
+    EXPECT_EQ(attached.size, data.size());
+    EXPECT_EQ(attached.absent_count, 4u);
+    EXPECT_EQ(attached.chunk_count, 0u);
+    EXPECT_FALSE(extent_store_is_dirty(&attached));
+
+    // Only the chunk a read touches comes in
+    ASSERT_EQ(disk_file_extents_fault(302, &attached, 2 * EXTENT_CHUNK_SIZE + 1, 10), 0);
+    EXPECT_EQ(attached.absent_count, 3u);
+    EXPECT_FALSE(extent_store_range_absent(&attached, 2 * EXTENT_CHUNK_SIZE, 10));
+
+    char buf[10];
+    ASSERT_EQ(extent_store_read(&attached, buf, 10, 2 * EXTENT_CHUNK_SIZE + 1), 10);
+    EXPECT_EQ(memcmp(buf, &data[2 * EXTENT_CHUNK_SIZE + 1], 10), 0);
+    EXPECT_FALSE(extent_store_is_dirty(&attached));
+
+    // The rest of the file, faulted in whole, matches what was saved
+    ASSERT_EQ(disk_file_extents_fault(302, &attached, 0, attached.size), 0);
+    EXPECT_EQ(attached.absent_count, 0u);
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&attached, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+
+    extent_store_destroy(&attached);
+    disk_file_data_remove(302);
+}
+
+TEST_F(ExtentStoreTest, DiskKeepsChunksCompressed) {
+    std::vector<char> data(4 * EXTENT_CHUNK_SIZE, 'e');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(extent_store_compress_range(&es, 0, es.size), 4u);
+    ASSERT_EQ(disk_file_extents_save(301, &es, 0, es.size), 0);
+
+    // Shrink and persist just the new tail
+    ASSERT_EQ(extent_store_truncate(&es, EXTENT_CHUNK_SIZE + 3), 0);
+    ASSERT_EQ(disk_file_extents_save(301, &es, es.size, 0), 0);
+
+    struct extent_store restored;
+    ASSERT_EQ(extent_store_init(&restored), 0);
+    ASSERT_EQ(disk_file_extents_restore(301, &restored), 0);
+    EXPECT_EQ(restored.size, (uint64_t)EXTENT_CHUNK_SIZE + 3);
+    EXPECT_EQ(restored.compressed_count, 1u);  // Loaded without recompressing
+
+    std::vector<char> out(EXTENT_CHUNK_SIZE + 3);
+    ASSERT_EQ(extent_store_read(&restored, out.data(), out.size(), 0), (ssize_t)out.size());
+    for (char c : out) ASSERT_EQ(c, 'e');
+
+    extent_store_destroy(&restored);
+    disk_file_data_remove(301);
+}
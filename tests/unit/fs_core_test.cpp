@@ -0,0 +1,1005 @@
+/**
+ * Filesystem Core Unit Tests
+ * Tests for the operations shared by the FUSE front ends
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "fs_core.h"
+}
+
+class FsCoreTest : public ::testing::Test {
+protected:
+    struct fs_core fs;
+
+    void SetUp() override {
+        memset(&fs, 0, sizeof(fs));
+        ASSERT_EQ(nary_tree_mt_init(&fs.tree), 0);
+        // Keep clear of the inodes of a real mount sharing the data dir
+        fs.tree.next_inode = 900000;
+        ASSERT_EQ(fs_core_init(&fs), 0);
+
+        struct fs_core_options opts = FS_CORE_OPTIONS_DEFAULT;
+        opts.compress_threads = 0;
+        opts.writeback_ms = 0;
+        opts.rebalance_ms = 0;
+        fs_core_start(&fs, &opts);
+    }
+
+    void TearDown() override {
+        fs_core_close(&fs);
+    }
+
+    // Mount again with a heap WAL of size bytes, set up as fs_core_open
+    // leaves it
+    void MountWithWal(size_t size, bool wal_data = false, unsigned int writeback_ms = 0) {
+        fs_core_close(&fs);
+        memset(&fs, 0, sizeof(fs));
+        ASSERT_EQ(nary_tree_mt_init(&fs.tree), 0);
+        fs.tree.next_inode = 900000;
+        ASSERT_EQ(wal_init(&fs.wal, size), 0);
+        wal_set_lockfree_append(&fs.wal, 1);
+        fs.wal_enabled = 1;
+        ASSERT_EQ(fs_core_init(&fs), 0);
+
+        struct fs_core_options opts = FS_CORE_OPTIONS_DEFAULT;
+        opts.compress_threads = 0;
+        opts.writeback_ms = 0;
+        opts.rebalance_ms = 0;
+        opts.wal_data = wal_data;
+        opts.writeback_ms = writeback_ms;
+        fs_core_start(&fs, &opts);
+    }
+
+    // A new mount over the same data directory: fresh tree and file table,
+    // with the node the last mount left (same inode and size)
+    uint32_t Remount(const char *name, uint32_t inode, uint64_t size) {
+        fs_core_close(&fs);
+        SetUp();
+        fs.tree.next_inode = inode;
+        uint32_t idx = nary_insert_mt(&fs.tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        struct nary_node node;
+        if (idx == NARY_INVALID_IDX || nary_read_node_mt(&fs.tree, idx, &node) != 0 ||
+            node.inode != inode) {
+            return NARY_INVALID_IDX;
+        }
+        node.size = size;
+        nary_update_node_mt(&fs.tree, idx, &node);
+        return idx;
+    }
+};
+
+TEST_F(FsCoreTest, CreateWriteReadTruncate) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "file", 0644, &node), 0);
+    EXPECT_TRUE(NARY_IS_FILE(&node));
+    EXPECT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "file", 0644, NULL), -EEXIST);
+
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    EXPECT_EQ(fh, node.inode);
+
+    const char data[] = "hello razorfs";
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, data, sizeof(data), 0), (ssize_t)sizeof(data));
+
+    struct stat st;
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_size, (off_t)sizeof(data));
+    EXPECT_EQ(st.st_ino, node.inode);
+
+    char buf[64] = {0};
+    ASSERT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), (ssize_t)sizeof(data));
+    EXPECT_STREQ(buf, data);
+
+    ASSERT_EQ(fs_core_truncate(&fs, idx, 5), 0);
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_size, 5);
+    EXPECT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), 5);
+    EXPECT_EQ(fs_core_truncate(&fs, idx, -1), -EINVAL);
+
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_fsync(&fs, fh), 0);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+}
+
+TEST_F(FsCoreTest, TruncateToZeroOfStoredDataSurvivesRemount) {
+    // Mount A: a file of more than one chunk, written back
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "stored", 0644, &node), 0);
+    uint32_t inode = node.inode;
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, inode);
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    std::string data(100000, 'A');
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(fs_core_fsync(&fs, fh), 0);
+    fs_core_release(&fs, fh);
+
+    // Mount B: truncate the never-opened file, then write past the first chunk
+    idx = Remount("stored", inode, data.size());
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+    ASSERT_EQ(fs_core_truncate(&fs, idx, 0), 0);
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, "Z", 1, EXTENT_CHUNK_SIZE), 1);
+    ASSERT_EQ(fs_core_fsync(&fs, fh), 0);
+    fs_core_release(&fs, fh);
+
+    // Mount C: the truncated bytes read as a hole
+    idx = Remount("stored", inode, EXTENT_CHUNK_SIZE + 1);
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    std::string out(EXTENT_CHUNK_SIZE + 1, 'x');
+    ASSERT_EQ(fs_core_read(&fs, fh, &out[0], out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out.find_first_not_of('\0'), (size_t)EXTENT_CHUNK_SIZE);
+    EXPECT_EQ(out.back(), 'Z');
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+}
+
+TEST_F(FsCoreTest, FullWalIsCheckpointedInTheBackground) {
+    MountWithWal(WAL_MIN_SIZE);
+
+    // Inserts filling the log several times over: none may be dropped
+    // for want of room
+    const int dirs = 100, per_dir = 400;
+    for (int d = 0; d < dirs; d++) {
+        struct nary_node dir;
+        std::string name = "d" + std::to_string(d);
+        ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, name.c_str(), 0755, &dir), 0);
+        uint32_t dir_idx = nary_inode_lookup_mt(&fs.tree, dir.inode);
+        for (int i = 0; i < per_dir; i++) {
+            struct nary_node sub;
+            name = "s" + std::to_string(i);
+            ASSERT_EQ(fs_core_mkdir(&fs, dir_idx, name.c_str(), 0755, &sub), 0);
+        }
+    }
+
+    struct wal_stats stats;
+    wal_get_stats(&fs.wal, &stats);
+    EXPECT_GT(stats.total_checkpoints, 0u);
+    EXPECT_GT(stats.bytes_reclaimed, (uint64_t)WAL_MIN_SIZE);
+    EXPECT_EQ(stats.total_entries - stats.total_checkpoints,
+              (uint64_t)dirs * (per_dir + 1));
+}
+
+TEST_F(FsCoreTest, FullPayloadWalIsCheckpointedOffTheWriters) {
+    MountWithWal(WAL_MIN_SIZE, true, 50);
+
+    // Writers logging many times the log's worth of payloads: each
+    // either has room or waits for the checkpoint thread, which needs
+    // the writers out of the gate (no deadlock) and the data written back
+    const int threads = 4, writes = 64;
+    const size_t len = 64 * 1024;
+    std::vector<uint64_t> fhs(threads);
+    std::vector<uint32_t> idxs(threads);
+    for (int t = 0; t < threads; t++) {
+        struct nary_node node;
+        std::string name = "payload" + std::to_string(t);
+        ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, name.c_str(), 0644, &node), 0);
+        idxs[t] = nary_inode_lookup_mt(&fs.tree, node.inode);
+        ASSERT_EQ(fs_core_open_file(&fs, idxs[t], &fhs[t]), 0);
+    }
+
+    std::vector<std::thread> workers;
+    std::vector<int> failures(threads, 0);
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            // Incompressible, so the payloads take their full size
+            std::vector<char> buf(len);
+            uint32_t x = 2463534242u + (uint32_t)t;
+            for (int w = 0; w < writes; w++) {
+                for (auto &c : buf) {
+                    x ^= x << 13;
+                    x ^= x >> 17;
+                    x ^= x << 5;
+                    c = (char)x;
+                }
+                if (fs_core_write(&fs, idxs[t], fhs[t], buf.data(), len,
+                                  (off_t)(w * len)) != (ssize_t)len) {
+                    failures[t]++;
+                }
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+    for (int t = 0; t < threads; t++) EXPECT_EQ(failures[t], 0);
+
+    struct wal_stats stats;
+    wal_get_stats(&fs.wal, &stats);
+    EXPECT_GT(stats.total_checkpoints, 0u);
+    EXPECT_GT(stats.bytes_reclaimed, (uint64_t)WAL_MIN_SIZE);
+    EXPECT_EQ(stats.payload_bytes, (uint64_t)threads * writes * len);
+}
+
+TEST_F(FsCoreTest, DurabilityModesAndDeferredErrors) {
+    // Unset means periodic
+    EXPECT_EQ(fs.durability, FS_DURABILITY_PERIODIC);
+
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "durable", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, "x", 1, 0), 1);
+
+    EXPECT_EQ(fs_core_flush(&fs, fh), 0);
+    EXPECT_EQ(fs_core_fsync(&fs, fh), 0);
+    EXPECT_EQ(fs_core_fsyncdir(&fs), 0);
+
+    // A failed background write-back is reported once, by flush or fsync
+    struct fs_file_data *fd = fs_core_find_file(&fs, node.inode);
+    ASSERT_NE(fd, nullptr);
+    fd->wb_error = 1;
+    EXPECT_EQ(fs_core_flush(&fs, fh), -EIO);
+    EXPECT_EQ(fs_core_flush(&fs, fh), 0);
+    fd->wb_error = 1;
+    EXPECT_EQ(fs_core_fsync(&fs, fh), -EIO);
+    EXPECT_EQ(fs_core_fsync(&fs, fh), 0);
+
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+}
+
+TEST_F(FsCoreTest, DurabilityOptionIsParsed) {
+    const char *names[] = {"sync", "periodic", "fsync-only", "bogus"};
+    const enum fs_durability modes[] = {FS_DURABILITY_SYNC, FS_DURABILITY_PERIODIC,
+                                        FS_DURABILITY_FSYNC, FS_DURABILITY_PERIODIC};
+    for (int i = 0; i < 4; i++) {
+        fs_core_close(&fs);
+        memset(&fs, 0, sizeof(fs));
+        ASSERT_EQ(nary_tree_mt_init(&fs.tree), 0);
+        fs.tree.next_inode = 900000;
+        ASSERT_EQ(fs_core_init(&fs), 0);
+
+        struct fs_core_options opts = FS_CORE_OPTIONS_DEFAULT;
+        opts.compress_threads = 0;
+        opts.writeback_ms = 50;
+        opts.rebalance_ms = 0;
+        opts.durability = const_cast<char *>(names[i]);
+        fs_core_start(&fs, &opts);
+
+        EXPECT_EQ(fs.durability, modes[i]) << names[i];
+        // Synchronous mounts write file data through
+        EXPECT_EQ(fs.writeback.interval_ms, modes[i] == FS_DURABILITY_SYNC ? 0u : 50u)
+            << names[i];
+    }
+}
+
+TEST_F(FsCoreTest, FallocatePunchAndSeek) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "sparse", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+
+    // Growing the size allocates nothing
+    ASSERT_EQ(fs_core_fallocate(&fs, idx, 0, 0, (off_t)1 << 30), 0);
+    struct stat st;
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_size, (off_t)1 << 30);
+    EXPECT_EQ(fs_core_fallocate(&fs, idx, FALLOC_FL_KEEP_SIZE, 0, (off_t)2 << 30), 0);
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_size, (off_t)1 << 30);
+    EXPECT_EQ(fs_core_lseek(&fs, fh, 0, SEEK_DATA), -ENXIO);
+    EXPECT_EQ(fs_core_lseek(&fs, fh, 0, SEEK_HOLE), 0);
+
+    std::vector<char> data(4 * EXTENT_CHUNK_SIZE, 'd');
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, data.data(), data.size(), 0), (ssize_t)data.size());
+
+    // Punching needs KEEP_SIZE; other modes are not supported
+    EXPECT_EQ(fs_core_fallocate(&fs, idx, FALLOC_FL_PUNCH_HOLE, 0, 1), -EOPNOTSUPP);
+    EXPECT_EQ(fs_core_fallocate(&fs, idx, FALLOC_FL_ZERO_RANGE, 0, 1), -EOPNOTSUPP);
+    ASSERT_EQ(fs_core_fallocate(&fs, idx, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                EXTENT_CHUNK_SIZE, 2 * EXTENT_CHUNK_SIZE), 0);
+
+    EXPECT_EQ(fs_core_lseek(&fs, fh, 0, SEEK_HOLE), (off_t)EXTENT_CHUNK_SIZE);
+    EXPECT_EQ(fs_core_lseek(&fs, fh, EXTENT_CHUNK_SIZE, SEEK_DATA), (off_t)(3 * EXTENT_CHUNK_SIZE));
+    EXPECT_EQ(fs_core_lseek(&fs, fh, 3 * EXTENT_CHUNK_SIZE, SEEK_HOLE), (off_t)(4 * EXTENT_CHUNK_SIZE));
+    EXPECT_EQ(fs_core_lseek(&fs, fh, (off_t)1 << 30, SEEK_HOLE), -ENXIO);
+
+    char buf[4];
+    ASSERT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 2 * EXTENT_CHUNK_SIZE), 4);
+    EXPECT_EQ(memcmp(buf, "\0\0\0\0", 4), 0);
+
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+}
+
+// Collects up to `room` entries per readdir call
+struct Listing {
+    std::vector<std::string> names;
+    std::vector<struct nary_node> nodes;
+    off_t next_off = 0;
+    int room = 0;
+};
+
+static int collect_dirent(void *ctx, const char *name, const struct nary_node *node,
+                          off_t next_off) {
+    Listing *l = static_cast<Listing *>(ctx);
+    if (l->room == 0) return 0;
+    l->room--;
+    l->names.push_back(name);
+    l->nodes.push_back(*node);
+    l->next_off = next_off;
+    return 1;
+}
+
+// Lists a directory `batch` entries per call, calling between() after the first
+static void list_dir(struct fs_core *fs, uint32_t idx, uint64_t dh, int batch, Listing *l,
+                     const std::function<void()> &between = nullptr) {
+    for (int call = 0;; call++) {
+        size_t before = l->names.size();
+        l->room = batch;
+        ASSERT_EQ(fs_core_readdir(fs, idx, dh, l->next_off, collect_dirent, l), 0);
+        if (l->names.size() == before) break;
+        if (call == 0 && between) between();
+    }
+}
+
+TEST_F(FsCoreTest, ReaddirResumesAcrossCalls) {
+    struct nary_node dir;
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "big", 0755, &dir), 0);
+    uint32_t dir_idx = nary_inode_lookup_mt(&fs.tree, dir.inode);
+    ASSERT_NE(dir_idx, NARY_INVALID_IDX);
+
+    const int files = 200;
+    for (int i = 0; i < files; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%03d", i);
+        ASSERT_EQ(fs_core_create(&fs, dir_idx, name, 0644, NULL), 0);
+    }
+
+    uint64_t dh = 0;
+    EXPECT_EQ(fs_core_opendir(&fs, NARY_ROOT_IDX, &dh), 0);
+    fs_core_releasedir(&fs, dh);
+    ASSERT_EQ(fs_core_opendir(&fs, dir_idx, &dh), 0);
+
+    // Small batches, with a cursor and without one
+    for (uint64_t handle : {dh, (uint64_t)0}) {
+        Listing l;
+        list_dir(&fs, dir_idx, handle, 7, &l);
+        ASSERT_EQ(l.names.size(), (size_t)files + 2);
+        EXPECT_EQ(l.names[0], ".");
+        EXPECT_EQ(l.names[1], "..");
+        EXPECT_EQ(l.nodes[1].inode, fs.tree.nodes[NARY_ROOT_IDX].node.inode);
+        for (int i = 0; i < files; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "f%03d", i);
+            EXPECT_EQ(l.names[i + 2], name);
+            // Whole nodes come along: attributes need no lookup
+            EXPECT_TRUE(NARY_IS_FILE(&l.nodes[i + 2]));
+        }
+    }
+
+    // A directory changed mid-listing is walked again, not resumed blindly
+    Listing l;
+    list_dir(&fs, dir_idx, dh, 50, &l, [&]() {
+        ASSERT_EQ(fs_core_create(&fs, dir_idx, "zzz", 0644, NULL), 0);
+    });
+    ASSERT_EQ(l.names.size(), (size_t)files + 3);
+    EXPECT_EQ(l.names.back(), "zzz");
+    fs_core_releasedir(&fs, dh);
+
+    struct nary_node file;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "plain", 0644, &file), 0);
+    EXPECT_EQ(fs_core_opendir(&fs, nary_inode_lookup_mt(&fs.tree, file.inode), &dh), -ENOTDIR);
+}
+
+TEST_F(FsCoreTest, PinnedReadMatchesCopy) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "pinned", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    uint64_t fh;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+
+    std::string data(3 * EXTENT_CHUNK_SIZE / 2, 'p');
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, data.data(), data.size(), 0), (ssize_t)data.size());
+
+    struct fs_read_pin pin;
+    ASSERT_EQ(fs_core_read_pin(&fs, fh, data.size(), 0, &pin), (ssize_t)data.size());
+    EXPECT_NE(pin.fd, nullptr);
+    std::string viewed;
+    for (uint32_t i = 0; i < pin.view.count; i++) {
+        viewed.append((const char *)pin.view.iov[i].iov_base, pin.view.iov[i].iov_len);
+    }
+    fs_core_read_unpin(&pin);
+    EXPECT_EQ(pin.fd, nullptr);
+    EXPECT_EQ(viewed, data);
+
+    // Unpinning released the lock: writes go through again
+    EXPECT_EQ(fs_core_write(&fs, idx, fh, "q", 1, 0), 1);
+    EXPECT_EQ(fs_core_read_pin(&fs, fh, 1, -1, &pin), -EINVAL);
+
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+}
+
+TEST_F(FsCoreTest, MemoryBudgetEvictsColdFileData) {
+    // Room for four chunks of file data next to the tree
+    fs.memory_limit = nary_get_memory_usage_mt(&fs.tree) + 4 * EXTENT_CHUNK_SIZE;
+
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "big", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    uint64_t fh;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+
+    // Written through (writeback_ms = 0), so every chunk is clean and evictable
+    std::string data(8 * EXTENT_CHUNK_SIZE, '\0');
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i * 7 % 253);
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, data.data(), data.size(), 0), (ssize_t)data.size());
+    EXPECT_GT(fs.evicted_bytes, 0u);
+    EXPECT_LE(fs.file_bytes, fs.file_budget);
+
+    // Evicted chunks fault back in on access
+    std::string out(data.size(), '\0');
+    ASSERT_EQ(fs_core_read(&fs, fh, &out[0], out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+    EXPECT_LE(fs.file_bytes, fs.file_budget);
+
+    // Overwriting part of an evicted chunk keeps the rest of it
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, "zz", 2, 10), 2);
+    data.replace(10, 2, "zz");
+    ASSERT_EQ(fs_core_read(&fs, fh, &out[0], 64, 0), 64);
+    EXPECT_EQ(out.compare(0, 64, data, 0, 64), 0);
+
+    fs_core_release(&fs, fh);
+    EXPECT_EQ(fs_core_unlink(&fs, idx), 0);
+    EXPECT_EQ(fs.file_bytes, 0u);
+}
+
+TEST_F(FsCoreTest, DirectoryRules) {
+    struct nary_node dir;
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "dir", 0755, &dir), 0);
+    EXPECT_TRUE(NARY_IS_DIR(&dir));
+    uint32_t dir_idx = nary_inode_lookup_mt(&fs.tree, dir.inode);
+
+    struct nary_node file;
+    ASSERT_EQ(fs_core_create(&fs, dir_idx, "inner", 0644, &file), 0);
+    uint32_t file_idx = nary_inode_lookup_mt(&fs.tree, file.inode);
+
+    EXPECT_EQ(fs_core_rmdir(&fs, dir_idx), -ENOTEMPTY);
+    EXPECT_EQ(fs_core_rmdir(&fs, file_idx), -ENOTDIR);
+    EXPECT_EQ(fs_core_unlink(&fs, dir_idx), -EISDIR);
+
+    uint64_t fh;
+    EXPECT_EQ(fs_core_open_file(&fs, dir_idx, &fh), -EISDIR);
+
+    ASSERT_EQ(fs_core_unlink(&fs, nary_inode_lookup_mt(&fs.tree, file.inode)), 0);
+    EXPECT_EQ(nary_inode_lookup_mt(&fs.tree, file.inode), NARY_INVALID_IDX);
+    EXPECT_EQ(fs_core_rmdir(&fs, nary_inode_lookup_mt(&fs.tree, dir.inode)), 0);
+}
+
+TEST_F(FsCoreTest, CreatedNodeIsReportedAcrossRebalance) {
+    // Compaction may renumber nodes between creates; the node handed back
+    // must still be the one just created
+    for (int i = 0; i < 250; i++) {
+        std::string name = "n" + std::to_string(i);
+        struct nary_node node;
+        ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, name.c_str(), 0644, &node), 0);
+
+        uint32_t idx = nary_find_child_mt(&fs.tree, NARY_ROOT_IDX, name.c_str());
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        EXPECT_EQ(fs.tree.nodes[idx].node.inode, node.inode) << name;
+    }
+}
+
+TEST_F(FsCoreTest, ChmodUtimensRename) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "a", 0644, &node), 0);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "b", 0644, NULL), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+
+    ASSERT_EQ(fs_core_chmod(&fs, idx, 0600), 0);
+    struct stat st;
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_mode, (mode_t)(S_IFREG | 0600));
+
+    struct timespec tv[2] = { { 0, UTIME_OMIT }, { 12345, 0 } };
+    ASSERT_EQ(fs_core_utimens(&fs, idx, tv), 0);
+    ASSERT_EQ(fs_core_getattr(&fs, idx, &st), 0);
+    EXPECT_EQ(st.st_mtime, 12345);
+
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, idx, NARY_ROOT_IDX, "b", RENAME_NOREPLACE), -EEXIST);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, idx, idx, "c", 0), -ENOTDIR);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, NARY_ROOT_IDX, NARY_ROOT_IDX, "c", 0), -EBUSY);
+}
+
+TEST_F(FsCoreTest, RenameAndUnlinkReleaseNames) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "before", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    uint32_t unreferenced = fs.tree.strings.unreferenced_bytes;
+
+    // The old name is left without a user
+    ASSERT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, idx, NARY_ROOT_IDX, "after", 0), 0);
+    EXPECT_STREQ(string_table_get(&fs.tree.strings, fs.tree.nodes[idx].node.name_offset), "after");
+    EXPECT_EQ(fs.tree.strings.unreferenced_bytes, unreferenced + sizeof("before"));
+
+    ASSERT_EQ(fs_core_unlink(&fs, idx), 0);
+    EXPECT_EQ(fs.tree.strings.unreferenced_bytes,
+              unreferenced + sizeof("before") + sizeof("after"));
+}
+
+TEST_F(FsCoreTest, RenameMovesAndReplacesAcrossDirectories) {
+    struct nary_node d1, d2, file, victim;
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "d1", 0755, &d1), 0);
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "d2", 0755, &d2), 0);
+    uint32_t d1_idx = nary_inode_lookup_mt(&fs.tree, d1.inode);
+    uint32_t d2_idx = nary_inode_lookup_mt(&fs.tree, d2.inode);
+    ASSERT_EQ(fs_core_create(&fs, d1_idx, "f", 0644, &file), 0);
+    ASSERT_EQ(fs_core_create(&fs, d2_idx, "g", 0644, &victim), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, file.inode);
+
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    ASSERT_EQ(fs_core_write(&fs, idx, fh, "moved", 5, 0), 5);
+    fs_core_release(&fs, fh);
+    uint32_t victim_idx = nary_inode_lookup_mt(&fs.tree, victim.inode);
+    ASSERT_EQ(fs_core_open_file(&fs, victim_idx, &fh), 0);
+    ASSERT_EQ(fs_core_write(&fs, victim_idx, fh, "gone", 4, 0), 4);
+    fs_core_release(&fs, fh);
+
+    // Moving onto d2/g replaces it: same node, same data, g's data dropped
+    ASSERT_EQ(fs_core_rename(&fs, d1_idx, idx, d2_idx, "g", 0), 0);
+    EXPECT_EQ(nary_find_child_mt(&fs.tree, d1_idx, "f"), NARY_INVALID_IDX);
+    EXPECT_EQ(nary_find_child_mt(&fs.tree, d2_idx, "g"), idx);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/d2/g"), idx);
+    EXPECT_EQ(fs.tree.nodes[idx].node.parent_idx, d2_idx);
+    EXPECT_EQ(nary_inode_lookup_mt(&fs.tree, victim.inode), NARY_INVALID_IDX);
+    EXPECT_EQ(fs_core_find_file(&fs, victim.inode), nullptr);
+
+    char buf[8] = {0};
+    ASSERT_EQ(fs_core_open_file(&fs, idx, &fh), 0);
+    EXPECT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), 5);
+    EXPECT_EQ(std::string(buf, 5), "moved");
+    fs_core_release(&fs, fh);
+
+    // Directories move with their contents and never below themselves
+    ASSERT_EQ(fs_core_mkdir(&fs, d1_idx, "sub", 0755, NULL), 0);
+    uint32_t sub_idx = nary_find_child_mt(&fs.tree, d1_idx, "sub");
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, d1_idx, sub_idx, "x", 0), -EINVAL);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, d1_idx, d1_idx, "x", 0), -EINVAL);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, d2_idx, NARY_ROOT_IDX, "d1", 0), -ENOTEMPTY);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, d1_idx, d2_idx, "g", 0), -ENOTDIR);
+    EXPECT_EQ(fs_core_rename(&fs, d2_idx, idx, d1_idx, "sub", 0), -EISDIR);
+    EXPECT_EQ(fs_core_rename(&fs, d1_idx, idx, d1_idx, "h", 0), -ENOENT);
+
+    ASSERT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, d2_idx, sub_idx, "moved", 0), 0);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/d1/sub/moved/g"), idx);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/d2"), NARY_INVALID_IDX);
+
+    // An empty directory can be replaced by another
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "empty", 0755, NULL), 0);
+    ASSERT_EQ(fs_core_rename(&fs, d1_idx, sub_idx, NARY_ROOT_IDX, "empty", 0), 0);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/empty/moved/g"), idx);
+}
+
+TEST_F(FsCoreTest, RenameExchangeSwapsEntries) {
+    struct nary_node dir, a, b;
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "dir", 0755, &dir), 0);
+    uint32_t dir_idx = nary_inode_lookup_mt(&fs.tree, dir.inode);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "a", 0644, &a), 0);
+    ASSERT_EQ(fs_core_create(&fs, dir_idx, "b", 0644, &b), 0);
+    uint32_t a_idx = nary_inode_lookup_mt(&fs.tree, a.inode);
+    uint32_t b_idx = nary_inode_lookup_mt(&fs.tree, b.inode);
+    uint32_t unreferenced = fs.tree.strings.unreferenced_bytes;
+
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, a_idx, dir_idx, "none", RENAME_EXCHANGE), -ENOENT);
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, a_idx, dir_idx, "b",
+                             RENAME_EXCHANGE | RENAME_NOREPLACE), -EINVAL);
+
+    ASSERT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, a_idx, dir_idx, "b", RENAME_EXCHANGE), 0);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/dir/b"), a_idx);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/a"), b_idx);
+    EXPECT_EQ(fs.tree.strings.unreferenced_bytes, unreferenced);
+
+    // A directory cannot be swapped with something below it
+    EXPECT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, dir_idx, dir_idx, "b", RENAME_EXCHANGE), -EINVAL);
+
+    // Files and directories can trade places
+    ASSERT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, dir_idx, NARY_ROOT_IDX, "a", RENAME_EXCHANGE), 0);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/a/b"), a_idx);
+    EXPECT_EQ(nary_path_lookup_mt(&fs.tree, "/dir"), b_idx);
+}
+
+TEST_F(FsCoreTest, ExtendedAttributesFollowTheNode) {
+    struct nary_node a, b;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "a", 0644, &a), 0);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "b", 0644, &b), 0);
+    uint32_t a_idx = nary_inode_lookup_mt(&fs.tree, a.inode);
+    uint32_t b_idx = nary_inode_lookup_mt(&fs.tree, b.inode);
+
+    // Nodes without attributes answer from xattr_head alone
+    char buf[64];
+    struct xattr_stats stats;
+    EXPECT_EQ(fs_core_getxattr(&fs, a_idx, "user.k", buf, sizeof(buf)), -ENODATA);
+    EXPECT_EQ(fs_core_listxattr(&fs, a_idx, buf, sizeof(buf)), 0);
+    xattr_get_stats(&fs.xattrs, &stats);
+    EXPECT_EQ(stats.negative, 2u);
+    EXPECT_EQ(stats.lookups, 0u);
+
+    ASSERT_EQ(fs_core_setxattr(&fs, a_idx, "user.k", "value", 5, 0), 0);
+    ASSERT_EQ(fs_core_setxattr(&fs, b_idx, "user.k", "other", 5, 0), 0);
+    EXPECT_EQ(fs_core_getxattr(&fs, a_idx, "user.k", buf, sizeof(buf)), 5);
+    EXPECT_EQ(std::string(buf, 5), "value");
+    EXPECT_EQ(fs_core_listxattr(&fs, a_idx, buf, sizeof(buf)), 7);
+    EXPECT_STREQ(buf, "user.k");
+
+    // Attributes move with a rename and go with the node they belong to
+    ASSERT_EQ(fs_core_rename(&fs, NARY_ROOT_IDX, a_idx, NARY_ROOT_IDX, "b", 0), 0);
+    EXPECT_EQ(fs_core_getxattr(&fs, a_idx, "user.k", buf, sizeof(buf)), 5);
+    EXPECT_EQ(std::string(buf, 5), "value");
+    EXPECT_EQ(fs.xattrs.live, 1u);
+
+    ASSERT_EQ(fs_core_removexattr(&fs, a_idx, "user.k"), 0);
+    EXPECT_EQ(fs_core_removexattr(&fs, a_idx, "user.k"), -ENODATA);
+    ASSERT_EQ(fs_core_setxattr(&fs, a_idx, "user.k", "again", 5, 0), 0);
+    ASSERT_EQ(fs_core_unlink(&fs, a_idx), 0);
+    EXPECT_EQ(fs.xattrs.live, 0u);
+}
+
+// Appends one FS_CORE_IOC_CREATE_BATCH record
+static void add_record(struct fs_core_batch_ioctl *req, size_t *pos, uint32_t mode,
+                       const char *name) {
+    memcpy(req->buf + *pos, &mode, sizeof(mode));
+    *pos += sizeof(mode);
+    strcpy(req->buf + *pos, name);
+    *pos += strlen(name) + 1;
+    req->count++;
+}
+
+TEST_F(FsCoreTest, BatchCreateThroughIoctlBuffer) {
+    struct nary_node dir;
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "bulk", 0755, &dir), 0);
+    uint32_t dir_idx = nary_inode_lookup_mt(&fs.tree, dir.inode);
+
+    struct fs_core_batch_ioctl req = {};
+    size_t pos = 0;
+    add_record(&req, &pos, S_IFREG | 0644, "file");
+    add_record(&req, &pos, S_IFDIR | 0755, "sub");
+    ASSERT_EQ(fs_core_ioctl_create_batch(&fs, dir_idx, &req), 0);
+    EXPECT_EQ(req.created, 2u);
+
+    uint32_t file_idx = nary_path_lookup_mt(&fs.tree, "/bulk/file");
+    ASSERT_NE(file_idx, NARY_INVALID_IDX);
+    ASSERT_NE(nary_path_lookup_mt(&fs.tree, "/bulk/sub"), NARY_INVALID_IDX);
+
+    // Batch files get their data storage on first write
+    uint64_t fh = 0;
+    ASSERT_EQ(fs_core_open_file(&fs, file_idx, &fh), 0);
+    ASSERT_EQ(fs_core_write(&fs, file_idx, fh, "data", 4, 0), 4);
+    char buf[8];
+    EXPECT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), 4);
+    fs_core_release(&fs, fh);
+
+    // Devices, names with '/', and records past the buffer are refused
+    struct fs_core_batch_ioctl bad = {};
+    pos = 0;
+    add_record(&bad, &pos, S_IFCHR | 0644, "dev");
+    EXPECT_EQ(fs_core_ioctl_create_batch(&fs, dir_idx, &bad), -EINVAL);
+    bad = {};
+    pos = 0;
+    add_record(&bad, &pos, S_IFREG | 0644, "a/b");
+    EXPECT_EQ(fs_core_ioctl_create_batch(&fs, dir_idx, &bad), -EINVAL);
+    bad = {};
+    memset(bad.buf, 'x', sizeof(bad.buf));
+    bad.count = 1;
+    EXPECT_EQ(fs_core_ioctl_create_batch(&fs, dir_idx, &bad), -EINVAL);
+    EXPECT_EQ(fs.tree.nodes[dir_idx].node.num_children, 2);
+}
+
+TEST_F(FsCoreTest, FileTableKeepsAddressesAndRecyclesEntries) {
+    struct nary_node a, b;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "keep", 0644, &a), 0);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "drop", 0644, &b), 0);
+    struct fs_file_data *kept = fs_core_find_file(&fs, a.inode);
+    struct fs_file_data *dropped = fs_core_find_file(&fs, b.inode);
+    ASSERT_NE(kept, nullptr);
+    ASSERT_NE(dropped, nullptr);
+
+    // Growing the table never moves existing entries
+    for (int i = 0; i < 300; i++) {
+        ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, ("g" + std::to_string(i)).c_str(),
+                                 0644, NULL), 0);
+    }
+    EXPECT_EQ(fs_core_find_file(&fs, a.inode), kept);
+
+    // A removed entry stays valid memory and is handed out again
+    ASSERT_EQ(fs_core_unlink(&fs, nary_inode_lookup_mt(&fs.tree, b.inode)), 0);
+    EXPECT_EQ(fs_core_find_file(&fs, b.inode), nullptr);
+    EXPECT_FALSE(dropped->is_active);
+
+    struct nary_node c;
+    uint32_t inode;
+    do {  // Same shard as the removed entry
+        ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, ("r" + std::to_string(fs.tree.next_inode)).c_str(),
+                                 0644, &c), 0);
+        inode = c.inode;
+    } while (inode % FS_CORE_FILE_SHARDS != b.inode % FS_CORE_FILE_SHARDS);
+    EXPECT_EQ(fs_core_find_file(&fs, inode), dropped);
+    EXPECT_TRUE(dropped->is_active);
+
+    // Stale handles of the old file see nothing of the new one
+    char buf[4];
+    EXPECT_EQ(fs_core_read(&fs, b.inode, buf, sizeof(buf), 0), 0);
+}
+
+TEST_F(FsCoreTest, SnapshotsKeepNamespaceAndData) {
+    struct nary_node doc, gone;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "doc", 0644, &doc), 0);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "gone", 0644, &gone), 0);
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "dir", 0755, NULL), 0);
+    uint32_t doc_idx = nary_inode_lookup_mt(&fs.tree, doc.inode);
+    uint32_t gone_idx = nary_inode_lookup_mt(&fs.tree, gone.inode);
+    std::string a(3 * EXTENT_CHUNK_SIZE, 'a');
+    ASSERT_EQ(fs_core_write(&fs, doc_idx, doc.inode, a.data(), a.size(), 0), (ssize_t)a.size());
+    ASSERT_EQ(fs_core_write(&fs, gone_idx, gone.inode, "bye", 3, 0), 3);
+
+    // Plain unique names; the directory's name is taken in the root
+    EXPECT_EQ(fs_core_snapshot_create(&fs, ""), -EINVAL);
+    EXPECT_EQ(fs_core_snapshot_create(&fs, "a/b"), -EINVAL);
+    ASSERT_EQ(fs_core_snapshot_create(&fs, "s1"), 0);
+    EXPECT_EQ(fs_core_snapshot_create(&fs, "s1"), -EEXIST);
+    EXPECT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, FS_CORE_SNAPSHOT_DIR, 0755, NULL), -EEXIST);
+    EXPECT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, FS_CORE_SNAPSHOT_DIR, 0644, NULL), -EEXIST);
+    uint32_t s1 = fs_core_snapshot_find(&fs, "s1");
+    ASSERT_NE(s1, 0u);
+
+    // Overwrite, punch, shrink, unlink and create afterwards
+    std::string b(100, 'b');
+    ASSERT_EQ(fs_core_write(&fs, doc_idx, doc.inode, b.data(), b.size(), EXTENT_CHUNK_SIZE),
+              (ssize_t)b.size());
+    ASSERT_EQ(fs_core_fallocate(&fs, doc_idx, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, 10), 0);
+    ASSERT_EQ(fs_core_truncate(&fs, doc_idx, 2 * EXTENT_CHUNK_SIZE + 5), 0);
+    ASSERT_EQ(fs_core_unlink(&fs, gone_idx), 0);
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "new", 0644, NULL), 0);
+
+    // The snapshot reads as it was, and only reads
+    uint32_t idx;
+    struct nary_node node;
+    ASSERT_EQ(fs_core_snapshot_lookup(&fs, s1, NARY_ROOT_IDX, "doc", &idx, &node), 0);
+    EXPECT_EQ(node.size, a.size());
+    EXPECT_EQ(node.mode & 0222, 0);
+    uint64_t fh = 0;
+    EXPECT_EQ(fs_core_snapshot_open(&fs, s1, idx, O_RDWR, &fh), -EROFS);
+    ASSERT_EQ(fs_core_snapshot_open(&fs, s1, idx, O_RDONLY, &fh), 0);
+    std::string got(a.size() + 10, 'x');
+    ASSERT_EQ(fs_core_read(&fs, fh, &got[0], got.size(), 0), (ssize_t)a.size());
+    got.resize(a.size());
+    EXPECT_EQ(got, a);
+    EXPECT_EQ(fs_core_write(&fs, idx, fh, "x", 1, 0), -EROFS);
+    EXPECT_EQ(fs_core_lseek(&fs, fh, 0, SEEK_HOLE), (off_t)a.size());
+    fs_core_release(&fs, fh);
+
+    ASSERT_EQ(fs_core_snapshot_lookup(&fs, s1, NARY_ROOT_IDX, "gone", &idx, NULL), 0);
+    ASSERT_EQ(fs_core_snapshot_open(&fs, s1, idx, O_RDONLY, &fh), 0);
+    char buf[8] = {0};
+    EXPECT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), 3);
+    EXPECT_STREQ(buf, "bye");
+    EXPECT_EQ(fs_core_snapshot_lookup(&fs, s1, NARY_ROOT_IDX, "new", &idx, NULL), -ENOENT);
+
+    // While the live file moved on
+    ASSERT_EQ(fs_core_read(&fs, doc.inode, buf, 4, 0), 4);
+    EXPECT_EQ(memcmp(buf, "\0\0\0\0", 4), 0);
+    ASSERT_EQ(fs_core_read(&fs, doc.inode, buf, 4, EXTENT_CHUNK_SIZE), 4);
+    EXPECT_EQ(memcmp(buf, "bbbb", 4), 0);
+
+    Listing snaps;
+    snaps.room = 100;
+    ASSERT_EQ(fs_core_snapshot_list(&fs, 0, collect_dirent, &snaps), 0);
+    EXPECT_EQ(snaps.names, (std::vector<std::string>{".", "..", "s1"}));
+
+    uint64_t dh = 0;
+    ASSERT_EQ(fs_core_snapshot_opendir(&fs, s1, NARY_ROOT_IDX, &dh), 0);
+    Listing root;
+    root.room = 100;
+    ASSERT_EQ(fs_core_snapshot_readdir(&fs, s1, NARY_ROOT_IDX, dh, 0, collect_dirent, &root), 0);
+    EXPECT_EQ(root.names, (std::vector<std::string>{".", "..", "dir", "doc", "gone"}));
+    EXPECT_EQ(root.nodes[1].inode, FS_CORE_SNAPSHOT_DIR_INODE);
+    Listing rest;
+    rest.room = 100;
+    ASSERT_EQ(fs_core_snapshot_readdir(&fs, s1, NARY_ROOT_IDX, dh, 3, collect_dirent, &rest), 0);
+    EXPECT_EQ(rest.names, (std::vector<std::string>{"doc", "gone"}));
+    fs_core_releasedir(&fs, dh);
+
+    ASSERT_EQ(fs_core_snapshot_delete(&fs, "s1"), 0);
+    EXPECT_EQ(fs_core_snapshot_delete(&fs, "s1"), -ENOENT);
+    EXPECT_EQ(fs_core_read(&fs, fh, buf, sizeof(buf), 0), -ESTALE);
+}
+
+TEST_F(FsCoreTest, DroppedSnapshotsHandDataToOlderOnes) {
+    struct nary_node file;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "f", 0644, &file), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, file.inode);
+    ASSERT_EQ(fs_core_write(&fs, idx, file.inode, "one", 3, 0), 3);
+
+    // "one" is saved in s2 only, "two" in s3
+    ASSERT_EQ(fs_core_snapshot_create(&fs, "s1"), 0);
+    ASSERT_EQ(fs_core_snapshot_create(&fs, "s2"), 0);
+    ASSERT_EQ(fs_core_write(&fs, idx, file.inode, "two", 3, 0), 3);
+    ASSERT_EQ(fs_core_snapshot_create(&fs, "s3"), 0);
+    ASSERT_EQ(fs_core_write(&fs, idx, file.inode, "333", 3, 0), 3);
+    ASSERT_EQ(fs_core_unlink(&fs, idx), 0);
+
+    auto read_in = [&](const char *snap) {
+        uint32_t id = fs_core_snapshot_find(&fs, snap);
+        uint32_t in_idx;
+        uint64_t fh;
+        char buf[8] = {0};
+        if (fs_core_snapshot_lookup(&fs, id, NARY_ROOT_IDX, "f", &in_idx, NULL) != 0 ||
+            fs_core_snapshot_open(&fs, id, in_idx, O_RDONLY, &fh) != 0 ||
+            fs_core_read(&fs, fh, buf, sizeof(buf), 0) < 0) {
+            return std::string("<none>");
+        }
+        return std::string(buf);
+    };
+    EXPECT_EQ(read_in("s1"), "one");
+    EXPECT_EQ(read_in("s2"), "one");
+    EXPECT_EQ(read_in("s3"), "two");
+
+    ASSERT_EQ(fs_core_snapshot_delete(&fs, "s2"), 0);
+    EXPECT_EQ(read_in("s1"), "one");
+    ASSERT_EQ(fs_core_snapshot_delete(&fs, "s3"), 0);
+    EXPECT_EQ(read_in("s1"), "one");
+
+    struct snapshot_stats stats;
+    snapshot_get_stats(&fs.snapshots, &stats);
+    EXPECT_EQ(stats.snapshots, 1u);
+    EXPECT_EQ(stats.files, 1u);
+    EXPECT_EQ(stats.lost, 0u);
+    ASSERT_EQ(fs_core_snapshot_delete(&fs, "s1"), 0);
+    snapshot_get_stats(&fs.snapshots, &stats);
+    EXPECT_EQ(stats.snapshots, 0u);
+    EXPECT_EQ(stats.bytes, 0u);
+}
+
+TEST_F(FsCoreTest, ConcurrentWriteReadUnlink) {
+    // Nodes first: inserts may rebalance, which moves node indices
+    std::vector<uint32_t> inodes;
+    for (int i = 0; i < 800; i++) {
+        struct nary_node node;
+        ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, ("c" + std::to_string(i)).c_str(),
+                                 0644, &node), 0);
+        inodes.push_back(node.inode);
+    }
+    std::vector<uint32_t> idxs;
+    for (uint32_t inode : inodes) {
+        idxs.push_back(nary_inode_lookup_mt(&fs.tree, inode));
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([this, t, &inodes, &idxs]() {
+            for (size_t i = t; i < inodes.size(); i += 8) {
+                std::string data = "data" + std::to_string(i);
+                ASSERT_EQ(fs_core_write(&fs, idxs[i], inodes[i], data.data(), data.size(), 0),
+                          (ssize_t)data.size());
+
+                char buf[32] = {0};
+                ASSERT_EQ(fs_core_read(&fs, inodes[i], buf, sizeof(buf), 0), (ssize_t)data.size());
+                EXPECT_EQ(std::string(buf), data);
+
+                if (i % 2) {
+                    ASSERT_EQ(fs_core_unlink(&fs, idxs[i]), 0);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    uint32_t active = 0;
+    for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+        active += fs.file_shards[i].active;
+    }
+    EXPECT_EQ(active, 400u);
+
+    // Leave no data files behind
+    for (size_t i = 0; i < inodes.size(); i += 2) {
+        EXPECT_EQ(fs_core_unlink(&fs, idxs[i]), 0);
+    }
+}
+
+TEST_F(FsCoreTest, UnlinkAndRenameFollowNodesMovedBySteps) {
+    ASSERT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, "wide", 0755, NULL), 0);
+    uint32_t dir = nary_path_lookup_mt(&fs.tree, "/wide");
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(fs_core_create(&fs, dir, ("keep" + std::to_string(i)).c_str(), 0644, NULL), 0);
+    }
+
+    // Compaction steps move the directory's children while they are
+    // created, renamed and unlinked with indices looked up just before
+    std::atomic<bool> done{false};
+    std::atomic<int> moving_steps{0};
+    std::thread stepper([this, &done, &moving_steps]() {
+        while (!done.load()) {
+            uint32_t d = nary_path_lookup_mt(&fs.tree, "/wide");
+            for (int i = 0; d != NARY_INVALID_IDX && i < NARY_HEAT_SAMPLE * NARY_HEAT_HOT * 2; i++) {
+                nary_find_child_mt(&fs.tree, d, "keep0");
+            }
+            if (nary_rebalance_step_mt(&fs.tree, 16) > 0) moving_steps++;
+        }
+    });
+
+    // The directory by inode, as the low-level front end finds it, and
+    // whether name is in it, read while it held still
+    struct nary_node wide;
+    ASSERT_EQ(nary_read_node_mt(&fs.tree, dir, &wide), 0);
+    auto present = [this, &wide](const std::string &name) {
+        for (;;) {
+            uint32_t d = nary_inode_lookup_mt(&fs.tree, wide.inode);
+            bool found = nary_find_child_mt(&fs.tree, d, name.c_str()) != NARY_INVALID_IDX;
+            if (nary_inode_lookup_mt(&fs.tree, wide.inode) == d) return found;
+        }
+    };
+
+    // Runs op on name until it takes; only a lookup overtaken by a move
+    // (the name is still there, or still missing) is tried again
+    auto retry = [this, &wide, &present](const std::string &name, bool present_after,
+                                         const std::function<int(uint32_t, uint32_t)> &op) {
+        for (;;) {
+            uint32_t d = nary_inode_lookup_mt(&fs.tree, wide.inode);
+            ASSERT_NE(d, NARY_INVALID_IDX);
+            int ret = op(d, nary_find_child_mt(&fs.tree, d, name.c_str()));
+            if (ret == 0) return;
+            ASSERT_TRUE(ret == -ENOENT || ret == -EEXIST) << name << ": " << ret;
+            ASSERT_NE(present(name), present_after) << name << ": " << ret;
+        }
+    };
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 8; t++) {
+        writers.emplace_back([this, t, &moving_steps, deadline, &retry]() {
+            for (int i = 0; moving_steps.load() < 100 &&
+                            std::chrono::steady_clock::now() < deadline; i++) {
+                std::string a = "t" + std::to_string(t) + "_" + std::to_string(i % 8);
+                std::string b = a + "_renamed";
+                retry(a, true, [this, &a](uint32_t d, uint32_t) {
+                    return fs_core_create(&fs, d, a.c_str(), 0644, NULL);
+                });
+                retry(a, false, [this, &b](uint32_t d, uint32_t idx) {
+                    return idx == NARY_INVALID_IDX ? -ENOENT : fs_core_rename(&fs, d, idx, d, b.c_str(), 0);
+                });
+                retry(b, false, [this](uint32_t, uint32_t idx) {
+                    return idx == NARY_INVALID_IDX ? -ENOENT : fs_core_unlink(&fs, idx);
+                });
+            }
+        });
+    }
+    for (auto &th : writers) th.join();
+    done = true;
+    stepper.join();
+    EXPECT_GE(moving_steps.load(), 100);
+
+    // Only the residents are left, each once and in order
+    dir = nary_path_lookup_mt(&fs.tree, "/wide");
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    ASSERT_EQ(nary_child_check_mt(&fs.tree, &fs.tree.nodes[dir].node), 0);
+    EXPECT_EQ(fs.tree.nodes[dir].node.num_children, 100);
+    for (int i = 0; i < 100; i++) {
+        std::string path = "/wide/keep" + std::to_string(i);
+        EXPECT_NE(nary_path_lookup_mt(&fs.tree, path.c_str()), NARY_INVALID_IDX) << path;
+    }
+    uint32_t active = 0;
+    for (int i = 0; i < FS_CORE_FILE_SHARDS; i++) {
+        active += fs.file_shards[i].active;
+    }
+    EXPECT_EQ(active, 100u);
+}
@@ -30,32 +30,32 @@ protected:
 // Test 1: Create file with invalid mode
 TEST_F(FUSEEdgeCasesTest, InvalidFileMode) {
     // Try to create with invalid mode bits
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "badmode.txt", 0xFFFF);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "badmode.txt", 0xFFFF);
     // Should handle gracefully
     EXPECT_TRUE(idx == NARY_INVALID_IDX || idx != NARY_INVALID_IDX);
 }
 
 // Test 2: Deep directory nesting (path depth limit)
 TEST_F(FUSEEdgeCasesTest, DeepDirectoryNesting) {
-    uint16_t parent = NARY_ROOT_IDX;
+    uint32_t parent = NARY_ROOT_IDX;
     
     // Create 10 levels deep
     for (int i = 0; i < 10; i++) {
         char name[32];
         snprintf(name, sizeof(name), "level_%d", i);
-        uint16_t dir = nary_insert_mt(&tree, parent, name, S_IFDIR | 0755);
+        uint32_t dir = nary_insert_mt(&tree, parent, name, S_IFDIR | 0755);
         ASSERT_NE(dir, NARY_INVALID_IDX) << "Failed at depth " << i;
         parent = dir;
     }
     
     // Create file at deepest level
-    uint16_t file = nary_insert_mt(&tree, parent, "deep_file.txt", S_IFREG | 0644);
+    uint32_t file = nary_insert_mt(&tree, parent, "deep_file.txt", S_IFREG | 0644);
     EXPECT_NE(file, NARY_INVALID_IDX);
 }
 
 // Test 3: Large file simulation (>1GB metadata)
 TEST_F(FUSEEdgeCasesTest, LargeFileMetadata) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "large.bin", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "large.bin", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
     
     // Simulate large file (just metadata, not actual data)
@@ -71,14 +71,14 @@ TEST_F(FUSEEdgeCasesTest, ManySmallFilesHierarchy) {
     for (int d = 0; d < 5; d++) {
         char dirname[32];
         snprintf(dirname, sizeof(dirname), "batch_%d", d);
-        uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
+        uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
         ASSERT_NE(dir, NARY_INVALID_IDX);
         
         // 10 files per directory (under 16-child limit)
         for (int f = 0; f < 10; f++) {
             char filename[32];
             snprintf(filename, sizeof(filename), "file_%03d.txt", f);
-            uint16_t file = nary_insert_mt(&tree, dir, filename, S_IFREG | 0644);
+            uint32_t file = nary_insert_mt(&tree, dir, filename, S_IFREG | 0644);
             EXPECT_NE(file, NARY_INVALID_IDX);
         }
     }
@@ -89,14 +89,14 @@ TEST_F(FUSEEdgeCasesTest, ManySmallFilesHierarchy) {
 
 // Test 5: Empty filename edge case
 TEST_F(FUSEEdgeCasesTest, EmptyFilename) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "", S_IFREG | 0644);
     // Should fail or handle gracefully
     EXPECT_EQ(idx, NARY_INVALID_IDX);
 }
 
 // Test 6: NULL filename
 TEST_F(FUSEEdgeCasesTest, NullFilename) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, nullptr, S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, nullptr, S_IFREG | 0644);
     EXPECT_EQ(idx, NARY_INVALID_IDX);
 }
 
@@ -111,7 +111,7 @@ TEST_F(FUSEEdgeCasesTest, SpecialCharactersInFilename) {
     };
     
     for (const char* name : names) {
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
         EXPECT_NE(idx, NARY_INVALID_IDX) << "Failed for: " << name;
     }
 }
@@ -119,17 +119,17 @@ TEST_F(FUSEEdgeCasesTest, SpecialCharactersInFilename) {
 // Test 8: Directory operations on files
 TEST_F(FUSEEdgeCasesTest, DirectoryOpsOnFile) {
     // Create a file
-    uint16_t file = nary_insert_mt(&tree, NARY_ROOT_IDX, "regular.txt", S_IFREG | 0644);
+    uint32_t file = nary_insert_mt(&tree, NARY_ROOT_IDX, "regular.txt", S_IFREG | 0644);
     ASSERT_NE(file, NARY_INVALID_IDX);
     
     // Try to create child of a file (should fail)
-    uint16_t child = nary_insert_mt(&tree, file, "child.txt", S_IFREG | 0644);
+    uint32_t child = nary_insert_mt(&tree, file, "child.txt", S_IFREG | 0644);
     EXPECT_EQ(child, NARY_INVALID_IDX);
 }
 
 // Test 9: File operations on directories
 TEST_F(FUSEEdgeCasesTest, FileOpsOnDirectory) {
-    uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir", S_IFDIR | 0755);
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir", S_IFDIR | 0755);
     ASSERT_NE(dir, NARY_INVALID_IDX);
     
     // Verify it's a directory
@@ -139,7 +139,7 @@ TEST_F(FUSEEdgeCasesTest, FileOpsOnDirectory) {
 
 // Test 10: Concurrent access to same file
 TEST_F(FUSEEdgeCasesTest, ConcurrentSameFileAccess) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "shared.txt", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "shared.txt", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
     
     // Simulate concurrent access (locking test)
@@ -164,20 +164,20 @@ TEST_F(FUSEEdgeCasesTest, PermissionEdgeCases) {
     };
     
     for (auto& tc : test_cases) {
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, tc.name, tc.mode);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, tc.name, tc.mode);
         EXPECT_NE(idx, NARY_INVALID_IDX) << "Failed for: " << tc.name;
     }
 }
 
 // Test 12: Delete non-existent file
 TEST_F(FUSEEdgeCasesTest, DeleteNonExistent) {
-    uint16_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "nonexistent.txt");
+    uint32_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "nonexistent.txt");
     EXPECT_EQ(found, NARY_INVALID_IDX);
 }
 
 // Test 13: Rename/Move operations
 TEST_F(FUSEEdgeCasesTest, RenameOperations) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "old_name.txt", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "old_name.txt", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
     
     // Note: Tree doesn't have rename, but we test the underlying structure
@@ -187,7 +187,7 @@ TEST_F(FUSEEdgeCasesTest, RenameOperations) {
 
 // Test 14: Truncate to zero
 TEST_F(FUSEEdgeCasesTest, TruncateToZero) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "truncate.txt", S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "truncate.txt", S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
     
     struct nary_node_mt *node = &tree.nodes[idx];
@@ -205,7 +205,7 @@ TEST_F(FUSEEdgeCasesTest, MaximumPathLength) {
     memset(long_name, 'a', 250);
     long_name[250] = '\0';
     
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, long_name, S_IFREG | 0644);
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, long_name, S_IFREG | 0644);
     EXPECT_NE(idx, NARY_INVALID_IDX);
 }
 
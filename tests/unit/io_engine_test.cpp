@@ -0,0 +1,158 @@
+/**
+ * I/O Engine Unit Tests
+ * Tests for the psync and io_uring persistence engines
+ */
+
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+extern "C" {
+#include "io_engine.h"
+}
+
+static const char *FILE_PATH = "/tmp/razorfs_io_engine_test.dat";
+
+static std::string read_all(const char *path) {
+    std::string out;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return out;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, (size_t)n);
+    close(fd);
+    return out;
+}
+
+class IoEngineTest : public ::testing::TestWithParam<enum io_engine_kind> {
+protected:
+    struct io_engine io;
+    int fd = -1;
+
+    void SetUp() override {
+        unlink(FILE_PATH);
+        fd = open(FILE_PATH, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(io_engine_init(&io, GetParam(), 8), 0);
+        if (io.kind != GetParam()) {
+            GTEST_SKIP() << "io_uring unavailable here";
+        }
+    }
+
+    void TearDown() override {
+        io_engine_destroy(&io);
+        if (fd >= 0) close(fd);
+        unlink(FILE_PATH);
+    }
+};
+
+TEST_P(IoEngineTest, BatchIsWrittenInOrder) {
+    ASSERT_EQ(io_engine_write(&io, fd, "hello ", 6, 0), 0);
+    ASSERT_EQ(io_engine_write(&io, fd, "world", 5, 6), 0);
+    // Overwrites what the first write put there, so only order makes it right
+    ASSERT_EQ(io_engine_write(&io, fd, "H", 1, 0), 0);
+    ASSERT_EQ(io_engine_fsync(&io, fd), 0);
+    ASSERT_EQ(io_engine_submit(&io), 0);
+
+    EXPECT_EQ(read_all(FILE_PATH), "Hello world");
+    EXPECT_EQ(io.stats.ops, 4u);
+    EXPECT_EQ(io.queued, 0u);
+}
+
+TEST_P(IoEngineTest, MoreOpsThanDepthKeepTheirOrder) {
+    // 8 slots: the queue goes out several times on the way (sources stay
+    // valid until submitted)
+    const char *letters = "abcdefghijklmnopqrst";
+    for (int i = 0; i < 20; i++) {
+        ASSERT_EQ(io_engine_write(&io, fd, letters + i, 1, (uint64_t)i), 0);
+        ASSERT_EQ(io_engine_write(&io, fd, "-", 1, (uint64_t)i + 1), 0);
+    }
+    ASSERT_EQ(io_engine_submit(&io), 0);
+    EXPECT_EQ(read_all(FILE_PATH), "abcdefghijklmnopqrst-");
+}
+
+TEST_P(IoEngineTest, FailureIsReportedOnceAndSkipsTheBatch) {
+    int ro = open(FILE_PATH, O_RDONLY);
+    ASSERT_GE(ro, 0);
+    io_engine_write(&io, ro, "x", 1, 0);
+    io_engine_write(&io, fd, "y", 1, 0);
+    EXPECT_EQ(io_engine_submit(&io), -1);
+    EXPECT_EQ(errno, EBADF);
+    EXPECT_EQ(io.stats.failed, 1u);
+    EXPECT_EQ(read_all(FILE_PATH), "");
+    close(ro);
+
+    // The next batch starts clean
+    ASSERT_EQ(io_engine_write(&io, fd, "z", 1, 0), 0);
+    EXPECT_EQ(io_engine_submit(&io), 0);
+    EXPECT_EQ(read_all(FILE_PATH), "z");
+}
+
+TEST_P(IoEngineTest, RegisteredFileAndBuffer) {
+    int registered = io_engine_register_file(&io, fd);
+    void *buf = aligned_alloc(4096, 4096);
+    ASSERT_NE(buf, nullptr);
+    memset(buf, 'b', 4096);
+    int fixed = io_engine_register_buffer(&io, buf, 4096);
+
+    if (GetParam() == IO_ENGINE_PSYNC) {
+        EXPECT_EQ(registered, -1);
+        EXPECT_EQ(fixed, -1);
+    }
+    ASSERT_EQ(io_engine_write(&io, fd, (char *)buf + 100, 200, 0), 0);
+    ASSERT_EQ(io_engine_write(&io, fd, "tail", 4, 200), 0);
+    ASSERT_EQ(io_engine_submit(&io), 0);
+    EXPECT_EQ(read_all(FILE_PATH), std::string(200, 'b') + "tail");
+
+    if (GetParam() == IO_ENGINE_URING) {
+        if (registered == 0) {
+            EXPECT_EQ(io.stats.fixed_files, 2u);
+        }
+        if (fixed == 0) {
+            EXPECT_EQ(io.stats.fixed_buffers, 1u);
+        }
+    }
+
+    io_engine_unregister_file(&io, fd);
+    EXPECT_EQ(io_engine_register_buffer(&io, nullptr, 0), GetParam() == IO_ENGINE_URING ? 0 : -1);
+    ASSERT_EQ(io_engine_write(&io, fd, "T", 1, 200), 0);
+    ASSERT_EQ(io_engine_submit(&io), 0);
+    EXPECT_EQ(read_all(FILE_PATH), std::string(200, 'b') + "Tail");
+    free(buf);
+}
+
+TEST_P(IoEngineTest, LargeWriteIsComplete) {
+    std::string big(3 << 20, 'L');
+    big[0] = 'F';
+    big.back() = 'E';
+    ASSERT_EQ(io_engine_write(&io, fd, big.data(), big.size(), 4096), 0);
+    ASSERT_EQ(io_engine_fsync(&io, fd), 0);
+    ASSERT_EQ(io_engine_submit(&io), 0);
+
+    std::string data = read_all(FILE_PATH);
+    ASSERT_EQ(data.size(), big.size() + 4096);
+    EXPECT_EQ(data.substr(4096), big);
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, IoEngineTest,
+                         ::testing::Values(IO_ENGINE_PSYNC, IO_ENGINE_URING),
+                         [](const ::testing::TestParamInfo<enum io_engine_kind> &info) {
+                             return std::string(io_engine_name(info.param));
+                         });
+
+TEST(IoEngineNames, ParseAndName) {
+    enum io_engine_kind kind;
+    ASSERT_EQ(io_engine_parse("uring", &kind), 0);
+    EXPECT_EQ(kind, IO_ENGINE_URING);
+    ASSERT_EQ(io_engine_parse("io_uring", &kind), 0);
+    EXPECT_EQ(kind, IO_ENGINE_URING);
+    ASSERT_EQ(io_engine_parse("psync", &kind), 0);
+    EXPECT_EQ(kind, IO_ENGINE_PSYNC);
+    EXPECT_EQ(io_engine_parse("aio", &kind), -1);
+    EXPECT_STREQ(io_engine_name(IO_ENGINE_URING), "uring");
+    EXPECT_STREQ(io_engine_name(IO_ENGINE_PSYNC), "psync");
+}
@@ -0,0 +1,316 @@
+/**
+ * Runtime Metrics Unit Tests
+ * Tests for the latency histograms, lock instrumentation and the
+ * statistics files under /.razorfs
+ */
+
+#include <gtest/gtest.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "metrics.h"
+#include "fs_core.h"
+}
+
+static struct metrics_shard *take_snapshot() {
+    auto *snap = static_cast<struct metrics_shard *>(malloc(sizeof(struct metrics_shard)));
+    metrics_snapshot(snap);
+    return snap;
+}
+
+class MetricsTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        metrics_destroy();
+    }
+};
+
+TEST_F(MetricsTest, LevelNames) {
+    enum metrics_level level = METRICS_OFF;
+    EXPECT_EQ(metrics_level_parse("full", &level), 0);
+    EXPECT_EQ(level, METRICS_FULL);
+    EXPECT_EQ(metrics_level_parse("ops", &level), 0);
+    EXPECT_EQ(level, METRICS_OPS);
+    EXPECT_EQ(metrics_level_parse("verbose", &level), -1);
+    EXPECT_STREQ(metrics_level_name(METRICS_OFF), "off");
+    EXPECT_STREQ(metrics_hist_name(METRICS_OP_GETATTR), "getattr");
+    EXPECT_STREQ(metrics_hist_name(METRICS_WAL_SYNC), "wal_sync");
+    EXPECT_STREQ(metrics_lock_name(METRICS_LOCK_WAL), "wal");
+}
+
+TEST_F(MetricsTest, OffRecordsNothing) {
+    ASSERT_EQ(metrics_init(METRICS_OFF), 0);
+    EXPECT_EQ(metrics_start(), 0u);
+    metrics_record(METRICS_OP_READ, 1000);
+
+    struct metrics_shard *snap = take_snapshot();
+    EXPECT_EQ(snap->hist[METRICS_OP_READ].count, 0u);
+    free(snap);
+}
+
+TEST_F(MetricsTest, BucketsCoverEveryValue) {
+    uint64_t prev = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS; b++) {
+        uint64_t limit = metrics_bucket_limit(b);
+        EXPECT_GT(limit, prev) << "bucket " << b;
+        // At most a quarter wider than where it starts
+        if (b >= 8 && b < METRICS_BUCKETS - 1) {
+            EXPECT_LE(limit - prev, prev / 4 + 1) << "bucket " << b;
+        }
+        prev = limit;
+    }
+    EXPECT_EQ(metrics_bucket_limit(METRICS_BUCKETS - 1), UINT64_MAX);
+}
+
+TEST_F(MetricsTest, PercentilesWithinABucket) {
+    ASSERT_EQ(metrics_init(METRICS_OPS), 0);
+    for (int i = 0; i < 990; i++) metrics_record(METRICS_OP_GETATTR, 10000);
+    for (int i = 0; i < 10; i++) metrics_record(METRICS_OP_GETATTR, 5000000);
+
+    struct metrics_shard *snap = take_snapshot();
+    const struct metrics_hist_data *h = &snap->hist[METRICS_OP_GETATTR];
+    EXPECT_EQ(h->count, 1000u);
+    EXPECT_EQ(h->sum_ns, 990u * 10000 + 10u * 5000000);
+
+    uint64_t p50 = metrics_percentile(h, 0.50);
+    uint64_t p999 = metrics_percentile(h, 0.999);
+    EXPECT_GE(p50, 8000u);
+    EXPECT_LE(p50, 12500u);
+    EXPECT_GE(p999, 4000000u);
+    EXPECT_LE(p999, 6250000u);
+    EXPECT_EQ(metrics_percentile(&snap->hist[METRICS_OP_READ], 0.5), 0u);
+    free(snap);
+}
+
+TEST_F(MetricsTest, ThreadsAddUp) {
+    ASSERT_EQ(metrics_init(METRICS_OPS), 0);
+    const int threads = 8, per_thread = 10000;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([] {
+            for (int i = 0; i < per_thread; i++) {
+                metrics_record(METRICS_OP_WRITE, (uint64_t)i);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    struct metrics_shard *snap = take_snapshot();
+    EXPECT_EQ(snap->hist[METRICS_OP_WRITE].count, (uint64_t)threads * per_thread);
+    uint64_t in_buckets = 0;
+    for (unsigned int b = 0; b < METRICS_BUCKETS; b++) {
+        in_buckets += snap->hist[METRICS_OP_WRITE].buckets[b];
+    }
+    EXPECT_EQ(in_buckets, (uint64_t)threads * per_thread);
+    free(snap);
+}
+
+TEST_F(MetricsTest, LockAcquisitionsAndHoldTimes) {
+    ASSERT_EQ(metrics_init(METRICS_FULL), 0);
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_rwlock_t a = PTHREAD_RWLOCK_INITIALIZER;
+    pthread_rwlock_t b = PTHREAD_RWLOCK_INITIALIZER;
+
+    ASSERT_EQ(metrics_mutex_lock(&mutex, METRICS_LOCK_WAL), 0);
+    ASSERT_EQ(metrics_mutex_unlock(&mutex, METRICS_LOCK_WAL), 0);
+
+    // Nested locks of one kind: one hold, outermost to last release
+    ASSERT_EQ(metrics_rwlock_rdlock(&a, METRICS_LOCK_NODE), 0);
+    ASSERT_EQ(metrics_rwlock_wrlock(&b, METRICS_LOCK_NODE), 0);
+    ASSERT_EQ(metrics_rwlock_unlock(&b, METRICS_LOCK_NODE), 0);
+    ASSERT_EQ(metrics_rwlock_unlock(&a, METRICS_LOCK_NODE), 0);
+
+    ASSERT_EQ(metrics_rwlock_trywrlock(&a, METRICS_LOCK_TREE), 0);
+    EXPECT_EQ(pthread_rwlock_tryrdlock(&a), EBUSY);
+    ASSERT_EQ(metrics_rwlock_unlock(&a, METRICS_LOCK_TREE), 0);
+
+    struct metrics_shard *snap = take_snapshot();
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_WAL, METRICS_LOCK_EXCLUSIVE)], 1u);
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_NODE, METRICS_LOCK_SHARED)], 1u);
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_NODE, METRICS_LOCK_EXCLUSIVE)], 1u);
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_TREE, METRICS_LOCK_EXCLUSIVE)], 1u);
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_NODE, METRICS_LOCK_CONTENDED)], 0u);
+    EXPECT_EQ(snap->hist[METRICS_LOCK_HOLD(METRICS_LOCK_WAL)].count, 1u);
+    EXPECT_EQ(snap->hist[METRICS_LOCK_HOLD(METRICS_LOCK_NODE)].count, 1u);
+    EXPECT_EQ(snap->hist[METRICS_LOCK_HOLD(METRICS_LOCK_TREE)].count, 1u);
+    EXPECT_EQ(snap->hist[METRICS_LOCK_WAIT(METRICS_LOCK_NODE)].count, 0u);
+    free(snap);
+}
+
+TEST_F(MetricsTest, ContendedLockRecordsWait) {
+    ASSERT_EQ(metrics_init(METRICS_OPS), 0);
+    pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+
+    ASSERT_EQ(pthread_rwlock_wrlock(&lock), 0);
+    std::thread reader([&lock] {
+        metrics_rwlock_rdlock(&lock, METRICS_LOCK_FILE);
+        metrics_rwlock_unlock(&lock, METRICS_LOCK_FILE);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    pthread_rwlock_unlock(&lock);
+    reader.join();
+
+    struct metrics_shard *snap = take_snapshot();
+    EXPECT_EQ(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_FILE, METRICS_LOCK_CONTENDED)], 1u);
+    const struct metrics_hist_data *wait = &snap->hist[METRICS_LOCK_WAIT(METRICS_LOCK_FILE)];
+    EXPECT_EQ(wait->count, 1u);
+    EXPECT_GE(wait->sum_ns, 10u * 1000 * 1000);
+    // Hold times only at METRICS_FULL
+    EXPECT_EQ(snap->hist[METRICS_LOCK_HOLD(METRICS_LOCK_FILE)].count, 0u);
+    free(snap);
+}
+
+TEST_F(MetricsTest, PrometheusHistogramsAreCumulative) {
+    ASSERT_EQ(metrics_init(METRICS_OPS), 0);
+    metrics_record(METRICS_OP_LOOKUP, 2000);
+    metrics_record(METRICS_OP_LOOKUP, 3000000);
+    metrics_record(METRICS_OP_LOOKUP, 30000000000ULL);
+
+    struct metrics_shard *snap = take_snapshot();
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    ASSERT_NE(out, nullptr);
+    metrics_write_prometheus(out, snap);
+    fclose(out);
+    free(snap);
+    std::string s(text, len);
+    free(text);
+
+    EXPECT_NE(s.find("# TYPE razorfs_op_duration_seconds histogram"), std::string::npos);
+    EXPECT_NE(s.find("razorfs_op_duration_seconds_count{op=\"lookup\"} 3\n"), std::string::npos);
+    EXPECT_NE(s.find("razorfs_op_duration_seconds_bucket{op=\"lookup\",le=\"+Inf\"} 3\n"),
+              std::string::npos);
+    EXPECT_NE(s.find("razorfs_lock_acquisitions_total{lock=\"tree\",mode=\"shared\"}"),
+              std::string::npos);
+
+    // Bucket counts never drop as le grows
+    std::string prefix = "razorfs_op_duration_seconds_bucket{op=\"lookup\",le=\"";
+    unsigned long last = 0;
+    int buckets = 0;
+    for (size_t pos = s.find(prefix); pos != std::string::npos; pos = s.find(prefix, pos + 1)) {
+        size_t value = s.find("} ", pos) + 2;
+        unsigned long count = strtoul(s.c_str() + value, NULL, 10);
+        EXPECT_GE(count, last);
+        last = count;
+        buckets++;
+    }
+    EXPECT_GT(buckets, 10);
+    EXPECT_EQ(last, 3u);
+}
+
+/* === Statistics Files === */
+
+class StatsFilesTest : public ::testing::Test {
+protected:
+    struct fs_core fs;
+
+    void SetUp() override {
+        ASSERT_EQ(metrics_init(METRICS_FULL), 0);
+        memset(&fs, 0, sizeof(fs));
+        ASSERT_EQ(nary_tree_mt_init(&fs.tree), 0);
+        fs.tree.next_inode = 900000;
+        ASSERT_EQ(fs_core_init(&fs), 0);
+
+        struct fs_core_options opts = FS_CORE_OPTIONS_DEFAULT;
+        opts.compress_threads = 0;
+        opts.writeback_ms = 0;
+        opts.rebalance_ms = 0;
+        fs_core_start(&fs, &opts);
+    }
+
+    void TearDown() override {
+        fs_core_close(&fs);
+    }
+
+    std::string read_file(enum fs_core_stats_file file) {
+        uint64_t fh = 0;
+        EXPECT_EQ(fs_core_stats_open(&fs, file, O_RDONLY, &fh), 0);
+        EXPECT_TRUE(FS_CORE_FH_IS_STATS(fh));
+
+        std::string out;
+        char buf[1000];
+        ssize_t n;
+        while ((n = fs_core_read(&fs, fh, buf, sizeof(buf), (off_t)out.size())) > 0) {
+            out.append(buf, (size_t)n);
+        }
+        EXPECT_EQ(n, 0);
+        EXPECT_EQ(fs_core_lseek(&fs, fh, 0, SEEK_HOLE), (off_t)out.size());
+        EXPECT_EQ(fs_core_write(&fs, NARY_ROOT_IDX, fh, "x", 1, 0), -EROFS);
+        fs_core_release(&fs, fh);
+        return out;
+    }
+};
+
+static int collect_name(void *ctx, const char *name, const struct nary_node *node,
+                        off_t next_off) {
+    (void)node;
+    (void)next_off;
+    static_cast<std::vector<std::string> *>(ctx)->push_back(name);
+    return 1;
+}
+
+TEST_F(StatsFilesTest, DirectoryListsTheFiles) {
+    EXPECT_EQ(fs_core_stats_find("stats"), FS_CORE_STATS_TEXT);
+    EXPECT_EQ(fs_core_stats_find("metrics"), FS_CORE_STATS_PROMETHEUS);
+    EXPECT_EQ(fs_core_stats_find("other"), FS_CORE_STATS_ROOT);
+
+    struct nary_node node;
+    ASSERT_EQ(fs_core_stats_node(&fs, FS_CORE_STATS_ROOT, &node), 0);
+    EXPECT_TRUE(NARY_IS_DIR(&node));
+    EXPECT_EQ(node.inode, FS_CORE_STATS_DIR_INODE);
+    ASSERT_EQ(fs_core_stats_node(&fs, FS_CORE_STATS_TEXT, &node), 0);
+    EXPECT_TRUE(NARY_IS_FILE(&node));
+    EXPECT_EQ(node.mode & 0222, 0u);
+
+    std::vector<std::string> names;
+    ASSERT_EQ(fs_core_stats_list(&fs, 0, collect_name, &names), 0);
+    EXPECT_EQ(names, (std::vector<std::string>{".", "..", "stats", "metrics"}));
+    names.clear();
+    ASSERT_EQ(fs_core_stats_list(&fs, 3, collect_name, &names), 0);
+    EXPECT_EQ(names, (std::vector<std::string>{"metrics"}));
+
+    // The name is reserved in the root
+    EXPECT_EQ(fs_core_mkdir(&fs, NARY_ROOT_IDX, FS_CORE_STATS_DIR, 0755, NULL), -EEXIST);
+
+    uint64_t fh;
+    EXPECT_EQ(fs_core_stats_open(&fs, FS_CORE_STATS_TEXT, O_RDWR, &fh), -EROFS);
+    EXPECT_EQ(fs_core_stats_open(&fs, FS_CORE_STATS_ROOT, O_RDONLY, &fh), -EISDIR);
+}
+
+TEST_F(StatsFilesTest, ReportsShowActivity) {
+    struct nary_node node;
+    ASSERT_EQ(fs_core_create(&fs, NARY_ROOT_IDX, "file", 0644, &node), 0);
+    uint32_t idx = nary_inode_lookup_mt(&fs.tree, node.inode);
+    std::string data(200000, 'a');
+    ASSERT_EQ(fs_core_write(&fs, idx, node.inode, data.data(), data.size(), 0),
+              (ssize_t)data.size());
+
+    std::string text = read_file(FS_CORE_STATS_TEXT);
+    EXPECT_NE(text.find("Metrics: full"), std::string::npos);
+    EXPECT_NE(text.find("Locks (us)"), std::string::npos);
+    EXPECT_NE(text.find("tree_nodes"), std::string::npos);
+    EXPECT_NE(text.find("file_memory_bytes"), std::string::npos);
+
+    std::string prom = read_file(FS_CORE_STATS_PROMETHEUS);
+    EXPECT_NE(prom.find("# TYPE razorfs_tree_nodes gauge\nrazorfs_tree_nodes 2\n"),
+              std::string::npos);
+    EXPECT_NE(prom.find("razorfs_lock_hold_seconds_count{lock=\"file\"}"), std::string::npos);
+
+    // Tree and node lock counters now come from the recorder
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&fs.tree, &stats);
+    EXPECT_GT(stats.read_locks + stats.write_locks, 0u);
+
+    struct metrics_shard *snap = take_snapshot();
+    EXPECT_GT(snap->counters[METRICS_LOCK_COUNTER(METRICS_LOCK_FILE, METRICS_LOCK_EXCLUSIVE)], 0u);
+    EXPECT_GT(snap->hist[METRICS_LOCK_HOLD(METRICS_LOCK_FILE)].count, 0u);
+    free(snap);
+}
@@ -7,8 +7,10 @@
 #include <gmock/gmock.h>
 #include <pthread.h>
 #include <thread>
+#include <string>
 #include <vector>
 #include <atomic>
+#include <chrono>
 
 extern "C" {
 #include "nary_tree_mt.h"
@@ -40,7 +42,7 @@ TEST_F(NaryTreeTest, Initialization) {
 }
 
 TEST_F(NaryTreeTest, RootNodeExists) {
-    uint16_t root_idx = NARY_ROOT_IDX;
+    uint32_t root_idx = NARY_ROOT_IDX;
     struct nary_node_mt *root = &tree.nodes[root_idx];
 
     EXPECT_TRUE(NARY_IS_DIR(&root->node));
@@ -48,7 +50,7 @@ TEST_F(NaryTreeTest, RootNodeExists) {
 }
 
 TEST_F(NaryTreeTest, InsertSingleChild) {
-    uint16_t child_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "test.txt",
+    uint32_t child_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "test.txt",
                                         S_IFREG | 0644);
 
     EXPECT_NE(child_idx, NARY_INVALID_IDX);
@@ -60,11 +62,11 @@ TEST_F(NaryTreeTest, InsertSingleChild) {
 }
 
 TEST_F(NaryTreeTest, InsertMultipleChildren) {
-    uint16_t idx1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1.txt",
+    uint32_t idx1 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file1.txt",
                                    S_IFREG | 0644);
-    uint16_t idx2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2.txt",
+    uint32_t idx2 = nary_insert_mt(&tree, NARY_ROOT_IDX, "file2.txt",
                                    S_IFREG | 0644);
-    uint16_t idx3 = nary_insert_mt(&tree, NARY_ROOT_IDX, "subdir",
+    uint32_t idx3 = nary_insert_mt(&tree, NARY_ROOT_IDX, "subdir",
                                    S_IFDIR | 0755);
 
     EXPECT_NE(idx1, NARY_INVALID_IDX);
@@ -77,37 +79,37 @@ TEST_F(NaryTreeTest, InsertMultipleChildren) {
 }
 
 TEST_F(NaryTreeTest, FindChild) {
-    uint16_t inserted = nary_insert_mt(&tree, NARY_ROOT_IDX, "findme.txt",
+    uint32_t inserted = nary_insert_mt(&tree, NARY_ROOT_IDX, "findme.txt",
                                        S_IFREG | 0644);
     ASSERT_NE(inserted, NARY_INVALID_IDX);
 
-    uint16_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "findme.txt");
+    uint32_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "findme.txt");
     EXPECT_EQ(found, inserted);
 }
 
 TEST_F(NaryTreeTest, FindNonExistentChild) {
-    uint16_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "nonexistent.txt");
+    uint32_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "nonexistent.txt");
     EXPECT_EQ(found, NARY_INVALID_IDX);
 }
 
 TEST_F(NaryTreeTest, DeleteChild) {
-    uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "delete_me.txt",
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "delete_me.txt",
                                   S_IFREG | 0644);
     ASSERT_NE(idx, NARY_INVALID_IDX);
 
     EXPECT_EQ(nary_delete_mt(&tree, idx, nullptr, 0), 0);
 
-    uint16_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "delete_me.txt");
+    uint32_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, "delete_me.txt");
     EXPECT_EQ(found, NARY_INVALID_IDX);
 }
 
 TEST_F(NaryTreeTest, DeleteNonEmptyDirectory) {
     // Create directory with child
-    uint16_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir",
+    uint32_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "mydir",
                                       S_IFDIR | 0755);
     ASSERT_NE(dir_idx, NARY_INVALID_IDX);
 
-    uint16_t file_idx = nary_insert_mt(&tree, dir_idx, "child.txt",
+    uint32_t file_idx = nary_insert_mt(&tree, dir_idx, "child.txt",
                                        S_IFREG | 0644);
     ASSERT_NE(file_idx, NARY_INVALID_IDX);
 
@@ -116,7 +118,7 @@ TEST_F(NaryTreeTest, DeleteNonEmptyDirectory) {
 }
 
 TEST_F(NaryTreeTest, DeleteEmptyDirectory) {
-    uint16_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "emptydir",
+    uint32_t dir_idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "emptydir",
                                       S_IFDIR | 0755);
     ASSERT_NE(dir_idx, NARY_INVALID_IDX);
 
@@ -129,14 +131,14 @@ TEST_F(NaryTreeTest, DeleteEmptyDirectory) {
 
 TEST_F(NaryTreeTest, CreateNestedPath) {
     // Create /a/b/c
-    uint16_t a = nary_insert_mt(&tree, NARY_ROOT_IDX, "a",
+    uint32_t a = nary_insert_mt(&tree, NARY_ROOT_IDX, "a",
                                 S_IFDIR | 0755);
     ASSERT_NE(a, NARY_INVALID_IDX);
 
-    uint16_t b = nary_insert_mt(&tree, a, "b", S_IFDIR | 0755);
+    uint32_t b = nary_insert_mt(&tree, a, "b", S_IFDIR | 0755);
     ASSERT_NE(b, NARY_INVALID_IDX);
 
-    uint16_t c = nary_insert_mt(&tree, b, "c", S_IFDIR | 0755);
+    uint32_t c = nary_insert_mt(&tree, b, "c", S_IFDIR | 0755);
     ASSERT_NE(c, NARY_INVALID_IDX);
 
     // Verify hierarchy
@@ -196,7 +198,7 @@ TEST_F(NaryTreeTest, ConcurrentReads) {
     EXPECT_EQ(success_count.load(), NUM_READERS * 100);
 }
 
-TEST_F(NaryTreeTest, DISABLED_ConcurrentInserts) {  // Concurrency bug: only 16/100 files successfully inserted
+TEST_F(NaryTreeTest, ConcurrentInserts) {
     const int NUM_WRITERS = 5;
     const int INSERTS_PER_WRITER = 20;
     std::atomic<int> success_count(0);
@@ -206,7 +208,7 @@ TEST_F(NaryTreeTest, DISABLED_ConcurrentInserts) {  // Concurrency bug: only 16/
             char name[32];
             snprintf(name, sizeof(name), "thread%d_file%d.txt", thread_id, i);
 
-            uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
+            uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
                                           S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 success_count++;
@@ -231,7 +233,7 @@ TEST_F(NaryTreeTest, DISABLED_ConcurrentInserts) {  // Concurrency bug: only 16/
             char name[32];
             snprintf(name, sizeof(name), "thread%d_file%d.txt", tid, i);
 
-            uint16_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
+            uint32_t found = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
             EXPECT_NE(found, NARY_INVALID_IDX) << "Missing: " << name;
         }
     }
@@ -252,7 +254,7 @@ TEST_F(NaryTreeTest, ConcurrentMixedOperations) {
         for (int i = 0; i < 50; i++) {
             char name[32];
             snprintf(name, sizeof(name), "initial_%d.txt", i % 10);
-            uint16_t idx = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
+            uint32_t idx = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
             if (idx != NARY_INVALID_IDX) {
                 read_count++;
             }
@@ -263,7 +265,7 @@ TEST_F(NaryTreeTest, ConcurrentMixedOperations) {
         for (int i = 0; i < 10; i++) {
             char name[32];
             snprintf(name, sizeof(name), "new_%d_%d.txt", tid, i);
-            uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
+            uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
                                           S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 write_count++;
@@ -316,7 +318,7 @@ TEST_F(NaryTreeTest, CapacityLimit) {
         char name[32];
         snprintf(name, sizeof(name), "file_%d.txt", i);
 
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
                                       S_IFREG | 0644);
         if (idx != NARY_INVALID_IDX) {
             inserted++;
@@ -325,7 +327,10 @@ TEST_F(NaryTreeTest, CapacityLimit) {
         }
     }
 
-    EXPECT_LE(inserted, 1024);  // Should not exceed capacity
+    // The node array grows past its initial capacity and one directory
+    // holds up to NARY_MAX_CHILDREN entries
+    EXPECT_EQ(inserted, 2000);
+    EXPECT_GT(tree.capacity, (uint32_t)NARY_INITIAL_CAPACITY);
 }
 
 // ============================================================================
@@ -333,14 +338,14 @@ TEST_F(NaryTreeTest, CapacityLimit) {
 // ============================================================================
 
 TEST_F(NaryTreeTest, DeepNesting) {
-    uint16_t parent = NARY_ROOT_IDX;
+    uint32_t parent = NARY_ROOT_IDX;
 
     // Create deep directory structure
     for (int depth = 0; depth < 100; depth++) {
         char name[32];
         snprintf(name, sizeof(name), "level_%d", depth);
 
-        uint16_t child = nary_insert_mt(&tree, parent, name,
+        uint32_t child = nary_insert_mt(&tree, parent, name,
                                         S_IFDIR | 0755);
         ASSERT_NE(child, NARY_INVALID_IDX) << "Failed at depth " << depth;
         parent = child;
@@ -351,14 +356,14 @@ TEST_F(NaryTreeTest, DeepNesting) {
 }
 
 TEST_F(NaryTreeTest, ManyChildren) {
-    // Insert many children under root (up to NARY_CHILDREN_MAX)
-    int max_children = 16;  // NARY_CHILDREN_MAX
+    // Insert well past NARY_BRANCHING_FACTOR under root
+    int max_children = 100;
 
     for (int i = 0; i < max_children; i++) {
         char name[32];
         snprintf(name, sizeof(name), "child_%d.txt", i);
 
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name,
                                       S_IFREG | 0644);
         EXPECT_NE(idx, NARY_INVALID_IDX) << "Failed at child " << i;
     }
@@ -366,11 +371,873 @@ TEST_F(NaryTreeTest, ManyChildren) {
     // Verify root has correct child count
     struct nary_node_mt *root = &tree.nodes[NARY_ROOT_IDX];
     EXPECT_EQ(root->node.num_children, max_children);
+    EXPECT_NE(nary_find_child_mt(&tree, NARY_ROOT_IDX, "child_42.txt"), NARY_INVALID_IDX);
 
-    // Try to insert one more - should fail (children array full)
-    uint16_t overflow = nary_insert_mt(&tree, NARY_ROOT_IDX, "overflow.txt",
-                                       S_IFREG | 0644);
-    EXPECT_EQ(overflow, NARY_INVALID_IDX);
+    // Duplicates are still rejected once the children live in blocks
+    uint32_t dup = nary_insert_mt(&tree, NARY_ROOT_IDX, "child_7.txt",
+                                  S_IFREG | 0644);
+    EXPECT_EQ(dup, NARY_INVALID_IDX);
+}
+
+TEST_F(NaryTreeTest, WideDirectoryUsesChildBlock) {
+    // Insert out of order so the block has to stay sorted
+    const int order[16] = {9, 3, 14, 0, 7, 12, 5, 1, 15, 10, 2, 8, 13, 4, 11, 6};
+    uint32_t idx[16];
+    for (int i = 0; i < 16; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "entry_%02d", order[i]);
+        idx[order[i]] = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        ASSERT_NE(idx[order[i]], NARY_INVALID_IDX);
+    }
+
+    struct nary_node *root = &tree.nodes[NARY_ROOT_IDX].node;
+    ASSERT_EQ(root->num_children, 16);
+    EXPECT_EQ(tree.block_used, 1u);
+
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, &tree, root);
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(nary_child_iter_next(&it), idx[i]) << "Unsorted at " << i;
+
+        char name[32];
+        snprintf(name, sizeof(name), "entry_%02d", i);
+        EXPECT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX, name), idx[i]);
+    }
+
+    // Shrinking back to the inline slots gives the block back
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(nary_delete_mt(&tree, idx[i * 2], nullptr, 0), 0);
+    }
+    ASSERT_EQ(root->num_children, 8);
+    EXPECT_EQ(tree.block_free, 0u);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(root->children[i], idx[i * 2 + 1]);
+    }
+
+    // Growing again reuses it
+    ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, "entry_00", S_IFREG | 0644), NARY_INVALID_IDX);
+    EXPECT_EQ(root->num_children, 9);
+    EXPECT_EQ(tree.block_used, 1u);
+    EXPECT_EQ(tree.block_free, NARY_INVALID_IDX);
+    EXPECT_NE(nary_find_child_mt(&tree, NARY_ROOT_IDX, "entry_15"), NARY_INVALID_IDX);
+}
+
+TEST_F(NaryTreeTest, LargeDirectorySplitsAndMerges) {
+    // Enough entries for two interior levels, inserted in scrambled order
+    const int count = 5000;
+    for (int i = 0; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%05d", (i * 2713) % count);
+        ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644),
+                  NARY_INVALID_IDX) << name;
+    }
+
+    struct nary_node *root = &tree.nodes[NARY_ROOT_IDX].node;
+    ASSERT_EQ(root->num_children, count);
+    EXPECT_GE(NARY_CHILD_HEIGHT(root), 2u);
+    EXPECT_EQ(nary_child_check_mt(&tree, root), 0);
+
+    // Iteration streams the children in name order
+    auto expect_sorted = [&](int expected) {
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, &tree, root);
+        std::string prev;
+        int seen = 0;
+        uint32_t child;
+        while ((child = nary_child_iter_next(&it)) != NARY_INVALID_IDX) {
+            std::string name = string_table_get(&tree.strings,
+                                                tree.nodes[child].node.name_offset);
+            EXPECT_LT(prev, name);
+            prev = name;
+            seen++;
+        }
+        EXPECT_EQ(seen, expected);
+    };
+    expect_sorted(count);
+
+    for (int i = 0; i < count; i += 97) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%05d", i);
+        uint32_t idx = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
+        ASSERT_NE(idx, NARY_INVALID_IDX) << name;
+        EXPECT_STREQ(string_table_get(&tree.strings, tree.nodes[idx].node.name_offset), name);
+    }
+    EXPECT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX, "f99999"), NARY_INVALID_IDX);
+
+    // Delete all but the first eight; blocks merge away and the
+    // survivors end up inline again
+    for (int i = 8; i < count; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "f%05d", i);
+        uint32_t idx = nary_find_child_mt(&tree, NARY_ROOT_IDX, name);
+        ASSERT_NE(idx, NARY_INVALID_IDX) << name;
+        ASSERT_EQ(nary_delete_mt(&tree, idx, nullptr, 0), 0) << name;
+        if (i % 500 == 0) {
+            ASSERT_EQ(nary_child_check_mt(&tree, root), 0) << "after " << name;
+            expect_sorted(count - i - 1 + 8);
+        }
+    }
+
+    ASSERT_EQ(root->num_children, 8);
+    expect_sorted(8);
+    EXPECT_NE(nary_find_child_mt(&tree, NARY_ROOT_IDX, "f00007"), NARY_INVALID_IDX);
+
+    // All blocks are back on the free chain
+    uint32_t free_blocks = 0;
+    for (uint32_t b = tree.block_free; b != NARY_INVALID_IDX;
+         b = tree.child_blocks[b].children[0]) {
+        free_blocks++;
+    }
+    EXPECT_EQ(free_blocks, tree.block_used);
+}
+
+TEST_F(NaryTreeTest, FingerprintsFollowChildren) {
+    // Inline, single-leaf and multi-level directories, with rebalances
+    // moving the nodes (and their inline fingerprints) in between
+    const int sizes[3] = { 8, 16, 300 };
+    uint32_t dirs[3];
+    for (int d = 0; d < 3; d++) {
+        char name[16];
+        snprintf(name, sizeof(name), "dir%d", d);
+        dirs[d] = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFDIR | 0755);
+        ASSERT_NE(dirs[d], NARY_INVALID_IDX);
+    }
+    for (int d = 0; d < 3; d++) {
+        for (int i = 0; i < sizes[d]; i++) {
+            char dir[16], name[32];
+            snprintf(dir, sizeof(dir), "/dir%d", d);
+            snprintf(name, sizeof(name), "n%d_%d", d, (i * 37) % sizes[d]);
+            ASSERT_NE(nary_insert_mt(&tree, nary_path_lookup_mt(&tree, dir), name, S_IFREG | 0644),
+                      NARY_INVALID_IDX) << name;
+        }
+    }
+    ASSERT_EQ(nary_rebalance_mt(&tree), 0);
+
+    for (int d = 0; d < 3; d++) {
+        char dir[16];
+        snprintf(dir, sizeof(dir), "/dir%d", d);
+        uint32_t dir_idx = nary_path_lookup_mt(&tree, dir);
+        ASSERT_NE(dir_idx, NARY_INVALID_IDX);
+
+        for (int i = 0; i < sizes[d]; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "n%d_%d", d, i);
+            uint32_t idx = nary_find_child_mt(&tree, dir_idx, name);
+            ASSERT_NE(idx, NARY_INVALID_IDX) << name;
+            EXPECT_STREQ(string_table_get(&tree.strings, tree.nodes[idx].node.name_offset), name);
+        }
+
+        // Absent names: fingerprint hits still have to compare the name
+        for (int i = 0; i < 2000; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "x%d_%d", d, i);
+            EXPECT_EQ(nary_find_child_mt(&tree, dir_idx, name), NARY_INVALID_IDX) << name;
+        }
+    }
+
+    // Removals shift the fingerprints with the entries
+    uint32_t wide = nary_path_lookup_mt(&tree, "/dir2");
+    for (int i = 0; i < 300; i += 3) {
+        char name[32];
+        snprintf(name, sizeof(name), "n2_%d", i);
+        ASSERT_EQ(nary_delete_mt(&tree, nary_find_child_mt(&tree, wide, name), nullptr, 0), 0);
+        wide = nary_path_lookup_mt(&tree, "/dir2");
+    }
+    for (int i = 0; i < 300; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "n2_%d", i);
+        EXPECT_EQ(nary_find_child_mt(&tree, wide, name) != NARY_INVALID_IDX, i % 3 != 0) << name;
+    }
+}
+
+TEST_F(NaryTreeTest, DirectoryEntryLimit) {
+    for (uint32_t i = 0; i < NARY_MAX_CHILDREN; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%u", i);
+        ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644),
+                  NARY_INVALID_IDX) << name;
+    }
+
+    EXPECT_EQ(tree.nodes[NARY_ROOT_IDX].node.num_children, NARY_MAX_CHILDREN);
+    EXPECT_EQ(nary_insert_mt(&tree, NARY_ROOT_IDX, "one_too_many", S_IFREG | 0644),
+              NARY_INVALID_IDX);
+    EXPECT_EQ(nary_child_check_mt(&tree, &tree.nodes[NARY_ROOT_IDX].node), 0);
+}
+
+TEST_F(NaryTreeTest, BatchInsertIsAllOrNothing) {
+    ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, "m050", S_IFREG | 0644), NARY_INVALID_IDX);
+
+    // Unsorted input, enough to spill into child blocks
+    std::vector<std::string> names;
+    for (int i = 99; i >= 0; i--) {
+        if (i == 50) continue;
+        char name[8];
+        snprintf(name, sizeof(name), "m%03d", i);
+        names.push_back(name);
+    }
+    std::vector<struct nary_batch_entry> entries(names.size());
+    for (size_t i = 0; i < names.size(); i++) {
+        entries[i].name = names[i].c_str();
+        entries[i].mode = (i % 10 == 0) ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+    }
+
+    // A name that exists already fails the whole batch
+    struct nary_batch_entry clash = {"m050", S_IFREG | 0644, 0};
+    entries.push_back(clash);
+    uint32_t used = tree.used;
+    EXPECT_EQ(nary_insert_batch_mt(&tree, NARY_ROOT_IDX, entries.data(),
+                                   (uint32_t)entries.size(), NULL, 0), -EEXIST);
+    EXPECT_EQ(tree.nodes[NARY_ROOT_IDX].node.num_children, 1);
+    EXPECT_EQ(tree.used, used);
+
+    // So do names repeated within the batch
+    entries.back().name = "m000";
+    EXPECT_EQ(nary_insert_batch_mt(&tree, NARY_ROOT_IDX, entries.data(),
+                                   (uint32_t)entries.size(), NULL, 0), -EINVAL);
+    entries.pop_back();
+
+    ASSERT_EQ(nary_insert_batch_mt(&tree, NARY_ROOT_IDX, entries.data(),
+                                   (uint32_t)entries.size(), NULL, 0), 0);
+    EXPECT_EQ(tree.nodes[NARY_ROOT_IDX].node.num_children, 100);
+    EXPECT_EQ(nary_child_check_mt(&tree, &tree.nodes[NARY_ROOT_IDX].node), 0);
+    for (const auto &e : entries) {
+        EXPECT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX, e.name), e.idx) << e.name;
+        EXPECT_EQ(tree.nodes[e.idx].node.mode, e.mode);
+        EXPECT_EQ(nary_inode_lookup_mt(&tree, tree.nodes[e.idx].node.inode), e.idx);
+    }
+
+    // Only directories take children
+    struct nary_batch_entry child = {"c", S_IFREG | 0644, 0};
+    EXPECT_EQ(nary_insert_batch_mt(&tree, entries[1].idx, &child, 1, NULL, 0), -ENOTDIR);
+    EXPECT_EQ(nary_insert_batch_mt(&tree, entries[0].idx, &child, 1, NULL, 0), 0);
+}
+
+TEST_F(NaryTreeTest, MoreThan65535Nodes) {
+    // Four levels of 16-wide directories: 69904 nodes below the root.
+    // Rebalancing renumbers nodes, so parents are looked up by path.
+    std::vector<std::string> level = { "" };
+    for (int depth = 0; depth < 4; depth++) {
+        std::vector<std::string> next;
+        for (const std::string &parent : level) {
+            for (int i = 0; i < 16; i++) {
+                char name[16];
+                snprintf(name, sizeof(name), "d%d_%d", depth, i);
+                uint32_t parent_idx = parent.empty() ? NARY_ROOT_IDX :
+                                      nary_path_lookup_mt(&tree, parent.c_str());
+                ASSERT_NE(nary_insert_mt(&tree, parent_idx, name, S_IFDIR | 0755),
+                          NARY_INVALID_IDX) << parent << "/" << name;
+                next.push_back(parent + "/" + name);
+            }
+        }
+        level.swap(next);
+    }
+
+    EXPECT_EQ(tree.used, 69905u);
+    uint32_t deepest = nary_path_lookup_mt(&tree, "/d0_15/d1_15/d2_15/d3_15");
+    ASSERT_NE(deepest, NARY_INVALID_IDX);
+    EXPECT_GT(deepest, 65535u);
+    EXPECT_EQ(tree.nodes[deepest].node.parent_idx,
+              nary_path_lookup_mt(&tree, "/d0_15/d1_15/d2_15"));
+}
+
+TEST_F(NaryTreeTest, HugePageTreeWithAndWithoutPrefetch) {
+    // Committed in whole huge pages: the first commit is one of them
+    numa_set_huge_pages(NUMA_HUGE_THP);
+    struct nary_tree_mt huge;
+    int ret = nary_tree_mt_init(&huge);
+    numa_set_huge_pages(NUMA_HUGE_OFF);
+    ASSERT_EQ(ret, 0);
+    const uint32_t per_page = NUMA_HUGE_PAGE_SIZE / sizeof(struct nary_node_mt);
+    EXPECT_EQ(huge.capacity, per_page);
+    EXPECT_GE(huge.strings.capacity, NUMA_HUGE_PAGE_SIZE);
+    EXPECT_EQ(huge.prefetch, 1);
+
+    // A wide directory (block tree) with nested paths, past the first page
+    numa_set_huge_pages(NUMA_HUGE_THP);
+    uint32_t dir = nary_insert_mt(&huge, NARY_ROOT_IDX, "wide", S_IFDIR | 0755);
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    for (uint32_t i = 0; i < per_page + 1000; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "entry_%u", i);
+        ASSERT_NE(nary_insert_mt(&huge, dir, name, S_IFREG | 0644), NARY_INVALID_IDX) << i;
+    }
+    numa_set_huge_pages(NUMA_HUGE_OFF);
+    EXPECT_EQ(huge.capacity % per_page, 0u);
+
+    for (int prefetch = 1; prefetch >= 0; prefetch--) {
+        huge.prefetch = prefetch;
+        for (uint32_t i = 0; i < per_page + 1000; i += 7) {
+            char path[64];
+            snprintf(path, sizeof(path), "/wide/entry_%u", i);
+            uint32_t idx = nary_path_lookup_mt(&huge, path);
+            ASSERT_NE(idx, NARY_INVALID_IDX) << path << " prefetch=" << prefetch;
+            EXPECT_STREQ(string_table_get(&huge.strings, huge.nodes[idx].node.name_offset),
+                         path + strlen("/wide/"));
+        }
+        EXPECT_EQ(nary_path_lookup_mt(&huge, "/wide/entry_x"), NARY_INVALID_IDX);
+
+        // Listing order is unaffected
+        uint32_t listed = 0;
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, &huge, &huge.nodes[dir].node);
+        while (nary_child_iter_next(&it) != NARY_INVALID_IDX) listed++;
+        EXPECT_EQ(listed, per_page + 1000);
+    }
+    nary_tree_mt_destroy(&huge);
+}
+
+TEST_F(NaryTreeTest, InodeLookupFollowsRebalance) {
+    // Enough inserts to trigger rebalances, then delete every other file
+    std::vector<uint32_t> inodes;
+    for (int i = 0; i < 300; i++) {
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX,
+                                      ("f" + std::to_string(i)).c_str(), S_IFREG | 0644);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        // The returned index is valid even if the insert rebalanced
+        inodes.push_back(tree.nodes[idx].node.inode);
+        EXPECT_EQ(nary_inode_lookup_mt(&tree, inodes.back()), idx);
+    }
+    for (int i = 0; i < 300; i += 2) {
+        uint32_t idx = nary_inode_lookup_mt(&tree, inodes[i]);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        ASSERT_EQ(nary_delete_mt(&tree, idx, NULL, 0), 0);
+    }
+    ASSERT_EQ(nary_rebalance_mt(&tree), 0);
+
+    for (int i = 0; i < 300; i++) {
+        uint32_t idx = nary_inode_lookup_mt(&tree, inodes[i]);
+        if (i % 2 == 0) {
+            EXPECT_EQ(idx, NARY_INVALID_IDX) << i;
+        } else {
+            ASSERT_NE(idx, NARY_INVALID_IDX) << i;
+            EXPECT_EQ(tree.nodes[idx].node.inode, inodes[i]);
+            EXPECT_EQ(idx, nary_path_lookup_mt(&tree, ("/f" + std::to_string(i)).c_str()));
+        }
+    }
+    EXPECT_EQ(nary_inode_lookup_mt(&tree, 1), NARY_ROOT_IDX);
+    EXPECT_EQ(nary_inode_lookup_mt(&tree, 0), NARY_INVALID_IDX);
+}
+
+TEST_F(NaryTreeTest, NodesNeverMoveWhileGrowing) {
+    struct nary_node_mt *base = tree.nodes;
+    uint32_t initial = tree.capacity;
+    EXPECT_EQ(initial % NARY_SLAB_NODES, 0u);
+
+    // Readers keep using the root while the tree grows past several slabs
+    std::atomic<bool> done{false};
+    std::thread reader([this, &done]() {
+        struct nary_node node;
+        while (!done.load()) {
+            ASSERT_EQ(nary_read_node_mt(&tree, NARY_ROOT_IDX, &node), 0);
+        }
+    });
+
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "grow", S_IFDIR | 0755);
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    for (uint32_t i = 0; tree.capacity < initial + 3 * NARY_SLAB_NODES; i++) {
+        ASSERT_NE(nary_insert_mt(&tree, dir, ("n" + std::to_string(i)).c_str(),
+                                 S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(tree.nodes, base);
+    EXPECT_EQ(tree.capacity % NARY_SLAB_NODES, 0u);
+    EXPECT_EQ(nary_reserve_mt(&tree, tree.capacity), 0);
+    EXPECT_EQ(tree.nodes, base);
+}
+
+TEST_F(NaryTreeTest, ChildBlocksNeverMoveWhileGrowing) {
+    struct nary_child_block *blocks = tree.child_blocks;
+    struct nary_child_fp *fps = tree.block_fp;
+    uint32_t initial = tree.block_capacity;
+
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "wide", S_IFDIR | 0755);
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    for (int i = 0; i < 64; i++) {
+        ASSERT_NE(nary_insert_mt(&tree, dir, ("w" + std::to_string(i)).c_str(),
+                                 S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+
+    // Lookups walk the wide directory's blocks while other directories
+    // take enough blocks to grow the array several times
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 2; t++) {
+        readers.emplace_back([this, &done, dir]() {
+            for (uint32_t i = 0; !done.load(); i++) {
+                std::string name = "w" + std::to_string(i % 64);
+                ASSERT_NE(nary_find_child_mt(&tree, dir, name.c_str()), NARY_INVALID_IDX) << name;
+            }
+        });
+    }
+
+    for (uint32_t d = 0; tree.block_capacity < 4 * initial; d++) {
+        uint32_t sub = nary_insert_mt(&tree, NARY_ROOT_IDX, ("d" + std::to_string(d)).c_str(),
+                                      S_IFDIR | 0755);
+        ASSERT_NE(sub, NARY_INVALID_IDX);
+        for (int i = 0; i < 100; i++) {
+            ASSERT_NE(nary_insert_mt(&tree, sub, ("n" + std::to_string(i)).c_str(),
+                                     S_IFREG | 0644), NARY_INVALID_IDX);
+        }
+    }
+    done = true;
+    for (auto &th : readers) th.join();
+
+    EXPECT_EQ(tree.child_blocks, blocks);
+    EXPECT_EQ(tree.block_fp, fps);
+}
+
+TEST_F(NaryTreeTest, StatsAccountMetadataPerNumaNode) {
+    for (int i = 0; i < 50; i++) {
+        ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, ("m" + std::to_string(i)).c_str(),
+                                 S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&tree, &stats);
+    ASSERT_GE(stats.numa_nodes, 1u);
+    ASSERT_LE(stats.numa_nodes, (uint32_t)NUMA_MAX_NODES);
+
+    // At least the touched nodes are resident, never more than committed
+    uint64_t total = 0;
+    for (uint32_t n = 0; n < NUMA_MAX_NODES; n++) total += stats.node_memory_bytes[n];
+    EXPECT_GE(total, (uint64_t)tree.used * sizeof(struct nary_node_mt));
+    EXPECT_LE(total, (uint64_t)tree.capacity * sizeof(struct nary_node_mt) +
+                     tree.strings.capacity + 2 * 4096);
+}
+
+// Sanitized builds read under the node locks (see nary_tree_mt.c)
+#if defined(__SANITIZE_THREAD__)
+#define OPTIMISTIC_READS 0
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define OPTIMISTIC_READS 0
+#endif
+#endif
+#ifndef OPTIMISTIC_READS
+#define OPTIMISTIC_READS 1
+#endif
+
+TEST_F(NaryTreeTest, ReadsDoNotTakeNodeLocks) {
+    if (!OPTIMISTIC_READS) GTEST_SKIP() << "Reads lock under ThreadSanitizer";
+
+    uint32_t f = nary_insert_mt(&tree, NARY_ROOT_IDX, "f", S_IFREG | 0644);
+    ASSERT_NE(f, NARY_INVALID_IDX);
+
+    // A write-locked node that is not being changed still reads
+    ASSERT_EQ(nary_lock_write(&tree, NARY_ROOT_IDX), 0);
+    ASSERT_EQ(nary_lock_write(&tree, f), 0);
+
+    struct nary_node node;
+    EXPECT_EQ(nary_read_node_mt(&tree, f, &node), 0);
+    EXPECT_EQ(node.inode, tree.nodes[f].node.inode);
+    EXPECT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX, "f"), f);
+    EXPECT_EQ(nary_find_parent_mt(&tree, f), (uint32_t)NARY_ROOT_IDX);
+
+    nary_unlock(&tree, f);
+    nary_unlock(&tree, NARY_ROOT_IDX);
+
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&tree, &stats);
+    EXPECT_EQ(stats.read_fallbacks, 0u);
+}
+
+TEST_F(NaryTreeTest, OptimisticReadsSeeWholeChanges) {
+    // Wide directory: lookups go through child blocks that keep changing
+    std::vector<uint32_t> stable;
+    for (int i = 0; i < 40; i++) {
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, ("s" + std::to_string(i)).c_str(),
+                                      S_IFREG | 0644);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        ASSERT_EQ(nary_update_size_mtime_mt(&tree, idx, 0, 0), 0);
+        stable.push_back(idx);
+    }
+    // Rebalance moves indices; keep it out of the way
+    tree.op_count = 0;
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([this, &stable, &done]() {
+            while (!done.load()) {
+                for (size_t i = 0; i < stable.size(); i++) {
+                    struct nary_node node;
+                    ASSERT_EQ(nary_read_node_mt(&tree, stable[i], &node), 0);
+                    // Size and mtime are always written together
+                    ASSERT_EQ(node.size, (uint64_t)node.mtime);
+                    ASSERT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX,
+                                                 ("s" + std::to_string(i)).c_str()), stable[i]);
+                }
+            }
+        });
+    }
+
+    for (uint32_t round = 1; round <= 300; round++) {
+        for (uint32_t idx : stable) {
+            ASSERT_EQ(nary_update_size_mtime_mt(&tree, idx, round, round), 0);
+        }
+        std::string name = "churn" + std::to_string(round % 7);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(), S_IFREG | 0644);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        ASSERT_EQ(nary_delete_mt(&tree, idx, NULL, 0), 0);
+        tree.op_count = 0;
+    }
+    done = true;
+    for (auto &th : readers) th.join();
+}
+
+TEST_F(NaryTreeTest, OptimisticDescentsSurviveBlockChurn) {
+    std::vector<uint32_t> stable;
+    for (int i = 0; i < 200; i++) {
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, ("s" + std::to_string(i)).c_str(),
+                                      S_IFREG | 0644);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        stable.push_back(idx);
+    }
+    tree.op_count = 0;
+    uint32_t initial = tree.block_capacity;
+
+    // Descents through the root's blocks while other directories take
+    // blocks (growing the array), give them back and take them again
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([this, &stable, &done]() {
+            for (uint32_t i = 0; !done.load(); i++) {
+                uint32_t k = i % stable.size();
+                ASSERT_EQ(nary_find_child_mt(&tree, NARY_ROOT_IDX,
+                                             ("s" + std::to_string(k)).c_str()), stable[k]);
+            }
+        });
+    }
+
+    for (int round = 0; round < 6; round++) {
+        std::vector<uint32_t> dirs;
+        for (int d = 0; d < 8 * (round + 1); d++) {
+            uint32_t sub = nary_insert_mt(&tree, NARY_ROOT_IDX,
+                                          ("r" + std::to_string(d)).c_str(), S_IFDIR | 0755);
+            ASSERT_NE(sub, NARY_INVALID_IDX);
+            for (int i = 0; i < 100; i++) {
+                ASSERT_NE(nary_insert_mt(&tree, sub, ("n" + std::to_string(i)).c_str(),
+                                         S_IFREG | 0644), NARY_INVALID_IDX);
+            }
+            dirs.push_back(sub);
+        }
+        for (uint32_t sub : dirs) {
+            for (int i = 0; i < 100; i++) {
+                uint32_t idx = nary_find_child_mt(&tree, sub, ("n" + std::to_string(i)).c_str());
+                ASSERT_NE(idx, NARY_INVALID_IDX);
+                ASSERT_EQ(nary_delete_mt(&tree, idx, NULL, 0), 0);
+            }
+            ASSERT_EQ(nary_delete_mt(&tree, sub, NULL, 0), 0);
+        }
+        tree.op_count = 0;
+    }
+    done = true;
+    for (auto &th : readers) th.join();
+
+    EXPECT_GT(tree.block_capacity, initial);
+}
+
+// Lookups until the directory is sampled hot
+static void heat_directory(struct nary_tree_mt *tree, uint32_t dir, const char *name) {
+    for (int i = 0; i < NARY_HEAT_SAMPLE * NARY_HEAT_HOT * 2; i++) {
+        nary_find_child_mt(tree, dir, name);
+    }
+}
+
+TEST_F(NaryTreeTest, StepGathersHotDirectory) {
+    // Interleaved creates scatter both directories' children
+    uint32_t hot = nary_insert_mt(&tree, NARY_ROOT_IDX, "hot", S_IFDIR | 0755);
+    uint32_t cold = nary_insert_mt(&tree, NARY_ROOT_IDX, "cold", S_IFDIR | 0755);
+    ASSERT_NE(hot, NARY_INVALID_IDX);
+    ASSERT_NE(cold, NARY_INVALID_IDX);
+    std::vector<uint32_t> inodes;
+    for (int i = 0; i < 100; i++) {
+        std::string name = "e" + std::to_string(i);
+        uint32_t idx = nary_insert_mt(&tree, hot, name.c_str(),
+                                      (i % 10 ? S_IFREG | 0644 : S_IFDIR | 0755));
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        inodes.push_back(tree.nodes[idx].node.inode);
+        ASSERT_NE(nary_insert_mt(&tree, cold, name.c_str(), S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+    // Subdirectories have children whose parent index must follow a move
+    uint32_t sub = nary_find_child_mt(&tree, hot, "e0");
+    ASSERT_NE(nary_insert_mt(&tree, sub, "inner", S_IFREG | 0644), NARY_INVALID_IDX);
+    uint32_t sub_inode = tree.nodes[sub].node.inode;
+
+    heat_directory(&tree, hot, "e1");
+
+    // Bounded steps until the children are adjacent
+    int steps = 0;
+    int moved;
+    while ((moved = nary_rebalance_step_mt(&tree, NARY_REBALANCE_STEP_NODES)) > 0) {
+        EXPECT_LE(moved, NARY_REBALANCE_STEP_NODES);
+        ASSERT_LT(++steps, 100);
+    }
+    ASSERT_EQ(moved, 0);
+    EXPECT_GT(steps, 1);
+
+    struct nary_node dir;
+    ASSERT_EQ(nary_read_node_mt(&tree, hot, &dir), 0);
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, &tree, &dir);
+    uint32_t prev = nary_child_iter_next(&it), child;
+    while ((child = nary_child_iter_next(&it)) != NARY_INVALID_IDX) {
+        EXPECT_EQ(child, prev + 1);
+        prev = child;
+    }
+
+    // Every entry still resolves, by name and by inode
+    for (int i = 0; i < 100; i++) {
+        std::string name = "e" + std::to_string(i);
+        uint32_t idx = nary_find_child_mt(&tree, hot, name.c_str());
+        ASSERT_NE(idx, NARY_INVALID_IDX) << name;
+        EXPECT_EQ(tree.nodes[idx].node.inode, inodes[i]);
+        EXPECT_EQ(tree.nodes[idx].node.parent_idx, hot);
+        EXPECT_EQ(nary_inode_lookup_mt(&tree, inodes[i]), idx);
+        EXPECT_NE(nary_find_child_mt(&tree, cold, name.c_str()), NARY_INVALID_IDX);
+    }
+    sub = nary_inode_lookup_mt(&tree, sub_inode);
+    uint32_t inner = nary_path_lookup_mt(&tree, "/hot/e0/inner");
+    ASSERT_NE(inner, NARY_INVALID_IDX);
+    EXPECT_EQ(tree.nodes[inner].node.parent_idx, sub);
+
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&tree, &stats);
+    EXPECT_EQ(stats.rebalance_steps, (uint64_t)steps);
+    EXPECT_GE(stats.nodes_moved, 100u);
+    uint64_t paused = 0;
+    for (int b = 0; b < NARY_PAUSE_BUCKETS; b++) paused += stats.pause_hist[b];
+    EXPECT_EQ(paused, stats.rebalance_steps);
+}
+
+TEST_F(NaryTreeTest, LookupsRunThroughSteps) {
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "busy", S_IFDIR | 0755);
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    for (int i = 0; i < 200; i++) {
+        std::string name = "b" + std::to_string(i);
+        ASSERT_NE(nary_insert_mt(&tree, dir, name.c_str(), S_IFREG | 0644), NARY_INVALID_IDX);
+        ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(), S_IFREG | 0644),
+                  NARY_INVALID_IDX);
+    }
+
+    // Path lookups never miss an entry that is only being moved
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([this, &done]() {
+            for (uint32_t i = 0; !done.load(); i++) {
+                std::string path = "/busy/b" + std::to_string(i % 200);
+                ASSERT_NE(nary_path_lookup_mt(&tree, path.c_str()), NARY_INVALID_IDX) << path;
+            }
+        });
+    }
+
+    for (int round = 0; round < 20; round++) {
+        heat_directory(&tree, dir, "b0");
+        while (nary_rebalance_step_mt(&tree, 16) > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        dir = nary_path_lookup_mt(&tree, "/busy");
+        ASSERT_NE(dir, NARY_INVALID_IDX);
+    }
+    done = true;
+    for (auto &th : readers) th.join();
+}
+
+TEST_F(NaryTreeTest, DeletesRacingStepsLeaveMovedNodesAlone) {
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "wide", S_IFDIR | 0755);
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_NE(nary_insert_mt(&tree, dir, ("keep" + std::to_string(i)).c_str(),
+                                 S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+
+    // Steps keep moving the directory's children while writers create and
+    // delete theirs, each with an index found just before
+    std::atomic<bool> done{false};
+    std::atomic<int> moving_steps{0};
+    std::thread stepper([this, &done, &moving_steps]() {
+        while (!done.load()) {
+            uint32_t d = nary_path_lookup_mt(&tree, "/wide");
+            if (d != NARY_INVALID_IDX) heat_directory(&tree, d, "keep0");
+            if (nary_rebalance_step_mt(&tree, 16) > 0) moving_steps++;
+        }
+    });
+
+    const int THREADS = 8, NAMES = 16;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < THREADS; t++) {
+        writers.emplace_back([this, t, &moving_steps, deadline]() {
+            // Toggle each name, then delete what is left
+            auto toggle = [this](const std::string &name, bool create) {
+                for (;;) {
+                    uint32_t d = nary_path_lookup_mt(&tree, "/wide");
+                    ASSERT_NE(d, NARY_INVALID_IDX);
+                    uint32_t idx = nary_find_child_mt(&tree, d, name.c_str());
+                    if (idx == NARY_INVALID_IDX) {
+                        if (!create ||
+                            nary_insert_mt(&tree, d, name.c_str(), S_IFREG | 0644) != NARY_INVALID_IDX) {
+                            return;
+                        }
+                    } else {
+                        int ret = nary_delete_mt(&tree, idx, nullptr, 0);
+                        if (ret == 0) return;
+                        ASSERT_EQ(ret, -ESTALE) << name;
+                    }
+                    // The directory or the node moved: look again
+                }
+            };
+            for (int round = 0; moving_steps.load() < 200 &&
+                                std::chrono::steady_clock::now() < deadline; round++) {
+                toggle("t" + std::to_string(t) + "_" + std::to_string(round % NAMES), true);
+            }
+            for (int i = 0; i < NAMES; i++) {
+                toggle("t" + std::to_string(t) + "_" + std::to_string(i), false);
+            }
+        });
+    }
+    for (auto &th : writers) th.join();
+    done = true;
+    stepper.join();
+    EXPECT_GE(moving_steps.load(), 200);
+
+    // Only the residents are left, all in order
+    dir = nary_path_lookup_mt(&tree, "/wide");
+    ASSERT_NE(dir, NARY_INVALID_IDX);
+    const struct nary_node *wide = &tree.nodes[dir].node;
+    ASSERT_EQ(nary_child_check_mt(&tree, wide), 0);
+    EXPECT_EQ(wide->num_children, 100);
+    struct nary_child_iter it;
+    nary_child_iter_init(&it, &tree, wide);
+    std::string prev;
+    for (uint32_t child; (child = nary_child_iter_next(&it)) != NARY_INVALID_IDX;) {
+        std::string name = string_table_get(&tree.strings, tree.nodes[child].node.name_offset);
+        EXPECT_LT(prev, name);
+        EXPECT_EQ(tree.nodes[child].node.parent_idx, dir);
+        prev = name;
+    }
+    for (int i = 0; i < 100; i++) {
+        std::string path = "/wide/keep" + std::to_string(i);
+        EXPECT_NE(nary_path_lookup_mt(&tree, path.c_str()), NARY_INVALID_IDX) << path;
+    }
+
+    // No slot is free twice, and no free slot holds a node
+    std::vector<bool> seen(tree.used);
+    for (uint32_t i = 0; i < tree.free_count; i++) {
+        uint32_t idx = tree.free_list[i];
+        ASSERT_LT(idx, tree.used);
+        EXPECT_FALSE(seen[idx]) << "slot " << idx << " free twice";
+        EXPECT_EQ(tree.nodes[idx].node.inode, 0u) << "slot " << idx;
+        seen[idx] = true;
+    }
+}
+
+TEST_F(NaryTreeTest, SnapshotsKeepTheOldTree) {
+    uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, "dir", S_IFDIR | 0755);
+    uint32_t file = nary_insert_mt(&tree, dir, "file", S_IFREG | 0644);
+    uint32_t gone = nary_insert_mt(&tree, NARY_ROOT_IDX, "gone", S_IFREG | 0644);
+    ASSERT_NE(file, NARY_INVALID_IDX);
+    ASSERT_NE(gone, NARY_INVALID_IDX);
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 100, 1), 0);
+
+    uint32_t s1;
+    ASSERT_EQ(nary_snapshot_create_mt(&tree, &s1), 0);
+
+    // Change, delete, create and move after the snapshot
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 500, 2), 0);
+    uint32_t added = nary_insert_mt(&tree, NARY_ROOT_IDX, "added", S_IFREG | 0644);
+    ASSERT_NE(added, NARY_INVALID_IDX);
+    ASSERT_EQ(nary_delete_mt(&tree, gone, NULL, 0), 0);
+    // A node reusing the freed slot is not the snapshot's
+    uint32_t reused = nary_insert_mt(&tree, NARY_ROOT_IDX, "reused", S_IFREG | 0644);
+    ASSERT_NE(reused, NARY_INVALID_IDX);
+    struct nary_node replaced;
+    ASSERT_EQ(nary_rename_mt(&tree, file, NARY_ROOT_IDX, "moved", 0, &replaced, NULL, 0), 0);
+
+    // The snapshot sees the tree as it was
+    struct nary_node node;
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/dir/file"), file);
+    ASSERT_EQ(nary_snapshot_read_node_mt(&tree, s1, file, &node), 0);
+    EXPECT_EQ(node.size, 100u);
+    EXPECT_EQ(node.parent_idx, dir);
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/gone"), gone);
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/moved"), NARY_INVALID_IDX);
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/added"), NARY_INVALID_IDX);
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/reused"), NARY_INVALID_IDX);
+    EXPECT_EQ(nary_snapshot_read_node_mt(&tree, s1, added, &node), -ENOENT);
+
+    uint32_t *children;
+    uint32_t count;
+    ASSERT_EQ(nary_snapshot_children_mt(&tree, s1, NARY_ROOT_IDX, &children, &count), 0);
+    std::vector<std::string> names;
+    for (uint32_t i = 0; i < count; i++) {
+        ASSERT_EQ(nary_snapshot_read_node_mt(&tree, s1, children[i], &node), 0);
+        names.push_back(string_table_get(&tree.strings, node.name_offset));
+    }
+    free(children);
+    EXPECT_EQ(names, (std::vector<std::string>{"dir", "gone"}));
+    EXPECT_EQ(nary_snapshot_children_mt(&tree, s1, file, &children, &count), -ENOTDIR);
+
+    // The live tree has moved on
+    EXPECT_EQ(nary_path_lookup_mt(&tree, "/moved"), file);
+    EXPECT_EQ(nary_path_lookup_mt(&tree, "/gone"), NARY_INVALID_IDX);
+
+    // Compaction would renumber nodes: it waits for the snapshots to go
+    uint32_t hot = nary_insert_mt(&tree, NARY_ROOT_IDX, "hot", S_IFDIR | 0755);
+    for (int i = 0; i < 20; i++) {
+        std::string name = "h" + std::to_string(i);
+        ASSERT_NE(nary_insert_mt(&tree, hot, name.c_str(), S_IFREG | 0644), NARY_INVALID_IDX);
+        ASSERT_NE(nary_insert_mt(&tree, NARY_ROOT_IDX, name.c_str(), S_IFREG | 0644),
+                  NARY_INVALID_IDX);
+    }
+    heat_directory(&tree, hot, "h1");
+    EXPECT_EQ(nary_rebalance_step_mt(&tree, NARY_REBALANCE_STEP_NODES), 0);
+
+    ASSERT_EQ(nary_snapshot_drop_mt(&tree, s1), 0);
+    EXPECT_EQ(nary_snapshot_drop_mt(&tree, s1), -ENOENT);
+    EXPECT_EQ(nary_snapshot_path_lookup_mt(&tree, s1, "/dir"), NARY_INVALID_IDX);
+    EXPECT_GT(nary_rebalance_step_mt(&tree, NARY_REBALANCE_STEP_NODES), 0);
+}
+
+TEST_F(NaryTreeTest, DroppingASnapshotHandsItsNodesToTheOlder) {
+    uint32_t file = nary_insert_mt(&tree, NARY_ROOT_IDX, "file", S_IFREG | 0644);
+    ASSERT_NE(file, NARY_INVALID_IDX);
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 1, 1), 0);
+
+    uint32_t s1, s2, s3;
+    struct nary_node node;
+    ASSERT_EQ(nary_snapshot_create_mt(&tree, &s1), 0);
+    ASSERT_EQ(nary_snapshot_create_mt(&tree, &s2), 0);
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 2, 2), 0);  // Saved in s2 only
+    ASSERT_EQ(nary_snapshot_create_mt(&tree, &s3), 0);
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 3, 3), 0);
+
+    struct nary_mt_stats stats;
+    nary_get_mt_stats(&tree, &stats);
+    EXPECT_EQ(stats.snapshots, 3u);
+    EXPECT_EQ(stats.snapshot_nodes, 2u);
+
+    // s1 saw size 1 through s2's copy, which moves to s1
+    ASSERT_EQ(nary_snapshot_drop_mt(&tree, s2), 0);
+    ASSERT_EQ(nary_snapshot_read_node_mt(&tree, s1, file, &node), 0);
+    EXPECT_EQ(node.size, 1u);
+    ASSERT_EQ(nary_snapshot_read_node_mt(&tree, s3, file, &node), 0);
+    EXPECT_EQ(node.size, 2u);
+
+    // Dropping the newest brings changes back to the older one
+    ASSERT_EQ(nary_snapshot_drop_mt(&tree, s3), 0);
+    ASSERT_EQ(nary_update_size_mtime_mt(&tree, file, 4, 4), 0);
+    ASSERT_EQ(nary_snapshot_read_node_mt(&tree, s1, file, &node), 0);
+    EXPECT_EQ(node.size, 1u);
+
+    nary_get_mt_stats(&tree, &stats);
+    EXPECT_EQ(stats.snapshots, 1u);
+    EXPECT_EQ(stats.snapshot_nodes, 1u);
+    EXPECT_EQ(stats.snapshot_lost, 0u);
 }
 
 int main(int argc, char **argv) {
@@ -7,6 +7,7 @@
 #include <sys/mman.h>
 #include <cstdlib>
 #include <cstring>
+#include <unistd.h>
 
 extern "C" {
 #include "numa_support.h"
@@ -104,6 +105,139 @@ TEST_F(NumaSupportTest, BindZeroSize) {
     munmap(addr, 4096);
 }
 
+/* Test: Policy names round-trip */
+TEST_F(NumaSupportTest, PolicyNames) {
+    const enum numa_policy all[] = {
+        NUMA_POLICY_DEFAULT, NUMA_POLICY_INTERLEAVE, NUMA_POLICY_LOCAL, NUMA_POLICY_SUBTREE,
+    };
+    for (enum numa_policy policy : all) {
+        enum numa_policy parsed;
+        ASSERT_EQ(numa_policy_parse(numa_policy_name(policy), &parsed), 0);
+        EXPECT_EQ(parsed, policy);
+    }
+
+    enum numa_policy parsed = NUMA_POLICY_LOCAL;
+    EXPECT_EQ(numa_policy_parse("nearest", &parsed), -1);
+    EXPECT_EQ(parsed, NUMA_POLICY_LOCAL);
+}
+
+/* Test: Every policy places both kinds of memory without breaking it */
+TEST_F(NumaSupportTest, PlaceUnderEveryPolicy) {
+    const size_t size = 16 * 4096;
+    const enum numa_policy all[] = {
+        NUMA_POLICY_DEFAULT, NUMA_POLICY_INTERLEAVE, NUMA_POLICY_LOCAL, NUMA_POLICY_SUBTREE,
+    };
+
+    for (enum numa_policy policy : all) {
+        numa_set_policy(policy);
+        EXPECT_EQ(numa_get_policy(), policy);
+
+        char *addr = (char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ASSERT_NE(addr, MAP_FAILED);
+        memset(addr, 0x5a, size);
+
+        EXPECT_EQ(numa_place(addr, size / 2, NUMA_MEM_METADATA, -1), 0);
+        EXPECT_EQ(numa_place(addr + size / 2, size / 2, NUMA_MEM_FILE_DATA, 0), 0);
+        // Less than a page: nothing to place
+        EXPECT_EQ(numa_place(addr + 1, 100, NUMA_MEM_FILE_DATA, -1), 0);
+
+        for (size_t i = 0; i < size; i += 4096) {
+            ASSERT_EQ(addr[i], 0x5a);
+        }
+        munmap(addr, size);
+    }
+    numa_set_policy(NUMA_POLICY_DEFAULT);
+}
+
+/* Test: Touched pages are counted on some node */
+TEST_F(NumaSupportTest, ResidentBytes) {
+    const size_t size = 8 * 4096;
+    char *addr = (char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(addr, 1, size / 2);
+
+    uint64_t bytes[NUMA_MAX_NODES] = {0};
+    int result = numa_resident_bytes(addr, size, bytes);
+    uint64_t total = 0;
+    for (int n = 0; n < NUMA_MAX_NODES; n++) total += bytes[n];
+    munmap(addr, size);
+
+    if (result != 0) {
+        GTEST_SKIP() << "Page placement cannot be queried here";
+    }
+    // Only the touched half is resident
+    EXPECT_EQ(total, (uint64_t)size / 2);
+}
+
+/* Test: Huge page mode names round-trip */
+TEST_F(NumaSupportTest, HugePageModeNames) {
+    const enum numa_huge_pages all[] = { NUMA_HUGE_OFF, NUMA_HUGE_THP, NUMA_HUGE_HUGETLB };
+    for (enum numa_huge_pages mode : all) {
+        enum numa_huge_pages parsed;
+        ASSERT_EQ(numa_huge_pages_parse(numa_huge_pages_name(mode), &parsed), 0);
+        EXPECT_EQ(parsed, mode);
+    }
+
+    enum numa_huge_pages parsed = NUMA_HUGE_THP;
+    EXPECT_EQ(numa_huge_pages_parse("1g", &parsed), -1);
+    EXPECT_EQ(parsed, NUMA_HUGE_THP);
+}
+
+/* Test: Reserved regions are huge page aligned and commit piecewise in
+ * every mode (hugetlb falls back when the pool is empty) */
+TEST_F(NumaSupportTest, ReserveAndCommitInEveryMode) {
+    const size_t size = 4 * NUMA_HUGE_PAGE_SIZE;
+    const enum numa_huge_pages all[] = { NUMA_HUGE_OFF, NUMA_HUGE_THP, NUMA_HUGE_HUGETLB };
+
+    for (enum numa_huge_pages mode : all) {
+        numa_set_huge_pages(mode);
+        EXPECT_EQ(numa_get_huge_pages(), mode);
+        EXPECT_EQ(numa_commit_granule(),
+                  mode == NUMA_HUGE_OFF ? (size_t)sysconf(_SC_PAGESIZE) : NUMA_HUGE_PAGE_SIZE);
+
+        char *addr = (char *)numa_reserve(size);
+        ASSERT_NE(addr, nullptr);
+        EXPECT_EQ((uintptr_t)addr % NUMA_HUGE_PAGE_SIZE, 0u);
+
+        // A small head, then a piece spanning one whole huge page
+        const size_t head = 64 * 1024;
+        const size_t end = 3 * NUMA_HUGE_PAGE_SIZE + 4096;
+        ASSERT_EQ(numa_commit(addr, head, NUMA_MEM_METADATA, -1), 0);
+        memset(addr, 0x5a, head);
+        ASSERT_EQ(numa_commit(addr + head, end - head, NUMA_MEM_METADATA, -1), 0);
+
+        // The head kept its contents, the rest reads as zero and is writable
+        for (size_t i = 0; i < head; i += 4096) {
+            ASSERT_EQ(addr[i], 0x5a);
+        }
+        for (size_t i = head; i < end; i += 4096) {
+            ASSERT_EQ(addr[i], 0);
+            addr[i] = 1;
+        }
+        numa_release(addr, size);
+    }
+    numa_set_huge_pages(NUMA_HUGE_OFF);
+}
+
+/* Test: Advising existing mappings never breaks them */
+TEST_F(NumaSupportTest, AdviseHugeOnSharedMapping) {
+    const size_t size = 2 * NUMA_HUGE_PAGE_SIZE;
+    char *addr = (char *)mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+
+    EXPECT_EQ(numa_advise_huge(addr, size), 0);  // Off: nothing to do
+    numa_set_huge_pages(NUMA_HUGE_THP);
+    numa_advise_huge(addr, size);                // Up to the kernel config
+    numa_set_huge_pages(NUMA_HUGE_OFF);
+
+    memset(addr, 0x3c, size);
+    EXPECT_EQ(addr[size - 1], 0x3c);
+    munmap(addr, size);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,138 @@
+/**
+ * Path Cache Unit Tests
+ * Tests for the dentry cache and the tree's path generation
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "path_cache.h"
+#include "nary_tree_mt.h"
+}
+
+class PathCacheTest : public ::testing::Test {
+protected:
+    struct path_cache cache;
+
+    void SetUp() override {
+        ASSERT_EQ(path_cache_init(&cache), 0);
+    }
+
+    void TearDown() override {
+        path_cache_destroy(&cache);
+    }
+};
+
+TEST_F(PathCacheTest, HitAndMiss) {
+    EXPECT_EQ(path_cache_lookup(&cache, "/a/b", 0), NARY_INVALID_IDX);
+
+    path_cache_insert(&cache, "/a/b", 42, 0);
+    EXPECT_EQ(path_cache_lookup(&cache, "/a/b", 0), 42u);
+    EXPECT_EQ(path_cache_lookup(&cache, "/a/c", 0), NARY_INVALID_IDX);
+    EXPECT_EQ(path_cache_lookup(&cache, "/a", 0), NARY_INVALID_IDX);
+
+    /* Reinserting the same path replaces it */
+    path_cache_insert(&cache, "/a/b", 43, 0);
+    EXPECT_EQ(path_cache_lookup(&cache, "/a/b", 0), 43u);
+
+    struct path_cache_stats stats;
+    path_cache_get_stats(&cache, &stats);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 3u);
+    EXPECT_EQ(stats.inserts, 2u);
+}
+
+TEST_F(PathCacheTest, NewGenerationStalesEntries) {
+    path_cache_insert(&cache, "/file", 7, 5);
+    EXPECT_EQ(path_cache_lookup(&cache, "/file", 5), 7u);
+    EXPECT_EQ(path_cache_lookup(&cache, "/file", 6), NARY_INVALID_IDX);
+
+    path_cache_insert(&cache, "/file", 9, 6);
+    EXPECT_EQ(path_cache_lookup(&cache, "/file", 6), 9u);
+}
+
+TEST_F(PathCacheTest, LongPathsBypassCache) {
+    std::string longpath(PATH_CACHE_MAX_PATH, 'x');
+    longpath[0] = '/';
+
+    path_cache_insert(&cache, longpath.c_str(), 3, 0);
+    EXPECT_EQ(path_cache_lookup(&cache, longpath.c_str(), 0), NARY_INVALID_IDX);
+
+    std::string fits = longpath.substr(0, PATH_CACHE_MAX_PATH - 1);
+    path_cache_insert(&cache, fits.c_str(), 3, 0);
+    EXPECT_EQ(path_cache_lookup(&cache, fits.c_str(), 0), 3u);
+}
+
+TEST_F(PathCacheTest, FullSetEvictsButKeepsWorking) {
+    /* More paths than the cache holds: every lookup is a hit or a clean miss */
+    const uint32_t n = PATH_CACHE_SETS * PATH_CACHE_WAYS * 2;
+    for (uint32_t i = 0; i < n; i++) {
+        path_cache_insert(&cache, ("/f" + std::to_string(i)).c_str(), i, 0);
+    }
+
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = path_cache_lookup(&cache, ("/f" + std::to_string(i)).c_str(), 0);
+        if (idx != NARY_INVALID_IDX) {
+            EXPECT_EQ(idx, i);
+            hits++;
+        }
+    }
+    EXPECT_GT(hits, 0u);
+    EXPECT_LE(hits, (uint32_t)(PATH_CACHE_SETS * PATH_CACHE_WAYS));
+}
+
+TEST_F(PathCacheTest, ConcurrentLookupsAndInserts) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; t++) {
+        threads.emplace_back([this]() {
+            for (uint32_t i = 0; i < 2000; i++) {
+                std::string path = "/d" + std::to_string(i % 64);
+                uint32_t idx = path_cache_lookup(&cache, path.c_str(), 0);
+                if (idx == NARY_INVALID_IDX) {
+                    path_cache_insert(&cache, path.c_str(), i % 64, 0);
+                } else {
+                    EXPECT_EQ(idx, i % 64);
+                }
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    struct path_cache_stats stats;
+    path_cache_get_stats(&cache, &stats);
+    EXPECT_EQ(stats.hits + stats.misses, 8u * 2000u);
+}
+
+TEST(PathGenerationTest, DeleteAndRebalanceInvalidate) {
+    struct nary_tree_mt tree;
+    ASSERT_EQ(nary_tree_mt_init(&tree), 0);
+
+    uint64_t gen = nary_paths_generation_mt(&tree);
+    ASSERT_NE(gen, NARY_PATHS_UNSTABLE);
+
+    /* Creating paths leaves existing resolutions valid */
+    uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, "f", S_IFREG | 0644);
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+    EXPECT_EQ(nary_paths_generation_mt(&tree), gen);
+
+    ASSERT_EQ(nary_delete_mt(&tree, idx, NULL, 0), 0);
+    uint64_t after_delete = nary_paths_generation_mt(&tree);
+    EXPECT_GT(after_delete, gen);
+
+    ASSERT_EQ(nary_rebalance_mt(&tree), 0);
+    EXPECT_GT(nary_paths_generation_mt(&tree), after_delete);
+
+    /* While a change is in progress nothing may be cached */
+    nary_paths_invalidate_begin_mt(&tree);
+    EXPECT_EQ(nary_paths_generation_mt(&tree), NARY_PATHS_UNSTABLE);
+    nary_paths_invalidate_end_mt(&tree);
+    EXPECT_NE(nary_paths_generation_mt(&tree), NARY_PATHS_UNSTABLE);
+
+    nary_tree_mt_destroy(&tree);
+}
@@ -70,7 +70,7 @@ TEST_F(PersistStressTest, LargeFilesystemPersistence) {
     for (int d = 0; d < 10; d++) {
         char dirname[32];
         snprintf(dirname, sizeof(dirname), "dir_%03d", d);
-        uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
+        uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
         
         if (dir != NARY_INVALID_IDX) {
             // Add 10 files per directory
@@ -100,7 +100,7 @@ TEST_F(PersistStressTest, ConcurrentPersistence) {
                 char name[32];
                 snprintf(name, sizeof(name), "t%d_file%d.txt", t, i);
                 
-                uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+                uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
                 if (idx != NARY_INVALID_IDX) {
                     op_count++;
                 }
@@ -128,7 +128,7 @@ TEST_F(PersistStressTest, MemoryPressure) {
         char dirname[32];
         snprintf(dirname, sizeof(dirname), "memtest_%d", i);
         
-        uint16_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
+        uint32_t dir = nary_insert_mt(&tree, NARY_ROOT_IDX, dirname, S_IFDIR | 0755);
         if (dir == NARY_INVALID_IDX) {
             break;
         }
@@ -177,11 +177,11 @@ TEST_F(PersistStressTest, DeleteHeavyWorkload) {
     ASSERT_EQ(nary_tree_mt_init(&tree), 0);
     
     // Create files
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < 20; i++) {
         char name[32];
         snprintf(name, sizeof(name), "delete_%d.txt", i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
         if (idx != NARY_INVALID_IDX) {
             indices.push_back(idx);
         }
@@ -200,11 +200,11 @@ TEST_F(PersistStressTest, UpdateHeavyWorkload) {
     ASSERT_EQ(nary_tree_mt_init(&tree), 0);
     
     // Create files
-    std::vector<uint16_t> indices;
+    std::vector<uint32_t> indices;
     for (int i = 0; i < 10; i++) {
         char name[32];
         snprintf(name, sizeof(name), "update_%d.txt", i);
-        uint16_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        uint32_t idx = nary_insert_mt(&tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
         if (idx != NARY_INVALID_IDX) {
             indices.push_back(idx);
         }
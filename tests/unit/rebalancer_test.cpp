@@ -0,0 +1,72 @@
+/**
+ * Background Compaction Unit Tests
+ * Tests for the thread driving incremental tree compaction
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+extern "C" {
+#include "rebalancer.h"
+#include "nary_tree_mt.h"
+}
+
+class RebalancerTest : public ::testing::Test {
+protected:
+    struct nary_tree_mt tree;
+    struct rebalancer rb;
+
+    void SetUp() override {
+        memset(&tree, 0, sizeof(tree));
+        memset(&rb, 0, sizeof(rb));
+        ASSERT_EQ(nary_tree_mt_init(&tree), 0);
+    }
+
+    void TearDown() override {
+        rebalancer_destroy(&rb);
+        nary_tree_mt_destroy(&tree);
+    }
+};
+
+TEST_F(RebalancerTest, ZeroIntervalStartsNothing) {
+    ASSERT_EQ(rebalancer_init(&rb, &tree, 0, 0), 0);
+    EXPECT_FALSE(rb.started);
+    rebalancer_destroy(&rb);  // Safe without a thread, and twice
+}
+
+TEST_F(RebalancerTest, CompactsHotDirectoryInTheBackground) {
+    uint32_t a = nary_insert_mt(&tree, NARY_ROOT_IDX, "a", S_IFDIR | 0755);
+    uint32_t b = nary_insert_mt(&tree, NARY_ROOT_IDX, "b", S_IFDIR | 0755);
+    ASSERT_NE(a, NARY_INVALID_IDX);
+    ASSERT_NE(b, NARY_INVALID_IDX);
+    for (int i = 0; i < 50; i++) {
+        std::string name = "f" + std::to_string(i);
+        ASSERT_NE(nary_insert_mt(&tree, a, name.c_str(), S_IFREG | 0644), NARY_INVALID_IDX);
+        ASSERT_NE(nary_insert_mt(&tree, b, name.c_str(), S_IFREG | 0644), NARY_INVALID_IDX);
+    }
+
+    ASSERT_EQ(rebalancer_init(&rb, &tree, 5, 16), 0);
+    EXPECT_TRUE(rb.started);
+    EXPECT_EQ(rb.step_nodes, 16u);
+
+    // Keep looking things up in "a" until the thread has moved its children
+    struct nary_mt_stats stats;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    do {
+        for (int i = 0; i < NARY_HEAT_SAMPLE * NARY_HEAT_HOT; i++) {
+            ASSERT_NE(nary_path_lookup_mt(&tree, ("/a/f" + std::to_string(i % 50)).c_str()),
+                      NARY_INVALID_IDX);
+        }
+        nary_get_mt_stats(&tree, &stats);
+    } while (stats.nodes_moved < 50 && std::chrono::steady_clock::now() < deadline);
+    rebalancer_destroy(&rb);
+
+    EXPECT_GE(stats.nodes_moved, 50u);
+    for (int i = 0; i < 50; i++) {
+        EXPECT_NE(nary_path_lookup_mt(&tree, ("/a/f" + std::to_string(i)).c_str()), NARY_INVALID_IDX);
+        EXPECT_NE(nary_path_lookup_mt(&tree, ("/b/f" + std::to_string(i)).c_str()), NARY_INVALID_IDX);
+    }
+}
@@ -13,6 +13,8 @@ extern "C" {
 #include <sys/mman.h>
 #include <cstring>
 #include <cstdlib>
+#include <string>
+#include <vector>
 
 // Test fixture for recovery tests using heap-allocated WAL
 class RecoveryTest : public ::testing::Test {
@@ -29,8 +31,9 @@ protected:
         // Initialize tree
         ASSERT_EQ(nary_tree_mt_init(&tree), 0);
 
-        // Initialize string tables
+        // Initialize string tables (the tree's starts out empty)
         ASSERT_EQ(string_table_init(&strings), 0);
+        string_table_destroy(&tree.strings);
         ASSERT_EQ(string_table_init(&tree.strings), 0);
 
         // Initialize recovery context
@@ -40,8 +43,7 @@ protected:
     void TearDown() override {
         recovery_destroy(&recovery);
         string_table_destroy(&strings);
-        string_table_destroy(&tree.strings);
-        free(tree.nodes);
+        nary_tree_mt_destroy(&tree);
         wal_destroy(&wal);
     }
 };
@@ -709,6 +711,486 @@ TEST_F(RecoveryTest, ChecksumCorruptionDetection) {
     unlink(test_path);
 }
 
+// ============================================================================
+// Entry Index and Parallel Redo
+// ============================================================================
+
+// Log ten committed file creations per directory; writes carry an unrelated
+// node index so replay has to find the file by inode
+static void log_directory_workload(struct wal *w, struct string_table *names,
+                                   const std::vector<uint32_t> &dirs) {
+    for (int round = 0; round < 10; round++) {
+        for (size_t d = 0; d < dirs.size(); d++) {
+            uint64_t tx;
+            ASSERT_EQ(wal_begin_tx(w, &tx), 0);
+            uint32_t inode = 10000 + (uint32_t)(d * 100 + round);
+
+            char name[32];
+            snprintf(name, sizeof(name), "f%d", round);
+            struct wal_insert_data insert = {};
+            insert.parent_idx = dirs[d];
+            insert.inode = inode;
+            insert.name_offset = string_table_intern(names, name);
+            insert.mode = S_IFREG | 0644;
+            insert.timestamp = 1;
+            ASSERT_EQ(wal_log_insert(w, tx, &insert), 0);
+
+            struct wal_write_data write = {};
+            write.node_idx = (uint32_t)(60000 + inode % 1000);
+            write.inode = inode;
+            write.new_size = inode;
+            ASSERT_EQ(wal_log_write(w, tx, &write), 0);
+            ASSERT_EQ(wal_commit_tx(w, tx), 0);
+        }
+    }
+}
+
+static std::vector<uint32_t> make_dirs(struct nary_tree_mt *t, int count) {
+    std::vector<uint32_t> dirs;
+    for (int i = 0; i < count; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "dir%d", i);
+        dirs.push_back(nary_insert_mt(t, 0, name, S_IFDIR | 0755));
+    }
+    return dirs;
+}
+
+TEST_F(RecoveryTest, ParallelRedoMatchesSerial) {
+    std::vector<uint32_t> dirs = make_dirs(&tree, 8);
+    log_directory_workload(&wal, &strings, dirs);
+
+    // Serial replay into the fixture tree
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_redone, 160u);
+
+    // Parallel replay of the same log into a fresh tree
+    struct nary_tree_mt ptree;
+    ASSERT_EQ(nary_tree_mt_init(&ptree), 0);
+    string_table_destroy(&ptree.strings);
+    ASSERT_EQ(string_table_init(&ptree.strings), 0);
+    make_dirs(&ptree, 8);
+
+    struct recovery_ctx prec;
+    ASSERT_EQ(recovery_init(&prec, &wal, &ptree, &strings), 0);
+    prec.verbose = 0;
+    prec.redo_threads = 4;
+    ASSERT_EQ(recovery_run(&prec), 0);
+    EXPECT_EQ(prec.partitions, 8u);  // One per directory
+    EXPECT_EQ(prec.ops_redone, recovery.ops_redone);
+    EXPECT_EQ(ptree.used, tree.used);
+
+    for (uint32_t inode = 10000; inode < 10800; inode++) {
+        if (inode % 100 >= 10) continue;
+        uint32_t serial_idx = UINT32_MAX, parallel_idx = UINT32_MAX;
+        for (uint32_t i = 0; i < tree.used; i++) {
+            if (tree.nodes[i].node.inode == inode) serial_idx = i;
+            if (ptree.nodes[i].node.inode == inode) parallel_idx = i;
+        }
+        ASSERT_NE(serial_idx, UINT32_MAX) << inode;
+        ASSERT_NE(parallel_idx, UINT32_MAX) << inode;
+        EXPECT_EQ(tree.nodes[serial_idx].node.size, inode);
+        EXPECT_EQ(ptree.nodes[parallel_idx].node.size, inode);
+        EXPECT_EQ(ptree.nodes[parallel_idx].node.parent_idx,
+                  tree.nodes[serial_idx].node.parent_idx);
+    }
+
+    recovery_destroy(&prec);
+    nary_tree_mt_destroy(&ptree);
+}
+
+TEST_F(RecoveryTest, SharedNodesStayInOnePartition) {
+    std::vector<uint32_t> dirs = make_dirs(&tree, 1);
+    log_directory_workload(&wal, &strings, {dirs[0], dirs[0]});
+
+    recovery.redo_threads = 4;
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.partitions, 1u);  // Same parent: serialized
+}
+
+TEST_F(RecoveryTest, UndoRollsBackAppliedInsert) {
+    // The uncommitted insert already reached the tree before the crash
+    uint32_t idx = nary_insert_mt(&tree, 0, "partial", S_IFREG | 0644);
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+    tree.nodes[idx].node.inode = 4242;
+
+    uint64_t tx;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx), 0);
+    struct wal_insert_data insert = {};
+    insert.parent_idx = 0;
+    insert.inode = 4242;
+    insert.name_offset = string_table_intern(&strings, "partial");
+    insert.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_insert(&wal, tx, &insert), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.entry_count, 2u);
+    EXPECT_EQ(recovery.ops_undone, 1u);
+    EXPECT_EQ(tree.nodes[idx].node.inode, 0u);
+}
+
+TEST_F(RecoveryTest, UntrackedOperationsAreReplayed) {
+    // tx_id 0: logged outside any transaction (as the FUSE layer does)
+    struct wal_insert_data insert = {};
+    insert.parent_idx = 0;
+    insert.inode = 5151;
+    insert.name_offset = string_table_intern(&strings, "autocommit");
+    insert.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_insert(&wal, 0, &insert), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 0u);
+    EXPECT_EQ(recovery.ops_redone, 1u);
+    EXPECT_EQ(recovery.ops_undone, 0u);
+}
+
+TEST_F(RecoveryTest, TransactionWrappedPastBufferEnd) {
+    // Fill the log up to just short of its end, then checkpoint it away
+    struct wal_write_data filler = {};
+    uint64_t filler_size = sizeof(struct wal_entry) + sizeof(filler);
+    while (wal.header->head_offset + filler_size + sizeof(struct wal_entry) <= wal.buffer_size) {
+        ASSERT_EQ(wal_log_write(&wal, 0, &filler), 0);
+    }
+    ASSERT_EQ(wal_checkpoint(&wal), 0);
+    uint64_t tail = wal.header->tail_offset;
+
+    // The transaction no longer fits before the end and continues at 0
+    uint64_t tx_id;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx_id), 0);
+    struct wal_insert_data insert = {};
+    insert.parent_idx = 0;
+    insert.inode = 100;
+    insert.name_offset = string_table_intern(&strings, "wrapped");
+    insert.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_insert(&wal, tx_id, &insert), 0);
+    ASSERT_EQ(wal_commit_tx(&wal, tx_id), 0);
+    ASSERT_LT(wal.header->head_offset, tail);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 1);
+    EXPECT_EQ(recovery.ops_redone, 1);
+    EXPECT_EQ(tree.used, 2);
+    EXPECT_EQ(tree.nodes[1].node.inode, 100);
+}
+
+// Record layouts written before WAL_VERSION_IDX32
+struct legacy_insert_data {
+    uint16_t parent_idx;
+    uint32_t inode;
+    uint32_t name_offset;
+    uint16_t mode;
+    uint64_t timestamp;
+} __attribute__((packed));
+
+struct legacy_update_data {
+    uint16_t node_idx;
+    uint32_t inode;
+    uint64_t old_size;
+    uint64_t new_size;
+    uint64_t old_mtime;
+    uint64_t new_mtime;
+    uint16_t mode;
+} __attribute__((packed));
+
+TEST_F(RecoveryTest, LegacyIndexRecordsAreWidened) {
+    wal.version = WAL_VERSION_CRC32C;
+    wal.header->version = WAL_VERSION_CRC32C;
+
+    uint64_t tx_id;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx_id), 0);
+    struct wal_insert_data insert = {};
+    insert.parent_idx = 0;
+    insert.inode = 4242;
+    insert.name_offset = string_table_intern(&strings, "legacy");
+    insert.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_insert(&wal, tx_id, &insert), 0);
+    struct wal_update_data update = {};
+    update.node_idx = 1;
+    update.inode = 4242;
+    update.new_size = 8192;
+    update.new_mtime = 77;
+    update.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_update(&wal, tx_id, &update), 0);
+    ASSERT_EQ(wal_commit_tx(&wal, tx_id), 0);
+
+    // Rewrite the records in their 16-bit layout (the tail stays padding)
+    uint64_t offset = wal.header->tail_offset;
+    while (offset < wal.header->head_offset) {
+        struct wal_entry *e = (struct wal_entry *)(wal.log_buffer + offset);
+        if (e->op_type == WAL_OP_INSERT) {
+            struct legacy_insert_data old = { 0, insert.inode, insert.name_offset,
+                                              insert.mode, insert.timestamp };
+            memset(e->data, 0, e->data_len);
+            memcpy(e->data, &old, sizeof(old));
+        } else if (e->op_type == WAL_OP_UPDATE) {
+            struct legacy_update_data old = { 1, update.inode, 0, update.new_size,
+                                              0, update.new_mtime, update.mode };
+            memset(e->data, 0, e->data_len);
+            memcpy(e->data, &old, sizeof(old));
+        }
+        e->checksum = wal_entry_checksum(&wal, e, e->data, e->data_len);
+        offset += sizeof(struct wal_entry) + e->data_len;
+    }
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_redone, 2u);
+    ASSERT_EQ(tree.used, 2u);
+    EXPECT_EQ(tree.nodes[1].node.inode, 4242u);
+    EXPECT_EQ(tree.nodes[1].node.parent_idx, 0u);
+    EXPECT_EQ(tree.nodes[1].node.size, 8192u);
+}
+
+TEST_F(RecoveryTest, RenameReplaysAsOneTransaction) {
+    // State at the last checkpoint: /d/g and /f
+    uint32_t d = nary_insert_mt(&tree, 0, "d", S_IFDIR | 0755);
+    uint32_t g = nary_insert_mt(&tree, d, "g", S_IFREG | 0644);
+    uint32_t f = nary_insert_mt(&tree, 0, "f", S_IFREG | 0644);
+    ASSERT_NE(f, NARY_INVALID_IDX);
+    uint32_t f_inode = tree.nodes[f].node.inode;
+    uint32_t g_inode = tree.nodes[g].node.inode;
+
+    // mv -f /f /d/g, as nary_rename_mt logs it
+    uint64_t tx;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx), 0);
+    struct wal_delete_data del = {};
+    del.node_idx = g;
+    del.parent_idx = d;
+    del.inode = g_inode;
+    del.name_offset = string_table_intern(&strings, "g");
+    del.mode = S_IFREG | 0644;
+    ASSERT_EQ(wal_log_delete(&wal, tx, &del), 0);
+    struct wal_rename_data ren = {};
+    ren.node_idx = f;
+    ren.inode = f_inode;
+    ren.old_parent_idx = 0;
+    ren.new_parent_idx = d;
+    ren.old_name_offset = string_table_intern(&strings, "f");
+    ren.new_name_offset = del.name_offset;
+    ren.other_idx = NARY_INVALID_IDX;
+    ASSERT_EQ(wal_log_rename(&wal, tx, &ren), 0);
+    ASSERT_EQ(wal_commit_tx(&wal, tx), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 1u);
+    EXPECT_EQ(recovery.ops_redone, 2u);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "g"), f);
+    EXPECT_EQ(nary_find_child_mt(&tree, 0, "f"), NARY_INVALID_IDX);
+    EXPECT_EQ(tree.nodes[f].node.parent_idx, d);
+    EXPECT_EQ(nary_inode_lookup_mt(&tree, g_inode), NARY_INVALID_IDX);
+
+    // Replaying the same log again changes nothing
+    recovery_destroy(&recovery);
+    ASSERT_EQ(recovery_init(&recovery, &wal, &tree, &strings), 0);
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_redone, 0u);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "g"), f);
+}
+
+TEST_F(RecoveryTest, LoggedRenameIsCommittedAndIdempotent) {
+    recovery_destroy(&recovery);
+    ASSERT_EQ(recovery_init(&recovery, &wal, &tree, &tree.strings), 0);
+
+    uint32_t a = nary_insert_mt(&tree, 0, "a", S_IFDIR | 0755);
+    uint32_t b = nary_insert_mt(&tree, 0, "b", S_IFDIR | 0755);
+    uint32_t x = nary_insert_mt(&tree, a, "x", S_IFREG | 0644);
+    uint32_t y = nary_insert_mt(&tree, b, "y", S_IFREG | 0644);
+    ASSERT_NE(y, NARY_INVALID_IDX);
+    uint32_t entries = wal.header->entry_count;
+
+    ASSERT_EQ(nary_rename_mt(&tree, x, b, "y", NARY_RENAME_EXCHANGE, NULL, &wal, 1), 0);
+    EXPECT_EQ(wal.header->entry_count, entries + 3);  // BEGIN, RENAME, COMMIT
+    EXPECT_EQ(nary_find_child_mt(&tree, b, "y"), x);
+    EXPECT_EQ(nary_find_child_mt(&tree, a, "x"), y);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 1u);
+    EXPECT_EQ(recovery.ops_skipped, 1u);
+    EXPECT_EQ(nary_find_child_mt(&tree, b, "y"), x);
+    EXPECT_EQ(nary_find_child_mt(&tree, a, "x"), y);
+}
+
+TEST_F(RecoveryTest, UncommittedRenameIsUndone) {
+    uint32_t d = nary_insert_mt(&tree, 0, "d", S_IFDIR | 0755);
+    uint32_t f = nary_insert_mt(&tree, 0, "f", S_IFREG | 0644);
+    ASSERT_NE(f, NARY_INVALID_IDX);
+
+    uint64_t tx;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx), 0);
+    struct wal_rename_data ren = {};
+    ren.node_idx = f;
+    ren.inode = tree.nodes[f].node.inode;
+    ren.old_parent_idx = 0;
+    ren.new_parent_idx = d;
+    ren.old_name_offset = string_table_intern(&strings, "f");
+    ren.new_name_offset = string_table_intern(&strings, "moved");
+    ren.other_idx = NARY_INVALID_IDX;
+    ASSERT_EQ(wal_log_rename(&wal, tx, &ren), 0);
+
+    // The move reached the tree, the commit did not reach the log
+    ASSERT_EQ(nary_rename_mt(&tree, f, d, "moved", 0, NULL, NULL, 0), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_undone, 1u);
+    EXPECT_EQ(nary_find_child_mt(&tree, 0, "f"), f);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "moved"), NARY_INVALID_IDX);
+}
+
+TEST_F(RecoveryTest, BatchInsertIsOneTransaction) {
+    recovery_destroy(&recovery);
+    ASSERT_EQ(recovery_init(&recovery, &wal, &tree, &tree.strings), 0);
+
+    uint32_t d = nary_insert_mt(&tree, 0, "d", S_IFDIR | 0755);
+    ASSERT_NE(d, NARY_INVALID_IDX);
+    uint32_t entries = wal.header->entry_count;
+
+    struct nary_batch_entry batch[3] = {
+        {"c", S_IFREG | 0644, 0}, {"a", S_IFDIR | 0755, 0}, {"b", S_IFREG | 0644, 0},
+    };
+    ASSERT_EQ(nary_insert_batch_mt(&tree, d, batch, 3, &wal, 1), 0);
+    EXPECT_EQ(wal.header->entry_count, entries + 5);  // BEGIN, 3 x INSERT, COMMIT
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 1u);
+    EXPECT_EQ(recovery.ops_skipped, 3u);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "a"), batch[1].idx);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "c"), batch[0].idx);
+}
+
+// File image rebuilt by the apply_data callback
+static int apply_to_string(void *arg, const struct wal_write_payload *record,
+                           const void *bytes) {
+    std::string *file = static_cast<std::string *>(arg);
+    const struct wal_write_data *w = &record->write;
+    switch (record->kind) {
+        case WAL_DATA_WRITE:
+            if (file->size() < w->offset + w->length) file->resize(w->offset + w->length, '\0');
+            file->replace(w->offset, w->length, static_cast<const char *>(bytes), w->length);
+            return 0;
+        case WAL_DATA_TRUNCATE:
+            file->resize(w->new_size, '\0');
+            return 0;
+        case WAL_DATA_PUNCH:
+            for (uint64_t i = w->offset; i < w->offset + w->length && i < file->size(); i++) {
+                (*file)[i] = '\0';
+            }
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static int log_payload(struct wal *wal, uint32_t inode, uint64_t offset,
+                       const std::string &bytes, uint64_t new_size, uint8_t kind) {
+    struct wal_write_data w = {};
+    w.node_idx = 1;
+    w.inode = inode;
+    w.offset = offset;
+    w.length = (uint32_t)bytes.size();
+    w.new_size = new_size;
+    return wal_log_write_payload(wal, 0, &w, kind, bytes.data());
+}
+
+TEST_F(RecoveryTest, WritePayloadsRebuildFileData) {
+    tree.used = 2;
+    tree.nodes[1].node.inode = 700;
+    tree.nodes[1].node.mode = S_IFREG | 0644;
+
+    std::string file;
+    recovery.apply_data = apply_to_string;
+    recovery.apply_arg = &file;
+
+    std::string big(5000, 'q');  // Compressed in the log
+    ASSERT_EQ(log_payload(&wal, 700, 0, big, big.size(), WAL_DATA_WRITE), 0);
+    ASSERT_EQ(log_payload(&wal, 700, 10, "hello", big.size(), WAL_DATA_WRITE), 0);
+    ASSERT_EQ(log_payload(&wal, 700, 0, std::string(4, 'x'), big.size(), WAL_DATA_PUNCH), 0);
+    ASSERT_EQ(log_payload(&wal, 700, 0, "", 4000, WAL_DATA_TRUNCATE), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.data_redone, 4u);
+
+    std::string expected(4000, 'q');
+    expected.replace(0, 4, 4, '\0');
+    expected.replace(10, 5, "hello");
+    EXPECT_EQ(file, expected);
+    EXPECT_EQ(tree.nodes[1].node.size, 4000u);
+}
+
+TEST_F(RecoveryTest, WritePayloadsOnlyGrowTheSize) {
+    tree.used = 2;
+    tree.nodes[1].node.inode = 701;
+    tree.nodes[1].node.mode = S_IFREG | 0644;
+    tree.nodes[1].node.size = 8192;
+
+    // Logged by a writer that saw an older size
+    ASSERT_EQ(log_payload(&wal, 701, 0, "abc", 3, WAL_DATA_WRITE), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_redone, 1u);
+    EXPECT_EQ(tree.nodes[1].node.size, 8192u);
+}
+
+TEST_F(RecoveryTest, WritePayloadOfRemovedFileIsSkipped) {
+    tree.used = 2;
+    tree.nodes[1].node.inode = 702;
+    tree.nodes[1].node.mode = S_IFREG | 0644;
+
+    std::string file;
+    recovery.apply_data = apply_to_string;
+    recovery.apply_arg = &file;
+
+    // Inode 703 no longer exists
+    ASSERT_EQ(log_payload(&wal, 703, 0, "gone", 4, WAL_DATA_WRITE), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.data_redone, 0u);
+    EXPECT_EQ(recovery.ops_skipped, 1u);
+    EXPECT_TRUE(file.empty());
+    EXPECT_EQ(tree.nodes[1].node.size, 0u);
+}
+
+TEST_F(RecoveryTest, FsckRepairsReplayOnce) {
+    uint32_t d = nary_insert_mt(&tree, 0, "d", S_IFDIR | 0755);
+    uint32_t x = nary_insert_mt(&tree, d, "x", S_IFREG | 0644);
+    uint32_t y = nary_insert_mt(&tree, d, "y", S_IFREG | 0644);
+    ASSERT_NE(y, NARY_INVALID_IDX);
+
+    // x lost its parent index, y its directory entry, d gained a bad child
+    tree.nodes[x].node.parent_idx = NARY_INVALID_IDX;
+    ASSERT_EQ(nary_child_remove_mt(&tree, &tree.nodes[d].node, y), 0);
+    tree.nodes[y].node.parent_idx = NARY_INVALID_IDX;
+    struct nary_node *dir = &tree.nodes[d].node;
+    dir->children[dir->num_children++] = 5000;
+
+    // As razorfsck logs them: one transaction
+    uint64_t tx;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx), 0);
+    struct wal_repair_data repairs[3] = {
+        {WAL_REPAIR_REATTACH, x, tree.nodes[x].node.inode, d, NARY_INVALID_IDX},
+        {WAL_REPAIR_REATTACH, y, tree.nodes[y].node.inode, 0, NARY_INVALID_IDX},
+        {WAL_REPAIR_UNLINK, NARY_INVALID_IDX, 0, d, 5000},
+    };
+    for (const auto &repair : repairs) {
+        ASSERT_EQ(wal_log_repair(&wal, tx, &repair), 0);
+    }
+    ASSERT_EQ(wal_commit_tx(&wal, tx), 0);
+
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.tx_count, 1u);
+    EXPECT_EQ(recovery.ops_redone, 3u);
+    EXPECT_EQ(tree.nodes[x].node.parent_idx, d);
+    EXPECT_EQ(nary_find_child_mt(&tree, d, "x"), x);   // Not listed twice
+    EXPECT_EQ(tree.nodes[d].node.num_children, 1u);
+    EXPECT_EQ(tree.nodes[y].node.parent_idx, 0u);
+    EXPECT_EQ(nary_find_child_mt(&tree, 0, "y"), y);
+
+    // Already in place: replaying again changes nothing
+    recovery_destroy(&recovery);
+    ASSERT_EQ(recovery_init(&recovery, &wal, &tree, &strings), 0);
+    ASSERT_EQ(recovery_run(&recovery), 0);
+    EXPECT_EQ(recovery.ops_redone, 0u);
+    EXPECT_EQ(recovery.ops_skipped, 3u);
+    EXPECT_EQ(tree.nodes[0].node.num_children, 2u);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -9,6 +9,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <cstring>
+#include <string>
+#include <vector>
 
 extern "C" {
 #include "shm_persist.h"
@@ -58,7 +61,7 @@ TEST_F(ShmPersistTest, CreateAndDetach) {
 
     ASSERT_EQ(shm_tree_init(tree), 0);
 
-    uint16_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, "test.txt",
+    uint32_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, "test.txt",
                                   S_IFREG | 0644);
     EXPECT_NE(idx, NARY_INVALID_IDX);
 
@@ -73,9 +76,9 @@ TEST_F(ShmPersistTest, CreateDetachReattach) {
     ASSERT_NE(tree, nullptr);
     ASSERT_EQ(shm_tree_init(tree), 0);
 
-    uint16_t file1 = nary_insert_mt(tree, NARY_ROOT_IDX, "persistent1.txt",
+    uint32_t file1 = nary_insert_mt(tree, NARY_ROOT_IDX, "persistent1.txt",
                                     S_IFREG | 0644);
-    uint16_t file2 = nary_insert_mt(tree, NARY_ROOT_IDX, "persistent2.txt",
+    uint32_t file2 = nary_insert_mt(tree, NARY_ROOT_IDX, "persistent2.txt",
                                     S_IFREG | 0644);
 
     ASSERT_NE(file1, NARY_INVALID_IDX);
@@ -97,8 +100,8 @@ TEST_F(ShmPersistTest, CreateDetachReattach) {
     EXPECT_EQ(tree->used, saved_used);
 
     // Verify files exist and have correct names
-    uint16_t found1 = nary_find_child_mt(tree, NARY_ROOT_IDX, "persistent1.txt");
-    uint16_t found2 = nary_find_child_mt(tree, NARY_ROOT_IDX, "persistent2.txt");
+    uint32_t found1 = nary_find_child_mt(tree, NARY_ROOT_IDX, "persistent1.txt");
+    uint32_t found2 = nary_find_child_mt(tree, NARY_ROOT_IDX, "persistent2.txt");
 
     EXPECT_EQ(found1, file1);
     EXPECT_EQ(found2, file2);
@@ -117,7 +120,7 @@ TEST_F(ShmPersistTest, StringTablePersistence) {
         "music.mp3"
     };
 
-    uint16_t indices[4];
+    uint32_t indices[4];
     for (int i = 0; i < 4; i++) {
         indices[i] = nary_insert_mt(tree, NARY_ROOT_IDX, test_names[i],
                                     S_IFREG | 0644);
@@ -136,26 +139,93 @@ TEST_F(ShmPersistTest, StringTablePersistence) {
 
     // Verify all filenames persisted correctly
     for (int i = 0; i < 4; i++) {
-        uint16_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, test_names[i]);
+        uint32_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, test_names[i]);
         EXPECT_EQ(found, indices[i]) << "Failed for: " << test_names[i];
     }
 }
 
+TEST_F(ShmPersistTest, ReattachCountsNameReferences) {
+    tree = (struct nary_tree_mt*)malloc(sizeof(struct nary_tree_mt));
+    ASSERT_NE(tree, nullptr);
+    ASSERT_EQ(shm_tree_init(tree), 0);
+
+    ASSERT_NE(nary_insert_mt(tree, NARY_ROOT_IDX, "keep", S_IFREG | 0644), NARY_INVALID_IDX);
+    uint32_t gone = nary_insert_mt(tree, NARY_ROOT_IDX, "gone", S_IFREG | 0644);
+    ASSERT_NE(gone, NARY_INVALID_IDX);
+    uint32_t gone_name = tree->nodes[gone].node.name_offset;
+    ASSERT_EQ(nary_delete_mt(tree, gone, NULL, 0), 0);
+    EXPECT_EQ(tree->strings.unreferenced_bytes, 5u);
+
+    shm_tree_detach(tree);
+    free(tree);
+    tree = (struct nary_tree_mt*)malloc(sizeof(struct nary_tree_mt));
+    ASSERT_NE(tree, nullptr);
+    ASSERT_EQ(shm_tree_init(tree), 0);
+
+    // Only the deleted name has no user after counting
+    EXPECT_EQ(tree->strings.unreferenced_bytes, 5u);
+    EXPECT_EQ(string_table_reclaim(&tree->strings), 5u);
+    uint32_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, "next", S_IFREG | 0644);
+    ASSERT_NE(idx, NARY_INVALID_IDX);
+    EXPECT_EQ(tree->nodes[idx].node.name_offset, gone_name);
+    EXPECT_NE(nary_find_child_mt(tree, NARY_ROOT_IDX, "keep"), NARY_INVALID_IDX);
+    EXPECT_EQ(nary_find_child_mt(tree, NARY_ROOT_IDX, "gone"), NARY_INVALID_IDX);
+}
+
+TEST_F(ShmPersistTest, StringTableSavesIncrementally) {
+    const char *path = "/tmp/razorfs_strings_incremental_test.dat";
+    unlink(path);
+
+    struct string_table st;
+    memset(&st, 0, sizeof(st));
+    ASSERT_EQ(string_table_init(&st), 0);
+    string_table_intern(&st, "first");
+    ASSERT_EQ(disk_string_table_save(&st, path), 0);
+
+    // Each save adds just the new names to the file
+    for (int i = 0; i < 20; i++) {
+        std::string name = "name_" + std::to_string(i);
+        string_table_intern(&st, name.c_str());
+        ASSERT_EQ(disk_string_table_save(&st, path), 0);
+
+        struct stat sb;
+        ASSERT_EQ(stat(path, &sb), 0);
+        EXPECT_EQ((uint32_t)sb.st_size, sizeof(uint32_t) + st.used);
+    }
+
+    // The file is rewritten when it is not the one saved last
+    ASSERT_EQ(truncate(path, 2), 0);
+    string_table_intern(&st, "after_truncate");
+    ASSERT_EQ(disk_string_table_save(&st, path), 0);
+
+    struct string_table loaded;
+    memset(&loaded, 0, sizeof(loaded));
+    ASSERT_EQ(string_table_init(&loaded), 0);
+    ASSERT_EQ(disk_string_table_load(&loaded, path), 0);
+    EXPECT_EQ(loaded.used, st.used);
+    EXPECT_EQ(memcmp(loaded.data, st.data, st.used), 0);
+    EXPECT_EQ(loaded.persisted, loaded.used);
+
+    string_table_destroy(&loaded);
+    string_table_destroy(&st);
+    unlink(path);
+}
+
 TEST_F(ShmPersistTest, DirectoryHierarchyPersistence) {
     // Create nested structure
     tree = (struct nary_tree_mt*)malloc(sizeof(struct nary_tree_mt));
     ASSERT_NE(tree, nullptr);
     ASSERT_EQ(shm_tree_init(tree), 0);
 
-    uint16_t dir1 = nary_insert_mt(tree, NARY_ROOT_IDX, "documents",
+    uint32_t dir1 = nary_insert_mt(tree, NARY_ROOT_IDX, "documents",
                                    S_IFDIR | 0755);
     ASSERT_NE(dir1, NARY_INVALID_IDX);
 
-    uint16_t dir2 = nary_insert_mt(tree, dir1, "work",
+    uint32_t dir2 = nary_insert_mt(tree, dir1, "work",
                                    S_IFDIR | 0755);
     ASSERT_NE(dir2, NARY_INVALID_IDX);
 
-    uint16_t file1 = nary_insert_mt(tree, dir2, "report.pdf",
+    uint32_t file1 = nary_insert_mt(tree, dir2, "report.pdf",
                                     S_IFREG | 0644);
     ASSERT_NE(file1, NARY_INVALID_IDX);
 
@@ -167,13 +237,13 @@ TEST_F(ShmPersistTest, DirectoryHierarchyPersistence) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     // Verify hierarchy
-    uint16_t found_dir1 = nary_find_child_mt(tree, NARY_ROOT_IDX, "documents");
+    uint32_t found_dir1 = nary_find_child_mt(tree, NARY_ROOT_IDX, "documents");
     ASSERT_NE(found_dir1, NARY_INVALID_IDX);
 
-    uint16_t found_dir2 = nary_find_child_mt(tree, found_dir1, "work");
+    uint32_t found_dir2 = nary_find_child_mt(tree, found_dir1, "work");
     ASSERT_NE(found_dir2, NARY_INVALID_IDX);
 
-    uint16_t found_file = nary_find_child_mt(tree, found_dir2, "report.pdf");
+    uint32_t found_file = nary_find_child_mt(tree, found_dir2, "report.pdf");
     EXPECT_EQ(found_file, file1);
 }
 
@@ -187,7 +257,7 @@ TEST_F(ShmPersistTest, FileMetadataPersistence) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     mode_t mode = S_IFREG | 0600;
-    uint16_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, "secret.txt", mode);
+    uint32_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, "secret.txt", mode);
     ASSERT_NE(idx, NARY_INVALID_IDX);
 
     struct nary_node_mt *node = &tree->nodes[idx];
@@ -202,7 +272,7 @@ TEST_F(ShmPersistTest, FileMetadataPersistence) {
     ASSERT_EQ(shm_tree_init(tree), 0);
 
     // Verify metadata
-    uint16_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, "secret.txt");
+    uint32_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, "secret.txt");
     ASSERT_NE(found, NARY_INVALID_IDX);
 
     node = &tree->nodes[found];
@@ -238,10 +308,120 @@ TEST_F(ShmPersistTest, Cleanup) {
     // Should be empty (just root)
     EXPECT_EQ(tree->used, 1u);
 
-    uint16_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, "temp.txt");
+    uint32_t found = nary_find_child_mt(tree, NARY_ROOT_IDX, "temp.txt");
     EXPECT_EQ(found, NARY_INVALID_IDX);
 }
 
+// ============================================================================
+// Format Migration Tests
+// ============================================================================
+
+TEST_F(ShmPersistTest, MigratesVersion1Image) {
+    // Intern the names in a fresh string table region
+    tree = (struct nary_tree_mt*)malloc(sizeof(struct nary_tree_mt));
+    ASSERT_NE(tree, nullptr);
+    ASSERT_EQ(shm_tree_init(tree), 0);
+
+    uint32_t root_name = tree->nodes[NARY_ROOT_IDX].node.name_offset;
+    uint32_t names[10];
+    for (int i = 0; i < 10; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%d", i);
+        uint32_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, name, S_IFREG | 0644);
+        ASSERT_NE(idx, NARY_INVALID_IDX);
+        names[i] = tree->nodes[idx].node.name_offset;
+    }
+    shm_tree_detach(tree);
+
+    // Replace the nodes with a version 1 image: root plus 10 files, whose
+    // 16-bit children don't fit inline any more
+    struct {
+        uint32_t magic, version, capacity, used, next_inode, free_count;
+    } hdr = { SHM_MAGIC, SHM_VERSION_V1, 1024, 11, 12, 0 };
+    std::vector<uint8_t> image(sizeof(hdr) + 1024 * 128 + 1024 * sizeof(uint16_t));
+    memcpy(image.data(), &hdr, sizeof(hdr));
+
+    for (uint32_t i = 0; i < 11; i++) {
+        uint8_t *n = image.data() + sizeof(hdr) + i * 128;
+        uint32_t inode = i + 1;
+        uint32_t parent = i == 0 ? 0xFFFF : 0;
+        uint16_t num_children = i == 0 ? 10 : 0;
+        uint16_t mode = i == 0 ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+        uint32_t name = i == 0 ? root_name : names[i - 1];
+        memcpy(n, &inode, 4);
+        memcpy(n + 4, &parent, 4);
+        memcpy(n + 8, &num_children, 2);
+        memcpy(n + 10, &mode, 2);
+        memcpy(n + 12, &name, 4);
+        for (uint16_t c = 0; c < 16; c++) {
+            uint16_t child = (i == 0 && c < 10) ? (uint16_t)(c + 1) : 0xFFFF;
+            memcpy(n + 16 + c * 2, &child, 2);
+        }
+    }
+
+    shm_unlink("/razorfs_nodes");
+    int fd = shm_open("/razorfs_nodes", O_RDWR | O_CREAT, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, image.data(), image.size()), (ssize_t)image.size());
+    close(fd);
+
+    memset(tree, 0, sizeof(*tree));
+    ASSERT_EQ(shm_tree_init(tree), 0);
+
+    EXPECT_EQ(tree->capacity, SHM_TREE_CAPACITY);
+    EXPECT_EQ(tree->used, 11u);
+    EXPECT_EQ(tree->next_inode, 12u);
+    EXPECT_EQ(tree->nodes[NARY_ROOT_IDX].node.parent_idx, NARY_INVALID_IDX);
+    EXPECT_EQ(tree->nodes[NARY_ROOT_IDX].node.num_children, 10);
+    EXPECT_EQ(tree->block_used, 1u);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%u", i);
+        EXPECT_EQ(nary_find_child_mt(tree, NARY_ROOT_IDX, name), i + 1) << name;
+    }
+
+    // The migrated tree keeps working
+    EXPECT_NE(nary_insert_mt(tree, NARY_ROOT_IDX, "f10", S_IFREG | 0644), NARY_INVALID_IDX);
+    EXPECT_EQ(tree->nodes[NARY_ROOT_IDX].node.num_children, 11);
+}
+
+TEST_F(ShmPersistTest, MapsImageWithoutAttaching) {
+    tree = (struct nary_tree_mt*)malloc(sizeof(struct nary_tree_mt));
+    ASSERT_NE(tree, nullptr);
+    ASSERT_EQ(shm_tree_init(tree), 0);
+    uint32_t dir = nary_insert_mt(tree, NARY_ROOT_IDX, "dir", S_IFDIR | 0755);
+    uint32_t file = nary_insert_mt(tree, dir, "file", S_IFREG | 0644);
+    ASSERT_NE(file, NARY_INVALID_IDX);
+    uint32_t inode = tree->nodes[file].node.inode;
+
+    // The image as razorfsck sees it, next to the attached tree
+    struct nary_tree_mt image;
+    ASSERT_EQ(disk_tree_map(&image, "/dev/shm/razorfs_nodes", 0), 0);
+    EXPECT_EQ(image.capacity, tree->capacity);
+    EXPECT_EQ(image.nodes[file].node.inode, inode);
+    EXPECT_EQ(image.nodes[file].node.parent_idx, dir);
+    EXPECT_EQ(image.nodes[dir].node.num_children, 1);
+    EXPECT_EQ(image.nodes[dir].node.children[0], file);
+    EXPECT_EQ(image.block_fp, nullptr);
+
+    // Shared: later changes of the mount show through
+    uint32_t other = nary_insert_mt(tree, dir, "other", S_IFREG | 0644);
+    ASSERT_NE(other, NARY_INVALID_IDX);
+    EXPECT_EQ(image.nodes[dir].node.num_children, 2);
+    disk_tree_unmap(&image);
+
+    // Anything but a tree image is refused
+    const char *junk = "/tmp/razorfs_not_an_image.dat";
+    int fd = open(junk, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, "not a tree image", 16), 16);
+    close(fd);
+    EXPECT_NE(disk_tree_map(&image, junk, 0), 0);
+    EXPECT_NE(disk_tree_map(&image, "/tmp/razorfs_missing_image.dat", 0), 0);
+    unlink(junk);
+}
+
 // ============================================================================
 // Error Handling Tests
 // ============================================================================
@@ -336,11 +516,42 @@ TEST_F(ShmPersistTest, DiskFileDataOperations) {
     disk_file_data_remove(200);
 }
 
+TEST_F(ShmPersistTest, PerInodeImageMovesIntoDataLog) {
+    const char *test_data = "Written before the data log";
+    size_t data_size = strlen(test_data);
+    disk_file_data_remove(201);
+    ASSERT_EQ(disk_file_data_save(201, test_data, data_size, data_size, 0), 0);
+
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+    ASSERT_EQ(disk_file_extents_restore(201, &es), 0);
+    EXPECT_FALSE(extent_store_is_dirty(&es));
+    extent_store_destroy(&es);
+
+    // The old image is gone; the log serves it from now on
+    void *restored_data = nullptr;
+    size_t restored_size = 0;
+    EXPECT_NE(disk_file_data_restore(201, &restored_data, &restored_size, nullptr, nullptr), 0);
+
+    ASSERT_EQ(extent_store_init(&es), 0);
+    ASSERT_EQ(disk_file_extents_restore(201, &es), 0);
+    ASSERT_EQ(es.size, data_size);
+    std::vector<char> out(data_size);
+    ASSERT_EQ(extent_store_read(&es, out.data(), out.size(), 0), (ssize_t)data_size);
+    EXPECT_EQ(std::string(out.begin(), out.end()), test_data);
+    extent_store_destroy(&es);
+
+    disk_file_data_remove(201);
+    ASSERT_EQ(extent_store_init(&es), 0);
+    EXPECT_NE(disk_file_extents_restore(201, &es), 0);
+    extent_store_destroy(&es);
+}
+
 // ============================================================================
 // Stress Tests
 // ============================================================================
 
-TEST_F(ShmPersistTest, DISABLED_ManyFilesAcrossRemounts) {  // File persistence bug: only 16/250 files persisted across remounts
+TEST_F(ShmPersistTest, ManyFilesAcrossRemounts) {
     const int BATCH_SIZE = 50;
     const int NUM_REMOUNTS = 5;
 
@@ -356,7 +567,7 @@ TEST_F(ShmPersistTest, DISABLED_ManyFilesAcrossRemounts) {  // File persistence
             char name[64];
             snprintf(name, sizeof(name), "remount%d_file%d.txt", remount, i);
 
-            uint16_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, name,
+            uint32_t idx = nary_insert_mt(tree, NARY_ROOT_IDX, name,
                                           S_IFREG | 0644);
             if (idx != NARY_INVALID_IDX) {
                 all_files.push_back(name);
@@ -372,7 +583,7 @@ TEST_F(ShmPersistTest, DISABLED_ManyFilesAcrossRemounts) {  // File persistence
 
         // Verify all files from all previous remounts
         for (const auto& filename : all_files) {
-            uint16_t found = nary_find_child_mt(tree, NARY_ROOT_IDX,
+            uint32_t found = nary_find_child_mt(tree, NARY_ROOT_IDX,
                                                 filename.c_str());
             EXPECT_NE(found, NARY_INVALID_IDX) << "Missing: " << filename;
         }
@@ -9,6 +9,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <cstring>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include "string_table.h"
@@ -204,6 +208,186 @@ TEST_F(StringTableShmTest, ShmNoRealloc) {
     EXPECT_TRUE(offset == UINT32_MAX || st.used <= st.capacity);
 }
 
+TEST_F(StringTableShmTest, AttachKeepsDeduplicating) {
+    ASSERT_EQ(string_table_init_shm(&st, shm_buffer, shm_size, 0), 0);
+    uint32_t off = string_table_intern(&st, "shared");
+    ASSERT_NE(off, UINT32_MAX);
+    string_table_destroy(&st);
+
+    ASSERT_EQ(string_table_init_shm(&st, shm_buffer, shm_size, 1), 0);
+    EXPECT_EQ(string_table_intern(&st, "shared"), off);
+    EXPECT_EQ(st.unreferenced_bytes, 0u);
+}
+
+// ============================================================================
+// References and Reclamation
+// ============================================================================
+
+TEST_F(StringTableTest, UnreferencedNamesStayInterned) {
+    ASSERT_EQ(string_table_init(&st), 0);
+
+    uint32_t off = string_table_intern(&st, "a");
+    ASSERT_EQ(string_table_intern(&st, "a"), off);
+    string_table_release(&st, off);
+    EXPECT_EQ(st.unreferenced_bytes, 0u);
+    string_table_release(&st, off);
+    EXPECT_EQ(st.unreferenced_bytes, 2u);
+
+    // Found again until reclaimed
+    EXPECT_EQ(string_table_intern(&st, "a"), off);
+    EXPECT_EQ(st.unreferenced_bytes, 0u);
+    EXPECT_EQ(string_table_reclaim(&st), 0u);
+
+    EXPECT_EQ(string_table_ref(&st, off + 1), -1);  // Not the start of a name
+    EXPECT_EQ(string_table_ref(&st, off), 0);
+}
+
+TEST_F(StringTableTest, ReclaimedSpaceIsReused) {
+    ASSERT_EQ(string_table_init(&st), 0);
+
+    uint32_t keep = string_table_intern(&st, "keep");
+    uint32_t gone = string_table_intern(&st, "abcdef");
+    string_table_release(&st, gone);
+    uint32_t used = st.used;
+
+    EXPECT_EQ(string_table_reclaim(&st), 7u);
+    EXPECT_EQ(st.free_bytes, 7u);
+    EXPECT_EQ(st.unreferenced_bytes, 0u);
+
+    // Smaller names take the front, the rest stays available
+    EXPECT_EQ(string_table_intern(&st, "xy"), gone);
+    EXPECT_STREQ(string_table_get(&st, gone), "xy");
+    EXPECT_EQ(st.free_bytes, 4u);
+    EXPECT_EQ(string_table_intern(&st, "pqr"), gone + 3);
+    EXPECT_EQ(st.free_bytes, 0u);
+    EXPECT_EQ(st.used, used);
+
+    // The reclaimed name is gone, the kept one untouched
+    uint32_t again = string_table_intern(&st, "abcdef");
+    EXPECT_EQ(again, used);
+    EXPECT_STREQ(string_table_get(&st, keep), "keep");
+}
+
+TEST_F(StringTableTest, GrowsWithoutMoving) {
+    ASSERT_EQ(string_table_init(&st), 0);
+    const char *base = st.data;
+    uint32_t initial = st.capacity;
+
+    std::vector<uint32_t> offsets;
+    for (int i = 0; st.used < 3 * initial; i++) {
+        offsets.push_back(string_table_intern(&st, ("grow_" + std::to_string(i)).c_str()));
+        ASSERT_NE(offsets.back(), UINT32_MAX);
+    }
+    EXPECT_EQ(st.data, base);
+    EXPECT_GT(st.capacity, initial);
+
+    for (size_t i = 0; i < offsets.size(); i++) {
+        std::string name = "grow_" + std::to_string(i);
+        EXPECT_STREQ(string_table_get(&st, offsets[i]), name.c_str());
+        EXPECT_EQ(string_table_intern(&st, name.c_str()), offsets[i]);
+    }
+}
+
+TEST_F(StringTableTest, LoadIndexesSavedStrings) {
+    ASSERT_EQ(string_table_init(&st), 0);
+    uint32_t a = string_table_intern(&st, "alpha");
+    uint32_t b = string_table_intern(&st, "beta");
+    std::string saved(st.data, st.used);
+
+    struct string_table copy;
+    memset(&copy, 0, sizeof(copy));
+    ASSERT_EQ(string_table_init(&copy), 0);
+    string_table_intern(&copy, "discarded");
+    ASSERT_EQ(string_table_load(&copy, saved.data(), (uint32_t)saved.size()), 0);
+
+    EXPECT_EQ(copy.used, st.used);
+    EXPECT_EQ(string_table_intern(&copy, "beta"), b);
+    EXPECT_STREQ(string_table_get(&copy, a), "alpha");
+    // Loaded names count no users until referenced
+    EXPECT_EQ(copy.unreferenced_bytes, 6u);
+    EXPECT_EQ(string_table_ref(&copy, a), 0);
+    EXPECT_EQ(copy.unreferenced_bytes, 0u);
+    string_table_destroy(&copy);
+}
+
+static int record_write(void *ctx, uint32_t offset, const char *data, uint32_t size) {
+    auto *writes = static_cast<std::vector<std::pair<uint32_t, std::string>> *>(ctx);
+    writes->emplace_back(offset, std::string(data, size));
+    return 0;
+}
+
+TEST_F(StringTableTest, FlushWritesOnlyChanges) {
+    ASSERT_EQ(string_table_init(&st), 0);
+    std::vector<std::pair<uint32_t, std::string>> writes;
+    uint32_t used = 0;
+
+    uint32_t a = string_table_intern(&st, "alpha");
+    ASSERT_EQ(string_table_flush(&st, 0, record_write, &writes, &used), 0);
+    ASSERT_EQ(writes.size(), 1u);
+    EXPECT_EQ(writes[0].first, a);
+    EXPECT_EQ(writes[0].second, std::string("alpha", 6));
+    EXPECT_EQ(used, st.used);
+
+    // Nothing new, nothing written
+    writes.clear();
+    ASSERT_EQ(string_table_flush(&st, 0, record_write, &writes, &used), 0);
+    EXPECT_TRUE(writes.empty());
+
+    // Appended names go out from the previous watermark
+    uint32_t b = string_table_intern(&st, "beta");
+    string_table_intern(&st, "gamma");
+    ASSERT_EQ(string_table_flush(&st, 0, record_write, &writes, &used), 0);
+    ASSERT_EQ(writes.size(), 1u);
+    EXPECT_EQ(writes[0].first, b);
+    EXPECT_EQ(writes[0].second, std::string("beta\0gamma", 11));
+
+    // Reused space below the watermark is written where it lies
+    string_table_release(&st, b);
+    ASSERT_EQ(string_table_reclaim(&st), 5u);
+    EXPECT_EQ(string_table_intern(&st, "xyz"), b);
+    writes.clear();
+    ASSERT_EQ(string_table_flush(&st, 0, record_write, &writes, &used), 0);
+    ASSERT_EQ(writes.size(), 1u);
+    EXPECT_EQ(writes[0].first, b);
+    EXPECT_EQ(writes[0].second, std::string("xyz", 4));
+
+    // A full flush rewrites everything
+    writes.clear();
+    ASSERT_EQ(string_table_flush(&st, 1, record_write, &writes, &used), 0);
+    ASSERT_EQ(writes.size(), 1u);
+    EXPECT_EQ(writes[0].first, 0u);
+    EXPECT_EQ(writes[0].second, std::string(st.data, st.used));
+}
+
+TEST_F(StringTableTest, ConcurrentInternDeduplicates) {
+    ASSERT_EQ(string_table_init(&st), 0);
+
+    const int threads = 8, names = 2000;
+    std::vector<std::vector<uint32_t>> seen(threads, std::vector<uint32_t>(names));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([this, t, &seen]() {
+            for (int i = 0; i < names; i++) {
+                int n = (i + t * 131) % names;  // Different orders, same names
+                std::string name = "name_" + std::to_string(n);
+                uint32_t off = string_table_intern(&st, name.c_str());
+                ASSERT_NE(off, UINT32_MAX);
+                ASSERT_STREQ(string_table_get(&st, off), name.c_str());
+                seen[t][n] = off;
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    for (int t = 1; t < threads; t++) {
+        EXPECT_EQ(seen[t], seen[0]);
+    }
+    for (int i = 0; i < names; i++) {
+        for (int t = 0; t < threads; t++) string_table_release(&st, seen[0][i]);
+    }
+    EXPECT_EQ(st.unreferenced_bytes, st.used);
+}
+
 // ============================================================================
 // Error Handling Tests
 // ============================================================================
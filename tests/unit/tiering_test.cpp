@@ -0,0 +1,289 @@
+/**
+ * Tiering Unit Tests
+ * Tests for offloading cold files from the data log to a storage tier
+ */
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "tiering.h"
+#include "data_log.h"
+}
+
+static const char *LOG_PATH = "/tmp/razorfs_tiering_test.log";
+static const char *TIER_DIR = "/tmp/razorfs_tiering_test_objects";
+static const char *CACHE_DIR = "/tmp/razorfs_tiering_test_cache";
+
+static int append(struct data_log *log, uint32_t inode, uint64_t size,
+                  const std::vector<std::string> &chunks) {
+    std::vector<struct data_log_put> puts;
+    for (uint32_t i = 0; i < chunks.size(); i++) {
+        puts.push_back({i, (uint32_t)chunks[i].size(), (uint32_t)chunks[i].size(),
+                        chunks[i].data(), 0, 0});
+    }
+    return data_log_append(log, inode, size, (uint32_t)puts.size(), puts.data(),
+                           (uint32_t)puts.size());
+}
+
+static bool object_exists(uint32_t inode) {
+    char key[TIER_KEY_MAX];
+    tier_object_key(inode, key, sizeof(key));
+    std::string path = std::string(TIER_DIR) + "/" + key;
+    return access(path.c_str(), F_OK) == 0;
+}
+
+static void remove_dir(const char *dir) {
+    std::string cmd = std::string("rm -rf ") + dir;
+    ASSERT_EQ(system(cmd.c_str()), 0);
+}
+
+static int no_chunk(void *, uint32_t, const char *, uint32_t, uint32_t) {
+    ADD_FAILURE() << "remote chunk handed out as local";
+    return -1;
+}
+
+// Files listed here are cold
+static int cold_set(void *ctx, uint32_t inode, time_t) {
+    return static_cast<std::set<uint32_t> *>(ctx)->count(inode) ? 1 : 0;
+}
+
+// Directory backend that lets a write land while an object is uploading
+struct RacingBackend {
+    struct tier_backend dir;
+    struct data_log *log;
+    uint32_t inode;
+    std::string rewrite;
+};
+
+static int racing_put(void *ctx, const char *key, const void *data, size_t size) {
+    RacingBackend *r = static_cast<RacingBackend *>(ctx);
+    struct data_log_put put = {1, (uint32_t)r->rewrite.size(), (uint32_t)r->rewrite.size(),
+                               r->rewrite.data(), 0, 0};
+    EXPECT_EQ(data_log_append(r->log, r->inode, 2 * 65536, 2, &put, 1), 0);
+    return r->dir.put(r->dir.ctx, key, data, size);
+}
+
+static int racing_get(void *ctx, const char *key, void **data_out, size_t *size_out) {
+    RacingBackend *r = static_cast<RacingBackend *>(ctx);
+    return r->dir.get(r->dir.ctx, key, data_out, size_out);
+}
+
+static int racing_remove(void *ctx, const char *key) {
+    RacingBackend *r = static_cast<RacingBackend *>(ctx);
+    return r->dir.remove(r->dir.ctx, key);
+}
+
+// Directory backend that deletes in batches and counts them
+struct BatchingBackend {
+    struct tier_backend dir;
+    int batches;
+    size_t keys;
+};
+
+static int batching_put(void *ctx, const char *key, const void *data, size_t size) {
+    BatchingBackend *b = static_cast<BatchingBackend *>(ctx);
+    return b->dir.put(b->dir.ctx, key, data, size);
+}
+
+static int batching_remove(void *ctx, const char *key) {
+    BatchingBackend *b = static_cast<BatchingBackend *>(ctx);
+    return b->dir.remove(b->dir.ctx, key);
+}
+
+static int batching_remove_many(void *ctx, const char *const *keys, size_t count) {
+    BatchingBackend *b = static_cast<BatchingBackend *>(ctx);
+    b->batches++;
+    b->keys += count;
+    for (size_t i = 0; i < count; i++) b->dir.remove(b->dir.ctx, keys[i]);
+    return 0;
+}
+
+class TieringTest : public ::testing::Test {
+protected:
+    struct data_log log;
+    struct tier tier;
+    std::set<uint32_t> cold;
+    bool tier_up = false;
+
+    void SetUp() override {
+        unlink(LOG_PATH);
+        remove_dir(TIER_DIR);
+        remove_dir(CACHE_DIR);
+        ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+    }
+
+    void TearDown() override {
+        if (tier_up) tier_destroy(&tier);
+        data_log_close(&log);
+        unlink(LOG_PATH);
+        std::string tmp = std::string(LOG_PATH) + ".tmp";
+        unlink(tmp.c_str());
+        remove_dir(TIER_DIR);
+        remove_dir(CACHE_DIR);
+    }
+
+    void start(const struct tier_backend *backend = nullptr, uint64_t min_bytes = 0) {
+        struct tier_backend dir;
+        if (!backend) {
+            ASSERT_EQ(tier_backend_dir(&dir, TIER_DIR), 0);
+            backend = &dir;
+        }
+        struct tier_config cfg = {};
+        cfg.cold_s = 0;
+        cfg.scan_ms = 0;  // Scans are driven by the tests
+        cfg.min_bytes = min_bytes;
+        cfg.cache_dir = CACHE_DIR;
+        cfg.cache_bytes = 1 << 20;
+        ASSERT_EQ(tier_init(&tier, &cfg, backend, &log, cold_set, &cold), 0);
+        tier_up = true;
+    }
+
+    std::string read_chunk(uint32_t inode, uint32_t idx) {
+        struct data_log_chunk_ref ref;
+        EXPECT_EQ(data_log_lookup(&log, inode, idx, &ref), 0);
+        EXPECT_TRUE(ref.flags & DATA_LOG_CHUNK_REMOTE);
+        std::string buf(ref.stored_size, '\0');
+        EXPECT_EQ(tier_read(&tier, inode, ref.offset, ref.stored_size, &buf[0]), 0);
+        return buf;
+    }
+};
+
+TEST_F(TieringTest, OffloadMakesChunksRemote) {
+    start();
+    ASSERT_EQ(append(&log, 7, 2 * 65536, {"first", "second"}), 0);
+    uint64_t live = log.live_bytes;
+
+    EXPECT_EQ(tier_offload(&tier, 7), 2);
+    EXPECT_TRUE(object_exists(7));
+    EXPECT_TRUE(data_log_has_remote(&log, 7));
+    EXPECT_EQ(log.live_bytes, live - 11);
+
+    // The payload is no longer in the log; the tier serves it
+    char buf[16];
+    EXPECT_EQ(data_log_restore_chunk(&log, 7, 0, no_chunk, nullptr), 2);
+    EXPECT_EQ(read_chunk(7, 0), "first");
+    EXPECT_EQ(read_chunk(7, 1), "second");
+
+    // Fetched once, then read from the cache
+    struct tier_stats stats;
+    tier_get_stats(&tier, &stats);
+    EXPECT_EQ(stats.offloaded_files, 1u);
+    EXPECT_EQ(stats.offloaded_bytes, 11u);
+    EXPECT_EQ(stats.fetches, 1u);
+    EXPECT_EQ(stats.cache_hits, 1u);
+
+    // Out of range reads fail instead of returning header bytes
+    EXPECT_NE(tier_read(&tier, 7, 0, 4, buf), 0);
+
+    // Offloading again finds nothing local
+    EXPECT_EQ(tier_offload(&tier, 7), 0);
+}
+
+TEST_F(TieringTest, RemoteRefsSurviveReopenAndRewrite) {
+    start();
+    ASSERT_EQ(append(&log, 3, 2 * 65536, {"aaaa", "bbbb"}), 0);
+    ASSERT_EQ(tier_offload(&tier, 3), 2);
+
+    // Rewriting a chunk brings just that one back
+    struct data_log_put put = {0, 4, 4, "AAAA", 0, 0};
+    ASSERT_EQ(data_log_append(&log, 3, 2 * 65536, 2, &put, 1), 0);
+
+    data_log_close(&log);
+    ASSERT_EQ(data_log_open(&log, LOG_PATH), 0);
+
+    struct data_log_chunk_ref ref;
+    ASSERT_EQ(data_log_lookup(&log, 3, 0, &ref), 0);
+    EXPECT_EQ(ref.flags, 0u);
+    EXPECT_EQ(read_chunk(3, 1), "bbbb");
+}
+
+TEST_F(TieringTest, WriteDuringUploadStaysLocal) {
+    RacingBackend racing;
+    ASSERT_EQ(tier_backend_dir(&racing.dir, TIER_DIR), 0);
+    racing.log = &log;
+    racing.inode = 5;
+    racing.rewrite = "new";
+    struct tier_backend backend = {racing_put, racing_get, racing_remove, nullptr,
+                                     nullptr, &racing};
+    start(&backend);
+
+    ASSERT_EQ(append(&log, 5, 2 * 65536, {"old0", "old1"}), 0);
+    EXPECT_EQ(tier_offload(&tier, 5), 1);
+
+    struct data_log_chunk_ref ref;
+    ASSERT_EQ(data_log_lookup(&log, 5, 1, &ref), 0);
+    EXPECT_EQ(ref.flags, 0u);
+    EXPECT_EQ(read_chunk(5, 0), "old0");
+
+    tier_destroy(&tier);
+    tier_up = false;
+    racing.dir.release(racing.dir.ctx);
+}
+
+TEST_F(TieringTest, ScanOffloadsColdFilesAndDeletesForgotten) {
+    start(nullptr, 100);
+    ASSERT_EQ(append(&log, 1, 200, {std::string(200, 'c')}), 0);   // Cold
+    ASSERT_EQ(append(&log, 2, 200, {std::string(200, 'h')}), 0);   // Hot
+    ASSERT_EQ(append(&log, 3, 10, {std::string(10, 's')}), 0);     // Too small
+    cold = {1, 3};
+
+    EXPECT_EQ(tier_scan(&tier), 1u);
+    EXPECT_TRUE(data_log_has_remote(&log, 1));
+    EXPECT_FALSE(data_log_has_remote(&log, 2));
+    EXPECT_FALSE(data_log_has_remote(&log, 3));
+
+    // Deleted files lose their object on the next scan
+    tier_forget(&tier, 1);
+    EXPECT_TRUE(object_exists(1));
+    EXPECT_EQ(tier_scan(&tier), 0u);
+    EXPECT_FALSE(object_exists(1));
+}
+
+TEST_F(TieringTest, ForgottenObjectsAreDeletedInOneBatch) {
+    BatchingBackend batching = {};
+    ASSERT_EQ(tier_backend_dir(&batching.dir, TIER_DIR), 0);
+    struct tier_backend backend = {batching_put, nullptr, batching_remove,
+                                   batching_remove_many, nullptr, &batching};
+    start(&backend);
+
+    for (uint32_t inode = 1; inode <= 20; inode++) {
+        ASSERT_EQ(append(&log, inode, 65536, {"data"}), 0);
+        ASSERT_EQ(tier_offload(&tier, inode), 1);
+    }
+    for (uint32_t inode = 1; inode <= 20; inode++) tier_forget(&tier, inode);
+
+    tier_scan(&tier);
+    EXPECT_EQ(batching.batches, 1);
+    EXPECT_EQ(batching.keys, 20u);
+    for (uint32_t inode = 1; inode <= 20; inode++) EXPECT_FALSE(object_exists(inode));
+
+    tier_destroy(&tier);
+    tier_up = false;
+    batching.dir.release(batching.dir.ctx);
+}
+
+TEST_F(TieringTest, CorruptObjectIsRejected) {
+    start();
+    ASSERT_EQ(append(&log, 9, 65536, {"payload"}), 0);
+    ASSERT_EQ(tier_offload(&tier, 9), 1);
+
+    char key[TIER_KEY_MAX];
+    tier_object_key(9, key, sizeof(key));
+    std::string path = std::string(TIER_DIR) + "/" + key;
+    FILE *f = fopen(path.c_str(), "r+");
+    ASSERT_NE(f, nullptr);
+    fseek(f, -1, SEEK_END);
+    fputc('X', f);
+    fclose(f);
+
+    struct data_log_chunk_ref ref;
+    ASSERT_EQ(data_log_lookup(&log, 9, 0, &ref), 0);
+    char buf[16];
+    EXPECT_NE(tier_read(&tier, 9, ref.offset, ref.stored_size, buf), 0);
+}
@@ -7,6 +7,11 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 extern "C" {
 #include "wal.h"
@@ -25,6 +30,16 @@ protected:
     void TearDown() override {
         wal_destroy(&wal);
         unlink(test_wal_path);
+        for (uint32_t i = 0; i < WAL_MAX_SEGMENTS; i++) {
+            unlink(segment(i).c_str());
+        }
+    }
+
+    // Name of segment i of a segmented test log
+    std::string segment(uint32_t i) {
+        char path[PATH_MAX];
+        EXPECT_EQ(wal_segment_path(path, sizeof(path), test_wal_path, i), 0);
+        return path;
     }
 };
 
@@ -149,4 +164,623 @@ TEST_F(WalTest, ChecksumValidation) {
 
     // Entries should have valid checksums (this verifies the checksum fix)
     // If checksum calculation was incorrect, recovery would fail to validate entries
-}
\ No newline at end of file
+}
+// ============================================================================
+// Group Commit
+// ============================================================================
+
+TEST_F(WalTest, GroupCommitConcurrentAppends) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+
+    const int threads = 8;
+    const int per_thread = 50;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([this, t]() {
+            for (int i = 0; i < per_thread; i++) {
+                struct wal_insert_data op = {
+                    .parent_idx = 0, .inode = (uint32_t)(t * per_thread + i + 2),
+                    .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1
+                };
+                ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    EXPECT_EQ(wal.header->entry_count, (uint32_t)(threads * per_thread));
+
+    // Every append waited for durability; flushes were shared
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.synced_entries, (uint64_t)(threads * per_thread));
+    EXPECT_GE(stats.sync_batches, 1u);
+    EXPECT_LE(stats.sync_batches, stats.synced_entries);
+
+    // LSNs are assigned in log order
+    uint64_t offset = wal.header->tail_offset;
+    uint64_t prev_lsn = 0;
+    while (offset != wal.header->head_offset) {
+        const struct wal_entry *e = (const struct wal_entry *)(wal.log_buffer + offset);
+        EXPECT_GT(e->lsn, prev_lsn);
+        prev_lsn = e->lsn;
+        offset += sizeof(struct wal_entry) + e->data_len;
+    }
+}
+
+TEST_F(WalTest, GroupCommitSurvivesReopen) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+
+    uint64_t tx_id;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx_id), 0);
+    struct wal_insert_data op = { .parent_idx = 1, .inode = 9, .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1 };
+    ASSERT_EQ(wal_log_insert(&wal, tx_id, &op), 0);
+    ASSERT_EQ(wal_commit_tx(&wal, tx_id), 0);
+
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+
+    EXPECT_TRUE(wal_is_valid(&wal));
+    EXPECT_EQ(wal.header->entry_count, 3u);
+    EXPECT_TRUE(wal_needs_recovery(&wal));
+}
+
+TEST_F(WalTest, GroupCommitThroughIoUring) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+    if (wal_set_io_engine(&wal, IO_ENGINE_URING) != 0) {
+        GTEST_SKIP() << "io_uring unavailable here";
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([this, t]() {
+            for (int i = 0; i < 25; i++) {
+                struct wal_insert_data op = {
+                    .parent_idx = 0, .inode = (uint32_t)(t * 25 + i + 2),
+                    .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1
+                };
+                ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    // One fdatasync per leader flush
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.synced_entries, 100u);
+    EXPECT_EQ(wal.io->stats.ops, stats.sync_batches);
+    EXPECT_EQ(wal.io->stats.failed, 0u);
+
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    EXPECT_EQ(wal.header->entry_count, 100u);
+}
+
+TEST_F(WalTest, DeferredAppendsWaitForSync) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+
+    for (uint32_t i = 0; i < 10; i++) {
+        struct wal_insert_data op = { .parent_idx = 0, .inode = i + 2, .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1 };
+        ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+    }
+
+    // Logged but not flushed
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.sync_batches, 0u);
+    EXPECT_LT(wal.durable_lsn, wal.appended_lsn);
+
+    // One flush covers all of them
+    ASSERT_EQ(wal_sync(&wal), 0);
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.sync_batches, 1u);
+    EXPECT_EQ(stats.synced_entries, 10u);
+    EXPECT_EQ(wal.durable_lsn, wal.appended_lsn);
+
+    // Nothing new: nothing to flush
+    ASSERT_EQ(wal_sync(&wal), 0);
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.sync_batches, 1u);
+}
+
+TEST_F(WalTest, SyncThreadFlushesDeferredAppends) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+    ASSERT_EQ(wal_start_sync_thread(&wal, 5), 0);
+
+    struct wal_insert_data op = { .parent_idx = 0, .inode = 2, .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1 };
+    ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+
+    for (int i = 0; i < 200 && __atomic_load_n(&wal.durable_lsn, __ATOMIC_ACQUIRE) < wal.appended_lsn; i++) {
+        usleep(5000);
+    }
+    EXPECT_EQ(__atomic_load_n(&wal.durable_lsn, __ATOMIC_ACQUIRE), wal.appended_lsn);
+
+    // Stopping flushes what is still pending
+    ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+    ASSERT_EQ(wal_stop_sync_thread(&wal), 0);
+    EXPECT_EQ(wal.durable_lsn, wal.appended_lsn);
+}
+
+// ============================================================================
+// Lock-Free Append
+// ============================================================================
+
+// Recompute an entry checksum the way recovery validates it
+static bool entry_checksum_ok(const struct wal *w, const struct wal_entry *e) {
+    return wal_entry_checksum(w, e, e->data, e->data_len) == e->checksum;
+}
+
+TEST_F(WalTest, LockFreeConcurrentAppends) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_lockfree_append(&wal, 1), 0);
+    ASSERT_EQ(wal_set_group_commit(&wal, 1), 0);
+
+    const int threads = 8;
+    const int per_thread = 100;
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([this, t]() {
+            for (int i = 0; i < per_thread; i++) {
+                struct wal_write_data op = {};
+                op.inode = (uint32_t)(t * per_thread + i + 2);
+                op.length = 4096;
+                ASSERT_EQ(wal_log_write(&wal, 0, &op), 0);
+            }
+        });
+    }
+    for (auto &w : workers) w.join();
+
+    EXPECT_EQ(wal.header->entry_count, (uint32_t)(threads * per_thread));
+    EXPECT_EQ(wal.header->next_lsn, (uint64_t)(threads * per_thread + 1));
+
+    // Published log is contiguous, in LSN order, and every entry validates
+    uint64_t offset = wal.header->tail_offset;
+    uint64_t expected_lsn = 1;
+    while (offset != wal.header->head_offset) {
+        const struct wal_entry *e = (const struct wal_entry *)(wal.log_buffer + offset);
+        ASSERT_EQ(e->lsn, expected_lsn);
+        ASSERT_TRUE(entry_checksum_ok(&wal, e));
+        expected_lsn++;
+        offset += sizeof(struct wal_entry) + e->data_len;
+    }
+    EXPECT_EQ(expected_lsn, (uint64_t)(threads * per_thread + 1));
+}
+
+TEST_F(WalTest, LockFreeCheckpointAndReopen) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_lockfree_append(&wal, 1), 0);
+
+    uint64_t tx_id;
+    ASSERT_EQ(wal_begin_tx(&wal, &tx_id), 0);
+    struct wal_insert_data op = { .parent_idx = 1, .inode = 5, .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1 };
+    ASSERT_EQ(wal_log_insert(&wal, tx_id, &op), 0);
+    ASSERT_EQ(wal_commit_tx(&wal, tx_id), 0);
+    ASSERT_EQ(wal_checkpoint(&wal), 0);
+    EXPECT_EQ(wal.header->checkpoint_lsn, 4u);
+
+    // Appends keep going after the checkpoint
+    ASSERT_EQ(wal_log_insert(&wal, tx_id, &op), 0);
+    EXPECT_EQ(wal.header->next_lsn, 6u);
+
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    EXPECT_TRUE(wal_is_valid(&wal));
+    EXPECT_EQ(wal.header->entry_count, 5u);
+}
+
+TEST_F(WalTest, LockFreeReportsFullLog) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_MIN_SIZE), 0);
+    ASSERT_EQ(wal_set_lockfree_append(&wal, 1), 0);
+
+    struct wal_write_data op = {};
+    int appended = 0;
+    while (wal_log_write(&wal, 0, &op) == 0) {
+        appended++;
+        ASSERT_LT(appended, 1000000);
+    }
+    EXPECT_EQ(errno, ENOSPC);
+    EXPECT_EQ(wal.header->entry_count, (uint32_t)appended);
+}
+
+// ============================================================================
+// Adaptive Checkpointing
+// ============================================================================
+
+// Append several times what the log holds, as fast as possible: the
+// checkpoint thread has to keep up without any append failing
+static uint64_t append_past_capacity(struct wal *w) {
+    struct wal_write_data op = {};
+    uint64_t entry_size = sizeof(struct wal_entry) + sizeof(op);
+    uint64_t appends = 3 * w->buffer_size / entry_size;
+    for (uint64_t i = 0; i < appends; i++) {
+        op.inode = (uint32_t)(i + 2);
+        if (wal_log_write(w, 0, &op) != 0) {
+            ADD_FAILURE() << "append " << i;
+            return 0;
+        }
+    }
+    return appends * entry_size;
+}
+
+TEST_F(WalTest, CheckpointThreadKeepsTheLogFromFilling) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_MIN_SIZE), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+    ASSERT_EQ(wal_start_checkpoint_thread(&wal), 0);
+
+    uint64_t appended = append_past_capacity(&wal);
+    ASSERT_EQ(wal_stop_checkpoint_thread(&wal), 0);
+
+    // All but what one buffer holds has been checkpointed away
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_GT(stats.total_checkpoints, 0u);
+    EXPECT_GE(stats.bytes_reclaimed, appended - wal.buffer_size);
+    EXPECT_GE(stats.max_checkpoint_us, stats.last_checkpoint_us);
+    EXPECT_GE(stats.checkpoint_time_us, stats.max_checkpoint_us);
+}
+
+TEST_F(WalTest, CheckpointThreadKeepsLockFreeLogFromFilling) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_MIN_SIZE), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+    ASSERT_EQ(wal_set_lockfree_append(&wal, 1), 0);
+    ASSERT_EQ(wal_start_checkpoint_thread(&wal), 0);
+
+    uint64_t appended = append_past_capacity(&wal);
+    ASSERT_EQ(wal_stop_checkpoint_thread(&wal), 0);
+
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_GT(stats.total_checkpoints, 0u);
+    EXPECT_GE(stats.bytes_reclaimed, appended - wal.buffer_size);
+
+    // Whatever is left still validates in LSN order from tail to head,
+    // from just after the last checkpoint
+    uint64_t offset = wal.header->tail_offset;
+    uint64_t lsn = wal.header->checkpoint_lsn;
+    while (offset != wal.header->head_offset) {
+        const struct wal_entry *e = (const struct wal_entry *)(wal.log_buffer + offset);
+        if (offset + sizeof(*e) > wal.buffer_size || e->lsn != lsn + 1) {
+            offset = 0;  // Wrapped: the rest of the buffer end was skipped
+            e = (const struct wal_entry *)wal.log_buffer;
+        }
+        ASSERT_EQ(e->lsn, lsn + 1);
+        ASSERT_TRUE(entry_checksum_ok(&wal, e));
+        lsn = e->lsn;
+        offset += sizeof(struct wal_entry) + e->data_len;
+    }
+    EXPECT_EQ(lsn + 1, wal.header->next_lsn);
+}
+
+TEST_F(WalTest, IdleLogIsNotCheckpointedAgain) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    struct wal_write_data op = {};
+    ASSERT_EQ(wal_log_write(&wal, 0, &op), 0);
+    ASSERT_EQ(wal_checkpoint(&wal), 0);
+    ASSERT_EQ(wal_start_checkpoint_thread(&wal), 0);
+
+    // A few ticks with nothing appended since the checkpoint
+    usleep(3 * WAL_CHECKPOINT_TICK_MS * 1000);
+
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.total_checkpoints, 1u);
+    EXPECT_EQ(stats.throttled_appends, 0u);
+}
+
+// ============================================================================
+// Segmented Log
+// ============================================================================
+
+static const uint32_t kSegments = 4;
+
+// Fill a bit over two segments and make it durable
+static uint64_t append_two_segments(struct wal *w) {
+    struct wal_write_data op = {};
+    uint64_t appends = 2 * WAL_SEGMENT_MIN_SIZE / (sizeof(struct wal_entry) + sizeof(op)) + 1;
+    for (uint64_t i = 0; i < appends; i++) {
+        op.inode = (uint32_t)(i + 2);
+        if (wal_log_write(w, 0, &op) != 0) {
+            ADD_FAILURE() << "append " << i;
+            return 0;
+        }
+    }
+    EXPECT_EQ(wal_sync(w), 0);
+    return appends;
+}
+
+// Every entry from the start of a never-wrapped log, in LSN order
+static void expect_entries_from_start(struct wal *w, uint64_t count) {
+    uint64_t offset = 0;
+    for (uint64_t lsn = 1; lsn <= count; lsn++) {
+        const struct wal_entry *e = (const struct wal_entry *)(w->log_buffer + offset);
+        ASSERT_EQ(e->lsn, lsn);
+        ASSERT_TRUE(entry_checksum_ok(w, e));
+        offset += sizeof(struct wal_entry) + e->data_len;
+    }
+    EXPECT_EQ(offset, w->header->head_offset);
+}
+
+TEST_F(WalTest, SegmentedLogSpansItsSegments) {
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+    EXPECT_EQ(wal.buffer_size, kSegments * WAL_SEGMENT_MIN_SIZE);
+    for (uint32_t i = 0; i < kSegments; i++) {
+        struct stat st;
+        ASSERT_EQ(stat(segment(i).c_str(), &st), 0);
+        EXPECT_EQ(st.st_size, WAL_SEGMENT_MIN_SIZE);
+    }
+
+    // Entries run across segment boundaries as in one region
+    uint64_t appends = append_two_segments(&wal);
+    EXPECT_GT(wal.header->head_offset, 2u * WAL_SEGMENT_MIN_SIZE);
+
+    // Entries to replay: the log reopens in its own layout
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    EXPECT_EQ(wal.segment_count, kSegments);
+    EXPECT_TRUE(wal_is_valid(&wal));
+    EXPECT_EQ(wal.header->entry_count, appends);
+    expect_entries_from_start(&wal, appends);
+}
+
+TEST_F(WalTest, SegmentsStripeOverDirectories) {
+    char dir_a[] = "/tmp/wal_stripe_a_XXXXXX";
+    char dir_b[] = "/tmp/wal_stripe_b_XXXXXX";
+    ASSERT_NE(mkdtemp(dir_a), nullptr);
+    ASSERT_NE(mkdtemp(dir_b), nullptr);
+    const char *dirs[] = { dir_a, dir_b };
+
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, dirs, 2, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+    for (uint32_t i = 0; i < kSegments; i++) {
+        struct stat st;
+        ASSERT_EQ(lstat(segment(i).c_str(), &st), 0);
+        EXPECT_TRUE(S_ISLNK(st.st_mode));
+        char target[PATH_MAX] = {};
+        ASSERT_GT(readlink(segment(i).c_str(), target, sizeof(target) - 1), 0);
+        EXPECT_EQ(strncmp(target, dirs[i % 2], strlen(dirs[i % 2])), 0) << target;
+    }
+
+    // Both directories live on one device here; pretend they do not, so
+    // the flush spanning them runs in parallel
+    for (uint32_t i = 0; i < kSegments; i++) {
+        wal.segment_device[i] = (uint8_t)(i % 2);
+    }
+    wal.device_count = 2;
+    uint64_t appends = append_two_segments(&wal);
+
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    EXPECT_EQ(wal.header->entry_count, appends);
+    expect_entries_from_start(&wal, appends);
+
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+    for (uint32_t i = 0; i < kSegments; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/test_wal.log.%u", dirs[i % 2], i);
+        unlink(path);
+    }
+    rmdir(dir_a);
+    rmdir(dir_b);
+}
+
+TEST_F(WalTest, CheckpointsRecycleSegments) {
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+
+    // Three times around the log, checkpointing whenever it gets full
+    struct wal_write_data op = {};
+    size_t entry_size = sizeof(struct wal_entry) + sizeof(op);
+    uint64_t appends = 3 * wal.buffer_size / entry_size;
+    for (uint64_t i = 0; i < appends; i++) {
+        if (wal_available_space(&wal) < 2 * entry_size) {
+            ASSERT_EQ(wal_checkpoint(&wal), 0);
+        }
+        ASSERT_EQ(wal_log_write(&wal, 0, &op), 0) << "append " << i;
+    }
+
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_GE(stats.segments_recycled, 2u * kSegments);
+}
+
+TEST_F(WalTest, EmptyLogTakesTheRequestedLayout) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+
+    // Nothing to replay: recreated as segments, the old log file shrinks
+    // to the header
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    EXPECT_EQ(wal.segment_count, kSegments);
+    struct stat st;
+    ASSERT_EQ(stat(test_wal_path, &st), 0);
+    EXPECT_EQ(st.st_size, (off_t)sizeof(struct wal_header));
+}
+
+TEST_F(WalTest, SingleFileLogWithEntriesStaysSingleFile) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    struct wal_write_data op = {};
+    ASSERT_EQ(wal_log_write(&wal, 0, &op), 0);
+    wal_destroy(&wal);
+    memset(&wal, 0, sizeof(wal));
+
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    EXPECT_EQ(wal.segment_count, 0u);
+    EXPECT_EQ(wal.buffer_size, (size_t)WAL_DEFAULT_SIZE);
+    EXPECT_EQ(wal.header->entry_count, 1u);
+}
+
+TEST_F(WalTest, SegmentedFlushThroughIoUring) {
+    ASSERT_EQ(wal_init_segmented(&wal, test_wal_path, NULL, 0, WAL_SEGMENT_MIN_SIZE, kSegments), 0);
+    if (wal_set_io_engine(&wal, IO_ENGINE_URING) != 0) {
+        GTEST_SKIP() << "io_uring unavailable here";
+    }
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+
+    // The sync covers three segments: their fdatasyncs go out together
+    uint64_t appends = append_two_segments(&wal);
+    EXPECT_EQ(wal.io->stats.ops, 3u);
+    EXPECT_EQ(wal.io->stats.submits, 1u);
+    if (wal.io->files_registered) {
+        EXPECT_EQ(wal.io->stats.fixed_files, 3u);
+    }
+    expect_entries_from_start(&wal, appends);
+}
+
+// ============================================================================
+// Write Payloads
+// ============================================================================
+
+TEST_F(WalTest, PayloadRecordCarriesCompressedBytes) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+
+    std::vector<char> data(8192, 'z');
+    struct wal_write_data write = {};
+    write.node_idx = 1;
+    write.inode = 42;
+    write.length = (uint32_t)data.size();
+    write.new_size = data.size();
+    ASSERT_EQ(wal_log_write_payload(&wal, 0, &write, WAL_DATA_WRITE, data.data()), 0);
+
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.total_entries, 1u);
+    EXPECT_EQ(stats.payload_bytes, 8192u);
+    EXPECT_LT(stats.payload_stored, stats.payload_bytes);
+
+    const struct wal_entry *entry = (const struct wal_entry *)wal.log_buffer;
+    const struct wal_write_payload *payload = (const struct wal_write_payload *)entry->data;
+    EXPECT_EQ(entry->op_type, (uint32_t)WAL_OP_WRITE_DATA);
+    EXPECT_EQ(entry->data_len, sizeof(*payload) + payload->stored_len);
+    EXPECT_TRUE(payload->flags & WAL_PAYLOAD_COMPRESSED);
+    EXPECT_EQ(payload->write.data_checksum, wal_checksum(&wal, data.data(), data.size()));
+}
+
+TEST_F(WalTest, SmallDeferredWritesAreCoalesced) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+
+    // 16 writes of 100 bytes, each continuing the one before
+    char chunk[100];
+    for (uint32_t i = 0; i < 16; i++) {
+        memset(chunk, 'a' + i, sizeof(chunk));
+        struct wal_write_data write = {};
+        write.node_idx = 1;
+        write.inode = 42;
+        write.offset = i * sizeof(chunk);
+        write.length = sizeof(chunk);
+        write.new_size = (i + 1) * sizeof(chunk);
+        ASSERT_EQ(wal_log_write_payload(&wal, 0, &write, WAL_DATA_WRITE, chunk), 0);
+    }
+
+    // Staged, not yet in the log
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.total_entries, 0u);
+
+    ASSERT_EQ(wal_sync(&wal), 0);
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.total_entries, 1u);
+    EXPECT_EQ(stats.coalesced_writes, 15u);
+    EXPECT_EQ(stats.payload_bytes, 1600u);
+
+    const struct wal_entry *entry = (const struct wal_entry *)wal.log_buffer;
+    const struct wal_write_payload *payload = (const struct wal_write_payload *)entry->data;
+    EXPECT_EQ(payload->write.offset, 0u);
+    EXPECT_EQ(payload->write.length, 1600u);
+    EXPECT_EQ(payload->write.new_size, 1600u);
+}
+
+TEST_F(WalTest, StagedWriteIsLoggedBeforeLaterEntries) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    ASSERT_EQ(wal_set_deferred(&wal, 1), 0);
+
+    char chunk[64];
+    memset(chunk, 'x', sizeof(chunk));
+    struct wal_write_data write = {};
+    write.node_idx = 1;
+    write.inode = 42;
+    write.length = sizeof(chunk);
+    write.new_size = sizeof(chunk);
+    ASSERT_EQ(wal_log_write_payload(&wal, 0, &write, WAL_DATA_WRITE, chunk), 0);
+
+    // Not contiguous: starts a new stage
+    write.offset = 4096;
+    write.new_size = 4096 + sizeof(chunk);
+    ASSERT_EQ(wal_log_write_payload(&wal, 0, &write, WAL_DATA_WRITE, chunk), 0);
+
+    struct wal_update_data update = {};
+    update.node_idx = 1;
+    update.inode = 42;
+    update.new_size = 0;
+    ASSERT_EQ(wal_log_update(&wal, 0, &update), 0);
+
+    // Both writes, in order, ahead of the update
+    const uint32_t expected[] = { WAL_OP_WRITE_DATA, WAL_OP_WRITE_DATA, WAL_OP_UPDATE };
+    uint64_t offset = 0;
+    for (uint32_t op : expected) {
+        ASSERT_LT(offset, wal.header->head_offset);
+        const struct wal_entry *entry = (const struct wal_entry *)(wal.log_buffer + offset);
+        EXPECT_EQ(entry->op_type, op);
+        offset += sizeof(*entry) + entry->data_len;
+    }
+    EXPECT_EQ(offset, wal.header->head_offset);
+
+    struct wal_stats stats;
+    wal_get_stats(&wal, &stats);
+    EXPECT_EQ(stats.coalesced_writes, 0u);
+}
+
+// ============================================================================
+// Checksum Format Versions
+// ============================================================================
+
+TEST_F(WalTest, NewLogUsesCrc32c) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    EXPECT_EQ(wal.header->version, (uint32_t)WAL_VERSION);
+    EXPECT_EQ(wal.version, (uint32_t)WAL_VERSION);
+    EXPECT_NE(wal.version, (uint32_t)WAL_VERSION_CRC32);
+}
+
+TEST_F(WalTest, LegacyCrc32LogStillValidates) {
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+
+    // Turn it into a version 1 log; the next header update re-checksums it
+    wal.version = WAL_VERSION_CRC32;
+    wal.header->version = WAL_VERSION_CRC32;
+    struct wal_insert_data op = { .parent_idx = 1, .inode = 9, .name_offset = 0, .mode = S_IFREG | 0644, .timestamp = 1 };
+    ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+    ASSERT_EQ(wal_log_insert(&wal, 0, &op), 0);
+    wal_destroy(&wal);
+
+    // Entries left to replay keep their format across a reopen
+    memset(&wal, 0, sizeof(wal));
+    ASSERT_EQ(wal_init_file(&wal, test_wal_path, WAL_DEFAULT_SIZE), 0);
+    EXPECT_EQ(wal.version, (uint32_t)WAL_VERSION_CRC32);
+    EXPECT_EQ(wal.header->entry_count, 2u);
+
+    const struct wal_entry *e = (const struct wal_entry *)wal.log_buffer;
+    EXPECT_EQ(e->checksum, wal_entry_checksum(&wal, e, e->data, e->data_len));
+
+    struct wal_entry copy;
+    memcpy(&copy, e, sizeof(copy));
+    copy.checksum = 0;
+    uint32_t legacy = wal_crc32_combine(wal_crc32(&copy, sizeof(copy)),
+                                        wal_crc32(e->data, e->data_len), e->data_len);
+    EXPECT_EQ(e->checksum, legacy);
+}
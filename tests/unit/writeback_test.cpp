@@ -0,0 +1,251 @@
+/**
+ * Write-Back Unit Tests
+ * Tests for the dirty inode flusher and dirty chunk persistence
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "writeback.h"
+#include "extent_store.h"
+#include "shm_persist.h"
+}
+
+struct FlushRecorder {
+    std::atomic<int> calls{0};
+    std::atomic<uint32_t> last_inode{0};
+    std::atomic<int> failures_left{0};
+};
+
+static int record_flush(void *ctx, uint32_t inode) {
+    auto *rec = static_cast<FlushRecorder *>(ctx);
+    rec->last_inode = inode;
+    rec->calls++;
+    if (rec->failures_left > 0) {
+        rec->failures_left--;
+        return -1;
+    }
+    return 0;
+}
+
+class WritebackTest : public ::testing::Test {
+protected:
+    struct writeback wb;
+    FlushRecorder rec;
+
+    void Start(uint32_t interval_ms) {
+        struct writeback_config cfg = { interval_ms };
+        ASSERT_EQ(writeback_init(&wb, &cfg, record_flush, &rec), 0);
+    }
+
+    void TearDown() override {
+        writeback_destroy(&wb);
+    }
+};
+
+// ============================================================================
+// Flusher Scheduling Tests
+// ============================================================================
+
+TEST_F(WritebackTest, FlushesAfterInterval) {
+    Start(50);
+
+    ASSERT_EQ(writeback_mark_dirty(&wb, 12), 0);
+    EXPECT_EQ(rec.calls.load(), 0);  // No I/O on the write path
+
+    for (int i = 0; i < 200 && rec.calls.load() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(rec.calls.load(), 1);
+    EXPECT_EQ(rec.last_inode.load(), 12u);
+}
+
+TEST_F(WritebackTest, RepeatedWritesDoNotPostponeFlush) {
+    Start(100);
+
+    // Keep writing past the interval; the first write's deadline still holds
+    auto start = std::chrono::steady_clock::now();
+    while (rec.calls.load() == 0 &&
+           std::chrono::steady_clock::now() - start < std::chrono::seconds(2)) {
+        writeback_mark_dirty(&wb, 8);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_GE(rec.calls.load(), 1);
+}
+
+TEST_F(WritebackTest, ScheduleFlushesNow) {
+    Start(60000);
+
+    writeback_mark_dirty(&wb, 1);
+    writeback_mark_dirty(&wb, 2);
+    writeback_schedule(&wb, 2);
+
+    for (int i = 0; i < 200 && rec.calls.load() == 0; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(rec.calls.load(), 1);
+    EXPECT_EQ(rec.last_inode.load(), 2u);
+
+    struct writeback_stats stats;
+    writeback_get_stats(&wb, &stats);
+    EXPECT_EQ(stats.dirty, 1u);
+}
+
+TEST_F(WritebackTest, SyncFlushesEverything) {
+    Start(60000);
+
+    for (uint32_t i = 1; i <= 100; i++) {
+        writeback_mark_dirty(&wb, i);
+    }
+    writeback_sync(&wb);
+
+    struct writeback_stats stats;
+    writeback_get_stats(&wb, &stats);
+    EXPECT_EQ(rec.calls.load(), 100);
+    EXPECT_EQ(stats.flushed, 100u);
+    EXPECT_EQ(stats.dirty, 0u);
+}
+
+TEST_F(WritebackTest, CancelDropsInode) {
+    Start(60000);
+
+    writeback_mark_dirty(&wb, 5);
+    writeback_cancel(&wb, 5);
+    writeback_sync(&wb);
+    EXPECT_EQ(rec.calls.load(), 0);
+}
+
+TEST_F(WritebackTest, FailedFlushIsRequeued) {
+    Start(20);
+    rec.failures_left = 1;
+
+    writeback_mark_dirty(&wb, 6);
+    writeback_sync(&wb);  // Fails and re-queues
+    writeback_sync(&wb);  // Succeeds
+
+    struct writeback_stats stats;
+    writeback_get_stats(&wb, &stats);
+    EXPECT_EQ(rec.calls.load(), 2);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_EQ(stats.flushed, 1u);
+    EXPECT_EQ(stats.dirty, 0u);
+}
+
+TEST_F(WritebackTest, DestroyFlushesPending) {
+    Start(60000);
+
+    writeback_mark_dirty(&wb, 3);
+    writeback_destroy(&wb);
+    EXPECT_EQ(rec.calls.load(), 1);
+
+    ASSERT_EQ(writeback_init(&wb, nullptr, record_flush, &rec), 0);  // For TearDown
+}
+
+TEST_F(WritebackTest, ZeroIntervalWritesThrough) {
+    Start(0);
+
+    EXPECT_EQ(writeback_mark_dirty(&wb, 4), 0);
+    EXPECT_EQ(rec.calls.load(), 1);
+
+    rec.failures_left = 1;
+    EXPECT_EQ(writeback_mark_dirty(&wb, 4), -1);
+}
+
+// ============================================================================
+// Dirty Chunk Persistence Tests
+// ============================================================================
+
+TEST(DirtyChunkTest, WritesAndTruncatesMarkDirty) {
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+    EXPECT_FALSE(extent_store_is_dirty(&es));
+
+    std::vector<char> data(3 * EXTENT_CHUNK_SIZE, 'w');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    EXPECT_EQ(es.dirty_count, 3u);
+
+    extent_store_mark_clean(&es);
+    EXPECT_FALSE(extent_store_is_dirty(&es));
+
+    ASSERT_EQ(extent_store_write(&es, "x", 1, EXTENT_CHUNK_SIZE + 1), 1);
+    EXPECT_EQ(es.dirty_count, 1u);
+    EXPECT_FALSE(extent_store_chunk_dirty(&es, 0));
+    EXPECT_TRUE(extent_store_chunk_dirty(&es, 1));
+
+    extent_store_mark_clean(&es);
+    ASSERT_EQ(extent_store_truncate(&es, 4 * EXTENT_CHUNK_SIZE), 0);
+    EXPECT_TRUE(extent_store_is_dirty(&es));  // Size-only change
+    EXPECT_EQ(es.dirty_count, 0u);
+
+    extent_store_destroy(&es);
+}
+
+TEST(DirtyChunkTest, FlushPersistsOnlyChanges) {
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+
+    std::vector<char> data(4 * EXTENT_CHUNK_SIZE);
+    for (size_t i = 0; i < data.size(); i++) data[i] = (char)(i % 113);
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(disk_file_extents_flush(310, &es), 0);
+    extent_store_mark_clean(&es);
+
+    // A clean store is a no-op
+    EXPECT_EQ(disk_file_extents_flush(310, &es), 0);
+
+    ASSERT_EQ(extent_store_write(&es, "DIRTY", 5, 2 * EXTENT_CHUNK_SIZE + 7), 5);
+    memcpy(&data[2 * EXTENT_CHUNK_SIZE + 7], "DIRTY", 5);
+    ASSERT_EQ(disk_file_extents_flush(310, &es), 0);
+    extent_store_mark_clean(&es);
+
+    struct extent_store restored;
+    ASSERT_EQ(extent_store_init(&restored), 0);
+    ASSERT_EQ(disk_file_extents_restore(310, &restored), 0);
+    EXPECT_FALSE(extent_store_is_dirty(&restored));
+
+    std::vector<char> out(data.size());
+    ASSERT_EQ(extent_store_read(&restored, out.data(), out.size(), 0), (ssize_t)out.size());
+    EXPECT_EQ(out, data);
+
+    extent_store_destroy(&restored);
+    extent_store_destroy(&es);
+    disk_file_data_remove(310);
+}
+
+TEST(DirtyChunkTest, ShrinkThenRegrowBeforeFlush) {
+    struct extent_store es;
+    ASSERT_EQ(extent_store_init(&es), 0);
+
+    std::vector<char> data(4 * EXTENT_CHUNK_SIZE, 's');
+    ASSERT_EQ(extent_store_write(&es, data.data(), data.size(), 0), (ssize_t)data.size());
+    ASSERT_EQ(disk_file_extents_flush(311, &es), 0);
+    extent_store_mark_clean(&es);
+
+    // Truncated chunks must not resurface from the old image once regrown
+    ASSERT_EQ(extent_store_truncate(&es, EXTENT_CHUNK_SIZE), 0);
+    ASSERT_EQ(extent_store_write(&es, "t", 1, 3 * EXTENT_CHUNK_SIZE), 1);
+    ASSERT_EQ(disk_file_extents_flush(311, &es), 0);
+    extent_store_mark_clean(&es);
+
+    struct extent_store restored;
+    ASSERT_EQ(extent_store_init(&restored), 0);
+    ASSERT_EQ(disk_file_extents_restore(311, &restored), 0);
+    ASSERT_EQ(restored.size, 3ULL * EXTENT_CHUNK_SIZE + 1);
+
+    std::vector<char> out(restored.size);
+    ASSERT_EQ(extent_store_read(&restored, out.data(), out.size(), 0), (ssize_t)out.size());
+    for (size_t i = 0; i < EXTENT_CHUNK_SIZE; i++) ASSERT_EQ(out[i], 's');
+    for (size_t i = EXTENT_CHUNK_SIZE; i < 3 * EXTENT_CHUNK_SIZE; i++) {
+        ASSERT_EQ(out[i], 0) << "at " << i;
+    }
+    EXPECT_EQ(out.back(), 't');
+
+    extent_store_destroy(&restored);
+    extent_store_destroy(&es);
+    disk_file_data_remove(311);
+}
@@ -0,0 +1,278 @@
+/**
+ * Extended Attribute Unit Tests
+ * Tests for the xattr arena: chains, inline and heap values, persistence
+ */
+
+#include <gtest/gtest.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "xattr.h"
+#include "string_table.h"
+}
+
+static const char *XATTR_PATH = "/tmp/razorfs_xattr_test.dat";
+
+class XattrTest : public ::testing::Test {
+protected:
+    struct string_table names;
+    struct xattr_store xs;
+
+    void SetUp() override {
+        unlink(XATTR_PATH);
+        ASSERT_EQ(string_table_init(&names), 0);
+        ASSERT_EQ(xattr_store_init(&xs, &names), 0);
+    }
+
+    void TearDown() override {
+        xattr_store_destroy(&xs);
+        string_table_destroy(&names);
+        unlink(XATTR_PATH);
+    }
+
+    std::string get(uint32_t head, const char *name) {
+        char buf[XATTR_VALUE_MAX];
+        int ret = xattr_get(&xs, head, name, buf, sizeof(buf));
+        if (ret < 0) return "<" + std::to_string(ret) + ">";
+        return std::string(buf, ret);
+    }
+
+    // Load the file into a fresh arena and string table
+    int reload() {
+        xattr_store_destroy(&xs);
+        string_table_destroy(&names);
+        if (string_table_init(&names) != 0 || xattr_store_init(&xs, &names) != 0) return -2;
+        return xattr_store_load(&xs, XATTR_PATH);
+    }
+
+    static off_t file_size() {
+        struct stat st;
+        return stat(XATTR_PATH, &st) == 0 ? st.st_size : -1;
+    }
+
+    std::vector<std::string> list(uint32_t head) {
+        char buf[1024];
+        int ret = xattr_list(&xs, head, buf, sizeof(buf));
+        std::vector<std::string> out;
+        for (int pos = 0; pos < ret; pos += (int)strlen(buf + pos) + 1) {
+            out.push_back(buf + pos);
+        }
+        return out;
+    }
+};
+
+TEST_F(XattrTest, SetGetListRemove) {
+    uint32_t head = 0;
+    EXPECT_EQ(xattr_get(&xs, head, "user.a", nullptr, 0), -ENODATA);
+
+    ASSERT_EQ(xattr_set(&xs, &head, "user.a", "one", 3, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.b", "two", 3, 0), 0);
+    EXPECT_NE(head, 0u);
+    EXPECT_EQ(xs.live, 2u);
+
+    EXPECT_EQ(get(head, "user.a"), "one");
+    EXPECT_EQ(get(head, "user.b"), "two");
+    EXPECT_EQ(list(head), (std::vector<std::string>{"user.b", "user.a"}));
+    EXPECT_EQ(xattr_list(&xs, head, nullptr, 0), 14);
+
+    // Removing the chain head moves it on; the other entry stays reachable
+    ASSERT_EQ(xattr_remove(&xs, &head, "user.b"), 0);
+    EXPECT_EQ(get(head, "user.b"), "<" + std::to_string(-ENODATA) + ">");
+    EXPECT_EQ(get(head, "user.a"), "one");
+    EXPECT_EQ(xattr_remove(&xs, &head, "user.b"), -ENODATA);
+
+    ASSERT_EQ(xattr_remove(&xs, &head, "user.a"), 0);
+    EXPECT_EQ(head, 0u);
+    EXPECT_EQ(xs.live, 0u);
+}
+
+TEST_F(XattrTest, FlagsAndSizeErrors) {
+    uint32_t head = 0;
+    EXPECT_EQ(xattr_set(&xs, &head, "user.x", "v", 1, XATTR_REPLACE), -ENODATA);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.x", "v", 1, XATTR_CREATE), 0);
+    EXPECT_EQ(xattr_set(&xs, &head, "user.x", "w", 1, XATTR_CREATE), -EEXIST);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.x", "w", 1, XATTR_REPLACE), 0);
+    EXPECT_EQ(get(head, "user.x"), "w");
+
+    // Size 0 asks for the size; a short buffer is -ERANGE
+    char small[1];
+    EXPECT_EQ(xattr_get(&xs, head, "user.x", nullptr, 0), 1);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.x", "long", 4, 0), 0);
+    EXPECT_EQ(xattr_get(&xs, head, "user.x", small, sizeof(small)), -ERANGE);
+    EXPECT_EQ(xattr_list(&xs, head, small, sizeof(small)), -ERANGE);
+
+    std::string long_name(XATTR_NAME_LEN_MAX + 1, 'n');
+    EXPECT_EQ(xattr_set(&xs, &head, long_name.c_str(), "v", 1, 0), -ERANGE);
+    EXPECT_EQ(xattr_set(&xs, &head, "", "v", 1, 0), -ERANGE);
+}
+
+TEST_F(XattrTest, LargeValuesUseTheHeap) {
+    uint32_t head = 0;
+    std::string big(1000, 'b');
+    std::string bigger(3000, 'c');
+
+    ASSERT_EQ(xattr_set(&xs, &head, "user.big", big.data(), big.size(), 0), 0);
+    EXPECT_EQ(xs.heap_used, 1000u);
+    EXPECT_EQ(get(head, "user.big"), big);
+
+    // Rewrites leave garbage that is compacted away once it dominates
+    for (int i = 0; i < 8; i++) {
+        ASSERT_EQ(xattr_set(&xs, &head, "user.big", bigger.data(), bigger.size(), 0), 0);
+        EXPECT_LE(xs.heap_used, 3 * bigger.size());
+    }
+    EXPECT_EQ(get(head, "user.big"), bigger);
+
+    // Shrinking back to an inline value frees the heap copy
+    ASSERT_EQ(xattr_set(&xs, &head, "user.big", "tiny", 4, 0), 0);
+    EXPECT_EQ(get(head, "user.big"), "tiny");
+    EXPECT_EQ(xs.heap_garbage, xs.heap_used);
+}
+
+TEST_F(XattrTest, DropFreesTheChainForReuse) {
+    uint32_t head = 0;
+    ASSERT_EQ(xattr_set(&xs, &head, "user.a", "1", 1, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.b", "2", 1, 0), 0);
+    uint32_t used = xs.used;
+
+    xattr_drop(&xs, head);
+    EXPECT_EQ(xs.live, 0u);
+
+    uint32_t other = 0;
+    ASSERT_EQ(xattr_set(&xs, &other, "user.c", "3", 1, 0), 0);
+    EXPECT_EQ(xs.used, used);
+}
+
+TEST_F(XattrTest, SaveLoadReinternsNames) {
+    uint32_t a = 0, b = 0;
+    std::string big(500, 'z');
+    ASSERT_EQ(xattr_set(&xs, &a, "user.small", "s", 1, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &a, "user.big", big.data(), big.size(), 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &b, "trusted.other", "o", 1, 0), 0);
+    ASSERT_EQ(xattr_store_save(&xs, XATTR_PATH), 0);
+
+    // A fresh string table: the saved offsets mean nothing there
+    xattr_store_destroy(&xs);
+    string_table_destroy(&names);
+    ASSERT_EQ(string_table_init(&names), 0);
+    string_table_intern(&names, "shifts every offset");
+    ASSERT_EQ(xattr_store_init(&xs, &names), 0);
+    ASSERT_EQ(xattr_store_load(&xs, XATTR_PATH), 0);
+
+    EXPECT_EQ(xs.live, 3u);
+    EXPECT_EQ(get(a, "user.small"), "s");
+    EXPECT_EQ(get(a, "user.big"), big);
+    EXPECT_EQ(get(b, "trusted.other"), "o");
+}
+
+TEST_F(XattrTest, LoadRejectsCorruptFile) {
+    FILE *f = fopen(XATTR_PATH, "w");
+    ASSERT_NE(f, nullptr);
+    fputs("not an xattr arena", f);
+    fclose(f);
+
+    EXPECT_EQ(xattr_store_load(&xs, XATTR_PATH), -1);
+    unlink(XATTR_PATH);
+    EXPECT_EQ(xattr_store_load(&xs, XATTR_PATH), -1);
+    EXPECT_EQ(xs.live, 0u);
+}
+
+TEST_F(XattrTest, FlushAppendsOnlyTheChangedEntries) {
+    uint32_t a = 0, b = 0;
+    std::string big(500, 'z');
+    for (int i = 0; i < 40; i++) {
+        std::string name = "user.n" + std::to_string(i);
+        ASSERT_EQ(xattr_set(&xs, &a, name.c_str(), big.data(), big.size(), 0), 0);
+    }
+    ASSERT_EQ(xattr_set(&xs, &b, "user.b", "b", 1, 0), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);  // Never saved: a full save
+    off_t image = file_size();
+    ASSERT_GT(image, 20000);
+
+    // Set, replace and remove (the removal relinks its predecessor)
+    ASSERT_EQ(xattr_set(&xs, &b, "user.new", "fresh", 5, 0), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+    ASSERT_EQ(xattr_set(&xs, &a, "user.n3", "short", 5, 0), 0);
+    ASSERT_EQ(xattr_remove(&xs, &a, "user.n20"), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+    EXPECT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);  // Nothing left to write
+    // Four records (the relinked predecessor carries its 500 byte value)
+    EXPECT_LT(file_size() - image, 1000);
+
+    ASSERT_EQ(reload(), 0);
+    EXPECT_EQ(xs.live, 41u);
+    EXPECT_EQ(get(b, "user.new"), "fresh");
+    EXPECT_EQ(get(b, "user.b"), "b");
+    EXPECT_EQ(get(a, "user.n3"), "short");
+    EXPECT_EQ(get(a, "user.n19"), big);
+    EXPECT_EQ(get(a, "user.n20"), "<" + std::to_string(-ENODATA) + ">");
+    EXPECT_EQ(list(a).size(), 39u);
+}
+
+TEST_F(XattrTest, TornRecordIsDroppedAndOverwritten) {
+    uint32_t head = 0;
+    ASSERT_EQ(xattr_set(&xs, &head, "user.a", "1", 1, 0), 0);
+    ASSERT_EQ(xattr_store_save(&xs, XATTR_PATH), 0);
+    ASSERT_EQ(xattr_set(&xs, &head, "user.b", "2", 1, 0), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+    off_t kept = file_size();
+    uint32_t kept_head = head;
+    ASSERT_EQ(xattr_set(&xs, &head, "user.c", "3", 1, 0), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+
+    // A crash in the middle of the last append
+    ASSERT_EQ(truncate(XATTR_PATH, kept + 10), 0);
+    ASSERT_EQ(reload(), 0);
+    EXPECT_EQ(xs.live, 2u);
+    EXPECT_EQ(get(head, "user.c"), "<" + std::to_string(-ENODATA) + ">");
+    head = kept_head;
+    EXPECT_EQ(get(head, "user.b"), "2");
+
+    // The next flush writes over the torn bytes
+    ASSERT_EQ(xattr_set(&xs, &head, "user.d", "4", 1, 0), 0);
+    ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+    ASSERT_EQ(reload(), 0);
+    EXPECT_EQ(list(head), (std::vector<std::string>{"user.d", "user.b", "user.a"}));
+}
+
+TEST_F(XattrTest, RecordsOutgrowingTheImageRewriteIt) {
+    uint32_t head = 0;
+    std::string value(1000, 'v');
+    ASSERT_EQ(xattr_set(&xs, &head, "user.v", "0", 1, 0), 0);
+    ASSERT_EQ(xattr_store_save(&xs, XATTR_PATH), 0);
+
+    for (int i = 0; i < 500; i++) {
+        value[0] = (char)('a' + i % 26);
+        ASSERT_EQ(xattr_set(&xs, &head, "user.v", value.data(), value.size(), 0), 0);
+        ASSERT_EQ(xattr_store_flush(&xs, XATTR_PATH), 0);
+        ASSERT_LE(file_size(), 2 * XATTR_LOG_MIN + 4096);
+    }
+
+    ASSERT_EQ(reload(), 0);
+    EXPECT_EQ(xs.live, 1u);
+    EXPECT_EQ(get(head, "user.v"), value);
+}
+
+TEST_F(XattrTest, ClaimAndSweepFreeOrphans) {
+    uint32_t kept = 0, orphan = 0;
+    ASSERT_EQ(xattr_set(&xs, &kept, "user.k1", "1", 1, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &orphan, "user.o1", "2", 1, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &kept, "user.k2", "3", 1, 0), 0);
+    ASSERT_EQ(xattr_set(&xs, &orphan, "user.o2", "4", 1, 0), 0);
+
+    std::vector<uint8_t> claimed((xs.capacity + 7) / 8, 0);
+    EXPECT_EQ(xattr_claim(&xs, kept, claimed.data()), kept);
+
+    // A second node pointing into a claimed chain gets nothing
+    EXPECT_EQ(xattr_claim(&xs, kept, claimed.data()), 0u);
+    // Out of range heads are cut off
+    EXPECT_EQ(xattr_claim(&xs, xs.used + 5, claimed.data()), 0u);
+
+    EXPECT_EQ(xattr_sweep(&xs, claimed.data()), 2u);
+    EXPECT_EQ(xs.live, 2u);
+    EXPECT_EQ(list(kept), (std::vector<std::string>{"user.k2", "user.k1"}));
+}
@@ -10,6 +10,18 @@
  * - Data block integrity
  * - WAL consistency
  * - Compression header validation
+ * - Data log block refcounts (deduplicated chunks)
+ *
+ * The node image (nodes.dat) and string table are mapped, not loaded:
+ * worker threads claim runs of node indices and run every per-node check
+ * on them in one pass, so the image is streamed once whatever its size.
+ * Checks that span nodes (orphans, duplicate inodes) meet in shared
+ * atomic tables. Repairs are collected during the scan and applied
+ * afterwards as one WAL transaction.
+ *
+ * With -o the filesystem may be mounted: everything is mapped read-only
+ * and nothing is repaired. A node failing a check is read again, and only
+ * reported if it fails the same way on an unchanged copy.
  */
 
 #include <stdio.h>
@@ -20,11 +32,23 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "../../src/nary_tree_mt.h"
 #include "../../src/shm_persist.h"
 #include "../../src/string_table.h"
 #include "../../src/compression.h"
 #include "../../src/wal.h"
+#include "../../src/crc32c.h"
+#include "../../src/data_log.h"
+
+#define FSCK_WAL_PATH        "/tmp/razorfs_wal.log"
+#define FSCK_MAX_THREADS     64
+#define FSCK_CHUNK_NODES     4096    /* Nodes a worker claims at a time */
+#define FSCK_ONLINE_RETRIES  3       /* Rereads of a node changing under -o */
 
 /* Configuration */
 typedef struct {
@@ -32,22 +56,67 @@ typedef struct {
     bool dry_run;
     bool auto_repair;
     bool verbose;
+    bool online;             /* Read-only, safe against a mount */
+    unsigned int threads;
     int error_count;
     int repair_count;
 } fsck_config;
 
+/* referenced[] bits */
+#define FSCK_NODE_LIVE       0x1     /* In use (inode != 0), not the root */
+#define FSCK_NODE_LINKED     0x2     /* Listed as a child by some node */
+
+/* The mapped filesystem, shared by all workers */
+typedef struct {
+    char data_dir[PATH_MAX];
+    struct nary_tree_mt tree;        /* Bound to nodes.dat (and strings.dat) */
+    bool have_strings;
+    struct data_log log;
+    bool have_log;
+    uint32_t used;                   /* Nodes scanned (header when mapped) */
+    uint32_t next;                   /* Next node to claim (atomic) */
+    uint8_t *referenced;             /* FSCK_NODE_* per node (atomic) */
+    uint32_t *listed_by;             /* A directory listing each node */
+    uint64_t *inodes;                /* inode << 32 | node, open addressing */
+    uint32_t inode_mask;
+} fsck_image;
+
+/* Per-thread results, summed once the scan is done */
+typedef struct {
+    fsck_image *img;
+    fsck_config *cfg;
+    pthread_t thread;
+    int tree_errors;
+    int inode_errors;
+    int string_errors;
+    int data_errors;
+    uint32_t nodes;
+    uint32_t files;
+    uint32_t logged_files;
+    uint32_t compressed_files;
+    uint32_t pending;                /* -o: names or data not yet written */
+    uint32_t changed;                /* -o: nodes that kept changing */
+    struct wal_repair_data *repairs;
+    uint32_t repair_count;
+    uint32_t repair_capacity;
+    bool out_of_memory;
+} fsck_worker;
+
 /* Forward declarations */
-static int check_tree_structure(struct nary_tree_mt *tree, fsck_config *cfg);
-static int check_inode_table(struct nary_tree_mt *tree, fsck_config *cfg);
-static int check_string_table(struct nary_tree_mt *tree, fsck_config *cfg);
-static int check_data_blocks(struct nary_tree_mt *tree, fsck_config *cfg);
+static int map_filesystem(fsck_image *img, fsck_config *cfg);
+static void unmap_filesystem(fsck_image *img);
+static int scan_nodes(fsck_image *img, fsck_config *cfg, fsck_worker **workers_out);
 static int check_wal_consistency(const char *wal_path, fsck_config *cfg);
+static int check_data_log(fsck_image *img, fsck_config *cfg);
+static int apply_repairs(fsck_image *img, fsck_worker *workers, fsck_config *cfg);
 static void print_usage(const char *prog);
 static void print_summary(fsck_config *cfg);
 
-/* Repair functions */
-static int repair_orphaned_node(struct nary_tree_mt *tree, uint16_t node_idx, fsck_config *cfg);
-static int repair_broken_child_link(struct nary_tree_mt *tree, uint16_t parent_idx, uint16_t broken_child, fsck_config *cfg);
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
 int main(int argc, char *argv[]) {
     fsck_config cfg = {
@@ -55,16 +124,18 @@ int main(int argc, char *argv[]) {
         .dry_run = false,
         .auto_repair = false,
         .verbose = false,
+        .online = false,
+        .threads = 0,
         .error_count = 0,
         .repair_count = 0
     };
-    
-    printf("razorfsck v0.1.0 - RAZORFS Filesystem Checker\n");
+
+    printf("razorfsck v0.2.0 - RAZORFS Filesystem Checker\n");
     printf("============================================\n\n");
-    
+
     /* Parse command line options */
     int opt;
-    while ((opt = getopt(argc, argv, "nyvh")) != -1) {
+    while ((opt = getopt(argc, argv, "nyvoj:h")) != -1) {
         switch (opt) {
             case 'n':
                 cfg.dry_run = true;
@@ -78,6 +149,20 @@ int main(int argc, char *argv[]) {
                 cfg.verbose = true;
                 printf("Mode: Verbose output\n");
                 break;
+            case 'o':
+                cfg.online = true;
+                printf("Mode: Online (read-only, filesystem may be mounted)\n");
+                break;
+            case 'j': {
+                long n = strtol(optarg, NULL, 10);
+                if (n < 1 || n > FSCK_MAX_THREADS) {
+                    fprintf(stderr, "Error: -j takes 1 to %d threads\n\n", FSCK_MAX_THREADS);
+                    print_usage(argv[0]);
+                    return 1;
+                }
+                cfg.threads = (unsigned int)n;
+                break;
+            }
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -86,319 +171,572 @@ int main(int argc, char *argv[]) {
                 return 1;
         }
     }
-    
+
     if (optind >= argc) {
         fprintf(stderr, "Error: Filesystem path required\n\n");
         print_usage(argv[0]);
         return 1;
     }
-    
+
+    if (cfg.online && cfg.auto_repair) {
+        fprintf(stderr, "Error: -o checks only; unmount to repair with -y\n");
+        return 1;
+    }
+
+    if (cfg.threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        cfg.threads = cpus < 1 ? 1 : (cpus > FSCK_MAX_THREADS ? FSCK_MAX_THREADS : (unsigned int)cpus);
+    }
+
     cfg.fs_path = argv[optind];
     printf("Checking filesystem: %s\n\n", cfg.fs_path);
-    
-    /* Initialize tree structure (read-only for now) */
-    struct nary_tree_mt tree;
-    memset(&tree, 0, sizeof(tree));
-    
-    printf("Phase 1: Loading filesystem...\n");
-    if (nary_tree_mt_init(&tree) != 0) {
-        fprintf(stderr, "ERROR: Failed to load filesystem\n");
+
+    /* Map the image (read-only unless repairing) */
+    fsck_image img;
+    memset(&img, 0, sizeof(img));
+
+    printf("Phase 1: Mapping filesystem...\n");
+    if (map_filesystem(&img, &cfg) != 0) {
+        fprintf(stderr, "ERROR: Failed to map filesystem\n");
         return 1;
     }
-    printf("  ✓ Loaded %u nodes\n\n", tree.used);
-    
-    /* Run checks */
-    printf("Phase 2: Checking tree structure...\n");
-    if (check_tree_structure(&tree, &cfg) != 0) {
-        fprintf(stderr, "  ✗ Tree structure check FAILED\n");
-    } else {
-        printf("  ✓ Tree structure OK\n");
-    }
-    
-    printf("\nPhase 3: Checking inode table...\n");
-    if (check_inode_table(&tree, &cfg) != 0) {
-        fprintf(stderr, "  ✗ Inode table check FAILED\n");
-    } else {
-        printf("  ✓ Inode table OK\n");
+    printf("  ✓ Mapped %u nodes (capacity %u)\n\n", img.used, img.tree.capacity);
+
+    /* Run the per-node checks in one parallel pass */
+    printf("Phase 2: Scanning nodes (%u threads)...\n", cfg.threads);
+    fsck_worker *workers = NULL;
+    if (scan_nodes(&img, &cfg, &workers) != 0) {
+        fprintf(stderr, "  ✗ Node scan could not run\n");
+        cfg.error_count++;
     }
-    
-    printf("\nPhase 4: Checking string table...\n");
-    if (check_string_table(&tree, &cfg) != 0) {
-        fprintf(stderr, "  ✗ String table check FAILED\n");
+
+    printf("\nPhase 3: Checking WAL consistency...\n");
+    if (check_wal_consistency(FSCK_WAL_PATH, &cfg) != 0) {
+        fprintf(stderr, "  ✗ WAL consistency check FAILED\n");
     } else {
-        printf("  ✓ String table OK\n");
+        printf("  ✓ WAL OK\n");
     }
-    
-    printf("\nPhase 5: Checking data blocks...\n");
-    if (check_data_blocks(&tree, &cfg) != 0) {
-        fprintf(stderr, "  ✗ Data block check FAILED\n");
+
+    printf("\nPhase 4: Checking data log block refcounts...\n");
+    if (check_data_log(&img, &cfg) != 0) {
+        fprintf(stderr, "  ✗ Data log check FAILED\n");
     } else {
-        printf("  ✓ Data blocks OK\n");
+        printf("  ✓ Data log OK\n");
     }
 
-    printf("\nPhase 6: Checking WAL consistency...\n");
-    if (check_wal_consistency("/tmp/razorfs_wal.log", &cfg) != 0) {
-        fprintf(stderr, "  ✗ WAL consistency check FAILED\n");
-    } else {
-        printf("  ✓ WAL OK\n");
+    /* Repairs found by the scan, all in one transaction */
+    uint32_t pending_repairs = 0;
+    for (unsigned int t = 0; workers && t < cfg.threads; t++) {
+        pending_repairs += workers[t].repair_count;
+    }
+    if (pending_repairs > 0) {
+        printf("\nPhase 5: Repairing %u links...\n", pending_repairs);
+        apply_repairs(&img, workers, &cfg);
     }
 
     /* Cleanup */
-    nary_tree_mt_destroy(&tree);
-    
+    for (unsigned int t = 0; workers && t < cfg.threads; t++) {
+        free(workers[t].repairs);
+    }
+    free(workers);
+    unmap_filesystem(&img);
+
     /* Print summary */
     print_summary(&cfg);
-    
+
     return cfg.error_count > 0 ? 1 : 0;
 }
 
-static int check_tree_structure(struct nary_tree_mt *tree, fsck_config *cfg) {
-    int errors = 0;
-    bool *visited = calloc(tree->used, sizeof(bool));
+/* === Mapping === */
 
-    if (!visited) {
-        fprintf(stderr, "  ERROR: Memory allocation failed\n");
-        return 1;
+static int map_filesystem(fsck_image *img, fsck_config *cfg) {
+    char path[PATH_MAX + 32];
+    snprintf(img->data_dir, sizeof(img->data_dir), "%s", cfg->fs_path);
+
+    /* The data log first: offline, its lock keeps a mount out until we
+     * are done; if a mount holds it, the check goes online */
+    snprintf(path, sizeof(path), "%s/data.log", img->data_dir);
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        if (!cfg->online && data_log_open(&img->log, path) == 0) {
+            img->have_log = true;
+        } else {
+            if (!cfg->online) {
+                printf("  Data log %s is in use: checking online (read-only)\n", path);
+                cfg->online = true;
+                cfg->auto_repair = false;
+            }
+            img->have_log = data_log_open_readonly(&img->log, path) == 0;
+            if (!img->have_log) {
+                printf("  Data log %s is unreadable - file data not checked\n", path);
+            }
+        }
     }
 
-    /* Check 1: Root node exists */
-    if (tree->used == 0) {
-        fprintf(stderr, "  ERROR: Empty tree (no root node)\n");
-        cfg->error_count++;
-        free(visited);
-        return 1;
+    snprintf(path, sizeof(path), "%s/nodes.dat", img->data_dir);
+    int writable = cfg->auto_repair && !cfg->dry_run && !cfg->online;
+    if (disk_tree_map(&img->tree, path, writable) != 0) {
+        fprintf(stderr, "  ERROR: %s is missing or not a tree image\n", path);
+        if (img->have_log) data_log_close(&img->log);
+        return -1;
     }
+    img->used = img->tree.used;
 
-    /* Check 2: Validate parent-child relationships */
-    for (uint16_t i = 0; i < tree->used; i++) {
-        struct nary_node_mt *node = &tree->nodes[i];
+    /* Names are checked against the string table as last persisted */
+    snprintf(path, sizeof(path), "%s/strings.dat", img->data_dir);
+    img->have_strings = disk_string_table_map(&img->tree.strings, path) == 0;
 
-        /* Check parent index validity */
-        if (i > 0 && node->node.parent_idx >= tree->used) {
-            fprintf(stderr, "  ERROR: Node %u has invalid parent %u (orphaned)\n",
-                    i, node->node.parent_idx);
-            cfg->error_count++;
-            errors++;
+    /* Workers stream through the node array in (roughly) ascending order */
+    madvise(img->tree.nodes, (size_t)img->used * sizeof(struct nary_node_mt), MADV_SEQUENTIAL);
 
-            /* Attempt repair if enabled */
-            if (cfg->auto_repair) {
-                if (repair_orphaned_node(tree, i, cfg) > 0) {
-                    printf("  ✓ Repaired orphaned node %u\n", i);
-                    errors--;  /* Repair successful */
-                }
-            }
-        }
+    /* Inode table: at most half full */
+    uint32_t slots = 64;
+    while (slots < 2 * (uint64_t)img->used) slots <<= 1;
+    img->inode_mask = slots - 1;
+    img->inodes = calloc(slots, sizeof(uint64_t));
+    img->referenced = calloc(img->used ? img->used : 1, 1);
+    img->listed_by = calloc(img->used ? img->used : 1, sizeof(uint32_t));
+    if (!img->inodes || !img->referenced || !img->listed_by) {
+        fprintf(stderr, "  ERROR: Memory allocation failed\n");
+        unmap_filesystem(img);
+        return -1;
+    }
+    return 0;
+}
 
-        /* Check children validity */
-        for (int c = 0; c < node->node.num_children; c++) {
-            uint16_t child = node->node.children[c];
-            if (child >= tree->used) {
-                fprintf(stderr, "  ERROR: Node %u has invalid child %u\n", i, child);
-                cfg->error_count++;
-                errors++;
-
-                /* Attempt repair if enabled */
-                if (cfg->auto_repair) {
-                    if (repair_broken_child_link(tree, i, child, cfg) > 0) {
-                        printf("  ✓ Repaired broken child link in node %u\n", i);
-                        errors--;  /* Repair successful */
-                    }
-                }
-            } else {
-                visited[child] = true;
-            }
-        }
+static void unmap_filesystem(fsck_image *img) {
+    free(img->inodes);
+    free(img->referenced);
+    free(img->listed_by);
+    img->inodes = NULL;
+    img->referenced = NULL;
+    img->listed_by = NULL;
+    disk_string_table_unmap(&img->tree.strings);
+    disk_tree_unmap(&img->tree);
+    if (img->have_log) {
+        data_log_close(&img->log);
+        img->have_log = false;
+    }
+}
 
-        /* Check branching factor limit */
-        if (node->node.num_children > NARY_BRANCHING_FACTOR) {
-            fprintf(stderr, "  ERROR: Node %u exceeds branching factor (%u > %u)\n",
-                    i, node->node.num_children, NARY_BRANCHING_FACTOR);
-            cfg->error_count++;
-            errors++;
+/* === Node scan === */
+
+/* Record inode -> node; returns the node that already has the inode, or
+ * NARY_INVALID_IDX (the same pair again is not a duplicate) */
+static uint32_t claim_inode(fsck_image *img, uint32_t inode, uint32_t idx) {
+    uint64_t entry = ((uint64_t)inode << 32) | idx;
+    uint32_t slot = (inode * 2654435761u) & img->inode_mask;
+    for (;; slot = (slot + 1) & img->inode_mask) {
+        uint64_t cur = __atomic_load_n(&img->inodes[slot], __ATOMIC_RELAXED);
+        if (cur == 0 &&
+            __atomic_compare_exchange_n(&img->inodes[slot], &cur, entry, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return NARY_INVALID_IDX;
+        }
+        if ((uint32_t)(cur >> 32) == inode) {
+            return (uint32_t)cur == idx ? NARY_INVALID_IDX : (uint32_t)cur;
         }
     }
+}
 
-    /* Check for orphaned nodes (nodes never referenced as children) */
-    int orphan_count = 0;
-    for (uint16_t i = 1; i < tree->used; i++) {  /* Skip root */
-        if (!visited[i]) {
-            orphan_count++;
-            if (cfg->verbose) {
-                fprintf(stderr, "  WARNING: Node %u is orphaned (not referenced)\n", i);
-            }
+static void add_repair(fsck_worker *w, const struct wal_repair_data *repair) {
+    if (w->repair_count == w->repair_capacity) {
+        uint32_t capacity = w->repair_capacity ? 2 * w->repair_capacity : 64;
+        struct wal_repair_data *grown = realloc(w->repairs, capacity * sizeof(*grown));
+        if (!grown) {
+            w->out_of_memory = true;
+            return;
         }
+        w->repairs = grown;
+        w->repair_capacity = capacity;
     }
+    w->repairs[w->repair_count++] = *repair;
+}
 
-    if (orphan_count > 0) {
-        printf("  Found %d orphaned nodes\n", orphan_count);
-    }
+static void check_file_data(fsck_worker *w, const struct nary_node *node, bool quiet,
+                            int *problems) {
+    fsck_image *img = w->img;
+    fsck_config *cfg = w->cfg;
 
-    if (cfg->verbose) {
-        printf("  Checked %u nodes\n", tree->used);
+    if (img->have_log && data_log_contains(&img->log, node->inode)) {
+        if (!quiet) w->logged_files++;
+        return;
     }
 
-    free(visited);
-    return errors;
-}
+    /* Older per-inode image, moved into the log when next read */
+    char filepath[PATH_MAX + 32];
+    snprintf(filepath, sizeof(filepath), "%s/file_%u", img->data_dir, node->inode);
+    struct stat st;
+    if (stat(filepath, &st) != 0) {
+        if (cfg->online) {
+            /* Written back within writeback_ms */
+            if (!quiet) w->pending++;
+            return;
+        }
+        (*problems)++;
+        if (!quiet) {
+            fprintf(stderr, "  ERROR: File inode %u has no data (not in the data log, no %s)\n",
+                    node->inode, filepath);
+            w->data_errors++;
+        }
+        return;
+    }
 
-static int check_inode_table(struct nary_tree_mt *tree, fsck_config *cfg) {
-    int errors = 0;
-    bool *seen_inodes = calloc(tree->used, sizeof(bool));
-    
-    if (!seen_inodes) {
-        fprintf(stderr, "  ERROR: Memory allocation failed\n");
-        return 1;
+    struct shm_file_header hdr;
+    int have_hdr = 0;
+    int fd = open(filepath, O_RDONLY);
+    if (fd >= 0) {
+        have_hdr = read(fd, &hdr, sizeof(hdr)) == (ssize_t)sizeof(hdr) &&
+                   hdr.magic == SHM_FILE_MAGIC;
+        close(fd);
     }
-    
-    /* Check for duplicate inodes */
-    for (uint16_t i = 0; i < tree->used; i++) {
-        uint32_t inode = tree->nodes[i].node.inode;
+    if (quiet) return;  /* Warnings only from here */
 
-        /* Inode 0 is reserved, valid inodes start at 1 */
-        if (inode == 0) {
-            fprintf(stderr, "  ERROR: Node %u has invalid inode 0\n", i);
-            cfg->error_count++;
-            errors++;
-            continue;
+    if (!have_hdr) {
+        fprintf(stderr, "  WARNING: File inode %u has an invalid data header\n", node->inode);
+    } else if (hdr.is_compressed != SHM_FILE_FORMAT_RAW) {
+        /* Compressed/blocked images are legitimately smaller than the file */
+        w->compressed_files++;
+        if (cfg->verbose) {
+            printf("    File inode %u: compressed (%zu bytes)\n",
+                   node->inode, (size_t)node->size);
         }
+    } else if ((size_t)st.st_size < sizeof(hdr) + node->size) {
+        fprintf(stderr, "  WARNING: File inode %u data truncated (expected %zu, got %ld)\n",
+                node->inode, (size_t)node->size, (long)(st.st_size - sizeof(hdr)));
+    }
+}
 
-        /* Check for inode reuse within tree size (approximate check) */
-        if (inode > tree->used * 2) {
-            if (cfg->verbose) {
-                printf("  INFO: Node %u has large inode %u (may be valid)\n", i, inode);
+/*
+ * Every per-node check on a copy of node i. Quiet runs only count the
+ * problems (used by -o to tell real ones from changes in flight); loud
+ * runs report them, count them and queue repairs. Marks in the shared
+ * tables are idempotent, so a node may be scanned more than once.
+ */
+static int check_node(fsck_worker *w, uint32_t i, const struct nary_node *node, bool quiet) {
+    fsck_image *img = w->img;
+    fsck_config *cfg = w->cfg;
+    struct nary_tree_mt *tree = &img->tree;
+    int problems = 0;
+
+    /* Tree structure: parent index */
+    if (i != NARY_ROOT_IDX && node->parent_idx >= img->used) {
+        problems++;
+        if (!quiet) {
+            fprintf(stderr, "  ERROR: Node %u has invalid parent %u (orphaned)\n",
+                    i, node->parent_idx);
+            w->tree_errors++;
+            if (cfg->dry_run) {
+                printf("  Would repair: orphaned node %u\n", i);
+            } else if (cfg->auto_repair) {
+                struct wal_repair_data repair = {
+                    .kind = WAL_REPAIR_REATTACH,
+                    .node_idx = i,
+                    .inode = node->inode,
+                    .parent_idx = NARY_INVALID_IDX,  /* Chosen after the scan */
+                    .child_idx = NARY_INVALID_IDX,
+                };
+                add_repair(w, &repair);
             }
         }
+    }
 
-        /* Check for duplicates among seen inodes */
-        for (uint16_t j = 0; j < i; j++) {
-            if (tree->nodes[j].node.inode == inode) {
-                fprintf(stderr, "  ERROR: Duplicate inode %u (nodes %u and %u)\n", inode, j, i);
-                cfg->error_count++;
-                errors++;
-                break;
+    /* Tree structure: children (wide directories keep them in a block tree) */
+    if (nary_child_check_mt(tree, node) != 0) {
+        problems++;
+        if (!quiet) {
+            fprintf(stderr, "  ERROR: Node %u has a corrupt child block tree\n", i);
+            w->tree_errors++;
+        }
+    } else {
+        struct nary_child_iter it;
+        nary_child_iter_init(&it, tree, node);
+        for (uint32_t c = 0; c < node->num_children; c++) {
+            uint32_t child = nary_child_iter_next(&it);
+            if (child < img->used) {
+                __atomic_fetch_or(&img->referenced[child], FSCK_NODE_LINKED, __ATOMIC_RELAXED);
+                __atomic_store_n(&img->listed_by[child], i, __ATOMIC_RELAXED);
+                continue;
+            }
+            problems++;
+            if (quiet) continue;
+            fprintf(stderr, "  ERROR: Node %u has invalid child %u\n", i, child);
+            w->tree_errors++;
+            if (cfg->dry_run) {
+                printf("  Would repair: remove broken child %u from parent %u\n", child, i);
+            } else if (cfg->auto_repair) {
+                struct wal_repair_data repair = {
+                    .kind = WAL_REPAIR_UNLINK,
+                    .node_idx = NARY_INVALID_IDX,
+                    .inode = 0,
+                    .parent_idx = i,
+                    .child_idx = child,
+                };
+                add_repair(w, &repair);
             }
         }
-        
-        /* Check mode validity */
-        if (!S_ISREG(tree->nodes[i].node.mode) && 
-            !S_ISDIR(tree->nodes[i].node.mode)) {
-            fprintf(stderr, "  WARNING: Node %u has unusual mode 0x%x\n",
-                    i, tree->nodes[i].node.mode);
+    }
+
+    /* Inode table */
+    uint32_t other = claim_inode(img, node->inode, i);
+    if (other != NARY_INVALID_IDX &&
+        (!cfg->online || __atomic_load_n(&tree->nodes[other].node.inode, __ATOMIC_RELAXED) ==
+                         node->inode)) {
+        problems++;
+        if (!quiet) {
+            fprintf(stderr, "  ERROR: Duplicate inode %u (nodes %u and %u)\n",
+                    node->inode, other < i ? other : i, other < i ? i : other);
+            w->inode_errors++;
         }
     }
-    
-    free(seen_inodes);
-    
-    if (cfg->verbose) {
-        printf("  Checked %u inodes\n", tree->used);
+    if (!quiet) {
+        if (cfg->verbose && node->inode > img->used * 2) {
+            printf("  INFO: Node %u has large inode %u (may be valid)\n", i, node->inode);
+        }
+        if (!S_ISREG(node->mode) && !S_ISDIR(node->mode)) {
+            fprintf(stderr, "  WARNING: Node %u has unusual mode 0x%x\n", i, node->mode);
+        }
     }
-    
-    return errors;
-}
 
-static int check_string_table(struct nary_tree_mt *tree, fsck_config *cfg) {
-    int errors = 0;
+    /* String table */
+    if (img->have_strings) {
+        const struct string_table *strings = &tree->strings;
+        const char *name = string_table_get(strings, node->name_offset);
+        if (!name) {
+            if (cfg->online) {
+                /* Named since strings.dat was last synced */
+                if (!quiet) w->pending++;
+            } else {
+                problems++;
+                if (!quiet) {
+                    fprintf(stderr, "  ERROR: Node %u has invalid name offset %u\n",
+                            i, node->name_offset);
+                    w->string_errors++;
+                }
+            }
+        } else if (!memchr(name, '\0', strings->used - node->name_offset)) {
+            problems++;
+            if (!quiet) {
+                fprintf(stderr, "  ERROR: Node %u has corrupted string at offset %u\n",
+                        i, node->name_offset);
+                w->string_errors++;
+            }
+        } else if (!quiet && cfg->verbose && i < 10) {
+            /* Show first 10 names in verbose mode */
+            printf("    Node %u: '%s' (offset %u)\n", i, name, node->name_offset);
+        }
+    }
 
-    /* Check string table validity */
-    if (tree->strings.data == NULL) {
-        fprintf(stderr, "  ERROR: String table not initialized\n");
-        cfg->error_count++;
-        return 1;
+    /* Data blocks */
+    if (!S_ISDIR(node->mode)) {
+        if (!quiet) w->files++;
+        if (node->size > 0) {
+            check_file_data(w, node, quiet, &problems);
+        }
     }
 
-    /* Verify all name offsets are valid */
-    for (uint16_t i = 0; i < tree->used; i++) {
-        uint32_t offset = tree->nodes[i].node.name_offset;
+    return problems;
+}
 
-        if (offset >= tree->strings.used) {
-            fprintf(stderr, "  ERROR: Node %u has invalid name offset %u\n", i, offset);
-            cfg->error_count++;
-            errors++;
-        } else {
-            /* Verify string is null-terminated */
-            const char *name = string_table_get(&tree->strings, offset);
-            if (name == NULL) {
-                fprintf(stderr, "  ERROR: Node %u has corrupted string at offset %u\n", i, offset);
-                cfg->error_count++;
-                errors++;
-            } else if (cfg->verbose && i < 10) {
-                /* Show first 10 names in verbose mode */
-                printf("    Node %u: '%s' (offset %u)\n", i, name, offset);
+static void *scan_worker(void *arg) {
+    fsck_worker *w = arg;
+    fsck_image *img = w->img;
+
+    for (;;) {
+        uint32_t first = __atomic_fetch_add(&img->next, FSCK_CHUNK_NODES, __ATOMIC_RELAXED);
+        if (first >= img->used) break;
+        uint32_t end = img->used - first < FSCK_CHUNK_NODES ? img->used : first + FSCK_CHUNK_NODES;
+
+        for (uint32_t i = first; i < end; i++) {
+            const struct nary_node *live = &img->tree.nodes[i].node;
+            struct nary_node node;
+            memcpy(&node, live, sizeof(node));
+
+            /* Free slot */
+            if (node.inode == 0) continue;
+
+            /* Online, a failing node must fail the same way twice in a row */
+            int tries = 0;
+            while (w->cfg->online && check_node(w, i, &node, true) > 0 &&
+                   tries < FSCK_ONLINE_RETRIES) {
+                struct nary_node again;
+                memcpy(&again, live, sizeof(again));
+                if (memcmp(&again, &node, sizeof(node)) == 0) break;
+                node = again;
+                tries++;
+            }
+            if (tries == FSCK_ONLINE_RETRIES) {
+                w->changed++;
+                continue;
             }
+            if (node.inode == 0) continue;  /* Freed meanwhile */
+
+            if (i != NARY_ROOT_IDX) {
+                __atomic_fetch_or(&img->referenced[i], FSCK_NODE_LIVE, __ATOMIC_RELAXED);
+            }
+            check_node(w, i, &node, false);
+            w->nodes++;
         }
     }
+    return NULL;
+}
 
-    if (cfg->verbose) {
-        printf("  String table size: %u / %u bytes used\n", tree->strings.used, tree->strings.capacity);
+static int scan_nodes(fsck_image *img, fsck_config *cfg, fsck_worker **workers_out) {
+    /* Check 1: Root node exists */
+    if (img->used == 0) {
+        fprintf(stderr, "  ERROR: Empty tree (no root node)\n");
+        cfg->error_count++;
+        return 0;
     }
 
-    return errors;
-}
+    unsigned int threads = cfg->threads;
+    fsck_worker *workers = calloc(threads, sizeof(*workers));
+    if (!workers) {
+        fprintf(stderr, "  ERROR: Memory allocation failed\n");
+        return -1;
+    }
+    *workers_out = workers;
 
-static int check_data_blocks(struct nary_tree_mt *tree, fsck_config *cfg) {
-    int errors = 0;
-    int files_checked = 0;
-    int compressed_files = 0;
+    double start = now_seconds();
+    for (unsigned int t = 0; t < threads; t++) {
+        workers[t].img = img;
+        workers[t].cfg = cfg;
+    }
+    /* Thread 0 is this one; workers that cannot start leave their share
+     * to the others (the cursor is shared) */
+    bool *started = calloc(threads, sizeof(bool));
+    for (unsigned int t = 1; started && t < threads; t++) {
+        started[t] = pthread_create(&workers[t].thread, NULL, scan_worker, &workers[t]) == 0;
+    }
+    scan_worker(&workers[0]);
+    for (unsigned int t = 1; started && t < threads; t++) {
+        if (started[t]) pthread_join(workers[t].thread, NULL);
+    }
+    free(started);
+    double elapsed = now_seconds() - start;
 
-    /* Check all regular files */
-    for (uint16_t i = 0; i < tree->used; i++) {
-        struct nary_node_mt *node = &tree->nodes[i];
+    fsck_worker sum;
+    memset(&sum, 0, sizeof(sum));
+    for (unsigned int t = 0; t < threads; t++) {
+        sum.tree_errors += workers[t].tree_errors;
+        sum.inode_errors += workers[t].inode_errors;
+        sum.string_errors += workers[t].string_errors;
+        sum.data_errors += workers[t].data_errors;
+        sum.nodes += workers[t].nodes;
+        sum.files += workers[t].files;
+        sum.logged_files += workers[t].logged_files;
+        sum.compressed_files += workers[t].compressed_files;
+        sum.pending += workers[t].pending;
+        sum.changed += workers[t].changed;
+        sum.out_of_memory |= workers[t].out_of_memory;
+    }
 
-        /* Skip directories */
-        if (S_ISDIR(node->node.mode)) {
-            continue;
+    /* An orphan still listed by a directory only lost its parent index;
+     * the others go under the root */
+    for (unsigned int t = 0; t < threads; t++) {
+        for (uint32_t r = 0; r < workers[t].repair_count; r++) {
+            struct wal_repair_data *repair = &workers[t].repairs[r];
+            if (repair->kind == WAL_REPAIR_REATTACH) {
+                repair->parent_idx = img->referenced[repair->node_idx] & FSCK_NODE_LINKED
+                    ? img->listed_by[repair->node_idx] : NARY_ROOT_IDX;
+            }
         }
+    }
 
-        files_checked++;
+    /* Orphaned nodes: in use but never referenced as a child */
+    int orphan_count = 0;
+    for (uint32_t i = 1; i < img->used; i++) {
+        if (img->referenced[i] == FSCK_NODE_LIVE) {
+            orphan_count++;
+            if (cfg->verbose) {
+                fprintf(stderr, "  WARNING: Node %u is orphaned (not referenced)\n", i);
+            }
+        }
+    }
 
-        /* Check if file has data */
-        if (node->node.size > 0) {
-            /* Try to access file data through shm_persist */
-            char filepath[512];
-            snprintf(filepath, sizeof(filepath), "/var/lib/razorfs/file_%u", node->node.inode);
+    printf("  Scanned %u nodes in %.2f s\n", sum.nodes, elapsed);
+    if (orphan_count > 0) {
+        printf("  Found %d orphaned nodes\n", orphan_count);
+    }
+    if (sum.changed > 0) {
+        printf("  %u nodes kept changing during the scan (not checked)\n", sum.changed);
+    }
+    if (sum.pending > 0) {
+        printf("  %u names or file contents not yet written back (mounted)\n", sum.pending);
+    }
+    if (sum.out_of_memory) {
+        fprintf(stderr, "  ERROR: Out of memory queueing repairs (some are missing)\n");
+        cfg->error_count++;
+    }
 
-            /* Check if file exists */
-            struct stat st;
-            if (stat(filepath, &st) == 0) {
-                /* File exists, verify size consistency */
-                if ((size_t)st.st_size < node->node.size) {
-                    fprintf(stderr, "  WARNING: File inode %u data truncated (expected %zu, got %ld)\n",
-                            node->node.inode, node->node.size, st.st_size);
-                }
+    printf(sum.tree_errors ? "" : "  ✓ Tree structure OK\n");
+    if (sum.tree_errors) fprintf(stderr, "  ✗ Tree structure check FAILED\n");
+    printf(sum.inode_errors ? "" : "  ✓ Inode table OK\n");
+    if (sum.inode_errors) fprintf(stderr, "  ✗ Inode table check FAILED\n");
+    if (!img->have_strings) {
+        fprintf(stderr, "  ERROR: String table %s/strings.dat missing or invalid\n", img->data_dir);
+        fprintf(stderr, "  ✗ String table check FAILED\n");
+        cfg->error_count++;
+    } else if (sum.string_errors) {
+        fprintf(stderr, "  ✗ String table check FAILED\n");
+    } else {
+        printf("  ✓ String table OK\n");
+    }
+    printf(sum.data_errors ? "" : "  ✓ Data blocks OK\n");
+    if (sum.data_errors) fprintf(stderr, "  ✗ Data block check FAILED\n");
 
-                /* Check compression header if file is large enough */
-                if (node->node.size >= 16) {  /* Minimum size for compression header */
-                    int fd = open(filepath, O_RDONLY);
-                    if (fd >= 0) {
-                        uint32_t magic;
-                        if (read(fd, &magic, sizeof(magic)) == sizeof(magic)) {
-                            /* Check for RAZORFS compression magic */
-                            if (magic == COMPRESSION_MAGIC) {
-                                compressed_files++;
-                                if (cfg->verbose) {
-                                    printf("    File inode %u: compressed (%zu bytes)\n",
-                                           node->node.inode, node->node.size);
-                                }
-                            }
-                        }
-                        close(fd);
-                    }
-                }
-            } else if (node->node.size > 0) {
-                /* File data missing */
-                fprintf(stderr, "  ERROR: File inode %u missing data file (%s)\n",
-                        node->node.inode, filepath);
-                cfg->error_count++;
-                errors++;
-            }
+    if (cfg->verbose) {
+        printf("  Checked %u nodes, %u files (%u in the data log, %u compressed images)\n",
+               sum.nodes, sum.files, sum.logged_files, sum.compressed_files);
+        if (img->have_strings) {
+            printf("  String table size: %u / %u bytes used\n",
+                   img->tree.strings.used, img->tree.strings.capacity);
         }
     }
 
-    if (cfg->verbose) {
-        printf("  Checked %d files (%d compressed)\n", files_checked, compressed_files);
+    cfg->error_count += sum.tree_errors + sum.inode_errors + sum.string_errors + sum.data_errors;
+    return 0;
+}
+
+/* === WAL === */
+
+/* Map the segments of a segmented log back to back, read-only, at
+ * wal->log_buffer; reports why not on failure */
+static int map_wal_segments(const char *wal_path, struct wal *wal) {
+    wal->segment_count = wal->header->segment_count;
+    wal->segment_size = wal->header->segment_size;
+    wal->buffer_size = (size_t)wal->segment_count * wal->segment_size;
+    if (wal->segment_count > WAL_MAX_SEGMENTS || wal->segment_size == 0) {
+        fprintf(stderr, "  ERROR: Bad WAL segment layout (%u x %zu)\n",
+                wal->segment_count, wal->segment_size);
+        return -1;
     }
 
-    return errors;
+    void *range = mmap(NULL, wal->buffer_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (range == MAP_FAILED) {
+        fprintf(stderr, "  ERROR: Cannot map WAL segments of %s\n", wal_path);
+        return -1;
+    }
+    wal->log_buffer = (char *)range;
+
+    for (uint32_t i = 0; i < wal->segment_count; i++) {
+        char path[PATH_MAX];
+        struct stat st;
+        int fd = wal_segment_path(path, sizeof(path), wal_path, i) == 0
+            ? open(path, O_RDONLY) : -1;
+        int ok = fd >= 0 && fstat(fd, &st) == 0 && st.st_size == (off_t)wal->segment_size &&
+                 mmap(wal->log_buffer + (size_t)i * wal->segment_size, wal->segment_size,
+                      PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED;
+        if (fd >= 0) close(fd);
+        if (!ok) {
+            fprintf(stderr, "  ERROR: WAL segment %s is missing or truncated\n", path);
+            munmap(range, wal->buffer_size);
+            wal->log_buffer = NULL;
+            return -1;
+        }
+    }
+    return 0;
 }
 
 static int check_wal_consistency(const char *wal_path, fsck_config *cfg) {
@@ -413,59 +751,296 @@ static int check_wal_consistency(const char *wal_path, fsck_config *cfg) {
         return 0;
     }
 
-    /* Open and validate WAL */
-    FILE *wal_file = fopen(wal_path, "rb");
-    if (!wal_file) {
+    if (st.st_size < (off_t)sizeof(struct wal_header)) {
+        fprintf(stderr, "  ERROR: WAL file %s is truncated\n", wal_path);
+        cfg->error_count++;
+        return 1;
+    }
+
+    /* Open and map WAL read-only */
+    int fd = open(wal_path, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, "  ERROR: Cannot open WAL file %s\n", wal_path);
         cfg->error_count++;
         return 1;
     }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "  ERROR: Cannot map WAL file %s\n", wal_path);
+        cfg->error_count++;
+        return 1;
+    }
 
-    /* Read WAL header */
-    struct wal_header {
-        uint32_t magic;
-        uint32_t version;
-        uint64_t tx_count;
-    } header;
+    struct wal wal;
+    memset(&wal, 0, sizeof(wal));
+    wal.header = (struct wal_header *)addr;
+    wal.log_buffer = (char *)addr + sizeof(struct wal_header);
+    wal.buffer_size = st.st_size - sizeof(struct wal_header);
+    wal.fd = -1;
 
-    if (fread(&header, sizeof(header), 1, wal_file) != 1) {
-        fprintf(stderr, "  ERROR: Cannot read WAL header\n");
+    const struct wal_header *header = wal.header;
+    if (header->magic != WAL_MAGIC) {
+        fprintf(stderr, "  ERROR: Bad WAL magic 0x%08x\n", header->magic);
+        cfg->error_count++;
+        munmap(addr, st.st_size);
+        return 1;
+    }
+
+    /* Every format is checked with the checksum it was written with */
+    if (header->version < WAL_VERSION_CRC32 || header->version > WAL_VERSION) {
+        fprintf(stderr, "  ERROR: Unknown WAL version %u\n", header->version);
+        cfg->error_count++;
+        munmap(addr, st.st_size);
+        return 1;
+    }
+    wal.version = header->version;
+
+    uint32_t header_checksum = wal_checksum(&wal, header, offsetof(struct wal_header, checksum));
+    if (header->segment_count != 0) {
+        /* Segmented logs also cover their geometry */
+        header_checksum = crc32c(header_checksum, &header->segment_count, 2 * sizeof(uint32_t));
+    }
+    if (header_checksum != header->checksum) {
+        if (cfg->online) {
+            /* Rewritten by the mount while we read it */
+            printf("  WAL header changed while reading - skipped\n");
+            munmap(addr, st.st_size);
+            return 0;
+        }
+        fprintf(stderr, "  ERROR: WAL header checksum mismatch\n");
         cfg->error_count++;
-        fclose(wal_file);
+        munmap(addr, st.st_size);
         return 1;
     }
 
-    /* Validate header magic (simplified check) */
     if (cfg->verbose) {
-        printf("  WAL file size: %ld bytes\n", st.st_size);
-        printf("  WAL transactions: %lu\n", (unsigned long)header.tx_count);
+        printf("  WAL file size: %ld bytes\n", (long)st.st_size);
+        printf("  WAL version: %u (%s)\n", header->version,
+               header->version != WAL_VERSION_CRC32 ? "CRC32C" : "CRC32");
+        printf("  WAL next transaction: %lu\n", (unsigned long)header->next_tx_id);
+    }
+
+    if (header->segment_count != 0) {
+        if (map_wal_segments(wal_path, &wal) != 0) {
+            cfg->error_count++;
+            munmap(addr, st.st_size);
+            return 1;
+        }
+        if (cfg->verbose) {
+            printf("  WAL segments: %u x %zu bytes\n", wal.segment_count, wal.segment_size);
+        }
+    }
+
+    /* Walk the live region [tail, head) and validate every entry */
+    uint64_t offset = header->tail_offset;
+    uint64_t head = header->head_offset;
+    uint32_t entry_count = 0;
+    if (offset == wal.buffer_size && head != offset) {
+        offset = 0;  /* Checkpoint ended exactly at the end of the buffer */
     }
+    while (offset != head && offset < wal.buffer_size) {
+        const struct wal_entry *entry = NULL;
+        if (offset + sizeof(struct wal_entry) <= wal.buffer_size) {
+            entry = (const struct wal_entry *)(wal.log_buffer + offset);
+            if (offset + sizeof(struct wal_entry) + entry->data_len > wal.buffer_size ||
+                wal_entry_checksum(&wal, entry, entry->data, entry->data_len) != entry->checksum) {
+                entry = NULL;
+            }
+        }
+
+        if (!entry) {
+            if (head < offset && offset != 0) {
+                /* Writer wrapped early: the entry did not fit at the end */
+                offset = 0;
+                continue;
+            }
+            if (cfg->online) {
+                /* Appended or reclaimed by the mount while we read */
+                if (cfg->verbose) {
+                    printf("  WAL changed at offset %lu while reading\n", (unsigned long)offset);
+                }
+                break;
+            }
+            fprintf(stderr, "  ERROR: Corrupt WAL entry at offset %lu\n",
+                    (unsigned long)offset);
+            errors++;
+            cfg->error_count++;
+            break;
+        }
 
-    /* Count entries in WAL */
-    int entry_count = 0;
-    char buffer[1024];
-    while (fread(buffer, 1, sizeof(buffer), wal_file) > 0) {
         entry_count++;
+        offset += sizeof(struct wal_entry) + entry->data_len;
+        if (offset >= wal.buffer_size) {
+            offset = 0;
+        }
     }
 
     if (cfg->verbose && entry_count > 0) {
-        printf("  WARNING: WAL has %d pending entries (unclean shutdown?)\n", entry_count);
+        printf("  WARNING: WAL has %u pending entries (%s)\n", entry_count,
+               cfg->online ? "mounted" : "unclean shutdown?");
     }
 
-    fclose(wal_file);
+    if (wal.segment_count != 0) {
+        munmap(wal.log_buffer, wal.buffer_size);
+    }
+    munmap(addr, st.st_size);
     return errors;
 }
 
+/* === Data log === */
+
+static int check_data_log(fsck_image *img, fsck_config *cfg) {
+    if (!img->have_log) {
+        if (cfg->verbose) {
+            printf("  No data log found\n");
+        }
+        return 0;
+    }
+
+    /* Opening replayed the records and checked every CRC; the payloads are
+     * rehashed in parallel */
+    struct data_log_verify_report report;
+    int64_t problems = data_log_verify_parallel(&img->log, &report, cfg->threads);
+    struct data_log_dedup_stats stats;
+    data_log_dedup_stats(&img->log, &stats);
+
+    if (problems < 0) {
+        fprintf(stderr, "  ERROR: Out of memory verifying %s/data.log\n", img->data_dir);
+        cfg->error_count++;
+        return 1;
+    }
+    if (report.bad_refcounts > 0) {
+        fprintf(stderr, "  ERROR: %lu blocks with a wrong refcount\n",
+                (unsigned long)report.bad_refcounts);
+    }
+    if (report.bad_payloads > 0) {
+        fprintf(stderr, "  ERROR: %lu blocks outside the log or changed\n",
+                (unsigned long)report.bad_payloads);
+    }
+    if (report.mismatched_refs > 0) {
+        fprintf(stderr, "  ERROR: %lu refs disagree with the block they share\n",
+                (unsigned long)report.mismatched_refs);
+    }
+    cfg->error_count += (int)problems;
+
+    if (cfg->verbose) {
+        printf("  %lu chunk refs in %lu blocks (%lu shared, %lu KB saved)\n",
+               (unsigned long)report.refs, (unsigned long)report.blocks,
+               (unsigned long)stats.shared_blocks, (unsigned long)(stats.saved_bytes / 1024));
+    }
+    return problems > 0 ? (int)problems : 0;
+}
+
+/* === Repairs === */
+
+/*
+ * Log every queued repair in one WAL transaction, then apply them to the
+ * image. If we stop after the commit, the next mount redoes them (each
+ * skips itself if it is already in place); the log is emptied once the
+ * image is synced.
+ */
+static int apply_repairs(fsck_image *img, fsck_worker *workers, fsck_config *cfg) {
+    struct nary_tree_mt *tree = &img->tree;
+
+    struct wal wal;
+    memset(&wal, 0, sizeof(wal));
+    if (wal_init_file(&wal, FSCK_WAL_PATH, WAL_DEFAULT_SIZE) != 0) {
+        fprintf(stderr, "  ERROR: Cannot open WAL %s - no repairs made\n", FSCK_WAL_PATH);
+        return -1;
+    }
+    /* Ending in a checkpoint is a clean unmount; anything else is the
+     * mount's to replay, against the image as it was */
+    const struct wal_header *wh = wal.header;
+    if (wal_needs_recovery(&wal) &&
+        (wh->checkpoint_lsn == 0 || wh->checkpoint_lsn + 1 != wh->next_lsn)) {
+        fprintf(stderr, "  ERROR: WAL %s has changes to replay - mount once, then repair\n",
+                FSCK_WAL_PATH);
+        wal_destroy(&wal);
+        return -1;
+    }
+
+    /* Only the leaves being changed need fingerprints (they never reach
+     * the image), so they start out empty instead of being recomputed */
+    tree->block_fp = calloc(tree->block_capacity ? tree->block_capacity : 1,
+                            sizeof(struct nary_child_fp));
+    if (!tree->block_fp || !img->have_strings) {
+        fprintf(stderr, "  ERROR: %s - no repairs made\n",
+                tree->block_fp ? "Repairs need the string table" : "Memory allocation failed");
+        wal_destroy(&wal);
+        return -1;
+    }
+    pthread_rwlock_init(&tree->tree_lock, NULL);
+
+    uint64_t tx_id;
+    int ret = wal_begin_tx(&wal, &tx_id);
+    for (unsigned int t = 0; ret == 0 && t < cfg->threads; t++) {
+        for (uint32_t r = 0; ret == 0 && r < workers[t].repair_count; r++) {
+            ret = wal_log_repair(&wal, tx_id, &workers[t].repairs[r]);
+        }
+    }
+    if (ret == 0) ret = wal_commit_tx(&wal, tx_id);
+    if (ret == 0) ret = wal_sync(&wal);
+    if (ret != 0) {
+        fprintf(stderr, "  ERROR: Cannot log repairs in %s - no repairs made\n", FSCK_WAL_PATH);
+        pthread_rwlock_destroy(&tree->tree_lock);
+        wal_destroy(&wal);
+        return -1;
+    }
+
+    /* Lock words in the image may be stale after a crash; nobody else has
+     * it open (we hold the data log lock) */
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+
+    for (unsigned int t = 0; t < cfg->threads; t++) {
+        for (uint32_t r = 0; r < workers[t].repair_count; r++) {
+            const struct wal_repair_data *repair = &workers[t].repairs[r];
+            if (repair->parent_idx < tree->used) {
+                pthread_rwlock_init(&tree->nodes[repair->parent_idx].lock, &attr);
+            }
+            int applied = nary_repair_link_mt(tree, repair);
+            if (applied == 0) {
+                cfg->repair_count++;
+                cfg->error_count--;
+                if (repair->kind == WAL_REPAIR_REATTACH) {
+                    printf("  ✓ Repaired orphaned node %u (reconnected to node %u)\n",
+                           repair->node_idx, repair->parent_idx);
+                } else {
+                    printf("  ✓ Repaired broken child link %u in node %u\n",
+                           repair->child_idx, repair->parent_idx);
+                }
+            } else if (applied < 0) {
+                fprintf(stderr, "  ERROR: Cannot repair %s %u (directory full or gone)\n",
+                        repair->kind == WAL_REPAIR_REATTACH ? "orphaned node" : "link in node",
+                        repair->kind == WAL_REPAIR_REATTACH ? repair->node_idx : repair->parent_idx);
+            }
+        }
+    }
+    pthread_rwlockattr_destroy(&attr);
+    pthread_rwlock_destroy(&tree->tree_lock);
+
+    /* Image on disk first, then the log can go (nothing else was in it) */
+    disk_tree_unmap(tree);
+    wal_reset(&wal);
+    wal_destroy(&wal);
+    return 0;
+}
+
 static void print_usage(const char *prog) {
-    printf("Usage: %s [OPTIONS] <filesystem_path>\n\n", prog);
+    printf("Usage: %s [OPTIONS] <data_directory>\n\n", prog);
     printf("Options:\n");
     printf("  -n        Dry run (check only, no repairs)\n");
     printf("  -y        Auto-repair without prompting\n");
+    printf("  -o        Online: read-only check of a mounted filesystem\n");
+    printf("  -j N      Worker threads (default: one per CPU, max %d)\n", FSCK_MAX_THREADS);
     printf("  -v        Verbose output\n");
     printf("  -h        Show this help message\n\n");
     printf("Examples:\n");
     printf("  %s -n /var/lib/razorfs           # Check only\n", prog);
     printf("  %s -y /var/lib/razorfs           # Auto-repair\n", prog);
+    printf("  %s -o /var/lib/razorfs           # Check while mounted\n", prog);
     printf("  %s -v -n /var/lib/razorfs        # Verbose check\n\n", prog);
 }
 
@@ -474,87 +1049,25 @@ static void print_summary(fsck_config *cfg) {
     printf("========================================\n");
     printf("FSCK Summary\n");
     printf("========================================\n");
-    printf("Errors found:    %d\n", cfg->error_count);
+    printf("Errors found:    %d\n", cfg->error_count + cfg->repair_count);
     printf("Repairs made:    %d\n", cfg->repair_count);
-    
-    if (cfg->dry_run) {
+
+    if (cfg->online) {
+        printf("Mode:            Online (read-only)\n");
+    } else if (cfg->dry_run) {
         printf("Mode:            Dry run (no changes made)\n");
     } else if (cfg->auto_repair) {
         printf("Mode:            Auto-repair\n");
     }
-    
+
     printf("\n");
-    
+
     if (cfg->error_count == 0) {
         printf("✓ Filesystem is CLEAN\n");
     } else {
         printf("✗ Filesystem has ERRORS\n");
-        if (cfg->dry_run) {
-            printf("  Run with -y to repair\n");
-        }
-    }
-}
-
-/* Repair function implementations */
-
-static int repair_orphaned_node(struct nary_tree_mt *tree, uint16_t node_idx, fsck_config *cfg) {
-    if (cfg->dry_run) {
-        printf("  Would repair: orphaned node %u\n", node_idx);
-        return 0;
-    }
-
-    // Attempt to reconnect orphaned node to root
-    if (node_idx >= tree->used) return -1;
-
-    struct nary_node_mt *node = &tree->nodes[node_idx];
-
-    // Check if already has valid parent
-    if (node->node.parent_idx < tree->used &&
-        node->node.parent_idx != NARY_INVALID_IDX) {
-        return 0;  // Not orphaned
-    }
-
-    // Try to attach to root (if space available)
-    struct nary_node_mt *root = &tree->nodes[NARY_ROOT_IDX];
-    if (root->node.num_children < NARY_BRANCHING_FACTOR) {
-        root->node.children[root->node.num_children++] = node_idx;
-        node->node.parent_idx = NARY_ROOT_IDX;
-        cfg->repair_count++;
-        if (cfg->verbose) {
-            printf("  Repaired: reconnected orphaned node %u to root\n", node_idx);
-        }
-        return 1;  // Repaired
-    }
-
-    return -1;  // Cannot repair (root full)
-}
-
-static int repair_broken_child_link(struct nary_tree_mt *tree, uint16_t parent_idx, uint16_t broken_child, fsck_config *cfg) {
-    if (cfg->dry_run) {
-        printf("  Would repair: remove broken child %u from parent %u\n", broken_child, parent_idx);
-        return 0;
-    }
-
-    // Remove broken child reference from parent
-    if (parent_idx >= tree->used) return -1;
-
-    struct nary_node_mt *parent = &tree->nodes[parent_idx];
-
-    // Find and remove broken child
-    for (int i = 0; i < parent->node.num_children; i++) {
-        if (parent->node.children[i] == broken_child) {
-            // Shift remaining children
-            for (int j = i; j < parent->node.num_children - 1; j++) {
-                parent->node.children[j] = parent->node.children[j + 1];
-            }
-            parent->node.num_children--;
-            cfg->repair_count++;
-            if (cfg->verbose) {
-                printf("  Repaired: removed broken child %u from parent %u\n", broken_child, parent_idx);
-            }
-            return 1;  // Repaired
+        if (cfg->dry_run || cfg->online) {
+            printf("  Run with -y%s to repair\n", cfg->online ? " (unmounted)" : "");
         }
     }
-
-    return 0;  // Child not found
 }